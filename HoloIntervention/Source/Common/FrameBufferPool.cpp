@@ -0,0 +1,212 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "FrameBufferPool.h"
+
+// STL includes
+#include <algorithm>
+#include <cstdlib>
+
+// OS includes
+#if defined(_WIN32)
+  #include <malloc.h>
+#endif
+
+namespace HoloIntervention
+{
+  const size_t FrameBufferPool::ALIGNMENT = 64;
+  const size_t FrameBufferPool::MIN_SIZE_CLASS = 4096;
+  const uint64_t FrameBufferPool::DEFAULT_MAX_POOLED_BYTES = 256ull * 1024 * 1024;
+
+  //----------------------------------------------------------------------------
+  FrameBufferPool& FrameBufferPool::instance()
+  {
+    static FrameBufferPool instance;
+    return instance;
+  }
+
+  //----------------------------------------------------------------------------
+  std::shared_ptr<uint8_t> FrameBufferPool::Acquire(size_t size)
+  {
+    const size_t sizeClass = GetSizeClass(size);
+    uint8_t* buffer(nullptr);
+    {
+      std::lock_guard<std::mutex> guard(m_state->Mutex);
+      m_state->Stats.Acquisitions++;
+
+      auto iter = m_state->FreeLists.find(sizeClass);
+      if (iter != m_state->FreeLists.end() && !iter->second.empty())
+      {
+        buffer = iter->second.back();
+        iter->second.pop_back();
+        m_state->Stats.Hits++;
+        m_state->Stats.PooledBytes -= sizeClass;
+      }
+      else
+      {
+        m_state->Stats.Misses++;
+      }
+
+      m_state->Stats.OutstandingBytes += sizeClass;
+      m_state->Stats.HighWaterBytes = std::max(m_state->Stats.HighWaterBytes, m_state->Stats.OutstandingBytes + m_state->Stats.PooledBytes);
+    }
+
+    if (buffer == nullptr)
+    {
+      buffer = AllocateAligned(sizeClass);
+      if (buffer == nullptr)
+      {
+        std::lock_guard<std::mutex> guard(m_state->Mutex);
+        m_state->Stats.OutstandingBytes -= sizeClass;
+        throw std::bad_alloc();
+      }
+    }
+
+    // The deleter keeps the pool state alive, so buffers can safely outlive the pool
+    auto state = m_state;
+    return std::shared_ptr<uint8_t>(buffer, [state, sizeClass](uint8_t* released)
+    {
+      state->Release(released, sizeClass);
+    });
+  }
+
+  //----------------------------------------------------------------------------
+  void FrameBufferPool::Trim()
+  {
+    std::lock_guard<std::mutex> guard(m_state->Mutex);
+    for (auto& pair : m_state->FreeLists)
+    {
+      for (auto buffer : pair.second)
+      {
+        FreeAligned(buffer);
+      }
+    }
+    m_state->FreeLists.clear();
+    m_state->Stats.PooledBytes = 0;
+  }
+
+  //----------------------------------------------------------------------------
+  void FrameBufferPool::SetMaxPooledBytes(uint64_t maxPooledBytes)
+  {
+    std::lock_guard<std::mutex> guard(m_state->Mutex);
+    m_state->MaxPooledBytes = maxPooledBytes;
+  }
+
+  //----------------------------------------------------------------------------
+  uint64_t FrameBufferPool::GetMaxPooledBytes() const
+  {
+    std::lock_guard<std::mutex> guard(m_state->Mutex);
+    return m_state->MaxPooledBytes;
+  }
+
+  //----------------------------------------------------------------------------
+  FrameBufferPool::Metrics FrameBufferPool::GetMetrics() const
+  {
+    std::lock_guard<std::mutex> guard(m_state->Mutex);
+    return m_state->Stats;
+  }
+
+  //----------------------------------------------------------------------------
+  void FrameBufferPool::ResetMetrics()
+  {
+    std::lock_guard<std::mutex> guard(m_state->Mutex);
+    Metrics metrics;
+    metrics.OutstandingBytes = m_state->Stats.OutstandingBytes;
+    metrics.PooledBytes = m_state->Stats.PooledBytes;
+    metrics.HighWaterBytes = metrics.OutstandingBytes + metrics.PooledBytes;
+    m_state->Stats = metrics;
+  }
+
+  //----------------------------------------------------------------------------
+  size_t FrameBufferPool::GetSizeClass(size_t size)
+  {
+    if (size <= MIN_SIZE_CLASS)
+    {
+      return MIN_SIZE_CLASS;
+    }
+
+    // Four classes per power of two: 4, 5, 6 and 7 times 2^(k-2)
+    size_t highBit(0);
+    for (size_t value = size - 1; value > 1; value >>= 1)
+    {
+      highBit++;
+    }
+    const size_t step = static_cast<size_t>(1) << (highBit - 2);
+    return ((size + step - 1) / step) * step;
+  }
+
+  //----------------------------------------------------------------------------
+  FrameBufferPool::FrameBufferPool()
+    : m_state(std::make_shared<State>())
+  {
+    m_state->MaxPooledBytes = DEFAULT_MAX_POOLED_BYTES;
+  }
+
+  //----------------------------------------------------------------------------
+  FrameBufferPool::~FrameBufferPool()
+  {
+    Trim();
+    std::lock_guard<std::mutex> guard(m_state->Mutex);
+    m_state->PoolAlive = false;
+  }
+
+  //----------------------------------------------------------------------------
+  void FrameBufferPool::State::Release(uint8_t* buffer, size_t sizeClass)
+  {
+    std::lock_guard<std::mutex> guard(Mutex);
+    Stats.OutstandingBytes -= sizeClass;
+    if (!PoolAlive || Stats.PooledBytes + sizeClass > MaxPooledBytes)
+    {
+      Stats.Evictions++;
+      FreeAligned(buffer);
+      return;
+    }
+
+    FreeLists[sizeClass].push_back(buffer);
+    Stats.PooledBytes += sizeClass;
+  }
+
+  //----------------------------------------------------------------------------
+  uint8_t* FrameBufferPool::AllocateAligned(size_t size)
+  {
+#if defined(_WIN32)
+    return static_cast<uint8_t*>(_aligned_malloc(size, ALIGNMENT));
+#else
+    void* buffer(nullptr);
+    return posix_memalign(&buffer, ALIGNMENT, size) == 0 ? static_cast<uint8_t*>(buffer) : nullptr;
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  void FrameBufferPool::FreeAligned(uint8_t* buffer)
+  {
+#if defined(_WIN32)
+    _aligned_free(buffer);
+#else
+    free(buffer);
+#endif
+  }
+}
\ No newline at end of file
@@ -0,0 +1,108 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace HoloIntervention
+{
+  // Recycles large pixel buffers so that streaming image frames does not hit the system allocator every frame
+  // Buffers are handed out as std::shared_ptr<uint8_t> (the same type as std::shared_ptr<byte>), are aligned for SIMD loads
+  // and return to the pool when the last reference is released, even if the pool itself has been destroyed by then
+  // Requests are rounded up to size classes of 4 steps per power of two, so a buffer is never more than 25% larger than asked for
+  // Users are the buffers this application allocates per frame: SliceRenderer's IBuffer copies, voxel format conversion in
+  // Slice and Volume, and recorder payloads. Receive side pooling is out of scope: UWPOpenIGTLink allocates the image of every
+  // received frame inside the client and offers no allocator hook. Tools/PortableTests/FrameBufferPoolBenchmark measures
+  // allocations per second for 1024x1024 streams at 30 and 60 Hz
+  class FrameBufferPool
+  {
+  public:
+    struct Metrics
+    {
+      uint64_t    Acquisitions = 0;
+      uint64_t    Hits = 0;               // Served from the pool
+      uint64_t    Misses = 0;             // Required a system allocation
+      uint64_t    Evictions = 0;          // Released buffers freed because the pool was full
+      uint64_t    OutstandingBytes = 0;   // Currently held by callers
+      uint64_t    HighWaterBytes = 0;     // Maximum of OutstandingBytes + PooledBytes
+      uint64_t    PooledBytes = 0;        // Idle in the pool
+
+      double HitRate() const
+      {
+        return Acquisitions == 0 ? 0.0 : static_cast<double>(Hits) / Acquisitions;
+      }
+    };
+
+  public:
+    static FrameBufferPool& instance();
+
+    /// Returns a buffer of at least size bytes, aligned to ALIGNMENT. Contents are undefined
+    std::shared_ptr<uint8_t> Acquire(size_t size);
+
+    /// Free all idle buffers
+    void Trim();
+
+    /// Idle buffers beyond this many bytes are freed rather than kept
+    void SetMaxPooledBytes(uint64_t maxPooledBytes);
+    uint64_t GetMaxPooledBytes() const;
+
+    Metrics GetMetrics() const;
+    void ResetMetrics();
+
+    static size_t GetSizeClass(size_t size);
+
+  public:
+    FrameBufferPool();
+    ~FrameBufferPool();
+
+    static const size_t ALIGNMENT;
+
+  protected:
+    struct State
+    {
+      mutable std::mutex                          Mutex;
+      std::map<size_t, std::vector<uint8_t*>>     FreeLists;  // Keyed by size class
+      uint64_t                                    MaxPooledBytes;
+      Metrics                                     Stats;
+      bool                                        PoolAlive = true;
+
+      void Release(uint8_t* buffer, size_t sizeClass);
+    };
+
+    static uint8_t* AllocateAligned(size_t size);
+    static void FreeAligned(uint8_t* buffer);
+
+  protected:
+    std::shared_ptr<State>                        m_state;
+
+    static const size_t                           MIN_SIZE_CLASS;
+    static const uint64_t                         DEFAULT_MAX_POOLED_BYTES;
+  };
+}
\ No newline at end of file
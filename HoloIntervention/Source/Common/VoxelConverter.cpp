@@ -0,0 +1,400 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "VoxelConverter.h"
+#include "WorkerPool.h"
+
+// STL includes
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+// SIMD includes
+#if defined(__AVX2__)
+  #include <immintrin.h>
+  #define VOXEL_CONVERTER_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define VOXEL_CONVERTER_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  // ARMv7 NEON cannot round to nearest when converting to integers, it uses the scalar path
+  #include <arm_neon.h>
+  #define VOXEL_CONVERTER_NEON
+#endif
+
+namespace
+{
+  struct Coefficients
+  {
+    float Scale;
+    float Offset;
+    float Minimum;
+    float Maximum;
+  };
+
+  //----------------------------------------------------------------------------
+  // Comparisons rather than std::min/max so that NaN lands on the minimum, as the SIMD min/max instructions do
+  inline float Apply(float value, const Coefficients& coefficients)
+  {
+    const float scaled = value * coefficients.Scale;
+    float result = scaled + coefficients.Offset;
+    result = result > coefficients.Minimum ? result : coefficients.Minimum;
+    return result < coefficients.Maximum ? result : coefficients.Maximum;
+  }
+
+  inline void StoreScalar(uint8_t* destination, float value) { *destination = static_cast<uint8_t>(std::lrint(value)); }
+  inline void StoreScalar(uint16_t* destination, float value) { *destination = static_cast<uint16_t>(std::lrint(value)); }
+  inline void StoreScalar(float* destination, float value) { *destination = value; }
+
+#if defined(VOXEL_CONVERTER_AVX2)
+  // Eight values in one register
+  struct Block
+  {
+    __m256 Values;
+  };
+
+  struct BlockCoefficients
+  {
+    explicit BlockCoefficients(const Coefficients& coefficients)
+      : Scale(_mm256_set1_ps(coefficients.Scale)), Offset(_mm256_set1_ps(coefficients.Offset))
+      , Minimum(_mm256_set1_ps(coefficients.Minimum)), Maximum(_mm256_set1_ps(coefficients.Maximum)) {}
+    __m256 Scale, Offset, Minimum, Maximum;
+  };
+
+  inline Block Load(const uint8_t* source) { return { _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)))) }; }
+  inline Block Load(const int8_t* source) { return { _mm256_cvtepi32_ps(_mm256_cvtepi8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)))) }; }
+  inline Block Load(const uint16_t* source) { return { _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)))) }; }
+  inline Block Load(const int16_t* source) { return { _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)))) }; }
+  inline Block Load(const float* source) { return { _mm256_loadu_ps(source) }; }
+
+  inline Block Apply(const Block& block, const BlockCoefficients& coefficients)
+  {
+    const __m256 result = _mm256_add_ps(_mm256_mul_ps(block.Values, coefficients.Scale), coefficients.Offset);
+    return { _mm256_min_ps(_mm256_max_ps(result, coefficients.Minimum), coefficients.Maximum) };
+  }
+
+  inline void Store(uint8_t* destination, const Block& block)
+  {
+    const __m256i integers = _mm256_cvtps_epi32(block.Values);
+    const __m128i words = _mm_packs_epi32(_mm256_castsi256_si128(integers), _mm256_extracti128_si256(integers, 1));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(destination), _mm_packus_epi16(words, words));
+  }
+  inline void Store(uint16_t* destination, const Block& block)
+  {
+    const __m256i integers = _mm256_cvtps_epi32(block.Values);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_packus_epi32(_mm256_castsi256_si128(integers), _mm256_extracti128_si256(integers, 1)));
+  }
+  inline void Store(float* destination, const Block& block) { _mm256_storeu_ps(destination, block.Values); }
+#elif defined(VOXEL_CONVERTER_SSE2)
+  // Eight values in two registers
+  struct Block
+  {
+    __m128 Low;
+    __m128 High;
+  };
+
+  struct BlockCoefficients
+  {
+    explicit BlockCoefficients(const Coefficients& coefficients)
+      : Scale(_mm_set1_ps(coefficients.Scale)), Offset(_mm_set1_ps(coefficients.Offset))
+      , Minimum(_mm_set1_ps(coefficients.Minimum)), Maximum(_mm_set1_ps(coefficients.Maximum)) {}
+    __m128 Scale, Offset, Minimum, Maximum;
+  };
+
+  inline Block FromWords(__m128i words, bool isSigned)
+  {
+    // SSE2 has no sign or zero extension, interleave with zero or with the value itself and shift the sign in
+    if (isSigned)
+    {
+      return { _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(words, words), 16)), _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(words, words), 16)) };
+    }
+    const __m128i zero = _mm_setzero_si128();
+    return { _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero)), _mm_cvtepi32_ps(_mm_unpackhi_epi16(words, zero)) };
+  }
+  inline Block Load(const uint8_t* source) { return FromWords(_mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(source)), _mm_setzero_si128()), false); }
+  inline Block Load(const int8_t* source)
+  {
+    const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(source));
+    return FromWords(_mm_srai_epi16(_mm_unpacklo_epi8(bytes, bytes), 8), true);
+  }
+  inline Block Load(const uint16_t* source) { return FromWords(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)), false); }
+  inline Block Load(const int16_t* source) { return FromWords(_mm_loadu_si128(reinterpret_cast<const __m128i*>(source)), true); }
+  inline Block Load(const float* source) { return { _mm_loadu_ps(source), _mm_loadu_ps(source + 4) }; }
+
+  inline __m128 Apply(__m128 values, const BlockCoefficients& coefficients)
+  {
+    return _mm_min_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(values, coefficients.Scale), coefficients.Offset), coefficients.Minimum), coefficients.Maximum);
+  }
+  inline Block Apply(const Block& block, const BlockCoefficients& coefficients) { return { Apply(block.Low, coefficients), Apply(block.High, coefficients) }; }
+
+  inline void Store(uint8_t* destination, const Block& block)
+  {
+    const __m128i words = _mm_packs_epi32(_mm_cvtps_epi32(block.Low), _mm_cvtps_epi32(block.High));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(destination), _mm_packus_epi16(words, words));
+  }
+  inline void Store(uint16_t* destination, const Block& block)
+  {
+    // SSE2 only packs with signed saturation, so shift the range to signed and back
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i words = _mm_packs_epi32(_mm_sub_epi32(_mm_cvtps_epi32(block.Low), bias32), _mm_sub_epi32(_mm_cvtps_epi32(block.High), bias32));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(destination), _mm_add_epi16(words, _mm_set1_epi16(-0x8000)));
+  }
+  inline void Store(float* destination, const Block& block)
+  {
+    _mm_storeu_ps(destination, block.Low);
+    _mm_storeu_ps(destination + 4, block.High);
+  }
+#elif defined(VOXEL_CONVERTER_NEON)
+  // Eight values in two registers
+  struct Block
+  {
+    float32x4_t Low;
+    float32x4_t High;
+  };
+
+  struct BlockCoefficients
+  {
+    explicit BlockCoefficients(const Coefficients& coefficients)
+      : Scale(vdupq_n_f32(coefficients.Scale)), Offset(vdupq_n_f32(coefficients.Offset))
+      , Minimum(vdupq_n_f32(coefficients.Minimum)), Maximum(vdupq_n_f32(coefficients.Maximum)) {}
+    float32x4_t Scale, Offset, Minimum, Maximum;
+  };
+
+  inline Block Load(const uint8_t* source)
+  {
+    const uint16x8_t words = vmovl_u8(vld1_u8(source));
+    return { vcvtq_f32_u32(vmovl_u16(vget_low_u16(words))), vcvtq_f32_u32(vmovl_u16(vget_high_u16(words))) };
+  }
+  inline Block Load(const int8_t* source)
+  {
+    const int16x8_t words = vmovl_s8(vld1_s8(source));
+    return { vcvtq_f32_s32(vmovl_s16(vget_low_s16(words))), vcvtq_f32_s32(vmovl_s16(vget_high_s16(words))) };
+  }
+  inline Block Load(const uint16_t* source)
+  {
+    const uint16x8_t words = vld1q_u16(source);
+    return { vcvtq_f32_u32(vmovl_u16(vget_low_u16(words))), vcvtq_f32_u32(vmovl_u16(vget_high_u16(words))) };
+  }
+  inline Block Load(const int16_t* source)
+  {
+    const int16x8_t words = vld1q_s16(source);
+    return { vcvtq_f32_s32(vmovl_s16(vget_low_s16(words))), vcvtq_f32_s32(vmovl_s16(vget_high_s16(words))) };
+  }
+  inline Block Load(const float* source) { return { vld1q_f32(source), vld1q_f32(source + 4) }; }
+
+  inline float32x4_t Apply(float32x4_t values, const BlockCoefficients& coefficients)
+  {
+    // The "number" forms of max/min pick the bound over NaN, like SSE
+    const float32x4_t result = vaddq_f32(vmulq_f32(values, coefficients.Scale), coefficients.Offset);
+    return vminnmq_f32(vmaxnmq_f32(result, coefficients.Minimum), coefficients.Maximum);
+  }
+  inline Block Apply(const Block& block, const BlockCoefficients& coefficients) { return { Apply(block.Low, coefficients), Apply(block.High, coefficients) }; }
+
+  inline void Store(uint8_t* destination, const Block& block)
+  {
+    const uint16x8_t words = vcombine_u16(vmovn_u32(vcvtnq_u32_f32(block.Low)), vmovn_u32(vcvtnq_u32_f32(block.High)));
+    vst1_u8(destination, vmovn_u16(words));
+  }
+  inline void Store(uint16_t* destination, const Block& block)
+  {
+    vst1q_u16(destination, vcombine_u16(vmovn_u32(vcvtnq_u32_f32(block.Low)), vmovn_u32(vcvtnq_u32_f32(block.High))));
+  }
+  inline void Store(float* destination, const Block& block)
+  {
+    vst1q_f32(destination, block.Low);
+    vst1q_f32(destination + 4, block.High);
+  }
+#endif
+
+  //----------------------------------------------------------------------------
+  template<typename Source, typename Destination>
+  void ConvertTyped(const Source* source, Destination* destination, size_t count, const Coefficients& coefficients)
+  {
+    size_t i = 0;
+#if defined(VOXEL_CONVERTER_AVX2) || defined(VOXEL_CONVERTER_SSE2) || defined(VOXEL_CONVERTER_NEON)
+    const BlockCoefficients blockCoefficients(coefficients);
+    for (; i + 8 <= count; i += 8)
+    {
+      Store(destination + i, Apply(Load(source + i), blockCoefficients));
+    }
+#endif
+    for (; i < count; ++i)
+    {
+      StoreScalar(destination + i, Apply(static_cast<float>(source[i]), coefficients));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename Destination>
+  void ConvertTo(const uint8_t* source, HoloIntervention::VoxelType sourceType, Destination* destination, size_t count, const Coefficients& coefficients)
+  {
+    switch (sourceType)
+    {
+    case HoloIntervention::VoxelType_UInt8:
+      ConvertTyped(source, destination, count, coefficients);
+      break;
+    case HoloIntervention::VoxelType_Int8:
+      ConvertTyped(reinterpret_cast<const int8_t*>(source), destination, count, coefficients);
+      break;
+    case HoloIntervention::VoxelType_UInt16:
+      ConvertTyped(reinterpret_cast<const uint16_t*>(source), destination, count, coefficients);
+      break;
+    case HoloIntervention::VoxelType_Int16:
+      ConvertTyped(reinterpret_cast<const int16_t*>(source), destination, count, coefficients);
+      break;
+    case HoloIntervention::VoxelType_Float32:
+      ConvertTyped(reinterpret_cast<const float*>(source), destination, count, coefficients);
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+namespace HoloIntervention
+{
+  // Values per chunk handed to a thread, large enough that claiming one costs nothing next to converting it
+  const size_t VoxelConverter::CHUNK_SIZE = 256 * 1024;
+
+  //----------------------------------------------------------------------------
+  bool VoxelConverter::IsSupported(VoxelType sourceType, VoxelType destinationType)
+  {
+    return GetSize(sourceType) != 0 && (destinationType == VoxelType_UInt8 || destinationType == VoxelType_UInt16 || destinationType == VoxelType_Float32);
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t VoxelConverter::GetSize(VoxelType type)
+  {
+    switch (type)
+    {
+    case VoxelType_UInt8:
+    case VoxelType_Int8:
+      return 1;
+    case VoxelType_UInt16:
+    case VoxelType_Int16:
+      return 2;
+    case VoxelType_Float32:
+      return 4;
+    default:
+      return 0;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  VoxelWindow VoxelConverter::GetTypeRangeWindow(VoxelType sourceType, VoxelType destinationType)
+  {
+    float minimum(0.f);
+    float maximum(1.f);
+    switch (sourceType)
+    {
+    case VoxelType_UInt8:
+      maximum = 255.f;
+      break;
+    case VoxelType_Int8:
+      minimum = -128.f;
+      maximum = 127.f;
+      break;
+    case VoxelType_UInt16:
+      maximum = 65535.f;
+      break;
+    case VoxelType_Int16:
+      minimum = -32768.f;
+      maximum = 32767.f;
+      break;
+    default:
+      break;
+    }
+    const float range = destinationType == VoxelType_UInt8 ? 255.f : (destinationType == VoxelType_UInt16 ? 65535.f : 1.f);
+
+    VoxelWindow window;
+    window.Slope = range / (maximum - minimum);
+    window.Intercept = -minimum * window.Slope;
+    return window;
+  }
+
+  //----------------------------------------------------------------------------
+  bool VoxelConverter::Convert(const void* source, VoxelType sourceType, void* destination, VoxelType destinationType, size_t count, const VoxelWindow& window)
+  {
+    if (!IsSupported(sourceType, destinationType) || (window.Windowed && !(window.WindowWidth > 0.f)))
+    {
+      return false;
+    }
+
+    Job job;
+    job.Source = static_cast<const uint8_t*>(source);
+    job.SourceType = sourceType;
+    job.Destination = static_cast<uint8_t*>(destination);
+    job.DestinationType = destinationType;
+    job.Count = count;
+
+    // Fold rescale, window and destination range into one multiply-add and a clamp
+    const float range = destinationType == VoxelType_UInt8 ? 255.f : (destinationType == VoxelType_UInt16 ? 65535.f : 1.f);
+    if (window.Windowed)
+    {
+      const float lowerBound = window.WindowCenter - 0.5f * window.WindowWidth;
+      job.Scale = window.Slope * range / window.WindowWidth;
+      job.Offset = (window.Intercept - lowerBound) * range / window.WindowWidth;
+      job.Minimum = 0.f;
+      job.Maximum = range;
+    }
+    else
+    {
+      job.Scale = window.Slope;
+      job.Offset = window.Intercept;
+      job.Minimum = destinationType == VoxelType_Float32 ? -FLT_MAX : 0.f;
+      job.Maximum = destinationType == VoxelType_Float32 ? FLT_MAX : range;
+    }
+
+    const size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    WorkerPool::instance().ParallelFor(chunkCount, [&job](size_t chunk)
+    {
+      const size_t first = chunk * CHUNK_SIZE;
+      ConvertRange(job, first, std::min(CHUNK_SIZE, job.Count - first));
+    });
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void VoxelConverter::ConvertRange(const Job& job, size_t first, size_t count)
+  {
+    const Coefficients coefficients = { job.Scale, job.Offset, job.Minimum, job.Maximum };
+    const uint8_t* source = job.Source + first * GetSize(job.SourceType);
+    switch (job.DestinationType)
+    {
+    case VoxelType_UInt8:
+      ConvertTo(source, job.SourceType, job.Destination + first, count, coefficients);
+      break;
+    case VoxelType_UInt16:
+      ConvertTo(source, job.SourceType, reinterpret_cast<uint16_t*>(job.Destination) + first, count, coefficients);
+      break;
+    case VoxelType_Float32:
+      ConvertTo(source, job.SourceType, reinterpret_cast<float*>(job.Destination) + first, count, coefficients);
+      break;
+    default:
+      break;
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,91 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstddef>
+#include <cstdint>
+
+namespace HoloIntervention
+{
+  enum VoxelType
+  {
+    VoxelType_Unknown,
+    VoxelType_UInt8,
+    VoxelType_Int8,
+    VoxelType_UInt16,
+    VoxelType_Int16,
+    VoxelType_Float32,
+  };
+
+  // Stored values become modality values through slope and intercept, then a window maps [center - width / 2,
+  // center + width / 2] onto the destination's full range (0 to 1 for floats). Without a window, modality values are
+  // only clamped to the destination type. Integer destinations round to nearest, NaN becomes the lowest value.
+  struct VoxelWindow
+  {
+    float     Slope = 1.f;
+    float     Intercept = 0.f;
+    bool      Windowed = false;
+    float     WindowCenter = 0.5f;
+    float     WindowWidth = 1.f;
+  };
+
+  // Converts pixel and voxel buffers between types with rescale and window/level applied in the same pass
+  // Everything folds into one multiply, one add and a clamp per value, run 8 values at a time with AVX2, SSE2 or NEON
+  // (scalar otherwise, every backend gives the same result). Large buffers are split into chunks over the WorkerPool.
+  // Mapping D3D formats to voxel types is left to the renderers, see GetVoxelType in RenderingCommon.h.
+  class VoxelConverter
+  {
+  public:
+    /// Destinations are the unsigned types and floats, the formats the renderers filter
+    static bool IsSupported(VoxelType sourceType, VoxelType destinationType);
+    static uint32_t GetSize(VoxelType type);
+
+    /// Maps the whole range of the source type onto the destination type (0 to 1 for floats), for a lossless default
+    static VoxelWindow GetTypeRangeWindow(VoxelType sourceType, VoxelType destinationType);
+
+    /// Blocks until count values are converted, returns false if the pair is unsupported or the window is empty
+    static bool Convert(const void* source, VoxelType sourceType, void* destination, VoxelType destinationType, size_t count, const VoxelWindow& window);
+
+  protected:
+    struct Job
+    {
+      const uint8_t*        Source;
+      VoxelType             SourceType;
+      uint8_t*              Destination;
+      VoxelType             DestinationType;
+      size_t                Count;
+      float                 Scale;
+      float                 Offset;
+      float                 Minimum;
+      float                 Maximum;
+    };
+
+    static void ConvertRange(const Job& job, size_t first, size_t count);
+
+  protected:
+    static const size_t     CHUNK_SIZE;
+  };
+}
\ No newline at end of file
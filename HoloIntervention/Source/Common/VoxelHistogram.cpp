@@ -0,0 +1,622 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Local includes
+#include "pch.h"
+#include "VoxelHistogram.h"
+#include "WorkerPool.h"
+
+// STL includes
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+// SIMD includes
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define VOXEL_HISTOGRAM_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define VOXEL_HISTOGRAM_NEON
+#endif
+
+namespace
+{
+  // Values per pass of the four sets of counts, far below what a 32-bit count can overflow on
+  const size_t MAXIMUM_PASS_SIZE = size_t(1) << 30;
+  // Values counted and then scanned for their range while they are still in the L1 cache
+  const size_t BLOCK_SIZE = 8192;
+
+  // Signed values are offset to unsigned keys by flipping the sign bit, so keys order like values and bins run from the
+  // lowest value up. Range and sum are taken over keys and shifted back once at the end.
+  struct KeyRange
+  {
+    uint32_t Minimum;
+    uint32_t Maximum;
+    uint64_t Sum;
+  };
+
+  //----------------------------------------------------------------------------
+  template<typename Word>
+  void ScanKeysScalar(const Word* words, size_t count, Word bias, KeyRange& range)
+  {
+    uint32_t minimum = range.Minimum;
+    uint32_t maximum = range.Maximum;
+    uint64_t sum(0);
+    for (size_t i = 0; i < count; ++i)
+    {
+      const uint32_t key = static_cast<Word>(words[i] ^ bias);
+      minimum = key < minimum ? key : minimum;
+      maximum = key > maximum ? key : maximum;
+      sum += key;
+    }
+    range.Minimum = minimum;
+    range.Maximum = maximum;
+    range.Sum += sum;
+  }
+
+  //----------------------------------------------------------------------------
+  // Counts are at most BLOCK_SIZE, so the per lane sums below cannot overflow 32 bits
+  void ScanKeys(const uint8_t* words, size_t count, uint8_t bias, KeyRange& range)
+  {
+    size_t i = 0;
+#if defined(VOXEL_HISTOGRAM_SSE2)
+    if (count >= 16)
+    {
+      const __m128i biasLanes = _mm_set1_epi8(static_cast<char>(bias));
+      const __m128i zero = _mm_setzero_si128();
+      __m128i minimum = _mm_set1_epi8(static_cast<char>(range.Minimum > 0xFF ? 0xFF : range.Minimum));
+      __m128i maximum = _mm_set1_epi8(static_cast<char>(range.Maximum));
+      __m128i sum = zero;
+      for (; i + 16 <= count; i += 16)
+      {
+        const __m128i keys = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i)), biasLanes);
+        minimum = _mm_min_epu8(minimum, keys);
+        maximum = _mm_max_epu8(maximum, keys);
+        sum = _mm_add_epi64(sum, _mm_sad_epu8(keys, zero));
+      }
+      uint8_t minimums[16], maximums[16];
+      uint64_t sums[2];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(minimums), minimum);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(maximums), maximum);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+      for (int lane = 0; lane < 16; ++lane)
+      {
+        range.Minimum = std::min<uint32_t>(range.Minimum, minimums[lane]);
+        range.Maximum = std::max<uint32_t>(range.Maximum, maximums[lane]);
+      }
+      range.Sum += sums[0] + sums[1];
+    }
+#elif defined(VOXEL_HISTOGRAM_NEON)
+    if (count >= 16)
+    {
+      const uint8x16_t biasLanes = vdupq_n_u8(bias);
+      uint8x16_t minimum = vdupq_n_u8(static_cast<uint8_t>(range.Minimum > 0xFF ? 0xFF : range.Minimum));
+      uint8x16_t maximum = vdupq_n_u8(static_cast<uint8_t>(range.Maximum));
+      uint32x4_t sum = vdupq_n_u32(0);
+      for (; i + 16 <= count; i += 16)
+      {
+        const uint8x16_t keys = veorq_u8(vld1q_u8(words + i), biasLanes);
+        minimum = vminq_u8(minimum, keys);
+        maximum = vmaxq_u8(maximum, keys);
+        sum = vpadalq_u16(sum, vpaddlq_u8(keys));
+      }
+      uint8_t minimums[16], maximums[16];
+      uint32_t sums[4];
+      vst1q_u8(minimums, minimum);
+      vst1q_u8(maximums, maximum);
+      vst1q_u32(sums, sum);
+      for (int lane = 0; lane < 16; ++lane)
+      {
+        range.Minimum = std::min<uint32_t>(range.Minimum, minimums[lane]);
+        range.Maximum = std::max<uint32_t>(range.Maximum, maximums[lane]);
+      }
+      range.Sum += static_cast<uint64_t>(sums[0]) + sums[1] + sums[2] + sums[3];
+    }
+#endif
+    ScanKeysScalar(words + i, count - i, bias, range);
+  }
+
+  //----------------------------------------------------------------------------
+  void ScanKeys(const uint16_t* words, size_t count, uint16_t bias, KeyRange& range)
+  {
+    size_t i = 0;
+#if defined(VOXEL_HISTOGRAM_SSE2)
+    if (count >= 8)
+    {
+      // SSE2 only has signed 16-bit min, max and multiply-add, so flip keys to signed and back
+      const __m128i signedBias = _mm_set1_epi16(static_cast<short>(bias ^ 0x8000));
+      const __m128i ones = _mm_set1_epi16(1);
+      __m128i minimum = _mm_set1_epi16(static_cast<short>((range.Minimum > 0xFFFF ? 0xFFFF : range.Minimum) ^ 0x8000));
+      __m128i maximum = _mm_set1_epi16(static_cast<short>(range.Maximum ^ 0x8000));
+      __m128i sum = _mm_setzero_si128();
+      for (; i + 8 <= count; i += 8)
+      {
+        const __m128i keys = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(words + i)), signedBias);
+        minimum = _mm_min_epi16(minimum, keys);
+        maximum = _mm_max_epi16(maximum, keys);
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(keys, ones));
+      }
+      int16_t minimums[8], maximums[8];
+      int32_t sums[4];
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(minimums), minimum);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(maximums), maximum);
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(sums), sum);
+      for (int lane = 0; lane < 8; ++lane)
+      {
+        range.Minimum = std::min<uint32_t>(range.Minimum, static_cast<uint16_t>(minimums[lane] ^ 0x8000));
+        range.Maximum = std::max<uint32_t>(range.Maximum, static_cast<uint16_t>(maximums[lane] ^ 0x8000));
+      }
+      const int64_t signedSum = static_cast<int64_t>(sums[0]) + sums[1] + sums[2] + sums[3];
+      range.Sum += static_cast<uint64_t>(signedSum + 32768 * static_cast<int64_t>(i));
+    }
+#elif defined(VOXEL_HISTOGRAM_NEON)
+    if (count >= 8)
+    {
+      const uint16x8_t biasLanes = vdupq_n_u16(bias);
+      uint16x8_t minimum = vdupq_n_u16(static_cast<uint16_t>(range.Minimum > 0xFFFF ? 0xFFFF : range.Minimum));
+      uint16x8_t maximum = vdupq_n_u16(static_cast<uint16_t>(range.Maximum));
+      uint32x4_t sum = vdupq_n_u32(0);
+      for (; i + 8 <= count; i += 8)
+      {
+        const uint16x8_t keys = veorq_u16(vld1q_u16(words + i), biasLanes);
+        minimum = vminq_u16(minimum, keys);
+        maximum = vmaxq_u16(maximum, keys);
+        sum = vpadalq_u16(sum, keys);
+      }
+      uint16_t minimums[8], maximums[8];
+      uint32_t sums[4];
+      vst1q_u16(minimums, minimum);
+      vst1q_u16(maximums, maximum);
+      vst1q_u32(sums, sum);
+      for (int lane = 0; lane < 8; ++lane)
+      {
+        range.Minimum = std::min<uint32_t>(range.Minimum, minimums[lane]);
+        range.Maximum = std::max<uint32_t>(range.Maximum, maximums[lane]);
+      }
+      range.Sum += static_cast<uint64_t>(sums[0]) + sums[1] + sums[2] + sums[3];
+    }
+#endif
+    ScanKeysScalar(words + i, count - i, bias, range);
+  }
+}
+
+namespace HoloIntervention
+{
+  // Below this a range costs more to hand out than it saves, and each one adds a merge of every bin
+  const size_t VoxelHistogram::MINIMUM_VALUES_PER_THREAD = 256 * 1024;
+
+  //----------------------------------------------------------------------------
+  VoxelHistogram::VoxelHistogram()
+  {
+  }
+
+  //----------------------------------------------------------------------------
+  bool VoxelHistogram::Reset(VoxelType type, uint32_t binCount, float minimum, float maximum)
+  {
+    m_type = VoxelType_Unknown;
+    m_bins.clear();
+    m_scratch.clear();
+    Clear();
+
+    switch (type)
+    {
+    case VoxelType_UInt8:
+    case VoxelType_Int8:
+    case VoxelType_UInt16:
+    case VoxelType_Int16:
+    {
+      const uint32_t typeBits = VoxelConverter::GetSize(type) * 8;
+      if (binCount < 2 || (binCount & (binCount - 1)) != 0 || binCount > (1u << typeBits))
+      {
+        return false;
+      }
+      m_shift = 0;
+      while ((binCount << m_shift) < (1u << typeBits))
+      {
+        ++m_shift;
+      }
+      m_rangeMinimum = (type == VoxelType_Int8 || type == VoxelType_Int16) ? -static_cast<float>(1u << (typeBits - 1)) : 0.f;
+      m_binWidth = static_cast<float>(1u << m_shift);
+      m_binScale = 1.f / m_binWidth;
+      break;
+    }
+    case VoxelType_Float32:
+      if (binCount < 1 || binCount > 65536 || !(maximum > minimum) || !std::isfinite(maximum - minimum))
+      {
+        return false;
+      }
+      m_shift = 0;
+      m_rangeMinimum = minimum;
+      m_binWidth = (maximum - minimum) / binCount;
+      m_binScale = binCount / (maximum - minimum);
+      break;
+    default:
+      return false;
+    }
+
+    m_type = type;
+    m_bins.assign(binCount, 0);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void VoxelHistogram::Clear()
+  {
+    std::fill(m_bins.begin(), m_bins.end(), 0);
+    m_count = 0;
+    m_sum = 0.0;
+    m_minimum = 0.f;
+    m_maximum = 0.f;
+  }
+
+  //----------------------------------------------------------------------------
+  void VoxelHistogram::SetThreadCount(uint32_t threadCount)
+  {
+    m_threadCount = threadCount;
+  }
+
+  //----------------------------------------------------------------------------
+  void VoxelHistogram::Accumulate(const void* values, size_t count)
+  {
+    if (!IsValid() || values == nullptr || count == 0)
+    {
+      return;
+    }
+
+    switch (m_type)
+    {
+    case VoxelType_UInt8:
+      AccumulateWords(static_cast<const uint8_t*>(values), count, uint8_t(0));
+      break;
+    case VoxelType_Int8:
+      AccumulateWords(static_cast<const uint8_t*>(values), count, uint8_t(0x80));
+      break;
+    case VoxelType_UInt16:
+      AccumulateWords(static_cast<const uint16_t*>(values), count, uint16_t(0));
+      break;
+    case VoxelType_Int16:
+      AccumulateWords(static_cast<const uint16_t*>(values), count, uint16_t(0x8000));
+      break;
+    case VoxelType_Float32:
+      AccumulateFloats(static_cast<const float*>(values), count);
+      break;
+    default:
+      break;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void VoxelHistogram::Build(const void* values, size_t count)
+  {
+    Clear();
+    if (!IsValid() || values == nullptr || count == 0)
+    {
+      return;
+    }
+
+    uint32_t threadCount = m_threadCount == 0 ? WorkerPool::instance().GetThreadCount() : m_threadCount;
+    threadCount = static_cast<uint32_t>(std::min<size_t>(threadCount, std::max<size_t>(count / MINIMUM_VALUES_PER_THREAD, 1)));
+    if (threadCount == 1)
+    {
+      Accumulate(values, count);
+      return;
+    }
+
+    // Contiguous ranges into private histograms, merged once every range is done. Range 0 goes into this one
+    const uint8_t* bytes = static_cast<const uint8_t*>(values);
+    const size_t valueSize = VoxelConverter::GetSize(m_type);
+    std::vector<VoxelHistogram> partials(threadCount - 1);
+    for (auto& partial : partials)
+    {
+      partial.m_type = m_type;
+      partial.m_shift = m_shift;
+      partial.m_rangeMinimum = m_rangeMinimum;
+      partial.m_binWidth = m_binWidth;
+      partial.m_binScale = m_binScale;
+      partial.m_bins.assign(m_bins.size(), 0);
+    }
+
+    WorkerPool::instance().ParallelFor(threadCount, [&](size_t i)
+    {
+      const size_t first = count * i / threadCount;
+      const size_t last = count * (i + 1) / threadCount;
+      (i == 0 ? *this : partials[i - 1]).Accumulate(bytes + first * valueSize, last - first);
+    });
+    for (auto& partial : partials)
+    {
+      Merge(partial);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool VoxelHistogram::Merge(const VoxelHistogram& other)
+  {
+    if (!IsValid() || other.m_type != m_type || other.m_bins.size() != m_bins.size() || other.m_rangeMinimum != m_rangeMinimum || other.m_binWidth != m_binWidth)
+    {
+      return false;
+    }
+    if (other.m_count == 0)
+    {
+      return true;
+    }
+
+    for (size_t i = 0; i < m_bins.size(); ++i)
+    {
+      m_bins[i] += other.m_bins[i];
+    }
+    m_minimum = m_count == 0 ? other.m_minimum : std::min(m_minimum, other.m_minimum);
+    m_maximum = m_count == 0 ? other.m_maximum : std::max(m_maximum, other.m_maximum);
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool VoxelHistogram::IsValid() const
+  {
+    return m_type != VoxelType_Unknown;
+  }
+
+  //----------------------------------------------------------------------------
+  VoxelType VoxelHistogram::GetType() const
+  {
+    return m_type;
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t VoxelHistogram::GetBinCount() const
+  {
+    return static_cast<uint32_t>(m_bins.size());
+  }
+
+  //----------------------------------------------------------------------------
+  const std::vector<uint64_t>& VoxelHistogram::GetBins() const
+  {
+    return m_bins;
+  }
+
+  //----------------------------------------------------------------------------
+  float VoxelHistogram::GetBinLowerBound(uint32_t bin) const
+  {
+    return m_rangeMinimum + bin * m_binWidth;
+  }
+
+  //----------------------------------------------------------------------------
+  float VoxelHistogram::GetBinWidth() const
+  {
+    return m_binWidth;
+  }
+
+  //----------------------------------------------------------------------------
+  uint64_t VoxelHistogram::GetCount() const
+  {
+    return m_count;
+  }
+
+  //----------------------------------------------------------------------------
+  float VoxelHistogram::GetMinimum() const
+  {
+    return m_minimum;
+  }
+
+  //----------------------------------------------------------------------------
+  float VoxelHistogram::GetMaximum() const
+  {
+    return m_maximum;
+  }
+
+  //----------------------------------------------------------------------------
+  float VoxelHistogram::GetMean() const
+  {
+    return m_count == 0 ? 0.f : static_cast<float>(m_sum / m_count);
+  }
+
+  //----------------------------------------------------------------------------
+  float VoxelHistogram::GetPercentile(float fraction) const
+  {
+    if (m_count == 0)
+    {
+      return 0.f;
+    }
+
+    const double target = std::min(std::max(fraction, 0.f), 1.f) * static_cast<double>(m_count);
+    uint64_t below(0);
+    uint32_t bin(0);
+    for (; bin + 1 < m_bins.size(); ++bin)
+    {
+      if (m_bins[bin] != 0 && static_cast<double>(below + m_bins[bin]) >= target)
+      {
+        break;
+      }
+      below += m_bins[bin];
+    }
+    while (m_bins[bin] == 0 && bin > 0)
+    {
+      // Only reached past the last occupied bin, step back to it
+      --bin;
+      below -= m_bins[bin];
+    }
+
+    // Values are taken as spread evenly over the bin, integers over the whole numbers it holds
+    const double position = std::min(std::max((target - below) / m_bins[bin], 0.0), 1.0);
+    double value;
+    if (m_type == VoxelType_Float32)
+    {
+      value = GetBinLowerBound(bin) + position * m_binWidth;
+    }
+    else
+    {
+      value = GetBinLowerBound(bin) + std::min(std::floor(position * m_binWidth), static_cast<double>(m_binWidth) - 1.0);
+    }
+    return std::min(std::max(static_cast<float>(value), m_minimum), m_maximum);
+  }
+
+  //----------------------------------------------------------------------------
+  VoxelWindow VoxelHistogram::GetAutoWindow(const VoxelWindow& rescale, float lowerFraction, float upperFraction) const
+  {
+    VoxelWindow window = rescale;
+    window.Windowed = false;
+    if (m_count == 0)
+    {
+      return window;
+    }
+
+    float lower = GetPercentile(std::min(lowerFraction, upperFraction)) * rescale.Slope + rescale.Intercept;
+    float upper = GetPercentile(std::max(lowerFraction, upperFraction)) * rescale.Slope + rescale.Intercept;
+    if (lower > upper)
+    {
+      std::swap(lower, upper);
+    }
+
+    // A flat image still gets a usable window, one bin wide
+    float width = upper - lower;
+    if (!(width > 0.f))
+    {
+      width = std::abs(rescale.Slope) * m_binWidth;
+    }
+    if (!(width > 0.f) || !std::isfinite(width))
+    {
+      width = 1.f;
+    }
+
+    window.Windowed = true;
+    window.WindowCenter = 0.5f * (lower + upper);
+    window.WindowWidth = width;
+    return window;
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename Word>
+  void VoxelHistogram::AccumulateWords(const Word* words, size_t count, Word bias)
+  {
+    const uint32_t binCount = static_cast<uint32_t>(m_bins.size());
+    const uint32_t shift = m_shift;
+    KeyRange range = { 0xFFFFFFFFu, 0u, 0u };
+
+    if (count < 4 * static_cast<size_t>(binCount))
+    {
+      // Too few values to pay for clearing and folding the scratch counts
+      for (size_t i = 0; i < count; ++i)
+      {
+        ++m_bins[static_cast<Word>(words[i] ^ bias) >> shift];
+      }
+      ScanKeys(words, count, bias, range);
+    }
+    else
+    {
+      // Four sets of counts so that runs of equal values do not wait on the previous increment of the same counter
+      m_scratch.resize(4 * static_cast<size_t>(binCount));
+      uint32_t* counts0 = m_scratch.data();
+      uint32_t* counts1 = counts0 + binCount;
+      uint32_t* counts2 = counts1 + binCount;
+      uint32_t* counts3 = counts2 + binCount;
+      for (size_t first = 0; first < count; first += MAXIMUM_PASS_SIZE)
+      {
+        const size_t passCount = std::min(count - first, MAXIMUM_PASS_SIZE);
+        memset(counts0, 0, m_scratch.size() * sizeof(uint32_t));
+        for (size_t block = 0; block < passCount; block += BLOCK_SIZE)
+        {
+          const Word* blockWords = words + first + block;
+          const size_t blockCount = std::min(passCount - block, BLOCK_SIZE);
+          size_t i = 0;
+          for (; i + 4 <= blockCount; i += 4)
+          {
+            ++counts0[static_cast<Word>(blockWords[i] ^ bias) >> shift];
+            ++counts1[static_cast<Word>(blockWords[i + 1] ^ bias) >> shift];
+            ++counts2[static_cast<Word>(blockWords[i + 2] ^ bias) >> shift];
+            ++counts3[static_cast<Word>(blockWords[i + 3] ^ bias) >> shift];
+          }
+          for (; i < blockCount; ++i)
+          {
+            ++counts0[static_cast<Word>(blockWords[i] ^ bias) >> shift];
+          }
+          ScanKeys(blockWords, blockCount, bias, range);
+        }
+        AddCounts(counts0, 4);
+      }
+    }
+
+    // Keys back to values, m_rangeMinimum is the lowest value of the type
+    const float minimum = range.Minimum + m_rangeMinimum;
+    const float maximum = range.Maximum + m_rangeMinimum;
+    m_minimum = m_count == 0 ? minimum : std::min(m_minimum, minimum);
+    m_maximum = m_count == 0 ? maximum : std::max(m_maximum, maximum);
+    m_count += count;
+    m_sum += static_cast<double>(range.Sum) + static_cast<double>(m_rangeMinimum) * count;
+  }
+
+  //----------------------------------------------------------------------------
+  void VoxelHistogram::AccumulateFloats(const float* values, size_t count)
+  {
+    const uint32_t binCount = static_cast<uint32_t>(m_bins.size());
+    const float lastBin = static_cast<float>(binCount - 1);
+    float minimum = FLT_MAX;
+    float maximum = -FLT_MAX;
+    double sum(0.0);
+    uint64_t counted(0);
+
+    // Comparisons rather than std::min/max so that infinities clamp into the end bins
+    for (size_t i = 0; i < count; ++i)
+    {
+      const float value = values[i];
+      if (value != value)
+      {
+        continue;
+      }
+      float bin = (value - m_rangeMinimum) * m_binScale;
+      bin = bin > 0.f ? bin : 0.f;
+      bin = bin < lastBin ? bin : lastBin;
+      ++m_bins[static_cast<uint32_t>(bin)];
+      minimum = value < minimum ? value : minimum;
+      maximum = value > maximum ? value : maximum;
+      sum += value;
+      ++counted;
+    }
+    if (counted == 0)
+    {
+      return;
+    }
+
+    m_minimum = m_count == 0 ? minimum : std::min(m_minimum, minimum);
+    m_maximum = m_count == 0 ? maximum : std::max(m_maximum, maximum);
+    m_count += counted;
+    m_sum += sum;
+  }
+
+  //----------------------------------------------------------------------------
+  void VoxelHistogram::AddCounts(const uint32_t* counts, uint32_t copies)
+  {
+    const size_t binCount = m_bins.size();
+    for (uint32_t copy = 0; copy < copies; ++copy)
+    {
+      for (size_t bin = 0; bin < binCount; ++bin)
+      {
+        m_bins[bin] += counts[copy * binCount + bin];
+      }
+    }
+  }
+}
\ No newline at end of file
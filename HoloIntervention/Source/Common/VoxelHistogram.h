@@ -0,0 +1,105 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+#pragma once
+
+// Local includes
+#include "VoxelConverter.h"
+
+// STL includes
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  // Histogram, exact range and mean of voxel values, built in one pass so window/level needs no second look at the data
+  // Integer types bin by shifting, so bin counts are powers of two no larger than the type's range (256 bins are exact for
+  // 8-bit data, 4096 bins are 16 values wide for 16-bit data). Floats bin linearly over a range given up front, values
+  // outside it count in the end bins. Percentiles interpolate within a bin and are clamped to the exact minimum and
+  // maximum. Rows or bricks can be accumulated as they arrive, histograms of disjoint data merge exactly.
+  class VoxelHistogram
+  {
+  public:
+    VoxelHistogram();
+
+    /// Returns false and disables the histogram for an unsupported type or bin count, the range only applies to floats
+    bool Reset(VoxelType type, uint32_t binCount, float minimum = 0.f, float maximum = 1.f);
+    /// Drops every count, keeps the type and bins
+    void Clear();
+    /// Most ranges Build splits a frame into, 0 uses every WorkerPool thread
+    void SetThreadCount(uint32_t threadCount);
+
+    /// Adds count values on the calling thread, for a row or brick at a time
+    void Accumulate(const void* values, size_t count);
+    /// Clears and adds a whole frame, split over the WorkerPool
+    void Build(const void* values, size_t count);
+    /// Returns false unless other has the same type and bins
+    bool Merge(const VoxelHistogram& other);
+
+    bool IsValid() const;
+    VoxelType GetType() const;
+    uint32_t GetBinCount() const;
+    const std::vector<uint64_t>& GetBins() const;
+    float GetBinLowerBound(uint32_t bin) const;
+    float GetBinWidth() const;
+
+    /// Counted values only, float NaNs are skipped. The rest are stored values, and 0 while the histogram is empty
+    uint64_t GetCount() const;
+    float GetMinimum() const;
+    float GetMaximum() const;
+    float GetMean() const;
+    /// fraction of 0.5 is the median
+    float GetPercentile(float fraction) const;
+
+    /// Window from the lower to the upper percentile, in the modality units of the given slope and intercept
+    /// Returns the rescale unwindowed while the histogram is empty
+    VoxelWindow GetAutoWindow(const VoxelWindow& rescale, float lowerFraction = 0.01f, float upperFraction = 0.99f) const;
+
+  protected:
+    template<typename Word>
+    void AccumulateWords(const Word* words, size_t count, Word bias);
+    void AccumulateFloats(const float* values, size_t count);
+    void AddCounts(const uint32_t* counts, uint32_t copies);
+
+  protected:
+    static const size_t           MINIMUM_VALUES_PER_THREAD;
+
+    VoxelType                     m_type = VoxelType_Unknown;
+    uint32_t                      m_shift = 0;              // Integer types, stored value to bin
+    float                         m_rangeMinimum = 0.f;     // Lower bound of the first bin
+    float                         m_binWidth = 1.f;
+    float                         m_binScale = 1.f;         // Floats, value to bin
+    uint32_t                      m_threadCount = 0;
+
+    std::vector<uint64_t>         m_bins;
+    uint64_t                      m_count = 0;
+    double                        m_sum = 0.0;
+    float                         m_minimum = 0.f;
+    float                         m_maximum = 0.f;
+
+    std::vector<uint32_t>         m_scratch;                // Four interleaved sets of counts, reused between calls
+  };
+}
\ No newline at end of file
@@ -0,0 +1,184 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Local includes
+#include "pch.h"
+#include "WorkerPool.h"
+
+// STL includes
+#include <algorithm>
+
+// PPL includes
+#if defined(_MSC_VER)
+  #include <ppl.h>
+#endif
+
+namespace HoloIntervention
+{
+  //----------------------------------------------------------------------------
+  WorkerPool& WorkerPool::instance()
+  {
+    static WorkerPool instance;
+    return instance;
+  }
+
+#if defined(_MSC_VER)
+  //----------------------------------------------------------------------------
+  WorkerPool::WorkerPool()
+  {
+  }
+
+  //----------------------------------------------------------------------------
+  WorkerPool::~WorkerPool()
+  {
+  }
+
+  //----------------------------------------------------------------------------
+  void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t)>& body)
+  {
+    if (count == 1)
+    {
+      body(0);
+      return;
+    }
+    concurrency::parallel_for(size_t(0), count, [&body](size_t i) { body(i); });
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t WorkerPool::GetThreadCount() const
+  {
+    return std::max(std::thread::hardware_concurrency(), 1u);
+  }
+#else
+  //----------------------------------------------------------------------------
+  WorkerPool::WorkerPool()
+  {
+    const uint32_t threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+    for (uint32_t i = 1; i < threadCount; ++i)
+    {
+      m_workers.push_back(std::thread(&WorkerPool::WorkerLoop, this));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  WorkerPool::~WorkerPool()
+  {
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_stopping = true;
+    }
+    m_loopCondition.notify_all();
+    for (auto& worker : m_workers)
+    {
+      worker.join();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t)>& body)
+  {
+    if (count == 0)
+    {
+      return;
+    }
+    if (count == 1 || m_workers.empty())
+    {
+      for (size_t i = 0; i < count; ++i)
+      {
+        body(i);
+      }
+      return;
+    }
+
+    auto loop = std::make_shared<Loop>();
+    loop->Body = &body;
+    loop->Count = count;
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_loops.push_back(loop);
+    }
+    m_loopCondition.notify_all();
+
+    RunIterations(*loop);
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_doneCondition.wait(lock, [&loop]() { return loop->Done == loop->Count; });
+    auto iter = std::find(m_loops.begin(), m_loops.end(), loop);
+    if (iter != m_loops.end())
+    {
+      m_loops.erase(iter);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t WorkerPool::GetThreadCount() const
+  {
+    return static_cast<uint32_t>(m_workers.size() + 1);
+  }
+
+  //----------------------------------------------------------------------------
+  void WorkerPool::RunIterations(Loop& loop)
+  {
+    for (size_t i = loop.Next++; i < loop.Count; i = loop.Next++)
+    {
+      (*loop.Body)(i);
+
+      // Notified under the lock so the caller cannot miss it between checking and waiting
+      if (++loop.Done == loop.Count)
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_doneCondition.notify_all();
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void WorkerPool::WorkerLoop()
+  {
+    for (;;)
+    {
+      // Each worker holds its own reference to the loop, so one that claims late only finds no iterations left
+      std::shared_ptr<Loop> loop;
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_loopCondition.wait(lock, [this]() { return m_stopping || !m_loops.empty(); });
+        if (m_stopping)
+        {
+          return;
+        }
+        loop = m_loops.front();
+        if (loop->Next >= loop->Count)
+        {
+          // Every iteration is claimed, the rest finish on the threads that claimed them
+          m_loops.pop_front();
+          continue;
+        }
+      }
+
+      RunIterations(*loop);
+    }
+  }
+#endif
+}
\ No newline at end of file
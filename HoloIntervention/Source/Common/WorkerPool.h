@@ -0,0 +1,84 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+#pragma once
+
+// STL includes
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace HoloIntervention
+{
+  // Runs data parallel loops for every CPU stage (voxel conversion, histograms, pyramids, gradients, pre-integration)
+  // on one shared set of threads, so no stage starts threads of its own and stages running at once share the cores
+  // With PPL the loop is a concurrency::parallel_for on the runtime's scheduler. Elsewhere it is a pool of hardware
+  // threads minus one that lives for the process; the calling thread works on its own loop too, so a loop always
+  // finishes even when every worker is busy, and loops may be nested.
+  class WorkerPool
+  {
+  public:
+    static WorkerPool& instance();
+
+    /// Calls body(i) for every i in [0, count), on any thread and in any order, returns once all calls have returned
+    void ParallelFor(size_t count, const std::function<void(size_t)>& body);
+
+    /// Threads a loop can run on, the caller's included
+    uint32_t GetThreadCount() const;
+
+  public:
+    WorkerPool();
+    ~WorkerPool();
+
+  protected:
+#if !defined(_MSC_VER)
+    struct Loop
+    {
+      const std::function<void(size_t)>*  Body = nullptr;
+      size_t                              Count = 0;
+      std::atomic<size_t>                 Next{ 0 };
+      std::atomic<size_t>                 Done{ 0 };
+    };
+
+    void RunIterations(Loop& loop);
+    void WorkerLoop();
+
+  protected:
+    std::mutex                            m_mutex;
+    std::condition_variable               m_loopCondition;
+    std::condition_variable               m_doneCondition;
+    std::deque<std::shared_ptr<Loop>>     m_loops;          // Loops with iterations left to claim
+    bool                                  m_stopping = false;
+    std::vector<std::thread>              m_workers;
+#endif
+  };
+}
\ No newline at end of file
@@ -26,6 +26,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "AppView.h"
 #include "Common.h"
 #include "Debug.h"
+#include "LatencyTracer.h"
 #include "DirectXHelper.h"
 #include "HoloInterventionCore.h"
 #include "IConfigurable.h"
@@ -341,8 +342,12 @@ namespace HoloIntervention
 
     SpatialCoordinateSystem^ hmdCoordinateSystem = m_attachedReferenceFrame->GetStationaryCoordinateSystemAtTimestamp(prediction->Timestamp);
 
+    // Predicted photon time on the LatencyTracer::Now() clock, DateTime counts 100ns ticks since 1601
+    const int64 unixEpochTicks = 116444736000000000LL;
+    const double photonTime = (prediction->Timestamp->TargetTime.UniversalTime - unixEpochTicks) * 1e-7;
+
     DX::CameraResources* cameraResources(nullptr);
-    if (!m_deviceResources->UseHolographicCameraResources<bool>([this, holographicFrame, prediction, hmdCoordinateSystem, &cameraResources](std::map<UINT32, std::unique_ptr<DX::CameraResources>>& cameraResourceMap)
+    if (!m_deviceResources->UseHolographicCameraResources<bool>([this, holographicFrame, prediction, hmdCoordinateSystem, photonTime, &cameraResources](std::map<UINT32, std::unique_ptr<DX::CameraResources>>& cameraResourceMap)
   {
     for (auto cameraPose : prediction->CameraPoses)
       {
@@ -382,7 +387,7 @@ namespace HoloIntervention
           m_volumeRenderer->Update(cameraResources, hmdCoordinateSystem, headPose);
         }
         m_imagingSystem->Update(m_timer, hmdCoordinateSystem);
-        m_toolSystem->Update(m_timer, hmdCoordinateSystem);
+        m_toolSystem->Update(m_timer, hmdCoordinateSystem, photonTime);
         m_networkSystem->Update(m_timer);
         m_taskSystem->Update(hmdCoordinateSystem, m_timer);
 
@@ -471,6 +476,12 @@ namespace HoloIntervention
         }
       }
 
+      if (atLeastOneCameraRendered)
+      {
+        // Everything consumed since the last frame is now on its way to the display
+        LatencyTracer::instance().StampRendered();
+      }
+
       return atLeastOneCameraRendered;
     });
   }
@@ -23,7 +23,10 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 // Local includes
 #include "pch.h"
+#include "Common.h"
 #include "Debug.h"
+#include "LatencyTracer.h"
+#include "Log.h"
 #include "ModelRenderer.h"
 #include "Slice.h"
 #include "SliceRenderer.h"
@@ -33,6 +36,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include <sstream>
 
 using namespace Windows::Foundation::Numerics;
+using namespace Windows::Storage;
 using namespace Windows::Media::SpeechRecognition;
 using namespace Windows::Perception::Spatial;
 using namespace Windows::UI::Input::Spatial;
@@ -88,6 +92,44 @@ namespace HoloIntervention
       m_sliceEntry->ForceCurrentPose(m_sliceEntry->GetCurrentPose());
       m_sliceEntry->SetHeadlocked(false);
     };
+
+    callbackMap[L"save latency"] = [this](SpeechRecognitionResult ^ result)
+    {
+      auto calendar = ref new Windows::Globalization::Calendar();
+      calendar->SetToNow();
+      std::wstring fileName = std::wstring(ApplicationData::Current->LocalFolder->Path->Data()) + L"\\Latency_" + calendar->YearAsString()->Data() + L"-" + calendar->MonthAsNumericString()->Data() + L"-" + calendar->DayAsString()->Data() + L"T" + calendar->HourAsPaddedString(2)->Data() + L"h" + calendar->MinuteAsPaddedString(2)->Data() + L"m" + calendar->SecondAsPaddedString(2)->Data() + L"s.csv";
+      std::string narrowFileName;
+      for (auto character : fileName)
+      {
+        narrowFileName.push_back(static_cast<char>(character));
+      }
+
+      if (LatencyTracer::instance().DumpToFile(narrowFileName))
+      {
+        WLOG_INFO(L"Latency report written to " + ref new Platform::String(fileName.c_str()));
+      }
+      else
+      {
+        WLOG_ERROR(L"Unable to write latency report to " + ref new Platform::String(fileName.c_str()));
+      }
+    };
+
+    callbackMap[L"reset latency"] = [this](SpeechRecognitionResult ^ result)
+    {
+      LatencyTracer::instance().Reset();
+    };
+
+    callbackMap[L"start latency"] = [this](SpeechRecognitionResult ^ result)
+    {
+      LatencyTracer::instance().SetEnabled(true);
+      WLOG_INFO(L"Latency tracing started.");
+    };
+
+    callbackMap[L"stop latency"] = [this](SpeechRecognitionResult ^ result)
+    {
+      LatencyTracer::instance().SetEnabled(false);
+      WLOG_INFO(L"Latency tracing stopped.");
+    };
   }
 
   //----------------------------------------------------------------------------
@@ -0,0 +1,444 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "LatencyTracer.h"
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+namespace HoloIntervention
+{
+  //----------------------------------------------------------------------------
+  void LatencyHistogram::Record(double seconds)
+  {
+    seconds = std::max(0.0, seconds);
+    m_buckets[BucketIndex(static_cast<uint64_t>(seconds * 1e6))]++;
+    m_count++;
+    m_sumSec += seconds;
+    m_maxSec = std::max(m_maxSec, seconds);
+  }
+
+  //----------------------------------------------------------------------------
+  void LatencyHistogram::Merge(const LatencyHistogram& other)
+  {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+      m_buckets[i] += other.m_buckets[i];
+    }
+    m_count += other.m_count;
+    m_sumSec += other.m_sumSec;
+    m_maxSec = std::max(m_maxSec, other.m_maxSec);
+  }
+
+  //----------------------------------------------------------------------------
+  void LatencyHistogram::Reset()
+  {
+    m_buckets.fill(0);
+    m_count = 0;
+    m_sumSec = 0.0;
+    m_maxSec = 0.0;
+  }
+
+  //----------------------------------------------------------------------------
+  uint64_t LatencyHistogram::GetCount() const
+  {
+    return m_count;
+  }
+
+  //----------------------------------------------------------------------------
+  double LatencyHistogram::GetMean() const
+  {
+    return m_count == 0 ? 0.0 : m_sumSec / m_count;
+  }
+
+  //----------------------------------------------------------------------------
+  double LatencyHistogram::GetMax() const
+  {
+    return m_maxSec;
+  }
+
+  //----------------------------------------------------------------------------
+  double LatencyHistogram::GetPercentile(double percentile) const
+  {
+    if (m_count == 0)
+    {
+      return 0.0;
+    }
+
+    // Rank of the requested sample, 1 based
+    uint64_t rank = static_cast<uint64_t>(std::ceil(std::min(std::max(percentile, 0.0), 100.0) / 100.0 * m_count));
+    rank = std::max<uint64_t>(rank, 1);
+
+    uint64_t cumulative(0);
+    for (size_t i = 0; i < BUCKET_COUNT; ++i)
+    {
+      cumulative += m_buckets[i];
+      if (cumulative >= rank)
+      {
+        return std::min(BucketMidpoint(i) * 1e-6, m_maxSec);
+      }
+    }
+    return m_maxSec;
+  }
+
+  //----------------------------------------------------------------------------
+  size_t LatencyHistogram::BucketIndex(uint64_t microseconds)
+  {
+    microseconds = std::min<uint64_t>(microseconds, (static_cast<uint64_t>(1) << (MAX_EXPONENT + 1)) - 1);
+    if (microseconds < SUB_BUCKET_COUNT)
+    {
+      return static_cast<size_t>(microseconds);
+    }
+
+    size_t exponent(0);
+    for (uint64_t value = microseconds; value > 1; value >>= 1)
+    {
+      exponent++;
+    }
+    size_t subBucket = static_cast<size_t>(microseconds >> (exponent - 4)) & (SUB_BUCKET_COUNT - 1);
+    return SUB_BUCKET_COUNT + (exponent - 4) * SUB_BUCKET_COUNT + subBucket;
+  }
+
+  //----------------------------------------------------------------------------
+  double LatencyHistogram::BucketMidpoint(size_t index)
+  {
+    if (index < SUB_BUCKET_COUNT)
+    {
+      return index + 0.5;
+    }
+
+    size_t exponent = (index - SUB_BUCKET_COUNT) / SUB_BUCKET_COUNT + 4;
+    size_t subBucket = (index - SUB_BUCKET_COUNT) % SUB_BUCKET_COUNT;
+    double width = static_cast<double>(static_cast<uint64_t>(1) << (exponent - 4));
+    return (SUB_BUCKET_COUNT + subBucket) * width + width / 2.0;
+  }
+
+  const size_t LatencyTracer::MAX_PENDING_PER_STREAM = 128;
+
+  //----------------------------------------------------------------------------
+  LatencyTracer& LatencyTracer::instance()
+  {
+    static LatencyTracer instance;
+    return instance;
+  }
+
+  //----------------------------------------------------------------------------
+  uint64_t LatencyTracer::MakeStreamId(uint64_t connection, uint64_t name)
+  {
+    return connection ^ (name + 0x9e3779b97f4a7c15ull + (connection << 6) + (connection >> 2));
+  }
+
+  //----------------------------------------------------------------------------
+  double LatencyTracer::Now()
+  {
+    return std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+  }
+
+  //----------------------------------------------------------------------------
+  void LatencyTracer::SetEnabled(bool enabled)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_enabled = enabled;
+    if (!enabled)
+    {
+      m_consumedSinceRender.clear();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool LatencyTracer::IsEnabled() const
+  {
+    return m_enabled.load(std::memory_order_relaxed);
+  }
+
+  //----------------------------------------------------------------------------
+  bool LatencyTracer::Stamp(uint64_t streamId, double messageTimestamp, LatencyStage stage)
+  {
+    if (!m_enabled.load(std::memory_order_relaxed))
+    {
+      return false;
+    }
+    return Stamp(streamId, messageTimestamp, stage, Now());
+  }
+
+  //----------------------------------------------------------------------------
+  bool LatencyTracer::Stamp(uint64_t streamId, double messageTimestamp, LatencyStage stage, double timeSec)
+  {
+    if (!m_enabled.load(std::memory_order_relaxed))
+    {
+      return false;
+    }
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (!m_enabled || stage >= LATENCY_STAGE_COUNT)
+    {
+      return false;
+    }
+
+    auto streamIter = m_streams.find(streamId);
+    bool newStream = streamIter == m_streams.end();
+    Stream& stream = newStream ? m_streams[streamId] : streamIter->second;
+
+    auto traceIter = stream.Pending.find(messageTimestamp);
+    if (traceIter == stream.Pending.end())
+    {
+      if (stream.Pending.size() >= MAX_PENDING_PER_STREAM)
+      {
+        // Messages that are never consumed (or never rendered) would otherwise accumulate
+        stream.Pending.erase(stream.Pending.begin());
+      }
+      traceIter = stream.Pending.insert(std::make_pair(messageTimestamp, Trace())).first;
+    }
+    Trace& trace = traceIter->second;
+
+    const uint32_t stageBit = 1u << stage;
+    if (trace.StampedMask & stageBit)
+    {
+      // Several consumers may pull the same message, the first one counts
+      return newStream;
+    }
+    trace.Times[stage] = timeSec;
+    trace.StampedMask |= stageBit;
+
+    // Time since the closest earlier stage that was stamped
+    for (int previous = static_cast<int>(stage) - 1; previous >= 0; --previous)
+    {
+      if (trace.StampedMask & (1u << previous))
+      {
+        stream.Stages[stage].Record(timeSec - trace.Times[previous]);
+        break;
+      }
+    }
+
+    if (stage == LATENCY_STAGE_CONSUMED)
+    {
+      m_consumedSinceRender.push_back(std::make_pair(streamId, messageTimestamp));
+    }
+    else if (stage == LATENCY_STAGE_RENDERED)
+    {
+      for (int first = LATENCY_STAGE_HANDOFF; first < LATENCY_STAGE_RENDERED; ++first)
+      {
+        if (trace.StampedMask & (1u << first))
+        {
+          stream.EndToEnd.Record(timeSec - trace.Times[first]);
+          break;
+        }
+      }
+      stream.Pending.erase(traceIter);
+    }
+
+    return newStream;
+  }
+
+  //----------------------------------------------------------------------------
+  void LatencyTracer::StampRendered()
+  {
+    if (!m_enabled.load(std::memory_order_relaxed))
+    {
+      return;
+    }
+
+    std::vector<std::pair<uint64_t, double>> consumed;
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      consumed.swap(m_consumedSinceRender);
+    }
+
+    const double now = Now();
+    for (auto& entry : consumed)
+    {
+      Stamp(entry.first, entry.second, LATENCY_STAGE_RENDERED, now);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void LatencyTracer::SetStreamName(uint64_t streamId, const std::string& name)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_streams[streamId].Name = name;
+  }
+
+  //----------------------------------------------------------------------------
+  bool LatencyTracer::GetStageLatency(uint64_t streamId, LatencyStage stage, Summary& outSummary) const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto iter = m_streams.find(streamId);
+    if (iter == m_streams.end() || stage >= LATENCY_STAGE_COUNT)
+    {
+      return false;
+    }
+    outSummary = Summarize(iter->second.Stages[stage]);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool LatencyTracer::GetEndToEndLatency(uint64_t streamId, Summary& outSummary) const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto iter = m_streams.find(streamId);
+    if (iter == m_streams.end())
+    {
+      return false;
+    }
+    outSummary = Summarize(iter->second.EndToEnd);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  std::vector<uint64_t> LatencyTracer::GetStreams() const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    std::vector<uint64_t> streams;
+    for (auto& pair : m_streams)
+    {
+      streams.push_back(pair.first);
+    }
+    return streams;
+  }
+
+  //----------------------------------------------------------------------------
+  std::string LatencyTracer::ToString() const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return ToStringInternal();
+  }
+
+  //----------------------------------------------------------------------------
+  bool LatencyTracer::DumpToFile(const std::string& fileName) const
+  {
+    std::string contents = ToString();
+    std::ofstream file(fileName, std::ios::out | std::ios::trunc);
+    if (!file.is_open())
+    {
+      return false;
+    }
+    file << contents;
+    return file.good();
+  }
+
+  //----------------------------------------------------------------------------
+  void LatencyTracer::Reset()
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    for (auto& pair : m_streams)
+    {
+      pair.second.Pending.clear();
+      for (auto& histogram : pair.second.Stages)
+      {
+        histogram.Reset();
+      }
+      pair.second.EndToEnd.Reset();
+    }
+    m_consumedSinceRender.clear();
+  }
+
+  //----------------------------------------------------------------------------
+  const char* LatencyTracer::StageToString(LatencyStage stage)
+  {
+    switch (stage)
+    {
+      case LATENCY_STAGE_SENT:
+        return "Sent";
+      case LATENCY_STAGE_HANDOFF:
+        return "Handoff";
+      case LATENCY_STAGE_CONSUMED:
+        return "Consumed";
+      case LATENCY_STAGE_RENDERED:
+        return "Rendered";
+      default:
+        return "Unknown";
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  LatencyTracer::LatencyTracer()
+  {
+  }
+
+  //----------------------------------------------------------------------------
+  LatencyTracer::~LatencyTracer()
+  {
+  }
+
+  //----------------------------------------------------------------------------
+  LatencyTracer::Summary LatencyTracer::Summarize(const LatencyHistogram& histogram)
+  {
+    Summary summary;
+    summary.Count = histogram.GetCount();
+    summary.MeanSec = histogram.GetMean();
+    summary.P50Sec = histogram.GetPercentile(50.0);
+    summary.P95Sec = histogram.GetPercentile(95.0);
+    summary.P99Sec = histogram.GetPercentile(99.0);
+    summary.MaxSec = histogram.GetMax();
+    return summary;
+  }
+
+  //----------------------------------------------------------------------------
+  std::string LatencyTracer::ToStringInternal() const
+  {
+    // Each stage row is the time since the previous stamped stage, in milliseconds
+    // Rows measured from Sent include any offset between the sender's clock and ours
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(3);
+    ss << "stream,stage,count,mean_ms,p50_ms,p95_ms,p99_ms,max_ms" << std::endl;
+
+    auto writeRow = [&ss](const std::string & name, const char* stage, const Summary & summary)
+    {
+      ss << name << "," << stage << "," << summary.Count << "," << summary.MeanSec * 1e3 << "," << summary.P50Sec * 1e3 << ","
+         << summary.P95Sec * 1e3 << "," << summary.P99Sec * 1e3 << "," << summary.MaxSec * 1e3 << std::endl;
+    };
+
+    for (auto& pair : m_streams)
+    {
+      std::string name = pair.second.Name;
+      if (name.empty())
+      {
+        std::ostringstream id;
+        id << std::hex << pair.first;
+        name = id.str();
+      }
+
+      for (int stage = LATENCY_STAGE_HANDOFF; stage < LATENCY_STAGE_COUNT; ++stage)
+      {
+        if (pair.second.Stages[stage].GetCount() > 0)
+        {
+          writeRow(name, StageToString(static_cast<LatencyStage>(stage)), Summarize(pair.second.Stages[stage]));
+        }
+      }
+      if (pair.second.EndToEnd.GetCount() > 0)
+      {
+        writeRow(name, "EndToEnd", Summarize(pair.second.EndToEnd));
+      }
+    }
+
+    return ss.str();
+  }
+}
\ No newline at end of file
@@ -0,0 +1,165 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace HoloIntervention
+{
+  // Points in the life of an IGT message at which it can be stamped
+  // Socket reads and unpacking happen inside the IGT client, which only hands out decoded messages, so the first local
+  // stamp is the handoff
+  enum LatencyStage
+  {
+    LATENCY_STAGE_SENT,       // Message timestamp, in the sender's clock
+    LATENCY_STAGE_HANDOFF,    // Handed out by NetworkSystem to a system (ToolSystem, ImagingSystem, ...)
+    LATENCY_STAGE_CONSUMED,   // Applied to a renderer (pose set, texture uploaded)
+    LATENCY_STAGE_RENDERED,   // First frame rendered after consumption
+    LATENCY_STAGE_COUNT
+  };
+
+  // Log-linear histogram of durations with 16 buckets per power of two, ~3% relative error, from 1 us to ~67 s
+  class LatencyHistogram
+  {
+  public:
+    void Record(double seconds);
+    void Merge(const LatencyHistogram& other);
+    void Reset();
+
+    uint64_t GetCount() const;
+    double GetMean() const;
+    double GetMax() const;
+
+    /// percentile in [0, 100]
+    double GetPercentile(double percentile) const;
+
+  protected:
+    static size_t BucketIndex(uint64_t microseconds);
+    static double BucketMidpoint(size_t index);
+
+  protected:
+    static const size_t                 SUB_BUCKET_COUNT = 16;
+    static const size_t                 MAX_EXPONENT = 26;
+    static const size_t                 BUCKET_COUNT = SUB_BUCKET_COUNT + (MAX_EXPONENT - 3) * SUB_BUCKET_COUNT;
+
+    std::array<uint32_t, BUCKET_COUNT>  m_buckets = {};
+    uint64_t                            m_count = 0;
+    double                              m_sumSec = 0.0;
+    double                              m_maxSec = 0.0;
+  };
+
+  // Collects stage stamps for messages of each stream, and aggregates the time between consecutive stages into histograms
+  // A message is identified by its stream and its timestamp, every stage keeps the first stamp it receives
+  // Tracing is off by default, a disabled tracer costs one relaxed atomic load per stamp and never takes the lock
+  class LatencyTracer
+  {
+  public:
+    struct Summary
+    {
+      uint64_t  Count = 0;
+      double    MeanSec = 0.0;
+      double    P50Sec = 0.0;
+      double    P95Sec = 0.0;
+      double    P99Sec = 0.0;
+      double    MaxSec = 0.0;
+    };
+
+  public:
+    static LatencyTracer& instance();
+
+    /// Combine a connection and a device/transform name hash into a stream id
+    static uint64_t MakeStreamId(uint64_t connection, uint64_t name);
+
+    /// Seconds since the UNIX epoch, the same base as OpenIGTLink timestamps
+    static double Now();
+
+    /// Disabling drops messages that were consumed but not yet rendered, collected histograms are kept
+    void SetEnabled(bool enabled);
+    bool IsEnabled() const;
+
+    /// Stamp a stage at the current time. Returns true the first time a stream is seen, so the caller can name it
+    bool Stamp(uint64_t streamId, double messageTimestamp, LatencyStage stage);
+    bool Stamp(uint64_t streamId, double messageTimestamp, LatencyStage stage, double timeSec);
+
+    /// Stamp LATENCY_STAGE_RENDERED on every message consumed since the last call, call once per rendered frame
+    void StampRendered();
+
+    void SetStreamName(uint64_t streamId, const std::string& name);
+
+    /// Time from the previous stamped stage to stage
+    bool GetStageLatency(uint64_t streamId, LatencyStage stage, Summary& outSummary) const;
+
+    /// Time from the first local stamp to LATENCY_STAGE_RENDERED
+    bool GetEndToEndLatency(uint64_t streamId, Summary& outSummary) const;
+
+    std::vector<uint64_t> GetStreams() const;
+
+    std::string ToString() const;
+    bool DumpToFile(const std::string& fileName) const;
+
+    void Reset();
+
+    static const char* StageToString(LatencyStage stage);
+
+  public:
+    LatencyTracer();
+    ~LatencyTracer();
+
+  protected:
+    struct Trace
+    {
+      std::array<double, LATENCY_STAGE_COUNT>   Times;
+      uint32_t                                  StampedMask = 0;
+    };
+
+    struct Stream
+    {
+      std::string                                         Name;
+      std::map<double, Trace>                             Pending;   // Keyed by message timestamp
+      std::array<LatencyHistogram, LATENCY_STAGE_COUNT>   Stages;
+      LatencyHistogram                                    EndToEnd;
+    };
+
+  protected:
+    static Summary Summarize(const LatencyHistogram& histogram);
+    std::string ToStringInternal() const;
+
+  protected:
+    mutable std::mutex                                    m_mutex;
+    std::atomic_bool                                      m_enabled{ false };
+    std::unordered_map<uint64_t, Stream>                  m_streams;
+    std::vector<std::pair<uint64_t, double>>              m_consumedSinceRender;
+
+    static const size_t                                   MAX_PENDING_PER_STREAM;
+  };
+}
\ No newline at end of file
@@ -0,0 +1,96 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstring>
+
+// SIMD includes
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #include <emmintrin.h>
+  #define HOLOINTERVENTION_LANES_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM) || defined(_M_ARM64)
+  #include <arm_neon.h>
+  #define HOLOINTERVENTION_LANES_NEON
+#endif
+
+namespace HoloIntervention
+{
+  /// Four floats in one SSE2 or NEON register, or a plain array where neither is available
+  /// Only IEEE add, subtract, multiply and divide are used, so every backend rounds exactly like scalar code
+  struct Float4Lanes
+  {
+#if defined(HOLOINTERVENTION_LANES_SSE2)
+    __m128 v;
+    static Float4Lanes Load(const float* source) { Float4Lanes result; result.v = _mm_loadu_ps(source); return result; }
+    static Float4Lanes Set(float value) { Float4Lanes result; result.v = _mm_set1_ps(value); return result; }
+    static Float4Lanes Set(float x, float y, float z, float w) { Float4Lanes result; result.v = _mm_setr_ps(x, y, z, w); return result; }
+    void Store(float* destination) const { _mm_storeu_ps(destination, v); }
+    Float4Lanes operator+(const Float4Lanes& other) const { Float4Lanes result; result.v = _mm_add_ps(v, other.v); return result; }
+    Float4Lanes operator-(const Float4Lanes& other) const { Float4Lanes result; result.v = _mm_sub_ps(v, other.v); return result; }
+    Float4Lanes operator*(const Float4Lanes& other) const { Float4Lanes result; result.v = _mm_mul_ps(v, other.v); return result; }
+    Float4Lanes operator/(const Float4Lanes& other) const { Float4Lanes result; result.v = _mm_div_ps(v, other.v); return result; }
+#elif defined(HOLOINTERVENTION_LANES_NEON)
+    float32x4_t v;
+    static Float4Lanes Load(const float* source) { Float4Lanes result; result.v = vld1q_f32(source); return result; }
+    static Float4Lanes Set(float value) { Float4Lanes result; result.v = vdupq_n_f32(value); return result; }
+    static Float4Lanes Set(float x, float y, float z, float w) { const float values[4] = { x, y, z, w }; return Load(values); }
+    void Store(float* destination) const { vst1q_f32(destination, v); }
+    Float4Lanes operator+(const Float4Lanes& other) const { Float4Lanes result; result.v = vaddq_f32(v, other.v); return result; }
+    Float4Lanes operator-(const Float4Lanes& other) const { Float4Lanes result; result.v = vsubq_f32(v, other.v); return result; }
+    Float4Lanes operator*(const Float4Lanes& other) const { Float4Lanes result; result.v = vmulq_f32(v, other.v); return result; }
+#if defined(__aarch64__) || defined(_M_ARM64)
+    Float4Lanes operator/(const Float4Lanes& other) const { Float4Lanes result; result.v = vdivq_f32(v, other.v); return result; }
+#else
+    Float4Lanes operator/(const Float4Lanes& other) const
+    {
+      // ARMv7 NEON has no divide
+      float a[4], b[4];
+      Store(a);
+      other.Store(b);
+      return Set(a[0] / b[0], a[1] / b[1], a[2] / b[2], a[3] / b[3]);
+    }
+#endif
+#else
+    float v[4];
+    static Float4Lanes Load(const float* source) { Float4Lanes result; memcpy(result.v, source, sizeof(result.v)); return result; }
+    static Float4Lanes Set(float value) { return Set(value, value, value, value); }
+    static Float4Lanes Set(float x, float y, float z, float w) { Float4Lanes result; result.v[0] = x; result.v[1] = y; result.v[2] = z; result.v[3] = w; return result; }
+    void Store(float* destination) const { memcpy(destination, v, sizeof(v)); }
+    Float4Lanes operator+(const Float4Lanes& other) const { return Set(v[0] + other.v[0], v[1] + other.v[1], v[2] + other.v[2], v[3] + other.v[3]); }
+    Float4Lanes operator-(const Float4Lanes& other) const { return Set(v[0] - other.v[0], v[1] - other.v[1], v[2] - other.v[2], v[3] - other.v[3]); }
+    Float4Lanes operator*(const Float4Lanes& other) const { return Set(v[0] * other.v[0], v[1] * other.v[1], v[2] * other.v[2], v[3] * other.v[3]); }
+    Float4Lanes operator/(const Float4Lanes& other) const { return Set(v[0] / other.v[0], v[1] / other.v[1], v[2] / other.v[2], v[3] / other.v[3]); }
+#endif
+
+    /// (x + y) + (z + w)
+    float Sum() const
+    {
+      float values[4];
+      Store(values);
+      return (values[0] + values[1]) + (values[2] + values[3]);
+    }
+  };
+}
\ No newline at end of file
@@ -0,0 +1,156 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "PoseDecomposition.h"
+
+// STL includes
+#include <cmath>
+
+namespace HoloIntervention
+{
+  //----------------------------------------------------------------------------
+  DecomposedPose DecomposePose(const std::array<float, 16>& m)
+  {
+    DecomposedPose pose;
+    double r[3][3];
+    for (int col = 0; col < 3; ++col)
+    {
+      double length = std::sqrt((double)m[col] * m[col] + (double)m[4 + col] * m[4 + col] + (double)m[8 + col] * m[8 + col]);
+      pose.Scale[col] = length;
+      for (int row = 0; row < 3; ++row)
+      {
+        r[row][col] = length > 0.0 ? m[row * 4 + col] / length : (row == col ? 1.0 : 0.0);
+      }
+      pose.Translation[col] = m[col * 4 + 3];
+    }
+
+    // Shepperd's method, pick the largest diagonal term for stability
+    double trace = r[0][0] + r[1][1] + r[2][2];
+    double* q = pose.Rotation;
+    if (trace > 0.0)
+    {
+      double s = std::sqrt(trace + 1.0) * 2.0;
+      q[3] = 0.25 * s;
+      q[0] = (r[2][1] - r[1][2]) / s;
+      q[1] = (r[0][2] - r[2][0]) / s;
+      q[2] = (r[1][0] - r[0][1]) / s;
+    }
+    else if (r[0][0] > r[1][1] && r[0][0] > r[2][2])
+    {
+      double s = std::sqrt(1.0 + r[0][0] - r[1][1] - r[2][2]) * 2.0;
+      q[3] = (r[2][1] - r[1][2]) / s;
+      q[0] = 0.25 * s;
+      q[1] = (r[0][1] + r[1][0]) / s;
+      q[2] = (r[0][2] + r[2][0]) / s;
+    }
+    else if (r[1][1] > r[2][2])
+    {
+      double s = std::sqrt(1.0 + r[1][1] - r[0][0] - r[2][2]) * 2.0;
+      q[3] = (r[0][2] - r[2][0]) / s;
+      q[0] = (r[0][1] + r[1][0]) / s;
+      q[1] = 0.25 * s;
+      q[2] = (r[1][2] + r[2][1]) / s;
+    }
+    else
+    {
+      double s = std::sqrt(1.0 + r[2][2] - r[0][0] - r[1][1]) * 2.0;
+      q[3] = (r[1][0] - r[0][1]) / s;
+      q[0] = (r[0][2] + r[2][0]) / s;
+      q[1] = (r[1][2] + r[2][1]) / s;
+      q[2] = 0.25 * s;
+    }
+    return pose;
+  }
+
+  //----------------------------------------------------------------------------
+  std::array<float, 16> ComposePose(const DecomposedPose& pose)
+  {
+    const double x = pose.Rotation[0], y = pose.Rotation[1], z = pose.Rotation[2], w = pose.Rotation[3];
+    const double r[3][3] =
+    {
+      { 1.0 - 2.0 * (y * y + z * z), 2.0 * (x * y - z * w), 2.0 * (x * z + y * w) },
+      { 2.0 * (x * y + z * w), 1.0 - 2.0 * (x * x + z * z), 2.0 * (y * z - x * w) },
+      { 2.0 * (x * z - y * w), 2.0 * (y * z + x * w), 1.0 - 2.0 * (x * x + y * y) }
+    };
+
+    std::array<float, 16> m;
+    for (int row = 0; row < 3; ++row)
+    {
+      for (int col = 0; col < 3; ++col)
+      {
+        m[row * 4 + col] = static_cast<float>(r[row][col] * pose.Scale[col]);
+      }
+      m[row * 4 + 3] = static_cast<float>(pose.Translation[row]);
+    }
+    m[12] = 0.f;
+    m[13] = 0.f;
+    m[14] = 0.f;
+    m[15] = 1.f;
+    return m;
+  }
+
+  //----------------------------------------------------------------------------
+  void QuaternionMultiply(const double a[4], const double b[4], double outQuaternion[4])
+  {
+    const double x = a[3] * b[0] + a[0] * b[3] + a[1] * b[2] - a[2] * b[1];
+    const double y = a[3] * b[1] - a[0] * b[2] + a[1] * b[3] + a[2] * b[0];
+    const double z = a[3] * b[2] + a[0] * b[1] - a[1] * b[0] + a[2] * b[3];
+    const double w = a[3] * b[3] - a[0] * b[0] - a[1] * b[1] - a[2] * b[2];
+    outQuaternion[0] = x;
+    outQuaternion[1] = y;
+    outQuaternion[2] = z;
+    outQuaternion[3] = w;
+  }
+
+  //----------------------------------------------------------------------------
+  void QuaternionToRotationVector(const double quaternion[4], double outRotationVector[3])
+  {
+    // q and -q are the same rotation, take the short way round
+    const double sign = quaternion[3] < 0.0 ? -1.0 : 1.0;
+    const double sinHalfAngle = std::sqrt(quaternion[0] * quaternion[0] + quaternion[1] * quaternion[1] + quaternion[2] * quaternion[2]);
+    double scale(2.0 * sign);
+    if (sinHalfAngle > 1e-9)
+    {
+      scale = 2.0 * std::atan2(sinHalfAngle, sign * quaternion[3]) / sinHalfAngle * sign;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      outRotationVector[i] = quaternion[i] * scale;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void RotationVectorToQuaternion(const double rotationVector[3], double outQuaternion[4])
+  {
+    const double angle = std::sqrt(rotationVector[0] * rotationVector[0] + rotationVector[1] * rotationVector[1] + rotationVector[2] * rotationVector[2]);
+    const double scale = angle > 1e-9 ? std::sin(angle * 0.5) / angle : 0.5;
+    for (int i = 0; i < 3; ++i)
+    {
+      outQuaternion[i] = rotationVector[i] * scale;
+    }
+    outQuaternion[3] = std::cos(angle * 0.5);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,48 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <array>
+
+namespace HoloIntervention
+{
+  /// Rotation, translation and per-axis scale of an affine pose without shear
+  struct DecomposedPose
+  {
+    double Rotation[4];     // Quaternion x, y, z, w
+    double Translation[3];
+    double Scale[3];
+  };
+
+  /// Matrices are row major, column vectors (the TransformRepository convention)
+  DecomposedPose DecomposePose(const std::array<float, 16>& matrix);
+  std::array<float, 16> ComposePose(const DecomposedPose& pose);
+
+  /// Quaternion helpers, x y z w order
+  void QuaternionMultiply(const double a[4], const double b[4], double outQuaternion[4]);
+  void QuaternionToRotationVector(const double quaternion[4], double outRotationVector[3]);
+  void RotationVectorToQuaternion(const double rotationVector[3], double outQuaternion[4]);
+}
\ No newline at end of file
@@ -0,0 +1,293 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "PoseDecomposition.h"
+#include "PosePredictor.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  void ClampMagnitude(double vector[3], double maximum)
+  {
+    const double magnitude = std::sqrt(vector[0] * vector[0] + vector[1] * vector[1] + vector[2] * vector[2]);
+    if (magnitude > maximum && magnitude > 0.0)
+    {
+      const double scale = maximum / magnitude;
+      for (int i = 0; i < 3; ++i)
+      {
+        vector[i] *= scale;
+      }
+    }
+  }
+}
+
+namespace HoloIntervention
+{
+  //----------------------------------------------------------------------------
+  PosePredictor::PosePredictor()
+  {
+    Reset();
+  }
+
+  //----------------------------------------------------------------------------
+  void PosePredictor::SetSettings(const Settings& settings)
+  {
+    m_settings = settings;
+    UpdateVelocity();
+  }
+
+  //----------------------------------------------------------------------------
+  const PosePredictor::Settings& PosePredictor::GetSettings() const
+  {
+    return m_settings;
+  }
+
+  //----------------------------------------------------------------------------
+  bool PosePredictor::AddSample(double deviceTimestamp, double localArrivalTime, const Matrix& pose, bool valid)
+  {
+    if (!valid)
+    {
+      // Tracking dropped, the next valid sample starts a fresh fit
+      Reset();
+      return false;
+    }
+
+    if (m_count > 0 && deviceTimestamp == m_time[0])
+    {
+      return false;
+    }
+
+    if (m_count > 0 && deviceTimestamp < m_time[0])
+    {
+      // Velocities and clock offsets fitted on the old timeline are meaningless on the new one
+      Reset();
+    }
+
+    DecomposedPose decomposed = DecomposePose(pose);
+
+    // Keep quaternions in one hemisphere so the fit doesn't see sign flips
+    if (m_count > 0)
+    {
+      const double dot = decomposed.Rotation[0] * m_rotation[0][0] + decomposed.Rotation[1] * m_rotation[1][0] + decomposed.Rotation[2] * m_rotation[2][0] + decomposed.Rotation[3] * m_rotation[3][0];
+      if (dot < 0.0)
+      {
+        for (int i = 0; i < 4; ++i)
+        {
+          decomposed.Rotation[i] = -decomposed.Rotation[i];
+        }
+      }
+    }
+
+    const uint32_t last = std::min(m_count, WINDOW_SIZE - 1);
+    for (uint32_t i = last; i > 0; --i)
+    {
+      m_time[i] = m_time[i - 1];
+      m_clockOffset[i] = m_clockOffset[i - 1];
+      for (int j = 0; j < 3; ++j)
+      {
+        m_translation[j][i] = m_translation[j][i - 1];
+      }
+      for (int j = 0; j < 4; ++j)
+      {
+        m_rotation[j][i] = m_rotation[j][i - 1];
+      }
+    }
+
+    m_time[0] = deviceTimestamp;
+    m_clockOffset[0] = localArrivalTime - deviceTimestamp;
+    for (int j = 0; j < 3; ++j)
+    {
+      m_translation[j][0] = decomposed.Translation[j];
+      m_newestScale[j] = decomposed.Scale[j];
+    }
+    for (int j = 0; j < 4; ++j)
+    {
+      m_rotation[j][0] = decomposed.Rotation[j];
+    }
+    m_count = std::min(m_count + 1, WINDOW_SIZE);
+    m_newestValid = true;
+
+    UpdateVelocity();
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void PosePredictor::Reset()
+  {
+    m_count = 0;
+    m_newestValid = false;
+    std::fill(std::begin(m_time), std::end(m_time), 0.0);
+    std::fill(std::begin(m_clockOffset), std::end(m_clockOffset), 0.0);
+    for (int j = 0; j < 3; ++j)
+    {
+      std::fill(std::begin(m_translation[j]), std::end(m_translation[j]), 0.0);
+      m_newestScale[j] = 1.0;
+      m_linearVelocity[j] = 0.0;
+      m_angularVelocity[j] = 0.0;
+    }
+    for (int j = 0; j < 4; ++j)
+    {
+      std::fill(std::begin(m_rotation[j]), std::end(m_rotation[j]), j == 3 ? 1.0 : 0.0);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool PosePredictor::PredictAtLocalTime(double localTime, Matrix& outPose) const
+  {
+    return PredictAtDeviceTime(localTime - GetClockOffset() + m_settings.AdditionalLatencySec, outPose);
+  }
+
+  //----------------------------------------------------------------------------
+  bool PosePredictor::PredictAtDeviceTime(double deviceTime, Matrix& outPose) const
+  {
+    if (m_count == 0)
+    {
+      return false;
+    }
+
+    double horizon = std::min(std::max(deviceTime - m_time[0], 0.0), m_settings.MaxHorizonSec);
+    if (deviceTime - m_time[0] > m_settings.StaleSec)
+    {
+      horizon = 0.0;
+    }
+
+    DecomposedPose pose;
+    double delta[3];
+    for (int j = 0; j < 3; ++j)
+    {
+      pose.Translation[j] = m_translation[j][0] + m_linearVelocity[j] * horizon;
+      pose.Scale[j] = m_newestScale[j];
+      delta[j] = m_angularVelocity[j] * horizon;
+    }
+
+    const double newest[4] = { m_rotation[0][0], m_rotation[1][0], m_rotation[2][0], m_rotation[3][0] };
+    double deltaRotation[4];
+    RotationVectorToQuaternion(delta, deltaRotation);
+    QuaternionMultiply(newest, deltaRotation, pose.Rotation);
+
+    outPose = ComposePose(pose);
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool PosePredictor::HasSample() const
+  {
+    return m_count > 0;
+  }
+
+  //----------------------------------------------------------------------------
+  bool PosePredictor::IsValid() const
+  {
+    return m_newestValid;
+  }
+
+  //----------------------------------------------------------------------------
+  double PosePredictor::GetClockOffset() const
+  {
+    double offset = std::numeric_limits<double>::max();
+    for (uint32_t i = 0; i < m_count; ++i)
+    {
+      offset = std::min(offset, m_clockOffset[i]);
+    }
+    return m_count == 0 ? 0.0 : offset;
+  }
+
+  //----------------------------------------------------------------------------
+  void PosePredictor::GetVelocity(double outLinear[3], double outAngular[3]) const
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      outLinear[j] = m_linearVelocity[j];
+      outAngular[j] = m_angularVelocity[j];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void PosePredictor::UpdateVelocity()
+  {
+    for (int j = 0; j < 3; ++j)
+    {
+      m_linearVelocity[j] = 0.0;
+      m_angularVelocity[j] = 0.0;
+    }
+    if (m_count < 2)
+    {
+      return;
+    }
+
+    // Relative times and rotations in the newest sample's frame, zero weight outside the window
+    alignas(32) double dt[WINDOW_SIZE];
+    alignas(32) double rotationVector[3][WINDOW_SIZE];
+    const double inverseNewest[4] = { -m_rotation[0][0], -m_rotation[1][0], -m_rotation[2][0], m_rotation[3][0] };
+    for (uint32_t i = 0; i < WINDOW_SIZE; ++i)
+    {
+      const bool used = i < m_count && m_time[0] - m_time[i] <= m_settings.VelocityWindowSec;
+      dt[i] = used ? m_time[i] - m_time[0] : 0.0;
+
+      double sample[4] = { m_rotation[0][i], m_rotation[1][i], m_rotation[2][i], m_rotation[3][i] };
+      double relative[4];
+      double vector[3];
+      QuaternionMultiply(inverseNewest, sample, relative);
+      QuaternionToRotationVector(relative, vector);
+      for (int j = 0; j < 3; ++j)
+      {
+        rotationVector[j][i] = used ? vector[j] : 0.0;
+      }
+    }
+
+    // Least squares slope through the newest sample: v = sum(dt * dx) / sum(dt^2)
+    double sumSquares(0.0);
+    for (uint32_t i = 0; i < WINDOW_SIZE; ++i)
+    {
+      sumSquares += dt[i] * dt[i];
+    }
+    if (sumSquares <= 0.0)
+    {
+      return;
+    }
+
+    for (int j = 0; j < 3; ++j)
+    {
+      double linear(0.0);
+      double angular(0.0);
+      for (uint32_t i = 0; i < WINDOW_SIZE; ++i)
+      {
+        linear += dt[i] * (m_translation[j][i] - m_translation[j][0]);
+        angular += dt[i] * rotationVector[j][i];
+      }
+      m_linearVelocity[j] = linear / sumSquares;
+      m_angularVelocity[j] = angular / sumSquares;
+    }
+
+    ClampMagnitude(m_linearVelocity, m_settings.MaxLinearSpeed);
+    ClampMagnitude(m_angularVelocity, m_settings.MaxAngularSpeed);
+  }
+}
\ No newline at end of file
@@ -0,0 +1,95 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <array>
+#include <cstdint>
+
+namespace HoloIntervention
+{
+  // Extrapolates a tracked pose to the time its frame reaches the display
+  // Linear and angular velocity are least-squares fits over the most recent samples, anchored at the newest sample so a
+  // stationary tool is not dragged. Sample timestamps are in the tracker clock, render targets in the local clock; the
+  // offset between them is the minimum (local arrival - device timestamp) over the window, which includes the fastest
+  // observed transport but not the tracker's own latency.
+  // Matrices follow the TransformRepository convention: row major, column vectors.
+  class PosePredictor
+  {
+  public:
+    typedef std::array<float, 16> Matrix;
+
+    struct Settings
+    {
+      double    MaxHorizonSec = 0.1;            // Never extrapolate further than this past the newest sample
+      double    VelocityWindowSec = 0.05;       // Samples older than this relative to the newest don't contribute
+      double    StaleSec = 0.25;                // No extrapolation once the newest sample is this old, tracking was probably lost
+      double    MaxLinearSpeed = 3000.0;        // Units per second, velocity is clamped to this (tracker units, usually mm)
+      double    MaxAngularSpeed = 12.57;        // Radians per second
+      double    AdditionalLatencySec = 0.0;     // Tracker latency not visible in the clock offset
+    };
+
+  public:
+    PosePredictor();
+
+    void SetSettings(const Settings& settings);
+    const Settings& GetSettings() const;
+
+    /// Add a tracker sample, true if it is now the newest sample. A repeat of the newest timestamp is ignored, an invalid
+    /// sample or one older than the newest (the tracker restarted its clock) resets the predictor.
+    bool AddSample(double deviceTimestamp, double localArrivalTime, const Matrix& pose, bool valid = true);
+    void Reset();
+
+    /// Pose at a local clock time (eg. the predicted photon time of the frame being rendered)
+    bool PredictAtLocalTime(double localTime, Matrix& outPose) const;
+    /// Pose at a tracker clock time
+    bool PredictAtDeviceTime(double deviceTime, Matrix& outPose) const;
+
+    bool HasSample() const;
+    bool IsValid() const;
+    double GetClockOffset() const;
+    void GetVelocity(double outLinear[3], double outAngular[3]) const; // Angular is in the body frame of the newest sample
+
+  protected:
+    void UpdateVelocity();
+
+  protected:
+    static const uint32_t     WINDOW_SIZE = 8;
+
+    Settings                  m_settings;
+
+    // Structure of arrays so the fits vectorize, index 0 is the newest sample
+    alignas(32) double        m_time[WINDOW_SIZE];
+    alignas(32) double        m_translation[3][WINDOW_SIZE];
+    alignas(32) double        m_rotation[4][WINDOW_SIZE];
+    alignas(32) double        m_clockOffset[WINDOW_SIZE];
+    uint32_t                  m_count = 0;
+
+    double                    m_newestScale[3];
+    bool                      m_newestValid = false;
+    double                    m_linearVelocity[3];
+    double                    m_angularVelocity[3];
+  };
+}
\ No newline at end of file
@@ -0,0 +1,452 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "TransformGraph.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <limits>
+
+namespace HoloIntervention
+{
+  const TransformGraph::FrameId TransformGraph::INVALID_FRAME = std::numeric_limits<uint32_t>::max();
+  const TransformGraph::ChainId TransformGraph::INVALID_CHAIN = std::numeric_limits<uint32_t>::max();
+
+  //----------------------------------------------------------------------------
+  TransformGraph::FrameId TransformGraph::InternFrame(const std::wstring& name)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto iter = m_frameIds.find(name);
+    if (iter != m_frameIds.end())
+    {
+      return iter->second;
+    }
+
+    FrameId id = static_cast<FrameId>(m_frameNames.size());
+    m_frameNames.push_back(name);
+    m_frameIds[name] = id;
+    m_adjacency.emplace_back();
+    return id;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::FindFrame(const std::wstring& name, FrameId& outId) const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto iter = m_frameIds.find(name);
+    if (iter == m_frameIds.end())
+    {
+      return false;
+    }
+    outId = iter->second;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  std::wstring TransformGraph::GetFrameName(FrameId id) const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return id < m_frameNames.size() ? m_frameNames[id] : std::wstring();
+  }
+
+  //----------------------------------------------------------------------------
+  size_t TransformGraph::GetFrameCount() const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_frameNames.size();
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::SetTransform(FrameId from, FrameId to, const Matrix& fromToTo, bool valid)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (from >= m_frameNames.size() || to >= m_frameNames.size() || from == to)
+    {
+      return false;
+    }
+
+    auto iter = m_linkLookup.find(PairKey(from, to));
+    if (iter != m_linkLookup.end())
+    {
+      Link& link = m_links[iter->second];
+      link.FromToTo = fromToTo;
+      link.Valid = valid;
+      link.Version = m_nextLinkVersion++;
+      return true;
+    }
+
+    iter = m_linkLookup.find(PairKey(to, from));
+    if (iter != m_linkLookup.end())
+    {
+      Link& link = m_links[iter->second];
+      if (!Invert(fromToTo, link.FromToTo))
+      {
+        return false;
+      }
+      link.Valid = valid;
+      link.Version = m_nextLinkVersion++;
+      return true;
+    }
+
+    // New link, the shape of the graph changed so every chain searches its path again on next use
+    Link link;
+    link.From = from;
+    link.To = to;
+    link.FromToTo = fromToTo;
+    link.Valid = valid;
+    link.Version = m_nextLinkVersion++;
+    uint32_t index = static_cast<uint32_t>(m_links.size());
+    if (m_freeLinks.empty())
+    {
+      m_links.push_back(link);
+    }
+    else
+    {
+      index = m_freeLinks.back();
+      m_freeLinks.pop_back();
+      m_links[index] = link;
+    }
+    m_linkLookup[PairKey(from, to)] = index;
+
+    Step forward;
+    forward.LinkIndex = index;
+    forward.Inverse = false;
+    m_adjacency[from].push_back(std::make_pair(to, forward));
+    Step backward;
+    backward.LinkIndex = index;
+    backward.Inverse = true;
+    m_adjacency[to].push_back(std::make_pair(from, backward));
+
+    m_structureVersion++;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::SetTransform(const std::wstring& from, const std::wstring& to, const Matrix& fromToTo, bool valid)
+  {
+    return SetTransform(InternFrame(from), InternFrame(to), fromToTo, valid);
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::SetTransformValid(FrameId from, FrameId to, bool valid)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto iter = m_linkLookup.find(PairKey(from, to));
+    if (iter == m_linkLookup.end())
+    {
+      iter = m_linkLookup.find(PairKey(to, from));
+      if (iter == m_linkLookup.end())
+      {
+        return false;
+      }
+    }
+    Link& link = m_links[iter->second];
+    if (link.Valid != valid)
+    {
+      link.Valid = valid;
+      link.Version = m_nextLinkVersion++;
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::RemoveTransform(FrameId from, FrameId to)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto iter = m_linkLookup.find(PairKey(from, to));
+    if (iter == m_linkLookup.end())
+    {
+      iter = m_linkLookup.find(PairKey(to, from));
+      if (iter == m_linkLookup.end())
+      {
+        return false;
+      }
+    }
+
+    const uint32_t index = iter->second;
+    const Link& link = m_links[index];
+    for (FrameId frame : { link.From, link.To })
+    {
+      auto& neighbours = m_adjacency[frame];
+      neighbours.erase(std::remove_if(neighbours.begin(), neighbours.end(), [index](const std::pair<FrameId, Step>& neighbour)
+      {
+        return neighbour.second.LinkIndex == index;
+      }), neighbours.end());
+    }
+    m_linkLookup.erase(iter);
+    m_freeLinks.push_back(index);
+
+    // Chains that used the link must not read its slot again, and chains without a path may now find a different one
+    m_structureVersion++;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  TransformGraph::ChainId TransformGraph::CompileChain(FrameId from, FrameId to)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return CompileChainInternal(from, to);
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::GetTransform(ChainId chain, Matrix& outMatrix, bool& outValid)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (chain >= m_chains.size())
+    {
+      return false;
+    }
+    return Evaluate(m_chains[chain], outMatrix, outValid);
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::GetTransform(FrameId from, FrameId to, Matrix& outMatrix, bool& outValid)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    ChainId chain = CompileChainInternal(from, to);
+    if (chain == INVALID_CHAIN)
+    {
+      return false;
+    }
+    return Evaluate(m_chains[chain], outMatrix, outValid);
+  }
+
+  //----------------------------------------------------------------------------
+  TransformGraph::Stats TransformGraph::GetStats() const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_stats;
+  }
+
+  //----------------------------------------------------------------------------
+  TransformGraph::Matrix TransformGraph::Identity()
+  {
+    Matrix identity = { 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+    return identity;
+  }
+
+  //----------------------------------------------------------------------------
+  TransformGraph::Matrix TransformGraph::Multiply(const Matrix& lhs, const Matrix& rhs)
+  {
+    Matrix result;
+    for (int row = 0; row < 4; ++row)
+    {
+      const float* l = &lhs[row * 4];
+      for (int col = 0; col < 4; ++col)
+      {
+        result[row * 4 + col] = l[0] * rhs[col] + l[1] * rhs[4 + col] + l[2] * rhs[8 + col] + l[3] * rhs[12 + col];
+      }
+    }
+    return result;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::Invert(const Matrix& m, Matrix& outInverse)
+  {
+    // Cofactor expansion in double, links may carry scale (image to probe) so a rigid inverse is not enough
+    double inv[16];
+    inv[0] = (double)m[5] * m[10] * m[15] - (double)m[5] * m[11] * m[14] - (double)m[9] * m[6] * m[15] + (double)m[9] * m[7] * m[14] + (double)m[13] * m[6] * m[11] - (double)m[13] * m[7] * m[10];
+    inv[4] = -(double)m[4] * m[10] * m[15] + (double)m[4] * m[11] * m[14] + (double)m[8] * m[6] * m[15] - (double)m[8] * m[7] * m[14] - (double)m[12] * m[6] * m[11] + (double)m[12] * m[7] * m[10];
+    inv[8] = (double)m[4] * m[9] * m[15] - (double)m[4] * m[11] * m[13] - (double)m[8] * m[5] * m[15] + (double)m[8] * m[7] * m[13] + (double)m[12] * m[5] * m[11] - (double)m[12] * m[7] * m[9];
+    inv[12] = -(double)m[4] * m[9] * m[14] + (double)m[4] * m[10] * m[13] + (double)m[8] * m[5] * m[14] - (double)m[8] * m[6] * m[13] - (double)m[12] * m[5] * m[10] + (double)m[12] * m[6] * m[9];
+    inv[1] = -(double)m[1] * m[10] * m[15] + (double)m[1] * m[11] * m[14] + (double)m[9] * m[2] * m[15] - (double)m[9] * m[3] * m[14] - (double)m[13] * m[2] * m[11] + (double)m[13] * m[3] * m[10];
+    inv[5] = (double)m[0] * m[10] * m[15] - (double)m[0] * m[11] * m[14] - (double)m[8] * m[2] * m[15] + (double)m[8] * m[3] * m[14] + (double)m[12] * m[2] * m[11] - (double)m[12] * m[3] * m[10];
+    inv[9] = -(double)m[0] * m[9] * m[15] + (double)m[0] * m[11] * m[13] + (double)m[8] * m[1] * m[15] - (double)m[8] * m[3] * m[13] - (double)m[12] * m[1] * m[11] + (double)m[12] * m[3] * m[9];
+    inv[13] = (double)m[0] * m[9] * m[14] - (double)m[0] * m[10] * m[13] - (double)m[8] * m[1] * m[14] + (double)m[8] * m[2] * m[13] + (double)m[12] * m[1] * m[10] - (double)m[12] * m[2] * m[9];
+    inv[2] = (double)m[1] * m[6] * m[15] - (double)m[1] * m[7] * m[14] - (double)m[5] * m[2] * m[15] + (double)m[5] * m[3] * m[14] + (double)m[13] * m[2] * m[7] - (double)m[13] * m[3] * m[6];
+    inv[6] = -(double)m[0] * m[6] * m[15] + (double)m[0] * m[7] * m[14] + (double)m[4] * m[2] * m[15] - (double)m[4] * m[3] * m[14] - (double)m[12] * m[2] * m[7] + (double)m[12] * m[3] * m[6];
+    inv[10] = (double)m[0] * m[5] * m[15] - (double)m[0] * m[7] * m[13] - (double)m[4] * m[1] * m[15] + (double)m[4] * m[3] * m[13] + (double)m[12] * m[1] * m[7] - (double)m[12] * m[3] * m[5];
+    inv[14] = -(double)m[0] * m[5] * m[14] + (double)m[0] * m[6] * m[13] + (double)m[4] * m[1] * m[14] - (double)m[4] * m[2] * m[13] - (double)m[12] * m[1] * m[6] + (double)m[12] * m[2] * m[5];
+    inv[3] = -(double)m[1] * m[6] * m[11] + (double)m[1] * m[7] * m[10] + (double)m[5] * m[2] * m[11] - (double)m[5] * m[3] * m[10] - (double)m[9] * m[2] * m[7] + (double)m[9] * m[3] * m[6];
+    inv[7] = (double)m[0] * m[6] * m[11] - (double)m[0] * m[7] * m[10] - (double)m[4] * m[2] * m[11] + (double)m[4] * m[3] * m[10] + (double)m[8] * m[2] * m[7] - (double)m[8] * m[3] * m[6];
+    inv[11] = -(double)m[0] * m[5] * m[11] + (double)m[0] * m[7] * m[9] + (double)m[4] * m[1] * m[11] - (double)m[4] * m[3] * m[9] - (double)m[8] * m[1] * m[7] + (double)m[8] * m[3] * m[5];
+    inv[15] = (double)m[0] * m[5] * m[10] - (double)m[0] * m[6] * m[9] - (double)m[4] * m[1] * m[10] + (double)m[4] * m[2] * m[9] + (double)m[8] * m[1] * m[6] - (double)m[8] * m[2] * m[5];
+
+    double determinant = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+    if (std::abs(determinant) < 1e-12)
+    {
+      return false;
+    }
+
+    for (int i = 0; i < 16; ++i)
+    {
+      outInverse[i] = static_cast<float>(inv[i] / determinant);
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  TransformGraph::ChainId TransformGraph::CompileChainInternal(FrameId from, FrameId to)
+  {
+    if (from >= m_frameNames.size() || to >= m_frameNames.size())
+    {
+      return INVALID_CHAIN;
+    }
+
+    auto iter = m_chainLookup.find(PairKey(from, to));
+    if (iter != m_chainLookup.end())
+    {
+      return iter->second;
+    }
+
+    Chain chain;
+    chain.From = from;
+    chain.To = to;
+    FindPath(chain);
+
+    ChainId id = static_cast<ChainId>(m_chains.size());
+    m_chains.push_back(chain);
+    m_chainLookup[PairKey(from, to)] = id;
+    return id;
+  }
+
+  //----------------------------------------------------------------------------
+  void TransformGraph::FindPath(Chain& chain)
+  {
+    // Breadth first, so the path uses as few links (and multiplies) as possible
+    m_stats.Compiles++;
+    chain.StructureVersion = m_structureVersion;
+    chain.Steps.clear();
+    chain.SeenVersions.clear();
+    chain.HasResult = false;
+    chain.HasPath = chain.From == chain.To;
+    if (chain.HasPath)
+    {
+      return;
+    }
+
+    std::vector<std::pair<FrameId, Step>> cameFrom(m_frameNames.size(), std::make_pair(INVALID_FRAME, Step()));
+    std::deque<FrameId> queue;
+    queue.push_back(chain.From);
+    cameFrom[chain.From].first = chain.From;
+    while (!queue.empty() && !chain.HasPath)
+    {
+      FrameId current = queue.front();
+      queue.pop_front();
+      for (auto& neighbour : m_adjacency[current])
+      {
+        if (cameFrom[neighbour.first].first != INVALID_FRAME)
+        {
+          continue;
+        }
+        cameFrom[neighbour.first] = std::make_pair(current, neighbour.second);
+        if (neighbour.first == chain.To)
+        {
+          chain.HasPath = true;
+          break;
+        }
+        queue.push_back(neighbour.first);
+      }
+    }
+
+    if (!chain.HasPath)
+    {
+      return;
+    }
+
+    for (FrameId frame = chain.To; frame != chain.From; frame = cameFrom[frame].first)
+    {
+      chain.Steps.insert(chain.Steps.begin(), cameFrom[frame].second);
+    }
+    chain.SeenVersions.assign(chain.Steps.size(), 0);
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformGraph::Evaluate(Chain& chain, Matrix& outMatrix, bool& outValid)
+  {
+    m_stats.Queries++;
+    if (chain.StructureVersion != m_structureVersion)
+    {
+      FindPath(chain);
+    }
+    if (!chain.HasPath)
+    {
+      return false;
+    }
+
+    bool dirty = !chain.HasResult;
+    for (size_t i = 0; i < chain.Steps.size() && !dirty; ++i)
+    {
+      dirty = chain.SeenVersions[i] != m_links[chain.Steps[i].LinkIndex].Version;
+    }
+
+    if (!dirty)
+    {
+      m_stats.CacheHits++;
+      outMatrix = chain.Result;
+      outValid = chain.ResultValid;
+      return true;
+    }
+
+    m_stats.Recomputes++;
+    Matrix result = Identity();
+    bool valid = true;
+    for (size_t i = 0; i < chain.Steps.size(); ++i)
+    {
+      const Link& link = m_links[chain.Steps[i].LinkIndex];
+      const Matrix* stepMatrix = GetStepMatrix(chain.Steps[i]);
+      valid = valid && link.Valid && stepMatrix != nullptr;
+      if (stepMatrix != nullptr)
+      {
+        result = i == 0 ? *stepMatrix : Multiply(*stepMatrix, result);
+      }
+      chain.SeenVersions[i] = link.Version;
+    }
+
+    chain.Result = result;
+    chain.ResultValid = valid;
+    chain.HasResult = true;
+    outMatrix = result;
+    outValid = valid;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  const TransformGraph::Matrix* TransformGraph::GetStepMatrix(const Step& step)
+  {
+    Link& link = m_links[step.LinkIndex];
+    if (!step.Inverse)
+    {
+      return &link.FromToTo;
+    }
+
+    // Inverses are computed once per link version, however many chains walk the link backwards
+    if (link.InverseVersion != link.Version)
+    {
+      link.InverseOk = Invert(link.FromToTo, link.Inverse);
+      link.InverseVersion = link.Version;
+    }
+    return link.InverseOk ? &link.Inverse : nullptr;
+  }
+
+  //----------------------------------------------------------------------------
+  uint64_t TransformGraph::PairKey(FrameId from, FrameId to)
+  {
+    return (static_cast<uint64_t>(from) << 32) | to;
+  }
+}
\ No newline at end of file
@@ -0,0 +1,146 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace HoloIntervention
+{
+  // Frame graph for the per-frame transform queries of the render loop
+  // Frame names are interned to integer ids once (at configuration time), and each from->to query is compiled once
+  // into the list of links it multiplies. Results are cached per chain and only recomputed when one of its links changed.
+  // Matrices follow the TransformRepository convention: row major, column vectors (p_to = M * p_from).
+  class TransformGraph
+  {
+  public:
+    typedef uint32_t FrameId;
+    typedef uint32_t ChainId;
+    typedef std::array<float, 16> Matrix;
+
+    static const FrameId INVALID_FRAME;
+    static const ChainId INVALID_CHAIN;
+
+    struct Stats
+    {
+      uint64_t  Queries = 0;
+      uint64_t  CacheHits = 0;      // Answered without a single multiply
+      uint64_t  Recomputes = 0;     // A link changed since the last query
+      uint64_t  Compiles = 0;       // Path searches, initial or after a link was added or removed
+    };
+
+  public:
+    /// Returns the id of name, adding it if it is new
+    FrameId InternFrame(const std::wstring& name);
+    bool FindFrame(const std::wstring& name, FrameId& outId) const;
+    std::wstring GetFrameName(FrameId id) const;
+    size_t GetFrameCount() const;
+
+    /// Sets the from->to link. If only to->from exists it is updated with the inverse instead.
+    bool SetTransform(FrameId from, FrameId to, const Matrix& fromToTo, bool valid = true);
+    /// Interns from and to first, for links known by name such as the coordinate definitions of the configuration
+    bool SetTransform(const std::wstring& from, const std::wstring& to, const Matrix& fromToTo, bool valid = true);
+    bool SetTransformValid(FrameId from, FrameId to, bool valid);
+
+    /// Removes the link between from and to, in whichever direction it is stored. Chains search their path again on next use.
+    bool RemoveTransform(FrameId from, FrameId to);
+
+    /// Precompile a query, returns INVALID_CHAIN for unknown frames
+    ChainId CompileChain(FrameId from, FrameId to);
+
+    /// Returns false if there is no path. outValid is false if any link along the path is invalid.
+    bool GetTransform(ChainId chain, Matrix& outMatrix, bool& outValid);
+    bool GetTransform(FrameId from, FrameId to, Matrix& outMatrix, bool& outValid);
+
+    Stats GetStats() const;
+
+    static Matrix Identity();
+    /// lhs * rhs
+    static Matrix Multiply(const Matrix& lhs, const Matrix& rhs);
+    static bool Invert(const Matrix& matrix, Matrix& outInverse);
+
+  protected:
+    struct Link
+    {
+      FrameId               From = 0;
+      FrameId               To = 0;
+      Matrix                FromToTo;
+      bool                  Valid = true;
+      uint64_t              Version = 0;
+      Matrix                Inverse;
+      uint64_t              InverseVersion = 0;   // Version the inverse was computed for, 0 if never
+      bool                  InverseOk = false;
+    };
+
+    struct Step
+    {
+      uint32_t              LinkIndex = 0;
+      bool                  Inverse = false;
+    };
+
+    struct Chain
+    {
+      FrameId               From = 0;
+      FrameId               To = 0;
+      uint64_t              StructureVersion = 0; // Graph shape the path was found in
+      bool                  HasPath = false;
+      std::vector<Step>     Steps;                // In order from From to To
+      std::vector<uint64_t> SeenVersions;         // Link versions the cached result was computed from
+      bool                  HasResult = false;
+      Matrix                Result;
+      bool                  ResultValid = false;
+    };
+
+  protected:
+    ChainId CompileChainInternal(FrameId from, FrameId to);
+    void FindPath(Chain& chain);
+    bool Evaluate(Chain& chain, Matrix& outMatrix, bool& outValid);
+    const Matrix* GetStepMatrix(const Step& step);
+    static uint64_t PairKey(FrameId from, FrameId to);
+
+  protected:
+    mutable std::mutex                                          m_mutex;
+
+    std::vector<std::wstring>                                   m_frameNames;
+    std::unordered_map<std::wstring, FrameId>                   m_frameIds;
+
+    std::vector<Link>                                           m_links;
+    std::vector<uint32_t>                                       m_freeLinks;    // Slots of removed links, reused by new ones
+    std::unordered_map<uint64_t, uint32_t>                      m_linkLookup;   // PairKey(from, to) of each stored link
+    std::vector<std::vector<std::pair<FrameId, Step>>>          m_adjacency;    // Per frame, neighbours in either direction
+
+    std::vector<Chain>                                          m_chains;
+    std::unordered_map<uint64_t, ChainId>                       m_chainLookup;
+
+    uint64_t                                                    m_structureVersion = 1;
+    uint64_t                                                    m_nextLinkVersion = 1;
+    Stats                                                       m_stats;
+  };
+}
\ No newline at end of file
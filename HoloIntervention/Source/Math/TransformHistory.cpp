@@ -0,0 +1,278 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "PoseDecomposition.h"
+#include "TransformHistory.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+namespace HoloIntervention
+{
+  const size_t TransformHistory::DEFAULT_CAPACITY = 128;
+
+  //----------------------------------------------------------------------------
+  TransformHistory::TransformHistory(size_t capacity)
+    : m_samples(std::max<size_t>(capacity, 2))
+  {
+  }
+
+  //----------------------------------------------------------------------------
+  void TransformHistory::SetSettings(const Settings& settings)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_settings = settings;
+  }
+
+  //----------------------------------------------------------------------------
+  TransformHistory::Settings TransformHistory::GetSettings() const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_settings;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformHistory::Add(double timestamp, const Matrix& matrix, bool valid)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_size > 0)
+    {
+      const Sample& newest = At(m_size - 1);
+      if (timestamp < newest.Timestamp)
+      {
+        // A source restarted or switched clocks, samples on the old timeline would be interpolated against the new one
+        m_stats.Resets++;
+        m_oldest = 0;
+        m_size = 0;
+      }
+      else if (timestamp == newest.Timestamp)
+      {
+        Sample& replaced = m_samples[(m_oldest + m_size - 1) % m_samples.size()];
+        replaced.Pose = matrix;
+        replaced.Valid = valid;
+        m_stats.Added++;
+        return true;
+      }
+    }
+
+    Sample* sample(nullptr);
+    if (m_size < m_samples.size())
+    {
+      sample = &m_samples[(m_oldest + m_size) % m_samples.size()];
+      m_size++;
+    }
+    else
+    {
+      // Full, overwrite the oldest
+      sample = &m_samples[m_oldest];
+      m_oldest = (m_oldest + 1) % m_samples.size();
+    }
+    sample->Timestamp = timestamp;
+    sample->Pose = matrix;
+    sample->Valid = valid;
+    m_stats.Added++;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void TransformHistory::Clear()
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_oldest = 0;
+    m_size = 0;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformHistory::GetTransform(double timestamp, Matrix& outMatrix, bool& outValid)
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    m_stats.Queries++;
+    if (m_size == 0)
+    {
+      m_stats.Missed++;
+      return false;
+    }
+
+    // First sample at or after timestamp
+    size_t low(0);
+    size_t high(m_size);
+    while (low < high)
+    {
+      size_t middle = (low + high) / 2;
+      if (At(middle).Timestamp < timestamp)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+
+    if (low < m_size && At(low).Timestamp == timestamp)
+    {
+      m_stats.Exact++;
+      outMatrix = At(low).Pose;
+      outValid = At(low).Valid;
+      return true;
+    }
+
+    if (low == 0 || low == m_size)
+    {
+      const Sample& nearest = At(low == 0 ? 0 : m_size - 1);
+      if (std::abs(nearest.Timestamp - timestamp) > m_settings.ClampToleranceSec)
+      {
+        m_stats.Missed++;
+        return false;
+      }
+      m_stats.Clamped++;
+      outMatrix = nearest.Pose;
+      outValid = nearest.Valid;
+      return true;
+    }
+
+    const Sample& before = At(low - 1);
+    const Sample& after = At(low);
+    if (after.Timestamp - before.Timestamp > m_settings.MaxInterpolationGapSec)
+    {
+      m_stats.Missed++;
+      return false;
+    }
+
+    m_stats.Interpolated++;
+    outMatrix = Interpolate(before.Pose, after.Pose, (timestamp - before.Timestamp) / (after.Timestamp - before.Timestamp));
+    outValid = before.Valid && after.Valid;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformHistory::GetLatest(Matrix& outMatrix, double& outTimestamp, bool& outValid) const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_size == 0)
+    {
+      return false;
+    }
+    const Sample& newest = At(m_size - 1);
+    outMatrix = newest.Pose;
+    outTimestamp = newest.Timestamp;
+    outValid = newest.Valid;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  size_t TransformHistory::GetSize() const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_size;
+  }
+
+  //----------------------------------------------------------------------------
+  size_t TransformHistory::GetCapacity() const
+  {
+    return m_samples.size();
+  }
+
+  //----------------------------------------------------------------------------
+  bool TransformHistory::GetTimeRange(double& outOldest, double& outNewest) const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    if (m_size == 0)
+    {
+      return false;
+    }
+    outOldest = At(0).Timestamp;
+    outNewest = At(m_size - 1).Timestamp;
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  size_t TransformHistory::GetMemoryUsageBytes() const
+  {
+    return sizeof(TransformHistory) + m_samples.capacity() * sizeof(Sample);
+  }
+
+  //----------------------------------------------------------------------------
+  TransformHistory::Stats TransformHistory::GetStats() const
+  {
+    std::lock_guard<std::mutex> guard(m_mutex);
+    return m_stats;
+  }
+
+  //----------------------------------------------------------------------------
+  TransformHistory::Matrix TransformHistory::Interpolate(const Matrix& from, const Matrix& to, double t)
+  {
+    DecomposedPose a = DecomposePose(from);
+    DecomposedPose b = DecomposePose(to);
+
+    // Shortest arc
+    double dot = a.Rotation[0] * b.Rotation[0] + a.Rotation[1] * b.Rotation[1] + a.Rotation[2] * b.Rotation[2] + a.Rotation[3] * b.Rotation[3];
+    if (dot < 0.0)
+    {
+      dot = -dot;
+      for (int i = 0; i < 4; ++i)
+      {
+        b.Rotation[i] = -b.Rotation[i];
+      }
+    }
+
+    double weightA(1.0 - t);
+    double weightB(t);
+    if (dot < 0.9995)
+    {
+      double theta = std::acos(std::min(dot, 1.0));
+      double sinTheta = std::sin(theta);
+      weightA = std::sin((1.0 - t) * theta) / sinTheta;
+      weightB = std::sin(t * theta) / sinTheta;
+    }
+
+    DecomposedPose result;
+    double norm(0.0);
+    for (int i = 0; i < 4; ++i)
+    {
+      result.Rotation[i] = weightA * a.Rotation[i] + weightB * b.Rotation[i];
+      norm += result.Rotation[i] * result.Rotation[i];
+    }
+    norm = std::sqrt(norm);
+    for (int i = 0; i < 4; ++i)
+    {
+      result.Rotation[i] /= norm;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      result.Translation[i] = a.Translation[i] + (b.Translation[i] - a.Translation[i]) * t;
+      result.Scale[i] = a.Scale[i] + (b.Scale[i] - a.Scale[i]) * t;
+    }
+    return ComposePose(result);
+  }
+
+  //----------------------------------------------------------------------------
+  const TransformHistory::Sample& TransformHistory::At(size_t index) const
+  {
+    return m_samples[(m_oldest + index) % m_samples.size()];
+  }
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace HoloIntervention
+{
+  // Bounded, timestamp ordered history of one transform, queryable at any time within the history
+  // Samples live in a fixed ring buffer, so memory is fixed at construction. Lookups are a binary search over the ring,
+  // and poses between two samples are interpolated (SLERP rotation, LERP translation and scale).
+  // Matrices follow the TransformRepository convention: row major, column vectors (p_to = M * p_from).
+  class TransformHistory
+  {
+  public:
+    typedef std::array<float, 16> Matrix;
+
+    struct Settings
+    {
+      double    MaxInterpolationGapSec = 0.25;  // Samples further apart than this are a tracking dropout, no interpolation across them
+      double    ClampToleranceSec = 0.005;      // Queries this close outside the history use the nearest sample
+    };
+
+    struct Stats
+    {
+      uint64_t  Added = 0;
+      uint64_t  Resets = 0;                     // Timestamps went backwards, the source restarted its clock
+      uint64_t  Queries = 0;
+      uint64_t  Exact = 0;
+      uint64_t  Interpolated = 0;
+      uint64_t  Clamped = 0;
+      uint64_t  Missed = 0;                     // Outside the history, or across a dropout
+    };
+
+  public:
+    explicit TransformHistory(size_t capacity = DEFAULT_CAPACITY);
+
+    void SetSettings(const Settings& settings);
+    Settings GetSettings() const;
+
+    /// Samples arrive in timestamp order, a sample at the newest timestamp replaces it and an older one clears the history
+    bool Add(double timestamp, const Matrix& matrix, bool valid = true);
+    void Clear();
+
+    /// Pose at timestamp, false if it can't be answered from the history
+    bool GetTransform(double timestamp, Matrix& outMatrix, bool& outValid);
+    bool GetLatest(Matrix& outMatrix, double& outTimestamp, bool& outValid) const;
+
+    size_t GetSize() const;
+    size_t GetCapacity() const;
+    bool GetTimeRange(double& outOldest, double& outNewest) const;
+    size_t GetMemoryUsageBytes() const;
+    Stats GetStats() const;
+
+    /// Interpolate between two poses, t in [0, 1]
+    static Matrix Interpolate(const Matrix& from, const Matrix& to, double t);
+
+  protected:
+    struct Sample
+    {
+      double    Timestamp = 0.0;
+      Matrix    Pose;
+      bool      Valid = false;
+    };
+
+  protected:
+    const Sample& At(size_t index) const; // 0 is the oldest sample
+
+  protected:
+    static const size_t       DEFAULT_CAPACITY;
+
+    mutable std::mutex        m_mutex;
+    std::vector<Sample>       m_samples;
+    size_t                    m_oldest = 0;
+    size_t                    m_size = 0;
+    Settings                  m_settings;
+    Stats                     m_stats;
+  };
+}
\ No newline at end of file
@@ -56,6 +56,46 @@ namespace HoloIntervention
 
     return true;
   }
+
+  //----------------------------------------------------------------------------
+  VoxelType GetVoxelType(DXGI_FORMAT format)
+  {
+    switch (format)
+    {
+    case DXGI_FORMAT_R8_UNORM:
+    case DXGI_FORMAT_R8_UINT:
+      return VoxelType_UInt8;
+    case DXGI_FORMAT_R8_SNORM:
+    case DXGI_FORMAT_R8_SINT:
+      return VoxelType_Int8;
+    case DXGI_FORMAT_R16_UNORM:
+    case DXGI_FORMAT_R16_UINT:
+      return VoxelType_UInt16;
+    case DXGI_FORMAT_R16_SNORM:
+    case DXGI_FORMAT_R16_SINT:
+      return VoxelType_Int16;
+    case DXGI_FORMAT_R32_FLOAT:
+      return VoxelType_Float32;
+    default:
+      return VoxelType_Unknown;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  DXGI_FORMAT GetVoxelUploadFormat(DXGI_FORMAT format)
+  {
+    switch (GetVoxelType(format))
+    {
+    case VoxelType_Int8:
+      return DXGI_FORMAT_R8_UNORM;
+    case VoxelType_Int16:
+    case VoxelType_Float32:
+      // 16 bits keep float data well below the precision a transfer function table resolves
+      return DXGI_FORMAT_R16_UNORM;
+    default:
+      return format;
+    }
+  }
 }
 
 //----------------------------------------------------------------------------
@@ -23,11 +23,15 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #pragma once
 
+// Common includes
+#include "VoxelConverter.h"
+
 // STL includes
 #include <vector>
 
 // DirectX includes
 #include <DirectXMath.h>
+#include <dxgiformat.h>
 
 DirectX::XMFLOAT4 operator-(const DirectX::XMFLOAT4& lhs, const DirectX::XMFLOAT4& rhs);
 
@@ -40,4 +44,9 @@ DirectX::XMFLOAT4 operator*(const DirectX::XMFLOAT4& lhs, const float& rhs);
 namespace HoloIntervention
 {
   bool IsInFrustum(const Windows::Perception::Spatial::SpatialBoundingFrustum& frustum, const std::vector<Windows::Foundation::Numerics::float3>& bounds);
+
+  /// Single channel formats only, anything else is VoxelType_Unknown
+  VoxelType GetVoxelType(DXGI_FORMAT format);
+  /// Signed and float formats are converted to the unsigned normalized format the renderers filter, others upload as they are
+  DXGI_FORMAT GetVoxelUploadFormat(DXGI_FORMAT format);
 }
\ No newline at end of file
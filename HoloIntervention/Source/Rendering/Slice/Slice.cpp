@@ -26,10 +26,13 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "Common.h"
 #include "DeviceResources.h"
 #include "DirectXHelper.h"
+#include "FrameBufferPool.h"
 #include "RenderingCommon.h"
 #include "Slice.h"
 #include "SliceRenderer.h"
 #include "StepTimer.h"
+#include "VoxelConverter.h"
+#include "VoxelHistogram.h"
 
 // DirectXTex includes
 #include <DirectXTex.h>
@@ -54,6 +57,8 @@ namespace HoloIntervention
   {
     const float Slice::LOCKED_SLICE_DISTANCE_OFFSET = 2.1f;
     const float Slice::LERP_RATE = 2.5f;
+    const uint32 Slice::HISTOGRAM_BYTE_BIN_COUNT = 256;
+    const uint32 Slice::HISTOGRAM_WIDE_BIN_COUNT = 4096;
 
     //----------------------------------------------------------------------------
     float3 Slice::GetStabilizedPosition(SpatialPointerPose^ pose) const
@@ -221,7 +226,56 @@ namespace HoloIntervention
       }
 
       auto frameSize = frame->Dimensions;
-      auto format = (DXGI_FORMAT)frame->GetPixelFormat(true);
+      auto sourceFormat = (DXGI_FORMAT)frame->GetPixelFormat(true);
+      auto format = GetVoxelUploadFormat(sourceFormat);
+      const auto sourceType = GetVoxelType(sourceFormat);
+      const auto destinationType = GetVoxelType(format);
+
+      bool autoWindow(false);
+      float lowerFraction(0.f);
+      float upperFraction(1.f);
+      std::shared_ptr<const VoxelHistogram> previousHistogram;
+      {
+        std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+        autoWindow = m_autoWindow && VoxelConverter::IsSupported(sourceType, destinationType);
+        lowerFraction = m_autoWindowLowerFraction;
+        upperFraction = m_autoWindowUpperFraction;
+        previousHistogram = m_histogram;
+      }
+
+      if (format != sourceFormat || autoWindow)
+      {
+        // Signed and float pixels cannot be filtered as they are, map the type's range onto unsigned normalized values
+        const size_t count = static_cast<size_t>(frameSize[0]) * frameSize[1];
+        VoxelWindow window = VoxelConverter::GetTypeRangeWindow(sourceType, destinationType);
+        if (autoWindow)
+        {
+          // Or the frame's own percentiles, float bins span the previous frame's range
+          float minimum(0.f);
+          float maximum(1.f);
+          if (previousHistogram != nullptr && previousHistogram->GetType() == sourceType && previousHistogram->GetMaximum() > previousHistogram->GetMinimum())
+          {
+            minimum = previousHistogram->GetMinimum();
+            maximum = previousHistogram->GetMaximum();
+          }
+          auto histogram = std::make_shared<VoxelHistogram>();
+          histogram->Reset(sourceType, VoxelConverter::GetSize(sourceType) == 1 ? HISTOGRAM_BYTE_BIN_COUNT : HISTOGRAM_WIDE_BIN_COUNT, minimum, maximum);
+          histogram->Build(image.get(), count);
+          window = histogram->GetAutoWindow(VoxelWindow(), lowerFraction, upperFraction);
+
+          std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+          m_histogram = histogram;
+        }
+
+        std::shared_ptr<byte> converted = FrameBufferPool::instance().Acquire(count * VoxelConverter::GetSize(destinationType));
+        if (!VoxelConverter::Convert(image.get(), sourceType, converted.get(), destinationType, count, window))
+        {
+          LOG(LogLevelType::LOG_LEVEL_ERROR, "Unable to convert slice frame.");
+          return;
+        }
+        image = converted;
+      }
+
       if (frameSize[0] != m_width || frameSize[1] != m_height || format != GetPixelFormat())
       {
         m_width = frameSize[0];
@@ -233,24 +287,34 @@ namespace HoloIntervention
 
       m_frame = frame;
 
-      auto context = m_deviceResources->GetD3DDeviceContext();
-
+      // Upload straight from the frame's buffer or its converted copy, the runtime handles the texture's row pitch
       auto bytesPerPixel = BitsPerPixel(GetPixelFormat()) / 8;
+      m_deviceResources->GetD3DDeviceContext()->UpdateSubresource(m_imageTexture.Get(), 0, nullptr, image.get(), m_width * bytesPerPixel, 0);
+    }
 
-      byte* imageRaw = image.get();
-      D3D11_MAPPED_SUBRESOURCE mappedResource;
-      context->Map(m_imageStagingTexture.Get(), 0, D3D11_MAP_READ_WRITE, 0, &mappedResource);
-      byte* mappedData = reinterpret_cast<byte*>(mappedResource.pData);
-      for (uint32 i = 0; i < m_height; ++i)
+    //----------------------------------------------------------------------------
+    void Slice::SetAutoWindow(bool enabled, float lowerFraction, float upperFraction)
+    {
+      if (enabled && !(lowerFraction >= 0.f && lowerFraction < upperFraction && upperFraction <= 1.f))
       {
-        memcpy(mappedData, imageRaw, m_width * bytesPerPixel);
-        mappedData += mappedResource.RowPitch;
-        imageRaw += m_width * bytesPerPixel;
+        LOG(LogLevelType::LOG_LEVEL_ERROR, "Auto window percentiles must satisfy 0 <= lower < upper <= 1.");
+        return;
       }
 
-      context->Unmap(m_imageStagingTexture.Get(), 0);
+      std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+      m_autoWindow = enabled;
+      if (enabled)
+      {
+        m_autoWindowLowerFraction = lowerFraction;
+        m_autoWindowUpperFraction = upperFraction;
+      }
+    }
 
-      context->CopyResource(m_imageTexture.Get(), m_imageStagingTexture.Get());
+    //----------------------------------------------------------------------------
+    std::shared_ptr<const VoxelHistogram> Slice::GetHistogram() const
+    {
+      std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+      return m_histogram;
     }
 
     //----------------------------------------------------------------------------
@@ -267,24 +331,8 @@ namespace HoloIntervention
 
       m_imageData = imageData;
 
-      auto context = m_deviceResources->GetD3DDeviceContext();
-
       auto bytesPerPixel = BitsPerPixel(pixelFormat) / 8;
-
-      D3D11_MAPPED_SUBRESOURCE mappedResource;
-      context->Map(m_imageStagingTexture.Get(), 0, D3D11_MAP_READ_WRITE, 0, &mappedResource);
-      byte* image = m_imageData.get();
-      byte* mappedData = reinterpret_cast<byte*>(mappedResource.pData);
-      for (uint32 i = 0; i < m_height; ++i)
-      {
-        memcpy(mappedData, image, m_width * bytesPerPixel);
-        mappedData += mappedResource.RowPitch;
-        image += m_width * bytesPerPixel;
-      }
-
-      context->Unmap(m_imageStagingTexture.Get(), 0);
-
-      context->CopyResource(m_imageTexture.Get(), m_imageStagingTexture.Get());
+      m_deviceResources->GetD3DDeviceContext()->UpdateSubresource(m_imageTexture.Get(), 0, nullptr, m_imageData.get(), m_width * bytesPerPixel, 0);
     }
 
     //----------------------------------------------------------------------------
@@ -326,7 +374,6 @@ namespace HoloIntervention
       m_ownTexture = false;
       m_imageData = nullptr;
       m_imageTexture = imageTexture;
-      m_imageStagingTexture = nullptr;
 
       D3D11_TEXTURE2D_DESC desc;
       imageTexture->GetDesc(&desc);
@@ -484,10 +531,7 @@ namespace HoloIntervention
       {
         if (m_ownTexture)
         {
-          CD3D11_TEXTURE2D_DESC textureDesc(GetPixelFormat(), m_width, m_height, 1, 0, 0, D3D11_USAGE_STAGING, D3D11_CPU_ACCESS_WRITE | D3D11_CPU_ACCESS_READ);
-          DX::ThrowIfFailed(device->CreateTexture2D(&textureDesc, nullptr, &m_imageStagingTexture));
-
-          textureDesc = CD3D11_TEXTURE2D_DESC(GetPixelFormat(), m_width, m_height, 1, 0, D3D11_BIND_SHADER_RESOURCE);
+          CD3D11_TEXTURE2D_DESC textureDesc(GetPixelFormat(), m_width, m_height, 1, 0, D3D11_BIND_SHADER_RESOURCE);
           DX::ThrowIfFailed(device->CreateTexture2D(&textureDesc, nullptr, &m_imageTexture));
         }
         DX::ThrowIfFailed(device->CreateShaderResourceView(m_imageTexture.Get(), nullptr, &m_shaderResourceView));
@@ -506,7 +550,6 @@ namespace HoloIntervention
       m_sliceConstantBuffer.Reset();
       m_shaderResourceView.Reset();
       m_imageTexture.Reset();
-      m_imageStagingTexture.Reset();
     }
 
     //----------------------------------------------------------------------------
@@ -35,6 +35,7 @@ namespace DX
 namespace HoloIntervention
 {
   class Debug;
+  class VoxelHistogram;
 
   namespace Rendering
   {
@@ -65,6 +66,10 @@ namespace HoloIntervention
       void Render(uint32 indexCount);
 
       void SetFrame(UWPOpenIGTLink::VideoFrame^ frame);
+      /// Window each frame between percentiles of its own histogram instead of mapping the type's whole range
+      void SetAutoWindow(bool enabled, float lowerFraction = 0.01f, float upperFraction = 0.99f);
+      /// Histogram of the latest automatically windowed frame, nullptr before the first
+      std::shared_ptr<const VoxelHistogram> GetHistogram() const;
       void SetImageData(const std::wstring& fileName);
       void SetImageData(std::shared_ptr<byte> imageData, uint16 width, uint16 height, DXGI_FORMAT pixelFormat);
       std::shared_ptr<byte> GetImageData() const;
@@ -114,7 +119,6 @@ namespace HoloIntervention
       // D3D resources
       std::atomic_bool                                    m_ownTexture = true;
       Microsoft::WRL::ComPtr<ID3D11Texture2D>             m_imageTexture;
-      Microsoft::WRL::ComPtr<ID3D11Texture2D>             m_imageStagingTexture;
       Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>    m_shaderResourceView;
       Microsoft::WRL::ComPtr<ID3D11Buffer>                m_sliceConstantBuffer;
 
@@ -148,11 +152,17 @@ namespace HoloIntervention
       std::shared_ptr<byte>                               m_imageData = nullptr;
       uint16                                              m_width = 0;
       uint16                                              m_height = 0;
-      std::mutex                                          m_imageAccessMutex;
+      mutable std::mutex                                  m_imageAccessMutex;
+      bool                                                m_autoWindow = false;
+      float                                               m_autoWindowLowerFraction = 0.01f;
+      float                                               m_autoWindowUpperFraction = 0.99f;
+      std::shared_ptr<const VoxelHistogram>               m_histogram;
 
       // Constants relating to slice renderer behavior
       static const float                                  LOCKED_SLICE_DISTANCE_OFFSET;
       static const float                                  LERP_RATE;
+      static const uint32                                 HISTOGRAM_BYTE_BIN_COUNT;
+      static const uint32                                 HISTOGRAM_WIDE_BIN_COUNT;
     };
   }
 }
\ No newline at end of file
@@ -30,6 +30,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "Common.h"
 #include "DeviceResources.h"
 #include "DirectXHelper.h"
+#include "FrameBufferPool.h"
 #include "StepTimer.h"
 
 // STL includes
@@ -114,7 +115,7 @@ namespace HoloIntervention
           {
             return entry->GetId();
           }
-          std::shared_ptr<byte> imDataPtr(new byte[imageData->Length], std::default_delete<byte[]>());
+          std::shared_ptr<byte> imDataPtr = FrameBufferPool::instance().Acquire(imageData->Length);
           memcpy(imDataPtr.get(), HoloIntervention::GetDataFromIBuffer(imageData), imageData->Length * sizeof(byte));
           entry->SetImageData(imDataPtr, width, height, pixelFormat);
 
@@ -25,6 +25,10 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "pch.h"
 #include "BaseTransferFunction.h"
 
+// STL includes
+#include <algorithm>
+#include <stdexcept>
+
 using namespace DirectX;
 
 namespace HoloIntervention
@@ -47,6 +51,8 @@ namespace HoloIntervention
     void BaseTransferFunction::SetLookupTableSize(uint32 size)
     {
       m_lookupTable.SetArraySize(size);
+      m_isValid = false;
+      m_fullUpdateNeeded = true;
     }
 
     //----------------------------------------------------------------------------
@@ -80,6 +86,7 @@ namespace HoloIntervention
       {
         // special case, replace assumed 0,0
         m_controlPoints[0].m_outputValue = XMFLOAT4(r, g, b, alpha);
+        InvalidateInputRange(0);
         return m_controlPoints[0].m_uid;
       }
 
@@ -87,29 +94,26 @@ namespace HoloIntervention
       {
         if (point.m_inputValue == pixelValue)
         {
-          throw std::exception("Pixel value control point already exists.");
+          throw std::invalid_argument("Pixel value control point already exists.");
         }
       }
 
       m_controlPoints.push_back(ControlPoint(m_nextUid, pixelValue, XMFLOAT4(r, g, b, alpha)));
-      std::sort(m_controlPoints.begin(), m_controlPoints.end(), [](auto & left, auto & right)
-      {
-        return left.m_uid < right.m_uid;
-      });
+      SortControlPoints();
+      InvalidateInputRange(FindControlPoint(m_nextUid));
 
       m_nextUid++;
-      m_isValid = false;
       return m_nextUid - 1;
     }
 
     //----------------------------------------------------------------------------
     bool BaseTransferFunction::RemoveControlPoint(uint32 controlPointUid)
     {
-      if (m_controlPoints[0].m_inputValue == controlPointUid)
+      if (m_controlPoints[0].m_uid == controlPointUid)
       {
         // handle special 0 case, reset to assumed 0,0
         m_controlPoints[0].m_outputValue = XMFLOAT4(0.f, 0.f, 0.f, 0.f);
-        m_isValid = false;
+        InvalidateInputRange(0);
         return true;
       }
 
@@ -117,8 +121,8 @@ namespace HoloIntervention
       {
         if (it->m_uid == controlPointUid)
         {
+          InvalidateInputRange(it - m_controlPoints.begin());
           m_controlPoints.erase(it);
-          m_isValid = false;
           return true;
         }
       }
@@ -126,6 +130,88 @@ namespace HoloIntervention
       return false;
     }
 
+    //----------------------------------------------------------------------------
+    bool BaseTransferFunction::MoveControlPoint(uint32 controlPointUid, float pixelValue, float r, float g, float b)
+    {
+      return MoveControlPoint(controlPointUid, pixelValue, r, g, b, 1.f);
+    }
+
+    //----------------------------------------------------------------------------
+    bool BaseTransferFunction::MoveControlPoint(uint32 controlPointUid, float pixelValue, float alphaValue)
+    {
+      return MoveControlPoint(controlPointUid, pixelValue, 0.f, 0.f, 0.f, alphaValue);
+    }
+
+    //----------------------------------------------------------------------------
+    bool BaseTransferFunction::MoveControlPoint(uint32 controlPointUid, float pixelValue, float r, float g, float b, float alpha)
+    {
+      const size_t index = FindControlPoint(controlPointUid);
+      if (index == m_controlPoints.size())
+      {
+        return false;
+      }
+
+      if ((index == 0) != (pixelValue == 0.f))
+      {
+        // The 0 control point is fixed in place, and nothing else can take its place
+        return false;
+      }
+
+      for (auto& point : m_controlPoints)
+      {
+        if (point.m_uid != controlPointUid && point.m_inputValue == pixelValue)
+        {
+          throw std::invalid_argument("Pixel value control point already exists.");
+        }
+      }
+
+      // Entries between the neighbours at the old and the new position change
+      InvalidateInputRange(index);
+      m_controlPoints[index].m_inputValue = pixelValue;
+      m_controlPoints[index].m_outputValue = XMFLOAT4(r, g, b, alpha);
+      SortControlPoints();
+      InvalidateInputRange(FindControlPoint(controlPointUid));
+
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void BaseTransferFunction::SortControlPoints()
+    {
+      std::sort(m_controlPoints.begin(), m_controlPoints.end(), [](const ControlPoint & left, const ControlPoint & right)
+      {
+        return left.m_inputValue < right.m_inputValue;
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    size_t BaseTransferFunction::FindControlPoint(uint32 controlPointUid) const
+    {
+      for (size_t i = 0; i < m_controlPoints.size(); ++i)
+      {
+        if (m_controlPoints[i].m_uid == controlPointUid)
+        {
+          return i;
+        }
+      }
+      return m_controlPoints.size();
+    }
+
+    //----------------------------------------------------------------------------
+    void BaseTransferFunction::InvalidateInputRange(size_t controlPointIndex)
+    {
+      m_isValid = false;
+      if (controlPointIndex + 1 >= m_controlPoints.size())
+      {
+        // The last point sets the input range, every entry moves with it
+        m_fullUpdateNeeded = true;
+        return;
+      }
+
+      m_dirtyMinimum = std::min(m_dirtyMinimum, m_controlPoints[controlPointIndex == 0 ? 0 : controlPointIndex - 1].m_inputValue);
+      m_dirtyMaximum = std::max(m_dirtyMaximum, m_controlPoints[controlPointIndex + 1].m_inputValue);
+    }
+
     //----------------------------------------------------------------------------
     BaseTransferFunction::BaseTransferFunction()
     {
@@ -29,6 +29,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 // STL includes
 #include <atomic>
+#include <limits>
 #include <vector>
 
 namespace HoloIntervention
@@ -47,7 +48,7 @@ namespace HoloIntervention
         float             m_inputValue;
         DirectX::XMFLOAT4 m_outputValue;
       };
-      typedef std::vector<ControlPoint> ControlPointList;
+      typedef std::vector<ControlPoint> ControlPointList;  // Sorted by input value
 
     public:
       virtual ~BaseTransferFunction();
@@ -59,11 +60,20 @@ namespace HoloIntervention
 
       virtual uint32 AddControlPoint(float pixelValue, float r, float g, float b);
       virtual uint32 AddControlPoint(float pixelValue, float alphaValue);
+      virtual uint32 AddControlPoint(float pixelValue, float r, float g, float b, float alpha);
 
       virtual bool RemoveControlPoint(uint32 controlPointUid);
 
+      /// Move an existing control point, the next Update only recomputes the table entries it affects
+      virtual bool MoveControlPoint(uint32 controlPointUid, float pixelValue, float r, float g, float b);
+      virtual bool MoveControlPoint(uint32 controlPointUid, float pixelValue, float alphaValue);
+
     protected:
-      virtual uint32 AddControlPoint(float pixelValue, float r, float g, float b, float alpha);
+      virtual bool MoveControlPoint(uint32 controlPointUid, float pixelValue, float r, float g, float b, float alpha);
+
+      void SortControlPoints();
+      size_t FindControlPoint(uint32 controlPointUid) const;  // Index, or the point count if not found
+      void InvalidateInputRange(size_t controlPointIndex);
 
       BaseTransferFunction();
 
@@ -71,7 +81,12 @@ namespace HoloIntervention
       uint32_t                        m_nextUid = 0;
       ControlPointList                m_controlPoints;
       TransferFunctionLookupTable     m_lookupTable;
-      std::atomic_bool                m_isValid = false;
+      std::atomic_bool                m_isValid{ false };
+
+      // Table entries that are stale, either all of them or those for an input value range
+      bool                            m_fullUpdateNeeded = true;
+      float                           m_dirtyMinimum = std::numeric_limits<float>::infinity();
+      float                           m_dirtyMaximum = -std::numeric_limits<float>::infinity();
     };
   }
 }
\ No newline at end of file
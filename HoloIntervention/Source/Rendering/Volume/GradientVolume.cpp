@@ -0,0 +1,294 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Local includes
+#include "pch.h"
+#include "GradientVolume.h"
+
+// Common includes
+#include "WorkerPool.h"
+
+// Math includes
+#include "Float4Lanes.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  inline uint8_t PackUnit(float value)
+  {
+    return static_cast<uint8_t>(value * 255.f + 0.5f);
+  }
+
+  //----------------------------------------------------------------------------
+  // Pack gradients[c][first, last) into RGBA voxels, the SIMD paths use the same IEEE operations as the scalar one
+  void PackRow(const float* const gradients[3], uint8_t* destination, uint32_t first, uint32_t last, float magnitudeScale)
+  {
+    uint32_t x = first;
+#if defined(HOLOINTERVENTION_LANES_SSE2)
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(0.5f);
+    const __m128 minusHalf = _mm_set1_ps(-0.5f);
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 range = _mm_set1_ps(255.f);
+    const __m128 scale = _mm_set1_ps(magnitudeScale);
+    for (; x + 4 <= last; x += 4)
+    {
+      const __m128 gx = _mm_loadu_ps(gradients[0] + x);
+      const __m128 gy = _mm_loadu_ps(gradients[1] + x);
+      const __m128 gz = _mm_loadu_ps(gradients[2] + x);
+      const __m128 magnitude = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(gx, gx), _mm_mul_ps(gy, gy)), _mm_mul_ps(gz, gz)));
+      const __m128 inverse = _mm_and_ps(_mm_div_ps(minusHalf, magnitude), _mm_cmpgt_ps(magnitude, zero));
+
+      // Channels are below 256, so shifting them into place packs a voxel into each 32 bit lane
+      const __m128i r = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(gx, inverse), half), range), half));
+      const __m128i g = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(gy, inverse), half), range), half));
+      const __m128i b = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(gz, inverse), half), range), half));
+      const __m128i a = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(_mm_sqrt_ps(_mm_min_ps(_mm_mul_ps(magnitude, scale), one)), range), half));
+      const __m128i rgba = _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), _mm_slli_epi32(a, 24)));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + x * 4), rgba);
+    }
+#elif defined(HOLOINTERVENTION_LANES_NEON) && (defined(__aarch64__) || defined(_M_ARM64))
+    // ARMv7 NEON has no divide or square root, it uses the scalar loop
+    const float32x4_t zero = vdupq_n_f32(0.f);
+    const float32x4_t half = vdupq_n_f32(0.5f);
+    const float32x4_t minusHalf = vdupq_n_f32(-0.5f);
+    const float32x4_t one = vdupq_n_f32(1.f);
+    const float32x4_t range = vdupq_n_f32(255.f);
+    const float32x4_t scale = vdupq_n_f32(magnitudeScale);
+    for (; x + 4 <= last; x += 4)
+    {
+      const float32x4_t gx = vld1q_f32(gradients[0] + x);
+      const float32x4_t gy = vld1q_f32(gradients[1] + x);
+      const float32x4_t gz = vld1q_f32(gradients[2] + x);
+      const float32x4_t magnitude = vsqrtq_f32(vaddq_f32(vaddq_f32(vmulq_f32(gx, gx), vmulq_f32(gy, gy)), vmulq_f32(gz, gz)));
+      const float32x4_t inverse = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(vdivq_f32(minusHalf, magnitude)), vcgtq_f32(magnitude, zero)));
+
+      const uint32x4_t r = vcvtq_u32_f32(vaddq_f32(vmulq_f32(vaddq_f32(vmulq_f32(gx, inverse), half), range), half));
+      const uint32x4_t g = vcvtq_u32_f32(vaddq_f32(vmulq_f32(vaddq_f32(vmulq_f32(gy, inverse), half), range), half));
+      const uint32x4_t b = vcvtq_u32_f32(vaddq_f32(vmulq_f32(vaddq_f32(vmulq_f32(gz, inverse), half), range), half));
+      const uint32x4_t a = vcvtq_u32_f32(vaddq_f32(vmulq_f32(vsqrtq_f32(vminq_f32(vmulq_f32(magnitude, scale), one)), range), half));
+      const uint32x4_t rgba = vorrq_u32(vorrq_u32(r, vshlq_n_u32(g, 8)), vorrq_u32(vshlq_n_u32(b, 16), vshlq_n_u32(a, 24)));
+      vst1q_u8(destination + x * 4, vreinterpretq_u8_u32(rgba));
+    }
+#endif
+    for (; x < last; ++x)
+    {
+      const float gx = gradients[0][x];
+      const float gy = gradients[1][x];
+      const float gz = gradients[2][x];
+      const float magnitude = std::sqrt(gx * gx + gy * gy + gz * gz);
+      const float inverse = magnitude > 0.f ? -0.5f / magnitude : 0.f;
+      uint8_t* voxel = destination + x * 4;
+      voxel[0] = PackUnit(gx * inverse + 0.5f);
+      voxel[1] = PackUnit(gy * inverse + 0.5f);
+      voxel[2] = PackUnit(gz * inverse + 0.5f);
+      voxel[3] = PackUnit(std::sqrt(std::min(magnitude * magnitudeScale, 1.f)));
+    }
+  }
+}
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // A changed 32³ brick with its one voxel margin stays below two of these, so it is rebuilt on the calling thread
+    const uint32_t GradientVolume::MINIMUM_VOXELS_PER_THREAD = 32768;
+    const float GradientVolume::MAXIMUM_MAGNITUDE = 0.8660254f;
+
+    //----------------------------------------------------------------------------
+    GradientVolume::GradientVolume()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    void GradientVolume::Reset(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel)
+    {
+      m_dimensions[0] = width;
+      m_dimensions[1] = height;
+      m_dimensions[2] = depth;
+      m_bytesPerVoxel = bytesPerVoxel;
+      m_data.clear();
+      if (IsSupported())
+      {
+        m_data.assign((size_t)width * height * depth * 4, 0);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void GradientVolume::SetThreadCount(uint32_t threadCount)
+    {
+      m_threadCount = threadCount;
+    }
+
+    //----------------------------------------------------------------------------
+    void GradientVolume::BuildAll(const uint8_t* image)
+    {
+      const BrickBox region = { 0, 0, 0, m_dimensions[0], m_dimensions[1], m_dimensions[2] };
+      UpdateRegion(image, region);
+    }
+
+    //----------------------------------------------------------------------------
+    void GradientVolume::UpdateRegion(const uint8_t* image, const BrickBox& region, BrickBox* outRegion)
+    {
+      if (!IsSupported() || m_dimensions[0] == 0 || m_dimensions[1] == 0 || m_dimensions[2] == 0)
+      {
+        return;
+      }
+
+      // Central differences reach one voxel either way
+      const BrickBox box =
+      {
+        region.Left > 0 ? region.Left - 1 : 0,
+        region.Top > 0 ? region.Top - 1 : 0,
+        region.Front > 0 ? region.Front - 1 : 0,
+        std::min(region.Right + 1, m_dimensions[0]),
+        std::min(region.Bottom + 1, m_dimensions[1]),
+        std::min(region.Back + 1, m_dimensions[2])
+      };
+      if (box.Left >= box.Right || box.Top >= box.Bottom || box.Front >= box.Back)
+      {
+        return;
+      }
+
+      BuildBox(box, image);
+      if (outRegion != nullptr)
+      {
+        *outRegion = box;
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    bool GradientVolume::IsSupported() const
+    {
+      return m_bytesPerVoxel == 1 || m_bytesPerVoxel == 2;
+    }
+
+    //----------------------------------------------------------------------------
+    const std::vector<uint8_t>& GradientVolume::GetData() const
+    {
+      return m_data;
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t GradientVolume::GetMemoryBytes() const
+    {
+      return m_data.size();
+    }
+
+    //----------------------------------------------------------------------------
+    void GradientVolume::Decode(const uint8_t packed[4], float outNormal[3], float& outMagnitude)
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        outNormal[i] = packed[i] / 255.f * 2.f - 1.f;
+      }
+      const float root = packed[3] / 255.f;
+      outMagnitude = root * root * MAXIMUM_MAGNITUDE;
+    }
+
+    //----------------------------------------------------------------------------
+    void GradientVolume::BuildBox(const BrickBox& box, const uint8_t* image)
+    {
+      // Slices are interleaved across the worker pool, each share writes only its own
+      const uint32_t slices = box.Back - box.Front;
+      const uint64_t voxels = (uint64_t)(box.Right - box.Left) * (box.Bottom - box.Top) * slices;
+      uint32_t threadCount = m_threadCount == 0 ? WorkerPool::instance().GetThreadCount() : m_threadCount;
+      threadCount = static_cast<uint32_t>(std::min<uint64_t>(std::min<uint64_t>(threadCount, slices), std::max<uint64_t>(voxels / MINIMUM_VOXELS_PER_THREAD, 1)));
+
+      const uint16_t* words = reinterpret_cast<const uint16_t*>(image);
+      if (threadCount == 1)
+      {
+        if (m_bytesPerVoxel == 1)
+        {
+          BuildSlices<uint8_t>(box, image, 0, 1);
+        }
+        else
+        {
+          BuildSlices<uint16_t>(box, words, 0, 1);
+        }
+        return;
+      }
+
+      WorkerPool::instance().ParallelFor(threadCount, [this, &box, image, words, threadCount](size_t share)
+      {
+        if (m_bytesPerVoxel == 1)
+        {
+          BuildSlices<uint8_t>(box, image, static_cast<uint32_t>(share), threadCount);
+        }
+        else
+        {
+          BuildSlices<uint16_t>(box, words, static_cast<uint32_t>(share), threadCount);
+        }
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    template<typename T>
+    void GradientVolume::BuildSlices(const BrickBox& box, const T* image, uint32_t firstSlice, uint32_t sliceStride)
+    {
+      const uint32_t width = m_dimensions[0];
+      const uint32_t height = m_dimensions[1];
+      const uint32_t depth = m_dimensions[2];
+      const size_t row = width;
+      const size_t slice = row * height;
+
+      // Half of a central difference, in normalized units
+      const float scale = 0.5f / (m_bytesPerVoxel == 1 ? 255.f : 65535.f);
+      const float magnitudeScale = 1.f / MAXIMUM_MAGNITUDE;
+      std::vector<T> zeroRow(width, 0);
+      std::vector<float> gradients[3] = { std::vector<float>(width), std::vector<float>(width), std::vector<float>(width) };
+      const float* const rows[3] = { gradients[0].data(), gradients[1].data(), gradients[2].data() };
+
+      for (uint32_t z = box.Front + firstSlice; z < box.Back; z += sliceStride)
+      {
+        for (uint32_t y = box.Top; y < box.Bottom; ++y)
+        {
+          const T* centre = image + z * slice + y * row;
+          const T* below = y > 0 ? centre - row : zeroRow.data();
+          const T* above = y + 1 < height ? centre + row : zeroRow.data();
+          const T* behind = z > 0 ? centre - slice : zeroRow.data();
+          const T* ahead = z + 1 < depth ? centre + slice : zeroRow.data();
+          uint8_t* destination = m_data.data() + (z * slice + y * row) * 4;
+
+          // Differences along x read zero beyond the row's ends, like those along y and z
+          for (uint32_t x = box.Left; x < box.Right; ++x)
+          {
+            const float left = x > 0 ? static_cast<float>(centre[x - 1]) : 0.f;
+            const float right = x + 1 < width ? static_cast<float>(centre[x + 1]) : 0.f;
+            gradients[0][x] = (right - left) * scale;
+            gradients[1][x] = (static_cast<float>(above[x]) - static_cast<float>(below[x])) * scale;
+            gradients[2][x] = (static_cast<float>(ahead[x]) - static_cast<float>(behind[x])) * scale;
+          }
+          PackRow(rows, destination, box.Left, box.Right, magnitudeScale);
+        }
+      }
+    }
+  }
+}
\ No newline at end of file
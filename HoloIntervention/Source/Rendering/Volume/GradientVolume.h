@@ -0,0 +1,80 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+#pragma once
+
+// Local includes
+#include "VolumeBricks.h"
+
+// STL includes
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Precomputed gradients of a volume, one RGBA8 voxel per scalar voxel so shading costs one fetch instead of six
+    // Gradients are central differences of the normalized values, reading zero beyond the edges like the volume sampler's
+    // border. RGB holds the unit normal (the negated gradient) mapped from [-1, 1] to [0, 1]; A holds the square root of
+    // the magnitude over its largest possible value (sqrt(3) / 2), so weak edges keep more of the 8 bits than strong ones.
+    // Built on the WorkerPool, a changed brick only rebuilds the voxels whose differences read it, on the calling thread.
+    class GradientVolume
+    {
+    public:
+      GradientVolume();
+
+      /// bytesPerVoxel of 1 or 2 (unsigned normalized data), anything else disables gradients
+      void Reset(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel);
+      /// threadCount shares of the work run on the WorkerPool, 0 uses one per pool thread
+      void SetThreadCount(uint32_t threadCount);
+
+      void BuildAll(const uint8_t* image);
+      /// Rebuild the gradients a changed region of image feeds, outRegion receives the rebuilt box
+      void UpdateRegion(const uint8_t* image, const BrickBox& region, BrickBox* outRegion = nullptr);
+
+      bool IsSupported() const;
+      const std::vector<uint8_t>& GetData() const;  // 4 bytes per voxel, x fastest
+      uint64_t GetMemoryBytes() const;
+
+      /// Inverse of the packing, for checking against the shader
+      static void Decode(const uint8_t packed[4], float outNormal[3], float& outMagnitude);
+
+    protected:
+      void BuildBox(const BrickBox& box, const uint8_t* image);
+      template<typename T>
+      void BuildSlices(const BrickBox& box, const T* image, uint32_t firstSlice, uint32_t sliceStride);
+
+    protected:
+      static const uint32_t   MINIMUM_VOXELS_PER_THREAD;
+      static const float      MAXIMUM_MAGNITUDE;
+
+      uint32_t                m_dimensions[3] = { 0, 0, 0 };
+      uint32_t                m_bytesPerVoxel = 0;
+      uint32_t                m_threadCount = 0;
+      std::vector<uint8_t>    m_data;
+    };
+  }
+}
\ No newline at end of file
@@ -0,0 +1,259 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "MacrocellGrid.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    const uint32_t MacrocellGrid::DEFAULT_CELL_SIZE = 8;
+
+    //----------------------------------------------------------------------------
+    MacrocellGrid::MacrocellGrid(uint32_t cellSize)
+      : m_cellSize(std::max<uint32_t>(cellSize, 1))
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    void MacrocellGrid::Reset(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel)
+    {
+      m_dimensions[0] = width;
+      m_dimensions[1] = height;
+      m_dimensions[2] = depth;
+      m_bytesPerVoxel = bytesPerVoxel;
+      for (int i = 0; i < 3; ++i)
+      {
+        m_gridSize[i] = (m_dimensions[i] + m_cellSize - 1) / m_cellSize;
+      }
+
+      const size_t cellCount = (size_t)m_gridSize[0] * m_gridSize[1] * m_gridSize[2];
+      m_minimum.assign(cellCount, 0);
+      m_maximum.assign(cellCount, 0xFFFF);
+      m_cellDirty.assign(cellCount, 0);
+      m_occupancy.assign(cellCount, 1);
+      m_anyCellDirty = false;
+    }
+
+    //----------------------------------------------------------------------------
+    void MacrocellGrid::UpdateRegion(const uint8_t* image, const BrickBox& region)
+    {
+      if (!IsSupported() || region.Right <= region.Left || region.Bottom <= region.Top || region.Back <= region.Front)
+      {
+        return;
+      }
+
+      // A changed voxel is also read by samples in the neighbouring cell through the apron
+      uint32_t first[3] = { region.Left, region.Top, region.Front };
+      uint32_t last[3] = { region.Right, region.Bottom, region.Back };
+      uint32_t firstCell[3];
+      uint32_t lastCell[3];
+      for (int i = 0; i < 3; ++i)
+      {
+        firstCell[i] = first[i] > 0 ? (first[i] - 1) / m_cellSize : 0;
+        lastCell[i] = std::min(last[i] / m_cellSize, m_gridSize[i] - 1);
+      }
+
+      for (uint32_t cz = firstCell[2]; cz <= lastCell[2]; ++cz)
+      {
+        for (uint32_t cy = firstCell[1]; cy <= lastCell[1]; ++cy)
+        {
+          for (uint32_t cx = firstCell[0]; cx <= lastCell[0]; ++cx)
+          {
+            const uint32_t cell[3] = { cx, cy, cz };
+            int64_t lo[3];
+            int64_t hi[3];
+            bool touchesBorder(false);
+            for (int i = 0; i < 3; ++i)
+            {
+              lo[i] = (int64_t)cell[i] * m_cellSize - 1;
+              hi[i] = (int64_t)(cell[i] + 1) * m_cellSize;
+              if (lo[i] < 0)
+              {
+                lo[i] = 0;
+                touchesBorder = true;
+              }
+              if (hi[i] > (int64_t)m_dimensions[i] - 1)
+              {
+                hi[i] = m_dimensions[i] - 1;
+                touchesBorder = true;
+              }
+            }
+
+            // Samples near the faces blend in the border colour
+            uint32_t minimum = touchesBorder ? 0 : 0xFFFF;
+            uint32_t maximum(0);
+            for (int64_t z = lo[2]; z <= hi[2]; ++z)
+            {
+              for (int64_t y = lo[1]; y <= hi[1]; ++y)
+              {
+                for (int64_t x = lo[0]; x <= hi[0]; ++x)
+                {
+                  const uint32_t value = ReadVoxel(image, (uint32_t)x, (uint32_t)y, (uint32_t)z);
+                  minimum = std::min(minimum, value);
+                  maximum = std::max(maximum, value);
+                }
+              }
+            }
+
+            const size_t index = ((size_t)cz * m_gridSize[1] + cy) * m_gridSize[0] + cx;
+            m_minimum[index] = static_cast<uint16_t>(minimum);
+            m_maximum[index] = static_cast<uint16_t>(maximum);
+            m_cellDirty[index] = 1;
+            m_anyCellDirty = true;
+          }
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void MacrocellGrid::UpdateAll(const uint8_t* image)
+    {
+      BrickBox all = { 0, 0, 0, m_dimensions[0], m_dimensions[1], m_dimensions[2] };
+      UpdateRegion(image, all);
+    }
+
+    //----------------------------------------------------------------------------
+    void MacrocellGrid::SetOpacityTable(const std::vector<float>& opacities, float maximumInputValue)
+    {
+      m_opaquePrefix.assign(opacities.size() + 1, 0);
+      for (size_t i = 0; i < opacities.size(); ++i)
+      {
+        m_opaquePrefix[i + 1] = m_opaquePrefix[i] + (opacities[i] > 0.f ? 1 : 0);
+      }
+      m_maximumInputValue = maximumInputValue;
+      m_tableChanged = true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool MacrocellGrid::IsSupported() const
+    {
+      return m_bytesPerVoxel == 1 || m_bytesPerVoxel == 2;
+    }
+
+    //----------------------------------------------------------------------------
+    bool MacrocellGrid::IsEmpty(uint32_t x, uint32_t y, uint32_t z) const
+    {
+      return m_occupancy[((size_t)z * m_gridSize[1] + y) * m_gridSize[0] + x] == 0;
+    }
+
+    //----------------------------------------------------------------------------
+    const std::vector<uint8_t>& MacrocellGrid::GetOccupancy() const
+    {
+      return m_occupancy;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t MacrocellGrid::GetCellSize() const
+    {
+      return m_cellSize;
+    }
+
+    //----------------------------------------------------------------------------
+    void MacrocellGrid::GetGridSize(uint32_t outSize[3]) const
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        outSize[i] = m_gridSize[i];
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    float MacrocellGrid::GetEmptyFraction() const
+    {
+      if (m_occupancy.empty())
+      {
+        return 0.f;
+      }
+      return static_cast<float>(std::count(m_occupancy.begin(), m_occupancy.end(), 0)) / m_occupancy.size();
+    }
+
+    //----------------------------------------------------------------------------
+    bool MacrocellGrid::Classify()
+    {
+      if (!m_tableChanged && !m_anyCellDirty)
+      {
+        return false;
+      }
+
+      bool changed(false);
+      for (size_t i = 0; i < m_occupancy.size(); ++i)
+      {
+        if (!m_tableChanged && !m_cellDirty[i])
+        {
+          continue;
+        }
+        const uint8_t occupied = (!IsSupported() || m_opaquePrefix.size() < 2 || !IsRangeTransparent(m_minimum[i], m_maximum[i])) ? 1 : 0;
+        changed = changed || occupied != m_occupancy[i];
+        m_occupancy[i] = occupied;
+      }
+
+      std::fill(m_cellDirty.begin(), m_cellDirty.end(), 0);
+      m_anyCellDirty = false;
+      m_tableChanged = false;
+      return changed;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t MacrocellGrid::ReadVoxel(const uint8_t* image, uint32_t x, uint32_t y, uint32_t z) const
+    {
+      const size_t index = ((size_t)z * m_dimensions[1] + y) * m_dimensions[0] + x;
+      if (m_bytesPerVoxel == 1)
+      {
+        return image[index];
+      }
+      uint16_t value;
+      memcpy(&value, image + index * 2, sizeof(value));
+      return value;
+    }
+
+    //----------------------------------------------------------------------------
+    bool MacrocellGrid::IsRangeTransparent(uint32_t minimum, uint32_t maximum) const
+    {
+      if (m_maximumInputValue <= 0.f)
+      {
+        return false;
+      }
+
+      // The shader lerps table[floor(f)] and table[ceil(f)], widen by an entry either side against float rounding
+      const int64_t lastEntry = static_cast<int64_t>(m_opaquePrefix.size()) - 2;
+      const double scale = lastEntry / static_cast<double>(m_maximumInputValue);
+      const int64_t first = std::max<int64_t>(static_cast<int64_t>(std::floor(minimum * scale)) - 1, 0);
+      const int64_t last = std::min<int64_t>(static_cast<int64_t>(std::ceil(maximum * scale)) + 1, lastEntry);
+      if (first > last)
+      {
+        // Entirely above the table, the shader clamps to the last entry
+        return m_opaquePrefix[lastEntry + 1] == m_opaquePrefix[lastEntry];
+      }
+      return m_opaquePrefix[last + 1] == m_opaquePrefix[first];
+    }
+  }
+}
\ No newline at end of file
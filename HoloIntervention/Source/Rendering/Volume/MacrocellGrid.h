@@ -0,0 +1,90 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// Local includes
+#include "VolumeBricks.h"
+
+// STL includes
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Coarse grid over a volume marking which cells are fully transparent under the current transfer function
+    // Each cell keeps the min/max voxel value of everything a trilinear sample inside it can read (the cell plus a one
+    // voxel apron, and the zero border colour at the volume's edge). A cell is empty when the opacity table is zero over
+    // every entry the shader could interpolate for that value range, so skipping it never changes the image.
+    // Data changes rebuild only the touched cells, transfer function changes only reclassify.
+    class MacrocellGrid
+    {
+    public:
+      explicit MacrocellGrid(uint32_t cellSize = DEFAULT_CELL_SIZE);
+
+      /// bytesPerVoxel of 1 or 2 (unsigned normalized data), anything else disables skipping
+      void Reset(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel);
+      void UpdateRegion(const uint8_t* image, const BrickBox& region);
+      void UpdateAll(const uint8_t* image);
+
+      /// Opacity table as uploaded to the shader, entry i is at input value i / (size - 1) * maximumInputValue
+      void SetOpacityTable(const std::vector<float>& opacities, float maximumInputValue);
+
+      bool IsSupported() const;
+      bool IsEmpty(uint32_t x, uint32_t y, uint32_t z) const;
+      const std::vector<uint8_t>& GetOccupancy() const; // One byte per cell, x fastest, 0 is empty
+      uint32_t GetCellSize() const;
+      void GetGridSize(uint32_t outSize[3]) const;
+      float GetEmptyFraction() const;
+
+      /// Reclassify cells if the data or table changed since the last call, returns true if the occupancy changed
+      bool Classify();
+
+    protected:
+      uint32_t ReadVoxel(const uint8_t* image, uint32_t x, uint32_t y, uint32_t z) const;
+      bool IsRangeTransparent(uint32_t minimum, uint32_t maximum) const;
+
+    protected:
+      static const uint32_t   DEFAULT_CELL_SIZE;
+
+      uint32_t                m_cellSize;
+      uint32_t                m_dimensions[3] = { 0, 0, 0 };
+      uint32_t                m_gridSize[3] = { 0, 0, 0 };
+      uint32_t                m_bytesPerVoxel = 0;
+
+      std::vector<uint16_t>   m_minimum;
+      std::vector<uint16_t>   m_maximum;
+      std::vector<uint8_t>    m_cellDirty;
+      std::vector<uint8_t>    m_occupancy;
+      bool                    m_anyCellDirty = false;
+
+      // Prefix count of non-zero table entries, so a value range is checked in constant time
+      std::vector<uint32_t>   m_opaquePrefix;
+      float                   m_maximumInputValue = 0.f;
+      bool                    m_tableChanged = false;
+    };
+  }
+}
\ No newline at end of file
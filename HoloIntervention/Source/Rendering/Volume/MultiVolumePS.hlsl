@@ -0,0 +1,218 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Marches every volume a ray crosses in one pass, see MultiVolumeRayMarcher for the CPU reference
+// Drawn as the faces of a box enclosing every volume, each pixel's ray runs from the eye (0) to that box's far side (1).
+// The ends of each volume's interval of the ray are sorted and the spans between them marched in depth order.
+
+#define MAXIMUM_VOLUMES 4
+
+struct VolumeParameters
+{
+  float4x4  textureFromWorld;
+  float3    stepSize;
+  float     levelOfDetail;
+  float     tfMaximumXValue;
+  uint      tfArraySize;
+  float     voxelValueRange;
+  uint      numIterations;
+};
+
+cbuffer MultiVolumeConstantBuffer : register(b0)
+{
+  float4x4          c_boundsPose;   // Read as c_worldPose by the vertex shader
+  float4            c_cameraPosition[2];
+  float4            c_boundsMinimum;
+  float4            c_boundsMaximum;
+  VolumeParameters  c_volumes[MAXIMUM_VOLUMES];
+  uint              c_volumeCount;
+  uint              c_maximumSteps;
+};
+
+struct PixelShaderInput
+{
+  min16float4 Position              : SV_POSITION;
+  min16float3 ModelSpacePosition    : TEXCOORD0;
+  uint        rtvId                 : SV_RenderTargetArrayIndex;
+};
+
+Texture3D                               r_volumeTextures[MAXIMUM_VOLUMES]         : register(t0);
+Texture2D<float4>                       r_preIntegrationTables[MAXIMUM_VOLUMES]   : register(t4);
+SamplerState                            r_sampler                                 : s0;
+SamplerState                            r_tableSampler                            : s1;
+
+float4 main(PixelShaderInput input) : SV_TARGET
+{
+  // Front faces are drawn while the eyes are outside the box, so the ray is carried on through the surface to the far side
+  float3 eye = c_cameraPosition[input.rtvId].xyz;
+  float3 ray = mul(c_boundsPose, float4(input.ModelSpacePosition, 1.f)).xyz - eye;
+  float3 boundsInverse = ray != 0.f ? 1.f / ray : 1e30f;
+  float3 boundsExit = max((c_boundsMinimum.xyz - eye) * boundsInverse, (c_boundsMaximum.xyz - eye) * boundsInverse);
+  ray *= max(min(min(boundsExit.x, boundsExit.y), boundsExit.z), 1.f);
+
+  // Each volume's interval of the ray, and its own step length as a fraction of the ray
+  float3 origin[MAXIMUM_VOLUMES];
+  float3 direction[MAXIMUM_VOLUMES];
+  float enter[MAXIMUM_VOLUMES];
+  float exit[MAXIMUM_VOLUMES];
+  float stepLength[MAXIMUM_VOLUMES];
+  float events[2 * MAXIMUM_VOLUMES];
+  [unroll]
+  for (uint v = 0; v < MAXIMUM_VOLUMES; v++)
+  {
+    origin[v] = mul(c_volumes[v].textureFromWorld, float4(eye, 1.f)).xyz;
+    direction[v] = mul(c_volumes[v].textureFromWorld, float4(ray, 0.f)).xyz;
+
+    // Slabs of the unit box, a ray parallel to one is inside it everywhere or nowhere
+    float3 inverse = direction[v] != 0.f ? 1.f / direction[v] : 1e30f;
+    float3 t0 = -origin[v] * inverse;
+    float3 t1 = (1.f - origin[v]) * inverse;
+    float3 tNear = min(t0, t1);
+    float3 tFar = max(t0, t1);
+    enter[v] = max(max(max(tNear.x, tNear.y), tNear.z), 0.f);
+    exit[v] = min(min(min(tFar.x, tFar.y), tFar.z), 1.f);
+
+    float directionLength = length(direction[v]);
+    stepLength[v] = directionLength > 0.f ? length(direction[v] / directionLength * c_volumes[v].stepSize) / directionLength : 0.f;
+    if (v >= c_volumeCount || !(enter[v] < exit[v]) || stepLength[v] <= 0.f)
+    {
+      enter[v] = 1.f;
+      exit[v] = 1.f;
+    }
+    events[2 * v] = enter[v];
+    events[2 * v + 1] = exit[v];
+  }
+
+  // Interval ends in depth order
+  [unroll]
+  for (uint i = 1; i < 2 * MAXIMUM_VOLUMES; i++)
+  {
+    [unroll]
+    for (uint j = i; j > 0; j--)
+    {
+      float lower = min(events[j - 1], events[j]);
+      events[j] = max(events[j - 1], events[j]);
+      events[j - 1] = lower;
+    }
+  }
+
+  float4 dst = float4(0, 0, 0, 0);
+  float previous[MAXIMUM_VOLUMES] = { 0.f, 0.f, 0.f, 0.f };
+  bool havePrevious[MAXIMUM_VOLUMES] = { false, false, false, false };
+  uint steps = 0;
+
+  [loop]
+  for (uint k = 0; k + 1 < 2 * MAXIMUM_VOLUMES; k++)
+  {
+    float spanStart = events[k];
+    float spanEnd = events[k + 1];
+    if (!(spanEnd > spanStart))
+    {
+      continue;
+    }
+
+    // The volumes covering this span step together at the finest of their steps
+    float middle = 0.5f * (spanStart + spanEnd);
+    bool active[MAXIMUM_VOLUMES];
+    float step = 1e30f;
+    [unroll]
+    for (uint v = 0; v < MAXIMUM_VOLUMES; v++)
+    {
+      active[v] = enter[v] < exit[v] && enter[v] <= middle && middle <= exit[v];
+      if (active[v])
+      {
+        step = min(step, stepLength[v]);
+        if (!havePrevious[v])
+        {
+          // A volume's first segment starts at its entry point
+          previous[v] = r_volumeTextures[v].SampleLevel(r_sampler, origin[v] + direction[v] * spanStart, c_volumes[v].levelOfDetail).r;
+          havePrevious[v] = true;
+        }
+      }
+    }
+    if (step == 1e30f)
+    {
+      continue;
+    }
+    uint stepCount = (uint)max(ceil((spanEnd - spanStart) / step), 1.f);
+    step = (spanEnd - spanStart) / stepCount;
+
+    [loop]
+    for (uint s = 1; s <= stepCount; s++)
+    {
+      float t = spanStart + step * s;
+      float3 colour = float3(0, 0, 0);
+      float alphaSum = 0.f;
+      float transmittance = 1.f;
+      [unroll]
+      for (uint v = 0; v < MAXIMUM_VOLUMES; v++)
+      {
+        if (active[v])
+        {
+          float value = r_volumeTextures[v].SampleLevel(r_sampler, origin[v] + direction[v] * t, c_volumes[v].levelOfDetail).r;
+
+          // Pre-integrated segment from the previous sample, as LookupSegment in VolumeRendererPS.hlsl
+          float maximumX = c_volumes[v].tfMaximumXValue;
+          float tableSize = c_volumes[v].tfArraySize;
+          float2 index = saturate(float2(value, previous[v]) * c_volumes[v].voxelValueRange / maximumX) * (tableSize - 1);
+          float4 src = r_preIntegrationTables[v].SampleLevel(r_tableSampler, (index + 0.5f) / tableSize, 0.f);
+          previous[v] = value;
+
+          // The table is for the volume's own step, a shorter shared step lets proportionally less light through
+          float ratio = step / stepLength[v];
+          if (ratio < 1.f)
+          {
+            float alpha = 1.f - pow(1.f - src.a, ratio);
+            src.rgb *= src.a > 0.f ? alpha / src.a : ratio;
+            src.a = alpha;
+          }
+
+          colour += src.rgb;
+          alphaSum += src.a;
+          transmittance *= 1.f - src.a;
+        }
+      }
+
+      // Coincident samples block light together, and each colours the result in proportion to its opacity
+      float alpha = 1.f - transmittance;
+      float4 src = float4(colour * (alphaSum > 0.f ? alpha / alphaSum : 1.f), alpha);
+
+      // Front to back blending of the premultiplied colour
+      dst += (1.0f - dst.a) * src;
+      steps++;
+      if (dst.a >= .95f || steps >= c_maximumSteps)
+      {
+        break;
+      }
+    }
+    if (dst.a >= .95f || steps >= c_maximumSteps)
+    {
+      break;
+    }
+  }
+
+  dst.y = dst.z = dst.x;
+  return dst;
+}
\ No newline at end of file
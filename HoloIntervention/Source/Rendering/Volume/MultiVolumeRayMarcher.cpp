@@ -0,0 +1,299 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Local includes
+#include "pch.h"
+#include "MultiVolumeRayMarcher.h"
+#include "VolumeRayMarcher.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Texture slots the shader has for volumes and their tables
+    const uint32_t MultiVolumeRayMarcher::MAXIMUM_VOLUMES = 4;
+    const float MultiVolumeRayMarcher::EARLY_TERMINATION_ALPHA = 0.95f;
+
+    //----------------------------------------------------------------------------
+    MultiVolumeRayMarcher::MultiVolumeRayMarcher()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    bool MultiVolumeRayMarcher::AddVolume(const VolumeRayMarcher* volume, const float textureFromWorld[16])
+    {
+      if (volume == nullptr || m_volumes.size() >= MAXIMUM_VOLUMES)
+      {
+        return false;
+      }
+
+      Entry entry;
+      entry.Volume = volume;
+      std::copy(textureFromWorld, textureFromWorld + 16, entry.TextureFromWorld);
+      m_volumes.push_back(entry);
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void MultiVolumeRayMarcher::ClearVolumes()
+    {
+      m_volumes.clear();
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t MultiVolumeRayMarcher::GetVolumeCount() const
+    {
+      return static_cast<uint32_t>(m_volumes.size());
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t MultiVolumeRayMarcher::GetMaximumVolumeCount()
+    {
+      return MAXIMUM_VOLUMES;
+    }
+
+    //----------------------------------------------------------------------------
+    void MultiVolumeRayMarcher::FindIntervals(const float eye[3], const float end[3], std::vector<Interval>& outIntervals) const
+    {
+      outIntervals.clear();
+      VolumeRay rays[MAXIMUM_VOLUMES];
+      IntersectVolumes(eye, end, rays);
+      for (uint32_t i = 0; i < m_volumes.size(); ++i)
+      {
+        if (rays[i].Enter < rays[i].Exit)
+        {
+          Interval interval;
+          interval.Volume = i;
+          interval.Enter = rays[i].Enter;
+          interval.Exit = rays[i].Exit;
+          outIntervals.push_back(interval);
+        }
+      }
+      std::stable_sort(outIntervals.begin(), outIntervals.end(), [](const Interval& a, const Interval& b) { return a.Enter < b.Enter; });
+    }
+
+    //----------------------------------------------------------------------------
+    MultiVolumeRayMarcher::RayResult MultiVolumeRayMarcher::March(const float eye[3], const float end[3]) const
+    {
+      RayResult result;
+      const uint32_t volumeCount = static_cast<uint32_t>(m_volumes.size());
+      if (volumeCount == 0)
+      {
+        return result;
+      }
+
+      VolumeRay rays[MAXIMUM_VOLUMES];
+      IntersectVolumes(eye, end, rays);
+
+      // Both ends of every interval in depth order, insertion sorted as the shader does
+      float events[2 * MAXIMUM_VOLUMES];
+      const uint32_t eventCount = 2 * volumeCount;
+      for (uint32_t i = 0; i < volumeCount; ++i)
+      {
+        events[2 * i] = rays[i].Enter;
+        events[2 * i + 1] = rays[i].Exit;
+      }
+      for (uint32_t i = 1; i < eventCount; ++i)
+      {
+        const float event = events[i];
+        uint32_t j = i;
+        for (; j > 0 && events[j - 1] > event; --j)
+        {
+          events[j] = events[j - 1];
+        }
+        events[j] = event;
+      }
+
+      // A guard against runaway loops rather than a limit on depth, a box's diagonal is under twice its longest side
+      uint32_t maximumSteps(0);
+      for (auto& entry : m_volumes)
+      {
+        float stepSize[3];
+        uint32_t numIterations;
+        entry.Volume->GetStep(stepSize, numIterations);
+        maximumSteps += 2 * numIterations;
+      }
+
+      float* dst = result.Colour;
+      float previous[MAXIMUM_VOLUMES] = {};
+      bool havePrevious[MAXIMUM_VOLUMES] = {};
+      bool done = false;
+      for (uint32_t k = 0; k + 1 < eventCount && !done; ++k)
+      {
+        const float spanStart = events[k];
+        const float spanEnd = events[k + 1];
+        if (!(spanEnd > spanStart))
+        {
+          continue;
+        }
+
+        // The volumes covering this span and the finest step among them
+        const float middle = 0.5f * (spanStart + spanEnd);
+        bool active[MAXIMUM_VOLUMES] = {};
+        float step = 1e30f;
+        for (uint32_t i = 0; i < volumeCount; ++i)
+        {
+          active[i] = rays[i].Enter < rays[i].Exit && rays[i].Enter <= middle && middle <= rays[i].Exit;
+          if (active[i])
+          {
+            step = std::min(step, rays[i].Step);
+          }
+        }
+        if (step == 1e30f)
+        {
+          continue;
+        }
+        const uint32_t stepCount = static_cast<uint32_t>(std::max(std::ceil((spanEnd - spanStart) / step), 1.f));
+        step = (spanEnd - spanStart) / stepCount;
+
+        // A volume's first segment starts at its entry point
+        for (uint32_t i = 0; i < volumeCount; ++i)
+        {
+          if (active[i] && !havePrevious[i])
+          {
+            const float pos[3] = { rays[i].Origin[0] + rays[i].Direction[0] * spanStart, rays[i].Origin[1] + rays[i].Direction[1] * spanStart, rays[i].Origin[2] + rays[i].Direction[2] * spanStart };
+            previous[i] = m_volumes[i].Volume->Sample(pos);
+            havePrevious[i] = true;
+            result.Samples++;
+          }
+        }
+
+        for (uint32_t j = 1; j <= stepCount && !done; ++j)
+        {
+          const float t = spanStart + step * j;
+          float colour[3] = { 0.f, 0.f, 0.f };
+          float alphaSum(0.f);
+          float transmittance(1.f);
+          for (uint32_t i = 0; i < volumeCount; ++i)
+          {
+            if (!active[i])
+            {
+              continue;
+            }
+            const float pos[3] = { rays[i].Origin[0] + rays[i].Direction[0] * t, rays[i].Origin[1] + rays[i].Direction[1] * t, rays[i].Origin[2] + rays[i].Direction[2] * t };
+            const float value = m_volumes[i].Volume->Sample(pos);
+            result.Samples++;
+
+            float src[4];
+            m_volumes[i].Volume->ShadeSegment(previous[i], value, src);
+            previous[i] = value;
+
+            // The table is for the volume's own step, a shorter shared step lets proportionally less light through
+            const float ratio = step / rays[i].Step;
+            if (ratio < 1.f)
+            {
+              const float alpha = 1.f - std::pow(1.f - src[3], ratio);
+              const float scale = src[3] > 0.f ? alpha / src[3] : ratio;
+              src[0] *= scale;
+              src[1] *= scale;
+              src[2] *= scale;
+              src[3] = alpha;
+            }
+
+            colour[0] += src[0];
+            colour[1] += src[1];
+            colour[2] += src[2];
+            alphaSum += src[3];
+            transmittance *= 1.f - src[3];
+          }
+
+          // Coincident samples block light together, and each colours the result in proportion to its opacity
+          const float alpha = 1.f - transmittance;
+          const float mix = alphaSum > 0.f ? alpha / alphaSum : 1.f;
+          const float src[4] = { colour[0] * mix, colour[1] * mix, colour[2] * mix, alpha };
+
+          const float remaining = 1.f - dst[3];
+          for (int c = 0; c < 4; ++c)
+          {
+            dst[c] += remaining * src[c];
+          }
+          result.Steps++;
+          done = dst[3] >= EARLY_TERMINATION_ALPHA || result.Steps >= maximumSteps;
+        }
+      }
+
+      return result;
+    }
+
+    //----------------------------------------------------------------------------
+    void MultiVolumeRayMarcher::IntersectVolumes(const float eye[3], const float end[3], VolumeRay outRays[]) const
+    {
+      const float ray[3] = { end[0] - eye[0], end[1] - eye[1], end[2] - eye[2] };
+      for (uint32_t i = 0; i < m_volumes.size(); ++i)
+      {
+        const float* matrix = m_volumes[i].TextureFromWorld;
+        VolumeRay& out = outRays[i];
+        float tNear = 0.f;
+        float tFar = 1.f;
+        float lengthSquared = 0.f;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+          const float* row = matrix + axis * 4;
+          out.Origin[axis] = row[0] * eye[0] + row[1] * eye[1] + row[2] * eye[2] + row[3];
+          out.Direction[axis] = row[0] * ray[0] + row[1] * ray[1] + row[2] * ray[2];
+          lengthSquared += out.Direction[axis] * out.Direction[axis];
+
+          // Slabs of the unit box, a ray parallel to one is inside it everywhere or nowhere
+          const float inverse = out.Direction[axis] != 0.f ? 1.f / out.Direction[axis] : 1e30f;
+          const float t0 = -out.Origin[axis] * inverse;
+          const float t1 = (1.f - out.Origin[axis]) * inverse;
+          tNear = std::max(tNear, std::min(t0, t1));
+          tFar = std::min(tFar, std::max(t0, t1));
+        }
+
+        float stepSize[3];
+        uint32_t numIterations;
+        m_volumes[i].Volume->GetStep(stepSize, numIterations);
+        const float length = std::sqrt(lengthSquared);
+        out.Step = 0.f;
+        if (length > 0.f)
+        {
+          // The length of the volume's own step along this direction, as VolumeRendererPS.hlsl takes it
+          float stepLengthSquared(0.f);
+          for (int axis = 0; axis < 3; ++axis)
+          {
+            const float component = out.Direction[axis] / length * stepSize[axis];
+            stepLengthSquared += component * component;
+          }
+          out.Step = std::sqrt(stepLengthSquared) / length;
+        }
+
+        if (tNear < tFar && out.Step > 0.f)
+        {
+          out.Enter = tNear;
+          out.Exit = tFar;
+        }
+        else
+        {
+          out.Enter = out.Exit = 1.f;
+        }
+      }
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,99 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    class VolumeRayMarcher;
+
+    // CPU reference for MultiVolumePS.hlsl, the pass that marches every volume a ray crosses together
+    // Each volume's box covers an interval of the ray, from the eye (0) to the far side of the box enclosing every volume
+    // (1). Interval ends are sorted, and between neighbouring ends the volumes covering that span step together at the
+    // finest of their own step lengths. Opacity is corrected from each volume's step to the shared one, and samples at
+    // the same depth are mixed by opacity before front to back compositing, so the result is the same in any volume order.
+    class MultiVolumeRayMarcher
+    {
+    public:
+      struct Interval
+      {
+        uint32_t  Volume = 0;
+        float     Enter = 0.f;  // Fractions of the ray
+        float     Exit = 0.f;
+      };
+
+      struct RayResult
+      {
+        float     Colour[4] = { 0.f, 0.f, 0.f, 0.f };
+        uint32_t  Samples = 0;  // Volume samples taken
+        uint32_t  Steps = 0;    // Shared steps, each samples every volume covering it
+      };
+
+    public:
+      MultiVolumeRayMarcher();
+
+      /// textureFromWorld is row-major with column vectors, volume holds the step, samples and transfer function
+      /// Returns false once the shader's volume slots are full
+      bool AddVolume(const VolumeRayMarcher* volume, const float textureFromWorld[16]);
+      void ClearVolumes();
+      uint32_t GetVolumeCount() const;
+      static uint32_t GetMaximumVolumeCount();
+
+      /// Every box the ray from eye to end crosses, sorted by entry
+      void FindIntervals(const float eye[3], const float end[3], std::vector<Interval>& outIntervals) const;
+      RayResult March(const float eye[3], const float end[3]) const;
+
+    protected:
+      struct VolumeRay
+      {
+        float     Origin[3];      // Texture space, at the eye
+        float     Direction[3];   // Texture space, eye to end
+        float     Enter;
+        float     Exit;
+        float     Step;           // The volume's own step as a fraction of the ray
+      };
+
+      void IntersectVolumes(const float eye[3], const float end[3], VolumeRay outRays[]) const;
+
+    protected:
+      struct Entry
+      {
+        const VolumeRayMarcher*   Volume;
+        float                     TextureFromWorld[16];
+      };
+
+      static const uint32_t       MAXIMUM_VOLUMES;
+      static const float          EARLY_TERMINATION_ALPHA;
+
+      std::vector<Entry>          m_volumes;
+    };
+  }
+}
\ No newline at end of file
@@ -26,6 +26,11 @@ OTHER DEALINGS IN THE SOFTWARE.
 // Local includes
 #include "BaseTransferFunction.h"
 
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
 namespace HoloIntervention
 {
   namespace Rendering
@@ -42,27 +47,46 @@ namespace HoloIntervention
         // function range is from 0 to max value provided by control points
         if (m_controlPoints.size() < 2)
         {
-          throw std::exception("Not enough control points to compute a function. Need at least 2.");
+          throw std::logic_error("Not enough control points to compute a function. Need at least 2.");
+        }
+
+        if (m_isValid)
+        {
+          return;
         }
 
-        for (unsigned int i = 0; i < m_lookupTable.GetArraySize(); ++i)
+        const uint32 lastEntry = m_lookupTable.GetArraySize() - 1;
+        const float maximumXValue = GetMaximumXValue();
+        uint32 firstDirty = 0;
+        uint32 lastDirty = lastEntry;
+        if (!m_fullUpdateNeeded)
         {
-          auto ratio = (1.f * i) / (m_lookupTable.GetArraySize() - 1);
-          auto xValue = ratio * GetMaximumXValue();
-          // find xValue in control points
-          for (unsigned int j = 1; j < m_controlPoints.size(); ++j)
+          // Widened by an entry each way so rounding never leaves a stale entry behind
+          firstDirty = static_cast<uint32>(std::max(std::floor(m_dirtyMinimum / maximumXValue * lastEntry) - 1.f, 0.f));
+          lastDirty = static_cast<uint32>(std::min(std::ceil(m_dirtyMaximum / maximumXValue * lastEntry) + 1.f, static_cast<float>(lastEntry)));
+        }
+
+        // Sweep entries and control points together, both are sorted by input value
+        auto table = m_lookupTable.GetLookupTableArray();
+        size_t j = 1;
+        for (uint32 i = firstDirty; i <= lastDirty; ++i)
+        {
+          auto xValue = (1.f * i) / lastEntry * maximumXValue;
+          while (j < m_controlPoints.size() - 1 && xValue > m_controlPoints[j].m_inputValue)
           {
-            if (xValue >= m_controlPoints[j - 1].m_inputValue && xValue < m_controlPoints[j].m_inputValue)
-            {
-              // found it, linear interpolate y value and store
-              float thisXRange = m_controlPoints[j].m_inputValue - m_controlPoints[j - 1].m_inputValue;
-              DirectX::XMFLOAT4 thisYRange = m_controlPoints[j].m_outputValue - m_controlPoints[j - 1].m_outputValue;
-              float offset = xValue - m_controlPoints[j - 1].m_inputValue;
-              m_lookupTable.GetLookupTableArray()[i] = m_controlPoints[j - 1].m_outputValue + (offset / thisXRange) * thisYRange;
-            }
+            ++j;
           }
+
+          // linear interpolate y value and store, the last entry lands on the last control point
+          float thisXRange = m_controlPoints[j].m_inputValue - m_controlPoints[j - 1].m_inputValue;
+          DirectX::XMFLOAT4 thisYRange = m_controlPoints[j].m_outputValue - m_controlPoints[j - 1].m_outputValue;
+          float offset = std::min(std::max(xValue - m_controlPoints[j - 1].m_inputValue, 0.f), thisXRange);
+          table[i] = m_controlPoints[j - 1].m_outputValue + (offset / thisXRange) * thisYRange;
         }
 
+        m_fullUpdateNeeded = false;
+        m_dirtyMinimum = std::numeric_limits<float>::infinity();
+        m_dirtyMaximum = -std::numeric_limits<float>::infinity();
         m_isValid = true;
       }
     };
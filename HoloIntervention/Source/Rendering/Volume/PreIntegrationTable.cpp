@@ -0,0 +1,210 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "Float4Lanes.h"
+#include "PreIntegrationTable.h"
+
+// Common includes
+#include "WorkerPool.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Fully opaque entries would have infinite extinction
+    const float PreIntegrationTable::MAXIMUM_ENTRY_ALPHA = 0.9999f;
+
+    //----------------------------------------------------------------------------
+    PreIntegrationTable::PreIntegrationTable()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    bool PreIntegrationTable::Build(const std::vector<float>& rgba, uint32_t tableSize, float stepRatio, uint32_t threadCount)
+    {
+      const uint32_t inputCount = static_cast<uint32_t>(rgba.size() / 4);
+      if (inputCount < 2 || rgba.size() % 4 != 0 || tableSize < 2 || !(stepRatio > 0.f))
+      {
+        return false;
+      }
+
+      m_size = tableSize;
+      m_stepRatio = stepRatio;
+      m_opacities.resize(m_size);
+      m_extinction.resize(m_size);
+      m_colour.resize(m_size * 3);
+      m_extinctionIntegral.resize(m_size);
+      m_colourIntegral.resize(m_size * 3);
+      m_table.resize(m_size * m_size * 4);
+
+      // Resample the input linearly onto the table's entries
+      for (uint32_t i = 0; i < m_size; ++i)
+      {
+        const float position = static_cast<float>(i) / (m_size - 1) * (inputCount - 1);
+        const uint32_t lower = std::min(static_cast<uint32_t>(position), inputCount - 2);
+        const float fraction = position - lower;
+        float entry[4];
+        for (uint32_t c = 0; c < 4; ++c)
+        {
+          entry[c] = rgba[lower * 4 + c] + (rgba[(lower + 1) * 4 + c] - rgba[lower * 4 + c]) * fraction;
+        }
+
+        m_opacities[i] = entry[3];
+        m_extinction[i] = -std::log(1.f - std::min(std::max(entry[3], 0.f), MAXIMUM_ENTRY_ALPHA));
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+          m_colour[i * 3 + c] = entry[c];
+        }
+      }
+
+      // Trapezoidal running integrals, extinction and colour are piecewise linear between entries
+      m_extinctionIntegral[0] = 0.0;
+      m_colourIntegral[0] = m_colourIntegral[1] = m_colourIntegral[2] = 0.0;
+      for (uint32_t i = 1; i < m_size; ++i)
+      {
+        m_extinctionIntegral[i] = m_extinctionIntegral[i - 1] + 0.5 * (m_extinction[i - 1] + m_extinction[i]);
+        for (uint32_t c = 0; c < 3; ++c)
+        {
+          m_colourIntegral[i * 3 + c] = m_colourIntegral[(i - 1) * 3 + c] + 0.5 * (m_extinction[i - 1] * m_colour[(i - 1) * 3 + c] + m_extinction[i] * m_colour[i * 3 + c]);
+        }
+      }
+
+      // Rows are interleaved across the worker pool so the cost of each share is even
+      if (threadCount == 0)
+      {
+        threadCount = WorkerPool::instance().GetThreadCount();
+      }
+      threadCount = std::max(std::min(threadCount, m_size), 1u);
+
+      WorkerPool::instance().ParallelFor(threadCount, [this, threadCount](size_t share)
+      {
+        BuildRows(static_cast<uint32_t>(share), threadCount);
+      });
+
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool PreIntegrationTable::IsValid() const
+    {
+      return m_size > 0;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t PreIntegrationTable::GetSize() const
+    {
+      return m_size;
+    }
+
+    //----------------------------------------------------------------------------
+    float PreIntegrationTable::GetStepRatio() const
+    {
+      return m_stepRatio;
+    }
+
+    //----------------------------------------------------------------------------
+    const std::vector<float>& PreIntegrationTable::GetTable() const
+    {
+      return m_table;
+    }
+
+    //----------------------------------------------------------------------------
+    const std::vector<float>& PreIntegrationTable::GetOpacities() const
+    {
+      return m_opacities;
+    }
+
+    //----------------------------------------------------------------------------
+    void PreIntegrationTable::Lookup(float front, float back, float outRgba[4]) const
+    {
+      outRgba[0] = outRgba[1] = outRgba[2] = outRgba[3] = 0.f;
+      if (m_size == 0)
+      {
+        return;
+      }
+
+      const float row = std::min(std::max(front, 0.f), 1.f) * (m_size - 1);
+      const float column = std::min(std::max(back, 0.f), 1.f) * (m_size - 1);
+      const uint32_t row0 = std::min(static_cast<uint32_t>(row), m_size - 2);
+      const uint32_t column0 = std::min(static_cast<uint32_t>(column), m_size - 2);
+      const float rowFraction = row - row0;
+      const float columnFraction = column - column0;
+
+      // Entries are RGBA, each one a full set of lanes
+      const float* top = &m_table[(row0 * m_size + column0) * 4];
+      const float* bottom = top + m_size * 4;
+      const Float4Lanes left = Float4Lanes::Set(1.f - columnFraction);
+      const Float4Lanes right = Float4Lanes::Set(columnFraction);
+      const Float4Lanes topRow = Float4Lanes::Load(top) * left + Float4Lanes::Load(top + 4) * right;
+      const Float4Lanes bottomRow = Float4Lanes::Load(bottom) * left + Float4Lanes::Load(bottom + 4) * right;
+      (topRow * Float4Lanes::Set(1.f - rowFraction) + bottomRow * Float4Lanes::Set(rowFraction)).Store(outRgba);
+    }
+
+    //----------------------------------------------------------------------------
+    void PreIntegrationTable::BuildRows(uint32_t firstRow, uint32_t rowStride)
+    {
+      for (uint32_t front = firstRow; front < m_size; front += rowStride)
+      {
+        float* entry = &m_table[front * m_size * 4];
+        for (uint32_t back = 0; back < m_size; ++back, entry += 4)
+        {
+          // Average extinction and extinction weighted colour over the segment
+          double extinction;
+          double colour[3];
+          if (front == back)
+          {
+            extinction = m_extinction[front];
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+              colour[c] = m_extinction[front] * m_colour[front * 3 + c];
+            }
+          }
+          else
+          {
+            const double length = std::abs(static_cast<double>(back) - front);
+            extinction = std::abs(m_extinctionIntegral[back] - m_extinctionIntegral[front]) / length;
+            for (uint32_t c = 0; c < 3; ++c)
+            {
+              colour[c] = std::abs(m_colourIntegral[back * 3 + c] - m_colourIntegral[front * 3 + c]) / length;
+            }
+          }
+
+          const float alpha = static_cast<float>(1.0 - std::exp(-extinction * m_stepRatio));
+          for (uint32_t c = 0; c < 3; ++c)
+          {
+            // Colour is premultiplied, segments with no extinction contribute nothing
+            entry[c] = extinction > 0.0 ? static_cast<float>(alpha * colour[c] / extinction) : 0.f;
+          }
+          entry[3] = alpha;
+        }
+      }
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,76 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Pre-integrated transfer function for ray segments
+    // Entry (front, back) holds the premultiplied colour and opacity of one step whose samples vary linearly from the
+    // front value to the back value, so features narrower than a step are not missed and larger steps keep the look of
+    // small ones. Entries come from prefix integrals of extinction, so a build is O(N^2) for an N entry table.
+    class PreIntegrationTable
+    {
+    public:
+      PreIntegrationTable();
+
+      /// rgba holds 4 floats per entry, evenly spaced over the transfer function input range, alpha is per reference step
+      /// stepRatio is the ray step length over the reference step the alphas were specified for
+      /// threadCount shares of the work run on the WorkerPool, 0 uses one per pool thread
+      bool Build(const std::vector<float>& rgba, uint32_t tableSize, float stepRatio, uint32_t threadCount = 0);
+
+      bool IsValid() const;
+      uint32_t GetSize() const;
+      float GetStepRatio() const;
+      const std::vector<float>& GetTable() const;      // size * size * 4 floats, row is the front entry, column the back
+      const std::vector<float>& GetOpacities() const;  // The input alphas resampled to size entries
+
+      /// front and back are normalized to the input range, filtered like the shader's linear clamp sampler
+      void Lookup(float front, float back, float outRgba[4]) const;
+
+    protected:
+      void BuildRows(uint32_t firstRow, uint32_t rowStride);
+
+    protected:
+      static const float      MAXIMUM_ENTRY_ALPHA;
+
+      uint32_t                m_size = 0;
+      float                   m_stepRatio = 1.f;
+      std::vector<float>      m_table;
+      std::vector<float>      m_opacities;
+
+      // Resampled entries and their running integrals, index i of an integral covers entries [0, i]
+      std::vector<float>      m_extinction;
+      std::vector<float>      m_colour;
+      std::vector<double>     m_extinctionIntegral;
+      std::vector<double>     m_colourIntegral;  // Extinction weighted colour, 3 per entry
+    };
+  }
+}
\ No newline at end of file
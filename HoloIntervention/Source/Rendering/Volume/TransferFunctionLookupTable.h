@@ -23,6 +23,12 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #pragma once
 
+// DirectX includes
+#include <DirectXMath.h>
+
+// STL includes
+#include <cstring>
+
 namespace HoloIntervention
 {
   namespace Rendering
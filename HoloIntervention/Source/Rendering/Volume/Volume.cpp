@@ -25,12 +25,16 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "pch.h"
 #include "AppView.h"
 #include "Volume.h"
+#include "VolumeRayMarcher.h"
 
 // Common includes
 #include "Common.h"
 #include "DeviceResources.h"
 #include "DirectXHelper.h"
+#include "FrameBufferPool.h"
+#include "RenderingCommon.h"
 #include "StepTimer.h"
+#include "WorkerPool.h"
 
 // System includes
 #include "NotificationSystem.h"
@@ -47,6 +51,11 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "Log.h"
 #include <WindowsNumerics.h>
 
+// STL includes
+#include <chrono>
+#include <limits>
+#include <thread>
+
 using namespace Concurrency;
 using namespace DirectX;
 using namespace Windows::Foundation::Numerics;
@@ -76,6 +85,82 @@ namespace
 
     return res;
   }
+
+  // Uploads bricks straight from the frame's buffer into the volume texture
+  class D3DBrickUploadTarget : public HoloIntervention::Rendering::IBrickUploadTarget
+  {
+  public:
+    D3DBrickUploadTarget(ID3D11DeviceContext* context, ID3D11Resource* texture)
+      : m_context(context)
+      , m_texture(texture)
+    {
+    }
+
+    virtual void UploadBox(const HoloIntervention::Rendering::BrickBox& box, const uint8_t* source, uint32_t rowPitch, uint32_t depthPitch)
+    {
+      D3D11_BOX d3dBox = { box.Left, box.Top, box.Front, box.Right, box.Bottom, box.Back };
+      m_context->UpdateSubresource(m_texture, 0, &d3dBox, source, rowPitch, depthPitch);
+    }
+
+  protected:
+    ID3D11DeviceContext*  m_context;
+    ID3D11Resource*       m_texture;
+  };
+
+  // Each slot of a volume's frame ring is its own single level texture, drawn by binding that slot's view
+  class D3DVolumeFrameTarget : public HoloIntervention::Rendering::IVolumeFrameTarget
+  {
+  public:
+    D3DVolumeFrameTarget(ID3D11Device* device,
+                         ID3D11DeviceContext* context,
+                         DXGI_FORMAT format,
+                         std::vector<Microsoft::WRL::ComPtr<ID3D11Texture3D>>& textures,
+                         std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>& views)
+      : m_device(device)
+      , m_context(context)
+      , m_format(format)
+      , m_textures(textures)
+      , m_views(views)
+    {
+    }
+
+    virtual bool AllocateSlots(uint32_t slotCount, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel)
+    {
+      ReleaseSlots();
+      m_textures.resize(slotCount);
+      m_views.resize(slotCount);
+      for (uint32_t i = 0; i < slotCount; ++i)
+      {
+        CD3D11_TEXTURE3D_DESC textureDesc(m_format, width, height, depth, 1);
+        CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc(D3D11_SRV_DIMENSION_TEXTURE3D, m_format);
+        if (FAILED(m_device->CreateTexture3D(&textureDesc, nullptr, m_textures[i].GetAddressOf())) ||
+            FAILED(m_device->CreateShaderResourceView(m_textures[i].Get(), &srvDesc, m_views[i].GetAddressOf())))
+        {
+          ReleaseSlots();
+          return false;
+        }
+      }
+      return true;
+    }
+
+    virtual void ReleaseSlots()
+    {
+      m_textures.clear();
+      m_views.clear();
+    }
+
+    virtual void UploadFrame(uint32_t slot, const uint8_t* image, uint32_t rowPitch, uint32_t depthPitch)
+    {
+      m_context->UpdateSubresource(m_textures[slot].Get(), 0, nullptr, image, rowPitch, depthPitch);
+    }
+
+  protected:
+    ID3D11Device*                                                     m_device;
+    ID3D11DeviceContext*                                              m_context;
+    DXGI_FORMAT                                                       m_format;
+    std::vector<Microsoft::WRL::ComPtr<ID3D11Texture3D>>&             m_textures;
+    std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>>&    m_views;
+  };
 }
 
 namespace HoloIntervention
@@ -83,6 +168,12 @@ namespace HoloIntervention
   namespace Rendering
   {
     const float Volume::LERP_RATE = 2.5f;
+    const uint64 Volume::UPLOAD_BUDGET_BYTES_PER_FRAME = 8 * 1024 * 1024;
+    const uint32 Volume::PREINTEGRATION_TABLE_SIZE = 256;
+    // Frames are shown this far behind the newest arrival, so the ring can upload them before they are due
+    const double Volume::TIME_SERIES_PLAYOUT_DELAY_SEC = 0.1;
+    const uint32 Volume::HISTOGRAM_BYTE_BIN_COUNT = 256;
+    const uint32 Volume::HISTOGRAM_WIDE_BIN_COUNT = 4096;
 
     //----------------------------------------------------------------------------
     Volume::Volume(const std::shared_ptr<DX::DeviceResources>& deviceResources, uint64 token, ID3D11Buffer* cwIndexBuffer, ID3D11Buffer* ccwIndexBuffer, ID3D11InputLayout* inputLayout, ID3D11Buffer* vertexBuffer, ID3D11VertexShader* volRenderVertexShader, ID3D11GeometryShader* volRenderGeometryShader, ID3D11PixelShader* volRenderPixelShader, ID3D11PixelShader* faceCalcPixelShader, ID3D11Texture2D* frontPositionTextureArray, ID3D11Texture2D* backPositionTextureArray, ID3D11RenderTargetView* frontPositionRTV, ID3D11RenderTargetView* backPositionRTV, ID3D11ShaderResourceView* frontPositionSRV, ID3D11ShaderResourceView* backPositionSRV, DX::StepTimer& timer)
@@ -103,10 +194,12 @@ namespace HoloIntervention
       , m_frontPositionSRV(frontPositionSRV)
       , m_backPositionSRV(backPositionSRV)
       , m_timer(timer)
+      , m_timeSeriesClockOffset(-std::numeric_limits<double>::infinity())
     {
+      m_constantBuffer.gradientEnabled = 0;
       ControlPointList points;
       points.push_back(ControlPoint(0.f, float4(0.f, 0.f, 0.f, 0.f)));
-      points.push_back(ControlPoint(255.f, float4(0.f, 0.f, 0.f, 1.f)));
+      points.push_back(ControlPoint(255.f, float4(1.f, 1.f, 1.f, 1.f)));
       SetOpacityTransferFunctionTypeAsync(TransferFunction_Piecewise_Linear, 512, points);
 
       CreateDeviceDependentResources();
@@ -196,28 +289,47 @@ namespace HoloIntervention
 
       m_currentPose = MatrixCompose(smoothedTranslation, smoothedRotation, smoothedScale, true);
 
-      if (m_volumeUpdateNeeded)
+      AcceptPublishedFrame();
+      if (m_volumeBuilt.exchange(false))
+      {
+        FinishVolumeResources();
+      }
+      if (m_volumeReady && AreGradientsWanted() != m_gradientsWanted)
+      {
+        m_volumeUpdateNeeded = true;
+      }
+      if (m_volumeUpdateNeeded && !m_volumeBuilding)
       {
+        // A volume still being built is replaced once it is finished
         ReleaseVolumeResources();
         CreateVolumeResources();
         m_volumeUpdateNeeded = false;
       }
 
-      if (m_onGPUFrame != m_frame)
+      if (m_timeSeriesActive)
+      {
+        UpdateTimeSeries();
+      }
+      else if (m_onGPUFrame != m_frame)
       {
         UpdateGPUImageData();
       }
+      UpdateMacrocells();
+      UpdateStepScale();
+      m_constantBuffer.shadingAmbient = m_shadingAmbient;
+      m_constantBuffer.gradientOpacityWeight = m_gradientOpacityWeight;
+      m_constantBuffer.gradientOpacityGain = m_gradientOpacityGain;
 
       XMStoreFloat4x4(&m_constantBuffer.worldMatrix, XMLoadFloat4x4(&m_currentPose));
       context->UpdateSubresource(m_volumeEntryConstantBuffer.Get(), 0, nullptr, &m_constantBuffer, 0, 0);
     }
 
     //----------------------------------------------------------------------------
-    void Volume::Render(uint32 indexCount)
+    bool Volume::Render(uint32 indexCount)
     {
-      if (!m_volumeReady || !m_tfResourcesReady)
+      if (!m_volumeReady || !m_tfResourcesReady || (m_timeSeriesActive && m_displayedSlot < 0))
       {
-        return;
+        return false;
       }
 
       ID3D11DeviceContext3* context = m_deviceResources->GetD3DDeviceContext();
@@ -262,19 +374,49 @@ namespace HoloIntervention
       targets[0] = hololensRenderTargetView;
       context->OMSetRenderTargets(1, targets, hololensStencilView);
       context->IASetIndexBuffer(m_cwIndexBuffer, DXGI_FORMAT_R16_UINT, 0);
-      ID3D11ShaderResourceView* shaderResourceViews[4] = { m_opacityLookupTableSRV.Get(), m_volumeSRV.Get(), m_frontPositionSRV, m_backPositionSRV };
-      context->PSSetShaderResources(0, 4, shaderResourceViews);
-      ID3D11SamplerState* samplerStates[1] = { m_samplerState.Get() };
-      context->PSSetSamplers(0, 1, samplerStates);
+      ID3D11ShaderResourceView* volumeSRV = m_timeSeriesActive ? m_frameSRVs[m_displayedSlot].Get() : m_volumeSRV.Get();
+      ID3D11ShaderResourceView* shaderResourceViews[6] = { m_preIntegrationSRV.Get(), volumeSRV, m_frontPositionSRV, m_backPositionSRV, m_occupancySRV.Get(), m_gradientSRV.Get() };
+      context->PSSetShaderResources(0, 6, shaderResourceViews);
+      ID3D11SamplerState* samplerStates[2] = { m_samplerState.Get(), m_tableSamplerState.Get() };
+      context->PSSetSamplers(0, 2, samplerStates);
       context->PSSetConstantBuffers(0, 1, m_volumeEntryConstantBuffer.GetAddressOf());
       context->PSSetShader(m_volRenderPixelShader, nullptr, 0);
       context->DrawIndexedInstanced(indexCount, 2, 0, 0, 0);
 
       // Clear values
-      ID3D11ShaderResourceView* ppSRVnullptr[4] = { nullptr, nullptr, nullptr, nullptr };
-      context->PSSetShaderResources(0, 4, ppSRVnullptr);
-      ID3D11SamplerState* ppSamplerStatesnullptr[1] = { nullptr };
-      context->PSSetSamplers(0, 1, ppSamplerStatesnullptr);
+      ID3D11ShaderResourceView* ppSRVnullptr[6] = { nullptr, nullptr, nullptr, nullptr, nullptr, nullptr };
+      context->PSSetShaderResources(0, 6, ppSRVnullptr);
+      ID3D11SamplerState* ppSamplerStatesnullptr[2] = { nullptr, nullptr };
+      context->PSSetSamplers(0, 2, ppSamplerStatesnullptr);
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool Volume::GetMultiVolumeEntry(MultiVolumeEntry& outEntry, ID3D11ShaderResourceView*& outVolumeSRV, ID3D11ShaderResourceView*& outTableSRV) const
+    {
+      if (!m_volumeReady || !m_tfResourcesReady || (m_timeSeriesActive && m_displayedSlot < 0))
+      {
+        return false;
+      }
+
+      // Texture coordinates flip y and z of the unit cube, as FaceAnalysisPS does
+      float4x4 modelFromWorld;
+      if (!invert(m_currentPose, &modelFromWorld))
+      {
+        return false;
+      }
+      const float4x4 textureFromWorld = modelFromWorld * make_float4x4_scale(1.f, -1.f, -1.f) * make_float4x4_translation(0.f, 1.f, 1.f);
+      XMStoreFloat4x4(&outEntry.textureFromWorld, XMLoadFloat4x4(&textureFromWorld));
+      outEntry.stepSize = m_constantBuffer.stepSize;
+      outEntry.levelOfDetail = m_constantBuffer.levelOfDetail;
+      outEntry.lt_maximumXValue = m_constantBuffer.lt_maximumXValue;
+      outEntry.lt_arraySize = m_constantBuffer.lt_arraySize;
+      outEntry.voxelValueRange = m_constantBuffer.voxelValueRange;
+      outEntry.numIterations = m_constantBuffer.numIterations;
+
+      outVolumeSRV = m_timeSeriesActive ? m_frameSRVs[m_displayedSlot].Get() : m_volumeSRV.Get();
+      outTableSRV = m_preIntegrationSRV.Get();
+      return true;
     }
 
     //----------------------------------------------------------------------------
@@ -286,24 +428,282 @@ namespace HoloIntervention
         return;
       }
 
-      if (!m_volumeReady)
+      std::shared_ptr<byte> image = *(std::shared_ptr<byte>*)(frame->Image->GetImageData());
+      if (image == nullptr)
       {
-        m_volumeUpdateNeeded = true;
+        LOG(LogLevelType::LOG_LEVEL_ERROR, "Unable to access image buffer.");
+        return;
       }
-      else if (m_frame != nullptr)
+
+      const auto format = (DXGI_FORMAT)frame->GetPixelFormat(true);
+      const auto uploadFormat = GetVoxelUploadFormat(format);
+      const auto sourceType = GetVoxelType(format);
+      const auto destinationType = GetVoxelType(uploadFormat);
+
+      VoxelWindow window;
+      bool hasWindow(false);
+      bool autoWindow(false);
+      float lowerFraction(0.f);
+      float upperFraction(1.f);
+      std::shared_ptr<const VoxelHistogram> previousHistogram;
+      uint64 sequence(0);
+      {
+        std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+        window = m_voxelWindow;
+        hasWindow = m_hasVoxelWindow;
+        autoWindow = m_autoWindow;
+        lowerFraction = m_autoWindowLowerFraction;
+        upperFraction = m_autoWindowUpperFraction;
+        previousHistogram = m_histogram;
+        sequence = ++m_frameSequence;
+      }
+
+      if (!VoxelConverter::IsSupported(sourceType, destinationType) || (uploadFormat == format && !hasWindow && !autoWindow))
+      {
+        PublishFrame(frame, image, format, sequence);
+        return;
+      }
+
+      if (!hasWindow && !autoWindow)
+      {
+        window = VoxelConverter::GetTypeRangeWindow(sourceType, destinationType);
+      }
+
+      // Converted into a pooled buffer off the calling thread, the render thread only sees finished frames
+      const size_t count = static_cast<size_t>(frameSize[0]) * frameSize[1] * frameSize[2];
+      create_task([this, frame, image, sourceType, destinationType, uploadFormat, window, autoWindow, lowerFraction, upperFraction, previousHistogram, count, sequence]()
       {
-        if (m_frame != nullptr)
         {
-          auto myFrameSize = m_frame->Dimensions;
-          if (myFrameSize[0] != frameSize[0] || myFrameSize[1] != frameSize[1] || myFrameSize[2] != frameSize[2])
+          // Frames arriving faster than they convert are dropped rather than queued
+          std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+          if (sequence != m_frameSequence)
           {
-            // GPU needs to be reallocated
-            m_volumeUpdateNeeded = true;
+            return;
           }
         }
+
+        VoxelWindow frameWindow = window;
+        std::shared_ptr<VoxelHistogram> histogram;
+        if (autoWindow)
+        {
+          // Integer bins span the whole type; float bins span the previous frame's range, the ends catch anything beyond it
+          float minimum(0.f);
+          float maximum(1.f);
+          if (previousHistogram != nullptr && previousHistogram->GetType() == sourceType && previousHistogram->GetMaximum() > previousHistogram->GetMinimum())
+          {
+            minimum = previousHistogram->GetMinimum();
+            maximum = previousHistogram->GetMaximum();
+          }
+          histogram = std::make_shared<VoxelHistogram>();
+          histogram->Reset(sourceType, VoxelConverter::GetSize(sourceType) == 1 ? HISTOGRAM_BYTE_BIN_COUNT : HISTOGRAM_WIDE_BIN_COUNT, minimum, maximum);
+          histogram->Build(image.get(), count);
+          frameWindow = histogram->GetAutoWindow(window, lowerFraction, upperFraction);
+        }
+
+        std::shared_ptr<uint8_t> converted = FrameBufferPool::instance().Acquire(count * VoxelConverter::GetSize(destinationType));
+        if (!VoxelConverter::Convert(image.get(), sourceType, converted.get(), destinationType, count, frameWindow))
+        {
+          LOG(LogLevelType::LOG_LEVEL_ERROR, "Unable to convert volume frame.");
+          return;
+        }
+
+        if (histogram != nullptr)
+        {
+          std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+          if (sequence > m_histogramSequence)
+          {
+            m_histogram = histogram;
+            m_histogramWindow = frameWindow;
+            m_histogramUploadType = destinationType;
+            m_histogramSequence = sequence;
+          }
+        }
+        PublishFrame(frame, converted, uploadFormat, sequence);
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::SetVoxelWindow(const VoxelWindow& window)
+    {
+      if (window.Windowed && !(window.WindowWidth > 0.f))
+      {
+        LOG(LogLevelType::LOG_LEVEL_ERROR, "Voxel window width must be positive.");
+        return;
+      }
+
+      // Applies from the next frame on
+      std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+      m_voxelWindow = window;
+      m_hasVoxelWindow = true;
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::ClearVoxelWindow()
+    {
+      std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+      m_hasVoxelWindow = false;
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::SetAutoWindow(bool enabled, float lowerFraction, float upperFraction)
+    {
+      if (enabled && !(lowerFraction >= 0.f && lowerFraction < upperFraction && upperFraction <= 1.f))
+      {
+        LOG(LogLevelType::LOG_LEVEL_ERROR, "Auto window percentiles must satisfy 0 <= lower < upper <= 1.");
+        return;
+      }
+
+      // Applies from the next frame on
+      std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+      m_autoWindow = enabled;
+      if (enabled)
+      {
+        m_autoWindowLowerFraction = lowerFraction;
+        m_autoWindowUpperFraction = upperFraction;
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    std::shared_ptr<const VoxelHistogram> Volume::GetHistogram() const
+    {
+      std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+      return m_histogram;
+    }
+
+    //----------------------------------------------------------------------------
+    bool Volume::GetTransferFunctionRange(float lowerFraction, float upperFraction, float& outMinimum, float& outMaximum) const
+    {
+      std::shared_ptr<const VoxelHistogram> histogram;
+      VoxelWindow window;
+      VoxelType uploadType;
+      {
+        std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+        histogram = m_histogram;
+        window = m_histogramWindow;
+        uploadType = m_histogramUploadType;
+      }
+      if (histogram == nullptr || histogram->GetCount() == 0)
+      {
+        return false;
+      }
+
+      // Follow stored values through the conversion to the uploaded values the transfer function is indexed by
+      const float range = uploadType == VoxelType_UInt16 ? 65535.f : 255.f;
+      auto toUploaded = [&window, range](float stored)
+      {
+        float value = stored * window.Slope + window.Intercept;
+        if (window.Windowed)
+        {
+          value = (value - (window.WindowCenter - 0.5f * window.WindowWidth)) * range / window.WindowWidth;
+        }
+        return std::min(std::max(value, 0.f), range);
+      };
+      const float lower = toUploaded(histogram->GetPercentile(lowerFraction));
+      const float upper = toUploaded(histogram->GetPercentile(upperFraction));
+      outMinimum = std::min(lower, upper);
+      outMaximum = std::max(lower, upper);
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::PublishFrame(UWPOpenIGTLink::VideoFrame^ frame, std::shared_ptr<uint8_t> image, DXGI_FORMAT format, uint64 sequence)
+    {
+      std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+      if (sequence < m_publishedSequence)
+      {
+        return;
       }
+      m_publishedSequence = sequence;
+      m_publishedFrame = frame;
+      m_publishedImage = image;
+      m_publishedFormat = format;
+    }
 
+    //----------------------------------------------------------------------------
+    void Volume::AcceptPublishedFrame()
+    {
+      UWPOpenIGTLink::VideoFrame^ frame;
+      std::shared_ptr<uint8_t> image;
+      DXGI_FORMAT format;
+      {
+        std::lock_guard<std::mutex> guard(m_imageAccessMutex);
+        if (m_publishedFrame == nullptr)
+        {
+          return;
+        }
+        frame = m_publishedFrame;
+        image = std::move(m_publishedImage);
+        format = m_publishedFormat;
+        m_publishedFrame = nullptr;
+      }
+
+      if (!m_volumeReady || m_frame == nullptr || format != m_frameFormat)
+      {
+        m_volumeUpdateNeeded = true;
+      }
+      else
+      {
+        auto myFrameSize = m_frame->Dimensions;
+        auto frameSize = frame->Dimensions;
+        if (myFrameSize[0] != frameSize[0] || myFrameSize[1] != frameSize[1] || myFrameSize[2] != frameSize[2])
+        {
+          // GPU needs to be reallocated
+          m_volumeUpdateNeeded = true;
+        }
+      }
+
+      const bool clockRestarted = m_frame != nullptr && frame->Timestamp < m_frame->Timestamp;
       m_frame = frame;
+      m_frameImage = image;
+      m_frameFormat = format;
+
+      // Arrival on the render timer bounds the offset between the clocks, the least delayed frame is the closest bound
+      // A restarted frame clock invalidates every earlier bound, the ring discards its frames in the same case
+      const double clockOffset = frame->Timestamp - m_timer.GetTotalSeconds();
+      m_timeSeriesClockOffset = clockRestarted ? clockOffset : std::max(m_timeSeriesClockOffset, clockOffset);
+      if (m_timeSeriesActive && !m_volumeUpdateNeeded)
+      {
+        std::lock_guard<std::mutex> guard(m_frameRingMutex);
+        if (!m_frameRing.AddFrame(frame->Timestamp, image) && m_frameRing.GetSlotCount() == 0)
+        {
+          // The ring failed to allocate, retry with this frame rather than drawing a stale one
+          m_volumeUpdateNeeded = true;
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::SetTimeSeries(uint32 frameCount, uint64 memoryBudgetBytes)
+    {
+      std::lock_guard<std::mutex> guard(m_frameRingMutex);
+      if (frameCount == m_timeSeriesFrameCount && memoryBudgetBytes == m_timeSeriesBudget)
+      {
+        return;
+      }
+      m_timeSeriesFrameCount = frameCount;
+      m_timeSeriesBudget = memoryBudgetBytes;
+      m_volumeUpdateNeeded = true;
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::SetTimeSeriesPlayback(VolumeFrameRing::PlaybackMode mode)
+    {
+      std::lock_guard<std::mutex> guard(m_frameRingMutex);
+      m_frameRing.SetPlaybackMode(mode);
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeFrameRing::Stats Volume::GetTimeSeriesStats() const
+    {
+      std::lock_guard<std::mutex> guard(m_frameRingMutex);
+      return m_frameRing.GetStats();
+    }
+
+    //----------------------------------------------------------------------------
+    uint64 Volume::GetTimeSeriesMemoryUsage() const
+    {
+      std::lock_guard<std::mutex> guard(m_frameRingMutex);
+      return m_frameRing.GetResidentBytes() + m_frameRing.GetWaitingBytes();
     }
 
     //----------------------------------------------------------------------------
@@ -347,9 +747,7 @@ namespace HoloIntervention
     {
       const auto context = m_deviceResources->GetD3DDeviceContext();
 
-      auto bytesPerPixel = BitsPerPixel((DXGI_FORMAT)m_frame->GetPixelFormat(true)) / 8;
-
-      std::shared_ptr<byte> image = *(std::shared_ptr<byte>*)(m_frame->Image->GetImageData());
+      const std::shared_ptr<uint8_t>& image = m_frameImage;
       if (image == nullptr)
       {
         LOG(LogLevelType::LOG_LEVEL_ERROR, "Unable to access image buffer.");
@@ -357,30 +755,163 @@ namespace HoloIntervention
       }
 
       auto frameSize = m_frame->Dimensions;
-      if (frameSize[2] < 1)
+      if (frameSize[2] < 1 || m_volumeTexture == nullptr)
+      {
+        return;
+      }
+
+      // Only bricks whose content changed are uploaded, a large change is spread over several frames
+      if (m_brickHashedFrame != m_frame)
+      {
+        m_brickUploader.MarkChanged(image.get());
+        m_brickHashedFrame = m_frame;
+      }
+
+      // The macrocells follow what is on the GPU, not what is waiting to be uploaded
+      D3DBrickUploadTarget target(context, m_volumeTexture.Get());
+      m_uploadedBricks.clear();
+      m_brickUploader.Upload(target, image.get(), UPLOAD_BUDGET_BYTES_PER_FRAME, &m_uploadedBricks);
+      for (auto& box : m_uploadedBricks)
+      {
+        m_macrocellGrid.UpdateRegion(image.get(), box);
+        m_pyramid.UpdateRegion(image.get(), box, &m_pyramidRegions);
+        UploadPyramidRegions(m_pyramidRegions);
+        UploadGradientRegion(box);
+      }
+
+      if (!m_brickUploader.HasDirtyBricks())
+      {
+        m_onGPUFrame = m_frame;
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::UpdateTimeSeries()
+    {
+      const double displayTime = m_timer.GetTotalSeconds() + m_timeSeriesClockOffset - TIME_SERIES_PLAYOUT_DELAY_SEC;
+
+      std::lock_guard<std::mutex> guard(m_frameRingMutex);
+      D3DVolumeFrameTarget target(m_deviceResources->GetD3DDevice(), m_deviceResources->GetD3DDeviceContext(), m_frameFormat, m_frameTextures, m_frameSRVs);
+      const uint64 frameBytes = std::max<uint64>(m_frameRing.GetFrameBytes(), 1);
+      m_frameRing.Upload(target, displayTime, static_cast<uint32>(std::max<uint64>(UPLOAD_BUDGET_BYTES_PER_FRAME / frameBytes, 1)));
+      m_displayedSlot = m_frameRing.SelectFrame(displayTime);
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::UploadPyramidRegions(const std::vector<BrickBox>& regions)
+    {
+      // regions[i] is the rebuilt box of mip level i + 1, not counted against the upload budget (at most a seventh more)
+      const auto context = m_deviceResources->GetD3DDeviceContext();
+      for (uint32 i = 0; i < regions.size(); ++i)
+      {
+        const uint32 level = i + 1;
+        uint32 size[3];
+        m_pyramid.GetLevelSize(level, size);
+        const uint32 rowPitch = size[0] * m_pyramid.GetBytesPerVoxel();
+        const uint32 depthPitch = rowPitch * size[1];
+        const BrickBox& box = regions[i];
+        const D3D11_BOX d3dBox = { box.Left, box.Top, box.Front, box.Right, box.Bottom, box.Back };
+        const uint8_t* source = m_pyramid.GetLevel(level).data() + (size_t)box.Front * depthPitch + (size_t)box.Top * rowPitch + (size_t)box.Left * m_pyramid.GetBytesPerVoxel();
+        context->UpdateSubresource(m_volumeTexture.Get(), D3D11CalcSubresource(level, 0, m_pyramid.GetLevelCount()), &d3dBox, source, rowPitch, depthPitch);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::UploadGradientRegion(const BrickBox& region)
+    {
+      // Gradients read a voxel either side, so the rebuilt box is the brick grown by one
+      if (!m_gradients.IsSupported() || m_gradientTexture == nullptr)
       {
         return;
       }
+      BrickBox box;
+      m_gradients.UpdateRegion(m_frameImage.get(), region, &box);
+
+      const uint32 rowPitch = m_volumeDimensions[0] * 4;
+      const uint32 depthPitch = rowPitch * m_volumeDimensions[1];
+      const D3D11_BOX d3dBox = { box.Left, box.Top, box.Front, box.Right, box.Bottom, box.Back };
+      const uint8_t* source = m_gradients.GetData().data() + (size_t)box.Front * depthPitch + (size_t)box.Top * rowPitch + (size_t)box.Left * 4;
+      m_deviceResources->GetD3DDeviceContext()->UpdateSubresource(m_gradientTexture.Get(), 0, &d3dBox, source, rowPitch, depthPitch);
+    }
 
-      // Map image resource and update data
-      byte* imageRaw = image.get();
-      D3D11_MAPPED_SUBRESOURCE mappedResource;
-      context->Map(m_volumeStagingTexture.Get(), 0, D3D11_MAP_READ_WRITE, 0, &mappedResource);
-      byte* mappedData = reinterpret_cast<byte*>(mappedResource.pData);
-      for (uint32 j = 0; j < frameSize[2]; ++j)
+    //----------------------------------------------------------------------------
+    void Volume::UpdateMacrocells()
+    {
+      if (m_volumeBuilding)
       {
-        for (uint32 i = 0; i < frameSize[1]; ++i)
+        // The build task owns the grid, and takes the latest opacity table when it starts
+        return;
+      }
+
+      if (m_opacityTableChanged.exchange(false))
+      {
+        std::lock_guard<std::mutex> guard(m_opacityTFMutex);
+        m_macrocellGrid.SetOpacityTable(m_pendingOpacityTable, m_constantBuffer.lt_maximumXValue);
+      }
+
+      if (m_macrocellGrid.Classify() && m_occupancyTexture != nullptr)
+      {
+        uint32_t gridSize[3];
+        m_macrocellGrid.GetGridSize(gridSize);
+        m_deviceResources->GetD3DDeviceContext()->UpdateSubresource(m_occupancyTexture.Get(), 0, nullptr, m_macrocellGrid.GetOccupancy().data(), gridSize[0], gridSize[0] * gridSize[1]);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::UpdateStepScale()
+    {
+      if (m_stepScaleTableReady.exchange(false))
+      {
+        // The table and the step it was integrated for go to the GPU together
+        // A table built before the transfer function last changed is stale, the check below requests a new one
+        std::lock_guard<std::mutex> guard(m_opacityTFMutex);
+        if (m_stepScaleTableGeneration == m_tfGeneration && m_preIntegrationTexture != nullptr && m_stepScaleTable.GetSize() == m_preIntegrationTable.GetSize())
         {
-          memcpy(mappedData, imageRaw, frameSize[0] * bytesPerPixel);
-          mappedData += mappedResource.RowPitch;
-          imageRaw += frameSize[0] * bytesPerPixel;
+          std::swap(m_preIntegrationTable, m_stepScaleTable);
+          m_stepScale = m_stepScaleTableScale;
+          m_deviceResources->GetD3DDeviceContext()->UpdateSubresource(m_preIntegrationTexture.Get(), 0, nullptr, m_preIntegrationTable.GetTable().data(), m_preIntegrationTable.GetSize() * sizeof(DirectX::XMFLOAT4), 0);
+          UpdateStepSize();
         }
+        m_stepScaleTableBuilding = false;
       }
-      context->Unmap(m_volumeStagingTexture.Get(), 0);
 
-      context->CopyResource(m_volumeTexture.Get(), m_volumeStagingTexture.Get());
+      const float requestedStepScale = m_requestedStepScale;
+      if (requestedStepScale == m_stepScale || !m_tfResourcesReady || m_stepScaleTableBuilding)
+      {
+        return;
+      }
 
-      m_onGPUFrame = m_frame;
+      m_stepScaleTableBuilding = true;
+      create_task([this, requestedStepScale]()
+      {
+        std::lock_guard<std::mutex> guard(m_opacityTFMutex);
+        m_stepScaleTableGeneration = m_tfGeneration;
+        m_stepScaleTableScale = requestedStepScale;
+        if (BuildPreIntegrationTable(m_stepScaleTable, requestedStepScale))
+        {
+          m_stepScaleTableReady = true;
+        }
+        else
+        {
+          LOG(LogLevelType::LOG_LEVEL_ERROR, "Unable to pre-integrate transfer function table for new step scale.");
+          m_stepScaleTableBuilding = false;
+        }
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::UpdateStepSize()
+    {
+      if (m_volumeDimensions[2] < 1)
+      {
+        return;
+      }
+
+      // Compute the step size and number of iterations to use, shared with the CPU reference marcher
+      const uint32_t dimensions[3] = { m_volumeDimensions[0], m_volumeDimensions[1], m_volumeDimensions[2] };
+      float stepSize[3];
+      VolumeRayMarcher::ComputeStep(dimensions, m_stepScale, stepSize, m_constantBuffer.numIterations);
+      m_constantBuffer.stepSize = XMFLOAT3(stepSize);
     }
 
     //----------------------------------------------------------------------------
@@ -428,9 +959,9 @@ namespace HoloIntervention
         return;
       }
 
-      auto format = (DXGI_FORMAT)m_frame->GetPixelFormat(true);
+      auto format = m_frameFormat;
       auto bytesPerPixel = BitsPerPixel(format) / 8;
-      byte* imageRaw = GetDataFromIBuffer<byte>(m_frame->Image->ImageData);
+      byte* imageRaw = m_frameImage.get();
       if (imageRaw == nullptr)
       {
         LOG(LogLevelType::LOG_LEVEL_ERROR, "Unable to access image buffer.");
@@ -443,55 +974,292 @@ namespace HoloIntervention
         return;
       }
 
-      // Create a staging texture that will be used to copy data from the CPU to the GPU,
-      // the staging texture will then copy to the render texture
-      CD3D11_TEXTURE3D_DESC textureDesc(format, frameSize[0], frameSize[1], frameSize[2], 1, 0, D3D11_USAGE_STAGING, D3D11_CPU_ACCESS_WRITE | D3D11_CPU_ACCESS_READ);
-      D3D11_SUBRESOURCE_DATA imgData;
-      imgData.pSysMem = imageRaw;
-      imgData.SysMemPitch = frameSize[0] * bytesPerPixel;
-      imgData.SysMemSlicePitch = frameSize[0] * frameSize[1] * bytesPerPixel;
-      DX::ThrowIfFailed(device->CreateTexture3D(&textureDesc, &imgData, m_volumeStagingTexture.GetAddressOf()));
+      {
+        std::lock_guard<std::mutex> guard(m_frameRingMutex);
+        if (m_timeSeriesFrameCount > 0)
+        {
+          CreateTimeSeriesResources();
+          return;
+        }
+      }
+
+      // Coarser levels are sampled when voxels project smaller than a pixel, they need the same unsigned data as the macrocells
+      // Building them, the macrocells and the gradients takes hundreds of milliseconds for a large volume, so it runs off
+      // the render thread; the volume is not drawn until FinishVolumeResources has created its textures
+      const bool normalized = format == DXGI_FORMAT_R8_UNORM || format == DXGI_FORMAT_R16_UNORM;
+      const uint32 width = frameSize[0];
+      const uint32 height = frameSize[1];
+      const uint32 depth = frameSize[2];
+      m_gradientsWanted = AreGradientsWanted();
+      const bool gradientsWanted = m_gradientsWanted;
+      m_buildFrame = m_frame;
+      m_buildImage = m_frameImage;
+      m_buildFormat = format;
+      m_volumeBuilding = true;
+
+      std::shared_ptr<uint8_t> image = m_frameImage;
+      m_volumeBuildTask = create_task([this, image, width, height, depth, bytesPerPixel, normalized, gradientsWanted]()
+      {
+        const uint8_t* imageRaw = image.get();
+        m_pyramid.Reset(width, height, depth, normalized ? bytesPerPixel : 0);
+        m_macrocellGrid.Reset(width, height, depth, normalized ? bytesPerPixel : 0);
+        m_gradients.Reset(width, height, depth, gradientsWanted && normalized ? bytesPerPixel : 0);
+        {
+          std::lock_guard<std::mutex> guard(m_opacityTFMutex);
+          m_macrocellGrid.SetOpacityTable(m_pendingOpacityTable, m_constantBuffer.lt_maximumXValue);
+          m_opacityTableChanged = false;
+        }
+
+        // The three stages are independent, and each one spreads its own work over the pool
+        WorkerPool::instance().ParallelFor(3, [this, imageRaw](size_t stage)
+        {
+          if (stage == 0)
+          {
+            m_pyramid.BuildAll(imageRaw);
+          }
+          else if (stage == 1)
+          {
+            m_macrocellGrid.UpdateAll(imageRaw);
+            m_macrocellGrid.Classify();
+          }
+          else if (m_gradients.IsSupported())
+          {
+            m_gradients.BuildAll(imageRaw);
+          }
+        });
+        m_volumeBuilt = true;
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::FinishVolumeResources()
+    {
+      // Render thread, once the build task has finished with the pyramid, macrocells and gradients
+      const auto device = m_deviceResources->GetD3DDevice();
+      auto format = m_buildFormat;
+      auto bytesPerPixel = BitsPerPixel(format) / 8;
+      byte* imageRaw = m_buildImage.get();
+      auto frameSize = m_buildFrame->Dimensions;
+
+      std::vector<D3D11_SUBRESOURCE_DATA> imgData(m_pyramid.GetLevelCount());
+      for (uint32 level = 0; level < m_pyramid.GetLevelCount(); ++level)
+      {
+        uint32 size[3];
+        m_pyramid.GetLevelSize(level, size);
+        imgData[level].pSysMem = level == 0 ? imageRaw : m_pyramid.GetLevel(level).data();
+        imgData[level].SysMemPitch = size[0] * bytesPerPixel;
+        imgData[level].SysMemSlicePitch = size[0] * size[1] * bytesPerPixel;
+      }
 
       // Create the texture that will be used by the shader to access the current volume to be rendered
-      textureDesc = CD3D11_TEXTURE3D_DESC(format, frameSize[0], frameSize[1], frameSize[2], 1);
-      DX::ThrowIfFailed(device->CreateTexture3D(&textureDesc, &imgData, m_volumeTexture.GetAddressOf()));
+      // Later frames are uploaded into it brick by brick with UpdateSubresource, no staging copy is kept
+      CD3D11_TEXTURE3D_DESC textureDesc(format, frameSize[0], frameSize[1], frameSize[2], m_pyramid.GetLevelCount());
+      DX::ThrowIfFailed(device->CreateTexture3D(&textureDesc, imgData.data(), m_volumeTexture.GetAddressOf()));
 #if _DEBUG
       m_volumeTexture->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("VolumeTexture") - 1, "VolumeTexture");
 #endif
+      // Frames that arrived during the build are uploaded as changed bricks from here on
+      m_brickUploader.Reset(frameSize[0], frameSize[1], frameSize[2], bytesPerPixel, imageRaw);
+      m_brickHashedFrame = m_buildFrame;
+
       CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc(m_volumeTexture.Get(), format);
       DX::ThrowIfFailed(device->CreateShaderResourceView(m_volumeTexture.Get(), &srvDesc, m_volumeSRV.GetAddressOf()));
 #if _DEBUG
       m_volumeSRV->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("VolumeSRV") - 1, "VolumeSRV");
 #endif
 
-      // Compute the step size and number of iterations to use
-      //    The step size for each component needs to be a ratio of the largest component
-      float maxSize = std::fmaxf(frameSize[0], std::fmaxf(frameSize[1], frameSize[2]));
-      float3 stepSize = float3(1.0f / (frameSize[0] * (maxSize / frameSize[0])),
-                               1.0f / (frameSize[1] * (maxSize / frameSize[1])),
-                               1.0f / (frameSize[2] * (maxSize / frameSize[2])));
+      m_volumeDimensions[0] = frameSize[0];
+      m_volumeDimensions[1] = frameSize[1];
+      m_volumeDimensions[2] = frameSize[2];
+      UpdateStepSize();
+
+      // Empty space skipping needs raw values it can compare against the transfer function
+      m_constantBuffer.voxelValueRange = bytesPerPixel == 2 ? 65535.f : 255.f;
+      uint32_t gridSize[3];
+      m_macrocellGrid.GetGridSize(gridSize);
+      m_constantBuffer.skipEmptySpace = m_macrocellGrid.IsSupported() ? 1 : 0;
+      m_constantBuffer.levelOfDetail = 0.f;
+      m_constantBuffer.macrocellScale = XMFLOAT3(static_cast<float>(frameSize[0]) / m_macrocellGrid.GetCellSize(),
+                                                 static_cast<float>(frameSize[1]) / m_macrocellGrid.GetCellSize(),
+                                                 static_cast<float>(frameSize[2]) / m_macrocellGrid.GetCellSize());
+      m_constantBuffer.macrocellCount = XMUINT4(gridSize[0], gridSize[1], gridSize[2], 0);
+
+      D3D11_SUBRESOURCE_DATA occupancyData;
+      occupancyData.pSysMem = m_macrocellGrid.GetOccupancy().data();
+      occupancyData.SysMemPitch = gridSize[0];
+      occupancyData.SysMemSlicePitch = gridSize[0] * gridSize[1];
+      CD3D11_TEXTURE3D_DESC occupancyDesc(DXGI_FORMAT_R8_UINT, gridSize[0], gridSize[1], gridSize[2], 1);
+      DX::ThrowIfFailed(device->CreateTexture3D(&occupancyDesc, &occupancyData, m_occupancyTexture.GetAddressOf()));
+      CD3D11_SHADER_RESOURCE_VIEW_DESC occupancySRVDesc(m_occupancyTexture.Get(), DXGI_FORMAT_R8_UINT);
+      DX::ThrowIfFailed(device->CreateShaderResourceView(m_occupancyTexture.Get(), &occupancySRVDesc, m_occupancySRV.GetAddressOf()));
+#if _DEBUG
+      m_occupancyTexture->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("VolumeOccupancyTexture") - 1, "VolumeOccupancyTexture");
+#endif
 
-      XMStoreFloat3(&m_constantBuffer.stepSize, XMLoadFloat3(&(stepSize * m_stepScale)));
-      m_constantBuffer.numIterations = static_cast<uint32>(maxSize * (1.0f / m_stepScale));
+      // Shading and gradient opacity read a packed gradient volume, kept only while one of them is on
+      if (m_gradients.IsSupported())
+      {
+        D3D11_SUBRESOURCE_DATA gradientData;
+        gradientData.pSysMem = m_gradients.GetData().data();
+        gradientData.SysMemPitch = frameSize[0] * 4;
+        gradientData.SysMemSlicePitch = frameSize[0] * frameSize[1] * 4;
+        CD3D11_TEXTURE3D_DESC gradientDesc(DXGI_FORMAT_R8G8B8A8_UNORM, frameSize[0], frameSize[1], frameSize[2], 1);
+        DX::ThrowIfFailed(device->CreateTexture3D(&gradientDesc, &gradientData, m_gradientTexture.GetAddressOf()));
+        CD3D11_SHADER_RESOURCE_VIEW_DESC gradientSRVDesc(m_gradientTexture.Get(), DXGI_FORMAT_R8G8B8A8_UNORM);
+        DX::ThrowIfFailed(device->CreateShaderResourceView(m_gradientTexture.Get(), &gradientSRVDesc, m_gradientSRV.GetAddressOf()));
+#if _DEBUG
+        m_gradientTexture->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("VolumeGradientTexture") - 1, "VolumeGradientTexture");
+#endif
+      }
+      m_constantBuffer.gradientEnabled = m_gradients.IsSupported() ? 1 : 0;
+
+      m_buildFrame = nullptr;
+      m_buildImage = nullptr;
+      m_volumeBuilding = false;
+
+      CreateVolumeSampler();
+      m_volumeReady = true;
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::CreateTimeSeriesResources()
+    {
+      // Called with m_frameRingMutex held
+      auto frameSize = m_frame->Dimensions;
+      auto bytesPerPixel = BitsPerPixel(m_frameFormat) / 8;
+      D3DVolumeFrameTarget target(m_deviceResources->GetD3DDevice(), m_deviceResources->GetD3DDeviceContext(), m_frameFormat, m_frameTextures, m_frameSRVs);
+      if (m_frameRing.Reset(target, frameSize[0], frameSize[1], frameSize[2], bytesPerPixel, m_timeSeriesFrameCount, m_timeSeriesBudget) == 0)
+      {
+        LOG(LogLevelType::LOG_LEVEL_ERROR, "Unable to allocate volume frame ring.");
+        return;
+      }
+      m_frameRing.AddFrame(m_frame->Timestamp, m_frameImage);
+      m_displayedSlot = -1;
+
+      // Frames are sampled at full resolution without empty space skipping, no mips or macrocells are kept per frame
+      m_pyramid.Reset(frameSize[0], frameSize[1], frameSize[2], 0);
+      m_macrocellGrid.Reset(frameSize[0], frameSize[1], frameSize[2], 0);
+      m_constantBuffer.voxelValueRange = bytesPerPixel == 2 ? 65535.f : 255.f;
+      m_constantBuffer.skipEmptySpace = 0;
+      m_constantBuffer.levelOfDetail = 0.f;
+      m_gradientsWanted = AreGradientsWanted();
+      m_gradients.Reset(frameSize[0], frameSize[1], frameSize[2], 0);
+      m_constantBuffer.gradientEnabled = 0;
+
+      m_volumeDimensions[0] = frameSize[0];
+      m_volumeDimensions[1] = frameSize[1];
+      m_volumeDimensions[2] = frameSize[2];
+      UpdateStepSize();
+
+      CreateVolumeSampler();
+      m_timeSeriesActive = true;
+      m_volumeReady = true;
+    }
 
+    //----------------------------------------------------------------------------
+    void Volume::CreateVolumeSampler()
+    {
       float borderColour[4] = { 0.f, 0.f, 0.f, 0.f };
       CD3D11_SAMPLER_DESC desc(D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_TEXTURE_ADDRESS_BORDER, D3D11_TEXTURE_ADDRESS_BORDER, D3D11_TEXTURE_ADDRESS_BORDER, 0.f, 3, D3D11_COMPARISON_NEVER, borderColour, 0, 3);
-      DX::ThrowIfFailed(device->CreateSamplerState(&desc, m_samplerState.GetAddressOf()));
+      DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateSamplerState(&desc, m_samplerState.GetAddressOf()));
 #if _DEBUG
       m_samplerState->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("VolRendSamplerState") - 1, "VolRendSamplerState");
 #endif
-
-      m_volumeReady = true;
     }
 
     //----------------------------------------------------------------------------
     void Volume::ReleaseVolumeResources()
     {
+      // Update never releases a volume that is still being built, the device going away waits for the build to end
+      // task::wait throws on the UI thread, so completion is polled instead
+      while (!m_volumeBuildTask.is_done())
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      m_volumeBuilding = false;
+      m_volumeBuilt = false;
+      m_buildFrame = nullptr;
+      m_buildImage = nullptr;
       m_volumeReady = false;
-      m_volumeStagingTexture.Reset();
+      {
+        std::lock_guard<std::mutex> guard(m_frameRingMutex);
+        D3DVolumeFrameTarget target(m_deviceResources->GetD3DDevice(), m_deviceResources->GetD3DDeviceContext(), m_frameFormat, m_frameTextures, m_frameSRVs);
+        m_frameRing.Clear(target);
+      }
+      m_timeSeriesActive = false;
+      m_displayedSlot = -1;
+      m_brickHashedFrame = nullptr;
       m_volumeTexture.Reset();
       m_volumeSRV.Reset();
       m_samplerState.Reset();
+      m_occupancySRV.Reset();
+      m_occupancyTexture.Reset();
+      m_gradientSRV.Reset();
+      m_gradientTexture.Reset();
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::SetShading(float ambient)
+    {
+      m_shadingAmbient = std::min(std::max(ambient, 0.f), 1.f);
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::SetGradientOpacity(float weight, float gain)
+    {
+      m_gradientOpacityWeight = std::min(std::max(weight, 0.f), 1.f);
+      if (gain > 0.f)
+      {
+        m_gradientOpacityGain = gain;
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    bool Volume::AreGradientsWanted() const
+    {
+      return m_shadingAmbient < 1.f || m_gradientOpacityWeight > 0.f;
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::SetStepScale(float stepScale)
+    {
+      if (stepScale > 0.f)
+      {
+        m_requestedStepScale = stepScale;
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    float Volume::GetStepScale() const
+    {
+      return m_stepScale;
+    }
+
+    //----------------------------------------------------------------------------
+    void Volume::UpdateLevelOfDetail(const float3& cameraPosition, float focalLengthPixels, float bias)
+    {
+      if (!m_volumeReady)
+      {
+        return;
+      }
+
+      // The smallest voxel edge decides, so no axis is blurred past a pixel
+      float3 scale;
+      quaternion rotation;
+      float3 translation;
+      decompose(m_currentPose, &scale, &rotation, &translation);
+      const float voxelWorldSize = std::min(std::min(std::abs(scale.x) / m_volumeDimensions[0], std::abs(scale.y) / m_volumeDimensions[1]), std::abs(scale.z) / m_volumeDimensions[2]);
+      const float distance = length(transform(float3(0.5f, 0.5f, 0.5f), m_currentPose) - cameraPosition);
+      m_constantBuffer.levelOfDetail = VolumePyramid::SelectLevel(voxelWorldSize, distance, focalLengthPixels, bias, m_pyramid.GetLevelCount());
+
+      // Macrocells bound the values of the full resolution data only, a coarser sample reaches past their apron
+      m_constantBuffer.skipEmptySpace = m_macrocellGrid.IsSupported() && m_constantBuffer.levelOfDetail == 0.f ? 1 : 0;
+    }
+
+    //----------------------------------------------------------------------------
+    float Volume::GetLevelOfDetail() const
+    {
+      return m_constantBuffer.levelOfDetail;
     }
 
     //----------------------------------------------------------------------------
@@ -517,7 +1285,7 @@ namespace HoloIntervention
 
         for (auto& point : controlPoints)
         {
-          m_opacityTransferFunction->AddControlPoint(point.first, point.second.w);
+          m_opacityTransferFunction->AddControlPoint(point.first, point.second.x, point.second.y, point.second.z, point.second.w);
         }
         m_opacityTransferFunction->SetLookupTableSize(tableSize);
         m_opacityTransferFunction->Update();
@@ -544,43 +1312,74 @@ namespace HoloIntervention
 
       m_opacityTransferFunction->Update();
       m_constantBuffer.lt_maximumXValue = m_opacityTransferFunction->GetMaximumXValue();
-      m_constantBuffer.lt_arraySize = m_opacityTransferFunction->GetTFLookupTable().GetArraySize();
+
+      if (!BuildPreIntegrationTable(m_preIntegrationTable, m_stepScale))
+      {
+        throw std::exception("Unable to pre-integrate transfer function table.");
+      }
+      ++m_tfGeneration;
+      m_constantBuffer.lt_arraySize = m_preIntegrationTable.GetSize();
+
+      // The macrocell grid classifies against the same resampled opacities the table was built from
+      m_pendingOpacityTable = m_preIntegrationTable.GetOpacities();
+      m_opacityTableChanged = true;
 
       // Set up GPU memory
-      D3D11_BUFFER_DESC desc;
-      ZeroMemory(&desc, sizeof(desc));
-      desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
-      desc.ByteWidth = sizeof(DirectX::XMFLOAT4) * m_opacityTransferFunction->GetTFLookupTable().GetArraySize();
-      desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
-      desc.StructureByteStride = sizeof(DirectX::XMFLOAT4);
-
-      D3D11_SUBRESOURCE_DATA bufferBytes = { m_opacityTransferFunction->GetTFLookupTable().GetLookupTableArray(), 0, 0 };
-      DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&desc, &bufferBytes, m_opacityLookupTableBuffer.GetAddressOf()));
+      const auto device = m_deviceResources->GetD3DDevice();
+      D3D11_SUBRESOURCE_DATA tableData;
+      tableData.pSysMem = m_preIntegrationTable.GetTable().data();
+      tableData.SysMemPitch = m_preIntegrationTable.GetSize() * sizeof(DirectX::XMFLOAT4);
+      tableData.SysMemSlicePitch = 0;
+      CD3D11_TEXTURE2D_DESC tableDesc(DXGI_FORMAT_R32G32B32A32_FLOAT, m_preIntegrationTable.GetSize(), m_preIntegrationTable.GetSize(), 1, 1);
+      DX::ThrowIfFailed(device->CreateTexture2D(&tableDesc, &tableData, m_preIntegrationTexture.GetAddressOf()));
 #if _DEBUG
-      m_opacityLookupTableBuffer->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("OpacityLookupTable") - 1, "OpacityLookupTable");
+      m_preIntegrationTexture->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("PreIntegrationTable") - 1, "PreIntegrationTable");
 #endif
 
-      D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
-      ZeroMemory(&srvDesc, sizeof(srvDesc));
-      srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFEREX;
-      srvDesc.BufferEx.FirstElement = 0;
-      srvDesc.Format = DXGI_FORMAT_UNKNOWN;
-      srvDesc.BufferEx.NumElements = m_opacityTransferFunction->GetTFLookupTable().GetArraySize();
+      CD3D11_SHADER_RESOURCE_VIEW_DESC srvDesc(m_preIntegrationTexture.Get(), D3D11_SRV_DIMENSION_TEXTURE2D, DXGI_FORMAT_R32G32B32A32_FLOAT);
+      DX::ThrowIfFailed(device->CreateShaderResourceView(m_preIntegrationTexture.Get(), &srvDesc, m_preIntegrationSRV.GetAddressOf()));
+#if _DEBUG
+      m_preIntegrationSRV->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("PreIntegrationTableSRV") - 1, "PreIntegrationTableSRV");
+#endif
 
-      DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateShaderResourceView(m_opacityLookupTableBuffer.Get(), &srvDesc, m_opacityLookupTableSRV.GetAddressOf()));
+      CD3D11_SAMPLER_DESC samplerDesc(D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_TEXTURE_ADDRESS_CLAMP, D3D11_TEXTURE_ADDRESS_CLAMP, D3D11_TEXTURE_ADDRESS_CLAMP, 0.f, 1, D3D11_COMPARISON_NEVER, nullptr, 0, 0);
+      DX::ThrowIfFailed(device->CreateSamplerState(&samplerDesc, m_tableSamplerState.GetAddressOf()));
 #if _DEBUG
-      m_opacityLookupTableSRV->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("OpacityLookupTableSRV") - 1, "OpacityLookupTableSRV");
+      m_tableSamplerState->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("PreIntegrationSamplerState") - 1, "PreIntegrationSamplerState");
 #endif
 
       m_tfResourcesReady = true;
     }
 
+    //----------------------------------------------------------------------------
+    bool Volume::BuildPreIntegrationTable(PreIntegrationTable& table, float stepScale)
+    {
+      if (m_opacityTransferFunction == nullptr)
+      {
+        return false;
+      }
+
+      // Pre-integrate the table for the given step length, one unscaled step is the reference the opacities are given for
+      auto& lookupTable = m_opacityTransferFunction->GetTFLookupTable();
+      std::vector<float> entries(lookupTable.GetArraySize() * 4);
+      for (uint32 i = 0; i < lookupTable.GetArraySize(); ++i)
+      {
+        const DirectX::XMFLOAT4& entry = lookupTable.GetLookupTableArray()[i];
+        entries[i * 4 + 0] = entry.x;
+        entries[i * 4 + 1] = entry.y;
+        entries[i * 4 + 2] = entry.z;
+        entries[i * 4 + 3] = entry.w;
+      }
+      return table.Build(entries, std::min(lookupTable.GetArraySize(), PREINTEGRATION_TABLE_SIZE), stepScale);
+    }
+
     //----------------------------------------------------------------------------
     void Volume::ReleaseTFResources()
     {
       m_tfResourcesReady = false;
-      m_opacityLookupTableSRV.Reset();
-      m_opacityLookupTableBuffer.Reset();
+      m_preIntegrationSRV.Reset();
+      m_preIntegrationTexture.Reset();
+      m_tableSamplerState.Reset();
     }
   }
 }
\ No newline at end of file
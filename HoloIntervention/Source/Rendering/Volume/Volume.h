@@ -23,7 +23,17 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 #pragma once
 
+#include "GradientVolume.h"
+#include "MacrocellGrid.h"
 #include "PiecewiseLinearTransferFunction.h"
+#include "PreIntegrationTable.h"
+#include "VolumeBricks.h"
+#include "VolumeFrameRing.h"
+#include "VolumePyramid.h"
+
+// Common includes
+#include "VoxelConverter.h"
+#include "VoxelHistogram.h"
 
 // WinRt includes
 #include <ppltasks.h>
@@ -38,21 +48,37 @@ namespace HoloIntervention
 {
   namespace Rendering
   {
-    struct LookupTableBufferType
+    struct VolumeEntryConstantBuffer
     {
-      DirectX::XMFLOAT4                       lookupValue;
+      DirectX::XMFLOAT4X4                     worldMatrix;
+      DirectX::XMFLOAT3                       stepSize;
+      float                                   lt_maximumXValue;
+      uint32                                  lt_arraySize;     // Entries per side of the pre-integration table
+      uint32                                  numIterations;
+      float                                   voxelValueRange;  // Normalized samples times this are transfer function input values
+      uint32                                  skipEmptySpace;
+      DirectX::XMFLOAT3                       macrocellScale;   // Macrocells per unit of texture coordinate
+      float                                   levelOfDetail;    // Mip level sampled, fractional levels blend
+      DirectX::XMUINT4                        macrocellCount;
+      uint32                                  gradientEnabled;        // The gradient texture is bound
+      float                                   gradientOpacityWeight;  // 0 leaves opacity alone, 1 scales it fully by gradient magnitude
+      float                                   gradientOpacityGain;    // Opacity is full from 1 / gain of the largest magnitude up
+      float                                   shadingAmbient;         // Light kept by surfaces facing away from the viewer, 1 is unlit
     };
+    static_assert((sizeof(VolumeEntryConstantBuffer) % (sizeof(float) * 4)) == 0, "Volume constant buffer size must be 16-byte aligned (16 bytes is the length of four floats).");
 
-    struct VolumeEntryConstantBuffer
+    // One volume's parameters in the single pass multi-volume shader, laid out as VolumeParameters in MultiVolumePS.hlsl
+    struct MultiVolumeEntry
     {
-      DirectX::XMFLOAT4X4                     worldMatrix;
+      DirectX::XMFLOAT4X4                     textureFromWorld;
       DirectX::XMFLOAT3                       stepSize;
+      float                                   levelOfDetail;
       float                                   lt_maximumXValue;
       uint32                                  lt_arraySize;
+      float                                   voxelValueRange;
       uint32                                  numIterations;
-      DirectX::XMFLOAT2                       buffer;
     };
-    static_assert((sizeof(VolumeEntryConstantBuffer) % (sizeof(float) * 4)) == 0, "Volume constant buffer size must be 16-byte aligned (16 bytes is the length of four floats).");
+    static_assert((sizeof(MultiVolumeEntry) % (sizeof(float) * 4)) == 0, "Multi-volume entry size must be 16-byte aligned (16 bytes is the length of four floats).");
 
     struct VertexPosition
     {
@@ -96,10 +122,30 @@ namespace HoloIntervention
       bool IsValid() const;
 
       void Update();
-      void Render(uint32 indexCount);
+      /// Returns false if the volume was not ready to draw
+      bool Render(uint32 indexCount);
+      /// What the single pass multi-volume shader needs to draw this volume, false if it is not ready to draw
+      /// Empty space skipping and gradients are not used there
+      bool GetMultiVolumeEntry(MultiVolumeEntry& outEntry, ID3D11ShaderResourceView*& outVolumeSRV, ID3D11ShaderResourceView*& outTableSRV) const;
 
 
+      /// Signed and float frames, and any frame while a voxel or auto window is set, are converted on worker threads before upload
       void SetFrame(UWPOpenIGTLink::VideoFrame^ frame);
+      void SetVoxelWindow(const VoxelWindow& window);
+      void ClearVoxelWindow();
+      /// Window each frame between percentiles of its own histogram, slope and intercept still come from SetVoxelWindow
+      void SetAutoWindow(bool enabled, float lowerFraction = 0.01f, float upperFraction = 0.99f);
+      /// Histogram of the latest automatically windowed frame, nullptr before the first
+      std::shared_ptr<const VoxelHistogram> GetHistogram() const;
+      /// Percentiles of the latest automatically windowed frame in transfer function input units
+      bool GetTransferFunctionRange(float lowerFraction, float upperFraction, float& outMinimum, float& outMaximum) const;
+
+      /// Keep up to frameCount frames on the GPU (within memoryBudgetBytes, 0 is unlimited) and play them back by timestamp
+      /// A frameCount of 0 returns to a single texture that always shows the latest frame
+      void SetTimeSeries(uint32 frameCount, uint64 memoryBudgetBytes);
+      void SetTimeSeriesPlayback(VolumeFrameRing::PlaybackMode mode);
+      VolumeFrameRing::Stats GetTimeSeriesStats() const;
+      uint64 GetTimeSeriesMemoryUsage() const;   // Resident slots plus frames waiting to upload
       void SetShowing(bool showing);
       uint64 GetToken() const;
 
@@ -108,6 +154,19 @@ namespace HoloIntervention
       Windows::Foundation::Numerics::float4x4 GetCurrentPose() const;
       Windows::Foundation::Numerics::float3 GetVelocity() const;
 
+      /// Ray step relative to one voxel, the pre-integration table is rebuilt in the background and both change together
+      void SetStepScale(float stepScale);
+      float GetStepScale() const;
+
+      /// Pick the mip level whose voxels project to about a pixel from the given camera, plus bias levels
+      void UpdateLevelOfDetail(const Windows::Foundation::Numerics::float3& cameraPosition, float focalLengthPixels, float bias);
+      float GetLevelOfDetail() const;
+
+      /// Headlight shading from precomputed gradients, ambient of 1 turns it off
+      void SetShading(float ambient);
+      /// Scale opacity by gradient magnitude so boundaries show through homogeneous regions, weight of 0 turns it off
+      void SetGradientOpacity(float weight, float gain);
+
       Concurrency::task<void> SetOpacityTransferFunctionTypeAsync(Volume::TransferFunctionType type, uint32 tableSize, const Volume::ControlPointList& controlPoints);
 
       // D3D device related controls
@@ -120,12 +179,25 @@ namespace HoloIntervention
       Windows::Foundation::Numerics::float3             m_velocity = { 0.f, 0.f, 0.f };
 
     protected:
+      void PublishFrame(UWPOpenIGTLink::VideoFrame^ frame, std::shared_ptr<uint8_t> image, DXGI_FORMAT format, uint64 sequence);
+      void AcceptPublishedFrame();
       void UpdateGPUImageData();
+      void UpdateTimeSeries();
+      void UploadPyramidRegions(const std::vector<BrickBox>& regions);
+      void UploadGradientRegion(const BrickBox& region);
+      bool AreGradientsWanted() const;
+      void UpdateMacrocells();
+      void UpdateStepScale();
+      void UpdateStepSize();
 
       void CreateVolumeResources();
+      void FinishVolumeResources();
+      void CreateTimeSeriesResources();
+      void CreateVolumeSampler();
       void ReleaseVolumeResources();
       void CreateTFResources();
       void ReleaseTFResources();
+      bool BuildPreIntegrationTable(PreIntegrationTable& table, float stepScale);
 
     protected:
       // Cached pointer to device resources.
@@ -144,10 +216,13 @@ namespace HoloIntervention
 
       // Direct3D resources for volume rendering
       Microsoft::WRL::ComPtr<ID3D11Buffer>              m_volumeEntryConstantBuffer;
-      Microsoft::WRL::ComPtr<ID3D11Texture3D>           m_volumeStagingTexture;
       Microsoft::WRL::ComPtr<ID3D11Texture3D>           m_volumeTexture;
       Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>  m_volumeSRV;
       Microsoft::WRL::ComPtr<ID3D11SamplerState>        m_samplerState;
+      Microsoft::WRL::ComPtr<ID3D11Texture3D>           m_occupancyTexture;
+      Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>  m_occupancySRV;
+      Microsoft::WRL::ComPtr<ID3D11Texture3D>           m_gradientTexture;
+      Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>  m_gradientSRV;
 
       // Cached D3D resources for left and right eye position calculation
       ID3D11Texture2D*                                  m_frontPositionTextureArray;
@@ -158,22 +233,80 @@ namespace HoloIntervention
       ID3D11ShaderResourceView*                         m_backPositionSRV;
 
       // Transfer function GPU resources
-      Microsoft::WRL::ComPtr<ID3D11Buffer>              m_opacityLookupTableBuffer;
-      Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>  m_opacityLookupTableSRV;
+      Microsoft::WRL::ComPtr<ID3D11Texture2D>           m_preIntegrationTexture;
+      Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>  m_preIntegrationSRV;
+      Microsoft::WRL::ComPtr<ID3D11SamplerState>        m_tableSamplerState;
       std::atomic_bool                                  m_tfResourcesReady = false;
 
       // Transfer function CPU resources
       mutable std::mutex                                m_opacityTFMutex;
       TransferFunctionType                              m_opacityTFType = TransferFunction_Unknown;
       BaseTransferFunction*                             m_opacityTransferFunction = nullptr;
+      PreIntegrationTable                               m_preIntegrationTable;
+      std::vector<float>                                m_pendingOpacityTable;  // Handed to the macrocell grid on the render thread
+      std::atomic_bool                                  m_opacityTableChanged = false;
+      uint32                                            m_tfGeneration = 0;  // Counts table rebuilds, a step scale table built from an older one is dropped
 
       // CPU resources for volume rendering
       VolumeEntryConstantBuffer                         m_constantBuffer;
       UWPOpenIGTLink::VideoFrame^                       m_frame;
+      std::shared_ptr<uint8_t>                          m_frameImage;   // The voxels uploaded for m_frame, its own buffer or a converted copy
+      DXGI_FORMAT                                       m_frameFormat = DXGI_FORMAT_UNKNOWN;
       UWPOpenIGTLink::VideoFrame^                       m_onGPUFrame;
+      UWPOpenIGTLink::VideoFrame^                       m_brickHashedFrame;
+      VolumeBrickUploader                               m_brickUploader;
+      MacrocellGrid                                     m_macrocellGrid;
+      VolumePyramid                                     m_pyramid;
+      std::vector<BrickBox>                             m_pyramidRegions;
+      std::vector<BrickBox>                             m_uploadedBricks;
+      GradientVolume                                    m_gradients;
+      bool                                              m_gradientsWanted = false;  // Whether the current resources were built with gradients
+      Concurrency::task<void>                           m_volumeBuildTask = Concurrency::task_from_result();
+      std::atomic_bool                                  m_volumeBuilding = false; // The build task owns the pyramid, macrocells and gradients until FinishVolumeResources
+      std::atomic_bool                                  m_volumeBuilt = false;
+      UWPOpenIGTLink::VideoFrame^                       m_buildFrame;             // The frame being built, and its voxels
+      std::shared_ptr<uint8_t>                          m_buildImage;
+      DXGI_FORMAT                                       m_buildFormat = DXGI_FORMAT_UNKNOWN;
+      std::atomic<float>                                m_shadingAmbient = 1.f;
+      std::atomic<float>                                m_gradientOpacityWeight = 0.f;
+      std::atomic<float>                                m_gradientOpacityGain = 10.f;
       mutable std::mutex                                m_imageAccessMutex;
+      UWPOpenIGTLink::VideoFrame^                       m_publishedFrame;   // Waiting for the render thread, guarded by m_imageAccessMutex
+      std::shared_ptr<uint8_t>                          m_publishedImage;
+      DXGI_FORMAT                                       m_publishedFormat = DXGI_FORMAT_UNKNOWN;
+      uint64                                            m_frameSequence = 0;      // Conversions finish out of order, an older frame never replaces a newer one
+      uint64                                            m_publishedSequence = 0;
+      VoxelWindow                                       m_voxelWindow;
+      bool                                              m_hasVoxelWindow = false;
+      bool                                              m_autoWindow = false;
+      float                                             m_autoWindowLowerFraction = 0.01f;
+      float                                             m_autoWindowUpperFraction = 0.99f;
+      std::shared_ptr<const VoxelHistogram>             m_histogram;          // Of the latest automatically windowed frame
+      VoxelWindow                                       m_histogramWindow;    // The window that frame was converted with
+      VoxelType                                         m_histogramUploadType = VoxelType_Unknown;
+      uint64                                            m_histogramSequence = 0;
+      uint32                                            m_volumeDimensions[3] = { 0, 0, 0 };
       float                                             m_stepScale = 1.f;  // Increasing this reduces the number of steps taken per pixel
 
+      // Step scale changes, the table for the requested scale is built off the render thread
+      std::atomic<float>                                m_requestedStepScale = 1.f;
+      std::atomic_bool                                  m_stepScaleTableBuilding = false;
+      std::atomic_bool                                  m_stepScaleTableReady = false;
+      PreIntegrationTable                               m_stepScaleTable;
+      float                                             m_stepScaleTableScale = 1.f;
+      uint32                                            m_stepScaleTableGeneration = 0;
+
+      // 4D playback, a ring of whole frames replaces the single texture while a frame count is set
+      mutable std::mutex                                m_frameRingMutex;
+      VolumeFrameRing                                   m_frameRing;
+      uint32                                            m_timeSeriesFrameCount = 0;
+      uint64                                            m_timeSeriesBudget = 0;
+      bool                                              m_timeSeriesActive = false;   // Render thread, the ring's resources exist
+      std::vector<Microsoft::WRL::ComPtr<ID3D11Texture3D>>          m_frameTextures;
+      std::vector<Microsoft::WRL::ComPtr<ID3D11ShaderResourceView>> m_frameSRVs;
+      int32                                             m_displayedSlot = -1;
+      double                                            m_timeSeriesClockOffset;      // Frame clock minus the render timer
+
       // State
       mutable std::atomic_bool                          m_isInFrustum = false;
       mutable uint64                                    m_frustumCheckFrameNumber = 0;
@@ -185,6 +318,11 @@ namespace HoloIntervention
 
       // Constants relating to volume entry behavior
       static const float                                LERP_RATE;
+      static const uint64                               UPLOAD_BUDGET_BYTES_PER_FRAME;
+      static const uint32                               PREINTEGRATION_TABLE_SIZE;
+      static const double                               TIME_SERIES_PLAYOUT_DELAY_SEC;
+      static const uint32                               HISTOGRAM_BYTE_BIN_COUNT;
+      static const uint32                               HISTOGRAM_WIDE_BIN_COUNT;
 
     };
   }
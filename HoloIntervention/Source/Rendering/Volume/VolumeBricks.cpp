@@ -0,0 +1,305 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "VolumeBricks.h"
+
+// STL includes
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  inline uint64_t MixWord(uint64_t hash, uint64_t word)
+  {
+    hash ^= word * 0x87c37b91114253d5ull;
+    hash = (hash << 31) | (hash >> 33);
+    return hash * 0x4cf5ad432745937full;
+  }
+}
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    const uint32_t VolumeBrickUploader::DEFAULT_BRICK_SIZE = 32;
+
+    //----------------------------------------------------------------------------
+    NullBrickUploadTarget::NullBrickUploadTarget(std::vector<uint8_t>* mirror, uint32_t bytesPerVoxel)
+      : m_mirror(mirror)
+      , m_bytesPerVoxel(bytesPerVoxel)
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    void NullBrickUploadTarget::UploadBox(const BrickBox& box, const uint8_t* source, uint32_t rowPitch, uint32_t depthPitch)
+    {
+      const size_t rowBytes = (box.Right - box.Left) * m_bytesPerVoxel;
+      m_boxCount++;
+      m_bytes += rowBytes * (box.Bottom - box.Top) * (box.Back - box.Front);
+
+      if (m_mirror == nullptr)
+      {
+        return;
+      }
+      for (uint32_t z = 0; z < box.Back - box.Front; ++z)
+      {
+        for (uint32_t y = 0; y < box.Bottom - box.Top; ++y)
+        {
+          const size_t offset = (box.Front + z) * (size_t)depthPitch + (box.Top + y) * (size_t)rowPitch + box.Left * m_bytesPerVoxel;
+          memcpy(m_mirror->data() + offset, source + z * (size_t)depthPitch + y * (size_t)rowPitch, rowBytes);
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t NullBrickUploadTarget::GetUploadedBoxCount() const
+    {
+      return m_boxCount;
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t NullBrickUploadTarget::GetUploadedBytes() const
+    {
+      return m_bytes;
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeBrickUploader::VolumeBrickUploader(uint32_t brickSize)
+      : m_brickSize(std::max<uint32_t>(brickSize, 1))
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeBrickUploader::Reset(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel, const uint8_t* uploadedImage)
+    {
+      m_dimensions[0] = width;
+      m_dimensions[1] = height;
+      m_dimensions[2] = depth;
+      m_bytesPerVoxel = bytesPerVoxel;
+      for (int i = 0; i < 3; ++i)
+      {
+        m_brickCounts[i] = (m_dimensions[i] + m_brickSize - 1) / m_brickSize;
+      }
+
+      const uint32_t brickCount = m_brickCounts[0] * m_brickCounts[1] * m_brickCounts[2];
+      m_hashes.assign(brickCount, 0);
+      m_dirty.assign(brickCount, 0);
+      m_dirtyQueue.clear();
+      m_dirtyQueueHead = 0;
+      m_stats = Stats();
+      m_stats.BrickCount = brickCount;
+
+      if (uploadedImage == nullptr)
+      {
+        MarkAllDirty();
+        return;
+      }
+      for (uint32_t i = 0; i < brickCount; ++i)
+      {
+        m_hashes[i] = HashBrick(uploadedImage, GetBrickBox(i));
+      }
+      m_stats.HashedBytes += (uint64_t)width * height * depth * bytesPerVoxel;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeBrickUploader::MarkChanged(const uint8_t* image)
+    {
+      uint32_t changed(0);
+      for (uint32_t i = 0; i < m_stats.BrickCount; ++i)
+      {
+        const uint64_t hash = HashBrick(image, GetBrickBox(i));
+        if (hash != m_hashes[i])
+        {
+          m_hashes[i] = hash;
+          if (!m_dirty[i])
+          {
+            changed++;
+          }
+          SetDirty(i);
+        }
+      }
+      m_stats.HashedBytes += (uint64_t)m_dimensions[0] * m_dimensions[1] * m_dimensions[2] * m_bytesPerVoxel;
+      return changed;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeBrickUploader::MarkDirty(const BrickBox& region)
+    {
+      if (region.Right <= region.Left || region.Bottom <= region.Top || region.Back <= region.Front)
+      {
+        return;
+      }
+      const uint32_t first[3] = { region.Left / m_brickSize, region.Top / m_brickSize, region.Front / m_brickSize };
+      const uint32_t last[3] =
+      {
+        std::min((region.Right - 1) / m_brickSize, m_brickCounts[0] - 1),
+        std::min((region.Bottom - 1) / m_brickSize, m_brickCounts[1] - 1),
+        std::min((region.Back - 1) / m_brickSize, m_brickCounts[2] - 1)
+      };
+      for (uint32_t z = first[2]; z <= last[2]; ++z)
+      {
+        for (uint32_t y = first[1]; y <= last[1]; ++y)
+        {
+          for (uint32_t x = first[0]; x <= last[0]; ++x)
+          {
+            SetDirty((z * m_brickCounts[1] + y) * m_brickCounts[0] + x);
+          }
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeBrickUploader::MarkAllDirty()
+    {
+      for (uint32_t i = 0; i < m_stats.BrickCount; ++i)
+      {
+        SetDirty(i);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeBrickUploader::Upload(IBrickUploadTarget& target, const uint8_t* image, uint64_t budgetBytes, std::vector<BrickBox>* outUploadedBricks)
+    {
+      const uint32_t rowPitch = m_dimensions[0] * m_bytesPerVoxel;
+      const uint32_t depthPitch = rowPitch * m_dimensions[1];
+      uint64_t uploadedBytes(0);
+      uint32_t uploaded(0);
+
+      while (m_dirtyQueueHead < m_dirtyQueue.size())
+      {
+        const uint32_t index = m_dirtyQueue[m_dirtyQueueHead];
+        const BrickBox box = GetBrickBox(index);
+        const uint64_t bytes = (uint64_t)(box.Right - box.Left) * (box.Bottom - box.Top) * (box.Back - box.Front) * m_bytesPerVoxel;
+
+        // Always make progress, even if a single brick is over budget
+        if (budgetBytes != 0 && uploaded > 0 && uploadedBytes + bytes > budgetBytes)
+        {
+          break;
+        }
+
+        target.UploadBox(box, image + box.Front * (size_t)depthPitch + box.Top * (size_t)rowPitch + box.Left * m_bytesPerVoxel, rowPitch, depthPitch);
+        if (outUploadedBricks != nullptr)
+        {
+          outUploadedBricks->push_back(box);
+        }
+        m_dirty[index] = 0;
+        m_dirtyQueueHead++;
+        uploaded++;
+        uploadedBytes += bytes;
+      }
+
+      if (m_dirtyQueueHead == m_dirtyQueue.size())
+      {
+        m_dirtyQueue.clear();
+        m_dirtyQueueHead = 0;
+      }
+
+      m_stats.DirtyBrickCount = static_cast<uint32_t>(m_dirtyQueue.size() - m_dirtyQueueHead);
+      m_stats.UploadedBricks += uploaded;
+      m_stats.UploadedBytes += uploadedBytes;
+      return uploaded;
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeBrickUploader::HasDirtyBricks() const
+    {
+      return m_dirtyQueueHead < m_dirtyQueue.size();
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeBrickUploader::GetBrickSize() const
+    {
+      return m_brickSize;
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeBrickUploader::Stats VolumeBrickUploader::GetStats() const
+    {
+      Stats stats = m_stats;
+      stats.DirtyBrickCount = static_cast<uint32_t>(m_dirtyQueue.size() - m_dirtyQueueHead);
+      return stats;
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t VolumeBrickUploader::HashBrick(const uint8_t* image, const BrickBox& box) const
+    {
+      const size_t rowPitch = (size_t)m_dimensions[0] * m_bytesPerVoxel;
+      const size_t depthPitch = rowPitch * m_dimensions[1];
+      const size_t rowBytes = (box.Right - box.Left) * m_bytesPerVoxel;
+
+      uint64_t hash = 0x9e3779b97f4a7c15ull;
+      for (uint32_t z = box.Front; z < box.Back; ++z)
+      {
+        for (uint32_t y = box.Top; y < box.Bottom; ++y)
+        {
+          const uint8_t* row = image + z * depthPitch + y * rowPitch + box.Left * m_bytesPerVoxel;
+          size_t i = 0;
+          for (; i + 8 <= rowBytes; i += 8)
+          {
+            uint64_t word;
+            memcpy(&word, row + i, sizeof(word));
+            hash = MixWord(hash, word);
+          }
+          if (i < rowBytes)
+          {
+            uint64_t word(0);
+            memcpy(&word, row + i, rowBytes - i);
+            hash = MixWord(hash, word);
+          }
+        }
+      }
+      return hash ^ (hash >> 29);
+    }
+
+    //----------------------------------------------------------------------------
+    BrickBox VolumeBrickUploader::GetBrickBox(uint32_t brickIndex) const
+    {
+      const uint32_t x = brickIndex % m_brickCounts[0];
+      const uint32_t y = (brickIndex / m_brickCounts[0]) % m_brickCounts[1];
+      const uint32_t z = brickIndex / (m_brickCounts[0] * m_brickCounts[1]);
+
+      BrickBox box;
+      box.Left = x * m_brickSize;
+      box.Top = y * m_brickSize;
+      box.Front = z * m_brickSize;
+      box.Right = std::min(box.Left + m_brickSize, m_dimensions[0]);
+      box.Bottom = std::min(box.Top + m_brickSize, m_dimensions[1]);
+      box.Back = std::min(box.Front + m_brickSize, m_dimensions[2]);
+      return box;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeBrickUploader::SetDirty(uint32_t brickIndex)
+    {
+      if (!m_dirty[brickIndex])
+      {
+        m_dirty[brickIndex] = 1;
+        m_dirtyQueue.push_back(brickIndex);
+      }
+    }
+  }
+}
\ No newline at end of file
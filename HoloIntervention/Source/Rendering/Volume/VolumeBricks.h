@@ -0,0 +1,130 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Voxel extents of one upload, half open like D3D11_BOX
+    struct BrickBox
+    {
+      uint32_t Left;
+      uint32_t Top;
+      uint32_t Front;
+      uint32_t Right;
+      uint32_t Bottom;
+      uint32_t Back;
+    };
+
+    // Where brick uploads go, the D3D implementation lives with Volume
+    class IBrickUploadTarget
+    {
+    public:
+      virtual ~IBrickUploadTarget() {}
+
+      /// source points at the box's first voxel, pitches are those of the whole image
+      virtual void UploadBox(const BrickBox& box, const uint8_t* source, uint32_t rowPitch, uint32_t depthPitch) = 0;
+    };
+
+    // Counts uploads without a GPU, optionally mirroring them into a CPU copy of the volume
+    class NullBrickUploadTarget : public IBrickUploadTarget
+    {
+    public:
+      NullBrickUploadTarget(std::vector<uint8_t>* mirror = nullptr, uint32_t bytesPerVoxel = 1);
+
+      virtual void UploadBox(const BrickBox& box, const uint8_t* source, uint32_t rowPitch, uint32_t depthPitch);
+
+      uint64_t GetUploadedBoxCount() const;
+      uint64_t GetUploadedBytes() const;
+
+    protected:
+      std::vector<uint8_t>*   m_mirror;
+      uint32_t                m_bytesPerVoxel;
+      uint64_t                m_boxCount = 0;
+      uint64_t                m_bytes = 0;
+    };
+
+    // Splits a volume into fixed size bricks and uploads only those whose content changed
+    // Changes are found by hashing each brick of a new frame (or marked directly by producers that know what changed).
+    // Dirty bricks are uploaded oldest-first up to a per-frame byte budget; the rest stay dirty for the next call, so a
+    // large change may show partially updated for a few frames rather than stalling one.
+    class VolumeBrickUploader
+    {
+    public:
+      struct Stats
+      {
+        uint32_t      BrickCount = 0;
+        uint32_t      DirtyBrickCount = 0;
+        uint64_t      HashedBytes = 0;
+        uint64_t      UploadedBricks = 0;
+        uint64_t      UploadedBytes = 0;
+      };
+
+    public:
+      explicit VolumeBrickUploader(uint32_t brickSize = DEFAULT_BRICK_SIZE);
+
+      /// Lay out bricks for a volume. With an image, it is taken as already on the GPU; without, everything is dirty.
+      void Reset(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel, const uint8_t* uploadedImage = nullptr);
+
+      /// Hash every brick of image and mark those that differ from the last hashed content, returns the number newly dirtied
+      uint32_t MarkChanged(const uint8_t* image);
+      /// Mark the bricks overlapping a voxel region without hashing
+      void MarkDirty(const BrickBox& region);
+      void MarkAllDirty();
+
+      /// Upload dirty bricks from image, at most budgetBytes (0 is unlimited). Returns the number of bricks uploaded.
+      uint32_t Upload(IBrickUploadTarget& target, const uint8_t* image, uint64_t budgetBytes, std::vector<BrickBox>* outUploadedBricks = nullptr);
+
+      bool HasDirtyBricks() const;
+      uint32_t GetBrickSize() const;
+      Stats GetStats() const;
+
+    protected:
+      uint64_t HashBrick(const uint8_t* image, const BrickBox& box) const;
+      BrickBox GetBrickBox(uint32_t brickIndex) const;
+      void SetDirty(uint32_t brickIndex);
+
+    protected:
+      static const uint32_t   DEFAULT_BRICK_SIZE;
+
+      uint32_t                m_brickSize;
+      uint32_t                m_dimensions[3] = { 0, 0, 0 };
+      uint32_t                m_brickCounts[3] = { 0, 0, 0 };
+      uint32_t                m_bytesPerVoxel = 1;
+
+      std::vector<uint64_t>   m_hashes;
+      std::vector<uint8_t>    m_dirty;
+      std::vector<uint32_t>   m_dirtyQueue;     // Upload order, each dirty brick appears once
+      size_t                  m_dirtyQueueHead = 0;
+      Stats                   m_stats;
+    };
+  }
+}
\ No newline at end of file
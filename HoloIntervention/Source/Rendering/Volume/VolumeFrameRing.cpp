@@ -0,0 +1,382 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Local includes
+#include "pch.h"
+#include "VolumeFrameRing.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    const double VolumeFrameRing::DEFAULT_LOOKAHEAD_SEC = 0.1;
+
+    //----------------------------------------------------------------------------
+    NullVolumeFrameTarget::NullVolumeFrameTarget(bool keepCopies)
+      : m_keepCopies(keepCopies)
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    bool NullVolumeFrameTarget::AllocateSlots(uint32_t slotCount, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel)
+    {
+      m_frameBytes = (uint64_t)width * height * depth * bytesPerVoxel;
+      m_slots.assign(slotCount, std::vector<uint8_t>());
+      if (m_keepCopies)
+      {
+        for (auto& slot : m_slots)
+        {
+          slot.resize((size_t)m_frameBytes);
+        }
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void NullVolumeFrameTarget::ReleaseSlots()
+    {
+      m_slots.clear();
+    }
+
+    //----------------------------------------------------------------------------
+    void NullVolumeFrameTarget::UploadFrame(uint32_t slot, const uint8_t* image, uint32_t /*rowPitch*/, uint32_t /*depthPitch*/)
+    {
+      m_uploadCount++;
+      m_uploadedBytes += m_frameBytes;
+      if (m_keepCopies && slot < m_slots.size())
+      {
+        memcpy(m_slots[slot].data(), image, m_slots[slot].size());
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t NullVolumeFrameTarget::GetSlotCount() const
+    {
+      return static_cast<uint32_t>(m_slots.size());
+    }
+
+    //----------------------------------------------------------------------------
+    const std::vector<uint8_t>& NullVolumeFrameTarget::GetSlot(uint32_t slot) const
+    {
+      return m_slots[slot];
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t NullVolumeFrameTarget::GetUploadCount() const
+    {
+      return m_uploadCount;
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t NullVolumeFrameTarget::GetUploadedBytes() const
+    {
+      return m_uploadedBytes;
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeFrameRing::VolumeFrameRing()
+      : m_lookahead(DEFAULT_LOOKAHEAD_SEC)
+      , m_lastAddedTimestamp(-std::numeric_limits<double>::infinity())
+      , m_loopStart(std::numeric_limits<double>::quiet_NaN())
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeFrameRing::Reset(IVolumeFrameTarget& target, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel, uint32_t slotCount, uint64_t memoryBudgetBytes)
+    {
+      m_dimensions[0] = width;
+      m_dimensions[1] = height;
+      m_dimensions[2] = depth;
+      m_bytesPerVoxel = bytesPerVoxel;
+      m_memoryBudget = memoryBudgetBytes;
+      m_oldestSlot = 0;
+      m_residentCount = 0;
+      m_waiting.clear();
+      m_lastAddedTimestamp = -std::numeric_limits<double>::infinity();
+      m_loopStart = std::numeric_limits<double>::quiet_NaN();
+
+      const uint64_t frameBytes = GetFrameBytes();
+      if (memoryBudgetBytes > 0 && frameBytes > 0)
+      {
+        slotCount = static_cast<uint32_t>(std::min<uint64_t>(slotCount, memoryBudgetBytes / frameBytes));
+      }
+      slotCount = std::max<uint32_t>(slotCount, 1);
+
+      if (frameBytes == 0 || !target.AllocateSlots(slotCount, width, height, depth, bytesPerVoxel))
+      {
+        m_slotTimestamps.clear();
+        return 0;
+      }
+      m_slotTimestamps.assign(slotCount, 0.0);
+      return slotCount;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeFrameRing::Clear(IVolumeFrameTarget& target)
+    {
+      target.ReleaseSlots();
+      m_slotTimestamps.clear();
+      m_oldestSlot = 0;
+      m_residentCount = 0;
+      m_waiting.clear();
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeFrameRing::AddFrame(double timestamp, std::shared_ptr<uint8_t> image)
+    {
+      if (m_slotTimestamps.empty() || image == nullptr || std::isnan(timestamp) || timestamp == m_lastAddedTimestamp)
+      {
+        return false;
+      }
+      if (timestamp < m_lastAddedTimestamp)
+      {
+        // Frames on the old timeline would never be due again, or would be drawn out of order against the new one
+        m_stats.Resets++;
+        m_oldestSlot = 0;
+        m_residentCount = 0;
+        m_waiting.clear();
+        m_loopStart = std::numeric_limits<double>::quiet_NaN();
+      }
+      m_lastAddedTimestamp = timestamp;
+      m_stats.FramesAdded++;
+
+      if (m_waiting.size() >= m_slotTimestamps.size())
+      {
+        m_waiting.pop_front();
+        m_stats.FramesDropped++;
+      }
+      WaitingFrame frame = { timestamp, image };
+      m_waiting.push_back(frame);
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeFrameRing::Upload(IVolumeFrameTarget& target, double displayTime, uint32_t maxFrames)
+    {
+      if (m_playbackMode == Playback_Loop || m_slotTimestamps.empty())
+      {
+        return 0;
+      }
+
+      // A single slot is also the frame on screen, it is only replaced once the new frame is due
+      const uint32_t slotCount = static_cast<uint32_t>(m_slotTimestamps.size());
+      const double horizon = slotCount > 1 ? displayTime + m_lookahead : displayTime;
+      const uint32_t rowPitch = m_dimensions[0] * m_bytesPerVoxel;
+      const uint32_t depthPitch = rowPitch * m_dimensions[1];
+
+      uint32_t uploaded(0);
+      while (!m_waiting.empty() && (maxFrames == 0 || uploaded < maxFrames))
+      {
+        // A frame followed by another that is already due would never be drawn
+        while (m_waiting.size() > 1 && m_waiting[1].Timestamp <= displayTime)
+        {
+          m_waiting.pop_front();
+          m_stats.FramesDropped++;
+        }
+
+        const WaitingFrame& frame = m_waiting.front();
+        if (frame.Timestamp > horizon)
+        {
+          break;
+        }
+
+        uint32_t slot;
+        if (m_residentCount < slotCount)
+        {
+          slot = GetResidentSlot(m_residentCount);
+          m_residentCount++;
+        }
+        else
+        {
+          // The oldest frame may still be the one on screen, until the frame after it is due
+          const uint32_t nextOldest = (m_oldestSlot + 1) % slotCount;
+          if (slotCount > 1 && m_slotTimestamps[nextOldest] > displayTime)
+          {
+            break;
+          }
+          slot = m_oldestSlot;
+          m_oldestSlot = nextOldest;
+        }
+
+        target.UploadFrame(slot, frame.Image.get(), rowPitch, depthPitch);
+        m_slotTimestamps[slot] = frame.Timestamp;
+        m_stats.Uploads++;
+        m_stats.UploadedBytes += GetFrameBytes();
+        m_waiting.pop_front();
+        uploaded++;
+      }
+      return uploaded;
+    }
+
+    //----------------------------------------------------------------------------
+    int32_t VolumeFrameRing::SelectFrame(double displayTime)
+    {
+      if (m_residentCount == 0)
+      {
+        if (!m_waiting.empty() && m_waiting.front().Timestamp <= displayTime)
+        {
+          m_stats.Misses++;
+        }
+        return -1;
+      }
+
+      const double oldest = m_slotTimestamps[GetResidentSlot(0)];
+      const double newest = m_slotTimestamps[GetResidentSlot(m_residentCount - 1)];
+      double frameTime = displayTime;
+      if (m_playbackMode == Playback_Loop)
+      {
+        if (m_residentCount == 1)
+        {
+          m_stats.Hits++;
+          return static_cast<int32_t>(GetResidentSlot(0));
+        }
+
+        // The last frame is held for the average frame interval before the loop restarts
+        if (std::isnan(m_loopStart))
+        {
+          m_loopStart = displayTime;
+        }
+        const double period = (newest - oldest) * m_residentCount / (m_residentCount - 1);
+        frameTime = oldest + std::fmod(std::max(displayTime - m_loopStart, 0.0), period);
+      }
+      else if (frameTime < oldest)
+      {
+        // Nothing resident is due yet, hold the oldest frame
+        return static_cast<int32_t>(GetResidentSlot(0));
+      }
+
+      uint32_t age = m_residentCount - 1;
+      while (age > 0 && m_slotTimestamps[GetResidentSlot(age)] > frameTime)
+      {
+        age--;
+      }
+
+      const bool newerFrameDue = m_playbackMode == Playback_Live && !m_waiting.empty() && m_waiting.front().Timestamp <= displayTime;
+      if (newerFrameDue)
+      {
+        m_stats.Misses++;
+      }
+      else
+      {
+        m_stats.Hits++;
+      }
+      return static_cast<int32_t>(GetResidentSlot(age));
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeFrameRing::SetPlaybackMode(PlaybackMode mode)
+    {
+      if (mode != m_playbackMode)
+      {
+        m_loopStart = std::numeric_limits<double>::quiet_NaN();
+      }
+      m_playbackMode = mode;
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeFrameRing::PlaybackMode VolumeFrameRing::GetPlaybackMode() const
+    {
+      return m_playbackMode;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeFrameRing::SetLookahead(double seconds)
+    {
+      m_lookahead = std::max(seconds, 0.0);
+    }
+
+    //----------------------------------------------------------------------------
+    double VolumeFrameRing::GetLookahead() const
+    {
+      return m_lookahead;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeFrameRing::GetSlotCount() const
+    {
+      return static_cast<uint32_t>(m_slotTimestamps.size());
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeFrameRing::GetResidentCount() const
+    {
+      return m_residentCount;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeFrameRing::GetWaitingCount() const
+    {
+      return static_cast<uint32_t>(m_waiting.size());
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t VolumeFrameRing::GetFrameBytes() const
+    {
+      return (uint64_t)m_dimensions[0] * m_dimensions[1] * m_dimensions[2] * m_bytesPerVoxel;
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t VolumeFrameRing::GetMemoryBudget() const
+    {
+      return m_memoryBudget;
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t VolumeFrameRing::GetResidentBytes() const
+    {
+      return m_slotTimestamps.size() * GetFrameBytes();
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t VolumeFrameRing::GetWaitingBytes() const
+    {
+      return m_waiting.size() * GetFrameBytes();
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeFrameRing::Stats VolumeFrameRing::GetStats() const
+    {
+      return m_stats;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeFrameRing::ResetStats()
+    {
+      m_stats = Stats();
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeFrameRing::GetResidentSlot(uint32_t age) const
+    {
+      return (m_oldestSlot + age) % static_cast<uint32_t>(m_slotTimestamps.size());
+    }
+  }
+}
\ No newline at end of file
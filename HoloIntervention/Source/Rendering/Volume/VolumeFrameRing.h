@@ -0,0 +1,166 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Where ring frames go, the D3D implementation lives with Volume
+    class IVolumeFrameTarget
+    {
+    public:
+      virtual ~IVolumeFrameTarget() {}
+
+      /// Create storage for slotCount whole frames, replacing any earlier slots
+      virtual bool AllocateSlots(uint32_t slotCount, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel) = 0;
+      virtual void ReleaseSlots() = 0;
+
+      /// image holds one tightly packed frame
+      virtual void UploadFrame(uint32_t slot, const uint8_t* image, uint32_t rowPitch, uint32_t depthPitch) = 0;
+    };
+
+    // Counts uploads without a GPU, optionally keeping a CPU copy of every slot
+    class NullVolumeFrameTarget : public IVolumeFrameTarget
+    {
+    public:
+      explicit NullVolumeFrameTarget(bool keepCopies = false);
+
+      virtual bool AllocateSlots(uint32_t slotCount, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel);
+      virtual void ReleaseSlots();
+      virtual void UploadFrame(uint32_t slot, const uint8_t* image, uint32_t rowPitch, uint32_t depthPitch);
+
+      uint32_t GetSlotCount() const;
+      const std::vector<uint8_t>& GetSlot(uint32_t slot) const;
+      uint64_t GetUploadCount() const;
+      uint64_t GetUploadedBytes() const;
+
+    protected:
+      bool                                m_keepCopies;
+      uint64_t                            m_frameBytes = 0;
+      std::vector<std::vector<uint8_t>>   m_slots;
+      uint64_t                            m_uploadCount = 0;
+      uint64_t                            m_uploadedBytes = 0;
+    };
+
+    // A ring of time-stamped volume frames resident on the GPU, fed from a queue of frames waiting on the CPU
+    // Waiting frames are uploaded once they fall within a lookahead of the display time, each into the slot of the oldest
+    // resident frame, but only when that frame can no longer be shown. Live playback draws the newest resident frame that
+    // is due; loop playback stops uploading and cycles through the resident frames by their own timestamps, so a cached
+    // sequence replays with no transfers at all. Timestamps only need to share a clock with the display time passed in.
+    class VolumeFrameRing
+    {
+    public:
+      enum PlaybackMode
+      {
+        Playback_Live,
+        Playback_Loop,
+      };
+
+      struct Stats
+      {
+        uint64_t      FramesAdded = 0;
+        uint64_t      FramesDropped = 0;    // Never uploaded, a newer frame was due first or the queue was full
+        uint64_t      Uploads = 0;
+        uint64_t      UploadedBytes = 0;
+        uint64_t      Hits = 0;             // The frame due was resident when drawn
+        uint64_t      Misses = 0;           // The frame due was still waiting, an older one was drawn
+        uint64_t      Resets = 0;           // Timestamps went backwards, the source restarted its clock
+
+        double HitRate() const
+        {
+          return Hits + Misses == 0 ? 0.0 : static_cast<double>(Hits) / (Hits + Misses);
+        }
+      };
+
+    public:
+      VolumeFrameRing();
+
+      /// Allocate as many of slotCount frames as fit in memoryBudgetBytes (0 is unlimited), at least one
+      /// The waiting queue holds at most as many frames as the ring. Returns the slot count, 0 if allocation failed.
+      uint32_t Reset(IVolumeFrameTarget& target, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel, uint32_t slotCount, uint64_t memoryBudgetBytes);
+      void Clear(IVolumeFrameTarget& target);
+
+      /// The buffer is held until its frame is uploaded or dropped. A repeated timestamp is rejected; an earlier one means the
+      /// source restarted its clock, so every waiting and resident frame is discarded and the ring refills from this frame
+      bool AddFrame(double timestamp, std::shared_ptr<uint8_t> image);
+
+      /// Upload waiting frames due before displayTime plus the lookahead, oldest first, at most maxFrames (0 is unlimited)
+      uint32_t Upload(IVolumeFrameTarget& target, double displayTime, uint32_t maxFrames);
+
+      /// Slot to draw at displayTime, -1 if nothing is resident yet. Counts a hit or a miss whenever a frame is due.
+      int32_t SelectFrame(double displayTime);
+
+      void SetPlaybackMode(PlaybackMode mode);
+      PlaybackMode GetPlaybackMode() const;
+      void SetLookahead(double seconds);
+      double GetLookahead() const;
+
+      uint32_t GetSlotCount() const;
+      uint32_t GetResidentCount() const;
+      uint32_t GetWaitingCount() const;
+      uint64_t GetFrameBytes() const;
+      uint64_t GetMemoryBudget() const;
+      uint64_t GetResidentBytes() const;  // Allocated slots, whether filled or not
+      uint64_t GetWaitingBytes() const;
+
+      Stats GetStats() const;
+      void ResetStats();
+
+    protected:
+      uint32_t GetResidentSlot(uint32_t age) const;  // 0 is the oldest resident frame
+
+    protected:
+      struct WaitingFrame
+      {
+        double                    Timestamp;
+        std::shared_ptr<uint8_t>  Image;
+      };
+
+      static const double         DEFAULT_LOOKAHEAD_SEC;
+
+      uint32_t                    m_dimensions[3] = { 0, 0, 0 };
+      uint32_t                    m_bytesPerVoxel = 0;
+      uint64_t                    m_memoryBudget = 0;
+      PlaybackMode                m_playbackMode = Playback_Live;
+      double                      m_lookahead;
+
+      std::vector<double>         m_slotTimestamps;
+      uint32_t                    m_oldestSlot = 0;
+      uint32_t                    m_residentCount = 0;
+      std::deque<WaitingFrame>    m_waiting;
+      double                      m_lastAddedTimestamp;
+      double                      m_loopStart;        // Display time the current loop began, NaN until the first selection
+      Stats                       m_stats;
+    };
+  }
+}
\ No newline at end of file
@@ -0,0 +1,322 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Local includes
+#include "pch.h"
+#include "VolumePyramid.h"
+
+// Common includes
+#include "WorkerPool.h"
+
+// Math includes
+#include "Float4Lanes.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Average 2x2x2 blocks into out[first, last), rows holds the four parent rows (y0 z0, y1 z0, y0 z1, y1 z1)
+  void FilterRow8(const uint8_t* const rows[4], uint8_t* out, uint32_t first, uint32_t last, uint32_t parentWidth)
+  {
+    uint32_t x = first;
+#if defined(HOLOINTERVENTION_LANES_SSE2)
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i half = _mm_set1_epi16(4);
+    for (; x + 8 <= last && 2 * x + 16 <= parentWidth; x += 8)
+    {
+      __m128i sum = _mm_setzero_si128();
+      for (int row = 0; row < 4; ++row)
+      {
+        const __m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[row] + 2 * x));
+        sum = _mm_add_epi16(sum, _mm_add_epi16(_mm_and_si128(pairs, lowBytes), _mm_srli_epi16(pairs, 8)));
+      }
+      sum = _mm_srli_epi16(_mm_add_epi16(sum, half), 3);
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_packus_epi16(sum, sum));
+    }
+#elif defined(HOLOINTERVENTION_LANES_NEON)
+    for (; x + 8 <= last && 2 * x + 16 <= parentWidth; x += 8)
+    {
+      uint16x8_t sum = vpaddlq_u8(vld1q_u8(rows[0] + 2 * x));
+      sum = vpadalq_u8(sum, vld1q_u8(rows[1] + 2 * x));
+      sum = vpadalq_u8(sum, vld1q_u8(rows[2] + 2 * x));
+      sum = vpadalq_u8(sum, vld1q_u8(rows[3] + 2 * x));
+      vst1_u8(out + x, vrshrn_n_u16(sum, 3));
+    }
+#endif
+    for (; x < last; ++x)
+    {
+      const uint32_t x0 = 2 * x;
+      const uint32_t x1 = std::min(x0 + 1, parentWidth - 1);
+      uint32_t sum(4);
+      for (int row = 0; row < 4; ++row)
+      {
+        sum += rows[row][x0] + rows[row][x1];
+      }
+      out[x] = static_cast<uint8_t>(sum >> 3);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void FilterRow16(const uint16_t* const rows[4], uint16_t* out, uint32_t first, uint32_t last, uint32_t parentWidth)
+  {
+    uint32_t x = first;
+#if defined(HOLOINTERVENTION_LANES_SSE2)
+    const __m128i lowWords = _mm_set1_epi32(0xFFFF);
+    const __m128i half = _mm_set1_epi32(4);
+    const __m128i bias32 = _mm_set1_epi32(0x8000);
+    const __m128i bias16 = _mm_set1_epi16(-0x8000);
+    for (; x + 4 <= last && 2 * x + 8 <= parentWidth; x += 4)
+    {
+      __m128i sum = _mm_setzero_si128();
+      for (int row = 0; row < 4; ++row)
+      {
+        const __m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[row] + 2 * x));
+        sum = _mm_add_epi32(sum, _mm_add_epi32(_mm_and_si128(pairs, lowWords), _mm_srli_epi32(pairs, 16)));
+      }
+      sum = _mm_srli_epi32(_mm_add_epi32(sum, half), 3);
+
+      // SSE2 only packs with signed saturation, so shift the range to signed and back
+      const __m128i packed = _mm_packs_epi32(_mm_sub_epi32(sum, bias32), _mm_sub_epi32(sum, bias32));
+      _mm_storel_epi64(reinterpret_cast<__m128i*>(out + x), _mm_add_epi16(packed, bias16));
+    }
+#elif defined(HOLOINTERVENTION_LANES_NEON)
+    for (; x + 4 <= last && 2 * x + 8 <= parentWidth; x += 4)
+    {
+      uint32x4_t sum = vpaddlq_u16(vld1q_u16(rows[0] + 2 * x));
+      sum = vpadalq_u16(sum, vld1q_u16(rows[1] + 2 * x));
+      sum = vpadalq_u16(sum, vld1q_u16(rows[2] + 2 * x));
+      sum = vpadalq_u16(sum, vld1q_u16(rows[3] + 2 * x));
+      vst1_u16(out + x, vrshrn_n_u32(sum, 3));
+    }
+#endif
+    for (; x < last; ++x)
+    {
+      const uint32_t x0 = 2 * x;
+      const uint32_t x1 = std::min(x0 + 1, parentWidth - 1);
+      uint32_t sum(4);
+      for (int row = 0; row < 4; ++row)
+      {
+        sum += rows[row][x0] + rows[row][x1];
+      }
+      out[x] = static_cast<uint16_t>(sum >> 3);
+    }
+  }
+}
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Below this many voxels a box is filtered on the calling thread, a changed brick never waits on the pool
+    const uint32_t VolumePyramid::MINIMUM_VOXELS_PER_THREAD = 32 * 32 * 32;
+
+    //----------------------------------------------------------------------------
+    VolumePyramid::VolumePyramid()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumePyramid::Reset(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel, uint32_t maximumLevels)
+    {
+      m_bytesPerVoxel = bytesPerVoxel;
+      m_sizes.clear();
+      m_levels.clear();
+
+      std::array<uint32_t, 3> size = { width, height, depth };
+      m_sizes.push_back(size);
+      m_levels.push_back(std::vector<uint8_t>());
+      if (!IsSupported() || width == 0 || height == 0 || depth == 0)
+      {
+        return;
+      }
+
+      while ((size[0] > 1 || size[1] > 1 || size[2] > 1) && (maximumLevels == 0 || m_sizes.size() < maximumLevels))
+      {
+        for (auto& dimension : size)
+        {
+          dimension = std::max<uint32_t>(dimension / 2, 1);
+        }
+        m_sizes.push_back(size);
+        m_levels.push_back(std::vector<uint8_t>((size_t)size[0] * size[1] * size[2] * m_bytesPerVoxel, 0));
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumePyramid::SetThreadCount(uint32_t threadCount)
+    {
+      m_threadCount = threadCount;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumePyramid::BuildAll(const uint8_t* image)
+    {
+      const BrickBox region = { 0, 0, 0, m_sizes[0][0], m_sizes[0][1], m_sizes[0][2] };
+      UpdateRegion(image, region);
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumePyramid::UpdateRegion(const uint8_t* image, const BrickBox& region, std::vector<BrickBox>* outRegions)
+    {
+      if (outRegions != nullptr)
+      {
+        outRegions->clear();
+      }
+
+      BrickBox box = region;
+      for (uint32_t level = 1; level < m_sizes.size(); ++level)
+      {
+        // Voxel c reads parents 2c and 2c + 1, so it is touched by [first, last) when 2c + 1 >= first and 2c < last
+        const std::array<uint32_t, 3>& size = m_sizes[level];
+        const uint32_t first[3] = { box.Left / 2, box.Top / 2, box.Front / 2 };
+        const uint32_t last[3] = { std::min((box.Right + 1) / 2, size[0]), std::min((box.Bottom + 1) / 2, size[1]), std::min((box.Back + 1) / 2, size[2]) };
+        if (first[0] >= last[0] || first[1] >= last[1] || first[2] >= last[2])
+        {
+          return;
+        }
+
+        box = { first[0], first[1], first[2], last[0], last[1], last[2] };
+        FilterBox(level, box, level == 1 ? image : m_levels[level - 1].data());
+        if (outRegions != nullptr)
+        {
+          outRegions->push_back(box);
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumePyramid::IsSupported() const
+    {
+      return m_bytesPerVoxel == 1 || m_bytesPerVoxel == 2;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumePyramid::GetLevelCount() const
+    {
+      return static_cast<uint32_t>(m_sizes.size());
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumePyramid::GetLevelSize(uint32_t level, uint32_t outSize[3]) const
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        outSize[i] = m_sizes[level][i];
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    const std::vector<uint8_t>& VolumePyramid::GetLevel(uint32_t level) const
+    {
+      return m_levels[level];
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumePyramid::GetBytesPerVoxel() const
+    {
+      return m_bytesPerVoxel;
+    }
+
+    //----------------------------------------------------------------------------
+    float VolumePyramid::SelectLevel(float voxelWorldSize, float distance, float focalLengthPixels, float bias, uint32_t levelCount)
+    {
+      float level = bias;
+      if (voxelWorldSize > 0.f && distance > 0.f && focalLengthPixels > 0.f)
+      {
+        // Each level doubles the voxel size, so the level is how many doublings bring a voxel up to a pixel
+        const float pixelsPerVoxel = voxelWorldSize * focalLengthPixels / distance;
+        level += std::max(-std::log2(pixelsPerVoxel), 0.f);
+      }
+      return std::min(std::max(level, 0.f), static_cast<float>(std::max<uint32_t>(levelCount, 1) - 1));
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumePyramid::FilterBox(uint32_t level, const BrickBox& box, const uint8_t* source)
+    {
+      // Slices are interleaved across the worker pool, each share only reads the level below
+      const uint32_t slices = box.Back - box.Front;
+      const uint64_t voxels = (uint64_t)(box.Right - box.Left) * (box.Bottom - box.Top) * slices;
+      uint32_t threadCount = m_threadCount == 0 ? WorkerPool::instance().GetThreadCount() : m_threadCount;
+      threadCount = static_cast<uint32_t>(std::min<uint64_t>(std::min<uint64_t>(threadCount, slices), std::max<uint64_t>(voxels / MINIMUM_VOXELS_PER_THREAD, 1)));
+
+      if (threadCount == 1)
+      {
+        FilterSlices(level, box, source, 0, 1);
+        return;
+      }
+      WorkerPool::instance().ParallelFor(threadCount, [this, level, &box, source, threadCount](size_t share)
+      {
+        FilterSlices(level, box, source, static_cast<uint32_t>(share), threadCount);
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumePyramid::FilterSlices(uint32_t level, const BrickBox& box, const uint8_t* source, uint32_t firstSlice, uint32_t sliceStride)
+    {
+      const std::array<uint32_t, 3>& parentSize = m_sizes[level - 1];
+      const std::array<uint32_t, 3>& size = m_sizes[level];
+      const size_t parentRow = (size_t)parentSize[0] * m_bytesPerVoxel;
+      const size_t parentSlice = parentRow * parentSize[1];
+      const size_t row = (size_t)size[0] * m_bytesPerVoxel;
+      const size_t slice = row * size[1];
+      uint8_t* destination = m_levels[level].data();
+
+      for (uint32_t z = box.Front + firstSlice; z < box.Back; z += sliceStride)
+      {
+        const size_t z0 = 2 * z;
+        const size_t z1 = std::min<size_t>(z0 + 1, parentSize[2] - 1);
+        for (uint32_t y = box.Top; y < box.Bottom; ++y)
+        {
+          const size_t y0 = 2 * y;
+          const size_t y1 = std::min<size_t>(y0 + 1, parentSize[1] - 1);
+          const uint8_t* const rows[4] =
+          {
+            source + z0 * parentSlice + y0 * parentRow,
+            source + z0 * parentSlice + y1 * parentRow,
+            source + z1 * parentSlice + y0 * parentRow,
+            source + z1 * parentSlice + y1 * parentRow
+          };
+          uint8_t* out = destination + z * slice + y * row;
+
+          if (m_bytesPerVoxel == 1)
+          {
+            FilterRow8(rows, out, box.Left, box.Right, parentSize[0]);
+          }
+          else
+          {
+            const uint16_t* const rows16[4] =
+            {
+              reinterpret_cast<const uint16_t*>(rows[0]), reinterpret_cast<const uint16_t*>(rows[1]),
+              reinterpret_cast<const uint16_t*>(rows[2]), reinterpret_cast<const uint16_t*>(rows[3])
+            };
+            FilterRow16(rows16, reinterpret_cast<uint16_t*>(out), box.Left, box.Right, parentSize[0]);
+          }
+        }
+      }
+    }
+  }
+}
\ No newline at end of file
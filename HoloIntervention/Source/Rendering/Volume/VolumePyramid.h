@@ -0,0 +1,81 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// Local includes
+#include "VolumeBricks.h"
+
+// STL includes
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Box filtered mip levels of a volume, built on the WorkerPool and rebuilt only where bricks change
+    // Level 0 is the caller's image and is not stored. Each level halves every dimension, rounding down to at least one
+    // voxel as D3D sizes mips, and each voxel is the rounded mean of the 2x2x2 block below it. Rows are filtered eight
+    // (8 bit) or four (16 bit) voxels at a time with SSE2 or NEON where available.
+    class VolumePyramid
+    {
+    public:
+      VolumePyramid();
+
+      /// bytesPerVoxel of 1 or 2 (unsigned data), anything else leaves only level 0
+      /// maximumLevels counts level 0, 0 goes all the way down to a single voxel
+      void Reset(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel, uint32_t maximumLevels = 0);
+      /// threadCount shares of the work run on the WorkerPool, 0 uses one per pool thread
+      void SetThreadCount(uint32_t threadCount);
+
+      void BuildAll(const uint8_t* image);
+      /// Rebuild the voxels a changed region of level 0 feeds, outRegions receives the rebuilt box of each level from 1 on
+      void UpdateRegion(const uint8_t* image, const BrickBox& region, std::vector<BrickBox>* outRegions = nullptr);
+
+      bool IsSupported() const;
+      uint32_t GetLevelCount() const;   // Including level 0
+      void GetLevelSize(uint32_t level, uint32_t outSize[3]) const;
+      const std::vector<uint8_t>& GetLevel(uint32_t level) const;  // level 1 and up, x fastest
+      uint32_t GetBytesPerVoxel() const;
+
+      /// Level whose voxels project to about one pixel, plus bias, clamped to [0, levelCount - 1]
+      /// focalLengthPixels is the projection's scale times half the viewport height
+      static float SelectLevel(float voxelWorldSize, float distance, float focalLengthPixels, float bias, uint32_t levelCount);
+
+    protected:
+      void FilterBox(uint32_t level, const BrickBox& box, const uint8_t* source);
+      void FilterSlices(uint32_t level, const BrickBox& box, const uint8_t* source, uint32_t firstSlice, uint32_t sliceStride);
+
+    protected:
+      static const uint32_t                 MINIMUM_VOXELS_PER_THREAD;
+
+      uint32_t                              m_bytesPerVoxel = 0;
+      uint32_t                              m_threadCount = 0;
+      std::vector<std::array<uint32_t, 3>>  m_sizes;    // Per level, level 0 included
+      std::vector<std::vector<uint8_t>>     m_levels;   // Index 0 is unused, level 0 belongs to the caller
+    };
+  }
+}
\ No newline at end of file
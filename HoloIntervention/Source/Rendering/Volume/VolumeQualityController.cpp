@@ -0,0 +1,244 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Local includes
+#include "pch.h"
+#include "VolumeQualityController.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    //----------------------------------------------------------------------------
+    VolumeQualityController::VolumeQualityController()
+    {
+      BuildLevels();
+      Reset();
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeQualityController::SetSettings(const Settings& settings)
+    {
+      if (!(settings.TargetMilliseconds > 0.f) ||
+          !(settings.ImproveThreshold > 0.f) ||
+          !(settings.ImproveThreshold < settings.DegradeThreshold) ||
+          !(settings.MinimumStepScale > 0.f) ||
+          !(settings.MaximumStepScale >= settings.MinimumStepScale) ||
+          !(settings.StepScaleRatio > 1.f) ||
+          !(settings.MaximumLevelOfDetailBias >= 0.f) ||
+          !(settings.LevelOfDetailBiasStep > 0.f) ||
+          !(settings.MinimumResolutionScale > 0.f && settings.MinimumResolutionScale <= 1.f) ||
+          !(settings.ResolutionScaleRatio > 0.f && settings.ResolutionScaleRatio < 1.f) ||
+          settings.WindowFrames == 0 ||
+          settings.MaximumImproveHold == 0)
+      {
+        return false;
+      }
+
+      m_settings = settings;
+      BuildLevels();
+      Reset();
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    const VolumeQualityController::Settings& VolumeQualityController::GetSettings() const
+    {
+      return m_settings;
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeQualityController::AddMeasurement(float milliseconds)
+    {
+      if (m_settleRemaining > 0)
+      {
+        // Still measuring frames queued before the last change
+        --m_settleRemaining;
+        return false;
+      }
+
+      if (!(milliseconds >= 0.f) || std::isinf(milliseconds))
+      {
+        return false;
+      }
+
+      m_windowSum += milliseconds;
+      if (++m_windowCount < m_settings.WindowFrames)
+      {
+        return false;
+      }
+
+      m_averageCost = static_cast<float>(m_windowSum / m_windowCount);
+      m_windowSum = 0.0;
+      m_windowCount = 0;
+
+      const bool onProbation = m_probationRemaining > 0;
+      if (onProbation)
+      {
+        --m_probationRemaining;
+      }
+      const float target = m_settings.TargetMilliseconds;
+
+      if (m_averageCost > target * m_settings.DegradeThreshold && m_level + 1 < m_levels.size())
+      {
+        // Drop far enough that the target should be met, rather than one level per window
+        // The saving of a coarser mip level depends on the texture cache and is not predicted, so a jump stops at one
+        uint32_t level = m_level + 1;
+        while (level + 1 < m_levels.size() && m_levels[level].LevelOfDetailBias == m_levels[m_level].LevelOfDetailBias && PredictCost(m_averageCost, m_level, level) > target)
+        {
+          ++level;
+        }
+
+        if (onProbation)
+        {
+          // The level just improved to could not be held, wait longer before trying it again
+          m_improveHold[m_level] = std::min(m_improveHold[m_level] * 2, m_settings.MaximumImproveHold);
+        }
+        m_improveWindows = 0;
+        m_probationRemaining = 0;
+        SetLevel(level);
+        return true;
+      }
+
+      if (onProbation && m_probationRemaining == 0)
+      {
+        m_improveHold[m_level] = std::max<uint32_t>(m_improveHold[m_level] / 2, 1);
+      }
+
+      // Only improve when the better level is expected to fit the target, not just the degrade threshold
+      if (m_averageCost < target * m_settings.ImproveThreshold && m_level > 0 && PredictCost(m_averageCost, m_level, m_level - 1) < target)
+      {
+        if (++m_improveWindows >= m_improveHold[m_level - 1])
+        {
+          m_improveWindows = 0;
+          m_probationRemaining = m_settings.ProbationWindows;
+          SetLevel(m_level - 1);
+          return true;
+        }
+        return false;
+      }
+
+      m_improveWindows = 0;
+      return false;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeQualityController::Reset()
+    {
+      m_level = 0;
+      m_settleRemaining = 0;
+      m_windowCount = 0;
+      m_windowSum = 0.0;
+      m_averageCost = 0.f;
+      m_improveHold.assign(m_levels.size(), 1);
+      m_improveWindows = 0;
+      m_probationRemaining = 0;
+    }
+
+    //----------------------------------------------------------------------------
+    const VolumeQualityController::Quality& VolumeQualityController::GetQuality() const
+    {
+      return m_levels[m_level];
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeQualityController::GetLevel() const
+    {
+      return m_level;
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t VolumeQualityController::GetLevelCount() const
+    {
+      return static_cast<uint32_t>(m_levels.size());
+    }
+
+    //----------------------------------------------------------------------------
+    float VolumeQualityController::GetAverageCost() const
+    {
+      return m_averageCost;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeQualityController::BuildLevels()
+    {
+      m_levels.clear();
+
+      Quality quality;
+      for (float stepScale = m_settings.MinimumStepScale; stepScale < m_settings.MaximumStepScale * 0.9999f; stepScale *= m_settings.StepScaleRatio)
+      {
+        quality.StepScale = stepScale;
+        m_levels.push_back(quality);
+      }
+      quality.StepScale = m_settings.MaximumStepScale;
+      m_levels.push_back(quality);
+
+      if (m_settings.MaximumLevelOfDetailBias > 0.f)
+      {
+        for (float bias = m_settings.LevelOfDetailBiasStep; bias < m_settings.MaximumLevelOfDetailBias * 0.9999f; bias += m_settings.LevelOfDetailBiasStep)
+        {
+          quality.LevelOfDetailBias = bias;
+          m_levels.push_back(quality);
+        }
+        quality.LevelOfDetailBias = m_settings.MaximumLevelOfDetailBias;
+        m_levels.push_back(quality);
+      }
+
+      for (float resolutionScale = m_settings.ResolutionScaleRatio; resolutionScale > m_settings.MinimumResolutionScale * 1.0001f; resolutionScale *= m_settings.ResolutionScaleRatio)
+      {
+        quality.ResolutionScale = resolutionScale;
+        m_levels.push_back(quality);
+      }
+      if (m_settings.MinimumResolutionScale < 1.f)
+      {
+        quality.ResolutionScale = m_settings.MinimumResolutionScale;
+        m_levels.push_back(quality);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    float VolumeQualityController::PredictCost(float cost, uint32_t fromLevel, uint32_t toLevel) const
+    {
+      // Samples per ray go with the inverse of the step, rays with the pixel count, a mip level bias is taken as free
+      const Quality& from = m_levels[fromLevel];
+      const Quality& to = m_levels[toLevel];
+      const float resolutionRatio = to.ResolutionScale / from.ResolutionScale;
+      return cost * (from.StepScale / to.StepScale) * resolutionRatio * resolutionRatio;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeQualityController::SetLevel(uint32_t level)
+    {
+      m_level = level;
+      m_settleRemaining = m_settings.SettleFrames;
+      m_windowCount = 0;
+      m_windowSum = 0.0;
+    }
+  }
+}
\ No newline at end of file
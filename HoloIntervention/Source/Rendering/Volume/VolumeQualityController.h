@@ -0,0 +1,109 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    // Chooses the volume rendering quality from the measured cost of the volume passes, to hold them to a frame budget
+    // Quality is a ladder of discrete levels. The ray step grows first (the iteration cap follows it, see
+    // VolumeRayMarcher::ComputeStep), then the volume's mip level is biased coarser, then once both are at their bounds
+    // the render resolution drops, if allowed.
+    // Measurements are averaged over a window and only a window outside the band around the target moves the level.
+    // Measurements still in flight when the level changes are dropped, and a level that had to be left again soon
+    // after improving to it is retried less and less often, so the controller settles instead of oscillating.
+    class VolumeQualityController
+    {
+    public:
+      struct Settings
+      {
+        float     TargetMilliseconds = 4.f;
+        float     DegradeThreshold = 1.1f;        // Fraction of the target above which quality drops
+        float     ImproveThreshold = 0.75f;       // Fraction of the target below which quality may rise
+        float     MinimumStepScale = 1.f;
+        float     MaximumStepScale = 4.f;
+        float     StepScaleRatio = 1.25f;         // Between adjacent step levels
+        float     MaximumLevelOfDetailBias = 2.f; // Mip levels added to the one picked from projected size, 0 disables
+        float     LevelOfDetailBiasStep = 1.f;    // Between adjacent bias levels
+        float     MinimumResolutionScale = 1.f;   // 1 keeps the full resolution
+        float     ResolutionScaleRatio = 0.85f;   // Between adjacent resolution levels
+        uint32_t  WindowFrames = 8;               // Measurements averaged per decision
+        uint32_t  SettleFrames = 4;               // Measurements dropped after a change, covers the query latency
+        uint32_t  ProbationWindows = 8;           // Windows an improved level must hold before it counts as sustainable
+        uint32_t  MaximumImproveHold = 64;        // Bound on the windows waited before retrying a level that failed
+      };
+
+      struct Quality
+      {
+        float     StepScale = 1.f;
+        float     LevelOfDetailBias = 0.f;
+        float     ResolutionScale = 1.f;
+      };
+
+    public:
+      VolumeQualityController();
+
+      /// Rebuilds the level ladder and returns to the best quality, returns false (and changes nothing) if the settings are out of range
+      bool SetSettings(const Settings& settings);
+      const Settings& GetSettings() const;
+
+      /// Cost of the volume passes in one rendered frame, frames that drew no volume should not be reported
+      /// Returns true when the quality changed
+      bool AddMeasurement(float milliseconds);
+      void Reset();
+
+      const Quality& GetQuality() const;
+      uint32_t GetLevel() const;
+      uint32_t GetLevelCount() const;
+      float GetAverageCost() const;   // Of the last complete window, 0 before the first
+
+    protected:
+      void BuildLevels();
+      float PredictCost(float cost, uint32_t fromLevel, uint32_t toLevel) const;
+      void SetLevel(uint32_t level);
+
+    protected:
+      Settings                m_settings;
+      std::vector<Quality>    m_levels;
+      uint32_t                m_level = 0;
+
+      // Measurement window
+      uint32_t                m_settleRemaining = 0;
+      uint32_t                m_windowCount = 0;
+      double                  m_windowSum = 0.0;
+      float                   m_averageCost = 0.f;
+
+      // Hysteresis
+      std::vector<uint32_t>   m_improveHold;            // Per level, windows below the threshold needed to improve to it
+      uint32_t                m_improveWindows = 0;     // Consecutive windows below the improve threshold
+      uint32_t                m_probationRemaining = 0; // Windows left before the last improvement counts as sustainable
+    };
+  }
+}
\ No newline at end of file
@@ -0,0 +1,662 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "Float4Lanes.h"
+#include "MacrocellGrid.h"
+#include "PreIntegrationTable.h"
+#include "VolumeRayMarcher.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <thread>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Row-major with column vectors, as the camera matrix is given
+  bool InvertMatrix(const float matrix[16], double outInverse[16])
+  {
+    double work[4][8];
+    for (int row = 0; row < 4; ++row)
+    {
+      for (int column = 0; column < 4; ++column)
+      {
+        work[row][column] = matrix[row * 4 + column];
+        work[row][column + 4] = row == column ? 1.0 : 0.0;
+      }
+    }
+
+    // Gauss-Jordan elimination with partial pivoting
+    for (int column = 0; column < 4; ++column)
+    {
+      int pivot = column;
+      for (int row = column + 1; row < 4; ++row)
+      {
+        if (std::abs(work[row][column]) > std::abs(work[pivot][column]))
+        {
+          pivot = row;
+        }
+      }
+      if (std::abs(work[pivot][column]) < 1e-12)
+      {
+        return false;
+      }
+      for (int i = 0; i < 8; ++i)
+      {
+        std::swap(work[column][i], work[pivot][i]);
+      }
+
+      const double scale = 1.0 / work[column][column];
+      for (int i = 0; i < 8; ++i)
+      {
+        work[column][i] *= scale;
+      }
+      for (int row = 0; row < 4; ++row)
+      {
+        if (row != column)
+        {
+          const double factor = work[row][column];
+          for (int i = 0; i < 8; ++i)
+          {
+            work[row][i] -= factor * work[column][i];
+          }
+        }
+      }
+    }
+
+    for (int row = 0; row < 4; ++row)
+    {
+      for (int column = 0; column < 4; ++column)
+      {
+        outInverse[row * 4 + column] = work[row][column + 4];
+      }
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  void Unproject(const double inverse[16], double x, double y, double z, double outPoint[3])
+  {
+    double result[4];
+    for (int row = 0; row < 4; ++row)
+    {
+      result[row] = inverse[row * 4 + 0] * x + inverse[row * 4 + 1] * y + inverse[row * 4 + 2] * z + inverse[row * 4 + 3];
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      outPoint[i] = result[i] / result[3];
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Model space to what FaceAnalysisPS writes, then quantized like the render target
+  void WritePosition(const double modelPosition[3], uint32_t positionBits, float* outTexel)
+  {
+    const double texture[3] = { modelPosition[0], 1.0 - modelPosition[1], 1.0 - modelPosition[2] };
+    for (int i = 0; i < 3; ++i)
+    {
+      double value = std::min(std::max(texture[i], 0.0), 1.0);
+      if (positionBits > 0)
+      {
+        const double levels = static_cast<double>((1u << positionBits) - 1);
+        value = std::floor(value * levels + 0.5) / levels;
+      }
+      outTexel[i] = static_cast<float>(value);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // The shader reads the position textures at (pixel centre - 0.5) / viewport, the top left corner of the pixel, so
+  // each read is an even blend of four texels with the black border outside the target
+  void ReadPosition(const std::vector<float>& image, uint32_t width, uint32_t height, uint32_t x, uint32_t y, float outPosition[3])
+  {
+    float sum[3] = { 0.f, 0.f, 0.f };
+    for (uint32_t dy = 0; dy < 2; ++dy)
+    {
+      for (uint32_t dx = 0; dx < 2; ++dx)
+      {
+        if (x + dx >= 1 && y + dy >= 1 && x + dx - 1 < width && y + dy - 1 < height)
+        {
+          const float* texel = &image[((size_t)(y + dy - 1) * width + (x + dx - 1)) * 3];
+          for (int i = 0; i < 3; ++i)
+          {
+            sum[i] += texel[i];
+          }
+        }
+      }
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+      outPosition[i] = 0.25f * sum[i];
+    }
+  }
+}
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    const float VolumeRayMarcher::EARLY_TERMINATION_ALPHA = 0.95f;
+
+    //----------------------------------------------------------------------------
+    VolumeRayMarcher::VolumeRayMarcher()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::SetVolume(const uint8_t* image, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel)
+    {
+      m_image = image;
+      m_dimensions[0] = width;
+      m_dimensions[1] = height;
+      m_dimensions[2] = depth;
+      m_bytesPerVoxel = bytesPerVoxel;
+      m_valueRange = bytesPerVoxel == 2 ? 65535.f : 255.f;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::SetOpacityTable(const std::vector<float>& opacities, float maximumInputValue)
+    {
+      m_opacities = opacities;
+      m_maximumInputValue = maximumInputValue;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::SetStep(const float stepSize[3], uint32_t numIterations)
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        m_stepSize[i] = stepSize[i];
+      }
+      m_numIterations = numIterations;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::GetStep(float outStepSize[3], uint32_t& outNumIterations) const
+    {
+      for (int i = 0; i < 3; ++i)
+      {
+        outStepSize[i] = m_stepSize[i];
+      }
+      outNumIterations = m_numIterations;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::SetMacrocellGrid(const MacrocellGrid* grid)
+    {
+      m_grid = grid;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::SetPreIntegrationTable(const PreIntegrationTable* table)
+    {
+      m_preIntegrationTable = table;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::SetPositionBits(uint32_t bits)
+    {
+      m_positionBits = std::min(bits, 16u);
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::ComputeStep(const uint32_t dimensions[3], float stepScale, float outStepSize[3], uint32_t& outNumIterations)
+    {
+      // The step size for each component needs to be a ratio of the largest component
+      const float maxSize = std::fmaxf(static_cast<float>(dimensions[0]), std::fmaxf(static_cast<float>(dimensions[1]), static_cast<float>(dimensions[2])));
+      for (int i = 0; i < 3; ++i)
+      {
+        outStepSize[i] = 1.0f / (dimensions[i] * (maxSize / dimensions[i])) * stepScale;
+      }
+      outNumIterations = static_cast<uint32_t>(maxSize * (1.0f / stepScale));
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeRayMarcher::RayResult VolumeRayMarcher::March(const float front[3], const float back[3], bool skipEmptySpace) const
+    {
+      RayResult result;
+
+      float step[3];
+      if (!ComputeRayStep(front, back, step))
+      {
+        return result;
+      }
+
+      uint32_t gridSize[3];
+      float cellScale[3];
+      const bool skipping = skipEmptySpace && GetGridGeometry(gridSize, cellScale);
+
+      float* dst = result.Colour;
+      float previous = 0.f;
+      bool havePrevious = false;
+      for (uint32_t i = 0; i < m_numIterations; ++i)
+      {
+        const float pos[3] = { front[0] + step[0] * i, front[1] + step[1] * i, front[2] + step[2] * i };
+        if (pos[0] > 1.f || pos[1] > 1.f || pos[2] > 1.f)
+        {
+          break;
+        }
+
+        uint32_t leap = 0;
+        bool leapAfterSample = false;
+        if (skipping && FindLeap(pos, step, gridSize, cellScale, leap))
+        {
+          // A segment entering the cell from a sampled one can still be visible, it is composited before leaping
+          if (!havePrevious || m_preIntegrationTable == nullptr)
+          {
+            result.SkippedSteps += std::min(leap + 1, m_numIterations - i);
+            i += leap;
+            havePrevious = false;
+            continue;
+          }
+          leapAfterSample = true;
+        }
+
+        const float value = Sample(pos);
+        result.Samples++;
+
+        float src[4];
+        ShadeSample(value, previous, havePrevious, front, step, i, result, src);
+
+        // Front to back blending of premultiplied colour, in the shader's order of operations
+        const float transmittance = 1.f - dst[3];
+        for (int c = 0; c < 4; ++c)
+        {
+          dst[c] += transmittance * src[c];
+        }
+
+        if (dst[3] >= EARLY_TERMINATION_ALPHA)
+        {
+          break;
+        }
+
+        if (leapAfterSample && leap > 0)
+        {
+          result.SkippedSteps += std::min(leap, m_numIterations - i - 1);
+          i += leap;
+          havePrevious = false;
+        }
+      }
+
+      return result;
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeRayMarcher::RenderStats VolumeRayMarcher::Render(const Camera& camera, bool skipEmptySpace, std::vector<float>& outImage, uint32_t threadCount) const
+    {
+      RenderStats stats;
+      outImage.assign((size_t)camera.Width * camera.Height * 4, 0.f);
+
+      std::vector<float> frontImage;
+      std::vector<float> backImage;
+      std::vector<uint8_t> covered;
+      if (m_image == nullptr || !RasterizePositions(camera, frontImage, backImage, covered))
+      {
+        return stats;
+      }
+
+      // Rows are interleaved across threads so the cost of each thread's share is even
+      if (threadCount == 0)
+      {
+        threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+      }
+      threadCount = std::max(std::min(threadCount, camera.Height), 1u);
+
+      std::vector<RenderStats> threadStats(threadCount);
+      std::vector<std::thread> workers;
+      for (uint32_t i = 1; i < threadCount; ++i)
+      {
+        workers.push_back(std::thread([&, i]()
+        {
+          RenderRows(camera, frontImage, backImage, covered, skipEmptySpace, i, threadCount, outImage, threadStats[i]);
+        }));
+      }
+      RenderRows(camera, frontImage, backImage, covered, skipEmptySpace, 0, threadCount, outImage, threadStats[0]);
+      for (auto& worker : workers)
+      {
+        worker.join();
+      }
+
+      for (auto& threadStat : threadStats)
+      {
+        stats.Rays += threadStat.Rays;
+        stats.Samples += threadStat.Samples;
+        stats.SkippedSteps += threadStat.SkippedSteps;
+      }
+      return stats;
+    }
+
+    //----------------------------------------------------------------------------
+    float VolumeRayMarcher::Sample(const float position[3]) const
+    {
+      float u[3];
+      int64_t base[3];
+      float fraction[3];
+      for (int i = 0; i < 3; ++i)
+      {
+        u[i] = position[i] * m_dimensions[i] - 0.5f;
+        const float floorU = std::floor(u[i]);
+        base[i] = static_cast<int64_t>(floorU);
+        fraction[i] = u[i] - floorU;
+      }
+
+      float corners[8];
+      ReadCorners(base[0], base[1], base[2], corners);
+
+      // Corners 0-3 are the front z slice with x fastest, 4-7 the back slice
+      const Float4Lanes weightXY = Float4Lanes::Set(1.f - fraction[0], fraction[0], 1.f - fraction[0], fraction[0]) *
+                                   Float4Lanes::Set(1.f - fraction[1], 1.f - fraction[1], fraction[1], fraction[1]);
+      const Float4Lanes result = weightXY * Float4Lanes::Set(1.f - fraction[2]) * Float4Lanes::Load(corners) +
+                                 weightXY * Float4Lanes::Set(fraction[2]) * Float4Lanes::Load(corners + 4);
+      return result.Sum();
+    }
+
+    //----------------------------------------------------------------------------
+    float VolumeRayMarcher::LookupOpacity(float inputValue) const
+    {
+      if (m_opacities.empty() || m_maximumInputValue <= 0.f)
+      {
+        return 0.f;
+      }
+      const uint32_t last = static_cast<uint32_t>(m_opacities.size() - 1);
+      const float index = std::min(std::max(inputValue / m_maximumInputValue, 0.f), 1.f) * last;
+      const uint32_t lower = static_cast<uint32_t>(std::floor(index));
+      const uint32_t upper = std::min(lower + 1, last);
+      const float fraction = index - std::floor(index);
+      return m_opacities[lower] + (m_opacities[upper] - m_opacities[lower]) * fraction;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::LookupSegment(float frontValue, float backValue, float outRgba[4]) const
+    {
+      if (m_maximumInputValue <= 0.f)
+      {
+        outRgba[0] = outRgba[1] = outRgba[2] = outRgba[3] = 0.f;
+        return;
+      }
+      m_preIntegrationTable->Lookup(frontValue / m_maximumInputValue, backValue / m_maximumInputValue, outRgba);
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::ShadeSegment(float frontSample, float backSample, float outRgba[4]) const
+    {
+      if (m_preIntegrationTable != nullptr)
+      {
+        LookupSegment(frontSample * m_valueRange, backSample * m_valueRange, outRgba);
+        return;
+      }
+
+      // Without a table the 1D opacity of the back sample is used, coloured by the sample value
+      outRgba[3] = LookupOpacity(backSample * m_valueRange);
+      outRgba[0] = outRgba[1] = outRgba[2] = backSample * outRgba[3];
+    }
+
+    //----------------------------------------------------------------------------
+    float VolumeRayMarcher::ReadVoxel(int64_t x, int64_t y, int64_t z) const
+    {
+      if (x < 0 || y < 0 || z < 0 || x >= m_dimensions[0] || y >= m_dimensions[1] || z >= m_dimensions[2])
+      {
+        // Border address mode, transparent black
+        return 0.f;
+      }
+      const size_t index = ((size_t)z * m_dimensions[1] + (size_t)y) * m_dimensions[0] + (size_t)x;
+      if (m_bytesPerVoxel == 2)
+      {
+        uint16_t value;
+        memcpy(&value, m_image + index * 2, sizeof(value));
+        return value / m_valueRange;
+      }
+      return m_image[index] / m_valueRange;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::ReadCorners(int64_t x, int64_t y, int64_t z, float outCorners[8]) const
+    {
+      if (x < 0 || y < 0 || z < 0 || x + 1 >= m_dimensions[0] || y + 1 >= m_dimensions[1] || z + 1 >= m_dimensions[2])
+      {
+        for (int corner = 0; corner < 8; ++corner)
+        {
+          outCorners[corner] = ReadVoxel(x + (corner & 1), y + ((corner >> 1) & 1), z + ((corner >> 2) & 1));
+        }
+        return;
+      }
+
+      // Fully inside, no border handling needed
+      const size_t rowPitch = m_dimensions[0];
+      const size_t slicePitch = rowPitch * m_dimensions[1];
+      const size_t offsets[8] = { 0, 1, rowPitch, rowPitch + 1, slicePitch, slicePitch + 1, slicePitch + rowPitch, slicePitch + rowPitch + 1 };
+      const size_t index = (size_t)z * slicePitch + (size_t)y * rowPitch + (size_t)x;
+      float raw[8];
+      if (m_bytesPerVoxel == 2)
+      {
+        for (int corner = 0; corner < 8; ++corner)
+        {
+          uint16_t value;
+          memcpy(&value, m_image + (index + offsets[corner]) * 2, sizeof(value));
+          raw[corner] = value;
+        }
+      }
+      else
+      {
+        for (int corner = 0; corner < 8; ++corner)
+        {
+          raw[corner] = m_image[index + offsets[corner]];
+        }
+      }
+
+      // Divides rather than multiplying by a reciprocal, so values match ReadVoxel at the border exactly
+      const Float4Lanes range = Float4Lanes::Set(m_valueRange);
+      (Float4Lanes::Load(raw) / range).Store(outCorners);
+      (Float4Lanes::Load(raw + 4) / range).Store(outCorners + 4);
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeRayMarcher::ComputeRayStep(const float front[3], const float back[3], float outStep[3]) const
+    {
+      float dir[3] = { back[0] - front[0], back[1] - front[1], back[2] - front[2] };
+      const float length = std::sqrt(dir[0] * dir[0] + dir[1] * dir[1] + dir[2] * dir[2]);
+      if (length == 0.f)
+      {
+        // normalize() of a zero vector is NaN in the shader, which never samples
+        return false;
+      }
+      for (int i = 0; i < 3; ++i)
+      {
+        dir[i] /= length;
+        outStep[i] = dir[i] * m_stepSize[i];
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeRayMarcher::GetGridGeometry(uint32_t outGridSize[3], float outCellScale[3]) const
+    {
+      if (m_grid == nullptr)
+      {
+        return false;
+      }
+      m_grid->GetGridSize(outGridSize);
+      for (int i = 0; i < 3; ++i)
+      {
+        outCellScale[i] = static_cast<float>(m_dimensions[i]) / m_grid->GetCellSize();
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeRayMarcher::FindLeap(const float position[3], const float step[3], const uint32_t gridSize[3], const float cellScale[3], uint32_t& outLeap) const
+    {
+      if (position[0] < 0.f || position[1] < 0.f || position[2] < 0.f)
+      {
+        return false;
+      }
+      const uint32_t cell[3] = { (uint32_t)(position[0] * cellScale[0]), (uint32_t)(position[1] * cellScale[1]), (uint32_t)(position[2] * cellScale[2]) };
+      if (cell[0] >= gridSize[0] || cell[1] >= gridSize[1] || cell[2] >= gridSize[2] || !m_grid->IsEmpty(cell[0], cell[1], cell[2]))
+      {
+        return false;
+      }
+
+      // Steps to the last sample inside this cell, the loop increment takes the one out of it
+      float exit = 1e30f;
+      for (int j = 0; j < 3; ++j)
+      {
+        if (step[j] != 0.f)
+        {
+          const float plane = (step[j] > 0.f ? cell[j] + 1.f : static_cast<float>(cell[j])) / cellScale[j];
+          exit = std::min(exit, (plane - position[j]) / step[j]);
+        }
+      }
+      outLeap = static_cast<uint32_t>(std::max(std::floor(exit), 0.f));
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::ShadeSample(float value, float& previous, bool& havePrevious, const float front[3], const float step[3], uint32_t index, RayResult& result, float outSrc[4]) const
+    {
+      if (m_preIntegrationTable != nullptr)
+      {
+        if (!havePrevious)
+        {
+          // The first segment is a point, one leaving a skipped cell starts at the last sample leapt over
+          previous = value;
+          if (index > 0)
+          {
+            const float back[3] = { front[0] + step[0] * (index - 1), front[1] + step[1] * (index - 1), front[2] + step[2] * (index - 1) };
+            previous = Sample(back);
+            result.Samples++;
+          }
+        }
+      }
+      ShadeSegment(previous, value, outSrc);
+      previous = value;
+      havePrevious = true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeRayMarcher::RasterizePositions(const Camera& camera, std::vector<float>& outFront, std::vector<float>& outBack, std::vector<uint8_t>& outCovered) const
+    {
+      double inverse[16];
+      if (camera.Width == 0 || camera.Height == 0 || !InvertMatrix(camera.ModelViewProjection, inverse))
+      {
+        return false;
+      }
+
+      // Targets are cleared to black, a pixel is covered where a front face of the unit cube is rasterized
+      const size_t pixelCount = (size_t)camera.Width * camera.Height;
+      outFront.assign(pixelCount * 3, 0.f);
+      outBack.assign(pixelCount * 3, 0.f);
+      outCovered.assign(pixelCount, 0);
+
+      for (uint32_t y = 0; y < camera.Height; ++y)
+      {
+        for (uint32_t x = 0; x < camera.Width; ++x)
+        {
+          // The ray through the pixel centre from the near plane (t = 0) to the far plane (t = 1)
+          const double ndcX = (x + 0.5) / camera.Width * 2.0 - 1.0;
+          const double ndcY = 1.0 - (y + 0.5) / camera.Height * 2.0;
+          double nearPoint[3];
+          double farPoint[3];
+          Unproject(inverse, ndcX, ndcY, 0.0, nearPoint);
+          Unproject(inverse, ndcX, ndcY, 1.0, farPoint);
+
+          double enter = -1e300;
+          double exit = 1e300;
+          bool hit = true;
+          for (int i = 0; i < 3 && hit; ++i)
+          {
+            const double direction = farPoint[i] - nearPoint[i];
+            if (std::abs(direction) < 1e-15)
+            {
+              hit = nearPoint[i] >= 0.0 && nearPoint[i] <= 1.0;
+              continue;
+            }
+            double t0 = (0.0 - nearPoint[i]) / direction;
+            double t1 = (1.0 - nearPoint[i]) / direction;
+            if (t0 > t1)
+            {
+              std::swap(t0, t1);
+            }
+            enter = std::max(enter, t0);
+            exit = std::min(exit, t1);
+          }
+          if (!hit || enter > exit)
+          {
+            continue;
+          }
+
+          // Faces outside the clip volume are not rasterized
+          const size_t pixel = (size_t)y * camera.Width + x;
+          if (enter >= 0.0 && enter <= 1.0)
+          {
+            const double point[3] = { nearPoint[0] + (farPoint[0] - nearPoint[0]) * enter, nearPoint[1] + (farPoint[1] - nearPoint[1]) * enter, nearPoint[2] + (farPoint[2] - nearPoint[2]) * enter };
+            WritePosition(point, m_positionBits, &outFront[pixel * 3]);
+            outCovered[pixel] = 1;
+          }
+          if (exit >= 0.0 && exit <= 1.0)
+          {
+            const double point[3] = { nearPoint[0] + (farPoint[0] - nearPoint[0]) * exit, nearPoint[1] + (farPoint[1] - nearPoint[1]) * exit, nearPoint[2] + (farPoint[2] - nearPoint[2]) * exit };
+            WritePosition(point, m_positionBits, &outBack[pixel * 3]);
+          }
+        }
+      }
+
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRayMarcher::RenderRows(const Camera& camera, const std::vector<float>& frontImage, const std::vector<float>& backImage, const std::vector<uint8_t>& covered,
+                                      bool skipEmptySpace, uint32_t firstRow, uint32_t rowStride, std::vector<float>& outImage, RenderStats& outStats) const
+    {
+      for (uint32_t y = firstRow; y < camera.Height; y += rowStride)
+      {
+        for (uint32_t x = 0; x < camera.Width; ++x)
+        {
+          const size_t pixel = (size_t)y * camera.Width + x;
+          if (!covered[pixel])
+          {
+            continue;
+          }
+
+          float front[3];
+          float back[3];
+          ReadPosition(frontImage, camera.Width, camera.Height, x, y, front);
+          ReadPosition(backImage, camera.Width, camera.Height, x, y, back);
+          const RayResult result = March(front, back, skipEmptySpace);
+
+          // The shader outputs grey, red copied to green and blue
+          float* output = &outImage[pixel * 4];
+          output[0] = output[1] = output[2] = result.Colour[0];
+          output[3] = result.Colour[3];
+          outStats.Rays++;
+          outStats.Samples += result.Samples;
+          outStats.SkippedSteps += result.SkippedSteps;
+        }
+      }
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Rendering
+  {
+    class MacrocellGrid;
+    class PreIntegrationTable;
+
+    // CPU reference for VolumeRenderer and VolumeRendererPS.hlsl, used to check shader changes against known images and
+    // to profile step size, skipping and termination strategies off device
+    // Follows the shader step for step: positions are front + i * step in texture space, samples are trilinear with a
+    // zero border, colour and opacity come from the pre-integrated table (or the 1D opacity table when none is set)
+    // and compositing is front to back with early termination. Render reproduces the position passes as well.
+    class VolumeRayMarcher
+    {
+    public:
+      struct RayResult
+      {
+        float     Colour[4] = { 0.f, 0.f, 0.f, 0.f };
+        uint32_t  Samples = 0;        // Volume samples taken
+        uint32_t  SkippedSteps = 0;   // Steps leapt over in empty cells
+      };
+
+      struct Camera
+      {
+        float     ModelViewProjection[16];  // Row-major with column vectors, from the unit cube to D3D clip space
+        uint32_t  Width = 0;
+        uint32_t  Height = 0;
+      };
+
+      struct RenderStats
+      {
+        uint64_t  Rays = 0;
+        uint64_t  Samples = 0;
+        uint64_t  SkippedSteps = 0;
+      };
+
+    public:
+      VolumeRayMarcher();
+
+      /// bytesPerVoxel of 1 or 2, unsigned normalized
+      void SetVolume(const uint8_t* image, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel);
+      void SetOpacityTable(const std::vector<float>& opacities, float maximumInputValue);
+      void SetStep(const float stepSize[3], uint32_t numIterations);
+      void GetStep(float outStepSize[3], uint32_t& outNumIterations) const;
+      void SetMacrocellGrid(const MacrocellGrid* grid);
+      void SetPreIntegrationTable(const PreIntegrationTable* table);
+
+      /// Bits per channel of the position render targets, 0 keeps full precision
+      void SetPositionBits(uint32_t bits);
+
+      /// Step size and iteration count as Volume computes them for a volume of these dimensions
+      static void ComputeStep(const uint32_t dimensions[3], float stepScale, float outStepSize[3], uint32_t& outNumIterations);
+
+      /// front and back are texture space entry and exit points, as read from the position textures
+      RayResult March(const float front[3], const float back[3], bool skipEmptySpace) const;
+
+      /// Render the volume to width * height RGBA floats, threadCount of 0 uses every hardware thread
+      RenderStats Render(const Camera& camera, bool skipEmptySpace, std::vector<float>& outImage, uint32_t threadCount = 0) const;
+
+      float Sample(const float position[3]) const;
+      float LookupOpacity(float inputValue) const;
+      void LookupSegment(float frontValue, float backValue, float outRgba[4]) const;
+      /// Premultiplied colour and opacity of one step between two normalized samples, as the shader shades it
+      void ShadeSegment(float frontSample, float backSample, float outRgba[4]) const;
+
+    protected:
+      float ReadVoxel(int64_t x, int64_t y, int64_t z) const;
+      void ReadCorners(int64_t x, int64_t y, int64_t z, float outCorners[8]) const;  // The 2x2x2 block a trilinear sample reads
+      bool ComputeRayStep(const float front[3], const float back[3], float outStep[3]) const;
+      bool GetGridGeometry(uint32_t outGridSize[3], float outCellScale[3]) const;
+      bool FindLeap(const float position[3], const float step[3], const uint32_t gridSize[3], const float cellScale[3], uint32_t& outLeap) const;
+      void ShadeSample(float value, float& previous, bool& havePrevious, const float front[3], const float step[3], uint32_t index, RayResult& result, float outSrc[4]) const;
+      bool RasterizePositions(const Camera& camera, std::vector<float>& outFront, std::vector<float>& outBack, std::vector<uint8_t>& outCovered) const;
+      void RenderRows(const Camera& camera, const std::vector<float>& frontImage, const std::vector<float>& backImage, const std::vector<uint8_t>& covered,
+                      bool skipEmptySpace, uint32_t firstRow, uint32_t rowStride, std::vector<float>& outImage, RenderStats& outStats) const;
+
+    protected:
+      static const float           EARLY_TERMINATION_ALPHA;
+
+      const uint8_t*               m_image = nullptr;
+      uint32_t                     m_dimensions[3] = { 0, 0, 0 };
+      uint32_t                     m_bytesPerVoxel = 1;
+      float                        m_valueRange = 255.f;
+
+      std::vector<float>           m_opacities;
+      float                        m_maximumInputValue = 1.f;
+
+      float                        m_stepSize[3] = { 0.f, 0.f, 0.f };
+      uint32_t                     m_numIterations = 0;
+      uint32_t                     m_positionBits = 8;  // VolumeRenderer's position targets are R8G8B8A8_UNORM
+
+      const MacrocellGrid*         m_grid = nullptr;
+      const PreIntegrationTable*   m_preIntegrationTable = nullptr;
+    };
+  }
+}
\ No newline at end of file
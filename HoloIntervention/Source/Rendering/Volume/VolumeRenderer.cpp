@@ -59,6 +59,11 @@ namespace HoloIntervention
 {
   namespace Rendering
   {
+    // Frames in flight before a timestamp is read back, reading sooner would stall on the GPU
+    const uint32 VolumeRenderer::TIMING_QUERY_COUNT = 4;
+    // Texture slots in MultiVolumePS.hlsl
+    const uint32 VolumeRenderer::MAXIMUM_MULTI_VOLUMES = 4;
+
     //----------------------------------------------------------------------------
     VolumeRenderer::VolumeRenderer(const std::shared_ptr<DX::DeviceResources>& deviceResources, DX::StepTimer& timer)
       : m_deviceResources(deviceResources)
@@ -297,8 +302,21 @@ namespace HoloIntervention
         m_deviceResources->GetD3DDeviceContext()->UpdateSubresource(m_volumeRendererConstantBuffer.Get(), 0, nullptr, &m_constantBuffer, 0, 0);
       }
 
+      // Mip level from each volume's projected voxel size, biased coarser once the quality controller runs out of step levels
+      float3 cameraPosition(0.f, 0.f, 0.f);
+      float focalLengthPixels(0.f);
+      if (m_cameraResources != nullptr)
+      {
+        const DX::ViewProjectionConstantBuffer buffer = m_cameraResources->GetLatestViewProjectionBuffer();
+        cameraPosition = float3(buffer.cameraPosition[0].x, buffer.cameraPosition[0].y, buffer.cameraPosition[0].z);
+        focalLengthPixels = buffer.projection[0]._22 * m_cameraResources->GetRenderTargetSize().Height * 0.5f;
+      }
+
+      const VolumeQualityController::Quality& quality = m_qualityController.GetQuality();
       for (auto& volEntry : m_volumes)
       {
+        volEntry->SetStepScale(quality.StepScale);
+        volEntry->UpdateLevelOfDetail(cameraPosition, focalLengthPixels, quality.LevelOfDetailBias);
         volEntry->Update();
       }
     }
@@ -328,13 +346,77 @@ namespace HoloIntervention
         m_cameraResources->GetLatestSpatialBoundingFrustum(frustum);
       }
 
+      // Time the volume passes on the GPU, results are read back a few frames later so nothing waits on them
+      ReadTimingQueries();
+      TimingQuery* timing = nullptr;
+      if (!m_timingQueries.empty() && !m_timingQueries[m_nextTimingQuery].Pending)
+      {
+        timing = &m_timingQueries[m_nextTimingQuery];
+        context->Begin(timing->Disjoint.Get());
+        context->End(timing->Begin.Get());
+      }
+
+      std::vector<std::shared_ptr<Volume>> visibleVolumes;
       for (auto& volEntry : m_volumes)
       {
         if (volEntry->IsInFrustum(frustum))
         {
-          volEntry->Render(m_indexCount);
+          visibleVolumes.push_back(volEntry);
         }
       }
+
+      bool drew = false;
+      if (m_multiVolumeMode && visibleVolumes.size() > 1)
+      {
+        std::vector<std::shared_ptr<Volume>> remainingVolumes;
+        if (RenderMultiVolume(visibleVolumes, remainingVolumes))
+        {
+          drew = true;
+          visibleVolumes.swap(remainingVolumes);
+        }
+      }
+
+      for (auto& volEntry : visibleVolumes)
+      {
+        drew = volEntry->Render(m_indexCount) || drew;
+      }
+
+      if (timing != nullptr)
+      {
+        context->End(timing->End.Get());
+        context->End(timing->Disjoint.Get());
+        timing->Pending = true;
+        timing->Drew = drew;
+        m_nextTimingQuery = (m_nextTimingQuery + 1) % m_timingQueries.size();
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeRenderer::SetQualitySettings(const VolumeQualityController::Settings& settings)
+    {
+      if (settings.MinimumResolutionScale < 1.f)
+      {
+        return false;
+      }
+      return m_qualityController.SetSettings(settings);
+    }
+
+    //----------------------------------------------------------------------------
+    VolumeQualityController::Quality VolumeRenderer::GetQuality() const
+    {
+      return m_qualityController.GetQuality();
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRenderer::SetMultiVolumeMode(bool enabled)
+    {
+      m_multiVolumeMode = enabled;
+    }
+
+    //----------------------------------------------------------------------------
+    bool VolumeRenderer::GetMultiVolumeMode() const
+    {
+      return m_multiVolumeMode;
     }
 
     //----------------------------------------------------------------------------
@@ -346,6 +428,7 @@ namespace HoloIntervention
       m_usingVprtShaders = m_deviceResources->GetDeviceSupportsVprt();
 
       CreateVertexResources();
+      CreateTimingQueries();
 
       VolumeEntryConstantBuffer buffer;
       XMStoreFloat4x4(&buffer.worldMatrix, XMMatrixIdentity());
@@ -356,6 +439,19 @@ namespace HoloIntervention
 
       DX::ThrowIfFailed(m_deviceResources->GetD3DDevice()->CreateBuffer(&CD3D11_BUFFER_DESC(sizeof(VolumeRendererConstantBuffer), D3D11_BIND_CONSTANT_BUFFER), &resData, &m_volumeRendererConstantBuffer));
 
+      // Joint pass over overlapping volumes, samplers match the ones each volume uses on its own
+      DX::ThrowIfFailed(device->CreateBuffer(&CD3D11_BUFFER_DESC(sizeof(MultiVolumeConstantBuffer), D3D11_BIND_CONSTANT_BUFFER), nullptr, &m_multiVolumeConstantBuffer));
+      float borderColour[4] = { 0.f, 0.f, 0.f, 0.f };
+      CD3D11_SAMPLER_DESC volumeSamplerDesc(D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_TEXTURE_ADDRESS_BORDER, D3D11_TEXTURE_ADDRESS_BORDER, D3D11_TEXTURE_ADDRESS_BORDER, 0.f, 3, D3D11_COMPARISON_NEVER, borderColour, 0, 3);
+      DX::ThrowIfFailed(device->CreateSamplerState(&volumeSamplerDesc, m_multiVolumeSamplerState.GetAddressOf()));
+      CD3D11_SAMPLER_DESC tableSamplerDesc(D3D11_FILTER_MIN_MAG_MIP_LINEAR, D3D11_TEXTURE_ADDRESS_CLAMP, D3D11_TEXTURE_ADDRESS_CLAMP, D3D11_TEXTURE_ADDRESS_CLAMP, 0.f, 1, D3D11_COMPARISON_NEVER, nullptr, 0, 0);
+      DX::ThrowIfFailed(device->CreateSamplerState(&tableSamplerDesc, m_multiVolumeTableSamplerState.GetAddressOf()));
+#if _DEBUG
+      m_multiVolumeConstantBuffer->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("MultiVolumeConstantBuffer") - 1, "MultiVolumeConstantBuffer");
+      m_multiVolumeSamplerState->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("MultiVolumeSamplerState") - 1, "MultiVolumeSamplerState");
+      m_multiVolumeTableSamplerState->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("MultiVolumeTableSamplerState") - 1, "MultiVolumeTableSamplerState");
+#endif
+
       task<std::vector<byte>> loadVSTask = DX::ReadDataAsync(m_usingVprtShaders ? L"ms-appx:///VolumeRendererVprtVS.cso" : L"ms-appx:///VolumeRendererVS.cso");
       task<std::vector<byte>> loadPSTask = DX::ReadDataAsync(L"ms-appx:///VolumeRendererPS.cso");
       task<std::vector<byte>> loadGSTask;
@@ -365,6 +461,7 @@ namespace HoloIntervention
       }
 
       task<std::vector<byte>> loadFacePSTask = DX::ReadDataAsync(L"ms-appx:///FaceAnalysisPS.cso");
+      task<std::vector<byte>> loadMultiVolumePSTask = DX::ReadDataAsync(L"ms-appx:///MultiVolumePS.cso");
       task<void> createVSTask = loadVSTask.then([this, device](const std::vector<byte>& fileData)
       {
         DX::ThrowIfFailed(device->CreateVertexShader(fileData.data(), fileData.size(), nullptr, &m_volRenderVertexShader));
@@ -393,6 +490,14 @@ namespace HoloIntervention
 #endif
       });
 
+      task<void> createMultiVolumePSTask = loadMultiVolumePSTask.then([this, device](const std::vector<byte>& fileData)
+      {
+        DX::ThrowIfFailed(device->CreatePixelShader(fileData.data(), fileData.size(), nullptr, &m_multiVolumePixelShader));
+#if _DEBUG
+        m_multiVolumePixelShader->SetPrivateData(WKPDID_D3DDebugObjectName, sizeof("MultiVolumePixelShader") - 1, "MultiVolumePixelShader");
+#endif
+      });
+
       task<void> createGSTask;
       task<void> createFaceGSTask;
       if (!m_usingVprtShaders)
@@ -406,8 +511,8 @@ namespace HoloIntervention
 
       // Once all shaders are loaded, create the mesh.
       task<void> shaderTaskGroup = m_usingVprtShaders
-                                   ? (createPSTask && createVSTask && createFacePSTask)
-                                   : (createPSTask && createVSTask && createGSTask && createFacePSTask);
+                                   ? (createPSTask && createVSTask && createFacePSTask && createMultiVolumePSTask)
+                                   : (createPSTask && createVSTask && createGSTask && createFacePSTask && createMultiVolumePSTask);
 
       for (auto& volEntry : m_volumes)
       {
@@ -430,6 +535,12 @@ namespace HoloIntervention
 
       ReleaseVertexResources();
       ReleaseCameraResources();
+      ReleaseTimingQueries();
+
+      m_multiVolumePixelShader.Reset();
+      m_multiVolumeConstantBuffer.Reset();
+      m_multiVolumeSamplerState.Reset();
+      m_multiVolumeTableSamplerState.Reset();
     }
 
     //----------------------------------------------------------------------------
@@ -494,6 +605,66 @@ namespace HoloIntervention
       m_backPositionSRV.Reset();
     }
 
+    //----------------------------------------------------------------------------
+    void VolumeRenderer::CreateTimingQueries()
+    {
+      const auto device = m_deviceResources->GetD3DDevice();
+
+      m_timingQueries.resize(TIMING_QUERY_COUNT);
+      for (auto& query : m_timingQueries)
+      {
+        DX::ThrowIfFailed(device->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP_DISJOINT), query.Disjoint.GetAddressOf()));
+        DX::ThrowIfFailed(device->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP), query.Begin.GetAddressOf()));
+        DX::ThrowIfFailed(device->CreateQuery(&CD3D11_QUERY_DESC(D3D11_QUERY_TIMESTAMP), query.End.GetAddressOf()));
+        query.Pending = false;
+      }
+      m_nextTimingQuery = 0;
+
+      // Costs measured on the old device say nothing about the new one
+      m_qualityController.Reset();
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRenderer::ReleaseTimingQueries()
+    {
+      m_timingQueries.clear();
+      m_nextTimingQuery = 0;
+    }
+
+    //----------------------------------------------------------------------------
+    void VolumeRenderer::ReadTimingQueries()
+    {
+      ID3D11DeviceContext3* context = m_deviceResources->GetD3DDeviceContext();
+
+      // Oldest first, the first query not yet done means the later ones are not either
+      for (uint32 i = 0; i < m_timingQueries.size(); ++i)
+      {
+        TimingQuery& query = m_timingQueries[(m_nextTimingQuery + i) % m_timingQueries.size()];
+        if (!query.Pending)
+        {
+          continue;
+        }
+
+        D3D11_QUERY_DATA_TIMESTAMP_DISJOINT disjoint;
+        UINT64 begin(0);
+        UINT64 end(0);
+        if (context->GetData(query.Disjoint.Get(), &disjoint, sizeof(disjoint), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+            context->GetData(query.Begin.Get(), &begin, sizeof(begin), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK ||
+            context->GetData(query.End.Get(), &end, sizeof(end), D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+        {
+          break;
+        }
+        query.Pending = false;
+
+        // Frames with nothing drawn would pull quality up without telling anything about the cost of a volume
+        if (!query.Drew || disjoint.Disjoint || disjoint.Frequency == 0 || end < begin)
+        {
+          continue;
+        }
+        m_qualityController.AddMeasurement(static_cast<float>(static_cast<double>(end - begin) * 1000.0 / disjoint.Frequency));
+      }
+    }
+
     //----------------------------------------------------------------------------
     bool VolumeRenderer::FindVolume(uint64 volumeToken, std::shared_ptr<Volume>& volumeEntry) const
     {
@@ -509,6 +680,114 @@ namespace HoloIntervention
       return false;
     }
 
+    //----------------------------------------------------------------------------
+    bool VolumeRenderer::RenderMultiVolume(const std::vector<std::shared_ptr<Volume>>& volumes, std::vector<std::shared_ptr<Volume>>& outRemaining)
+    {
+      outRemaining.clear();
+      if (m_multiVolumePixelShader == nullptr || m_cameraResources == nullptr)
+      {
+        outRemaining = volumes;
+        return false;
+      }
+
+      // Volume textures in t0 to t3, their pre-integration tables in t4 to t7
+      ID3D11ShaderResourceView* shaderResourceViews[2 * MAXIMUM_MULTI_VOLUMES] = {};
+      uint32 volumeCount(0);
+      uint32 maximumSteps(0);
+      float3 boundsMinimum(FLT_MAX, FLT_MAX, FLT_MAX);
+      float3 boundsMaximum(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+      for (auto& volEntry : volumes)
+      {
+        MultiVolumeEntry entry;
+        ID3D11ShaderResourceView* volumeSRV(nullptr);
+        ID3D11ShaderResourceView* tableSRV(nullptr);
+        if (volumeCount == MAXIMUM_MULTI_VOLUMES || !volEntry->GetMultiVolumeEntry(entry, volumeSRV, tableSRV))
+        {
+          outRemaining.push_back(volEntry);
+          continue;
+        }
+
+        m_multiVolumeConstants.volumes[volumeCount] = entry;
+        shaderResourceViews[volumeCount] = volumeSRV;
+        shaderResourceViews[MAXIMUM_MULTI_VOLUMES + volumeCount] = tableSRV;
+        maximumSteps += 2 * entry.numIterations;
+
+        // World bounds of the volume's unit cube
+        const float4x4 pose = volEntry->GetCurrentPose();
+        for (uint32 corner = 0; corner < 8; ++corner)
+        {
+          const float3 point = transform(float3((corner & 1) ? 1.f : 0.f, (corner & 2) ? 1.f : 0.f, (corner & 4) ? 1.f : 0.f), pose);
+          boundsMinimum = float3(std::min(boundsMinimum.x, point.x), std::min(boundsMinimum.y, point.y), std::min(boundsMinimum.z, point.z));
+          boundsMaximum = float3(std::max(boundsMaximum.x, point.x), std::max(boundsMaximum.y, point.y), std::max(boundsMaximum.z, point.z));
+        }
+        volumeCount++;
+      }
+
+      if (volumeCount < 2)
+      {
+        // Nothing overlaps, the usual pass is as good
+        outRemaining = volumes;
+        return false;
+      }
+
+      // Pad the box so faces never sit exactly on a volume's own faces
+      const float3 padding = (boundsMaximum - boundsMinimum) * 0.01f + float3(0.001f, 0.001f, 0.001f);
+      boundsMinimum -= padding;
+      boundsMaximum += padding;
+      const float4x4 boundsPose = make_float4x4_scale(boundsMaximum - boundsMinimum) * make_float4x4_translation(boundsMinimum);
+      XMStoreFloat4x4(&m_multiVolumeConstants.boundsPose, XMLoadFloat4x4(&boundsPose));
+      m_multiVolumeConstants.boundsMinimum = XMFLOAT4(boundsMinimum.x, boundsMinimum.y, boundsMinimum.z, 1.f);
+      m_multiVolumeConstants.boundsMaximum = XMFLOAT4(boundsMaximum.x, boundsMaximum.y, boundsMaximum.z, 1.f);
+
+      // Back faces while either eye is inside the box, or near enough that the front faces would be clipped by the near plane
+      const DX::ViewProjectionConstantBuffer buffer = m_cameraResources->GetLatestViewProjectionBuffer();
+      const float nearMargin = 0.1f;
+      bool eyeInside(false);
+      for (uint32 eye = 0; eye < 2; ++eye)
+      {
+        m_multiVolumeConstants.cameraPosition[eye] = buffer.cameraPosition[eye];
+        const float3 position(buffer.cameraPosition[eye].x, buffer.cameraPosition[eye].y, buffer.cameraPosition[eye].z);
+        const float3 lower = boundsMinimum - float3(nearMargin, nearMargin, nearMargin);
+        const float3 upper = boundsMaximum + float3(nearMargin, nearMargin, nearMargin);
+        eyeInside = eyeInside || (position.x >= lower.x && position.y >= lower.y && position.z >= lower.z && position.x <= upper.x && position.y <= upper.y && position.z <= upper.z);
+      }
+
+      m_multiVolumeConstants.volumeCount = volumeCount;
+      m_multiVolumeConstants.maximumSteps = maximumSteps;
+
+      ID3D11DeviceContext3* context = m_deviceResources->GetD3DDeviceContext();
+      context->UpdateSubresource(m_multiVolumeConstantBuffer.Get(), 0, nullptr, &m_multiVolumeConstants, 0, 0);
+
+      const UINT stride = sizeof(VertexPosition);
+      const UINT offset = 0;
+      context->IASetVertexBuffers(0, 1, m_vertexBuffer.GetAddressOf(), &stride, &offset);
+      context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+      context->IASetInputLayout(m_inputLayout.Get());
+      context->IASetIndexBuffer(eyeInside ? m_ccwIndexBuffer.Get() : m_cwIndexBuffer.Get(), DXGI_FORMAT_R16_UINT, 0);
+      context->RSSetState(nullptr);
+
+      context->VSSetShader(m_volRenderVertexShader.Get(), nullptr, 0);
+      context->VSSetConstantBuffers(0, 1, m_multiVolumeConstantBuffer.GetAddressOf());
+      if (!m_usingVprtShaders)
+      {
+        context->GSSetShader(m_volRenderGeometryShader.Get(), nullptr, 0);
+        context->GSSetConstantBuffers(0, 1, m_multiVolumeConstantBuffer.GetAddressOf());
+      }
+      context->PSSetShaderResources(0, 2 * MAXIMUM_MULTI_VOLUMES, shaderResourceViews);
+      ID3D11SamplerState* samplerStates[2] = { m_multiVolumeSamplerState.Get(), m_multiVolumeTableSamplerState.Get() };
+      context->PSSetSamplers(0, 2, samplerStates);
+      context->PSSetConstantBuffers(0, 1, m_multiVolumeConstantBuffer.GetAddressOf());
+      context->PSSetShader(m_multiVolumePixelShader.Get(), nullptr, 0);
+      context->DrawIndexedInstanced(m_indexCount, 2, 0, 0, 0);
+
+      // Clear values
+      ID3D11ShaderResourceView* ppSRVnullptr[2 * MAXIMUM_MULTI_VOLUMES] = {};
+      context->PSSetShaderResources(0, 2 * MAXIMUM_MULTI_VOLUMES, ppSRVnullptr);
+      ID3D11SamplerState* ppSamplerStatesnullptr[2] = { nullptr, nullptr };
+      context->PSSetSamplers(0, 2, ppSamplerStatesnullptr);
+      return true;
+    }
+
     //----------------------------------------------------------------------------
     void VolumeRenderer::CreateVertexResources()
     {
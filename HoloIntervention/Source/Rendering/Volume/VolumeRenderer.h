@@ -26,6 +26,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 // Local includes
 #include "IEngineComponent.h"
 #include "Volume.h"
+#include "VolumeQualityController.h"
 
 // WinRt includes
 #include <ppltasks.h>
@@ -47,6 +48,20 @@ namespace HoloIntervention
     };
     static_assert((sizeof(VolumeRendererConstantBuffer) % (sizeof(float) * 4)) == 0, "Volume constant buffer size must be 16-byte aligned (16 bytes is the length of four floats).");
 
+    // Laid out as MultiVolumeConstantBuffer in MultiVolumePS.hlsl, boundsPose is first so the vertex shader reads it as its world pose
+    struct MultiVolumeConstantBuffer
+    {
+      DirectX::XMFLOAT4X4 boundsPose;
+      DirectX::XMFLOAT4   cameraPosition[2];
+      DirectX::XMFLOAT4   boundsMinimum;
+      DirectX::XMFLOAT4   boundsMaximum;
+      MultiVolumeEntry    volumes[4];
+      uint32              volumeCount;
+      uint32              maximumSteps;
+      DirectX::XMFLOAT2   padding;
+    };
+    static_assert((sizeof(MultiVolumeConstantBuffer) % (sizeof(float) * 4)) == 0, "Multi-volume constant buffer size must be 16-byte aligned (16 bytes is the length of four floats).");
+
     class VolumeRenderer : public IEngineComponent
     {
       typedef std::list<std::shared_ptr<Volume>> VolumeList;
@@ -72,6 +87,16 @@ namespace HoloIntervention
       void SetDesiredVolumePose(uint64 volumeToken, const Windows::Foundation::Numerics::float4x4& pose);
       Windows::Foundation::Numerics::float3 GetVolumeVelocity(uint64 volumeToken) const;
 
+      /// Frame budget for the volume passes, the step scale of every volume follows it
+      /// The volumes draw straight into the camera's target, so settings that would lower the resolution are refused
+      bool SetQualitySettings(const VolumeQualityController::Settings& settings);
+      VolumeQualityController::Quality GetQuality() const;
+
+      /// Draw overlapping volumes in one pass that marches every volume a ray crosses together, in depth order
+      /// Up to 4 volumes are drawn this way, any more are drawn on their own as before
+      void SetMultiVolumeMode(bool enabled);
+      bool GetMultiVolumeMode() const;
+
       void Update(const DX::CameraResources* cameraResources, Windows::Perception::Spatial::SpatialCoordinateSystem^ coordSystem, Windows::UI::Input::Spatial::SpatialPointerPose^ headPose);
       void Render();
 
@@ -81,12 +106,27 @@ namespace HoloIntervention
 
     protected:
       bool FindVolume(uint64 volumeToken, std::shared_ptr<Volume>& volumeEntry) const;
+      /// Draws the listed volumes in one joint pass, returns false if fewer than two were ready to draw
+      bool RenderMultiVolume(const std::vector<std::shared_ptr<Volume>>& volumes, std::vector<std::shared_ptr<Volume>>& outRemaining);
 
     protected:
       void CreateVertexResources();
       void ReleaseVertexResources();
       void CreateCameraResources();
       void ReleaseCameraResources();
+      void CreateTimingQueries();
+      void ReleaseTimingQueries();
+      void ReadTimingQueries();
+
+    protected:
+      struct TimingQuery
+      {
+        Microsoft::WRL::ComPtr<ID3D11Query>             Disjoint;
+        Microsoft::WRL::ComPtr<ID3D11Query>             Begin;
+        Microsoft::WRL::ComPtr<ID3D11Query>             End;
+        bool                                            Pending = false;
+        bool                                            Drew = false;
+      };
 
     protected:
       // Cached pointer to device and camera resources.
@@ -115,6 +155,14 @@ namespace HoloIntervention
       // D3D resources for left and right eye position calculation
       Microsoft::WRL::ComPtr<ID3D11PixelShader>         m_faceCalcPixelShader;
 
+      // D3D resources for the joint multi-volume pass
+      Microsoft::WRL::ComPtr<ID3D11PixelShader>         m_multiVolumePixelShader;
+      Microsoft::WRL::ComPtr<ID3D11Buffer>              m_multiVolumeConstantBuffer;
+      Microsoft::WRL::ComPtr<ID3D11SamplerState>        m_multiVolumeSamplerState;
+      Microsoft::WRL::ComPtr<ID3D11SamplerState>        m_multiVolumeTableSamplerState;
+      MultiVolumeConstantBuffer                         m_multiVolumeConstants;
+      std::atomic_bool                                  m_multiVolumeMode = false;
+
       VolumeRendererConstantBuffer                      m_constantBuffer;
       std::atomic_bool                                  m_verticesReady = false;
       std::atomic_bool                                  m_cameraResourcesReady = false;
@@ -123,6 +171,14 @@ namespace HoloIntervention
       VolumeList                                        m_volumes;
       uint64                                            m_nextUnusedVolumeToken = INVALID_TOKEN + 1;
       std::atomic_bool                                  m_usingVprtShaders = false;
+
+      // Adaptive quality, fed by GPU timestamps of the volume passes
+      VolumeQualityController                           m_qualityController;
+      std::vector<TimingQuery>                          m_timingQueries;
+      uint32                                            m_nextTimingQuery = 0;
+
+      static const uint32                               TIMING_QUERY_COUNT;
+      static const uint32                               MAXIMUM_MULTI_VOLUMES;
     };
   }
 }
\ No newline at end of file
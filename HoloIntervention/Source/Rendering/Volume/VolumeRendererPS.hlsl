@@ -26,9 +26,22 @@ cbuffer VolumeConstantBuffer : register(b0)
   float4x4  c_worldPose           : packoffset(c0);
   float3    c_stepSize            : packoffset(c4);
   float     c_tfMaximumXValue     : packoffset(c4.w);
-  float2    c_viewportDimensions  : packoffset(c5);
-  uint      c_tfArraySize         : packoffset(c5.z);
-  uint      c_numIterations       : packoffset(c5.w);
+  uint      c_tfArraySize         : packoffset(c5.x);
+  uint      c_numIterations       : packoffset(c5.y);
+  float     c_voxelValueRange     : packoffset(c5.z);
+  uint      c_skipEmptySpace      : packoffset(c5.w);
+  float3    c_macrocellScale      : packoffset(c6);
+  float     c_levelOfDetail       : packoffset(c6.w);
+  uint3     c_macrocellCount      : packoffset(c7);
+  uint      c_gradientEnabled     : packoffset(c8.x);
+  float     c_gradientOpacityWeight : packoffset(c8.y);
+  float     c_gradientOpacityGain : packoffset(c8.z);
+  float     c_shadingAmbient      : packoffset(c8.w);
+};
+
+cbuffer VolumeRendererConstantBuffer : register(b2)
+{
+  float4    c_viewportDimensions;
 };
 
 struct PixelShaderInput
@@ -38,59 +51,119 @@ struct PixelShaderInput
   uint        rtvId                 : SV_RenderTargetArrayIndex;
 };
 
-struct LookupTableBufferType
-{
-  float4 lookupValue;
-};
-StructuredBuffer<LookupTableBufferType> r_opacityLookupTable      : register(t0);
+Texture2D<float4>                       r_preIntegrationTable     : register(t0);
 Texture3D                               r_volumeTexture           : register(t1);
 Texture2DArray                          r_frontPositionTextures   : register(t2);
 Texture2DArray                          r_backPositionTextures    : register(t3);
+Texture3D<uint>                         r_occupancyTexture        : register(t4);
+Texture3D<float4>                       r_gradientTexture         : register(t5);
 SamplerState                            r_sampler                 : s0;
+SamplerState                            r_tableSampler            : s1;
+
+// Premultiplied colour and opacity of one step whose samples go from frontValue to backValue
+float4 LookupSegment(float frontValue, float backValue)
+{
+  // Entry i of the table is at value i / (size - 1) * maximum, texel centres are at (i + 0.5) / size
+  float2 index = saturate(float2(backValue, frontValue) / c_tfMaximumXValue) * (c_tfArraySize - 1);
+  return r_preIntegrationTable.SampleLevel(r_tableSampler, (index + 0.5f) / c_tfArraySize, 0.f);
+}
+
+// Headlight shading and gradient magnitude opacity for a segment, from the precomputed gradient at its back sample
+float4 ApplyGradient(float4 src, float3 pos, float3 dir)
+{
+  // xyz is the unit normal mapped to [0, 1], w the square root of the magnitude over its largest value
+  float4 packed = r_gradientTexture.SampleLevel(r_sampler, pos, 0.f);
+  float3 normal = packed.xyz * 2.f - 1.f;
+  float normalLength = length(normal);
+
+  // Filtering shortens normals where they disagree, a near zero one has no direction to light
+  float diffuse = normalLength > 0.1f ? abs(dot(normal / normalLength, dir)) : 1.f;
+  src.rgb *= c_shadingAmbient + (1.f - c_shadingAmbient) * diffuse;
+
+  // Premultiplied, so colour scales with opacity
+  src *= lerp(1.f, saturate(packed.w * packed.w * c_gradientOpacityGain), c_gradientOpacityWeight);
+  return src;
+}
 
 float4 main(PixelShaderInput input) : SV_TARGET
 {
-  float3 pixelPosition = float3((input.Position.xy - float2(0.5f, 0.5f)) / c_viewportDimensions, input.rtvId);
+  float3 pixelPosition = float3((input.Position.xy - float2(0.5f, 0.5f)) / c_viewportDimensions.xy, input.rtvId);
   float3 front = r_frontPositionTextures.SampleLevel(r_sampler, pixelPosition, 0.f).xyz;
   float3 back = r_backPositionTextures.SampleLevel(r_sampler, pixelPosition, 0.f).xyz;
-    
+
   float3 dir = normalize(back - front);
-  float3 pos = front;
   float4 dst = float4(0, 0, 0, 0);
-  float4 src;
-	float3 step = dir * c_stepSize.xyz;
-    
+  float3 step = dir * c_stepSize.xyz;
+  float previous = 0.f;
+  bool havePrevious = false;
+
   [loop]
   for (uint i = 0; i < c_numIterations; i++)
   {
+    // Positions are computed rather than accumulated so a leap lands on the same samples as a full march
+    float3 pos = front + step * i;
+
     // Break if the position is greater than <1, 1, 1>
     if(pos.x > 1.0f || pos.y > 1.0f || pos.z > 1.0f)
     {
       break;
     }
 
-    src = r_volumeTexture.SampleLevel(r_sampler, pos, 0.f);
-    //src = float4(1.f, 0.f, 0.f, 1.f);
-    //float ratio = src.r * 255 / c_tfMaximumXValue;
-    //float arrayIndex = ratio * c_tfArraySize;
-    //float lowerIndex = floor(arrayIndex);
-    //float upperIndex = ceil(arrayIndex);
-    //float opacity = (r_opacityLookupTable[floor(arrayIndex)].lookupValue * (arrayIndex % 1.f) + r_opacityLookupTable[ceil(arrayIndex)].lookupValue * (1.f - (arrayIndex % 1.f))).a;
+    // Leap over macrocells that are fully transparent under the current transfer function
+    uint leap = 0;
+    bool leapAfterSample = false;
+    if (c_skipEmptySpace != 0 && all(pos >= 0.f))
+    {
+      uint3 cell = (uint3)(pos * c_macrocellScale);
+      if (all(cell < c_macrocellCount) && r_occupancyTexture.Load(int4(cell, 0)) == 0)
+      {
+        float3 exitPlane = (cell + (step > 0.f ? 1.f : 0.f)) / c_macrocellScale;
+        float3 exitSteps = step != 0.f ? (exitPlane - pos) / step : 1e30f;
+        leap = (uint)max(floor(min(exitSteps.x, min(exitSteps.y, exitSteps.z))), 0.f);
+
+        // A segment entering the cell from a sampled one can still be visible, it is composited before leaping
+        if (!havePrevious)
+        {
+          // The loop increment takes the final step out of the cell
+          i += leap;
+          continue;
+        }
+        leapAfterSample = true;
+      }
+    }
 
-    src.a *= 0.1;
+    float value = r_volumeTexture.SampleLevel(r_sampler, pos, c_levelOfDetail).r;
+    if (!havePrevious)
+    {
+      // The first segment is a point, one leaving a skipped cell starts at the last sample leapt over
+      previous = value;
+      if (i > 0)
+      {
+        previous = r_volumeTexture.SampleLevel(r_sampler, front + step * (i - 1), c_levelOfDetail).r;
+      }
+    }
+    float4 src = LookupSegment(previous * c_voxelValueRange, value * c_voxelValueRange);
+    if (c_gradientEnabled != 0)
+    {
+      src = ApplyGradient(src, pos, dir);
+    }
+    previous = value;
+    havePrevious = true;
 
-		// Front to back blending
-		//  dst.rgb = dst.rgb + (1 - dst.a) * src.a * src.rgb
-		//  dst.a   = dst.a   + (1 - dst.a) * src.a		
-    src.rgb *= src.a;
+    // Front to back blending of the premultiplied segment colour
+    //  dst.rgb = dst.rgb + (1 - dst.a) * src.rgb
+    //  dst.a   = dst.a   + (1 - dst.a) * src.a
     dst += (1.0f - dst.a) * src;
-		
-		// Break from the loop when alpha gets high enough
+
+    // Break from the loop when alpha gets high enough
     if(dst.a >= .95f)
       break;
-		
-		// Advance the current position
-    pos.xyz += step;
+
+    if (leapAfterSample && leap > 0)
+    {
+      i += leap;
+      havePrevious = false;
+    }
   }
 
   dst.y = dst.z = dst.x;
@@ -26,6 +26,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "Common.h"
 #include "Debug.h"
 #include "ImagingSystem.h"
+#include "LatencyTracer.h"
 #include "StepTimer.h"
 
 // System includes
@@ -54,6 +55,8 @@ namespace HoloIntervention
 {
   namespace System
   {
+    // Probe poses kept per connection, enough to cover image latency at tracker rates up to 100 Hz
+    const uint32 ImagingSystem::PROBE_HISTORY_LENGTH = 64;
 
     //----------------------------------------------------------------------------
     float3 ImagingSystem::GetStabilizedPosition(SpatialPointerPose^ pose) const
@@ -199,6 +202,7 @@ namespace HoloIntervention
 
         fromToFunction(L"/HoloIntervention/VolumeRendering", m_volumeFromCoordFrame, m_volumeToCoordFrame, m_volumeToHMDName, m_hashedVolumeConnectionName, m_volumeConnectionName);
         fromToFunction(L"/HoloIntervention/SliceRendering", m_sliceFromCoordFrame, m_sliceToCoordFrame, m_sliceToHMDName, m_hashedSliceConnectionName, m_sliceConnectionName);
+        SubscribeToProbe();
 
         if (document->SelectNodes(L"/HoloIntervention/SliceRendering")->Length == 1)
         {
@@ -254,6 +258,8 @@ namespace HoloIntervention
     ImagingSystem::~ImagingSystem()
     {
       m_componentReady = false;
+      m_networkSystem.Unsubscribe(m_sliceProbeSubscriptionToken);
+      m_networkSystem.Unsubscribe(m_volumeProbeSubscriptionToken);
     }
 
     //----------------------------------------------------------------------------
@@ -305,6 +311,41 @@ namespace HoloIntervention
       }
     }
 
+    //----------------------------------------------------------------------------
+    void ImagingSystem::SubscribeToProbe()
+    {
+      // Images arrive later than the tracker poses taken with them, keep a history so each image is placed with the
+      // probe pose at its acquisition time rather than the latest one
+      Network::IngestPolicy policy;
+      policy.Mode = Network::INGEST_MODE_HISTORY;
+      policy.HistoryLength = PROBE_HISTORY_LENGTH;
+
+      m_networkSystem.Unsubscribe(m_sliceProbeSubscriptionToken);
+      m_networkSystem.SetIngestPolicy(m_hashedSliceConnectionName, Network::SUBSCRIPTION_MESSAGE_TRANSFORM, m_probeToReferenceName, policy);
+      m_sliceProbeSubscriptionToken = m_networkSystem.SubscribeTransform(m_hashedSliceConnectionName, m_probeToReferenceName, m_sliceProbeMailbox);
+
+      m_networkSystem.Unsubscribe(m_volumeProbeSubscriptionToken);
+      m_volumeProbeSubscriptionToken = 0;
+      if (m_hashedVolumeConnectionName != m_hashedSliceConnectionName)
+      {
+        m_networkSystem.SetIngestPolicy(m_hashedVolumeConnectionName, Network::SUBSCRIPTION_MESSAGE_TRANSFORM, m_probeToReferenceName, policy);
+        m_volumeProbeSubscriptionToken = m_networkSystem.SubscribeTransform(m_hashedVolumeConnectionName, m_probeToReferenceName, m_volumeProbeMailbox);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    bool ImagingSystem::SetProbeTransformAtTime(uint64 hashedConnectionName, double timestamp)
+    {
+      // Without a history the repository keeps the pose embedded in the tracked frame
+      float4x4 probeToReference;
+      bool probeValid(false);
+      if (!m_networkSystem.GetTransformAtTime(hashedConnectionName, m_probeToReferenceName, timestamp, probeToReference, probeValid))
+      {
+        return false;
+      }
+      return m_transformRepository->SetTransform(m_probeToReferenceName, probeToReference, probeValid);
+    }
+
     //----------------------------------------------------------------------------
     bool ImagingSystem::HasSlice() const
     {
@@ -408,6 +449,7 @@ namespace HoloIntervention
           return;
         }
 
+        SetProbeTransformAtTime(m_hashedSliceConnectionName, frame->Timestamp);
         IKeyValuePair<bool, float4x4>^ result = m_transformRepository->GetTransform(m_sliceToHMDName);
         if (!result->Key)
         {
@@ -417,10 +459,6 @@ namespace HoloIntervention
         float4x4 imageToHMDTransform = transpose(result->Value);
 
 #if defined(_DEBUG)
-        auto name = ref new UWPOpenIGTLink::TransformName(L"Probe", L"Reference");
-        double latestTimestamp(0.0);
-        UWPOpenIGTLink::Transform^ transform = m_networkSystem.GetTransform(m_hashedSliceConnectionName, name, latestTimestamp);
-        m_transformRepository->SetTransform(name, transform->Matrix, transform->Valid);
         result = m_transformRepository->GetTransform(ref new UWPOpenIGTLink::TransformName(L"Probe", HOLOLENS_COORDINATE_SYSTEM_PNAME));
         // remove scaling before display
         float3 scale, translation;
@@ -468,6 +506,10 @@ namespace HoloIntervention
       }
 
       m_sliceEntry->SetFrame(frame);
+      if (LatencyTracer::instance().IsEnabled())
+      {
+        LatencyTracer::instance().Stamp(LatencyTracer::MakeStreamId(m_hashedSliceConnectionName, HashString(L"IMAGE")), frame->Timestamp, LATENCY_STAGE_CONSUMED);
+      }
     }
 
     //----------------------------------------------------------------------------
@@ -487,6 +529,7 @@ namespace HoloIntervention
         return;
       }
 
+      SetProbeTransformAtTime(m_hashedVolumeConnectionName, frame->Timestamp);
       IKeyValuePair<bool, float4x4>^ result = m_transformRepository->GetTransform(m_sliceToHMDName);
       if (!result->Key)
       {
@@ -499,6 +542,10 @@ namespace HoloIntervention
       {
         m_volumeEntry->SetFrame(frame);
         m_volumeEntry->SetDesiredPose(volumeToHMD);
+        if (LatencyTracer::instance().IsEnabled())
+        {
+          LatencyTracer::instance().Stamp(LatencyTracer::MakeStreamId(m_hashedVolumeConnectionName, HashString(L"IMAGE")), frame->Timestamp, LATENCY_STAGE_CONSUMED);
+        }
       }
     }
   }
@@ -28,6 +28,9 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "IStabilizedComponent.h"
 #include "IVoiceInput.h"
 
+// Network includes
+#include "SubscriptionHub.h"
+
 namespace DX
 {
   class StepTimer;
@@ -86,6 +89,8 @@ namespace HoloIntervention
     protected:
       void Process2DFrame(UWPOpenIGTLink::VideoFrame^ frame, Windows::Perception::Spatial::SpatialCoordinateSystem^ coordSystem);
       void Process3DFrame(UWPOpenIGTLink::VideoFrame^ frame, Windows::Perception::Spatial::SpatialCoordinateSystem^ coordSystem);
+      void SubscribeToProbe();
+      bool SetProbeTransformAtTime(uint64 hashedConnectionName, double timestamp);
 
     protected:
       // Cached variables
@@ -98,6 +103,11 @@ namespace HoloIntervention
 
       // Common variables
       UWPOpenIGTLink::TransformRepository^    m_transformRepository = ref new UWPOpenIGTLink::TransformRepository();
+      UWPOpenIGTLink::TransformName^          m_probeToReferenceName = ref new UWPOpenIGTLink::TransformName(L"Probe", L"Reference");
+      uint64                                  m_sliceProbeSubscriptionToken = 0;
+      uint64                                  m_volumeProbeSubscriptionToken = 0;
+      std::shared_ptr<Network::Mailbox<UWPOpenIGTLink::Transform^>> m_sliceProbeMailbox = nullptr;
+      std::shared_ptr<Network::Mailbox<UWPOpenIGTLink::Transform^>> m_volumeProbeMailbox = nullptr;
 
       // Slice system
       std::wstring                            m_sliceConnectionName; // For saving back to disk
@@ -119,6 +129,8 @@ namespace HoloIntervention
       UWPOpenIGTLink::TransformName^          m_volumeToHMDName = ref new UWPOpenIGTLink::TransformName(ref new Platform::String(m_volumeFromCoordFrame.c_str()), ref new Platform::String(m_volumeToCoordFrame.c_str()));
       std::shared_ptr<Rendering::Volume> m_volumeEntry = nullptr;
       double                                  m_latestVolumeTimestamp = 0.0;
+
+      static const uint32                     PROBE_HISTORY_LENGTH;
     };
   }
 }
\ No newline at end of file
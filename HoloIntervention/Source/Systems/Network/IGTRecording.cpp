@@ -0,0 +1,1095 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "IGTRecording.h"
+
+// STL includes
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+// OS includes
+#if defined(_WIN32)
+  #include <windows.h>
+#else
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+namespace
+{
+  const char FILE_MAGIC[8] = { 'H', 'I', 'R', 'E', 'C', '0', '0', '1' };
+  const char CHUNK_MAGIC[4] = { 'C', 'H', 'N', 'K' };
+  const char INDEX_MAGIC[8] = { 'H', 'I', 'R', 'I', 'D', 'X', '0', '1' };
+  const uint32_t FILE_VERSION = 1;
+  const uint32_t RECORD_FLAG_COMPRESSED = 0x1;
+
+  struct FileHeader
+  {
+    char      Magic[8];
+    uint32_t  Version;
+    uint32_t  Reserved;
+  };
+
+  struct ChunkHeader
+  {
+    char      Magic[4];
+    uint32_t  RecordCount;
+    uint64_t  Bytes;        // Size of the records that follow, including padding
+  };
+
+  struct RecordHeader
+  {
+    double    Timestamp;
+    uint64_t  StreamId;
+    uint64_t  StoredSize;
+    uint64_t  RawSize;
+    uint32_t  Type;
+    uint32_t  Flags;        // RECORD_FLAG_COMPRESSED | compression stride << 8
+  };
+
+  struct Footer
+  {
+    uint64_t  IndexOffset;
+    uint64_t  IndexCount;
+    char      Magic[8];
+  };
+
+  //----------------------------------------------------------------------------
+  size_t PaddedSize(size_t size)
+  {
+    return (size + 7) & ~static_cast<size_t>(7);
+  }
+
+  //----------------------------------------------------------------------------
+  void AppendBytes(std::vector<uint8_t>& buffer, const void* data, size_t size)
+  {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+  }
+
+  //----------------------------------------------------------------------------
+  std::string WideToUtf8(const std::wstring& wide)
+  {
+    std::string utf8;
+    utf8.reserve(wide.size());
+    for (size_t i = 0; i < wide.size(); ++i)
+    {
+      uint32_t codePoint = static_cast<uint32_t>(wide[i]);
+      if (sizeof(wchar_t) == 2 && codePoint >= 0xD800 && codePoint < 0xDC00 && i + 1 < wide.size())
+      {
+        uint32_t low = static_cast<uint32_t>(wide[i + 1]);
+        if (low >= 0xDC00 && low < 0xE000)
+        {
+          codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+          ++i;
+        }
+      }
+
+      if (codePoint < 0x80)
+      {
+        utf8.push_back(static_cast<char>(codePoint));
+      }
+      else if (codePoint < 0x800)
+      {
+        utf8.push_back(static_cast<char>(0xC0 | (codePoint >> 6)));
+        utf8.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+      else if (codePoint < 0x10000)
+      {
+        utf8.push_back(static_cast<char>(0xE0 | (codePoint >> 12)));
+        utf8.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        utf8.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+      else
+      {
+        utf8.push_back(static_cast<char>(0xF0 | (codePoint >> 18)));
+        utf8.push_back(static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F)));
+        utf8.push_back(static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F)));
+        utf8.push_back(static_cast<char>(0x80 | (codePoint & 0x3F)));
+      }
+    }
+    return utf8;
+  }
+
+#if defined(_WIN32)
+  //----------------------------------------------------------------------------
+  std::wstring Utf8ToWide(const std::string& utf8)
+  {
+    if (utf8.empty())
+    {
+      return std::wstring();
+    }
+    int length = MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), nullptr, 0);
+    std::wstring wide(static_cast<size_t>(length), L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, utf8.data(), static_cast<int>(utf8.size()), &wide[0], length);
+    return wide;
+  }
+#endif
+}
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    namespace Recording
+    {
+      //----------------------------------------------------------------------------
+      void CompressImage(const uint8_t* data, size_t size, uint32_t stride, std::vector<uint8_t>& outCompressed)
+      {
+        // Token < 128: literal run of token + 1 residuals follows
+        // Token >= 128: the next residual repeats token - 125 times (3 to 130)
+        outCompressed.clear();
+        outCompressed.reserve(size / 2);
+
+        auto residual = [data, stride](size_t i) -> uint8_t
+        {
+          return i < stride ? data[i] : static_cast<uint8_t>(data[i] - data[i - stride]);
+        };
+
+        size_t i(0);
+        size_t literalStart(0);
+        auto flushLiterals = [&](size_t end)
+        {
+          while (literalStart < end)
+          {
+            size_t count = std::min<size_t>(end - literalStart, 128);
+            outCompressed.push_back(static_cast<uint8_t>(count - 1));
+            for (size_t j = 0; j < count; ++j)
+            {
+              outCompressed.push_back(residual(literalStart + j));
+            }
+            literalStart += count;
+          }
+        };
+
+        while (i < size)
+        {
+          uint8_t value = residual(i);
+          size_t run(1);
+          while (i + run < size && run < 130 && residual(i + run) == value)
+          {
+            run++;
+          }
+
+          if (run >= 3)
+          {
+            flushLiterals(i);
+            outCompressed.push_back(static_cast<uint8_t>(run + 125));
+            outCompressed.push_back(value);
+            i += run;
+            literalStart = i;
+          }
+          else
+          {
+            i += run;
+          }
+        }
+        flushLiterals(size);
+      }
+
+      //----------------------------------------------------------------------------
+      bool DecompressImage(const uint8_t* data, size_t size, uint32_t stride, uint8_t* outData, size_t rawSize)
+      {
+        size_t in(0);
+        size_t out(0);
+        while (in < size)
+        {
+          uint8_t token = data[in++];
+          if (token < 128)
+          {
+            size_t count = static_cast<size_t>(token) + 1;
+            if (in + count > size || out + count > rawSize)
+            {
+              return false;
+            }
+            memcpy(outData + out, data + in, count);
+            in += count;
+            out += count;
+          }
+          else
+          {
+            size_t count = static_cast<size_t>(token) - 125;
+            if (in >= size || out + count > rawSize)
+            {
+              return false;
+            }
+            memset(outData + out, data[in++], count);
+            out += count;
+          }
+        }
+
+        if (out != rawSize)
+        {
+          return false;
+        }
+
+        for (size_t i = stride; i < rawSize; ++i)
+        {
+          outData[i] = static_cast<uint8_t>(outData[i] + outData[i - stride]);
+        }
+        return true;
+      }
+    }
+
+    const size_t RecordingWriter::DEFAULT_CHUNK_BYTES = 1024 * 1024;
+    const size_t RecordingWriter::MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::Open(const std::string& fileName, size_t chunkBytes /*= DEFAULT_CHUNK_BYTES*/)
+    {
+      if (IsOpen())
+      {
+        return false;
+      }
+#if defined(_WIN32)
+      return OpenInternal(_wfopen(Utf8ToWide(fileName).c_str(), L"wb"), chunkBytes);
+#else
+      return OpenInternal(fopen(fileName.c_str(), "wb"), chunkBytes);
+#endif
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::Open(const std::wstring& fileName, size_t chunkBytes /*= DEFAULT_CHUNK_BYTES*/)
+    {
+      if (IsOpen())
+      {
+        return false;
+      }
+#if defined(_WIN32)
+      return OpenInternal(_wfopen(fileName.c_str(), L"wb"), chunkBytes);
+#else
+      return OpenInternal(fopen(WideToUtf8(fileName).c_str(), "wb"), chunkBytes);
+#endif
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::IsOpen() const
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      return m_open;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::Append(const RecordInfo& info, const void* payload, size_t size, uint32_t compressionStride /*= 0*/)
+    {
+      std::shared_ptr<uint8_t> copy(new uint8_t[std::max<size_t>(size, 1)], std::default_delete<uint8_t[]>());
+      if (size > 0)
+      {
+        memcpy(copy.get(), payload, size);
+      }
+      return Append(info, std::shared_ptr<const uint8_t>(std::move(copy)), size, compressionStride);
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::Append(const RecordInfo& info, std::shared_ptr<const uint8_t> payload, size_t size, uint32_t compressionStride /*= 0*/)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      if (!m_open || m_writeFailed)
+      {
+        return false;
+      }
+
+      // Several consumers may pull the same message, only the first one is recorded
+      auto iter = m_lastStreamTimestamp.find(info.StreamId);
+      if (iter != m_lastStreamTimestamp.end() && info.Timestamp <= iter->second)
+      {
+        m_statistics.DuplicatesDropped++;
+        return true;
+      }
+
+      // A stalled disk must not grow the queue without bound, the record is lost but the stream carries on
+      if (!m_queue.empty() && m_queuedBytes + size > MAX_QUEUED_BYTES)
+      {
+        m_statistics.QueueDropped++;
+        return false;
+      }
+      m_lastStreamTimestamp[info.StreamId] = info.Timestamp;
+
+      QueuedRecord record = { info, std::move(payload), size, compressionStride };
+      m_queue.push_back(std::move(record));
+      m_queuedBytes += size;
+      m_queueCondition.notify_one();
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::IsNewRecord(uint64_t streamId, double timestamp)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      if (!m_open || m_writeFailed)
+      {
+        return false;
+      }
+
+      auto iter = m_lastStreamTimestamp.find(streamId);
+      if (iter != m_lastStreamTimestamp.end() && timestamp <= iter->second)
+      {
+        m_statistics.DuplicatesDropped++;
+        return false;
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::Flush()
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_open)
+      {
+        return false;
+      }
+
+      const uint64_t request = ++m_flushRequests;
+      m_queueCondition.notify_one();
+      m_flushCondition.wait(lock, [this, request]()
+      {
+        return m_flushesCompleted >= request;
+      });
+      return !m_writeFailed;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::Close()
+    {
+      {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (!m_open)
+        {
+          return false;
+        }
+        m_open = false;
+        m_stopRequested = true;
+        m_queueCondition.notify_one();
+      }
+
+      // The writer drains the queue before it exits, after that the file state belongs to this thread
+      m_writerThread.join();
+
+      bool result = FlushInternal();
+
+      // Records of different streams may arrive slightly out of order, the index is sorted so the reader can binary search it
+      std::stable_sort(m_index.begin(), m_index.end(), [](const PendingIndexEntry & a, const PendingIndexEntry & b)
+      {
+        return a.Timestamp < b.Timestamp;
+      });
+
+      std::vector<uint8_t> index;
+      index.reserve(m_index.size() * 32);
+      for (auto& entry : m_index)
+      {
+        uint32_t reserved(0);
+        AppendBytes(index, &entry.Timestamp, sizeof(entry.Timestamp));
+        AppendBytes(index, &entry.Offset, sizeof(entry.Offset));
+        AppendBytes(index, &entry.StreamId, sizeof(entry.StreamId));
+        AppendBytes(index, &entry.Type, sizeof(entry.Type));
+        AppendBytes(index, &reserved, sizeof(reserved));
+      }
+
+      Footer footer = {};
+      footer.IndexOffset = m_fileOffset;
+      footer.IndexCount = m_index.size();
+      memcpy(footer.Magic, INDEX_MAGIC, sizeof(INDEX_MAGIC));
+
+      if (result)
+      {
+        result = (index.empty() || fwrite(index.data(), index.size(), 1, m_file) == 1) && fwrite(&footer, sizeof(footer), 1, m_file) == 1;
+      }
+
+      result = fclose(m_file) == 0 && result;
+      m_file = nullptr;
+      m_index.clear();
+      m_compressionBuffer = std::vector<uint8_t>();
+
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_statistics.Chunks = m_chunksWritten;
+      return result && !m_writeFailed;
+    }
+
+    //----------------------------------------------------------------------------
+    RecordingWriter::Statistics RecordingWriter::GetStatistics() const
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      return m_statistics;
+    }
+
+    //----------------------------------------------------------------------------
+    RecordingWriter::RecordingWriter()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    RecordingWriter::~RecordingWriter()
+    {
+      Close();
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::OpenInternal(FILE* file, size_t chunkBytes)
+    {
+      if (file == nullptr)
+      {
+        return false;
+      }
+
+      FileHeader header = {};
+      memcpy(header.Magic, FILE_MAGIC, sizeof(FILE_MAGIC));
+      header.Version = FILE_VERSION;
+      if (fwrite(&header, sizeof(header), 1, file) != 1)
+      {
+        fclose(file);
+        return false;
+      }
+
+      m_file = file;
+      m_fileOffset = sizeof(header);
+      m_chunkBytes = chunkBytes;
+      m_chunk.clear();
+      m_chunk.reserve(chunkBytes);
+      m_chunkRecords = 0;
+      m_chunksWritten = 0;
+      m_index.clear();
+
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_queue.clear();
+      m_queuedBytes = 0;
+      m_open = true;
+      m_stopRequested = false;
+      m_writeFailed = false;
+      m_flushRequests = 0;
+      m_flushesCompleted = 0;
+      m_lastStreamTimestamp.clear();
+      m_statistics = Statistics();
+      m_writerThread = std::thread(&RecordingWriter::WriterLoop, this);
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void RecordingWriter::WriterLoop()
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (true)
+      {
+        m_queueCondition.wait(lock, [this]()
+        {
+          return !m_queue.empty() || m_flushesCompleted < m_flushRequests || m_stopRequested;
+        });
+
+        if (!m_queue.empty())
+        {
+          QueuedRecord record = std::move(m_queue.front());
+          m_queue.pop_front();
+          m_queuedBytes -= record.Size;
+
+          // Compression and file I/O happen without the lock so Append never waits on them
+          const bool failed = m_writeFailed;
+          lock.unlock();
+          uint64_t storedBytes(0);
+          bool result = !failed && WriteRecord(record, storedBytes);
+          record.Payload.reset();
+          lock.lock();
+
+          if (result)
+          {
+            m_statistics.Records++;
+            m_statistics.RawBytes += record.Size;
+            m_statistics.StoredBytes += storedBytes;
+            m_statistics.Chunks = m_chunksWritten;
+          }
+          else
+          {
+            m_writeFailed = true;
+          }
+          continue;
+        }
+
+        if (m_flushesCompleted < m_flushRequests)
+        {
+          const uint64_t requests = m_flushRequests;
+          lock.unlock();
+          bool result = FlushInternal() && fflush(m_file) == 0;
+          lock.lock();
+
+          m_writeFailed = m_writeFailed || !result;
+          m_statistics.Chunks = m_chunksWritten;
+          m_flushesCompleted = requests;
+          m_flushCondition.notify_all();
+          continue;
+        }
+
+        // Stop requested and nothing left to write
+        return;
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::WriteRecord(const QueuedRecord& record, uint64_t& outStoredBytes)
+    {
+      RecordHeader header = {};
+      header.Timestamp = record.Info.Timestamp;
+      header.StreamId = record.Info.StreamId;
+      header.Type = record.Info.Type;
+      header.RawSize = record.Size;
+      header.StoredSize = record.Size;
+
+      const void* stored = record.Payload.get();
+      if (record.CompressionStride > 0 && record.CompressionStride < (1 << 24) && record.Size > 0)
+      {
+        Recording::CompressImage(record.Payload.get(), record.Size, record.CompressionStride, m_compressionBuffer);
+        if (m_compressionBuffer.size() < record.Size)
+        {
+          stored = m_compressionBuffer.data();
+          header.StoredSize = m_compressionBuffer.size();
+          header.Flags = RECORD_FLAG_COMPRESSED | (record.CompressionStride << 8);
+        }
+      }
+
+      size_t recordBytes = sizeof(header) + PaddedSize(static_cast<size_t>(header.StoredSize));
+      if (!m_chunk.empty() && m_chunk.size() + recordBytes > m_chunkBytes)
+      {
+        if (!FlushInternal())
+        {
+          return false;
+        }
+      }
+
+      PendingIndexEntry entry = { header.Timestamp, m_fileOffset + sizeof(ChunkHeader) + m_chunk.size(), header.StreamId, header.Type };
+      m_index.push_back(entry);
+
+      AppendBytes(m_chunk, &header, sizeof(header));
+      AppendBytes(m_chunk, stored, static_cast<size_t>(header.StoredSize));
+      m_chunk.resize(m_chunk.size() + PaddedSize(static_cast<size_t>(header.StoredSize)) - static_cast<size_t>(header.StoredSize), 0);
+      m_chunkRecords++;
+
+      outStoredBytes = header.StoredSize;
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingWriter::FlushInternal()
+    {
+      if (m_chunk.empty())
+      {
+        return true;
+      }
+
+      ChunkHeader header = {};
+      memcpy(header.Magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC));
+      header.RecordCount = m_chunkRecords;
+      header.Bytes = m_chunk.size();
+      if (fwrite(&header, sizeof(header), 1, m_file) != 1 || fwrite(m_chunk.data(), m_chunk.size(), 1, m_file) != 1)
+      {
+        return false;
+      }
+
+      m_fileOffset += sizeof(header) + m_chunk.size();
+      m_chunk.clear();
+      m_chunkRecords = 0;
+      m_chunksWritten++;
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::Open(const std::string& fileName)
+    {
+      Close();
+
+      if (!MapFile(fileName))
+      {
+        return false;
+      }
+
+      FileHeader header;
+      if (m_size < sizeof(header))
+      {
+        Close();
+        return false;
+      }
+      memcpy(&header, m_data, sizeof(header));
+      if (memcmp(header.Magic, FILE_MAGIC, sizeof(FILE_MAGIC)) != 0 || header.Version != FILE_VERSION)
+      {
+        Close();
+        return false;
+      }
+
+      if (!LoadIndex() && !RebuildIndex())
+      {
+        Close();
+        return false;
+      }
+
+      for (size_t i = 0; i < m_indexCount; ++i)
+      {
+        if (m_index[i].Type < RECORD_TYPE_COUNT)
+        {
+          m_typeIndex[m_index[i].Type].push_back(static_cast<uint32_t>(i));
+        }
+      }
+
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::Open(const std::wstring& fileName)
+    {
+      return Open(WideToUtf8(fileName));
+    }
+
+    //----------------------------------------------------------------------------
+    void RecordingReader::Close()
+    {
+      m_index = nullptr;
+      m_indexCount = 0;
+      m_recoveredIndex.clear();
+      for (auto& typeIndex : m_typeIndex)
+      {
+        typeIndex.clear();
+      }
+      UnmapFile();
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::IsOpen() const
+    {
+      return m_data != nullptr;
+    }
+
+    //----------------------------------------------------------------------------
+    size_t RecordingReader::GetRecordCount() const
+    {
+      return m_indexCount;
+    }
+
+    //----------------------------------------------------------------------------
+    double RecordingReader::GetStartTime() const
+    {
+      return m_indexCount == 0 ? 0.0 : m_index[0].Timestamp;
+    }
+
+    //----------------------------------------------------------------------------
+    double RecordingReader::GetEndTime() const
+    {
+      return m_indexCount == 0 ? 0.0 : m_index[m_indexCount - 1].Timestamp;
+    }
+
+    //----------------------------------------------------------------------------
+    size_t RecordingReader::Find(double timestamp) const
+    {
+      auto iter = std::lower_bound(m_index, m_index + m_indexCount, timestamp, [](const IndexEntry & entry, double value)
+      {
+        return entry.Timestamp < value;
+      });
+      return static_cast<size_t>(iter - m_index);
+    }
+
+    //----------------------------------------------------------------------------
+    size_t RecordingReader::Find(double timestamp, RecordType type) const
+    {
+      if (type >= RECORD_TYPE_COUNT)
+      {
+        return Find(timestamp);
+      }
+
+      auto& typeIndex = m_typeIndex[type];
+      auto iter = std::lower_bound(typeIndex.begin(), typeIndex.end(), timestamp, [this](uint32_t position, double value)
+      {
+        return m_index[position].Timestamp < value;
+      });
+      return iter == typeIndex.end() ? m_indexCount : *iter;
+    }
+
+    //----------------------------------------------------------------------------
+    size_t RecordingReader::Next(size_t index, RecordType type) const
+    {
+      if (type >= RECORD_TYPE_COUNT)
+      {
+        return std::min(index + 1, m_indexCount);
+      }
+
+      auto& typeIndex = m_typeIndex[type];
+      auto iter = std::upper_bound(typeIndex.begin(), typeIndex.end(), static_cast<uint32_t>(index));
+      return iter == typeIndex.end() ? m_indexCount : *iter;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::GetInfo(size_t index, RecordInfo& outInfo) const
+    {
+      if (index >= m_indexCount)
+      {
+        return false;
+      }
+
+      outInfo.Timestamp = m_index[index].Timestamp;
+      outInfo.Type = static_cast<RecordType>(m_index[index].Type);
+      outInfo.StreamId = m_index[index].StreamId;
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::Read(size_t index, Record& outRecord) const
+    {
+      if (index >= m_indexCount)
+      {
+        return false;
+      }
+
+      const uint64_t offset = m_index[index].Offset;
+      RecordHeader header;
+      if (offset + sizeof(header) > m_size)
+      {
+        return false;
+      }
+      memcpy(&header, m_data + offset, sizeof(header));
+      if (offset + sizeof(header) + header.StoredSize > m_size)
+      {
+        return false;
+      }
+
+      outRecord.Info.Timestamp = header.Timestamp;
+      outRecord.Info.Type = static_cast<RecordType>(header.Type);
+      outRecord.Info.StreamId = header.StreamId;
+      outRecord.Payload.resize(static_cast<size_t>(header.RawSize));
+
+      const uint8_t* stored = m_data + offset + sizeof(header);
+      if (header.Flags & RECORD_FLAG_COMPRESSED)
+      {
+        return Recording::DecompressImage(stored, static_cast<size_t>(header.StoredSize), header.Flags >> 8, outRecord.Payload.data(), outRecord.Payload.size());
+      }
+
+      if (header.StoredSize != header.RawSize)
+      {
+        return false;
+      }
+      if (header.RawSize > 0)
+      {
+        memcpy(outRecord.Payload.data(), stored, static_cast<size_t>(header.RawSize));
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    const uint8_t* RecordingReader::GetMappedPayload(size_t index, size_t& outSize) const
+    {
+      if (index >= m_indexCount)
+      {
+        return nullptr;
+      }
+
+      const uint64_t offset = m_index[index].Offset;
+      RecordHeader header;
+      if (offset + sizeof(header) > m_size)
+      {
+        return nullptr;
+      }
+      memcpy(&header, m_data + offset, sizeof(header));
+      if ((header.Flags & RECORD_FLAG_COMPRESSED) || offset + sizeof(header) + header.StoredSize > m_size)
+      {
+        return nullptr;
+      }
+
+      outSize = static_cast<size_t>(header.StoredSize);
+      return m_data + offset + sizeof(header);
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::WasRecovered() const
+    {
+      return m_index != nullptr && m_index == m_recoveredIndex.data();
+    }
+
+    //----------------------------------------------------------------------------
+    RecordingReader::RecordingReader()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    RecordingReader::~RecordingReader()
+    {
+      Close();
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::MapFile(const std::string& fileName)
+    {
+#if defined(_WIN32)
+      HANDLE file = CreateFile2(Utf8ToWide(fileName).c_str(), GENERIC_READ, FILE_SHARE_READ, OPEN_EXISTING, nullptr);
+      if (file == INVALID_HANDLE_VALUE)
+      {
+        return false;
+      }
+
+      LARGE_INTEGER size;
+      if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+      {
+        CloseHandle(file);
+        return false;
+      }
+
+      HANDLE mapping = CreateFileMappingFromApp(file, nullptr, PAGE_READONLY, 0, nullptr);
+      if (mapping == nullptr)
+      {
+        CloseHandle(file);
+        return false;
+      }
+
+      void* view = MapViewOfFileFromApp(mapping, FILE_MAP_READ, 0, 0);
+      if (view == nullptr)
+      {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+      }
+
+      m_fileHandle = file;
+      m_mappingHandle = mapping;
+      m_data = static_cast<const uint8_t*>(view);
+      m_size = static_cast<uint64_t>(size.QuadPart);
+#else
+      int file = open(fileName.c_str(), O_RDONLY);
+      if (file < 0)
+      {
+        return false;
+      }
+
+      struct stat status;
+      if (fstat(file, &status) != 0 || status.st_size == 0)
+      {
+        close(file);
+        return false;
+      }
+
+      void* view = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+      close(file);
+      if (view == MAP_FAILED)
+      {
+        return false;
+      }
+
+      m_data = static_cast<const uint8_t*>(view);
+      m_size = static_cast<uint64_t>(status.st_size);
+#endif
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void RecordingReader::UnmapFile()
+    {
+      if (m_data == nullptr)
+      {
+        return;
+      }
+
+#if defined(_WIN32)
+      UnmapViewOfFile(m_data);
+      CloseHandle(static_cast<HANDLE>(m_mappingHandle));
+      CloseHandle(static_cast<HANDLE>(m_fileHandle));
+      m_mappingHandle = nullptr;
+      m_fileHandle = nullptr;
+#else
+      munmap(const_cast<uint8_t*>(m_data), static_cast<size_t>(m_size));
+#endif
+      m_data = nullptr;
+      m_size = 0;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::LoadIndex()
+    {
+      Footer footer;
+      if (m_size < sizeof(FileHeader) + sizeof(footer))
+      {
+        return false;
+      }
+      memcpy(&footer, m_data + m_size - sizeof(footer), sizeof(footer));
+      if (memcmp(footer.Magic, INDEX_MAGIC, sizeof(INDEX_MAGIC)) != 0 ||
+          footer.IndexOffset % 8 != 0 ||
+          footer.IndexOffset < sizeof(FileHeader) ||
+          footer.IndexOffset > m_size - sizeof(footer))
+      {
+        return false;
+      }
+
+      static_assert(sizeof(IndexEntry) == 32, "IndexEntry must match the on disk index layout");
+
+      // Bound the count by the bytes actually present before multiplying, a corrupt footer must not wrap the size check
+      const uint64_t indexBytes = m_size - sizeof(footer) - footer.IndexOffset;
+      if (footer.IndexCount > indexBytes / sizeof(IndexEntry) || footer.IndexCount * sizeof(IndexEntry) != indexBytes)
+      {
+        return false;
+      }
+
+      // The mapping is page aligned and the index offset is 8 byte aligned, so the index is used in place
+      m_index = reinterpret_cast<const IndexEntry*>(m_data + footer.IndexOffset);
+      m_indexCount = static_cast<size_t>(footer.IndexCount);
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingReader::RebuildIndex()
+    {
+      m_recoveredIndex.clear();
+
+      uint64_t offset = sizeof(FileHeader);
+      while (offset + sizeof(ChunkHeader) <= m_size)
+      {
+        ChunkHeader chunk;
+        memcpy(&chunk, m_data + offset, sizeof(chunk));
+        if (memcmp(chunk.Magic, CHUNK_MAGIC, sizeof(CHUNK_MAGIC)) != 0 || offset + sizeof(chunk) + chunk.Bytes > m_size)
+        {
+          // End of recording, or a chunk that was only partially written
+          break;
+        }
+
+        uint64_t recordOffset = offset + sizeof(chunk);
+        const uint64_t chunkEnd = recordOffset + chunk.Bytes;
+        for (uint32_t i = 0; i < chunk.RecordCount && recordOffset + sizeof(RecordHeader) <= chunkEnd; ++i)
+        {
+          RecordHeader header;
+          memcpy(&header, m_data + recordOffset, sizeof(header));
+
+          IndexEntry entry = { header.Timestamp, recordOffset, header.StreamId, header.Type, 0 };
+          m_recoveredIndex.push_back(entry);
+
+          recordOffset += sizeof(header) + PaddedSize(static_cast<size_t>(header.StoredSize));
+        }
+
+        offset = chunkEnd;
+      }
+
+      std::stable_sort(m_recoveredIndex.begin(), m_recoveredIndex.end(), [](const IndexEntry & a, const IndexEntry & b)
+      {
+        return a.Timestamp < b.Timestamp;
+      });
+
+      m_index = m_recoveredIndex.data();
+      m_indexCount = m_recoveredIndex.size();
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void RecordingPlayer::SetSpeed(double speed)
+    {
+      m_speed = std::max(0.0, speed);
+      Restart();
+    }
+
+    //----------------------------------------------------------------------------
+    double RecordingPlayer::GetSpeed() const
+    {
+      return m_speed;
+    }
+
+    //----------------------------------------------------------------------------
+    void RecordingPlayer::Seek(double timestamp)
+    {
+      m_position = m_reader.Find(timestamp, m_typeFilter);
+      Restart();
+    }
+
+    //----------------------------------------------------------------------------
+    void RecordingPlayer::SetTypeFilter(RecordType type)
+    {
+      RecordInfo info;
+      double timestamp = m_reader.GetInfo(m_position, info) ? info.Timestamp : m_reader.GetEndTime();
+      m_typeFilter = type;
+      m_position = m_reader.Find(timestamp, m_typeFilter);
+      Restart();
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingPlayer::Next(Record& outRecord)
+    {
+      RecordInfo info;
+      if (!m_reader.GetInfo(m_position, info))
+      {
+        return false;
+      }
+
+      if (m_speed > 0.0)
+      {
+        std::this_thread::sleep_until(DueTime(info.Timestamp));
+      }
+
+      bool result = m_reader.Read(m_position, outRecord);
+      m_position = m_reader.Next(m_position, m_typeFilter);
+      return result;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingPlayer::TryNext(Record& outRecord)
+    {
+      RecordInfo info;
+      if (!m_reader.GetInfo(m_position, info))
+      {
+        return false;
+      }
+
+      if (m_speed > 0.0 && Clock::now() < DueTime(info.Timestamp))
+      {
+        return false;
+      }
+
+      bool result = m_reader.Read(m_position, outRecord);
+      m_position = m_reader.Next(m_position, m_typeFilter);
+      return result;
+    }
+
+    //----------------------------------------------------------------------------
+    bool RecordingPlayer::IsFinished() const
+    {
+      return m_position >= m_reader.GetRecordCount();
+    }
+
+    //----------------------------------------------------------------------------
+    RecordingPlayer::RecordingPlayer(const RecordingReader& reader)
+      : m_reader(reader)
+    {
+      Restart();
+    }
+
+    //----------------------------------------------------------------------------
+    RecordingPlayer::~RecordingPlayer()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    void RecordingPlayer::Restart()
+    {
+      RecordInfo info;
+      m_originTimestamp = m_reader.GetInfo(m_position, info) ? info.Timestamp : 0.0;
+      m_originTime = Clock::now();
+    }
+
+    //----------------------------------------------------------------------------
+    RecordingPlayer::Clock::time_point RecordingPlayer::DueTime(double timestamp) const
+    {
+      double offsetSec = (timestamp - m_originTimestamp) / m_speed;
+      return m_originTime + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(offsetSec));
+    }
+  }
+}
\ No newline at end of file
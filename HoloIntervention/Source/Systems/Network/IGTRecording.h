@@ -0,0 +1,288 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    // Append-only recording of IGT messages
+    //
+    // File layout (little endian, all structures 8 byte aligned)
+    //   FileHeader
+    //   Chunk*          ChunkHeader followed by RecordHeader + payload (padded to 8 bytes) for each record in the chunk
+    //   IndexEntry*     Sorted by timestamp, only present if the recording was closed cleanly
+    //   Footer
+    // A recording that was not closed is still readable, the reader rebuilds the index by walking the chunks
+    enum RecordType : uint32_t
+    {
+      RECORD_TYPE_TRANSFORM,
+      RECORD_TYPE_TDATA,
+      RECORD_TYPE_IMAGE,
+      RECORD_TYPE_POLYDATA,
+      RECORD_TYPE_RAW_IGTL,   // Unparsed OpenIGTLink header + body
+      RECORD_TYPE_TRACKED_FRAME,  // Image followed by the transforms embedded in the tracked frame
+      RECORD_TYPE_COUNT
+    };
+
+    struct RecordInfo
+    {
+      double        Timestamp = 0.0;
+      RecordType    Type = RECORD_TYPE_RAW_IGTL;
+      uint64_t      StreamId = 0;     // Identifies the device/transform the record belongs to
+    };
+
+    struct Record
+    {
+      RecordInfo            Info;
+      std::vector<uint8_t>  Payload;  // Always decompressed
+    };
+
+    namespace Recording
+    {
+      // Lossless codec for image payloads: per component delta (stride = bytes per pixel) followed by run length encoding
+      void CompressImage(const uint8_t* data, size_t size, uint32_t stride, std::vector<uint8_t>& outCompressed);
+      bool DecompressImage(const uint8_t* data, size_t size, uint32_t stride, uint8_t* outData, size_t rawSize);
+    }
+
+    //----------------------------------------------------------------------------
+    // Records are queued by Append and compressed and written by a writer thread owned by the recording, so the
+    // threads handing out messages only pay for the duplicate check and, for the raw pointer overload, a copy
+    class RecordingWriter
+    {
+    public:
+      struct Statistics
+      {
+        uint64_t  Records = 0;
+        uint64_t  DuplicatesDropped = 0;
+        uint64_t  QueueDropped = 0;     // Records dropped because the writer fell MAX_QUEUED_BYTES behind
+        uint64_t  RawBytes = 0;         // Payload bytes before compression
+        uint64_t  StoredBytes = 0;      // Payload bytes written
+        uint64_t  Chunks = 0;
+      };
+
+    public:
+      /// fileName is UTF-8
+      bool Open(const std::string& fileName, size_t chunkBytes = DEFAULT_CHUNK_BYTES);
+      bool Open(const std::wstring& fileName, size_t chunkBytes = DEFAULT_CHUNK_BYTES);
+      bool IsOpen() const;
+
+      /// Append a record. Records that are not newer than the last record of the same stream are dropped as duplicates
+      /// compressionStride > 0 enables lossless image compression with the given bytes per pixel
+      /// The payload is copied, use the shared overload to hand over a buffer that is not modified afterwards
+      bool Append(const RecordInfo& info, const void* payload, size_t size, uint32_t compressionStride = 0);
+      bool Append(const RecordInfo& info, std::shared_ptr<const uint8_t> payload, size_t size, uint32_t compressionStride = 0);
+
+      /// False when a record of streamId at timestamp would be dropped as a duplicate (counted as one), or nothing is being
+      /// written. Lets callers skip building a payload Append would discard; Append still checks, so a race only costs a copy.
+      bool IsNewRecord(uint64_t streamId, double timestamp);
+
+      /// Wait for the queued records to be written, then write the pending chunk to disk
+      bool Flush();
+
+      /// Flush, then write the index and footer
+      bool Close();
+
+      Statistics GetStatistics() const;
+
+    public:
+      RecordingWriter();
+      ~RecordingWriter();
+
+    protected:
+      struct QueuedRecord
+      {
+        RecordInfo                        Info;
+        std::shared_ptr<const uint8_t>    Payload;
+        size_t                            Size;
+        uint32_t                          CompressionStride;
+      };
+
+      bool OpenInternal(FILE* file, size_t chunkBytes);
+      void WriterLoop();
+      bool WriteRecord(const QueuedRecord& record, uint64_t& outStoredBytes);
+      bool FlushInternal();
+
+    protected:
+      struct PendingIndexEntry
+      {
+        double      Timestamp;
+        uint64_t    Offset;
+        uint64_t    StreamId;
+        uint32_t    Type;
+      };
+
+      // Shared with the writer thread
+      mutable std::mutex                      m_mutex;
+      std::condition_variable                 m_queueCondition;
+      std::condition_variable                 m_flushCondition;
+      std::deque<QueuedRecord>                m_queue;
+      size_t                                  m_queuedBytes = 0;
+      bool                                    m_open = false;
+      bool                                    m_stopRequested = false;
+      bool                                    m_writeFailed = false;
+      uint64_t                                m_flushRequests = 0;
+      uint64_t                                m_flushesCompleted = 0;
+      std::unordered_map<uint64_t, double>    m_lastStreamTimestamp;
+      Statistics                              m_statistics;
+      std::thread                             m_writerThread;
+
+      // Only touched by the writer thread while it runs, and by Open/Close around it
+      FILE*                                   m_file = nullptr;
+      uint64_t                                m_fileOffset = 0;   // Where the pending chunk will be written
+      size_t                                  m_chunkBytes = DEFAULT_CHUNK_BYTES;
+      std::vector<uint8_t>                    m_chunk;
+      uint32_t                                m_chunkRecords = 0;
+      uint64_t                                m_chunksWritten = 0;
+      std::vector<PendingIndexEntry>          m_index;
+      std::vector<uint8_t>                    m_compressionBuffer;
+
+      static const size_t                     DEFAULT_CHUNK_BYTES;
+      static const size_t                     MAX_QUEUED_BYTES;
+    };
+
+    //----------------------------------------------------------------------------
+    class RecordingReader
+    {
+    public:
+      /// fileName is UTF-8
+      bool Open(const std::string& fileName);
+      bool Open(const std::wstring& fileName);
+      void Close();
+      bool IsOpen() const;
+
+      size_t GetRecordCount() const;
+      double GetStartTime() const;
+      double GetEndTime() const;
+
+      /// Index of the first record at or after timestamp, GetRecordCount() if there is none. O(log n)
+      size_t Find(double timestamp) const;
+
+      /// Index of the first record of the given type at or after timestamp, GetRecordCount() if there is none. O(log n)
+      size_t Find(double timestamp, RecordType type) const;
+
+      /// Index of the next record of the given type after index, GetRecordCount() if there is none
+      size_t Next(size_t index, RecordType type) const;
+
+      bool GetInfo(size_t index, RecordInfo& outInfo) const;
+
+      /// Read and decompress a record
+      bool Read(size_t index, Record& outRecord) const;
+
+      /// Zero copy access to an uncompressed payload in the mapped file, returns nullptr for compressed records
+      const uint8_t* GetMappedPayload(size_t index, size_t& outSize) const;
+
+      /// True if the file was not closed cleanly and the index was rebuilt from the chunks
+      bool WasRecovered() const;
+
+    public:
+      RecordingReader();
+      ~RecordingReader();
+
+    protected:
+      bool MapFile(const std::string& fileName);
+      void UnmapFile();
+      bool LoadIndex();
+      bool RebuildIndex();
+
+    protected:
+      struct IndexEntry
+      {
+        double      Timestamp;
+        uint64_t    Offset;     // Of the RecordHeader
+        uint64_t    StreamId;
+        uint32_t    Type;
+        uint32_t    Reserved;
+      };
+
+      const uint8_t*                          m_data = nullptr;
+      uint64_t                                m_size = 0;
+      void*                                   m_fileHandle = nullptr;
+      void*                                   m_mappingHandle = nullptr;
+
+      const IndexEntry*                       m_index = nullptr;  // Points into the mapping, or into m_recoveredIndex
+      size_t                                  m_indexCount = 0;
+      std::vector<IndexEntry>                 m_recoveredIndex;
+      std::array<std::vector<uint32_t>, RECORD_TYPE_COUNT> m_typeIndex;
+    };
+
+    //----------------------------------------------------------------------------
+    class RecordingPlayer
+    {
+    public:
+      /// Playback speed multiplier, 0 plays as fast as records can be read
+      void SetSpeed(double speed);
+      double GetSpeed() const;
+
+      /// Position playback at the first record at or after timestamp, O(log n)
+      void Seek(double timestamp);
+
+      /// Only return records of this type, RECORD_TYPE_COUNT returns all
+      void SetTypeFilter(RecordType type);
+
+      /// Wait until the next record is due and read it, false at the end of the recording
+      bool Next(Record& outRecord);
+
+      /// Like Next but never waits, false if no record is due yet or at the end of the recording
+      bool TryNext(Record& outRecord);
+
+      bool IsFinished() const;
+
+    public:
+      RecordingPlayer(const RecordingReader& reader);
+      ~RecordingPlayer();
+
+    protected:
+      typedef std::chrono::steady_clock Clock;
+
+      void Restart();
+      Clock::time_point DueTime(double timestamp) const;
+
+    protected:
+      const RecordingReader&  m_reader;
+      size_t                  m_position = 0;
+      double                  m_speed = 1.0;
+      RecordType              m_typeFilter = RECORD_TYPE_COUNT;
+
+      // Wall clock time at which the record at m_originTimestamp is played
+      Clock::time_point       m_originTime;
+      double                  m_originTimestamp = 0.0;
+    };
+  }
+}
\ No newline at end of file
@@ -0,0 +1,176 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "IngestPolicy.h"
+
+// STL includes
+#include <algorithm>
+#include <cwctype>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    const double ArrivalEstimator::EARLY_FRACTION = 0.875;
+    const double ArrivalEstimator::INTERVAL_SMOOTHING = 0.125;
+    const double ArrivalEstimator::MIN_CHECK_SPACING_SEC = 0.0005;
+    const double ArrivalEstimator::MAX_CHECK_SPACING_SEC = 0.02;
+
+    //----------------------------------------------------------------------------
+    bool IngestPolicy::ModeFromString(const std::wstring& name, IngestMode& outMode)
+    {
+      std::wstring lower(name);
+      std::transform(lower.begin(), lower.end(), lower.begin(), [](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+
+      if (lower == L"everymessage")
+      {
+        outMode = INGEST_MODE_EVERY_MESSAGE;
+      }
+      else if (lower == L"latestonly")
+      {
+        outMode = INGEST_MODE_LATEST_ONLY;
+      }
+      else if (lower == L"decimate")
+      {
+        outMode = INGEST_MODE_DECIMATE;
+      }
+      else if (lower == L"history")
+      {
+        outMode = INGEST_MODE_HISTORY;
+      }
+      else
+      {
+        return false;
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    std::wstring IngestPolicy::ModeToString(IngestMode mode)
+    {
+      switch (mode)
+      {
+        case INGEST_MODE_LATEST_ONLY:
+          return L"LatestOnly";
+        case INGEST_MODE_DECIMATE:
+          return L"Decimate";
+        case INGEST_MODE_HISTORY:
+          return L"History";
+        default:
+          return L"EveryMessage";
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void IngestGate::SetPolicy(const IngestPolicy& policy)
+    {
+      m_policy = policy;
+      m_policy.RateHz = std::max(m_policy.RateHz, 0.001);
+      m_policy.HistoryLength = std::max<uint32_t>(m_policy.HistoryLength, 1);
+    }
+
+    //----------------------------------------------------------------------------
+    const IngestPolicy& IngestGate::GetPolicy() const
+    {
+      return m_policy;
+    }
+
+    //----------------------------------------------------------------------------
+    bool IngestGate::ShouldPull(double nowSec, bool consumersFetchOnRead) const
+    {
+      switch (m_policy.Mode)
+      {
+        case INGEST_MODE_LATEST_ONLY:
+          // Consumers that fetch on read get a fresher message than anything pulled now, callbacks still need a push
+          return !consumersFetchOnRead;
+        case INGEST_MODE_DECIMATE:
+          return m_pullCount == 0 || nowSec >= m_nextPullSec;
+        default:
+          return true;
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void IngestGate::OnPulled(double nowSec)
+    {
+      // Pulls follow a fixed schedule so that messages arriving off the grid do not drag the average rate down
+      // After a gap longer than a period the schedule restarts from now instead of bursting to catch up
+      const double period = 1.0 / m_policy.RateHz;
+      m_nextPullSec = (m_pullCount == 0 || nowSec - m_nextPullSec > period) ? nowSec + period : m_nextPullSec + period;
+      m_pullCount++;
+    }
+
+    //----------------------------------------------------------------------------
+    double IngestGate::GetNextPullSec() const
+    {
+      return m_policy.Mode == INGEST_MODE_DECIMATE && m_pullCount > 0 ? m_nextPullSec : 0.0;
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t IngestGate::GetPullCount() const
+    {
+      return m_pullCount;
+    }
+
+    //----------------------------------------------------------------------------
+    void ArrivalEstimator::OnPulled(double nowSec, double messageTimestamp)
+    {
+      // Sender timestamps, so the period is not skewed by when this side happened to look
+      if (m_pullCount > 0 && messageTimestamp > m_lastTimestamp)
+      {
+        const double interval = messageTimestamp - m_lastTimestamp;
+        m_intervalSec = m_intervalSec == 0.0 ? interval : m_intervalSec + (interval - m_intervalSec) * INTERVAL_SMOOTHING;
+      }
+      m_lastTimestamp = messageTimestamp;
+      m_referenceSec = nowSec;
+      m_pullCount++;
+    }
+
+    //----------------------------------------------------------------------------
+    double ArrivalEstimator::GetNextCheckSec(double nowSec)
+    {
+      if (m_referenceSec == 0.0)
+      {
+        m_referenceSec = nowSec;
+      }
+
+      // Waking a little early keeps the time this side takes to notice a message from adding up over messages
+      const double dueSec = m_referenceSec + m_intervalSec * EARLY_FRACTION;
+      if (dueSec > nowSec)
+      {
+        return dueSec;
+      }
+      const double spacing = std::min(std::max((nowSec - dueSec) / 2.0, MIN_CHECK_SPACING_SEC), MAX_CHECK_SPACING_SEC);
+      return nowSec + spacing;
+    }
+
+    //----------------------------------------------------------------------------
+    double ArrivalEstimator::GetIntervalSec() const
+    {
+      return m_intervalSec;
+    }
+  }
+}
\ No newline at end of file
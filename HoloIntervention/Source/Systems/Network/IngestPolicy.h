@@ -0,0 +1,101 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <string>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    enum IngestMode
+    {
+      INGEST_MODE_EVERY_MESSAGE,  // Pull each new message as soon as it is seen
+      INGEST_MODE_LATEST_ONLY,    // Converted only when a consumer reads it, mailbox subscribers fetch the latest message themselves
+      INGEST_MODE_DECIMATE,       // Pull at most RateHz times per second
+      INGEST_MODE_HISTORY         // Pull every message and keep the last HistoryLength of them for queries by timestamp
+    };
+
+    struct IngestPolicy
+    {
+      IngestMode      Mode = INGEST_MODE_EVERY_MESSAGE;
+      double          RateHz = 60.0;        // INGEST_MODE_DECIMATE only
+      uint32_t        HistoryLength = 8;    // INGEST_MODE_HISTORY only
+
+      static bool ModeFromString(const std::wstring& name, IngestMode& outMode);
+      static std::wstring ModeToString(IngestMode mode);
+    };
+
+    // Decides, for one stream, whether a new message is worth pulling (and thus decoding) now
+    // Messages that are skipped are never converted, the client only keeps the latest one
+    class IngestGate
+    {
+    public:
+      void SetPolicy(const IngestPolicy& policy);
+      const IngestPolicy& GetPolicy() const;
+
+      /// consumersFetchOnRead: every subscriber is a mailbox that fetches the latest message when it is read
+      bool ShouldPull(double nowSec, bool consumersFetchOnRead) const;
+      void OnPulled(double nowSec);
+
+      /// INGEST_MODE_DECIMATE: earliest time of the next pull, 0 otherwise
+      double GetNextPullSec() const;
+      uint64_t GetPullCount() const;
+
+    protected:
+      IngestPolicy    m_policy;
+      double          m_nextPullSec = 0.0;
+      uint64_t        m_pullCount = 0;
+    };
+
+    // Tells a receive thread when to look for the next message of one stream, the client has no arrival notification
+    // The stream's period is learned from the timestamps of the messages pulled. The thread sleeps until shortly before
+    // the next message is due, then looks often, backing off the later the message is, so a stream that stopped costs
+    // a few wakeups per second rather than one per millisecond.
+    class ArrivalEstimator
+    {
+    public:
+      void OnPulled(double nowSec, double messageTimestamp);
+
+      /// Time at which to look for the next message, the first call on a stream that was never pulled starts its wait
+      double GetNextCheckSec(double nowSec);
+
+      double GetIntervalSec() const;
+
+    protected:
+      double          m_referenceSec = 0.0;   // Last pull, or first check before any pull
+      double          m_lastTimestamp = 0.0;
+      double          m_intervalSec = 0.0;
+      uint64_t        m_pullCount = 0;
+
+      static const double   EARLY_FRACTION;
+      static const double   INTERVAL_SMOOTHING;
+      static const double   MIN_CHECK_SPACING_SEC;
+      static const double   MAX_CHECK_SPACING_SEC;
+    };
+  }
+}
\ No newline at end of file
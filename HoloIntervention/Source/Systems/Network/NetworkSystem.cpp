@@ -25,24 +25,34 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "pch.h"
 #include "Common.h"
 #include "Debug.h"
+#include "FrameBufferPool.h"
 #include "Icons.h"
+#include "LatencyTracer.h"
 #include "Log.h"
+#include "MathCommon.h"
 #include "NetworkSystem.h"
 #include "StepTimer.h"
 
 // System includes
 #include "NotificationSystem.h"
 
+// DirectXTex includes
+#include <DirectXTex.h>
+
 // IGT includes
 #include <IGTCommon.h>
 #include <igtlMessageBase.h>
 #include <igtlStatusMessage.h>
 
 // STL includes
+#include <algorithm>
+#include <chrono>
 #include <sstream>
+#include <thread>
 
 using namespace Concurrency;
 using namespace Windows::Data::Xml::Dom;
+using namespace Windows::Foundation::Numerics;
 using namespace Windows::Media::SpeechRecognition;
 using namespace Windows::Networking::Connectivity;
 using namespace Windows::Networking;
@@ -54,10 +64,12 @@ namespace HoloIntervention
   {
     const float NetworkSystem::NETWORK_BLINK_TIME_SEC = 0.75;
     const double NetworkSystem::CONNECT_TIMEOUT_SEC = 3.0;
-    const uint32_t NetworkSystem::RECONNECT_RETRY_DELAY_MSEC = 100;
-    const uint32_t NetworkSystem::RECONNECT_RETRY_COUNT = 10;
     const uint32 NetworkSystem::DICTATION_TIMEOUT_DELAY_MSEC = 8000;
     const uint32 NetworkSystem::KEEP_ALIVE_INTERVAL_MSEC = 1000;
+    const uint16 NetworkSystem::DISCOVERY_PORT = 18944;
+    const uint32 NetworkSystem::RECEIVE_DISCONNECTED_SLEEP_MSEC = 20;
+    const size_t NetworkSystem::TRANSFORM_QUEUE_CAPACITY = 256;
+    const size_t NetworkSystem::FRAME_QUEUE_CAPACITY = 4;
 
     //----------------------------------------------------------------------------
     task<bool> NetworkSystem::WriteConfigurationAsync(XmlDocument^ document)
@@ -74,7 +86,7 @@ namespace HoloIntervention
 
         auto connectionsElem = document->CreateElement(L"IGTConnections");
 
-        for (auto connector : m_connectors)
+        for (auto& connector : GetConnectorSnapshot()->Connectors)
         {
           auto connectionElem = document->CreateElement(L"Connection");
           connectionElem->SetAttribute(L"Name", ref new Platform::String(connector->Name.c_str()));
@@ -90,6 +102,37 @@ namespace HoloIntervention
           {
             connectionElem->SetAttribute(L"EmbeddedImageTransformName", connector->Connector->EmbeddedImageTransformName->GetTransformName());
           }
+          if (connector->IO == IO_MODE_DEDICATED)
+          {
+            connectionElem->SetAttribute(L"IOMode", L"Dedicated");
+          }
+          {
+            std::lock_guard<std::mutex> guard(m_subscriptionSourceMutex);
+            for (auto& pair : m_ingestPolicies)
+            {
+              const IngestPolicyEntry& policyEntry = pair.second;
+              if (policyEntry.HashedConnectionName != connector->HashedName)
+              {
+                continue;
+              }
+              auto policyElem = document->CreateElement(L"IngestPolicy");
+              policyElem->SetAttribute(L"Type", ref new Platform::String(Network::SubscriptionMessageTypeToString(policyEntry.Type).c_str()));
+              if (!policyEntry.Name.empty())
+              {
+                policyElem->SetAttribute(L"Name", ref new Platform::String(policyEntry.Name.c_str()));
+              }
+              policyElem->SetAttribute(L"Mode", ref new Platform::String(Network::IngestPolicy::ModeToString(policyEntry.Policy.Mode).c_str()));
+              if (policyEntry.Policy.Mode == Network::INGEST_MODE_DECIMATE)
+              {
+                policyElem->SetAttribute(L"RateHz", policyEntry.Policy.RateHz.ToString());
+              }
+              if (policyEntry.Policy.Mode == Network::INGEST_MODE_HISTORY)
+              {
+                policyElem->SetAttribute(L"HistoryLength", policyEntry.Policy.HistoryLength.ToString());
+              }
+              connectionElem->AppendChild(policyElem);
+            }
+          }
           connectionsElem->AppendChild(connectionElem);
         }
 
@@ -164,6 +207,46 @@ namespace HoloIntervention
             }
           }
 
+          if (HasAttribute(L"IOMode", node))
+          {
+            Platform::String^ ioMode = dynamic_cast<Platform::String^>(node->Attributes->GetNamedItem(L"IOMode")->NodeValue);
+            entry->IO = IsEqualInsensitive(L"Dedicated", ioMode) ? IO_MODE_DEDICATED : IO_MODE_SHARED;
+          }
+
+          for (auto policyNode : node->SelectNodes(L"IngestPolicy"))
+          {
+            Network::SubscriptionMessageType type;
+            Network::IngestPolicy policy;
+            if (!HasAttribute(L"Type", policyNode) || !HasAttribute(L"Mode", policyNode) ||
+                !Network::SubscriptionMessageTypeFromString(dynamic_cast<Platform::String^>(policyNode->Attributes->GetNamedItem(L"Type")->NodeValue)->Data(), type) ||
+                !Network::IngestPolicy::ModeFromString(dynamic_cast<Platform::String^>(policyNode->Attributes->GetNamedItem(L"Mode")->NodeValue)->Data(), policy.Mode))
+            {
+              LOG_WARNING("Ignoring IngestPolicy without a valid Type and Mode.");
+              continue;
+            }
+            try
+            {
+              if (HasAttribute(L"RateHz", policyNode))
+              {
+                policy.RateHz = std::stod(dynamic_cast<Platform::String^>(policyNode->Attributes->GetNamedItem(L"RateHz")->NodeValue)->Data());
+              }
+              if (HasAttribute(L"HistoryLength", policyNode))
+              {
+                policy.HistoryLength = static_cast<uint32>(std::stoul(dynamic_cast<Platform::String^>(policyNode->Attributes->GetNamedItem(L"HistoryLength")->NodeValue)->Data()));
+              }
+            }
+            catch (const std::exception&)
+            {
+              LOG_WARNING("Unable to parse IngestPolicy RateHz/HistoryLength, using defaults.");
+            }
+            UWPOpenIGTLink::TransformName^ transformName = nullptr;
+            if (type == Network::SUBSCRIPTION_MESSAGE_TRANSFORM && HasAttribute(L"Name", policyNode))
+            {
+              transformName = ref new UWPOpenIGTLink::TransformName(dynamic_cast<Platform::String^>(policyNode->Attributes->GetNamedItem(L"Name")->NodeValue));
+            }
+            SetIngestPolicy(entry->HashedName, type, transformName, policy);
+          }
+
           // Create icon
           modelLoadingTasks.push_back(m_icons.AddEntryAsync(L"Assets/Models/network_icon.cmo", entry->HashedName).then([this, entry](std::shared_ptr<UI::Icon> iconEntry)
           {
@@ -171,8 +254,12 @@ namespace HoloIntervention
             return iconEntry;
           }));
 
-          std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-          m_connectors.push_back(entry);
+          // Started before the connector is published so the dispatch thread never sees the receiver change
+          if (entry->IO == IO_MODE_DEDICATED)
+          {
+            StartReceiveWorker(entry);
+          }
+          AddConnector(entry);
         }
 
         return when_all(begin(modelLoadingTasks), end(modelLoadingTasks)).then([this](std::vector<std::shared_ptr<UI::Icon>> entries)
@@ -191,74 +278,105 @@ namespace HoloIntervention
       , m_icons(icons)
       , m_debug(debug)
     {
-      /*
-      disabled, currently crashes
-      FindServersAsync().then([this](task<std::vector<std::wstring>> findServerTask)
+      FindServersAsync().then([](task<std::vector<std::wstring>> findServerTask)
       {
-      std::vector<std::wstring> servers;
-      try
-      {
-      servers = findServerTask.get();
-      }
-      catch (const std::exception& e)
-      {
-      LOG(LogLevelType::LOG_LEVEL_ERROR, std::string("IGTConnector failed to find servers: ") + e.what());
-      }
+        std::vector<std::wstring> servers;
+        try
+        {
+          servers = findServerTask.get();
+        }
+        catch (const std::exception& e)
+        {
+          LOG_ERROR(std::string("IGTConnector failed to find servers: ") + e.what());
+          return;
+        }
+
+        for (auto& server : servers)
+        {
+          WLOG_INFO(L"Found IGT server at " + ref new Platform::String(server.c_str()));
+        }
       });
-      */
+
+      // Each callback subscriber runs on the PPL pool, one callback at a time, so a slow one only coalesces its own stream
+      auto executor = [](std::function<void()> work)
+      {
+        create_task([work]()
+        {
+          try
+          {
+            work();
+          }
+          catch (const std::exception& e)
+          {
+            LOG_ERROR(std::string("Subscription callback failed: ") + e.what());
+          }
+        });
+      };
+      m_transformHub.SetExecutor(executor);
+      m_trackedFrameHub.SetExecutor(executor);
+      m_imageHub.SetExecutor(executor);
+
+      m_sharedReceiver = StartReceiveWorker(nullptr);
+      m_dispatchThread = std::thread(&NetworkSystem::DispatchLoop, this);
     }
 
     //----------------------------------------------------------------------------
     NetworkSystem::~NetworkSystem()
     {
+      m_serverDiscovery->Cancel();
+      StopReceiveWorkers();
+      {
+        std::lock_guard<std::mutex> guard(m_dispatchMutex);
+        m_dispatchStop = true;
+      }
+      m_dispatchCondition.notify_one();
+      if (m_dispatchThread.joinable())
+      {
+        m_dispatchThread.join();
+      }
+      StopRecording();
     }
 
     //----------------------------------------------------------------------------
     task<bool> NetworkSystem::ConnectAsync(uint64 hashedConnectionName, double timeoutSec /*= CONNECT_TIMEOUT_SEC*/, task_options& options /*= Concurrency::task_options()*/)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector == nullptr)
       {
-        return hashedConnectionName == entry->HashedName;
-      });
+        return task_from_result(false);
+      }
 
-      if (iter != end(m_connectors))
-      {
-        assert((*iter)->Connector != nullptr);
+      assert(connector->Connector != nullptr);
 
-        (*iter)->State = CONNECTION_STATE_CONNECTING;
+      connector->State = CONNECTION_STATE_CONNECTING;
 
-        return create_task((*iter)->Connector->ConnectAsync(timeoutSec), options).then([this, hashedConnectionName](task<bool> connectTask)
+      return create_task(connector->Connector->ConnectAsync(timeoutSec), options).then([this, connector](task<bool> connectTask)
+      {
+        bool result(false);
+        try
         {
-          bool result(false);
-          try
-          {
-            result = connectTask.get();
-          }
-          catch (const std::exception& e)
-          {
-            LOG(LogLevelType::LOG_LEVEL_ERROR, std::string("IGTConnector failed to connect: ") + e.what());
-            return false;
-          }
-
-          std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-          auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-          {
-            return hashedConnectionName == entry->HashedName;
-          });
+          result = connectTask.get();
+        }
+        catch (const std::exception& e)
+        {
+          LOG(LogLevelType::LOG_LEVEL_ERROR, std::string("IGTConnector failed to connect: ") + e.what());
+          connector->State = CONNECTION_STATE_DISCONNECTED;
+          m_reconnectScheduler.OnConnectFailed(connector->HashedName, e.what());
+          return false;
+        }
 
-          if (result)
-          {
-            (*iter)->State = CONNECTION_STATE_CONNECTED;
-          }
-          else
-          {
-            (*iter)->State = CONNECTION_STATE_DISCONNECTED;
-          }
-          return result;
-        });
-      }
-      return task_from_result(false);
+        connector->State = result ? CONNECTION_STATE_CONNECTED : CONNECTION_STATE_DISCONNECTED;
+        if (result)
+        {
+          m_reconnectScheduler.OnConnected(connector->HashedName);
+          WakeReceiveWorkers();
+        }
+        else
+        {
+          m_reconnectScheduler.OnConnectFailed(connector->HashedName, "Connection refused or timed out.");
+        }
+        return result;
+      });
     }
 
     //----------------------------------------------------------------------------
@@ -267,8 +385,7 @@ namespace HoloIntervention
       // Connect all connectors
       auto tasks = std::vector<task<bool>>();
 
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      for (auto entry : m_connectors)
+      for (auto& entry : GetConnectorSnapshot()->Connectors)
       {
         auto task = this->ConnectAsync(entry->HashedName, 4.0);
         tasks.push_back(task);
@@ -280,19 +397,14 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     bool NetworkSystem::IsConnected(uint64 hashedConnectionName) const
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      return iter == end(m_connectors) ? false : (*iter)->Connector->Connected;
+      auto connector = FindConnector(hashedConnectionName);
+      return connector == nullptr ? false : connector->Connector->Connected;
     }
 
     //----------------------------------------------------------------------------
     HoloIntervention::System::NetworkSystem::ConnectorList NetworkSystem::GetConnectors()
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      return m_connectors;
+      return GetConnectorSnapshot()->Connectors;
     }
 
     //----------------------------------------------------------------------------
@@ -300,13 +412,9 @@ namespace HoloIntervention
     {
       UWPOpenIGTLink::CommandData cmdData = {0, false};
 
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
+      auto connector = FindConnector(hashedConnectionName);
 
-      if (iter == end(m_connectors))
+      if (connector == nullptr)
       {
         LOG_ERROR("Unable to locate connector.");
         return task_from_result(cmdData);
@@ -319,31 +427,54 @@ namespace HoloIntervention
                     ref new Platform::String(pair.second.c_str()));
       }
 
-      return create_task((*iter)->Connector->SendCommandAsync(ref new Platform::String(commandName.c_str()), map));
+      return create_task(connector->Connector->SendCommandAsync(ref new Platform::String(commandName.c_str()), map));
     }
 
     //----------------------------------------------------------------------------
     bool NetworkSystem::IsCommandComplete(uint64 hashedConnectionName, uint32 commandId)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
+      auto connector = FindConnector(hashedConnectionName);
 
-      if (iter == end(m_connectors))
+      if (connector == nullptr)
       {
         LOG_ERROR("Unable to locate connector.");
         return false;
       }
 
-      return (*iter)->Connector->IsCommandComplete(commandId);
+      return connector->Connector->IsCommandComplete(commandId);
+    }
+
+    //----------------------------------------------------------------------------
+    const NetworkSystem::ConnectorSnapshot* NetworkSystem::GetConnectorSnapshot() const
+    {
+      return m_connectors.Load();
+    }
+
+    //----------------------------------------------------------------------------
+    NetworkSystem::ConnectorEntry* NetworkSystem::FindConnector(uint64 hashedConnectionName) const
+    {
+      // The entry is owned by this and every later snapshot, all of which live as long as this system
+      auto snapshot = GetConnectorSnapshot();
+      auto iter = snapshot->Lookup.find(hashedConnectionName);
+      return iter == snapshot->Lookup.end() ? nullptr : iter->second.get();
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::AddConnector(std::shared_ptr<ConnectorEntry> entry)
+    {
+      // Writers are serialized, readers continue to use the previous snapshot until the new one is published
+      m_connectors.Update([&entry](ConnectorSnapshot & snapshot)
+      {
+        snapshot.Connectors.push_back(entry);
+        snapshot.Lookup[entry->HashedName] = entry;
+        return true;
+      });
     }
 
     //----------------------------------------------------------------------------
     void NetworkSystem::ProcessNetworkLogic(DX::StepTimer& timer)
     {
-      for (auto& connector : m_connectors)
+      for (auto& connector : GetConnectorSnapshot()->Connectors)
       {
         if (!connector->Icon.m_iconEntry->GetModel()->IsLoaded())
         {
@@ -401,6 +532,11 @@ namespace HoloIntervention
       callbackMap[L"connect"] = [this](SpeechRecognitionResult ^ result)
       {
         uint64 connectMessageId = m_notificationSystem.QueueMessage(L"Connecting...");
+        for (auto& entry : GetConnectorSnapshot()->Connectors)
+        {
+          // An explicit request closes any open circuit
+          m_reconnectScheduler.Reset(entry->HashedName);
+        }
         auto task = this->ConnectAsync(4.0);
       };
 
@@ -438,11 +574,34 @@ namespace HoloIntervention
         */
       };
 
+      callbackMap[L"start recording"] = [this](SpeechRecognitionResult ^ result)
+      {
+        auto calendar = ref new Windows::Globalization::Calendar();
+        calendar->SetToNow();
+        auto fileName = std::wstring(ApplicationData::Current->LocalFolder->Path->Data()) + L"\\IGTRecording_" + calendar->YearAsString()->Data() + L"-" + calendar->MonthAsNumericString()->Data() + L"-" + calendar->DayAsString()->Data() + L"T" + calendar->HourAsPaddedString(2)->Data() + L"h" + calendar->MinuteAsPaddedString(2)->Data() + L"m" + calendar->SecondAsPaddedString(2)->Data() + L"s.hirec";
+        if (StartRecording(fileName))
+        {
+          m_notificationSystem.QueueMessage(L"Recording started.");
+        }
+        else
+        {
+          m_notificationSystem.QueueMessage(L"Unable to start recording.");
+        }
+      };
+
+      callbackMap[L"stop recording"] = [this](SpeechRecognitionResult ^ result)
+      {
+        if (StopRecording())
+        {
+          m_notificationSystem.QueueMessage(L"Recording saved.");
+        }
+      };
+
       callbackMap[L"disconnect"] = [this](SpeechRecognitionResult ^ result)
       {
-        std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-        for (auto entry : m_connectors)
+        for (auto& entry : GetConnectorSnapshot()->Connectors)
         {
+          m_reconnectScheduler.Reset(entry->HashedName);
           entry->Connector->Disconnect();
           entry->State = CONNECTION_STATE_DISCONNECTED;
         }
@@ -454,85 +613,80 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     UWPOpenIGTLink::TransformName^ NetworkSystem::GetEmbeddedImageTransformName(uint64 hashedConnectionName) const
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      return iter == end(m_connectors) ? nullptr : (*iter)->Connector->EmbeddedImageTransformName;
+      auto connector = FindConnector(hashedConnectionName);
+      return connector == nullptr ? nullptr : connector->Connector->EmbeddedImageTransformName;
     }
 
     //----------------------------------------------------------------------------
     void NetworkSystem::SetEmbeddedImageTransformName(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ name)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        (*iter)->Connector->EmbeddedImageTransformName = name;
+        connector->Connector->EmbeddedImageTransformName = name;
       }
     }
 
     //----------------------------------------------------------------------------
     void NetworkSystem::Disconnect(uint64 hashedConnectionName)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
+      auto connector = FindConnector(hashedConnectionName);
 
-      if (iter != end(m_connectors))
+      if (connector != nullptr)
       {
-        (*iter)->Connector->Disconnect();
-        (*iter)->State = CONNECTION_STATE_DISCONNECTED;
+        m_reconnectScheduler.Reset(hashedConnectionName);
+        connector->Connector->Disconnect();
+        connector->State = CONNECTION_STATE_DISCONNECTED;
       }
     }
 
+    //----------------------------------------------------------------------------
+    bool NetworkSystem::GetReconnectMetrics(uint64 hashedConnectionName, Network::ReconnectScheduler::Metrics& outMetrics) const
+    {
+      return m_reconnectScheduler.GetMetrics(hashedConnectionName, outMetrics);
+    }
+
     //----------------------------------------------------------------------------
     bool NetworkSystem::GetConnectionState(uint64 hashedConnectionName, ConnectionState& state) const
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        state = (*iter)->State;
+        state = connector->State;
         return true;
       }
       return false;
     }
 
     //----------------------------------------------------------------------------
-    void NetworkSystem::SetHostname(uint64 hashedConnectionName, const std::wstring& hostname)
+    bool NetworkSystem::GetIOMode(uint64 hashedConnectionName, IOMode& mode) const
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector == nullptr)
       {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+        return false;
+      }
+      mode = connector->IO;
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::SetHostname(uint64 hashedConnectionName, const std::wstring& hostname)
+    {
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        (*iter)->Connector->ServerHost = ref new HostName(ref new Platform::String(hostname.c_str()));
+        connector->Connector->ServerHost = ref new HostName(ref new Platform::String(hostname.c_str()));
       }
     }
 
     //----------------------------------------------------------------------------
     bool NetworkSystem::GetHostname(uint64 hashedConnectionName, std::wstring& hostName) const
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        hostName = (*iter)->Connector->ServerHost->DisplayName->Data();
+        hostName = connector->Connector->ServerHost->DisplayName->Data();
         return true;
       }
       return false;
@@ -541,28 +695,20 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     void NetworkSystem::SetPort(uint64 hashedConnectionName, int32 port)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        (*iter)->Connector->ServerPort = port.ToString();
+        connector->Connector->ServerPort = port.ToString();
       }
     }
 
     //----------------------------------------------------------------------------
     bool NetworkSystem::GetPort(uint64 hashedConnectionName, int32& port) const
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        port = std::stoi((*iter)->Connector->ServerPort->Data());
+        port = std::stoi(connector->Connector->ServerPort->Data());
         return true;
       }
       return false;
@@ -571,14 +717,10 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     UWPOpenIGTLink::TrackedFrame^ NetworkSystem::GetTrackedFrame(uint64 hashedConnectionName, double& latestTimestamp)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        auto latestFrame = (*iter)->Connector->GetTrackedFrame(latestTimestamp);
+        auto latestFrame = connector->Connector->GetTrackedFrame(latestTimestamp);
         if (latestFrame == nullptr)
         {
           return nullptr;
@@ -586,6 +728,11 @@ namespace HoloIntervention
         try
         {
           latestTimestamp = latestFrame->Timestamp;
+          StampHandoff(*connector, L"IMAGE", latestTimestamp);
+          if (m_recording)
+          {
+            RecordTrackedFrame(*connector, latestFrame, latestTimestamp);
+          }
         }
         catch (Platform::ObjectDisposedException^) { return nullptr; }
         return latestFrame;
@@ -596,14 +743,10 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     UWPOpenIGTLink::TransformListABI^ NetworkSystem::GetTDataFrame(uint64 hashedConnectionName, double& latestTimestamp)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        auto latestFrame = (*iter)->Connector->GetTDataFrame(latestTimestamp);
+        auto latestFrame = connector->Connector->GetTDataFrame(latestTimestamp);
         if (latestFrame == nullptr)
         {
           return nullptr;
@@ -613,6 +756,11 @@ namespace HoloIntervention
           if (latestFrame->Size > 0)
           {
             latestTimestamp = latestFrame->GetAt(0)->Timestamp;
+            StampHandoff(*connector, L"TDATA", latestTimestamp);
+            if (m_recording)
+            {
+              RecordTDataFrame(*connector, latestFrame);
+            }
           }
           else
           {
@@ -628,14 +776,10 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     UWPOpenIGTLink::Transform^ NetworkSystem::GetTransform(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName, double& latestTimestamp)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        auto latestFrame = (*iter)->Connector->GetTransform(transformName, latestTimestamp);
+        auto latestFrame = connector->Connector->GetTransform(transformName, latestTimestamp);
         if (latestFrame == nullptr)
         {
           return nullptr;
@@ -643,6 +787,11 @@ namespace HoloIntervention
         try
         {
           latestTimestamp = latestFrame->Timestamp;
+          StampHandoff(*connector, transformName->GetTransformName()->Data(), latestTimestamp);
+          if (m_recording)
+          {
+            RecordTransform(*connector, latestFrame);
+          }
         }
         catch (Platform::ObjectDisposedException^) { return nullptr; }
         return latestFrame;
@@ -653,14 +802,10 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     UWPOpenIGTLink::Polydata^ NetworkSystem::GetPolydata(uint64 hashedConnectionName, Platform::String^ name)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        auto polydata = (*iter)->Connector->GetPolydata(name);
+        auto polydata = connector->Connector->GetPolydata(name);
         return polydata;
       }
       return nullptr;
@@ -669,19 +814,128 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     UWPOpenIGTLink::VideoFrame^ NetworkSystem::GetImage(uint64 hashedConnectionName, double& latestTimestamp)
     {
-      std::lock_guard<std::recursive_mutex> guard(m_connectorsMutex);
-      auto iter = std::find_if(begin(m_connectors), end(m_connectors), [hashedConnectionName](std::shared_ptr<ConnectorEntry> entry)
-      {
-        return hashedConnectionName == entry->HashedName;
-      });
-      if (iter != end(m_connectors))
+      auto connector = FindConnector(hashedConnectionName);
+      if (connector != nullptr)
       {
-        auto image = (*iter)->Connector->GetImage(latestTimestamp);
+        auto image = connector->Connector->GetImage(latestTimestamp);
+        if (image != nullptr)
+        {
+          try
+          {
+            StampHandoff(*connector, L"IMAGE", image->Timestamp);
+            if (m_recording)
+            {
+              RecordVideoFrame(*connector, image, image->Timestamp);
+            }
+          }
+          catch (Platform::ObjectDisposedException^) { return nullptr; }
+        }
         return image;
       }
       return nullptr;
     }
 
+    //----------------------------------------------------------------------------
+    uint64 NetworkSystem::SubscribeTransform(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName, TransformHub::Callback callback)
+    {
+      return m_transformHub.Subscribe(AddSubscriptionSource(hashedConnectionName, Network::SUBSCRIPTION_MESSAGE_TRANSFORM, transformName), callback);
+    }
+
+    //----------------------------------------------------------------------------
+    uint64 NetworkSystem::SubscribeTransform(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName, TransformHub::MailboxPtr& outMailbox)
+    {
+      uint64 key = AddSubscriptionSource(hashedConnectionName, Network::SUBSCRIPTION_MESSAGE_TRANSFORM, transformName);
+      auto source = FindSubscriptionSource(key);
+      return m_transformHub.Subscribe(key, outMailbox, [this, source](double latestTimestamp, Network::Mailbox<UWPOpenIGTLink::Transform^>::Entry & outEntry)
+      {
+        ReceivedMessage message;
+        if (!source->FetchOnRead || !GetLatestMessage(*source, latestTimestamp, message))
+        {
+          return false;
+        }
+        outEntry.Payload = message.Transform;
+        outEntry.Timestamp = message.Timestamp;
+        return true;
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    uint64 NetworkSystem::SubscribeTrackedFrame(uint64 hashedConnectionName, TrackedFrameHub::Callback callback)
+    {
+      return m_trackedFrameHub.Subscribe(AddSubscriptionSource(hashedConnectionName, Network::SUBSCRIPTION_MESSAGE_TRACKED_FRAME, nullptr), callback);
+    }
+
+    //----------------------------------------------------------------------------
+    uint64 NetworkSystem::SubscribeTrackedFrame(uint64 hashedConnectionName, TrackedFrameHub::MailboxPtr& outMailbox)
+    {
+      uint64 key = AddSubscriptionSource(hashedConnectionName, Network::SUBSCRIPTION_MESSAGE_TRACKED_FRAME, nullptr);
+      auto source = FindSubscriptionSource(key);
+      return m_trackedFrameHub.Subscribe(key, outMailbox, [this, source](double latestTimestamp, Network::Mailbox<UWPOpenIGTLink::TrackedFrame^>::Entry & outEntry)
+      {
+        ReceivedMessage message;
+        if (!source->FetchOnRead || !GetLatestMessage(*source, latestTimestamp, message))
+        {
+          return false;
+        }
+        outEntry.Payload = message.TrackedFrame;
+        outEntry.Timestamp = message.Timestamp;
+        return true;
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    uint64 NetworkSystem::SubscribeImage(uint64 hashedConnectionName, ImageHub::Callback callback)
+    {
+      return m_imageHub.Subscribe(AddSubscriptionSource(hashedConnectionName, Network::SUBSCRIPTION_MESSAGE_IMAGE, nullptr), callback);
+    }
+
+    //----------------------------------------------------------------------------
+    uint64 NetworkSystem::SubscribeImage(uint64 hashedConnectionName, ImageHub::MailboxPtr& outMailbox)
+    {
+      uint64 key = AddSubscriptionSource(hashedConnectionName, Network::SUBSCRIPTION_MESSAGE_IMAGE, nullptr);
+      auto source = FindSubscriptionSource(key);
+      return m_imageHub.Subscribe(key, outMailbox, [this, source](double latestTimestamp, Network::Mailbox<UWPOpenIGTLink::VideoFrame^>::Entry & outEntry)
+      {
+        ReceivedMessage message;
+        if (!source->FetchOnRead || !GetLatestMessage(*source, latestTimestamp, message))
+        {
+          return false;
+        }
+        outEntry.Payload = message.Image;
+        outEntry.Timestamp = message.Timestamp;
+        return true;
+      });
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::Unsubscribe(uint64 subscriptionToken)
+    {
+      uint64 key(0);
+      bool stillNeeded(false);
+      if (m_transformHub.Unsubscribe(subscriptionToken, key))
+      {
+        stillNeeded = m_transformHub.HasSubscribers(key);
+      }
+      else if (m_trackedFrameHub.Unsubscribe(subscriptionToken, key))
+      {
+        stillNeeded = m_trackedFrameHub.HasSubscribers(key);
+      }
+      else if (m_imageHub.Unsubscribe(subscriptionToken, key))
+      {
+        stillNeeded = m_imageHub.HasSubscribers(key);
+      }
+      else
+      {
+        return;
+      }
+
+      if (!stillNeeded)
+      {
+        std::lock_guard<std::mutex> guard(m_subscriptionSourceMutex);
+        m_subscriptionSources.erase(key);
+      }
+    }
+
     //-----------------------------------------------------------------------------
     void NetworkSystem::Update(DX::StepTimer& timer)
     {
@@ -692,69 +946,729 @@ namespace HoloIntervention
 
       ProcessNetworkLogic(timer);
 
-      for (auto connector : m_connectors)
+      for (auto& connector : GetConnectorSnapshot()->Connectors)
       {
         if (connector->State == CONNECTION_STATE_CONNECTED && !connector->Connector->Connected)
         {
-          // Other end has likely dropped us, update the state (and thus the UI), and reconnect
+          // Other end has likely dropped us, update the state (and thus the UI), and let the scheduler reconnect
           LOG_INFO("Connection dropped by server. Reconnecting.");
           connector->State = CONNECTION_STATE_DISCONNECTED;
-          ConnectAsync(connector->HashedName, 4.0);
+          m_reconnectScheduler.OnConnectionLost(connector->HashedName);
         }
       }
+
+      for (auto hashedConnectionName : m_reconnectScheduler.Tick())
+      {
+        if (FindConnector(hashedConnectionName) == nullptr)
+        {
+          m_reconnectScheduler.Reset(hashedConnectionName);
+          continue;
+        }
+        ConnectAsync(hashedConnectionName, m_reconnectScheduler.GetSettings().ConnectTimeoutSec);
+      }
     }
 
     //----------------------------------------------------------------------------
-    task<std::vector<std::wstring>> NetworkSystem::FindServersAsync()
+    bool NetworkSystem::StartRecording(const std::wstring& fileName)
     {
-      return create_task([this]()
+      if (!m_recorder.Open(fileName))
       {
-        std::vector<std::wstring> results;
+        WLOG_ERROR(L"Unable to open recording file: " + ref new Platform::String(fileName.c_str()));
+        return false;
+      }
+      m_recording = true;
+      WLOG_INFO(L"Recording IGT messages to " + ref new Platform::String(fileName.c_str()));
+      return true;
+    }
 
-        auto hostNames = NetworkInformation::GetHostNames();
+    //----------------------------------------------------------------------------
+    bool NetworkSystem::StopRecording()
+    {
+      if (!m_recording.exchange(false))
+      {
+        return false;
+      }
 
-        for (auto host : hostNames)
-        {
-          if (host->Type == HostNameType::Ipv4)
+      auto stats = m_recorder.GetStatistics();
+      bool result = m_recorder.Close();
+      std::stringstream ss;
+      ss << "Recording closed: " << stats.Records << " records, " << stats.RawBytes << " bytes compressed to " << stats.StoredBytes << " bytes, " << stats.QueueDropped << " records dropped by a full write queue.";
+      LOG_INFO(ss.str());
+      return result;
+    }
+
+    //----------------------------------------------------------------------------
+    bool NetworkSystem::IsRecording() const
+    {
+      return m_recording;
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::SetIngestPolicy(uint64 hashedConnectionName, Network::SubscriptionMessageType type, UWPOpenIGTLink::TransformName^ transformName, const Network::IngestPolicy& policy)
+    {
+      IngestPolicyEntry entry;
+      entry.HashedConnectionName = hashedConnectionName;
+      entry.Type = type;
+      entry.Name = transformName == nullptr ? L"" : transformName->GetTransformName()->Data();
+      entry.Policy = policy;
+      uint64 key = Network::MakeSubscriptionKey(hashedConnectionName, type, transformName == nullptr ? 0 : HashString(transformName->GetTransformName()));
+
+      std::lock_guard<std::mutex> guard(m_subscriptionSourceMutex);
+      m_ingestPolicies[key] = entry;
+      auto iter = m_subscriptionSources.find(key);
+      if (iter != m_subscriptionSources.end())
+      {
+        // The pulling thread owns the gate, it picks this up on its next pass
+        std::lock_guard<std::mutex> sourceGuard(iter->second->Mutex);
+        iter->second->PendingPolicy = policy;
+        iter->second->PolicyChanged = true;
+        iter->second->FetchOnRead = policy.Mode == Network::INGEST_MODE_LATEST_ONLY;
+      }
+      WakeReceiveWorkers();
+    }
+
+    //----------------------------------------------------------------------------
+    bool NetworkSystem::GetTransformAtTime(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName, double timestamp, float4x4& outMatrix, bool& outValid)
+    {
+      auto history = GetTransformHistory(hashedConnectionName, transformName);
+      TransformHistory::Matrix matrix;
+      if (history == nullptr || !history->GetTransform(timestamp, matrix, outValid))
+      {
+        return false;
+      }
+      return ArrayToFloat4x4(matrix, outMatrix);
+    }
+
+    //----------------------------------------------------------------------------
+    std::shared_ptr<TransformHistory> NetworkSystem::GetTransformHistory(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName)
+    {
+      uint64 key = Network::MakeSubscriptionKey(hashedConnectionName, Network::SUBSCRIPTION_MESSAGE_TRANSFORM, HashString(transformName->GetTransformName()));
+      auto source = FindSubscriptionSource(key);
+      if (source == nullptr)
+      {
+        return nullptr;
+      }
+
+      std::lock_guard<std::mutex> sourceGuard(source->Mutex);
+      return source->History;
+    }
+
+    //----------------------------------------------------------------------------
+    size_t NetworkSystem::GetTransformHistoryMemoryUsage()
+    {
+      size_t bytes(0);
+      for (auto& pair : GetSubscriptionSources())
+      {
+        std::lock_guard<std::mutex> sourceGuard(pair.second->Mutex);
+        if (pair.second->History != nullptr)
+        {
+          bytes += pair.second->History->GetMemoryUsageBytes();
+        }
+      }
+      return bytes;
+    }
+
+    //----------------------------------------------------------------------------
+    uint64 NetworkSystem::AddSubscriptionSource(uint64 hashedConnectionName, Network::SubscriptionMessageType type, UWPOpenIGTLink::TransformName^ transformName)
+    {
+      uint64 hashedDeviceName = transformName == nullptr ? 0 : HashString(transformName->GetTransformName());
+      uint64 key = Network::MakeSubscriptionKey(hashedConnectionName, type, hashedDeviceName);
+
+      {
+        std::lock_guard<std::mutex> guard(m_subscriptionSourceMutex);
+        if (m_subscriptionSources.find(key) != m_subscriptionSources.end())
+        {
+          return key;
+        }
+
+        auto source = std::make_shared<SubscriptionSource>();
+        source->HashedConnectionName = hashedConnectionName;
+        source->Type = type;
+        source->Name = transformName;
+        auto policyIter = m_ingestPolicies.find(key);
+        if (policyIter != m_ingestPolicies.end())
+        {
+          source->Gate.SetPolicy(policyIter->second.Policy);
+          source->FetchOnRead = policyIter->second.Policy.Mode == Network::INGEST_MODE_LATEST_ONLY;
+          UpdateTransformHistory(*source);
+        }
+        m_subscriptionSources[key] = source;
+      }
+      WakeReceiveWorkers();
+      return key;
+    }
+
+    //----------------------------------------------------------------------------
+    std::vector<std::pair<uint64, std::shared_ptr<NetworkSystem::SubscriptionSource>>> NetworkSystem::GetSubscriptionSources()
+    {
+      std::lock_guard<std::mutex> guard(m_subscriptionSourceMutex);
+      return std::vector<std::pair<uint64, std::shared_ptr<SubscriptionSource>>>(m_subscriptionSources.begin(), m_subscriptionSources.end());
+    }
+
+    //----------------------------------------------------------------------------
+    std::shared_ptr<NetworkSystem::SubscriptionSource> NetworkSystem::FindSubscriptionSource(uint64 key)
+    {
+      std::lock_guard<std::mutex> guard(m_subscriptionSourceMutex);
+      auto iter = m_subscriptionSources.find(key);
+      return iter == m_subscriptionSources.end() ? nullptr : iter->second;
+    }
+
+    //----------------------------------------------------------------------------
+    bool NetworkSystem::PullSubscription(uint64 key, SubscriptionSource& source, ReceivedMessage& outMessage)
+    {
+      if (source.PolicyChanged.exchange(false))
+      {
+        std::lock_guard<std::mutex> guard(source.Mutex);
+        source.Gate.SetPolicy(source.PendingPolicy);
+        UpdateTransformHistory(source);
+      }
+
+      // Skipped messages are never converted, the client only keeps the latest
+      const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+      bool consumersFetchOnRead(false);
+      if (source.Gate.GetPolicy().Mode == Network::INGEST_MODE_LATEST_ONLY)
+      {
+        switch (source.Type)
+        {
+          case Network::SUBSCRIPTION_MESSAGE_TRANSFORM:
+            consumersFetchOnRead = m_transformHub.AllSubscribersFetch(key);
+            break;
+          case Network::SUBSCRIPTION_MESSAGE_TRACKED_FRAME:
+            consumersFetchOnRead = m_trackedFrameHub.AllSubscribersFetch(key);
+            break;
+          case Network::SUBSCRIPTION_MESSAGE_IMAGE:
+            consumersFetchOnRead = m_imageHub.AllSubscribersFetch(key);
+            break;
+        }
+      }
+      if (!source.Gate.ShouldPull(now, consumersFetchOnRead))
+      {
+        return false;
+      }
+
+      outMessage = ReceivedMessage();
+      outMessage.Key = key;
+      if (!GetLatestMessage(source, source.LatestTimestamp, outMessage))
+      {
+        return false;
+      }
+
+      source.Gate.OnPulled(now);
+      source.Arrival.OnPulled(now, outMessage.Timestamp);
+
+      if (source.History != nullptr && outMessage.Transform != nullptr)
+      {
+        // History has its own lock, the source mutex only guards swapping it
+        try
+        {
+          TransformHistory::Matrix matrix;
+          Float4x4ToArray(outMessage.Transform->Matrix, matrix.data());
+          source.History->Add(outMessage.Transform->Timestamp, matrix, outMessage.Transform->Valid);
+        }
+        catch (Platform::ObjectDisposedException^) {}
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    bool NetworkSystem::GetLatestMessage(const SubscriptionSource& source, double& latestTimestamp, ReceivedMessage& outMessage)
+    {
+      outMessage.Type = source.Type;
+      switch (source.Type)
+      {
+        case Network::SUBSCRIPTION_MESSAGE_TRANSFORM:
+          outMessage.Transform = GetTransform(source.HashedConnectionName, source.Name, latestTimestamp);
+          if (outMessage.Transform == nullptr)
+          {
+            return false;
+          }
+          break;
+        case Network::SUBSCRIPTION_MESSAGE_TRACKED_FRAME:
+          outMessage.TrackedFrame = GetTrackedFrame(source.HashedConnectionName, latestTimestamp);
+          if (outMessage.TrackedFrame == nullptr)
           {
-            std::wstring hostIP(host->ToString()->Data());
-            std::wstring machineIP = hostIP.substr(hostIP.find_last_of(L'.') + 1);
-            std::wstring prefix = hostIP.substr(0, hostIP.find_last_of(L'.'));
+            return false;
+          }
+          break;
+        case Network::SUBSCRIPTION_MESSAGE_IMAGE:
+          outMessage.Image = GetImage(source.HashedConnectionName, latestTimestamp);
+          if (outMessage.Image == nullptr)
+          {
+            return false;
+          }
+          try
+          {
+            latestTimestamp = outMessage.Image->Timestamp;
+          }
+          catch (Platform::ObjectDisposedException^) { return false; }
+          break;
+        default:
+          return false;
+      }
+      outMessage.Timestamp = latestTimestamp;
+      return true;
+    }
 
-            // Given a subnet, ping all other IPs
-            for (int i = 0; i < 256; ++i)
-            {
-              std::wstringstream ss;
-              ss << i;
-              if (ss.str() == machineIP)
-              {
-                continue;
-              }
+    //----------------------------------------------------------------------------
+    void NetworkSystem::UpdateTransformHistory(SubscriptionSource& source)
+    {
+      const Network::IngestPolicy& policy = source.Gate.GetPolicy();
+      if (source.Type != Network::SUBSCRIPTION_MESSAGE_TRANSFORM || policy.Mode != Network::INGEST_MODE_HISTORY)
+      {
+        source.History = nullptr;
+      }
+      else if (source.History == nullptr || source.History->GetCapacity() != std::max<size_t>(policy.HistoryLength, 2))
+      {
+        source.History = std::make_shared<TransformHistory>(policy.HistoryLength);
+      }
+    }
 
-              UWPOpenIGTLink::IGTClient^ client = ref new UWPOpenIGTLink::IGTClient();
-              client->ServerHost = ref new HostName(ref new Platform::String((prefix + L"." + ss.str()).c_str()));
-              client->ServerPort = L"18944";
+    //----------------------------------------------------------------------------
+    void NetworkSystem::PublishReceived(const ReceivedMessage& message)
+    {
+      switch (message.Type)
+      {
+        case Network::SUBSCRIPTION_MESSAGE_TRANSFORM:
+          m_transformHub.Publish(message.Key, message.Transform, message.Timestamp);
+          break;
+        case Network::SUBSCRIPTION_MESSAGE_TRACKED_FRAME:
+          m_trackedFrameHub.Publish(message.Key, message.TrackedFrame, message.Timestamp);
+          break;
+        case Network::SUBSCRIPTION_MESSAGE_IMAGE:
+          m_imageHub.Publish(message.Key, message.Image, message.Timestamp);
+          break;
+      }
+    }
 
-              task<bool> connectTask = create_task(client->ConnectAsync(0.5));
-              bool result(false);
-              try
-              {
-                result = connectTask.get();
-              }
-              catch (const std::exception&)
-              {
-                continue;
-              }
+    //----------------------------------------------------------------------------
+    bool NetworkSystem::DispatchSubscriptions()
+    {
+      bool published(false);
+      auto snapshot = GetConnectorSnapshot();
 
-              if (result)
-              {
-                client->Disconnect();
-                results.push_back(prefix + L"." + ss.str());
-              }
-            }
+      std::vector<ReceiveWorker*> workers;
+      workers.push_back(m_sharedReceiver.get());
+      for (auto& connector : snapshot->Connectors)
+      {
+        if (connector->Receiver != nullptr)
+        {
+          workers.push_back(connector->Receiver.get());
+        }
+      }
+
+      // Every pending transform goes out before the next frame
+      ReceivedMessage message;
+      for (auto worker : workers)
+      {
+        while (worker->TransformQueue.TryPop(message))
+        {
+          PublishReceived(message);
+          published = true;
+        }
+      }
+      for (auto worker : workers)
+      {
+        if (worker->FrameQueue.TryPop(message))
+        {
+          PublishReceived(message);
+          published = true;
+        }
+      }
+      return published;
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::DispatchLoop()
+    {
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock(m_dispatchMutex);
+          m_dispatchCondition.wait(lock, [this]()
+          {
+            return m_dispatchSignalled || m_dispatchStop;
+          });
+          if (m_dispatchStop)
+          {
+            return;
           }
+          m_dispatchSignalled = false;
         }
 
+        while (DispatchSubscriptions()) {}
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::SignalDispatch()
+    {
+      {
+        std::lock_guard<std::mutex> guard(m_dispatchMutex);
+        m_dispatchSignalled = true;
+      }
+      m_dispatchCondition.notify_one();
+    }
+
+    //----------------------------------------------------------------------------
+    std::shared_ptr<NetworkSystem::ReceiveWorker> NetworkSystem::StartReceiveWorker(std::shared_ptr<ConnectorEntry> connector)
+    {
+      // Not a PPL task, so that a large frame on one connector never waits for pool threads busy elsewhere
+      auto worker = std::make_shared<ReceiveWorker>();
+      if (connector != nullptr)
+      {
+        connector->Receiver = worker;
+      }
+      worker->Thread = std::thread(&NetworkSystem::ReceiveLoop, this, connector, worker);
+      return worker;
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::StopReceiveWorkers()
+    {
+      std::vector<std::shared_ptr<ReceiveWorker>> workers;
+      workers.push_back(m_sharedReceiver);
+      for (auto& connector : GetConnectorSnapshot()->Connectors)
+      {
+        workers.push_back(connector->Receiver);
+      }
+
+      for (auto& worker : workers)
+      {
+        if (worker != nullptr)
+        {
+          worker->Stop = true;
+          {
+            std::lock_guard<std::mutex> guard(worker->WakeMutex);
+            worker->WakeSignalled = true;
+          }
+          worker->WakeCondition.notify_one();
+        }
+      }
+      for (auto& worker : workers)
+      {
+        if (worker != nullptr && worker->Thread.joinable())
+        {
+          worker->Thread.join();
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::WakeReceiveWorkers()
+    {
+      std::vector<ReceiveWorker*> workers;
+      workers.push_back(m_sharedReceiver.get());
+      for (auto& connector : GetConnectorSnapshot()->Connectors)
+      {
+        workers.push_back(connector->Receiver.get());
+      }
+
+      for (auto worker : workers)
+      {
+        if (worker != nullptr)
+        {
+          {
+            std::lock_guard<std::mutex> guard(worker->WakeMutex);
+            worker->WakeSignalled = true;
+          }
+          worker->WakeCondition.notify_one();
+        }
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::WaitForWork(ReceiveWorker& worker, double wakeSec)
+    {
+      const auto wakeTime = std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(wakeSec)));
+      std::unique_lock<std::mutex> lock(worker.WakeMutex);
+      worker.WakeCondition.wait_until(lock, wakeTime, [&worker]()
+      {
+        return worker.WakeSignalled || worker.Stop;
+      });
+      worker.WakeSignalled = false;
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::ReceiveLoop(std::shared_ptr<ConnectorEntry> connector, std::shared_ptr<ReceiveWorker> worker)
+    {
+      // The client only offers polling, so this thread looks for each stream's next message when it is due and the
+      // dispatch thread sleeps until it is signalled
+      ReceivedMessage message;
+      while (!worker->Stop)
+      {
+        const double now = std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (connector != nullptr && !connector->Connector->Connected)
+        {
+          WaitForWork(*worker, now + RECEIVE_DISCONNECTED_SLEEP_MSEC * 1e-3);
+          continue;
+        }
+
+        auto snapshot = GetConnectorSnapshot();
+        auto isServedHere = [&connector, snapshot](const SubscriptionSource & source) -> bool
+        {
+          if (connector != nullptr)
+          {
+            return source.HashedConnectionName == connector->HashedName;
+          }
+          auto iter = snapshot->Lookup.find(source.HashedConnectionName);
+          return iter != snapshot->Lookup.end() && iter->second->IO == IO_MODE_SHARED && iter->second->Connector->Connected;
+        };
+
+        auto sources = GetSubscriptionSources();
+        bool received(false);
+
+        // Transforms first, then frames. Nothing is pulled unless the queue has room for it, so a message that was pulled
+        // (and advanced the stream's timestamp and ingest gate) is never dropped while the dispatch thread catches up
+        for (auto& entry : sources)
+        {
+          if (entry.second->Type == Network::SUBSCRIPTION_MESSAGE_TRANSFORM && isServedHere(*entry.second) && !worker->TransformQueue.IsFull() && PullSubscription(entry.first, *entry.second, message))
+          {
+            worker->TransformQueue.TryPush(message);
+            received = true;
+          }
+        }
+        for (auto& entry : sources)
+        {
+          if (entry.second->Type != Network::SUBSCRIPTION_MESSAGE_TRANSFORM && isServedHere(*entry.second) && !worker->FrameQueue.IsFull() && PullSubscription(entry.first, *entry.second, message))
+          {
+            worker->FrameQueue.TryPush(message);
+            received = true;
+          }
+        }
+
+        if (received)
+        {
+          SignalDispatch();
+          continue;
+        }
+
+        // Nothing was ready, sleep until the earliest stream served here is due. With nothing to serve, only a new
+        // subscription or connection (or the bound, for a shared connector that dropped) ends the wait
+        double wakeSec = now + RECEIVE_DISCONNECTED_SLEEP_MSEC * 1e-3;
+        for (auto& entry : sources)
+        {
+          if (isServedHere(*entry.second))
+          {
+            wakeSec = std::min(wakeSec, std::max(entry.second->Arrival.GetNextCheckSec(now), entry.second->Gate.GetNextPullSec()));
+          }
+        }
+        WaitForWork(*worker, wakeSec);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::StampHandoff(const ConnectorEntry& connector, const std::wstring& streamName, double timestamp)
+    {
+      if (!LatencyTracer::instance().IsEnabled())
+      {
+        return;
+      }
+
+      // Consumers stamp the later stages with the same stream id, see LatencyTracer::MakeStreamId
+      // The message timestamp is the sender's clock on the same epoch as LatencyTracer::Now(), so the handoff row is the
+      // transport latency plus the offset between the two clocks
+      uint64 streamId = LatencyTracer::MakeStreamId(connector.HashedName, HashString(streamName));
+      bool newStream = LatencyTracer::instance().Stamp(streamId, timestamp, LATENCY_STAGE_SENT, timestamp);
+      newStream = LatencyTracer::instance().Stamp(streamId, timestamp, LATENCY_STAGE_HANDOFF) || newStream;
+      if (newStream)
+      {
+        std::wstring fullName = connector.Name + L"/" + streamName;
+        std::string name;
+        for (auto character : fullName)
+        {
+          name.push_back(static_cast<char>(character));
+        }
+        LatencyTracer::instance().SetStreamName(streamId, name);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::RecordTransform(const ConnectorEntry& connector, UWPOpenIGTLink::Transform^ transform)
+    {
+      Network::RecordInfo info;
+      info.Timestamp = transform->Timestamp;
+      info.Type = Network::RECORD_TYPE_TRANSFORM;
+      info.StreamId = HashString(connector.Name + L"/" + transform->Name->GetTransformName()->Data());
+      if (!m_recorder.IsNewRecord(info.StreamId, info.Timestamp))
+      {
+        return;
+      }
+
+      std::vector<uint8_t> payload;
+      AppendTransformPayload(payload, transform);
+      m_recorder.Append(info, payload.data(), payload.size());
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::RecordTDataFrame(const ConnectorEntry& connector, UWPOpenIGTLink::TransformListABI^ frame)
+    {
+      Network::RecordInfo info;
+      info.Timestamp = frame->GetAt(0)->Timestamp;
+      info.Type = Network::RECORD_TYPE_TDATA;
+      info.StreamId = HashString(connector.Name + L"/TDATA");
+      if (!m_recorder.IsNewRecord(info.StreamId, info.Timestamp))
+      {
+        return;
+      }
+
+      std::vector<uint8_t> payload;
+      AppendTransformListPayload(payload, frame);
+      m_recorder.Append(info, payload.data(), payload.size());
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::RecordVideoFrame(const ConnectorEntry& connector, UWPOpenIGTLink::VideoFrame^ frame, double timestamp)
+    {
+      // Every consumer calling GetImage on an unchanged frame lands here, only the first one pays for the copy
+      Network::RecordInfo info;
+      info.Timestamp = timestamp;
+      info.Type = Network::RECORD_TYPE_IMAGE;
+      info.StreamId = HashString(connector.Name + L"/IMAGE");
+      if (!m_recorder.IsNewRecord(info.StreamId, info.Timestamp))
+      {
+        return;
+      }
+
+      uint32 header[6];
+      std::shared_ptr<byte> image;
+      size_t imageBytes = GetImagePayloadLayout(frame, header, image);
+      if (imageBytes == 0)
+      {
+        return;
+      }
+
+      // The pooled buffer is handed to the recorder's writer thread, which releases it once the record is written
+      auto payload = FrameBufferPool::instance().Acquire(sizeof(header) + imageBytes);
+      memcpy(payload.get(), header, sizeof(header));
+      memcpy(payload.get() + sizeof(header), image.get(), imageBytes);
+      m_recorder.Append(info, std::move(payload), sizeof(header) + imageBytes, header[4]);
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::RecordTrackedFrame(const ConnectorEntry& connector, UWPOpenIGTLink::TrackedFrame^ frame, double timestamp)
+    {
+      Network::RecordInfo info;
+      info.Timestamp = timestamp;
+      info.Type = Network::RECORD_TYPE_TRACKED_FRAME;
+      info.StreamId = HashString(connector.Name + L"/TRACKEDFRAME");
+      if (!m_recorder.IsNewRecord(info.StreamId, info.Timestamp))
+      {
+        return;
+      }
+
+      // Payload: the image as written by RecordVideoFrame, then the embedded transforms as written by RecordTDataFrame
+      uint32 header[6];
+      std::shared_ptr<byte> image;
+      size_t imageBytes = GetImagePayloadLayout(frame->Frame, header, image);
+      if (imageBytes == 0)
+      {
+        return;
+      }
+
+      std::vector<uint8_t> transforms;
+      AppendTransformListPayload(transforms, frame->FrameTransforms);
+
+      auto payload = FrameBufferPool::instance().Acquire(sizeof(header) + imageBytes + transforms.size());
+      memcpy(payload.get(), header, sizeof(header));
+      memcpy(payload.get() + sizeof(header), image.get(), imageBytes);
+      memcpy(payload.get() + sizeof(header) + imageBytes, transforms.data(), transforms.size());
+      m_recorder.Append(info, std::move(payload), sizeof(header) + imageBytes + transforms.size(), header[4]);
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::AppendTransformPayload(std::vector<uint8_t>& payload, UWPOpenIGTLink::Transform^ transform)
+    {
+      // Payload: float[16] row major matrix, uint32 valid, uint32 name length, UTF-16 name
+      std::wstring name(transform->Name->GetTransformName()->Data());
+      size_t offset = payload.size();
+      payload.resize(offset + 16 * sizeof(float) + 2 * sizeof(uint32) + name.size() * sizeof(uint16));
+
+      float4x4 matrix = transform->Matrix;
+      uint32 header[2] = { transform->Valid ? 1u : 0u, static_cast<uint32>(name.size()) };
+      memcpy(payload.data() + offset, &matrix, 16 * sizeof(float));
+      memcpy(payload.data() + offset + 16 * sizeof(float), header, sizeof(header));
+      uint16* nameOut = reinterpret_cast<uint16*>(payload.data() + offset + 16 * sizeof(float) + sizeof(header));
+      for (size_t i = 0; i < name.size(); ++i)
+      {
+        nameOut[i] = static_cast<uint16>(name[i]);
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    void NetworkSystem::AppendTransformListPayload(std::vector<uint8_t>& payload, UWPOpenIGTLink::TransformListABI^ transforms)
+    {
+      // Payload: uint32 count, then count transform payloads as written by AppendTransformPayload, each prefixed by its uint32 size
+      size_t countOffset = payload.size();
+      payload.resize(countOffset + sizeof(uint32));
+      uint32 count(0);
+      for (uint32 i = 0; transforms != nullptr && i < transforms->Size; ++i)
+      {
+        size_t sizeOffset = payload.size();
+        payload.resize(sizeOffset + sizeof(uint32));
+        AppendTransformPayload(payload, transforms->GetAt(i));
+        uint32 size = static_cast<uint32>(payload.size() - sizeOffset - sizeof(uint32));
+        memcpy(payload.data() + sizeOffset, &size, sizeof(uint32));
+        count++;
+      }
+      memcpy(payload.data() + countOffset, &count, sizeof(uint32));
+    }
+
+    //----------------------------------------------------------------------------
+    size_t NetworkSystem::GetImagePayloadLayout(UWPOpenIGTLink::VideoFrame^ frame, uint32 (&outHeader)[6], std::shared_ptr<byte>& outImage)
+    {
+      if (frame == nullptr)
+      {
+        return 0;
+      }
+
+      outImage = *(std::shared_ptr<byte>*)(frame->GetImage()->GetImageData());
+      if (outImage == nullptr)
+      {
+        return 0;
+      }
+
+      // Header: uint32 dimensions[3], uint32 DXGI format, uint32 bytes per pixel, uint32 reserved, followed by the pixels
+      auto dimensions = frame->Dimensions;
+      outHeader[0] = static_cast<uint32>(dimensions[0]);
+      outHeader[1] = static_cast<uint32>(dimensions[1]);
+      outHeader[2] = static_cast<uint32>(dimensions[2]);
+      outHeader[3] = static_cast<uint32>(frame->GetPixelFormat(true));
+      outHeader[4] = static_cast<uint32>(BitsPerPixel(static_cast<DXGI_FORMAT>(outHeader[3])) / 8);
+      outHeader[5] = 0;
+      return static_cast<size_t>(outHeader[0]) * outHeader[1] * outHeader[2] * outHeader[4];
+    }
+
+    //----------------------------------------------------------------------------
+    task<std::vector<std::wstring>> NetworkSystem::FindServersAsync(bool forceRefresh /*= false*/)
+    {
+      std::vector<std::string> localAddresses;
+      for (auto host : NetworkInformation::GetHostNames())
+      {
+        if (host->Type == HostNameType::Ipv4)
+        {
+          std::wstring hostIP(host->CanonicalName->Data());
+          localAddresses.push_back(std::string(hostIP.begin(), hostIP.end()));
+        }
+      }
+
+      // Capture the discovery engine rather than this, the destructor cancels the probe but does not wait for the task
+      // The generation is taken now, so a cancel that lands before the task starts still stops it
+      auto discovery = m_serverDiscovery;
+      const uint64 generation = discovery->GetGeneration();
+      return create_task([discovery, localAddresses, forceRefresh, generation]()
+      {
+        Network::ServerDiscovery::ServerList servers;
+        if (!discovery->DiscoverSubnets(localAddresses, DISCOVERY_PORT, servers, forceRefresh, generation))
+        {
+          LOG_INFO("Server discovery cancelled.");
+        }
+
+        // Ranked by response time, fastest first
+        std::vector<std::wstring> results;
+        for (auto& server : servers)
+        {
+          results.push_back(std::wstring(server.Address.begin(), server.Address.end()));
+        }
         return results;
       });
     }
@@ -762,11 +1676,13 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     void NetworkSystem::ErrorMessageHandler(UWPOpenIGTLink::IGTClient^ mc, Platform::String^ msg)
     {
-      for (auto& connector : m_connectors)
+      for (auto& connector : GetConnectorSnapshot()->Connectors)
       {
         if (connector->Connector == mc)
         {
           WLOG_ERROR(ref new Platform::String(connector->Name.c_str()) + L" error: " + msg);
+          std::wstring error(msg->Data());
+          m_reconnectScheduler.SetLastError(connector->HashedName, std::string(error.begin(), error.end()));
           return;
         }
       }
@@ -776,7 +1692,7 @@ namespace HoloIntervention
     //----------------------------------------------------------------------------
     void NetworkSystem::WarningMessageHandler(UWPOpenIGTLink::IGTClient^ mc, Platform::String^ msg)
     {
-      for (auto& connector : m_connectors)
+      for (auto& connector : GetConnectorSnapshot()->Connectors)
       {
         if (connector->Connector == mc)
         {
@@ -26,7 +26,15 @@ OTHER DEALINGS IN THE SOFTWARE.
 // Local includes
 #include "IConfigurable.h"
 #include "IEngineComponent.h"
+#include "IGTRecording.h"
+#include "IngestPolicy.h"
 #include "IVoiceInput.h"
+#include "ReconnectScheduler.h"
+#include "ServerDiscovery.h"
+#include "SnapshotPublisher.h"
+#include "SpscQueue.h"
+#include "SubscriptionHub.h"
+#include "TransformHistory.h"
 
 // IGT includes
 #include <IGTCommon.h>
@@ -34,6 +42,12 @@ OTHER DEALINGS IN THE SOFTWARE.
 // OS includes
 #include <ppltasks.h>
 
+// STL includes
+#include <condition_variable>
+#include <map>
+#include <thread>
+#include <unordered_map>
+
 namespace igtl
 {
   class TrackedFrameMessage;
@@ -81,6 +95,16 @@ namespace HoloIntervention
         CONNECTION_STATE_CONNECTED
       };
 
+      enum IOMode
+      {
+        IO_MODE_SHARED,     // Pulled by one receive thread shared with every other shared connector
+        IO_MODE_DEDICATED   // Pulled by a receive thread of its own
+      };
+
+      typedef Network::SubscriptionHub<UWPOpenIGTLink::Transform^> TransformHub;
+      typedef Network::SubscriptionHub<UWPOpenIGTLink::TrackedFrame^> TrackedFrameHub;
+      typedef Network::SubscriptionHub<UWPOpenIGTLink::VideoFrame^> ImageHub;
+
     private:
       struct UILogicEntry
       {
@@ -91,17 +115,85 @@ namespace HoloIntervention
         std::shared_ptr<UI::Icon>              m_iconEntry = nullptr;
       };
 
+      // A message pulled by a receive thread, waiting to be published
+      struct ReceivedMessage
+      {
+        uint64                                      Key = 0;
+        Network::SubscriptionMessageType            Type = Network::SUBSCRIPTION_MESSAGE_TRANSFORM;
+        UWPOpenIGTLink::Transform^                  Transform = nullptr;
+        UWPOpenIGTLink::TrackedFrame^               TrackedFrame = nullptr;
+        UWPOpenIGTLink::VideoFrame^                 Image = nullptr;
+        double                                      Timestamp = 0.0;
+      };
+
+      // Receive thread of a dedicated connector or of all shared connectors, the only producer of its queues
+      // The dispatch thread is the only consumer, and is signalled whenever a message is queued
+      // Between messages the thread waits on its condition until the next one is due, or until it is woken by a new
+      // subscription, a policy change, a connection or Stop
+      struct ReceiveWorker
+      {
+        ReceiveWorker() : TransformQueue(TRANSFORM_QUEUE_CAPACITY), FrameQueue(FRAME_QUEUE_CAPACITY) {}
+
+        Network::SpscQueue<ReceivedMessage>         TransformQueue; // Always drained before any frame is published
+        Network::SpscQueue<ReceivedMessage>         FrameQueue;     // Tracked frames and images
+        std::atomic_bool                            Stop = false;
+        std::thread                                 Thread;
+        std::mutex                                  WakeMutex;
+        std::condition_variable                     WakeCondition;
+        bool                                        WakeSignalled = false;  // Guarded by WakeMutex
+      };
+
       struct ConnectorEntry
       {
         std::wstring                                Name = L""; // For saving back to disk
         uint64                                      HashedName = 0;
-        ConnectionState                             State = CONNECTION_STATE_UNKNOWN;
+        std::atomic<ConnectionState>                State = CONNECTION_STATE_UNKNOWN;
         UWPOpenIGTLink::IGTClient^                  Connector = nullptr;
         UILogicEntry                                Icon;
         Windows::Foundation::EventRegistrationToken ErrorMessageToken;
         Windows::Foundation::EventRegistrationToken WarningMessageToken;
+        IOMode                                      IO = IO_MODE_SHARED; // Fixed once the connector is configured
+        std::shared_ptr<ReceiveWorker>              Receiver = nullptr;  // Only when IO is IO_MODE_DEDICATED
       };
       typedef std::vector<std::shared_ptr<ConnectorEntry>> ConnectorList;
+      typedef std::unordered_map<uint64, std::shared_ptr<ConnectorEntry>> ConnectorMap;
+
+      // Immutable view of the known connectors, replaced as a whole when a connector is added
+      // Readers load the published pointer with acquire ordering and use the entries through raw pointers, no lock and no
+      // reference count is touched. Entries are owned by every snapshot that lists them and connectors are never removed.
+      struct ConnectorSnapshot
+      {
+        ConnectorList                               Connectors; // In configuration order
+        ConnectorMap                                Lookup;     // Keyed by hashed connection name
+      };
+
+      // One per distinct subscribed stream, however many subscribers share it
+      struct SubscriptionSource
+      {
+        uint64                                      HashedConnectionName = 0;
+        Network::SubscriptionMessageType            Type = Network::SUBSCRIPTION_MESSAGE_TRANSFORM;
+        UWPOpenIGTLink::TransformName^              Name = nullptr;
+
+        // Only touched by the thread that pulls this stream
+        double                                      LatestTimestamp = 0.0;
+        Network::IngestGate                         Gate;
+        Network::ArrivalEstimator                   Arrival;
+
+        // Shared with other threads
+        std::mutex                                  Mutex;
+        std::atomic_bool                            PolicyChanged = false;
+        Network::IngestPolicy                       PendingPolicy;
+        std::atomic_bool                            FetchOnRead = false;  // INGEST_MODE_LATEST_ONLY, mailboxes read the client directly
+        std::shared_ptr<TransformHistory>           History; // INGEST_MODE_HISTORY transforms only
+      };
+
+      struct IngestPolicyEntry
+      {
+        uint64                                      HashedConnectionName = 0;
+        Network::SubscriptionMessageType            Type = Network::SUBSCRIPTION_MESSAGE_TRANSFORM;
+        std::wstring                                Name; // Empty for frames and images
+        Network::IngestPolicy                       Policy;
+      };
 
     public:
       virtual concurrency::task<bool> WriteConfigurationAsync(Windows::Data::Xml::Dom::XmlDocument^ document);
@@ -132,7 +224,9 @@ namespace HoloIntervention
       void SetEmbeddedImageTransformName(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ name);
 
       void Disconnect(uint64 hashedConnectionName);
+      bool GetReconnectMetrics(uint64 hashedConnectionName, Network::ReconnectScheduler::Metrics& outMetrics) const;
       bool GetConnectionState(uint64 hashedConnectionName, ConnectionState& state) const;
+      bool GetIOMode(uint64 hashedConnectionName, IOMode& mode) const;
 
       void SetHostname(uint64 hashedConnectionName, const std::wstring& hostname);
       bool GetHostname(uint64 hashedConnectionName, std::wstring& hostName) const;
@@ -148,9 +242,67 @@ namespace HoloIntervention
 
       void Update(DX::StepTimer& timer);
 
+      /// Push based access, an alternative to polling the getters above every frame
+      /// A receive thread pulls each distinct subscribed stream once as it arrives and the dispatch thread fans it out to all of its subscribers
+      /// Callbacks run on the PPL pool, one at a time per subscriber, mailboxes are read by the subscriber at its own pace. Both only ever see the latest message.
+      uint64 SubscribeTransform(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName, TransformHub::Callback callback);
+      uint64 SubscribeTransform(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName, TransformHub::MailboxPtr& outMailbox);
+      uint64 SubscribeTrackedFrame(uint64 hashedConnectionName, TrackedFrameHub::Callback callback);
+      uint64 SubscribeTrackedFrame(uint64 hashedConnectionName, TrackedFrameHub::MailboxPtr& outMailbox);
+      uint64 SubscribeImage(uint64 hashedConnectionName, ImageHub::Callback callback);
+      uint64 SubscribeImage(uint64 hashedConnectionName, ImageHub::MailboxPtr& outMailbox);
+      void Unsubscribe(uint64 subscriptionToken);
+
+      /// How a stream is pulled from its connector, see Network::IngestMode. Applies to current and future subscriptions.
+      void SetIngestPolicy(uint64 hashedConnectionName, Network::SubscriptionMessageType type, UWPOpenIGTLink::TransformName^ transformName, const Network::IngestPolicy& policy);
+      /// Pose of a subscribed INGEST_MODE_HISTORY transform at a device timestamp, interpolated between the received messages
+      /// Used to pair data with the tracker pose at its acquisition time rather than the latest pose
+      bool GetTransformAtTime(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName, double timestamp, Windows::Foundation::Numerics::float4x4& outMatrix, bool& outValid);
+      std::shared_ptr<TransformHistory> GetTransformHistory(uint64 hashedConnectionName, UWPOpenIGTLink::TransformName^ transformName);
+      /// Total memory held by all transform histories
+      size_t GetTransformHistoryMemoryUsage();
+
+      /// Record every transform, tracking and image message handed out by this system
+      bool StartRecording(const std::wstring& fileName);
+      bool StopRecording();
+      bool IsRecording() const;
+
     protected:
+      const ConnectorSnapshot* GetConnectorSnapshot() const;
+      ConnectorEntry* FindConnector(uint64 hashedConnectionName) const;
+      void AddConnector(std::shared_ptr<ConnectorEntry> entry);
+
       void ProcessNetworkLogic(DX::StepTimer& timer);
-      Concurrency::task<std::vector<std::wstring>> FindServersAsync();
+
+      uint64 AddSubscriptionSource(uint64 hashedConnectionName, Network::SubscriptionMessageType type, UWPOpenIGTLink::TransformName^ transformName);
+      std::vector<std::pair<uint64, std::shared_ptr<SubscriptionSource>>> GetSubscriptionSources();
+      std::shared_ptr<SubscriptionSource> FindSubscriptionSource(uint64 key);
+      bool PullSubscription(uint64 key, SubscriptionSource& source, ReceivedMessage& outMessage);
+      bool GetLatestMessage(const SubscriptionSource& source, double& latestTimestamp, ReceivedMessage& outMessage);
+      void UpdateTransformHistory(SubscriptionSource& source);
+      void PublishReceived(const ReceivedMessage& message);
+      bool DispatchSubscriptions();
+      void DispatchLoop();
+      void SignalDispatch();
+
+      /// A null connector starts the receive thread of all shared connectors
+      std::shared_ptr<ReceiveWorker> StartReceiveWorker(std::shared_ptr<ConnectorEntry> connector);
+      void StopReceiveWorkers();
+      void WakeReceiveWorkers();
+      void ReceiveLoop(std::shared_ptr<ConnectorEntry> connector, std::shared_ptr<ReceiveWorker> worker);
+
+      /// wakeSec on the steady clock, returns early when the worker is woken or stopped
+      static void WaitForWork(ReceiveWorker& worker, double wakeSec);
+
+      void StampHandoff(const ConnectorEntry& connector, const std::wstring& streamName, double timestamp);
+      void RecordTransform(const ConnectorEntry& connector, UWPOpenIGTLink::Transform^ transform);
+      void RecordTDataFrame(const ConnectorEntry& connector, UWPOpenIGTLink::TransformListABI^ frame);
+      void RecordVideoFrame(const ConnectorEntry& connector, UWPOpenIGTLink::VideoFrame^ frame, double timestamp);
+      void RecordTrackedFrame(const ConnectorEntry& connector, UWPOpenIGTLink::TrackedFrame^ frame, double timestamp);
+      static void AppendTransformPayload(std::vector<uint8_t>& payload, UWPOpenIGTLink::Transform^ transform);
+      static void AppendTransformListPayload(std::vector<uint8_t>& payload, UWPOpenIGTLink::TransformListABI^ transforms);
+      static size_t GetImagePayloadLayout(UWPOpenIGTLink::VideoFrame^ frame, uint32 (&outHeader)[6], std::shared_ptr<byte>& outImage);
+      Concurrency::task<std::vector<std::wstring>> FindServersAsync(bool forceRefresh = false);
 
     protected:
       void ErrorMessageHandler(UWPOpenIGTLink::IGTClient^ mc, Platform::String^ msg);
@@ -169,15 +321,41 @@ namespace HoloIntervention
       // Icons that this subsystem manages
       static const float                            NETWORK_BLINK_TIME_SEC;
 
-      mutable std::recursive_mutex                  m_connectorsMutex;
-      ConnectorList                                 m_connectors;
+      // Connector registry, one retired snapshot per connector ever added
+      Network::SnapshotPublisher<ConnectorSnapshot> m_connectors;
+
+      // Subnet discovery, shared with in flight discovery tasks so they can outlive this system
+      std::shared_ptr<Network::ServerDiscovery>     m_serverDiscovery = std::make_shared<Network::ServerDiscovery>();
+
+      // Retries dropped connectors with backoff, ticked once per frame for all connectors
+      Network::ReconnectScheduler                   m_reconnectScheduler;
+
+      // Push subscriptions
+      TransformHub                                  m_transformHub;
+      TrackedFrameHub                               m_trackedFrameHub;
+      ImageHub                                      m_imageHub;
+      std::mutex                                    m_subscriptionSourceMutex;
+      std::map<uint64, std::shared_ptr<SubscriptionSource>> m_subscriptionSources;
+      std::map<uint64, IngestPolicyEntry>           m_ingestPolicies;     // Keyed like m_subscriptionSources, guarded by m_subscriptionSourceMutex
+      std::shared_ptr<ReceiveWorker>                m_sharedReceiver;
+      std::thread                                   m_dispatchThread;
+      std::mutex                                    m_dispatchMutex;
+      std::condition_variable                       m_dispatchCondition;
+      bool                                          m_dispatchSignalled = false;  // Guarded by m_dispatchMutex
+      bool                                          m_dispatchStop = false;       // Guarded by m_dispatchMutex
+
+      // Recording
+      std::atomic_bool                              m_recording = false;
+      Network::RecordingWriter                      m_recorder;
 
       // Constants relating to IGT behavior
       static const double                           CONNECT_TIMEOUT_SEC;
-      static const uint32                           RECONNECT_RETRY_DELAY_MSEC;
-      static const uint32                           RECONNECT_RETRY_COUNT;
       static const uint32                           DICTATION_TIMEOUT_DELAY_MSEC;
       static const uint32                           KEEP_ALIVE_INTERVAL_MSEC;
+      static const uint16                           DISCOVERY_PORT;
+      static const uint32                           RECEIVE_DISCONNECTED_SLEEP_MSEC;
+      static const size_t                           TRANSFORM_QUEUE_CAPACITY;
+      static const size_t                           FRAME_QUEUE_CAPACITY;
     };
   }
 }
\ No newline at end of file
@@ -0,0 +1,206 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "ReconnectScheduler.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    //----------------------------------------------------------------------------
+    void ReconnectScheduler::OnConnectionLost(uint64_t id)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      Entry& entry = m_entries[id];
+      if (entry.Reconnecting)
+      {
+        return;
+      }
+
+      entry.Reconnecting = true;
+      entry.LostTime = Clock::now();
+      entry.Stats.ConsecutiveFailures = 0;
+      entry.Stats.State = RECONNECT_STATE_BACKOFF;
+      entry.NextAttempt = entry.LostTime + NextBackoffDelay(entry);
+    }
+
+    //----------------------------------------------------------------------------
+    void ReconnectScheduler::OnConnected(uint64_t id)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      Entry& entry = m_entries[id];
+      if (entry.Reconnecting)
+      {
+        double timeToReconnectSec = std::chrono::duration<double>(Clock::now() - entry.LostTime).count();
+        entry.Stats.Reconnects++;
+        entry.Stats.LastTimeToReconnectSec = timeToReconnectSec;
+        entry.Stats.MaxTimeToReconnectSec = std::max(entry.Stats.MaxTimeToReconnectSec, timeToReconnectSec);
+        entry.Reconnecting = false;
+      }
+      entry.Stats.ConsecutiveFailures = 0;
+      entry.Stats.State = RECONNECT_STATE_IDLE;
+    }
+
+    //----------------------------------------------------------------------------
+    void ReconnectScheduler::OnConnectFailed(uint64_t id, const std::string& error)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      Entry& entry = m_entries[id];
+      entry.Stats.LastError = error;
+
+      // Only attempts made by the scheduler move the schedule, a failed manual connect while backing off changes nothing
+      if (entry.Stats.State != RECONNECT_STATE_CONNECTING)
+      {
+        return;
+      }
+
+      entry.Stats.Failures++;
+      entry.Stats.ConsecutiveFailures++;
+      ScheduleAfterFailure(entry);
+    }
+
+    //----------------------------------------------------------------------------
+    void ReconnectScheduler::SetLastError(uint64_t id, const std::string& error)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_entries[id].Stats.LastError = error;
+    }
+
+    //----------------------------------------------------------------------------
+    void ReconnectScheduler::Reset(uint64_t id)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      auto iter = m_entries.find(id);
+      if (iter == m_entries.end())
+      {
+        return;
+      }
+
+      iter->second.Reconnecting = false;
+      iter->second.Stats.ConsecutiveFailures = 0;
+      iter->second.Stats.State = RECONNECT_STATE_IDLE;
+    }
+
+    //----------------------------------------------------------------------------
+    std::vector<uint64_t> ReconnectScheduler::Tick()
+    {
+      std::vector<uint64_t> due;
+
+      std::lock_guard<std::mutex> guard(m_mutex);
+      const Clock::time_point now = Clock::now();
+      for (auto& pair : m_entries)
+      {
+        Entry& entry = pair.second;
+        if ((entry.Stats.State == RECONNECT_STATE_BACKOFF || entry.Stats.State == RECONNECT_STATE_CIRCUIT_OPEN) && now >= entry.NextAttempt)
+        {
+          entry.Stats.State = RECONNECT_STATE_CONNECTING;
+          entry.Stats.Attempts++;
+          due.push_back(pair.first);
+        }
+      }
+
+      return due;
+    }
+
+    //----------------------------------------------------------------------------
+    bool ReconnectScheduler::GetMetrics(uint64_t id, Metrics& outMetrics) const
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      auto iter = m_entries.find(id);
+      if (iter == m_entries.end())
+      {
+        return false;
+      }
+
+      outMetrics = iter->second.Stats;
+      if (outMetrics.State == RECONNECT_STATE_BACKOFF || outMetrics.State == RECONNECT_STATE_CIRCUIT_OPEN)
+      {
+        outMetrics.NextAttemptInSec = std::max(0.0, std::chrono::duration<double>(iter->second.NextAttempt - Clock::now()).count());
+      }
+      return true;
+    }
+
+    //----------------------------------------------------------------------------
+    void ReconnectScheduler::SetSettings(const Settings& settings)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      m_settings = settings;
+    }
+
+    //----------------------------------------------------------------------------
+    ReconnectScheduler::Settings ReconnectScheduler::GetSettings() const
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      return m_settings;
+    }
+
+    //----------------------------------------------------------------------------
+    ReconnectScheduler::ReconnectScheduler()
+      : m_randomEngine(std::random_device()())
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    ReconnectScheduler::~ReconnectScheduler()
+    {
+    }
+
+    //----------------------------------------------------------------------------
+    ReconnectScheduler::Clock::duration ReconnectScheduler::NextBackoffDelay(const Entry& entry)
+    {
+      double delaySec = m_settings.InitialDelaySec * std::pow(m_settings.BackoffMultiplier, static_cast<double>(entry.Stats.ConsecutiveFailures));
+      delaySec = std::min(delaySec, m_settings.MaxDelaySec);
+
+      // Jitter spreads out the retries of connectors that dropped together, e.g. when a shared server restarts
+      std::uniform_real_distribution<double> jitter(1.0 - m_settings.JitterRatio, 1.0 + m_settings.JitterRatio);
+      delaySec = std::max(0.0, delaySec * jitter(m_randomEngine));
+
+      return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(delaySec));
+    }
+
+    //----------------------------------------------------------------------------
+    void ReconnectScheduler::ScheduleAfterFailure(Entry& entry)
+    {
+      const Clock::time_point now = Clock::now();
+      if (entry.Stats.ConsecutiveFailures >= m_settings.FailureThreshold)
+      {
+        // Also taken when the trial attempt after a cool-off fails
+        entry.Stats.State = RECONNECT_STATE_CIRCUIT_OPEN;
+        entry.Stats.CircuitOpenings++;
+        entry.NextAttempt = now + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_settings.CircuitOpenSec));
+      }
+      else
+      {
+        entry.Stats.State = RECONNECT_STATE_BACKOFF;
+        entry.NextAttempt = now + NextBackoffDelay(entry);
+      }
+    }
+  }
+}
\ No newline at end of file
@@ -0,0 +1,126 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    // Decides when dropped connections are retried, driven by a single Tick() shared by all connections
+    // Retries back off exponentially with jitter, and after too many consecutive failures the circuit opens and
+    // the connection is left alone for a cool-off period before a single trial attempt is made
+    class ReconnectScheduler
+    {
+    public:
+      enum ReconnectState
+      {
+        RECONNECT_STATE_IDLE,         // Connected, or not wanted
+        RECONNECT_STATE_BACKOFF,      // Waiting for the next attempt
+        RECONNECT_STATE_CONNECTING,   // Attempt in flight
+        RECONNECT_STATE_CIRCUIT_OPEN  // Too many failures, cooling off
+      };
+
+      struct Settings
+      {
+        double          InitialDelaySec = 0.1;
+        double          MaxDelaySec = 8.0;
+        double          BackoffMultiplier = 2.0;
+        double          JitterRatio = 0.25;       // Each delay is randomized by +/- this fraction
+        uint32_t        FailureThreshold = 8;     // Consecutive failures before the circuit opens
+        double          CircuitOpenSec = 30.0;
+        double          ConnectTimeoutSec = 4.0;
+      };
+
+      struct Metrics
+      {
+        ReconnectState  State = RECONNECT_STATE_IDLE;
+        uint64_t        Attempts = 0;             // Lifetime reconnect attempts
+        uint64_t        Failures = 0;
+        uint64_t        Reconnects = 0;           // Successful recoveries after a drop
+        uint64_t        CircuitOpenings = 0;
+        uint32_t        ConsecutiveFailures = 0;
+        std::string     LastError;
+        double          LastTimeToReconnectSec = 0.0;
+        double          MaxTimeToReconnectSec = 0.0;
+        double          NextAttemptInSec = 0.0;   // Only meaningful in BACKOFF and CIRCUIT_OPEN
+      };
+
+    public:
+      /// The connection dropped unexpectedly, begin retrying it
+      void OnConnectionLost(uint64_t id);
+
+      /// Report the outcome of any connect attempt for id, whether or not it was scheduled by Tick
+      void OnConnected(uint64_t id);
+      void OnConnectFailed(uint64_t id, const std::string& error);
+
+      /// Record the most recent error without affecting the schedule
+      void SetLastError(uint64_t id, const std::string& error);
+
+      /// Stop retrying id and clear its backoff and circuit state, metrics are kept
+      void Reset(uint64_t id);
+
+      /// Returns the connections whose next attempt is due, they are moved to CONNECTING and must be reported back
+      std::vector<uint64_t> Tick();
+
+      bool GetMetrics(uint64_t id, Metrics& outMetrics) const;
+
+      void SetSettings(const Settings& settings);
+      Settings GetSettings() const;
+
+    public:
+      ReconnectScheduler();
+      ~ReconnectScheduler();
+
+    protected:
+      typedef std::chrono::steady_clock Clock;
+
+      struct Entry
+      {
+        Metrics             Stats;
+        Clock::time_point   NextAttempt;
+        Clock::time_point   LostTime;
+        bool                Reconnecting = false; // A drop has not yet been recovered
+      };
+
+    protected:
+      Clock::duration NextBackoffDelay(const Entry& entry);
+      void ScheduleAfterFailure(Entry& entry);
+
+    protected:
+      mutable std::mutex              m_mutex;
+      Settings                        m_settings;
+      std::map<uint64_t, Entry>       m_entries;
+      std::mt19937                    m_randomEngine;
+    };
+  }
+}
\ No newline at end of file
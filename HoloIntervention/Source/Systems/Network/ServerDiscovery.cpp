@@ -0,0 +1,456 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "pch.h"
+#include "ServerDiscovery.h"
+
+// STL includes
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+// OS includes
+#if defined(_WIN32)
+  #include <winsock2.h>
+  #include <ws2tcpip.h>
+  #pragma comment(lib, "ws2_32.lib")
+#else
+  #include <arpa/inet.h>
+  #include <errno.h>
+  #include <fcntl.h>
+  #include <netinet/in.h>
+  #include <sys/select.h>
+  #include <sys/socket.h>
+  #include <unistd.h>
+#endif
+
+namespace
+{
+#if defined(_WIN32)
+  typedef SOCKET NativeSocket;
+  const NativeSocket INVALID_NATIVE_SOCKET = INVALID_SOCKET;
+#else
+  typedef int NativeSocket;
+  const NativeSocket INVALID_NATIVE_SOCKET = -1;
+#endif
+
+  //----------------------------------------------------------------------------
+  void CloseNativeSocket(NativeSocket socket)
+  {
+#if defined(_WIN32)
+    closesocket(socket);
+#else
+    close(socket);
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  bool SetNonBlocking(NativeSocket socket)
+  {
+#if defined(_WIN32)
+    u_long nonBlocking(1);
+    return ioctlsocket(socket, FIONBIO, &nonBlocking) == 0;
+#else
+    int flags = fcntl(socket, F_GETFL, 0);
+    return flags != -1 && fcntl(socket, F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsConnectPending()
+  {
+#if defined(_WIN32)
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EINPROGRESS || errno == EWOULDBLOCK;
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  int GetSocketError(NativeSocket socket)
+  {
+    int error(0);
+#if defined(_WIN32)
+    int length = sizeof(error);
+    if (getsockopt(socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error), &length) != 0)
+#else
+    socklen_t length = sizeof(error);
+    if (getsockopt(socket, SOL_SOCKET, SO_ERROR, &error, &length) != 0)
+#endif
+    {
+      return -1;
+    }
+    return error;
+  }
+
+  struct ConnectAttempt
+  {
+    NativeSocket                                    Socket;
+    size_t                                          AddressIndex;
+    std::chrono::steady_clock::time_point           Start;
+  };
+}
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    const uint32_t ServerDiscovery::DEFAULT_MAX_CONCURRENCY = 32;
+    const uint32_t ServerDiscovery::MAX_CONCURRENCY_LIMIT = 64; // FD_SETSIZE on Windows
+    const double ServerDiscovery::DEFAULT_CONNECT_TIMEOUT_SEC = 0.5;
+    const double ServerDiscovery::DEFAULT_CACHE_TTL_SEC = 60.0;
+    const uint32_t ServerDiscovery::POLL_INTERVAL_MSEC = 20;
+    const uint64_t ServerDiscovery::CURRENT_GENERATION = UINT64_MAX;
+
+    //----------------------------------------------------------------------------
+    bool ServerDiscovery::Probe(const std::vector<std::string>& addresses, uint16_t port, ServerList& outServers, uint64_t generation /*= CURRENT_GENERATION*/)
+    {
+      // Counted as active before the generation is read, so a Cancel either sees this probe or changes the generation it reads
+      m_activeProbes++;
+      if (generation == CURRENT_GENERATION)
+      {
+        generation = m_cancelGeneration;
+      }
+      const uint32_t maxConcurrency = m_maxConcurrency;
+      const auto timeout = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_connectTimeoutSec.load()));
+
+      std::vector<ConnectAttempt> inFlight;
+      inFlight.reserve(maxConcurrency);
+      size_t nextAddress(0);
+      bool cancelled(false);
+
+      auto addServer = [&](size_t addressIndex, Clock::time_point start)
+      {
+        DiscoveredServer server;
+        server.Address = addresses[addressIndex];
+        server.Port = port;
+        server.ResponseTimeSec = std::chrono::duration<double>(Clock::now() - start).count();
+        outServers.push_back(server);
+      };
+
+      while (true)
+      {
+        if (m_cancelGeneration != generation)
+        {
+          cancelled = true;
+          break;
+        }
+
+        // Keep the connect window full
+        while (inFlight.size() < maxConcurrency && nextAddress < addresses.size())
+        {
+          size_t addressIndex = nextAddress++;
+
+          sockaddr_in socketAddress = {};
+          socketAddress.sin_family = AF_INET;
+          socketAddress.sin_port = htons(port);
+          if (inet_pton(AF_INET, addresses[addressIndex].c_str(), &socketAddress.sin_addr) != 1)
+          {
+            continue;
+          }
+
+          NativeSocket socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+          if (socket == INVALID_NATIVE_SOCKET)
+          {
+            continue;
+          }
+#if !defined(_WIN32)
+          if (socket >= FD_SETSIZE)
+          {
+            CloseNativeSocket(socket);
+            continue;
+          }
+#endif
+          if (!SetNonBlocking(socket))
+          {
+            CloseNativeSocket(socket);
+            continue;
+          }
+
+          ConnectAttempt attempt = { socket, addressIndex, Clock::now() };
+          if (connect(socket, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) == 0)
+          {
+            addServer(addressIndex, attempt.Start);
+            CloseNativeSocket(socket);
+          }
+          else if (IsConnectPending())
+          {
+            inFlight.push_back(attempt);
+          }
+          else
+          {
+            CloseNativeSocket(socket);
+          }
+        }
+
+        if (inFlight.empty())
+        {
+          break;
+        }
+
+        // Wait until a connect completes, the oldest one expires, or it is time to check for cancellation
+        fd_set writeSet;
+        fd_set exceptSet;
+        FD_ZERO(&writeSet);
+        FD_ZERO(&exceptSet);
+        NativeSocket maxSocket(0);
+        Clock::time_point earliestDeadline = Clock::time_point::max();
+        for (auto& attempt : inFlight)
+        {
+          FD_SET(attempt.Socket, &writeSet);
+          FD_SET(attempt.Socket, &exceptSet);
+          maxSocket = std::max(maxSocket, attempt.Socket);
+          earliestDeadline = std::min(earliestDeadline, attempt.Start + timeout);
+        }
+
+        auto wait = std::min<Clock::duration>(std::max<Clock::duration>(earliestDeadline - Clock::now(), Clock::duration::zero()), std::chrono::milliseconds(POLL_INTERVAL_MSEC));
+        auto waitUsec = std::chrono::duration_cast<std::chrono::microseconds>(wait).count();
+        timeval selectTimeout;
+        selectTimeout.tv_sec = static_cast<long>(waitUsec / 1000000);
+        selectTimeout.tv_usec = static_cast<long>(waitUsec % 1000000);
+        int ready = select(static_cast<int>(maxSocket + 1), nullptr, &writeSet, &exceptSet, &selectTimeout);
+        if (ready < 0)
+        {
+          FD_ZERO(&writeSet);
+          FD_ZERO(&exceptSet);
+        }
+
+        const Clock::time_point now = Clock::now();
+        for (auto iter = inFlight.begin(); iter != inFlight.end();)
+        {
+          bool done(false);
+          if (FD_ISSET(iter->Socket, &writeSet) || FD_ISSET(iter->Socket, &exceptSet))
+          {
+            if (!FD_ISSET(iter->Socket, &exceptSet) && GetSocketError(iter->Socket) == 0)
+            {
+              addServer(iter->AddressIndex, iter->Start);
+            }
+            done = true;
+          }
+          else if (now - iter->Start >= timeout)
+          {
+            done = true;
+          }
+
+          if (done)
+          {
+            CloseNativeSocket(iter->Socket);
+            iter = inFlight.erase(iter);
+          }
+          else
+          {
+            ++iter;
+          }
+        }
+      }
+
+      for (auto& attempt : inFlight)
+      {
+        CloseNativeSocket(attempt.Socket);
+      }
+
+      std::sort(outServers.begin(), outServers.end(), [](const DiscoveredServer & a, const DiscoveredServer & b)
+      {
+        return a.ResponseTimeSec < b.ResponseTimeSec;
+      });
+
+      m_activeProbes--;
+      return !cancelled;
+    }
+
+    //----------------------------------------------------------------------------
+    bool ServerDiscovery::DiscoverSubnets(const std::vector<std::string>& localAddresses, uint16_t port, ServerList& outServers, bool forceRefresh /*= false*/, uint64_t generation /*= CURRENT_GENERATION*/)
+    {
+      const auto ttl = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(m_cacheTTLSec.load()));
+
+      // Use fresh cache entries, gather the addresses of every other subnet into one probe so they share the connect window
+      // Several local addresses may share a subnet, each subnet is used once
+      std::vector<std::string> visitedSubnets;
+      std::vector<std::string> staleSubnets;
+      std::vector<std::string> addresses;
+      {
+        std::lock_guard<std::mutex> guard(m_cacheMutex);
+        for (auto& localAddress : localAddresses)
+        {
+          std::string subnet = localAddress.substr(0, localAddress.find_last_of('.'));
+          if (std::find(visitedSubnets.begin(), visitedSubnets.end(), subnet) != visitedSubnets.end())
+          {
+            continue;
+          }
+          visitedSubnets.push_back(subnet);
+
+          auto iter = m_cache.find(std::make_pair(subnet, port));
+          if (!forceRefresh && iter != m_cache.end() && Clock::now() - iter->second.Timestamp < ttl)
+          {
+            outServers.insert(outServers.end(), iter->second.Servers.begin(), iter->second.Servers.end());
+            continue;
+          }
+
+          staleSubnets.push_back(subnet);
+          auto subnetAddresses = GetSubnetAddresses(localAddress);
+          addresses.insert(addresses.end(), subnetAddresses.begin(), subnetAddresses.end());
+        }
+      }
+
+      ServerList probed;
+      bool completed = addresses.empty() || Probe(addresses, port, probed, generation);
+
+      // Only complete results are cached, a cancelled probe would hide servers until the TTL expires
+      if (completed && !staleSubnets.empty())
+      {
+        std::lock_guard<std::mutex> guard(m_cacheMutex);
+        const Clock::time_point now = Clock::now();
+        for (auto& subnet : staleSubnets)
+        {
+          CacheEntry& entry = m_cache[std::make_pair(subnet, port)];
+          entry.Timestamp = now;
+          entry.Servers.clear();
+          for (auto& server : probed)
+          {
+            if (server.Address.compare(0, subnet.size() + 1, subnet + ".") == 0)
+            {
+              entry.Servers.push_back(server);
+            }
+          }
+        }
+      }
+
+      outServers.insert(outServers.end(), probed.begin(), probed.end());
+      std::sort(outServers.begin(), outServers.end(), [](const DiscoveredServer & a, const DiscoveredServer & b)
+      {
+        return a.ResponseTimeSec < b.ResponseTimeSec;
+      });
+
+      return completed;
+    }
+
+    //----------------------------------------------------------------------------
+    void ServerDiscovery::Cancel()
+    {
+      m_cancelGeneration++;
+      while (m_activeProbes > 0)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+    }
+
+    //----------------------------------------------------------------------------
+    uint64_t ServerDiscovery::GetGeneration() const
+    {
+      return m_cancelGeneration;
+    }
+
+    //----------------------------------------------------------------------------
+    void ServerDiscovery::InvalidateCache()
+    {
+      std::lock_guard<std::mutex> guard(m_cacheMutex);
+      m_cache.clear();
+    }
+
+    //----------------------------------------------------------------------------
+    void ServerDiscovery::SetMaxConcurrency(uint32_t maxConcurrency)
+    {
+      m_maxConcurrency = std::min(std::max(maxConcurrency, 1u), MAX_CONCURRENCY_LIMIT);
+    }
+
+    //----------------------------------------------------------------------------
+    uint32_t ServerDiscovery::GetMaxConcurrency() const
+    {
+      return m_maxConcurrency;
+    }
+
+    //----------------------------------------------------------------------------
+    void ServerDiscovery::SetConnectTimeoutSec(double timeoutSec)
+    {
+      m_connectTimeoutSec = timeoutSec;
+    }
+
+    //----------------------------------------------------------------------------
+    double ServerDiscovery::GetConnectTimeoutSec() const
+    {
+      return m_connectTimeoutSec;
+    }
+
+    //----------------------------------------------------------------------------
+    void ServerDiscovery::SetCacheTTLSec(double ttlSec)
+    {
+      m_cacheTTLSec = ttlSec;
+    }
+
+    //----------------------------------------------------------------------------
+    double ServerDiscovery::GetCacheTTLSec() const
+    {
+      return m_cacheTTLSec;
+    }
+
+    //----------------------------------------------------------------------------
+    std::vector<std::string> ServerDiscovery::GetSubnetAddresses(const std::string& localAddress)
+    {
+      std::vector<std::string> addresses;
+
+      auto separator = localAddress.find_last_of('.');
+      if (separator == std::string::npos)
+      {
+        return addresses;
+      }
+      std::string prefix = localAddress.substr(0, separator + 1);
+      std::string machine = localAddress.substr(separator + 1);
+
+      for (int i = 1; i < 255; ++i)
+      {
+        std::stringstream ss;
+        ss << i;
+        if (ss.str() == machine)
+        {
+          continue;
+        }
+        addresses.push_back(prefix + ss.str());
+      }
+
+      return addresses;
+    }
+
+    //----------------------------------------------------------------------------
+    ServerDiscovery::ServerDiscovery()
+      : m_maxConcurrency(DEFAULT_MAX_CONCURRENCY)
+      , m_connectTimeoutSec(DEFAULT_CONNECT_TIMEOUT_SEC)
+      , m_cacheTTLSec(DEFAULT_CACHE_TTL_SEC)
+    {
+#if defined(_WIN32)
+      WSADATA wsaData;
+      WSAStartup(MAKEWORD(2, 2), &wsaData);
+#endif
+    }
+
+    //----------------------------------------------------------------------------
+    ServerDiscovery::~ServerDiscovery()
+    {
+      Cancel();
+#if defined(_WIN32)
+      WSACleanup();
+#endif
+    }
+  }
+}
\ No newline at end of file
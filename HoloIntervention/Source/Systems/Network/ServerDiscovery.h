@@ -0,0 +1,117 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    struct DiscoveredServer
+    {
+      std::string   Address;
+      uint16_t      Port = 0;
+      double        ResponseTimeSec = 0.0;
+    };
+
+    // Finds listening servers by attempting TCP connections to a list of addresses
+    // Connects are non-blocking, at most m_maxConcurrency are in flight at any time, and each is abandoned after m_connectTimeoutSec
+    // Results are ranked by response time (fastest first) and subnet results are cached for m_cacheTTLSec
+    class ServerDiscovery
+    {
+    public:
+      typedef std::vector<DiscoveredServer> ServerList;
+
+      // Probe under whatever generation is current when it starts
+      static const uint64_t CURRENT_GENERATION;
+
+    public:
+      /// Probe the given addresses. Returns false if the probe was cancelled, outServers then holds what was found so far
+      /// generation is GetGeneration() from when the probe was requested, so a Cancel between request and start is not missed
+      bool Probe(const std::vector<std::string>& addresses, uint16_t port, ServerList& outServers, uint64_t generation = CURRENT_GENERATION);
+
+      /// Probe every host in the /24 subnet of each local IPv4 address, using cached results that are younger than the TTL
+      bool DiscoverSubnets(const std::vector<std::string>& localAddresses, uint16_t port, ServerList& outServers, bool forceRefresh = false, uint64_t generation = CURRENT_GENERATION);
+
+      /// Abort all probes currently in progress and any requested under an earlier generation, returns once the running ones have released their sockets
+      void Cancel();
+      uint64_t GetGeneration() const;
+
+      void InvalidateCache();
+
+      void SetMaxConcurrency(uint32_t maxConcurrency);
+      uint32_t GetMaxConcurrency() const;
+
+      void SetConnectTimeoutSec(double timeoutSec);
+      double GetConnectTimeoutSec() const;
+
+      void SetCacheTTLSec(double ttlSec);
+      double GetCacheTTLSec() const;
+
+      /// All host addresses in the /24 subnet of localAddress, excluding the network, broadcast and local addresses
+      static std::vector<std::string> GetSubnetAddresses(const std::string& localAddress);
+
+    public:
+      ServerDiscovery();
+      ~ServerDiscovery();
+
+    protected:
+      typedef std::chrono::steady_clock Clock;
+
+      struct CacheEntry
+      {
+        Clock::time_point   Timestamp;
+        ServerList          Servers;
+      };
+      typedef std::map<std::pair<std::string, uint16_t>, CacheEntry> SubnetCache;
+
+    protected:
+      std::atomic_uint32_t        m_maxConcurrency;
+      std::atomic<double>         m_connectTimeoutSec;
+      std::atomic<double>         m_cacheTTLSec;
+
+      // Incremented by Cancel, a probe stops as soon as it observes a change
+      std::atomic_uint64_t        m_cancelGeneration { 0 };
+      std::atomic_uint32_t        m_activeProbes { 0 };
+
+      mutable std::mutex          m_cacheMutex;
+      SubnetCache                 m_cache;
+
+      static const uint32_t       DEFAULT_MAX_CONCURRENCY;
+      static const uint32_t       MAX_CONCURRENCY_LIMIT;
+      static const double         DEFAULT_CONNECT_TIMEOUT_SEC;
+      static const double         DEFAULT_CACHE_TTL_SEC;
+      static const uint32_t       POLL_INTERVAL_MSEC;
+    };
+  }
+}
\ No newline at end of file
@@ -0,0 +1,87 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+#pragma once
+
+// STL includes
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    // Read-mostly state published as immutable snapshots, RCU style
+    // Readers load a raw pointer with acquire ordering: no lock, no reference count and no shared cache line is written.
+    // Writers are serialized, edit a copy of the current snapshot and publish it with release ordering. A superseded
+    // snapshot is retired rather than freed, so a reader still holding it stays valid until the publisher is destroyed.
+    // Suited to state that changes at configuration time (connectors, subscriptions), one snapshot is kept per change.
+    template<typename T>
+    class SnapshotPublisher
+    {
+    public:
+      SnapshotPublisher()
+      {
+        m_snapshots.push_back(std::unique_ptr<const T>(new T()));
+        m_current.store(m_snapshots.back().get(), std::memory_order_release);
+      }
+
+      /// Valid for the lifetime of the publisher
+      const T* Load() const
+      {
+        return m_current.load(std::memory_order_acquire);
+      }
+
+      /// edit(T&) receives a copy of the current snapshot and returns true to publish it
+      template<typename EditFunction>
+      bool Update(EditFunction edit)
+      {
+        std::lock_guard<std::mutex> guard(m_writeMutex);
+        std::unique_ptr<T> next(new T(*Load()));
+        if (!edit(*next))
+        {
+          return false;
+        }
+        m_current.store(next.get(), std::memory_order_release);
+        m_snapshots.push_back(std::unique_ptr<const T>(std::move(next)));
+        return true;
+      }
+
+      /// Snapshots published so far, the current one included
+      size_t GetSnapshotCount() const
+      {
+        std::lock_guard<std::mutex> guard(m_writeMutex);
+        return m_snapshots.size();
+      }
+
+    protected:
+      mutable std::mutex                      m_writeMutex;
+      std::vector<std::unique_ptr<const T>>   m_snapshots;  // Every published snapshot, guarded by m_writeMutex
+      std::atomic<const T*>                   m_current { nullptr };
+    };
+  }
+}
\ No newline at end of file
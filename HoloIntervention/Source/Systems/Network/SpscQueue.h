@@ -0,0 +1,124 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    // Bounded lock-free queue between exactly one producer thread and one consumer thread
+    // Capacity is rounded up to a power of two. Head and tail live on separate cache lines so the two sides do not contend.
+    template<typename T>
+    class SpscQueue
+    {
+    public:
+      explicit SpscQueue(size_t capacity)
+      {
+        size_t size(2);
+        while (size < capacity)
+        {
+          size <<= 1;
+        }
+        m_slots.resize(size);
+        m_mask = size - 1;
+      }
+
+      /// Producer side, returns false (and leaves the queue untouched) when full
+      bool TryPush(const T& item)
+      {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_cachedHead > m_mask)
+        {
+          m_cachedHead = m_head.load(std::memory_order_acquire);
+          if (tail - m_cachedHead > m_mask)
+          {
+            m_rejected.fetch_add(1, std::memory_order_relaxed);
+            return false;
+          }
+        }
+        m_slots[tail & m_mask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+      }
+
+      /// Consumer side, returns false when empty
+      bool TryPop(T& outItem)
+      {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_cachedTail)
+        {
+          m_cachedTail = m_tail.load(std::memory_order_acquire);
+          if (head == m_cachedTail)
+          {
+            return false;
+          }
+        }
+        outItem = m_slots[head & m_mask];
+        m_slots[head & m_mask] = T(); // Release references held by the item
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+      }
+
+      /// Approximate when called concurrently
+      size_t Size() const
+      {
+        return m_tail.load(std::memory_order_acquire) - m_head.load(std::memory_order_acquire);
+      }
+
+      bool IsFull() const
+      {
+        return Size() > m_mask;
+      }
+
+      size_t Capacity() const
+      {
+        return m_mask + 1;
+      }
+
+      uint64_t GetRejectedCount() const
+      {
+        return m_rejected.load(std::memory_order_relaxed);
+      }
+
+    protected:
+      std::vector<T>                    m_slots;
+      size_t                            m_mask = 0;
+
+      alignas(64) std::atomic<size_t>   m_head { 0 };
+      size_t                            m_cachedTail = 0; // Consumer's view of m_tail
+
+      alignas(64) std::atomic<size_t>   m_tail { 0 };
+      size_t                            m_cachedHead = 0; // Producer's view of m_head
+
+      alignas(64) std::atomic<uint64_t> m_rejected { 0 };
+    };
+  }
+}
\ No newline at end of file
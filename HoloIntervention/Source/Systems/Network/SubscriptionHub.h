@@ -0,0 +1,457 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// Local includes
+#include "SnapshotPublisher.h"
+
+// STL includes
+#include <array>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace HoloIntervention
+{
+  namespace Network
+  {
+    enum SubscriptionMessageType
+    {
+      SUBSCRIPTION_MESSAGE_TRANSFORM,
+      SUBSCRIPTION_MESSAGE_TRACKED_FRAME,
+      SUBSCRIPTION_MESSAGE_IMAGE
+    };
+
+    inline bool SubscriptionMessageTypeFromString(const std::wstring& name, SubscriptionMessageType& outType)
+    {
+      if (name == L"Transform")
+      {
+        outType = SUBSCRIPTION_MESSAGE_TRANSFORM;
+      }
+      else if (name == L"TrackedFrame")
+      {
+        outType = SUBSCRIPTION_MESSAGE_TRACKED_FRAME;
+      }
+      else if (name == L"Image")
+      {
+        outType = SUBSCRIPTION_MESSAGE_IMAGE;
+      }
+      else
+      {
+        return false;
+      }
+      return true;
+    }
+
+    inline std::wstring SubscriptionMessageTypeToString(SubscriptionMessageType type)
+    {
+      switch (type)
+      {
+        case SUBSCRIPTION_MESSAGE_TRACKED_FRAME:
+          return L"TrackedFrame";
+        case SUBSCRIPTION_MESSAGE_IMAGE:
+          return L"Image";
+        default:
+          return L"Transform";
+      }
+    }
+
+    /// Key identifying one (connector, message type, device name) stream
+    inline uint64_t MakeSubscriptionKey(uint64_t hashedConnectionName, SubscriptionMessageType type, uint64_t hashedDeviceName)
+    {
+      uint64_t key = hashedConnectionName;
+      key ^= static_cast<uint64_t>(type) + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+      key ^= hashedDeviceName + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+      return key;
+    }
+
+    /// Subscription tokens are unique across all hubs
+    inline uint64_t NextSubscriptionToken()
+    {
+      static std::atomic<uint64_t> nextToken(1);
+      return nextToken++;
+    }
+
+    // Latest value slot between one producer and one consumer, neither side ever blocks
+    // Implemented as a triple buffer: the producer fills its back slot and swaps it with the middle slot, the consumer
+    // swaps the middle slot with its front slot when it is marked fresh. Values the consumer never saw are coalesced.
+    // A mailbox may also be given a fetch function, which TryTake calls to read the producer's source directly, so the
+    // consumer sees the latest message at the moment it reads rather than the one last posted. Whichever of the two is
+    // newer is returned, and nothing older than what the consumer already took is ever returned.
+    template<typename PayloadType>
+    class Mailbox
+    {
+    public:
+      struct Entry
+      {
+        PayloadType   Payload = PayloadType();
+        double        Timestamp = 0.0;
+        uint64_t      Sequence = 0;   // Posted count, 0 for fetched entries
+      };
+
+      /// Fills outEntry and returns true only if the source has a message newer than latestTimestamp
+      typedef std::function<bool(double latestTimestamp, Entry& outEntry)> Fetch;
+
+    public:
+      Mailbox() {}
+      explicit Mailbox(Fetch fetch) : m_fetch(fetch) {}
+
+      /// Producer side
+      void Post(const PayloadType& payload, double timestamp)
+      {
+        Entry& back = m_slots[m_back];
+        back.Payload = payload;
+        back.Timestamp = timestamp;
+        back.Sequence = ++m_posted;
+
+        uint8_t previous = m_middle.exchange(static_cast<uint8_t>(m_back | FRESH_BIT), std::memory_order_acq_rel);
+        m_back = previous & INDEX_MASK;
+        if (previous & FRESH_BIT)
+        {
+          m_coalesced.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+
+      /// Consumer side, returns false if nothing newer was posted or fetched since the last successful take
+      bool TryTake(Entry& outEntry)
+      {
+        const Entry* posted = nullptr;
+        if (HasUpdate())
+        {
+          uint8_t previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+          m_front = previous & INDEX_MASK;
+          posted = &m_slots[m_front];
+        }
+        if (m_fetch == nullptr)
+        {
+          if (posted != nullptr)
+          {
+            outEntry = *posted;
+          }
+          return posted != nullptr;
+        }
+
+        // A posted message the consumer already read through the fetch is dropped
+        if (posted != nullptr && posted->Timestamp <= m_takenTimestamp)
+        {
+          posted = nullptr;
+        }
+        Entry fetched;
+        if (m_fetch(posted != nullptr ? posted->Timestamp : m_takenTimestamp, fetched))
+        {
+          m_fetched.fetch_add(1, std::memory_order_relaxed);
+          outEntry = fetched;
+        }
+        else if (posted != nullptr)
+        {
+          outEntry = *posted;
+        }
+        else
+        {
+          return false;
+        }
+        m_takenTimestamp = outEntry.Timestamp;
+        return true;
+      }
+
+      bool HasUpdate() const
+      {
+        return (m_middle.load(std::memory_order_acquire) & FRESH_BIT) != 0;
+      }
+
+      bool HasFetch() const
+      {
+        return m_fetch != nullptr;
+      }
+
+      uint64_t GetPostedCount() const
+      {
+        return m_posted;
+      }
+
+      uint64_t GetCoalescedCount() const
+      {
+        return m_coalesced.load(std::memory_order_relaxed);
+      }
+
+      uint64_t GetFetchedCount() const
+      {
+        return m_fetched.load(std::memory_order_relaxed);
+      }
+
+    protected:
+      static const uint8_t        INDEX_MASK = 0x3;
+      static const uint8_t        FRESH_BIT = 0x4;
+
+      std::array<Entry, 3>        m_slots;
+      uint8_t                     m_back = 0;     // Owned by the producer
+      uint8_t                     m_front = 1;    // Owned by the consumer
+      std::atomic<uint8_t>        m_middle { 2 };
+      std::atomic<uint64_t>       m_posted { 0 };
+      std::atomic<uint64_t>       m_coalesced { 0 };
+
+      Fetch                       m_fetch;
+      double                      m_takenTimestamp = 0.0;   // Owned by the consumer
+      std::atomic<uint64_t>       m_fetched { 0 };
+    };
+
+    // Fans published messages out to the consumers that registered interest in their key
+    // Consumers either receive a callback, or read a mailbox at their own pace. Both coalesce per subscriber: a slow
+    // callback or an idle mailbox only ever sees the latest message, never a backlog.
+    // Callbacks run through the executor when one is set, at most one at a time per subscriber, so a slow subscriber
+    // never holds up the publisher or any other subscriber. Without an executor they run on the publishing thread.
+    // Each key must have a single publishing thread at a time (the mailbox producer side)
+    // Subscribers are read through SnapshotPublisher, so Publish never locks or touches a reference count. Every
+    // Subscribe and Unsubscribe retires a copy of the subscriber map, and with it keeps removed subscribers alive, until
+    // the hub is destroyed. Subscriptions change when tools and views are configured, not per message.
+    template<typename PayloadType>
+    class SubscriptionHub
+    {
+    public:
+      typedef std::function<void(const PayloadType&, double)> Callback;
+      typedef std::shared_ptr<Mailbox<PayloadType>> MailboxPtr;
+      typedef std::function<void(std::function<void()>)> Executor;
+      typedef typename Mailbox<PayloadType>::Fetch Fetch;
+
+    public:
+      /// Set before the first Publish
+      void SetExecutor(Executor executor)
+      {
+        m_executor = executor;
+      }
+
+      /// Returns the subscription token
+      uint64_t Subscribe(uint64_t key, Callback callback)
+      {
+        auto subscriber = std::make_shared<Subscriber>();
+        subscriber->OnMessage = callback;
+        return AddSubscriber(key, subscriber);
+      }
+
+      /// fetch: optional, see Mailbox
+      uint64_t Subscribe(uint64_t key, MailboxPtr& outMailbox, Fetch fetch = nullptr)
+      {
+        auto subscriber = std::make_shared<Subscriber>();
+        subscriber->Box = std::make_shared<Mailbox<PayloadType>>(fetch);
+        outMailbox = subscriber->Box;
+        return AddSubscriber(key, subscriber);
+      }
+
+      /// A callback already in progress may still complete after this returns
+      bool Unsubscribe(uint64_t token, uint64_t& outKey)
+      {
+        return m_subscribers.Update([token, &outKey](SubscriberMap & subscribers)
+        {
+          for (auto& pair : subscribers)
+          {
+            for (auto iter = pair.second.begin(); iter != pair.second.end(); ++iter)
+            {
+              if ((*iter)->Token == token)
+              {
+                outKey = pair.first;
+                pair.second.erase(iter);
+                if (pair.second.empty())
+                {
+                  subscribers.erase(outKey);
+                }
+                return true;
+              }
+            }
+          }
+          return false;
+        });
+      }
+
+      bool HasSubscribers(uint64_t key) const
+      {
+        const SubscriberMap* current = m_subscribers.Load();
+        return current->find(key) != current->end();
+      }
+
+      /// True when every subscriber of key is a mailbox that fetches its own messages, publishing to it is then unnecessary
+      bool AllSubscribersFetch(uint64_t key) const
+      {
+        const SubscriberMap* current = m_subscribers.Load();
+        auto iter = current->find(key);
+        if (iter == current->end())
+        {
+          return false;
+        }
+        for (auto& subscriber : iter->second)
+        {
+          if (subscriber->Box == nullptr || !subscriber->Box->HasFetch())
+          {
+            return false;
+          }
+        }
+        return true;
+      }
+
+      /// Deliver a message to every subscriber of key, returns the number of subscribers reached
+      size_t Publish(uint64_t key, const PayloadType& payload, double timestamp)
+      {
+        const SubscriberMap* current = m_subscribers.Load();
+        auto iter = current->find(key);
+        if (iter == current->end())
+        {
+          return 0;
+        }
+        for (auto& subscriber : iter->second)
+        {
+          Deliver(subscriber, payload, timestamp);
+        }
+        return iter->second.size();
+      }
+
+      bool GetSubscriberCounts(uint64_t token, uint64_t& outDelivered, uint64_t& outCoalesced) const
+      {
+        const SubscriberMap* current = m_subscribers.Load();
+        for (auto& pair : *current)
+        {
+          for (auto& subscriber : pair.second)
+          {
+            if (subscriber->Token == token)
+            {
+              outDelivered = subscriber->Box != nullptr ? subscriber->Box->GetPostedCount() + subscriber->Box->GetFetchedCount() : subscriber->Delivered.load();
+              outCoalesced = subscriber->Box != nullptr ? subscriber->Box->GetCoalescedCount() : subscriber->Coalesced.load();
+              return true;
+            }
+          }
+        }
+        return false;
+      }
+
+    protected:
+      struct Subscriber
+      {
+        uint64_t                Token = 0;
+        Callback                OnMessage;
+        MailboxPtr              Box;
+
+        // Callback coalescing
+        std::mutex              PendingMutex;
+        bool                    InFlight = false;
+        bool                    HasPending = false;
+        PayloadType             Pending = PayloadType();
+        double                  PendingTimestamp = 0.0;
+        std::atomic<uint64_t>   Delivered { 0 };
+        std::atomic<uint64_t>   Coalesced { 0 };
+      };
+      typedef std::unordered_map<uint64_t, std::vector<std::shared_ptr<Subscriber>>> SubscriberMap;
+
+    protected:
+      uint64_t AddSubscriber(uint64_t key, std::shared_ptr<Subscriber> subscriber)
+      {
+        subscriber->Token = NextSubscriptionToken();
+        m_subscribers.Update([key, &subscriber](SubscriberMap & subscribers)
+        {
+          subscribers[key].push_back(subscriber);
+          return true;
+        });
+        return subscriber->Token;
+      }
+
+      void Deliver(const std::shared_ptr<Subscriber>& subscriber, const PayloadType& payload, double timestamp)
+      {
+        if (subscriber->Box != nullptr)
+        {
+          subscriber->Box->Post(payload, timestamp);
+          return;
+        }
+
+        {
+          std::lock_guard<std::mutex> guard(subscriber->PendingMutex);
+          if (subscriber->InFlight)
+          {
+            // The thread running the callback picks this up when it is done, replacing anything older
+            if (subscriber->HasPending)
+            {
+              subscriber->Coalesced++;
+            }
+            subscriber->Pending = payload;
+            subscriber->PendingTimestamp = timestamp;
+            subscriber->HasPending = true;
+            return;
+          }
+          subscriber->InFlight = true;
+        }
+
+        if (m_executor)
+        {
+          // The work item keeps the subscriber alive past an Unsubscribe
+          m_executor([subscriber, payload, timestamp]()
+          {
+            RunCallback(*subscriber, payload, timestamp);
+          });
+        }
+        else
+        {
+          RunCallback(*subscriber, payload, timestamp);
+        }
+      }
+
+      static void RunCallback(Subscriber& subscriber, PayloadType payload, double timestamp)
+      {
+        while (true)
+        {
+          try
+          {
+            subscriber.OnMessage(payload, timestamp);
+          }
+          catch (...)
+          {
+            // Anything that arrived meanwhile is older than what the next Publish brings, drop it so the subscriber
+            // is not left marked in flight and never called again
+            std::lock_guard<std::mutex> guard(subscriber.PendingMutex);
+            subscriber.Pending = PayloadType();
+            subscriber.HasPending = false;
+            subscriber.InFlight = false;
+            throw;
+          }
+          subscriber.Delivered++;
+
+          std::lock_guard<std::mutex> guard(subscriber.PendingMutex);
+          if (!subscriber.HasPending)
+          {
+            subscriber.InFlight = false;
+            return;
+          }
+          payload = subscriber.Pending;
+          timestamp = subscriber.PendingTimestamp;
+          subscriber.Pending = PayloadType();
+          subscriber.HasPending = false;
+        }
+      }
+
+    protected:
+      SnapshotPublisher<SubscriberMap>          m_subscribers;
+      Executor                                  m_executor;
+    };
+  }
+}
\ No newline at end of file
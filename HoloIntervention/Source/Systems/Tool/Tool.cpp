@@ -24,8 +24,12 @@ OTHER DEALINGS IN THE SOFTWARE.
 // Local includes
 #include "pch.h"
 #include "Common.h"
+#include "MathCommon.h"
 #include "Tool.h"
 
+// Debug includes
+#include "LatencyTracer.h"
+
 // UI includes
 #include "Icons.h"
 
@@ -96,16 +100,20 @@ namespace HoloIntervention
                uint64 hashedConnectionName,
                UWPOpenIGTLink::TransformName^ coordinateFrame,
                UWPOpenIGTLink::TransformRepository^ transformRepository,
+               std::shared_ptr<TransformGraph> transformGraph,
                Platform::String^ userId)
       : m_modelRenderer(modelRenderer)
       , m_networkSystem(networkSystem)
       , m_icons(icons)
       , m_hashedConnectionName(hashedConnectionName)
       , m_transformRepository(transformRepository)
+      , m_transformGraph(transformGraph)
       , m_coordinateFrame(coordinateFrame)
       , m_userId(std::wstring(userId->Data()))
     {
       m_modelCoordinateFrameName = MODEL_COORDINATE_FRAME_NAME + userId;
+      SubscribeToCoordinateFrame();
+      CompileTransformChains();
       m_componentReady = true;
     }
 
@@ -116,28 +124,34 @@ namespace HoloIntervention
                uint64 hashedConnectionName,
                const std::wstring& coordinateFrame,
                UWPOpenIGTLink::TransformRepository^ transformRepository,
+               std::shared_ptr<TransformGraph> transformGraph,
                Platform::String^ userId)
       : m_modelRenderer(modelRenderer)
       , m_networkSystem(networkSystem)
       , m_icons(icons)
       , m_hashedConnectionName(hashedConnectionName)
       , m_transformRepository(transformRepository)
+      , m_transformGraph(transformGraph)
       , m_userId(std::wstring(userId->Data()))
     {
       m_modelCoordinateFrameName = MODEL_COORDINATE_FRAME_NAME + userId;
       m_coordinateFrame = ref new UWPOpenIGTLink::TransformName(ref new Platform::String(coordinateFrame.c_str()));
+      SubscribeToCoordinateFrame();
+      CompileTransformChains();
     }
 
     //----------------------------------------------------------------------------
     Tool::~Tool()
     {
+      m_networkSystem.Unsubscribe(m_subscriptionToken);
     }
 
     //----------------------------------------------------------------------------
-    void Tool::Update(const DX::StepTimer& timer)
+    void Tool::Update(const DX::StepTimer& timer, double photonTime)
     {
-      bool registrationTransformValid = m_transformRepository->GetTransformValid(ref new UWPOpenIGTLink::TransformName(m_coordinateFrame->To(), HOLOLENS_COORDINATE_SYSTEM_PNAME));
-      if (!registrationTransformValid)
+      TransformGraph::Matrix matrix;
+      bool registrationTransformValid(false);
+      if (!m_transformGraph->GetTransform(m_referenceToHMDChain, matrix, registrationTransformValid) || !registrationTransformValid)
       {
         m_modelEntry->SetVisible(false);
         if (m_iconEntry != nullptr)
@@ -151,20 +165,35 @@ namespace HoloIntervention
         m_modelEntry->SetVisible(!m_hiddenOverride);
       }
 
-      // m_transformRepository has already been initialized with the network transforms for this update
-      auto objectToRefTransform = m_networkSystem.GetTransform(m_hashedConnectionName, m_coordinateFrame, m_latestTimestamp);
+      // m_transformGraph has already been updated with the latest registration for this update
+      Network::Mailbox<UWPOpenIGTLink::Transform^>::Entry update;
+      bool newTransform = m_transformMailbox->TryTake(update) && update.Payload != nullptr;
+      std::lock_guard<std::mutex> guard(m_predictorMutex);
+      bool predict(m_predictionEnabled);
+      if (newTransform)
+      {
+        auto objectToRefTransform = update.Payload;
+
+        m_latestTimestamp = objectToRefTransform->Timestamp;
+        Float4x4ToArray(objectToRefTransform->Matrix, matrix.data());
+        m_transformGraph->SetTransform(m_objectFrameId, m_referenceFrameId, matrix, objectToRefTransform->Valid);
 
-      if (objectToRefTransform == nullptr)
+        // A sample the predictor didn't take (invalid, repeated) must not be replaced by a prediction from older samples
+        predict = m_predictionEnabled && m_posePredictor.AddSample(m_latestTimestamp, LatencyTracer::Now(), matrix, objectToRefTransform->Valid);
+      }
+      else if (!m_predictionEnabled || !m_posePredictor.IsValid())
       {
-        // No new transform since last timestamp
+        // No new transform since last update, and nothing to extrapolate
         return;
       }
 
-      m_latestTimestamp = objectToRefTransform->Timestamp;
-      m_transformRepository->SetTransform(m_coordinateFrame, objectToRefTransform->Matrix, objectToRefTransform->Valid);
+      if (predict && m_posePredictor.IsValid() && m_posePredictor.PredictAtLocalTime(photonTime, matrix))
+      {
+        m_transformGraph->SetTransform(m_objectFrameId, m_referenceFrameId, matrix, true);
+      }
 
-      IKeyValuePair<bool, float4x4>^ result = m_transformRepository->GetTransform(ref new UWPOpenIGTLink::TransformName(GetModelCoordinateFrameName(), HOLOLENS_COORDINATE_SYSTEM_PNAME));
-      m_isValid = result->Key;
+      bool modelToHMDValid(false);
+      m_isValid = m_transformGraph->GetTransform(m_modelToHMDChain, matrix, modelToHMDValid) && modelToHMDValid;
       if (!m_isValid && m_wasValid)
       {
         m_wasValid = false;
@@ -195,7 +224,13 @@ namespace HoloIntervention
 
         if (m_modelEntry != nullptr)
         {
-          m_modelEntry->SetDesiredPose(transpose(result->Value));
+          float4x4 modelToHMD;
+          ArrayToFloat4x4(matrix, modelToHMD);
+          m_modelEntry->SetDesiredPose(transpose(modelToHMD));
+          if (newTransform && LatencyTracer::instance().IsEnabled())
+          {
+            LatencyTracer::instance().Stamp(LatencyTracer::MakeStreamId(m_hashedConnectionName, HashString(m_coordinateFrame->GetTransformName())), m_latestTimestamp, LATENCY_STAGE_CONSUMED);
+          }
         }
         m_wasValid = true;
       }
@@ -227,10 +262,43 @@ namespace HoloIntervention
     void Tool::SetCoordinateFrame(UWPOpenIGTLink::TransformName^ coordFrame)
     {
       m_coordinateFrame = coordFrame;
+      SubscribeToCoordinateFrame();
+      CompileTransformChains();
       m_transformRepository->SetTransform(ref new UWPOpenIGTLink::TransformName(GetModelCoordinateFrameName(), m_coordinateFrame->From()), transpose(m_modelToObjectTransform), true);
       m_transformRepository->SetTransformPersistent(ref new UWPOpenIGTLink::TransformName(GetModelCoordinateFrameName(), m_coordinateFrame->From()), true);
     }
 
+    //----------------------------------------------------------------------------
+    void Tool::SubscribeToCoordinateFrame()
+    {
+      // Many tools may share a connector, the network system pulls each transform once and delivers it to our mailbox
+      m_networkSystem.Unsubscribe(m_subscriptionToken);
+      m_subscriptionToken = m_networkSystem.SubscribeTransform(m_hashedConnectionName, m_coordinateFrame, m_transformMailbox);
+    }
+
+    //----------------------------------------------------------------------------
+    void Tool::CompileTransformChains()
+    {
+      // Frame names are resolved once here, Update only works with ids and precompiled chains
+      // The model frame is ours alone, a link to a previous object frame would leave the model attached to both
+      TransformGraph::FrameId objectFrameId = m_transformGraph->InternFrame(m_coordinateFrame->From()->Data());
+      if (m_modelFrameId != TransformGraph::INVALID_FRAME && m_objectFrameId != TransformGraph::INVALID_FRAME && m_objectFrameId != objectFrameId)
+      {
+        m_transformGraph->RemoveTransform(m_modelFrameId, m_objectFrameId);
+      }
+      m_modelFrameId = m_transformGraph->InternFrame(GetModelCoordinateFrameName()->Data());
+      m_objectFrameId = objectFrameId;
+      m_referenceFrameId = m_transformGraph->InternFrame(m_coordinateFrame->To()->Data());
+      TransformGraph::FrameId hmdFrameId = m_transformGraph->InternFrame(HOLOLENS_COORDINATE_SYSTEM_PNAME->Data());
+
+      TransformGraph::Matrix modelToObject;
+      Float4x4ToArray(transpose(m_modelToObjectTransform), modelToObject.data());
+      m_transformGraph->SetTransform(m_modelFrameId, m_objectFrameId, modelToObject, true);
+
+      m_referenceToHMDChain = m_transformGraph->CompileChain(m_referenceFrameId, hmdFrameId);
+      m_modelToHMDChain = m_transformGraph->CompileChain(m_modelFrameId, hmdFrameId);
+    }
+
     //----------------------------------------------------------------------------
     UWPOpenIGTLink::TransformName^ Tool::GetCoordinateFrame() const
     {
@@ -262,6 +330,10 @@ namespace HoloIntervention
       // Store as row-major (UWPOpenIGTLink convention)
       m_transformRepository->SetTransform(ref new UWPOpenIGTLink::TransformName(GetModelCoordinateFrameName(), m_coordinateFrame->From()), transpose(m_modelToObjectTransform), true);
       m_transformRepository->SetTransformPersistent(ref new UWPOpenIGTLink::TransformName(GetModelCoordinateFrameName(), m_coordinateFrame->From()), true);
+
+      TransformGraph::Matrix modelToObject;
+      Float4x4ToArray(transpose(m_modelToObjectTransform), modelToObject.data());
+      m_transformGraph->SetTransform(m_modelFrameId, m_objectFrameId, modelToObject, true);
     }
 
     //----------------------------------------------------------------------------
@@ -292,6 +364,37 @@ namespace HoloIntervention
       m_hiddenOverride = arg;
     }
 
+    //----------------------------------------------------------------------------
+    void Tool::SetPredictionEnabled(bool enabled)
+    {
+      std::lock_guard<std::mutex> guard(m_predictorMutex);
+      if (m_predictionEnabled != enabled)
+      {
+        m_posePredictor.Reset();
+      }
+      m_predictionEnabled = enabled;
+    }
+
+    //----------------------------------------------------------------------------
+    bool Tool::GetPredictionEnabled() const
+    {
+      return m_predictionEnabled;
+    }
+
+    //----------------------------------------------------------------------------
+    void Tool::SetPredictionSettings(const PosePredictor::Settings& settings)
+    {
+      std::lock_guard<std::mutex> guard(m_predictorMutex);
+      m_posePredictor.SetSettings(settings);
+    }
+
+    //----------------------------------------------------------------------------
+    PosePredictor::Settings Tool::GetPredictionSettings() const
+    {
+      std::lock_guard<std::mutex> guard(m_predictorMutex);
+      return m_posePredictor.GetSettings();
+    }
+
     //----------------------------------------------------------------------------
     void Tool::ShowIcon(bool show)
     {
@@ -25,9 +25,15 @@ OTHER DEALINGS IN THE SOFTWARE.
 
 // Local includes
 #include "IStabilizedComponent.h"
+#include "PosePredictor.h"
+#include "TransformGraph.h"
+
+// Network includes
+#include "SubscriptionHub.h"
 
 // STL includes
 #include <atomic>
+#include <mutex>
 
 // OpenCV
 #include <Opencv2/core/mat.hpp>
@@ -77,6 +83,7 @@ namespace HoloIntervention
            uint64 hashedConnectionName,
            UWPOpenIGTLink::TransformName^ coordinateFrame,
            UWPOpenIGTLink::TransformRepository^ transformRepository,
+           std::shared_ptr<TransformGraph> transformGraph,
            Platform::String^ userId);
       Tool(Rendering::ModelRenderer& modelRenderer,
            System::NetworkSystem& networkSystem,
@@ -84,10 +91,12 @@ namespace HoloIntervention
            uint64 hashedConnectionName,
            const std::wstring& coordinateFrame,
            UWPOpenIGTLink::TransformRepository^ transformRepository,
+           std::shared_ptr<TransformGraph> transformGraph,
            Platform::String^ userId);
       ~Tool();
 
-      void Update(const DX::StepTimer& timer);
+      /// photonTime is when the frame being prepared is predicted to reach the display, in LatencyTracer::Now() seconds
+      void Update(const DX::StepTimer& timer, double photonTime);
 
       Concurrency::task<void> SetModelAsync(std::shared_ptr<Rendering::Model> entry);
       std::shared_ptr<Rendering::Model> GetModel();
@@ -106,10 +115,18 @@ namespace HoloIntervention
 
       void SetHiddenOverride(bool arg);
 
+      /// Extrapolate the tracked pose to the photon time of each frame instead of showing the latest received pose
+      void SetPredictionEnabled(bool enabled);
+      bool GetPredictionEnabled() const;
+      void SetPredictionSettings(const PosePredictor::Settings& settings);
+      PosePredictor::Settings GetPredictionSettings() const;
+
       void ShowIcon(bool show);
 
     protected:
       Platform::String^ GetModelCoordinateFrameName();
+      void SubscribeToCoordinateFrame();
+      void CompileTransformChains();
 
     protected:
       // Cached links to system resources
@@ -123,6 +140,17 @@ namespace HoloIntervention
       double                                      m_latestTimestamp = 0.0;
       UWPOpenIGTLink::TransformRepository^        m_transformRepository;
       UWPOpenIGTLink::TransformName^              m_coordinateFrame;
+      std::shared_ptr<TransformGraph>             m_transformGraph;
+      TransformGraph::FrameId                     m_modelFrameId = TransformGraph::INVALID_FRAME;
+      TransformGraph::FrameId                     m_objectFrameId = TransformGraph::INVALID_FRAME;
+      TransformGraph::FrameId                     m_referenceFrameId = TransformGraph::INVALID_FRAME;
+      TransformGraph::ChainId                     m_referenceToHMDChain = TransformGraph::INVALID_CHAIN;
+      TransformGraph::ChainId                     m_modelToHMDChain = TransformGraph::INVALID_CHAIN;
+      uint64                                      m_subscriptionToken = 0;
+      std::shared_ptr<Network::Mailbox<UWPOpenIGTLink::Transform^>> m_transformMailbox = nullptr;
+      std::atomic_bool                            m_predictionEnabled = false;
+      mutable std::mutex                          m_predictorMutex;
+      PosePredictor                               m_posePredictor;
 
       // Model details
       std::atomic_bool                            m_isValid = false;
@@ -157,6 +157,13 @@ namespace HoloIntervention
           {
             toolElem->SetAttribute(L"LerpRate", tool->GetModel()->GetLerpRate().ToString());
           }
+          toolElem->SetAttribute(L"Prediction", tool->GetPredictionEnabled() ? L"true" : L"false");
+          if (tool->GetPredictionEnabled())
+          {
+            auto settings = tool->GetPredictionSettings();
+            toolElem->SetAttribute(L"PredictionMaxHorizonMsec", (settings.MaxHorizonSec * 1000.0).ToString());
+            toolElem->SetAttribute(L"PredictionLatencyMsec", (settings.AdditionalLatencySec * 1000.0).ToString());
+          }
           toolsElem->AppendChild(toolElem);
         }
 
@@ -173,6 +180,7 @@ namespace HoloIntervention
       {
         return task_from_result(false);
       }
+      SeedTransformGraph(document);
 
       return create_task([this, document]()
       {
@@ -355,6 +363,26 @@ namespace HoloIntervention
             {
               tool->GetModel()->SetPoseLerpRate(lerpRate);
             }
+
+            bool predictionEnabled;
+            if (GetBooleanAttribute(L"Prediction", node, predictionEnabled) && predictionEnabled)
+            {
+              auto settings = tool->GetPredictionSettings();
+              double msec;
+              if (GetScalarAttribute<double>(L"PredictionMaxHorizonMsec", node, msec))
+              {
+                settings.MaxHorizonSec = msec / 1000.0;
+              }
+              if (GetScalarAttribute<double>(L"PredictionLatencyMsec", node, msec))
+              {
+                settings.AdditionalLatencySec = msec / 1000.0;
+              }
+              tool->SetPredictionSettings(settings);
+              tool->SetPredictionEnabled(true);
+
+              // Smoothing towards an already extrapolated pose only adds back the lag
+              tool->GetModel()->EnablePoseLerp(false);
+            }
           });
         }
 
@@ -373,6 +401,8 @@ namespace HoloIntervention
       , m_transformRepository(ref new UWPOpenIGTLink::TransformRepository())
       , m_networkSystem(networkSystem)
     {
+      m_referenceFrameId = m_transformGraph->InternFrame(L"Reference");
+      m_hmdFrameId = m_transformGraph->InternFrame(HOLOLENS_COORDINATE_SYSTEM_PNAME->Data());
     }
 
     //----------------------------------------------------------------------------
@@ -470,7 +500,7 @@ namespace HoloIntervention
           LOG_ERROR("Cannot create tool. Model failed to load.");
           return task_from_result(INVALID_TOKEN);
         }
-        std::shared_ptr<Tools::Tool> entry = std::make_shared<Tools::Tool>(m_modelRenderer, m_networkSystem, m_icons, m_hashedConnectionName, coordinateFrame, m_transformRepository, userId);
+        std::shared_ptr<Tools::Tool> entry = std::make_shared<Tools::Tool>(m_modelRenderer, m_networkSystem, m_icons, m_hashedConnectionName, coordinateFrame, m_transformRepository, m_transformGraph, userId);
         entry->SetModelToObjectTransform(modelToObjectTransform);
         auto modelEntry = m_modelRenderer.GetModel(modelEntryId);
         return entry->SetModelAsync(modelEntry).then([this, entry, modelEntry, colour]()
@@ -509,17 +539,19 @@ namespace HoloIntervention
     }
 
     //----------------------------------------------------------------------------
-    void ToolSystem::Update(const DX::StepTimer& timer, SpatialCoordinateSystem^ hmdCoordinateSystem)
+    void ToolSystem::Update(const DX::StepTimer& timer, SpatialCoordinateSystem^ hmdCoordinateSystem, double photonTime)
     {
-      // Update the transform repository with the latest registration
+      // Update the transform graph with the latest registration
       float4x4 referenceToHMD(float4x4::identity());
       bool registrationAvailable = m_registrationSystem.GetReferenceToCoordinateSystemTransformation(hmdCoordinateSystem, referenceToHMD);
-      m_transformRepository->SetTransform(ref new UWPOpenIGTLink::TransformName(L"Reference", HOLOLENS_COORDINATE_SYSTEM_PNAME), transpose(referenceToHMD), registrationAvailable);
+      TransformGraph::Matrix referenceToHMDArray;
+      Float4x4ToArray(transpose(referenceToHMD), referenceToHMDArray.data());
+      m_transformGraph->SetTransform(m_referenceFrameId, m_hmdFrameId, referenceToHMDArray, registrationAvailable);
 
       std::lock_guard<std::mutex> guard(m_entriesMutex);
       for (auto entry : m_tools)
       {
-        entry->Update(timer);
+        entry->Update(timer, photonTime);
       }
     }
 
@@ -554,5 +586,31 @@ namespace HoloIntervention
       }
     }
 
+    //----------------------------------------------------------------------------
+    void ToolSystem::SeedTransformGraph(XmlDocument^ document)
+    {
+      // The repository has parsed the matrices, the document only lists which links it defined
+      auto xpath = ref new Platform::String(L"/HoloIntervention/CoordinateDefinitions/Transform");
+      for (auto node : document->SelectNodes(xpath))
+      {
+        if (!HasAttribute(L"From", node) || !HasAttribute(L"To", node))
+        {
+          continue;
+        }
+        Platform::String^ fromString = dynamic_cast<Platform::String^>(node->Attributes->GetNamedItem(L"From")->NodeValue);
+        Platform::String^ toString = dynamic_cast<Platform::String^>(node->Attributes->GetNamedItem(L"To")->NodeValue);
+        auto result = m_transformRepository->GetTransform(ref new UWPOpenIGTLink::TransformName(fromString, toString));
+        if (!result->Key)
+        {
+          WLOG_WARNING(L"Coordinate definition " + fromString + L"To" + toString + L" is not in the transform repository.");
+          continue;
+        }
+
+        TransformGraph::Matrix fromToTo;
+        Float4x4ToArray(result->Value, fromToTo.data());
+        m_transformGraph->SetTransform(fromString->Data(), toString->Data(), fromToTo, true);
+      }
+    }
+
   }
 }
@@ -27,6 +27,7 @@ OTHER DEALINGS IN THE SOFTWARE.
 #include "IConfigurable.h"
 #include "IStabilizedComponent.h"
 #include "IVoiceInput.h"
+#include "TransformGraph.h"
 
 namespace HoloIntervention
 {
@@ -85,13 +86,16 @@ namespace HoloIntervention
       void UnregisterTool(uint64 toolToken);
       void ClearTools();
 
-      void Update(const DX::StepTimer& timer, Windows::Perception::Spatial::SpatialCoordinateSystem^ coordSystem);
+      void Update(const DX::StepTimer& timer, Windows::Perception::Spatial::SpatialCoordinateSystem^ coordSystem, double photonTime);
 
       // IVoiceInput functions
       virtual void RegisterVoiceCallbacks(Input::VoiceInputCallbackMap& callbackMap);
 
       void ShowIcons(bool show);
 
+    protected:
+      void SeedTransformGraph(Windows::Data::Xml::Dom::XmlDocument^ document);
+
     protected:
       // Cached entries
       NotificationSystem&                               m_notificationSystem;
@@ -106,7 +110,10 @@ namespace HoloIntervention
       double                                            m_latestTimestamp;
       mutable std::mutex                                m_entriesMutex;
       std::vector<std::shared_ptr<Tools::Tool>>         m_tools;
-      UWPOpenIGTLink::TransformRepository^              m_transformRepository;
+      UWPOpenIGTLink::TransformRepository^              m_transformRepository; // Persistent model to object transforms, for config saving
+      std::shared_ptr<TransformGraph>                   m_transformGraph = std::make_shared<TransformGraph>(); // Per frame tool queries
+      TransformGraph::FrameId                           m_referenceFrameId = TransformGraph::INVALID_FRAME;
+      TransformGraph::FrameId                           m_hmdFrameId = TransformGraph::INVALID_FRAME;
     };
   }
 }
\ No newline at end of file
@@ -0,0 +1,292 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Benchmark client for IGTMockServer (or any OpenIGTLink server)
+// Receives and fully decodes every message, and reports per type throughput, decode cost,
+// end to end latency (server timestamp to decoded) and peak memory
+//   IGTLoadClient --Host=127.0.0.1 --Port=18944 --DurationSec=30 [--Record=session.igts]
+
+// Local includes
+#include "LoadProfile.h"
+#include "SessionFile.h"
+
+// OpenIGTLink includes
+#include <igtlClientSocket.h>
+#include <igtlImageMessage.h>
+#include <igtlMessageHeader.h>
+#include <igtlPolyDataMessage.h>
+#include <igtlTimeStamp.h>
+#include <igtlTrackingDataMessage.h>
+#include <igtlTransformMessage.h>
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// OS includes
+#if defined(_WIN32)
+  #include <windows.h>
+  #include <psapi.h>
+#else
+  #include <sys/resource.h>
+#endif
+
+using namespace IGTLoadTest;
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  const int RECONNECT_DELAY_MSEC = 250;
+
+  struct TypeStatistics
+  {
+    uint64_t              Count = 0;
+    uint64_t              Bytes = 0;
+    uint64_t              CrcFailures = 0;
+    double                DecodeSec = 0.0;
+    std::vector<double>   LatencyMsec;
+  };
+
+  //----------------------------------------------------------------------------
+  double Percentile(std::vector<double>& values, double percentile)
+  {
+    if (values.empty())
+    {
+      return 0.0;
+    }
+    size_t index = static_cast<size_t>(percentile / 100.0 * (values.size() - 1) + 0.5);
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+  }
+
+  //----------------------------------------------------------------------------
+  double PeakMemoryMiB()
+  {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+      return counters.PeakWorkingSetSize / (1024.0 * 1024.0);
+    }
+    return 0.0;
+#else
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss / 1024.0;
+#endif
+  }
+
+  //----------------------------------------------------------------------------
+  igtl::MessageBase::Pointer CreateMessage(const std::string& deviceType)
+  {
+    if (deviceType == "TRANSFORM")
+    {
+      return igtl::TransformMessage::New().GetPointer();
+    }
+    else if (deviceType == "TDATA")
+    {
+      return igtl::TrackingDataMessage::New().GetPointer();
+    }
+    else if (deviceType == "IMAGE")
+    {
+      return igtl::ImageMessage::New().GetPointer();
+    }
+    else if (deviceType == "POLYDATA")
+    {
+      return igtl::PolyDataMessage::New().GetPointer();
+    }
+    return igtl::MessageBase::New();
+  }
+
+  //----------------------------------------------------------------------------
+  MessageType ClassifyMessage(igtl::MessageHeader::Pointer header)
+  {
+    // The mock server sends its video stream as uncompressed IMAGE messages from the "Video" device
+    if (std::string(header->GetDeviceName()) == "Video")
+    {
+      return MESSAGE_TYPE_VIDEO;
+    }
+    return DeviceTypeToMessageType(header->GetDeviceType());
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  std::string host("127.0.0.1");
+  int port(18944);
+  double durationSec(10.0);
+  std::string recordFile;
+
+  for (int i = 1; i < argc; ++i)
+  {
+    std::string arg(argv[i]);
+    auto separator = arg.find('=');
+    std::string key = arg.substr(0, separator);
+    std::string value = separator == std::string::npos ? std::string() : arg.substr(separator + 1);
+    try
+    {
+      if (key == "--Host")
+      {
+        host = value;
+      }
+      else if (key == "--Port")
+      {
+        port = std::stoi(value);
+      }
+      else if (key == "--DurationSec")
+      {
+        durationSec = std::stod(value);
+      }
+      else if (key == "--Record")
+      {
+        recordFile = value;
+      }
+      else
+      {
+        std::cerr << "Unrecognized argument: " << arg << std::endl;
+        return EXIT_FAILURE;
+      }
+    }
+    catch (const std::exception&)
+    {
+      std::cerr << "Unable to parse argument: " << arg << std::endl;
+      return EXIT_FAILURE;
+    }
+  }
+
+  SessionWriter writer;
+  if (!recordFile.empty() && !writer.Open(recordFile))
+  {
+    std::cerr << "Unable to open " << recordFile << " for writing." << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  TypeStatistics stats[MESSAGE_TYPE_COUNT + 1];
+  uint32_t connections(0);
+  igtl::MessageHeader::Pointer header = igtl::MessageHeader::New();
+  igtl::TimeStamp::Pointer now = igtl::TimeStamp::New();
+  igtl::TimeStamp::Pointer sent = igtl::TimeStamp::New();
+
+  const Clock::time_point start = Clock::now();
+  auto elapsedSec = [&start]()
+  {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+
+  while (elapsedSec() < durationSec)
+  {
+    igtl::ClientSocket::Pointer socket = igtl::ClientSocket::New();
+    if (socket->ConnectToServer(host.c_str(), port) != 0)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(RECONNECT_DELAY_MSEC));
+      continue;
+    }
+    connections++;
+    socket->SetReceiveTimeout(1000);
+
+    while (elapsedSec() < durationSec)
+    {
+      header->InitPack();
+      bool timeout(false);
+      igtlUint64 received = socket->Receive(header->GetPackPointer(), header->GetPackSize(), timeout);
+      if (timeout)
+      {
+        continue;
+      }
+      if (received != header->GetPackSize())
+      {
+        break;
+      }
+      header->Unpack();
+
+      igtl::MessageBase::Pointer message = CreateMessage(header->GetDeviceType());
+      message->SetMessageHeader(header);
+      message->AllocatePack();
+      if (message->GetPackBodySize() > 0)
+      {
+        received = socket->Receive(message->GetPackBodyPointer(), message->GetPackBodySize(), timeout);
+        if (received != message->GetPackBodySize())
+        {
+          break;
+        }
+      }
+
+      auto decodeStart = Clock::now();
+      int result = message->Unpack(1);
+      double decodeSec = std::chrono::duration<double>(Clock::now() - decodeStart).count();
+
+      now->GetTime();
+      header->GetTimeStamp(sent);
+
+      MessageType type = ClassifyMessage(header);
+      TypeStatistics& entry = stats[type];
+      entry.Count++;
+      entry.Bytes += message->GetPackSize();
+      entry.DecodeSec += decodeSec;
+      entry.LatencyMsec.push_back((now->GetTimeStamp() - sent->GetTimeStamp()) * 1000.0);
+      if (!(result & igtl::MessageHeader::UNPACK_BODY) && message->GetPackBodySize() > 0)
+      {
+        entry.CrcFailures++;
+      }
+
+      if (!recordFile.empty())
+      {
+        writer.Write(elapsedSec(), header->GetPackPointer(), header->GetPackSize(), message->GetPackBodyPointer(), message->GetPackBodySize());
+      }
+    }
+
+    socket->CloseSocket();
+  }
+
+  double totalSec = elapsedSec();
+  std::cout << std::fixed << std::setprecision(2);
+  std::cout << "Ran " << totalSec << " s over " << connections << " connection(s), peak memory " << PeakMemoryMiB() << " MiB" << std::endl;
+  std::cout << std::setw(10) << "Type" << std::setw(10) << "Msgs/s" << std::setw(10) << "MiB/s" << std::setw(12) << "Decode us"
+            << std::setw(10) << "p50 ms" << std::setw(10) << "p95 ms" << std::setw(10) << "p99 ms" << std::setw(8) << "CRC" << std::endl;
+  for (int type = 0; type <= MESSAGE_TYPE_COUNT; ++type)
+  {
+    TypeStatistics& entry = stats[type];
+    if (entry.Count == 0)
+    {
+      continue;
+    }
+    std::cout << std::setw(10) << (type == MESSAGE_TYPE_COUNT ? "OTHER" : MessageTypeToString(static_cast<MessageType>(type)))
+              << std::setw(10) << entry.Count / totalSec
+              << std::setw(10) << entry.Bytes / (1024.0 * 1024.0) / totalSec
+              << std::setw(12) << entry.DecodeSec / entry.Count * 1e6
+              << std::setw(10) << Percentile(entry.LatencyMsec, 50.0)
+              << std::setw(10) << Percentile(entry.LatencyMsec, 95.0)
+              << std::setw(10) << Percentile(entry.LatencyMsec, 99.0)
+              << std::setw(8) << entry.CrcFailures << std::endl;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,502 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Mock OpenIGTLink server producing synthetic (or replayed) tracker, imaging and model traffic over TCP
+// so that NetworkSystem and UWPOpenIGTLink can be load tested without trackers or ultrasound devices
+//   IGTMockServer --Profile=profiles/tracking.profile --Port=18944
+//   IGTMockServer --ReplayFile=session.igts --ReplaySpeed=2
+
+// Local includes
+#include "LoadProfile.h"
+#include "SessionFile.h"
+
+// OpenIGTLink includes
+#include <igtlImageMessage.h>
+#include <igtlMath.h>
+#include <igtlPolyDataMessage.h>
+#include <igtlServerSocket.h>
+#include <igtlTimeStamp.h>
+#include <igtlTrackingDataMessage.h>
+#include <igtlTransformMessage.h>
+
+// STL includes
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <thread>
+
+using namespace IGTLoadTest;
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  const double PI = 3.14159265358979323846;
+  const int ACCEPT_TIMEOUT_MSEC = 500;
+
+  // Offset of the timestamp field in a packed OpenIGTLink header (version, type, device name precede it)
+  const size_t IGTL_HEADER_TIMESTAMP_OFFSET = 2 + 12 + 20;
+
+  //----------------------------------------------------------------------------
+  double SecondsSince(const Clock::time_point& start)
+  {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  }
+
+  //----------------------------------------------------------------------------
+  void WriteBigEndian64(uint8_t* dest, uint64_t value)
+  {
+    for (int i = 7; i >= 0; --i)
+    {
+      dest[i] = static_cast<uint8_t>(value & 0xFF);
+      value >>= 8;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // The header CRC only covers the body, so the timestamp can be replaced in place when replaying
+  void RestampPackedMessage(std::vector<uint8_t>& message, double timeSec)
+  {
+    if (message.size() < IGTL_HEADER_SIZE)
+    {
+      return;
+    }
+    double seconds = std::floor(timeSec);
+    uint64_t fraction = static_cast<uint64_t>((timeSec - seconds) * 4294967296.0);
+    WriteBigEndian64(message.data() + IGTL_HEADER_TIMESTAMP_OFFSET, (static_cast<uint64_t>(seconds) << 32) | (fraction & 0xFFFFFFFF));
+  }
+
+  //----------------------------------------------------------------------------
+  class MessageFactory
+  {
+  public:
+    MessageFactory(const LoadProfile& profile)
+      : m_profile(profile)
+      , m_timestamp(igtl::TimeStamp::New())
+    {
+      for (uint32_t i = 0; i < m_profile.ToolCount; ++i)
+      {
+        std::ostringstream ss;
+        ss << "Tool" << i << "ToReference";
+
+        igtl::TransformMessage::Pointer transform = igtl::TransformMessage::New();
+        transform->SetDeviceName(ss.str().c_str());
+        m_transforms.push_back(transform);
+
+        igtl::TrackingDataElement::Pointer element = igtl::TrackingDataElement::New();
+        element->SetName(ss.str().c_str());
+        element->SetType(igtl::TrackingDataElement::TYPE_6D);
+        m_trackingElements.push_back(element);
+      }
+
+      m_trackingData = igtl::TrackingDataMessage::New();
+      m_trackingData->SetDeviceName("Tracker");
+      for (auto& element : m_trackingElements)
+      {
+        m_trackingData->AddTrackingDataElement(element);
+      }
+
+      int imageSize[3] = { static_cast<int>(m_profile.ImageSize[0]), static_cast<int>(m_profile.ImageSize[1]), static_cast<int>(m_profile.ImageSize[2]) };
+      m_image = CreateImage("Image", imageSize, m_profile.ImageComponents);
+
+      int videoSize[3] = { static_cast<int>(m_profile.VideoSize[0]), static_cast<int>(m_profile.VideoSize[1]), 1 };
+      m_video = CreateImage("Video", videoSize, 3);
+
+      m_polydata = CreatePolydata(m_profile.PolydataPoints);
+    }
+
+    // Fills outMessages with packed messages of the requested type for the given stream time
+    void Build(MessageType type, double timeSec, uint64_t frameNumber, std::vector<igtl::MessageBase::Pointer>& outMessages)
+    {
+      m_timestamp->GetTime();
+      outMessages.clear();
+
+      switch (type)
+      {
+      case MESSAGE_TYPE_TRANSFORM:
+        for (size_t i = 0; i < m_transforms.size(); ++i)
+        {
+          igtl::Matrix4x4 matrix;
+          ToolMatrix(i, timeSec, matrix);
+          m_transforms[i]->SetMatrix(matrix);
+          m_transforms[i]->SetTimeStamp(m_timestamp);
+          m_transforms[i]->Pack();
+          outMessages.push_back(m_transforms[i].GetPointer());
+        }
+        break;
+      case MESSAGE_TYPE_TDATA:
+        for (size_t i = 0; i < m_trackingElements.size(); ++i)
+        {
+          igtl::Matrix4x4 matrix;
+          ToolMatrix(i, timeSec, matrix);
+          m_trackingElements[i]->SetMatrix(matrix);
+        }
+        m_trackingData->SetTimeStamp(m_timestamp);
+        m_trackingData->Pack();
+        outMessages.push_back(m_trackingData.GetPointer());
+        break;
+      case MESSAGE_TYPE_IMAGE:
+        UpdateImage(m_image, frameNumber);
+        outMessages.push_back(m_image.GetPointer());
+        break;
+      case MESSAGE_TYPE_VIDEO:
+        UpdateImage(m_video, frameNumber);
+        outMessages.push_back(m_video.GetPointer());
+        break;
+      case MESSAGE_TYPE_POLYDATA:
+        m_polydata->SetTimeStamp(m_timestamp);
+        m_polydata->Pack();
+        outMessages.push_back(m_polydata.GetPointer());
+        break;
+      default:
+        break;
+      }
+    }
+
+  protected:
+    //----------------------------------------------------------------------------
+    igtl::ImageMessage::Pointer CreateImage(const char* deviceName, int size[3], uint32_t components)
+    {
+      igtl::ImageMessage::Pointer image = igtl::ImageMessage::New();
+      float spacing[3] = { 0.1f, 0.1f, 0.1f };
+      image->SetDeviceName(deviceName);
+      image->SetDimensions(size);
+      image->SetSpacing(spacing);
+      image->SetScalarType(igtl::ImageMessage::TYPE_UINT8);
+      image->SetNumComponents(static_cast<int>(components));
+      image->AllocateScalars();
+      return image;
+    }
+
+    //----------------------------------------------------------------------------
+    igtl::PolyDataMessage::Pointer CreatePolydata(uint32_t pointCount)
+    {
+      igtl::PolyDataMessage::Pointer polydata = igtl::PolyDataMessage::New();
+      polydata->SetDeviceName("Model");
+
+      igtl::PolyDataPointArray::Pointer points = igtl::PolyDataPointArray::New();
+      igtl::PolyDataCellArray::Pointer polygons = igtl::PolyDataCellArray::New();
+
+      // Points on a spiral around a unit sphere, joined into a triangle strip
+      for (uint32_t i = 0; i < pointCount; ++i)
+      {
+        double t = pointCount > 1 ? static_cast<double>(i) / (pointCount - 1) : 0.0;
+        double theta = t * PI;
+        double phi = t * PI * 64.0;
+        igtlFloat32 point[3] = { static_cast<igtlFloat32>(std::sin(theta) * std::cos(phi) * 50.0),
+                                 static_cast<igtlFloat32>(std::sin(theta) * std::sin(phi) * 50.0),
+                                 static_cast<igtlFloat32>(std::cos(theta) * 50.0)
+                               };
+        points->AddPoint(point);
+
+        if (i >= 2)
+        {
+          igtlUint32 cell[3] = { i - 2, i - 1, i };
+          polygons->AddCell(3, cell);
+        }
+      }
+
+      polydata->SetPoints(points);
+      polydata->SetPolygons(polygons);
+      return polydata;
+    }
+
+    //----------------------------------------------------------------------------
+    void UpdateImage(igtl::ImageMessage::Pointer image, uint64_t frameNumber)
+    {
+      // Moving gradient so that consecutive frames differ, but cheaply enough not to limit the send rate
+      uint8_t* scalars = reinterpret_cast<uint8_t*>(image->GetScalarPointer());
+      int size[3];
+      image->GetDimensions(size);
+      const size_t rowLength = static_cast<size_t>(size[0]) * image->GetNumComponents();
+      const size_t rowCount = static_cast<size_t>(size[1]) * size[2];
+      for (size_t row = 0; row < rowCount; ++row)
+      {
+        memset(scalars + row * rowLength, static_cast<int>((row + frameNumber) & 0xFF), rowLength);
+      }
+      image->SetTimeStamp(m_timestamp);
+      image->Pack();
+    }
+
+    //----------------------------------------------------------------------------
+    void ToolMatrix(size_t toolIndex, double timeSec, igtl::Matrix4x4& matrix)
+    {
+      // Each tool follows a circle with a distinct phase, rotating about z as it goes
+      double angle = timeSec * 2.0 * PI * 0.25 + toolIndex * (2.0 * PI / (std::max<size_t>)(1, m_transforms.size()));
+      igtl::IdentityMatrix(matrix);
+      matrix[0][0] = static_cast<float>(std::cos(angle));
+      matrix[0][1] = static_cast<float>(-std::sin(angle));
+      matrix[1][0] = static_cast<float>(std::sin(angle));
+      matrix[1][1] = static_cast<float>(std::cos(angle));
+      matrix[0][3] = static_cast<float>(100.0 * std::cos(angle));
+      matrix[1][3] = static_cast<float>(100.0 * std::sin(angle));
+      matrix[2][3] = static_cast<float>(20.0 * toolIndex);
+    }
+
+  protected:
+    const LoadProfile&                              m_profile;
+    igtl::TimeStamp::Pointer                        m_timestamp;
+    std::vector<igtl::TransformMessage::Pointer>    m_transforms;
+    std::vector<igtl::TrackingDataElement::Pointer> m_trackingElements;
+    igtl::TrackingDataMessage::Pointer              m_trackingData;
+    igtl::ImageMessage::Pointer                     m_image;
+    igtl::ImageMessage::Pointer                     m_video;
+    igtl::PolyDataMessage::Pointer                  m_polydata;
+  };
+
+  //----------------------------------------------------------------------------
+  struct ServerStatistics
+  {
+    uint64_t  Sent[MESSAGE_TYPE_COUNT] = { 0 };
+    uint64_t  Dropped[MESSAGE_TYPE_COUNT] = { 0 };
+    uint64_t  Bytes = 0;
+    uint32_t  Disconnects = 0;
+  };
+
+  //----------------------------------------------------------------------------
+  // Returns false when the client went away
+  bool ServeSynthetic(igtl::Socket::Pointer socket, const LoadProfile& profile, const Clock::time_point& serverStart, std::mt19937& generator, ServerStatistics& stats)
+  {
+    MessageFactory factory(profile);
+    std::uniform_real_distribution<double> jitter(-profile.JitterMsec / 1000.0, profile.JitterMsec / 1000.0);
+    std::uniform_real_distribution<double> loss(0.0, 1.0);
+
+    struct Stream
+    {
+      MessageType       Type;
+      double            PeriodSec;
+      double            NominalSec;   // Jitter free schedule, advanced by exactly one period per send
+      double            NextSec;      // Nominal time plus this send's jitter
+      uint64_t          FrameNumber;
+    };
+    std::vector<Stream> streams;
+    const double connectionStart = SecondsSince(serverStart);
+    for (int type = 0; type < MESSAGE_TYPE_COUNT; ++type)
+    {
+      if (profile.RateHz[type] > 0.0)
+      {
+        streams.push_back(Stream{ static_cast<MessageType>(type), 1.0 / profile.RateHz[type], connectionStart, connectionStart, 0 });
+      }
+    }
+    if (streams.empty())
+    {
+      std::cerr << "No message types enabled in profile." << std::endl;
+      return false;
+    }
+
+    std::vector<igtl::MessageBase::Pointer> messages;
+    while (true)
+    {
+      auto next = std::min_element(streams.begin(), streams.end(), [](const Stream & a, const Stream & b)
+      {
+        return a.NextSec < b.NextSec;
+      });
+
+      double now = SecondsSince(serverStart);
+      if (profile.DurationSec > 0.0 && now >= profile.DurationSec)
+      {
+        return true;
+      }
+      if (profile.DisconnectPeriodSec > 0.0 && now - connectionStart >= profile.DisconnectPeriodSec)
+      {
+        stats.Disconnects++;
+        return true;
+      }
+      if (next->NextSec > now)
+      {
+        std::this_thread::sleep_for(std::chrono::duration<double>(next->NextSec - now));
+      }
+
+      factory.Build(next->Type, next->NextSec, next->FrameNumber++, messages);
+      for (auto& message : messages)
+      {
+        if (profile.LossRatio > 0.0 && loss(generator) < profile.LossRatio)
+        {
+          stats.Dropped[next->Type]++;
+          continue;
+        }
+        if (socket->Send(message->GetPackPointer(), message->GetPackSize()) == 0)
+        {
+          return false;
+        }
+        stats.Sent[next->Type]++;
+        stats.Bytes += message->GetPackSize();
+      }
+
+      // Schedule from the nominal time so jitter does not accumulate into drift
+      next->NominalSec += next->PeriodSec;
+      double jittered = next->NominalSec + (profile.JitterMsec > 0.0 ? jitter(generator) : 0.0);
+      next->NextSec = (std::max)(jittered, SecondsSince(serverStart));
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool ServeReplay(igtl::Socket::Pointer socket, const LoadProfile& profile, const Clock::time_point& serverStart, std::mt19937& generator, ServerStatistics& stats)
+  {
+    SessionReader reader;
+    if (!reader.Open(profile.ReplayFile))
+    {
+      std::cerr << "Unable to open session: " << profile.ReplayFile << std::endl;
+      return false;
+    }
+
+    std::uniform_real_distribution<double> loss(0.0, 1.0);
+    igtl::MessageHeader::Pointer header = igtl::MessageHeader::New();
+    const double connectionStart = SecondsSince(serverStart);
+    double replayOffset = connectionStart;
+    double firstRecordTime = -1.0;
+    SessionRecord record;
+
+    while (true)
+    {
+      if (!reader.Read(record))
+      {
+        if (!profile.ReplayLoop || !reader.Rewind())
+        {
+          return true;
+        }
+        replayOffset = SecondsSince(serverStart);
+        firstRecordTime = -1.0;
+        continue;
+      }
+
+      if (firstRecordTime < 0.0)
+      {
+        firstRecordTime = record.ReceiveTimeSec;
+      }
+
+      double now = SecondsSince(serverStart);
+      if (profile.DurationSec > 0.0 && now >= profile.DurationSec)
+      {
+        return true;
+      }
+      if (profile.DisconnectPeriodSec > 0.0 && now - connectionStart >= profile.DisconnectPeriodSec)
+      {
+        stats.Disconnects++;
+        return true;
+      }
+
+      if (profile.ReplaySpeed > 0.0)
+      {
+        double target = replayOffset + (record.ReceiveTimeSec - firstRecordTime) / profile.ReplaySpeed;
+        if (target > now)
+        {
+          std::this_thread::sleep_for(std::chrono::duration<double>(target - now));
+        }
+      }
+
+      if (record.Message.size() < IGTL_HEADER_SIZE)
+      {
+        continue;
+      }
+      header->InitPack();
+      memcpy(header->GetPackPointer(), record.Message.data(), IGTL_HEADER_SIZE);
+      header->Unpack();
+      MessageType type = DeviceTypeToMessageType(header->GetDeviceType());
+      type = type == MESSAGE_TYPE_COUNT ? MESSAGE_TYPE_TRANSFORM : type;
+
+      if (profile.LossRatio > 0.0 && loss(generator) < profile.LossRatio)
+      {
+        stats.Dropped[type]++;
+        continue;
+      }
+
+      igtl::TimeStamp::Pointer timestamp = igtl::TimeStamp::New();
+      timestamp->GetTime();
+      RestampPackedMessage(record.Message, timestamp->GetTimeStamp());
+      if (socket->Send(record.Message.data(), record.Message.size()) == 0)
+      {
+        return false;
+      }
+      stats.Sent[type]++;
+      stats.Bytes += record.Message.size();
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void PrintStatistics(const ServerStatistics& stats, double elapsedSec)
+  {
+    std::cout << "Elapsed " << elapsedSec << " s, " << stats.Bytes / (1024.0 * 1024.0) << " MiB sent, " << stats.Disconnects << " forced disconnects" << std::endl;
+    for (int type = 0; type < MESSAGE_TYPE_COUNT; ++type)
+    {
+      if (stats.Sent[type] + stats.Dropped[type] > 0)
+      {
+        std::cout << "  " << MessageTypeToString(static_cast<MessageType>(type)) << ": " << stats.Sent[type] << " sent (" << stats.Sent[type] / elapsedSec << " /s), " << stats.Dropped[type] << " dropped" << std::endl;
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  LoadProfile profile;
+  std::string error;
+  if (!ApplyProfileArguments(argc, argv, profile, error))
+  {
+    std::cerr << error << std::endl;
+    return EXIT_FAILURE;
+  }
+  std::cout << ProfileToString(profile) << std::endl;
+
+  igtl::ServerSocket::Pointer serverSocket = igtl::ServerSocket::New();
+  if (serverSocket->CreateServer(profile.Port) < 0)
+  {
+    std::cerr << "Unable to listen on port " << profile.Port << std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::mt19937 generator(std::random_device{}());
+  ServerStatistics stats;
+  const Clock::time_point serverStart = Clock::now();
+
+  while (profile.DurationSec <= 0.0 || SecondsSince(serverStart) < profile.DurationSec)
+  {
+    igtl::Socket::Pointer socket = serverSocket->WaitForConnection(ACCEPT_TIMEOUT_MSEC);
+    if (socket.IsNull())
+    {
+      continue;
+    }
+
+    std::cout << "Client connected." << std::endl;
+    bool clientAlive = profile.ReplayFile.empty()
+                       ? ServeSynthetic(socket, profile, serverStart, generator, stats)
+                       : ServeReplay(socket, profile, serverStart, generator, stats);
+    socket->CloseSocket();
+    std::cout << (clientAlive ? "Disconnected client." : "Client disconnected.") << std::endl;
+    PrintStatistics(stats, SecondsSince(serverStart));
+
+    if (clientAlive && profile.DisconnectPeriodSec > 0.0)
+    {
+      std::this_thread::sleep_for(std::chrono::duration<double>(profile.DisconnectDurationSec));
+    }
+  }
+
+  serverSocket->CloseSocket();
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,291 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "LoadProfile.h"
+
+// STL includes
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  std::string Trim(const std::string& input)
+  {
+    auto first = input.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+    {
+      return std::string();
+    }
+    auto last = input.find_last_not_of(" \t\r\n");
+    return input.substr(first, last - first + 1);
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsEqualInsensitive(const std::string& a, const std::string& b)
+  {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](char x, char y)
+    {
+      return std::tolower(x) == std::tolower(y);
+    });
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  bool ParseValues(const std::string& value, T* out, size_t count)
+  {
+    std::istringstream ss(value);
+    for (size_t i = 0; i < count; ++i)
+    {
+      if (!(ss >> out[i]))
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+namespace IGTLoadTest
+{
+  //----------------------------------------------------------------------------
+  bool ReadProfileFile(const std::string& fileName, LoadProfile& outProfile, std::string& outError)
+  {
+    std::ifstream file(fileName);
+    if (!file.is_open())
+    {
+      outError = "Unable to open profile: " + fileName;
+      return false;
+    }
+
+    std::string line;
+    uint32_t lineNumber(0);
+    while (std::getline(file, line))
+    {
+      lineNumber++;
+      auto comment = line.find('#');
+      if (comment != std::string::npos)
+      {
+        line = line.substr(0, comment);
+      }
+      line = Trim(line);
+      if (line.empty())
+      {
+        continue;
+      }
+
+      auto separator = line.find('=');
+      if (separator == std::string::npos || !SetProfileValue(Trim(line.substr(0, separator)), Trim(line.substr(separator + 1)), outProfile))
+      {
+        std::ostringstream ss;
+        ss << fileName << "(" << lineNumber << "): unable to parse \"" << line << "\"";
+        outError = ss.str();
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool ApplyProfileArguments(int argc, char** argv, LoadProfile& outProfile, std::string& outError)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      std::string arg(argv[i]);
+      if (arg.compare(0, 2, "--") != 0)
+      {
+        outError = "Unrecognized argument: " + arg;
+        return false;
+      }
+      arg = arg.substr(2);
+
+      auto separator = arg.find('=');
+      std::string key = separator == std::string::npos ? arg : arg.substr(0, separator);
+      std::string value = separator == std::string::npos ? std::string() : arg.substr(separator + 1);
+
+      if (IsEqualInsensitive(key, "Profile"))
+      {
+        if (!ReadProfileFile(value, outProfile, outError))
+        {
+          return false;
+        }
+        continue;
+      }
+
+      if (!SetProfileValue(key, value, outProfile))
+      {
+        outError = "Unable to parse argument: " + std::string(argv[i]);
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool SetProfileValue(const std::string& key, const std::string& value, LoadProfile& outProfile)
+  {
+    for (int type = 0; type < MESSAGE_TYPE_COUNT; ++type)
+    {
+      if (IsEqualInsensitive(key, std::string(MessageTypeToString(static_cast<MessageType>(type))) + "RateHz"))
+      {
+        return ParseValues(value, &outProfile.RateHz[type], 1) && outProfile.RateHz[type] >= 0.0;
+      }
+    }
+
+    if (IsEqualInsensitive(key, "Name"))
+    {
+      outProfile.Name = value;
+      return !value.empty();
+    }
+    else if (IsEqualInsensitive(key, "Port"))
+    {
+      return ParseValues(value, &outProfile.Port, 1);
+    }
+    else if (IsEqualInsensitive(key, "DurationSec"))
+    {
+      return ParseValues(value, &outProfile.DurationSec, 1);
+    }
+    else if (IsEqualInsensitive(key, "ToolCount"))
+    {
+      return ParseValues(value, &outProfile.ToolCount, 1) && outProfile.ToolCount > 0;
+    }
+    else if (IsEqualInsensitive(key, "ImageSize"))
+    {
+      return ParseValues(value, outProfile.ImageSize, 3);
+    }
+    else if (IsEqualInsensitive(key, "ImageComponents"))
+    {
+      return ParseValues(value, &outProfile.ImageComponents, 1) && (outProfile.ImageComponents == 1 || outProfile.ImageComponents == 3);
+    }
+    else if (IsEqualInsensitive(key, "VideoSize"))
+    {
+      return ParseValues(value, outProfile.VideoSize, 2);
+    }
+    else if (IsEqualInsensitive(key, "PolydataPoints"))
+    {
+      return ParseValues(value, &outProfile.PolydataPoints, 1);
+    }
+    else if (IsEqualInsensitive(key, "JitterMsec"))
+    {
+      return ParseValues(value, &outProfile.JitterMsec, 1) && outProfile.JitterMsec >= 0.0;
+    }
+    else if (IsEqualInsensitive(key, "LossRatio"))
+    {
+      return ParseValues(value, &outProfile.LossRatio, 1) && outProfile.LossRatio >= 0.0 && outProfile.LossRatio <= 1.0;
+    }
+    else if (IsEqualInsensitive(key, "DisconnectPeriodSec"))
+    {
+      return ParseValues(value, &outProfile.DisconnectPeriodSec, 1);
+    }
+    else if (IsEqualInsensitive(key, "DisconnectDurationSec"))
+    {
+      return ParseValues(value, &outProfile.DisconnectDurationSec, 1);
+    }
+    else if (IsEqualInsensitive(key, "ReplayFile"))
+    {
+      outProfile.ReplayFile = value;
+      return true;
+    }
+    else if (IsEqualInsensitive(key, "ReplaySpeed"))
+    {
+      return ParseValues(value, &outProfile.ReplaySpeed, 1) && outProfile.ReplaySpeed >= 0.0;
+    }
+    else if (IsEqualInsensitive(key, "ReplayLoop"))
+    {
+      outProfile.ReplayLoop = IsEqualInsensitive(value, "true") || value == "1";
+      return true;
+    }
+
+    return false;
+  }
+
+  //----------------------------------------------------------------------------
+  std::string ProfileToString(const LoadProfile& profile)
+  {
+    std::ostringstream ss;
+    ss << "Profile \"" << profile.Name << "\" on port " << profile.Port << std::endl;
+    if (!profile.ReplayFile.empty())
+    {
+      ss << "  Replaying " << profile.ReplayFile << " at " << (profile.ReplaySpeed == 0.0 ? std::string("max") : std::to_string(profile.ReplaySpeed) + "x") << " speed" << std::endl;
+    }
+    else
+    {
+      for (int type = 0; type < MESSAGE_TYPE_COUNT; ++type)
+      {
+        if (profile.RateHz[type] > 0.0)
+        {
+          ss << "  " << MessageTypeToString(static_cast<MessageType>(type)) << " at " << profile.RateHz[type] << " Hz" << std::endl;
+        }
+      }
+      ss << "  Tools: " << profile.ToolCount
+         << ", image: " << profile.ImageSize[0] << "x" << profile.ImageSize[1] << "x" << profile.ImageSize[2] << "x" << profile.ImageComponents
+         << ", video: " << profile.VideoSize[0] << "x" << profile.VideoSize[1]
+         << ", polydata points: " << profile.PolydataPoints << std::endl;
+    }
+    ss << "  Jitter: " << profile.JitterMsec << " ms, loss: " << profile.LossRatio * 100.0 << " %";
+    if (profile.DisconnectPeriodSec > 0.0)
+    {
+      ss << ", disconnect every " << profile.DisconnectPeriodSec << " s for " << profile.DisconnectDurationSec << " s";
+    }
+    return ss.str();
+  }
+
+  //----------------------------------------------------------------------------
+  const char* MessageTypeToString(MessageType type)
+  {
+    switch (type)
+    {
+    case MESSAGE_TYPE_TRANSFORM:
+      return "TRANSFORM";
+    case MESSAGE_TYPE_TDATA:
+      return "TDATA";
+    case MESSAGE_TYPE_IMAGE:
+      return "IMAGE";
+    case MESSAGE_TYPE_VIDEO:
+      return "VIDEO";
+    case MESSAGE_TYPE_POLYDATA:
+      return "POLYDATA";
+    default:
+      return "UNKNOWN";
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  MessageType DeviceTypeToMessageType(const std::string& deviceType)
+  {
+    for (int type = 0; type < MESSAGE_TYPE_COUNT; ++type)
+    {
+      if (deviceType == MessageTypeToString(static_cast<MessageType>(type)))
+      {
+        return static_cast<MessageType>(type);
+      }
+    }
+    return MESSAGE_TYPE_COUNT;
+  }
+}
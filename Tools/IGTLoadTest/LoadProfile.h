@@ -0,0 +1,79 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace IGTLoadTest
+{
+  enum MessageType
+  {
+    MESSAGE_TYPE_TRANSFORM,
+    MESSAGE_TYPE_TDATA,
+    MESSAGE_TYPE_IMAGE,
+    MESSAGE_TYPE_VIDEO,
+    MESSAGE_TYPE_POLYDATA,
+    MESSAGE_TYPE_COUNT
+  };
+
+  // Description of the traffic a mock server produces, read from a profile file and/or the command line
+  //   Profile files contain one "Key = Value" per line, '#' starts a comment
+  //   Command line arguments use the same keys: --Key=Value
+  struct LoadProfile
+  {
+    std::string   Name = "default";
+    uint16_t      Port = 18944;
+    double        DurationSec = 0.0;          // 0 runs until killed
+
+    // Per type message rates, 0 disables the type
+    double        RateHz[MESSAGE_TYPE_COUNT] = { 60.0, 0.0, 0.0, 0.0, 0.0 };
+
+    uint32_t      ToolCount = 4;              // TRANSFORM messages per tick, and elements per TDATA message
+    uint32_t      ImageSize[3] = { 640, 480, 1 };
+    uint32_t      ImageComponents = 1;        // 1 = greyscale, 3 = RGB
+    uint32_t      VideoSize[2] = { 1280, 720 };
+    uint32_t      PolydataPoints = 10000;
+
+    double        JitterMsec = 0.0;           // Uniform +/- jitter applied to every send time
+    double        LossRatio = 0.0;            // Probability [0,1] that a message is dropped instead of sent
+    double        DisconnectPeriodSec = 0.0;  // Drop the client every N seconds, 0 disables
+    double        DisconnectDurationSec = 1.0;
+
+    std::string   ReplayFile;                 // When set, messages come from a recorded session instead
+    double        ReplaySpeed = 1.0;          // 0 sends as fast as possible
+    bool          ReplayLoop = true;
+  };
+
+  bool ReadProfileFile(const std::string& fileName, LoadProfile& outProfile, std::string& outError);
+  bool ApplyProfileArguments(int argc, char** argv, LoadProfile& outProfile, std::string& outError);
+  bool SetProfileValue(const std::string& key, const std::string& value, LoadProfile& outProfile);
+  std::string ProfileToString(const LoadProfile& profile);
+
+  const char* MessageTypeToString(MessageType type);
+  MessageType DeviceTypeToMessageType(const std::string& deviceType);
+}
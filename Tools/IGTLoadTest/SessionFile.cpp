@@ -0,0 +1,107 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+// Local includes
+#include "SessionFile.h"
+
+// STL includes
+#include <cstring>
+
+namespace
+{
+  const char SESSION_MAGIC[8] = { 'I', 'G', 'T', 'S', 'E', 'S', 'S', '1' };
+  const uint64_t MAX_RECORD_SIZE = 1ull << 32;
+}
+
+namespace IGTLoadTest
+{
+  //----------------------------------------------------------------------------
+  bool SessionWriter::Open(const std::string& fileName)
+  {
+    m_file.open(fileName, std::ios::binary | std::ios::trunc);
+    if (!m_file.is_open())
+    {
+      return false;
+    }
+    m_file.write(SESSION_MAGIC, sizeof(SESSION_MAGIC));
+    return m_file.good();
+  }
+
+  //----------------------------------------------------------------------------
+  bool SessionWriter::Write(double receiveTimeSec, const void* header, uint64_t headerSize, const void* body, uint64_t bodySize)
+  {
+    uint64_t size = headerSize + bodySize;
+    m_file.write(reinterpret_cast<const char*>(&receiveTimeSec), sizeof(receiveTimeSec));
+    m_file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    m_file.write(reinterpret_cast<const char*>(header), headerSize);
+    if (bodySize > 0)
+    {
+      m_file.write(reinterpret_cast<const char*>(body), bodySize);
+    }
+    return m_file.good();
+  }
+
+  //----------------------------------------------------------------------------
+  void SessionWriter::Close()
+  {
+    m_file.close();
+  }
+
+  //----------------------------------------------------------------------------
+  bool SessionReader::Open(const std::string& fileName)
+  {
+    m_file.open(fileName, std::ios::binary);
+    return Rewind();
+  }
+
+  //----------------------------------------------------------------------------
+  bool SessionReader::Read(SessionRecord& outRecord)
+  {
+    uint64_t size(0);
+    if (!m_file.read(reinterpret_cast<char*>(&outRecord.ReceiveTimeSec), sizeof(outRecord.ReceiveTimeSec)) ||
+        !m_file.read(reinterpret_cast<char*>(&size), sizeof(size)) ||
+        size > MAX_RECORD_SIZE)
+    {
+      return false;
+    }
+
+    outRecord.Message.resize(static_cast<size_t>(size));
+    return static_cast<bool>(m_file.read(reinterpret_cast<char*>(outRecord.Message.data()), size));
+  }
+
+  //----------------------------------------------------------------------------
+  bool SessionReader::Rewind()
+  {
+    if (!m_file.is_open())
+    {
+      return false;
+    }
+
+    m_file.clear();
+    m_file.seekg(0, std::ios::beg);
+
+    char magic[sizeof(SESSION_MAGIC)];
+    return m_file.read(magic, sizeof(magic)) && memcmp(magic, SESSION_MAGIC, sizeof(magic)) == 0;
+  }
+}
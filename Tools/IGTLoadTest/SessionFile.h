@@ -0,0 +1,66 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+#pragma once
+
+// STL includes
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace IGTLoadTest
+{
+  // A recorded session is a flat sequence of packed OpenIGTLink messages (header + body, exactly as received)
+  // each prefixed with the local receive time in seconds and the packed size in bytes
+  //   "IGTSESS1"
+  //   { double receiveTimeSec; uint64 size; uint8 message[size]; } *
+  struct SessionRecord
+  {
+    double                ReceiveTimeSec = 0.0;
+    std::vector<uint8_t>  Message;
+  };
+
+  class SessionWriter
+  {
+  public:
+    bool Open(const std::string& fileName);
+    bool Write(double receiveTimeSec, const void* header, uint64_t headerSize, const void* body, uint64_t bodySize);
+    void Close();
+
+  protected:
+    std::ofstream m_file;
+  };
+
+  class SessionReader
+  {
+  public:
+    bool Open(const std::string& fileName);
+    bool Read(SessionRecord& outRecord);
+    bool Rewind();
+
+  protected:
+    std::ifstream m_file;
+  };
+}
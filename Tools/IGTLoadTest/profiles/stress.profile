@@ -0,0 +1,16 @@
+# Everything at once, with packet loss and a forced disconnect every 20 seconds to exercise reconnect logic
+Name = stress
+DurationSec = 120
+ToolCount = 16
+TRANSFORMRateHz = 120
+TDATARateHz = 60
+IMAGERateHz = 10
+ImageSize = 256 256 128
+VIDEORateHz = 30
+VideoSize = 1280 720
+POLYDATARateHz = 1
+PolydataPoints = 100000
+JitterMsec = 10
+LossRatio = 0.01
+DisconnectPeriodSec = 20
+DisconnectDurationSec = 2
\ No newline at end of file
@@ -0,0 +1,6 @@
+# Typical navigation session: several tools tracked at 60 Hz, both as individual transforms and as TDATA
+Name = tracking
+DurationSec = 60
+ToolCount = 6
+TRANSFORMRateHz = 60
+TDATARateHz = 60
\ No newline at end of file
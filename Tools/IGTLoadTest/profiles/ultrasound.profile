@@ -0,0 +1,9 @@
+# Tracked ultrasound: 2D image stream with probe and reference transforms
+Name = ultrasound
+DurationSec = 60
+ToolCount = 2
+TRANSFORMRateHz = 30
+IMAGERateHz = 30
+ImageSize = 640 480 1
+ImageComponents = 1
+JitterMsec = 5
\ No newline at end of file
@@ -0,0 +1,248 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Connector lookups by hashed name from 1 to 16 reader threads, as tools, imaging and tasks resolve connectors every
+// frame, through the three registries NetworkSystem has had: a recursive mutex and a linear search, a shared_ptr
+// snapshot published with std::atomic_load/atomic_store and returned by value, and SnapshotPublisher returning raw
+// pointers. A writer republishes the registry every 10 ms throughout, far more often than connectors are configured.
+//   ConnectorRegistryBenchmark [seconds per run, default 0.3]
+
+// Local includes
+#include "pch.h"
+#include "SnapshotPublisher.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace HoloIntervention::Network;
+
+namespace
+{
+  const int CONNECTOR_COUNT = 8;
+  const int WRITE_INTERVAL_MSEC = 10;
+
+  struct Entry
+  {
+    uint64_t              HashedName = 0;
+    std::atomic<int>      State { 0 };
+  };
+  typedef std::vector<std::shared_ptr<Entry>> EntryList;
+
+  struct Snapshot
+  {
+    EntryList                                       Connectors;
+    std::unordered_map<uint64_t, std::shared_ptr<Entry>> Lookup;
+  };
+
+  //----------------------------------------------------------------------------
+  uint64_t HashedName(int index)
+  {
+    return 0x9e3779b97f4a7c15ull * (index + 1);
+  }
+
+  // The original registry, every accessor locked and searched the vector
+  class LockedRegistry
+  {
+  public:
+    void Add(std::shared_ptr<Entry> entry)
+    {
+      std::lock_guard<std::recursive_mutex> guard(m_mutex);
+      m_connectors.push_back(entry);
+    }
+
+    int GetState(uint64_t hashedName) const
+    {
+      std::lock_guard<std::recursive_mutex> guard(m_mutex);
+      auto iter = std::find_if(m_connectors.begin(), m_connectors.end(), [hashedName](const std::shared_ptr<Entry>& entry)
+      {
+        return entry->HashedName == hashedName;
+      });
+      return iter == m_connectors.end() ? -1 : (*iter)->State.load(std::memory_order_relaxed);
+    }
+
+  protected:
+    mutable std::recursive_mutex  m_mutex;
+    EntryList                     m_connectors;
+  };
+
+  // Snapshots behind std::atomic_load, FindConnector returned the entry's shared_ptr by value
+  class SharedSnapshotRegistry
+  {
+  public:
+    void Add(std::shared_ptr<Entry> entry)
+    {
+      std::lock_guard<std::mutex> guard(m_writeMutex);
+      auto next = std::make_shared<Snapshot>(*std::atomic_load(&m_snapshot));
+      next->Connectors.push_back(entry);
+      next->Lookup[entry->HashedName] = entry;
+      std::atomic_store(&m_snapshot, std::shared_ptr<const Snapshot>(next));
+    }
+
+    int GetState(uint64_t hashedName) const
+    {
+      std::shared_ptr<Entry> entry = Find(hashedName);
+      return entry == nullptr ? -1 : entry->State.load(std::memory_order_relaxed);
+    }
+
+  protected:
+    std::shared_ptr<Entry> Find(uint64_t hashedName) const
+    {
+      auto snapshot = std::atomic_load(&m_snapshot);
+      auto iter = snapshot->Lookup.find(hashedName);
+      return iter == snapshot->Lookup.end() ? nullptr : iter->second;
+    }
+
+  protected:
+    std::mutex                        m_writeMutex;
+    std::shared_ptr<const Snapshot>   m_snapshot = std::make_shared<Snapshot>();
+  };
+
+  // The current registry
+  class PublishedRegistry
+  {
+  public:
+    void Add(std::shared_ptr<Entry> entry)
+    {
+      m_snapshots.Update([&entry](Snapshot & snapshot)
+      {
+        snapshot.Connectors.push_back(entry);
+        snapshot.Lookup[entry->HashedName] = entry;
+        return true;
+      });
+    }
+
+    int GetState(uint64_t hashedName) const
+    {
+      const Entry* entry = Find(hashedName);
+      return entry == nullptr ? -1 : entry->State.load(std::memory_order_relaxed);
+    }
+
+  protected:
+    const Entry* Find(uint64_t hashedName) const
+    {
+      auto snapshot = m_snapshots.Load();
+      auto iter = snapshot->Lookup.find(hashedName);
+      return iter == snapshot->Lookup.end() ? nullptr : iter->second.get();
+    }
+
+  protected:
+    SnapshotPublisher<Snapshot>   m_snapshots;
+  };
+
+  //----------------------------------------------------------------------------
+  // Total lookups per second across all readers
+  template<typename Registry>
+  double Run(int readerCount, double seconds)
+  {
+    Registry registry;
+    std::vector<std::shared_ptr<Entry>> entries;
+    for (int i = 0; i < CONNECTOR_COUNT; ++i)
+    {
+      entries.push_back(std::make_shared<Entry>());
+      entries.back()->HashedName = HashedName(i);
+      entries.back()->State = i;
+      registry.Add(entries.back());
+    }
+
+    std::atomic_bool start(false);
+    std::atomic_bool stop(false);
+    std::atomic<uint64_t> lookups(0);
+    std::atomic<int64_t> checksum(0);
+    std::vector<std::thread> readers;
+    for (int r = 0; r < readerCount; ++r)
+    {
+      readers.push_back(std::thread([&, r]()
+      {
+        while (!start)
+        {
+          std::this_thread::yield();
+        }
+        uint64_t count(0);
+        int64_t sum(0);
+        int index(r);
+        while (!stop.load(std::memory_order_relaxed))
+        {
+          for (int i = 0; i < 256; ++i)
+          {
+            sum += registry.GetState(HashedName(index));
+            index = (index + 1) % CONNECTOR_COUNT;
+          }
+          count += 256;
+        }
+        lookups += count;
+        checksum += sum;
+      }));
+    }
+
+    // Republishing an existing entry replaces the snapshot without changing what readers find
+    std::thread writer([&]()
+    {
+      while (!stop)
+      {
+        std::this_thread::sleep_for(std::chrono::milliseconds(WRITE_INTERVAL_MSEC));
+        registry.Add(entries[0]);
+      }
+    });
+
+    PortableTests::Stopwatch stopwatch;
+    start = true;
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    const double elapsed = stopwatch.GetElapsedSec();
+    for (auto& reader : readers)
+    {
+      reader.join();
+    }
+    writer.join();
+    return checksum.load() < 0 ? 0.0 : lookups.load() / elapsed;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const double seconds = argc > 1 ? std::max(0.01, atof(argv[1])) : 0.3;
+
+  printf("%u hardware threads, %d connectors, lookups per second summed over readers\n", std::thread::hardware_concurrency(), CONNECTOR_COUNT);
+  printf("%8s %16s %18s %18s %10s\n", "readers", "mutex + search", "atomic shared_ptr", "SnapshotPublisher", "speedup");
+  for (int readerCount : { 1, 2, 4, 8, 16 })
+  {
+    const double locked = Run<LockedRegistry>(readerCount, seconds);
+    const double shared = Run<SharedSnapshotRegistry>(readerCount, seconds);
+    const double published = Run<PublishedRegistry>(readerCount, seconds);
+    printf("%8d %14.1f M %16.1f M %16.1f M %9.1fx\n", readerCount, locked / 1e6, shared / 1e6, published / 1e6, published / std::max(locked, 1.0));
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
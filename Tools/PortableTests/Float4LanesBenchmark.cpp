@@ -0,0 +1,226 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// The three kernels written with Float4Lanes against the same arithmetic in plain scalar code: the trilinear weights
+// of VolumeRayMarcher::Sample, the corner normalisation of VolumeRayMarcher::ReadCorners and the bilinear lookup of
+// PreIntegrationTable::Lookup. Inputs are gathered up front, so only the arithmetic is timed, and both versions must
+// agree bit for bit.
+//   Float4LanesBenchmark [calls per kernel, default 4000000]
+
+// Local includes
+#include "pch.h"
+#include "Float4Lanes.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  const uint32_t TABLE_SIZE = 256;
+  const float VALUE_RANGE = 65535.f;
+  const int REPEATS = 5;
+
+  //----------------------------------------------------------------------------
+  float LanesTrilinear(const float corners[8], const float fraction[3])
+  {
+    const Float4Lanes weightXY = Float4Lanes::Set(1.f - fraction[0], fraction[0], 1.f - fraction[0], fraction[0]) *
+                                 Float4Lanes::Set(1.f - fraction[1], 1.f - fraction[1], fraction[1], fraction[1]);
+    const Float4Lanes result = weightXY * Float4Lanes::Set(1.f - fraction[2]) * Float4Lanes::Load(corners) +
+                               weightXY * Float4Lanes::Set(fraction[2]) * Float4Lanes::Load(corners + 4);
+    return result.Sum();
+  }
+
+  //----------------------------------------------------------------------------
+  float ScalarTrilinear(const float corners[8], const float fraction[3])
+  {
+    float lane[4];
+    for (int i = 0; i < 4; ++i)
+    {
+      const float weightXY = ((i & 1) ? fraction[0] : 1.f - fraction[0]) * ((i & 2) ? fraction[1] : 1.f - fraction[1]);
+      lane[i] = weightXY * (1.f - fraction[2]) * corners[i] + weightXY * fraction[2] * corners[i + 4];
+    }
+    return (lane[0] + lane[1]) + (lane[2] + lane[3]);
+  }
+
+  //----------------------------------------------------------------------------
+  void LanesNormalize(const float raw[8], float outCorners[8])
+  {
+    const Float4Lanes range = Float4Lanes::Set(VALUE_RANGE);
+    (Float4Lanes::Load(raw) / range).Store(outCorners);
+    (Float4Lanes::Load(raw + 4) / range).Store(outCorners + 4);
+  }
+
+  //----------------------------------------------------------------------------
+  void ScalarNormalize(const float raw[8], float outCorners[8])
+  {
+    for (int corner = 0; corner < 8; ++corner)
+    {
+      outCorners[corner] = raw[corner] / VALUE_RANGE;
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void LanesBilinear(const float* top, const float* bottom, float rowFraction, float columnFraction, float outRgba[4])
+  {
+    const Float4Lanes left = Float4Lanes::Set(1.f - columnFraction);
+    const Float4Lanes right = Float4Lanes::Set(columnFraction);
+    const Float4Lanes topRow = Float4Lanes::Load(top) * left + Float4Lanes::Load(top + 4) * right;
+    const Float4Lanes bottomRow = Float4Lanes::Load(bottom) * left + Float4Lanes::Load(bottom + 4) * right;
+    (topRow * Float4Lanes::Set(1.f - rowFraction) + bottomRow * Float4Lanes::Set(rowFraction)).Store(outRgba);
+  }
+
+  //----------------------------------------------------------------------------
+  void ScalarBilinear(const float* top, const float* bottom, float rowFraction, float columnFraction, float outRgba[4])
+  {
+    for (int c = 0; c < 4; ++c)
+    {
+      const float topRow = top[c] * (1.f - columnFraction) + top[c + 4] * columnFraction;
+      const float bottomRow = bottom[c] * (1.f - columnFraction) + bottom[c + 4] * columnFraction;
+      outRgba[c] = topRow * (1.f - rowFraction) + bottomRow * rowFraction;
+    }
+  }
+
+  struct Inputs
+  {
+    std::vector<float>    Corners;        // 8 per call, 16 bit voxel values for the normalisation
+    std::vector<float>    Fractions;      // 3 per call
+    std::vector<uint32_t> TableOffsets;   // Top left entry of each lookup
+    std::vector<float>    Table;          // TABLE_SIZE^2 RGBA entries
+  };
+
+  //----------------------------------------------------------------------------
+  Inputs MakeInputs(size_t calls)
+  {
+    std::mt19937 generator(43);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::uniform_int_distribution<uint32_t> voxel(0, 65535);
+    std::uniform_int_distribution<uint32_t> entry(0, TABLE_SIZE - 2);
+
+    Inputs inputs;
+    inputs.Corners.resize(calls * 8);
+    inputs.Fractions.resize(calls * 3);
+    inputs.TableOffsets.resize(calls);
+    inputs.Table.resize(TABLE_SIZE * TABLE_SIZE * 4);
+    for (auto& value : inputs.Corners)
+    {
+      value = static_cast<float>(voxel(generator));
+    }
+    for (auto& value : inputs.Fractions)
+    {
+      value = unit(generator);
+    }
+    for (auto& offset : inputs.TableOffsets)
+    {
+      offset = (entry(generator) * TABLE_SIZE + entry(generator)) * 4;
+    }
+    for (auto& value : inputs.Table)
+    {
+      value = unit(generator);
+    }
+    return inputs;
+  }
+
+  //----------------------------------------------------------------------------
+  // Best of REPEATS, in nanoseconds per call
+  template<typename Kernel>
+  double Time(size_t calls, Kernel kernel)
+  {
+    double best(1e30);
+    for (int repeat = 0; repeat < REPEATS; ++repeat)
+    {
+      PortableTests::Stopwatch stopwatch;
+      for (size_t i = 0; i < calls; ++i)
+      {
+        kernel(i);
+      }
+      best = std::min(best, stopwatch.GetElapsedSec());
+    }
+    return best / calls * 1e9;
+  }
+
+  //----------------------------------------------------------------------------
+  void Report(const char* name, double lanesNsec, double scalarNsec, bool identical)
+  {
+    printf("%-12s %10.2f %10.2f %8.2fx %10s\n", name, lanesNsec, scalarNsec, scalarNsec / lanesNsec, identical ? "yes" : "NO");
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const size_t calls = argc > 1 ? std::max(1000, atoi(argv[1])) : 4000000;
+  const Inputs inputs = MakeInputs(calls);
+
+#if defined(HOLOINTERVENTION_LANES_SSE2)
+  printf("Float4Lanes backend: SSE2\n");
+#elif defined(HOLOINTERVENTION_LANES_NEON)
+  printf("Float4Lanes backend: NEON\n");
+#else
+  printf("Float4Lanes backend: scalar\n");
+#endif
+  printf("%-12s %10s %10s %9s %10s\n", "kernel", "lanes ns", "scalar ns", "speedup", "identical");
+
+  std::vector<float> lanesOut(calls * 8);
+  std::vector<float> scalarOut(calls * 8);
+  auto same = [&](size_t count)
+  {
+    return memcmp(lanesOut.data(), scalarOut.data(), count * sizeof(float)) == 0;
+  };
+
+  {
+    const double lanes = Time(calls, [&](size_t i) { lanesOut[i] = LanesTrilinear(&inputs.Corners[i * 8], &inputs.Fractions[i * 3]); });
+    const double scalar = Time(calls, [&](size_t i) { scalarOut[i] = ScalarTrilinear(&inputs.Corners[i * 8], &inputs.Fractions[i * 3]); });
+    Report("trilinear", lanes, scalar, same(calls));
+  }
+  {
+    const double lanes = Time(calls, [&](size_t i) { LanesNormalize(&inputs.Corners[i * 8], &lanesOut[i * 8]); });
+    const double scalar = Time(calls, [&](size_t i) { ScalarNormalize(&inputs.Corners[i * 8], &scalarOut[i * 8]); });
+    Report("normalise", lanes, scalar, same(calls * 8));
+  }
+  {
+    const float* table = inputs.Table.data();
+    const double lanes = Time(calls, [&](size_t i)
+    {
+      const float* top = table + inputs.TableOffsets[i];
+      LanesBilinear(top, top + TABLE_SIZE * 4, inputs.Fractions[i * 3], inputs.Fractions[i * 3 + 1], &lanesOut[i * 4]);
+    });
+    const double scalar = Time(calls, [&](size_t i)
+    {
+      const float* top = table + inputs.TableOffsets[i];
+      ScalarBilinear(top, top + TABLE_SIZE * 4, inputs.Fractions[i * 3], inputs.Fractions[i * 3 + 1], &scalarOut[i * 4]);
+    });
+    Report("bilinear", lanes, scalar, same(calls * 4));
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,137 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Streams 1024x1024 frames at 30 and 60 Hz through FrameBufferPool and through the system allocator, and reports
+// system allocations per second of stream time. The consumer holds the last few frames of every stream, as the
+// slice renderer and the recorder's write queue do. Frames are produced as fast as possible, not in real time
+
+// Local includes
+#include "pch.h"
+#include "FrameBufferPool.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  const double STREAM_DURATION_SEC = 20.0;
+  const size_t FRAMES_HELD = 3;
+
+  struct Scenario
+  {
+    const char*   Name;
+    double        FrameRateHz;
+    uint32_t      Streams;
+    size_t        BytesPerPixel;
+  };
+
+  struct Result
+  {
+    double        AllocationsPerSec;
+    double        AcquireNsec;
+    double        HitRate;
+    double        HighWaterMB;
+  };
+
+  //----------------------------------------------------------------------------
+  Result Run(const Scenario& scenario, bool pooled)
+  {
+    const size_t frameBytes = 1024 * 1024 * scenario.BytesPerPixel;
+    const uint32_t frames = static_cast<uint32_t>(STREAM_DURATION_SEC * scenario.FrameRateHz);
+
+    FrameBufferPool pool;
+    std::deque<std::shared_ptr<uint8_t>> held;
+    uint64_t allocations(0);
+    double acquireSec(0.0);
+    PortableTests::Stopwatch stopwatch;
+
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+      for (uint32_t stream = 0; stream < scenario.Streams; ++stream)
+      {
+        stopwatch.Restart();
+        std::shared_ptr<uint8_t> buffer;
+        if (pooled)
+        {
+          buffer = pool.Acquire(frameBytes);
+        }
+        else
+        {
+          buffer = std::shared_ptr<uint8_t>(static_cast<uint8_t*>(malloc(frameBytes)), free);
+          allocations++;
+        }
+        acquireSec += stopwatch.GetElapsedSec();
+
+        // Touch every page, as copying the received image does
+        memset(buffer.get(), static_cast<int>(frame), frameBytes);
+        held.push_back(std::move(buffer));
+        if (held.size() > FRAMES_HELD * scenario.Streams)
+        {
+          held.pop_front();
+        }
+      }
+    }
+
+    auto metrics = pool.GetMetrics();
+    Result result;
+    result.AllocationsPerSec = (pooled ? metrics.Misses : allocations) / STREAM_DURATION_SEC;
+    result.AcquireNsec = acquireSec * 1e9 / (static_cast<double>(frames) * scenario.Streams);
+    result.HitRate = pooled ? metrics.HitRate() : 0.0;
+    result.HighWaterMB = pooled ? metrics.HighWaterBytes / (1024.0 * 1024.0) : (FRAMES_HELD * scenario.Streams + 1) * frameBytes / (1024.0 * 1024.0);
+    return result;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  const Scenario scenarios[] =
+  {
+    { "1 x 1024^2 8 bit @ 30 Hz", 30.0, 1, 1 },
+    { "1 x 1024^2 8 bit @ 60 Hz", 60.0, 1, 1 },
+    { "2 x 1024^2 8 bit @ 60 Hz", 60.0, 2, 1 },
+    { "1 x 1024^2 RGBA  @ 30 Hz", 30.0, 1, 4 },
+    { "1 x 1024^2 RGBA  @ 60 Hz", 60.0, 1, 4 },
+  };
+
+  printf("%-26s %-8s %14s %12s %9s %14s\n", "scenario", "source", "allocations/s", "acquire ns", "hit rate", "high water MB");
+  for (auto& scenario : scenarios)
+  {
+    for (int pooled = 0; pooled < 2; ++pooled)
+    {
+      Result result = Run(scenario, pooled != 0);
+      printf("%-26s %-8s %14.2f %12.0f %9.3f %14.1f\n", scenario.Name, pooled ? "pool" : "malloc", result.AllocationsPerSec, result.AcquireNsec, result.HitRate, result.HighWaterMB);
+    }
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
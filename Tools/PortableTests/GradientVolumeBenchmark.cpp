@@ -0,0 +1,171 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// GradientVolume build throughput for 256³ and 512³ volumes, 8 and 16 bit, on one and on every hardware thread, the
+// incremental rebuild after one 32³ brick changes, and the memory the packed gradients take against the scalar volume
+// and against unpacked float normals and magnitudes. Every voxel is checked against a scalar central difference.
+//   GradientVolumeBenchmark [repeats, default 3]
+
+// Local includes
+#include "pch.h"
+#include "GradientVolume.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  const uint32_t BRICK_SIZE = 32;
+  const size_t UNPACKED_BYTES_PER_VOXEL = 4 * sizeof(float);
+
+  //----------------------------------------------------------------------------
+  inline uint8_t PackUnit(float value)
+  {
+    return static_cast<uint8_t>(value * 255.f + 0.5f);
+  }
+
+  //----------------------------------------------------------------------------
+  // One voxel at a time, zero beyond the edges, packed as GradientVolume documents
+  template<typename T>
+  std::vector<uint8_t> ScalarGradients(const std::vector<T>& image, uint32_t edge)
+  {
+    const float scale = 0.5f / (sizeof(T) == 1 ? 255.f : 65535.f);
+    const float magnitudeScale = 1.f / 0.8660254f;
+    auto read = [&](int64_t x, int64_t y, int64_t z)
+    {
+      if (x < 0 || y < 0 || z < 0 || x >= edge || y >= edge || z >= edge)
+      {
+        return 0.f;
+      }
+      return static_cast<float>(image[(static_cast<size_t>(z) * edge + y) * edge + x]);
+    };
+
+    std::vector<uint8_t> result(image.size() * 4);
+    for (int64_t z = 0; z < edge; ++z)
+    {
+      for (int64_t y = 0; y < edge; ++y)
+      {
+        for (int64_t x = 0; x < edge; ++x)
+        {
+          const float gx = (read(x + 1, y, z) - read(x - 1, y, z)) * scale;
+          const float gy = (read(x, y + 1, z) - read(x, y - 1, z)) * scale;
+          const float gz = (read(x, y, z + 1) - read(x, y, z - 1)) * scale;
+          const float magnitude = std::sqrt(gx * gx + gy * gy + gz * gz);
+          const float inverse = magnitude > 0.f ? -0.5f / magnitude : 0.f;
+          uint8_t* voxel = &result[((static_cast<size_t>(z) * edge + y) * edge + x) * 4];
+          voxel[0] = PackUnit(gx * inverse + 0.5f);
+          voxel[1] = PackUnit(gy * inverse + 0.5f);
+          voxel[2] = PackUnit(gz * inverse + 0.5f);
+          voxel[3] = PackUnit(std::sqrt(std::min(magnitude * magnitudeScale, 1.f)));
+        }
+      }
+    }
+    return result;
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  void Run(uint32_t edge, int repeats)
+  {
+    // Smooth structure with noise on top, so normals point every way and some voxels have no gradient at all
+    std::vector<T> image(static_cast<size_t>(edge) * edge * edge);
+    std::mt19937 generator(edge);
+    std::uniform_int_distribution<uint32_t> noise(0, 15);
+    const uint32_t maximum = sizeof(T) == 1 ? 255 : 65535;
+    for (uint32_t z = 0; z < edge; ++z)
+    {
+      for (uint32_t y = 0; y < edge; ++y)
+      {
+        for (uint32_t x = 0; x < edge; ++x)
+        {
+          const float radius = std::sqrt(static_cast<float>((x - edge / 2.f) * (x - edge / 2.f) + (y - edge / 2.f) * (y - edge / 2.f) + (z - edge / 2.f) * (z - edge / 2.f)));
+          const uint32_t value = radius < edge / 3.f ? maximum * 3 / 4 : (z < edge / 8 ? 0 : noise(generator) * (maximum / 255));
+          image[(static_cast<size_t>(z) * edge + y) * edge + x] = static_cast<T>(value);
+        }
+      }
+    }
+    const double voxels = static_cast<double>(image.size());
+    const double sourceMegabytes = image.size() * sizeof(T) / 1e6;
+    const std::vector<uint8_t> expected = ScalarGradients(image, edge);
+
+    std::vector<uint32_t> threadCounts(1, 1);
+    if (std::thread::hardware_concurrency() > 1)
+    {
+      threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+    for (uint32_t threadCount : threadCounts)
+    {
+      GradientVolume gradients;
+      gradients.SetThreadCount(threadCount);
+      gradients.Reset(edge, edge, edge, sizeof(T));
+
+      double bestSec(1e9);
+      for (int r = 0; r < repeats; ++r)
+      {
+        PortableTests::Stopwatch stopwatch;
+        gradients.BuildAll(reinterpret_cast<const uint8_t*>(image.data()));
+        bestSec = std::min(bestSec, stopwatch.GetElapsedSec());
+      }
+      const bool match = memcmp(gradients.GetData().data(), expected.data(), expected.size()) == 0;
+
+      const BrickBox brick = { edge / 4, edge / 4, edge / 4, edge / 4 + BRICK_SIZE, edge / 4 + BRICK_SIZE, edge / 4 + BRICK_SIZE };
+      const int brickRepeats = 100;
+      PortableTests::Stopwatch stopwatch;
+      for (int r = 0; r < brickRepeats; ++r)
+      {
+        gradients.UpdateRegion(reinterpret_cast<const uint8_t*>(image.data()), brick);
+      }
+      const double brickUsec = stopwatch.GetElapsedSec() * 1e6 / brickRepeats;
+
+      const double packedMegabytes = gradients.GetMemoryBytes() / 1e6;
+      printf("%4u³ %2u bit %8u %9.1f %10.1f %10.0f %9.1f %9.1f %10.1f %6s\n", edge, static_cast<uint32_t>(sizeof(T) * 8), threadCount,
+             bestSec * 1000.0, voxels / bestSec / 1e6, brickUsec, sourceMegabytes, packedMegabytes, voxels * UNPACKED_BYTES_PER_VOXEL / 1e6, match ? "yes" : "NO");
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 3;
+
+  printf("%-11s %8s %9s %10s %10s %9s %9s %10s %6s\n", "volume", "threads", "build ms", "Mvoxels/s", "32³ us", "volume MB", "packed MB", "float4 MB", "match");
+  Run<uint8_t>(256, repeats);
+  Run<uint16_t>(256, repeats);
+  Run<uint8_t>(512, repeats);
+  Run<uint16_t>(512, repeats);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,235 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Writes recordings through the background writer and reads them back, including a non-ASCII wide file name, a
+// recording that was never closed and a footer whose index count would overflow the size check
+// Files are written to the system temporary directory and removed at the end
+
+// Local includes
+#include "pch.h"
+#include "IGTRecording.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace HoloIntervention::Network;
+
+namespace
+{
+  const size_t IMAGE_BYTES = 256 * 256 * 2;
+  const uint32_t IMAGE_COUNT = 20;
+  const uint32_t TRANSFORM_COUNT = 500;
+  const char* OPEN_FILE_NAME = "IGTRecordingTest_open.hirec";
+  const char* RECOVERED_FILE_NAME = "IGTRecordingTest_recovered.hirec";
+  const char* CORRUPT_FILE_NAME = "IGTRecordingTest_corrupt.hirec";
+  const char* WIDE_FILE_NAME_UTF8 = "IGTRecordingTest_\xc3\xa9\xe4\xb8\xad.hirec";
+
+  //----------------------------------------------------------------------------
+  std::vector<uint8_t> MakeImage(uint32_t index)
+  {
+    // 16 bit image of constant rows, compresses well with the per component delta
+    std::vector<uint8_t> image(IMAGE_BYTES);
+    for (size_t i = 0; i < IMAGE_BYTES / 2; ++i)
+    {
+      uint16_t value = static_cast<uint16_t>((i / 256) * 7 + index);
+      memcpy(&image[i * 2], &value, sizeof(value));
+    }
+    return image;
+  }
+
+  //----------------------------------------------------------------------------
+  void WriteRecords(RecordingWriter& writer)
+  {
+    for (uint32_t i = 0; i < TRANSFORM_COUNT; ++i)
+    {
+      float matrix[16] = {};
+      matrix[0] = matrix[5] = matrix[10] = matrix[15] = 1.f;
+      matrix[3] = static_cast<float>(i);
+      RecordInfo info;
+      info.Timestamp = i * 0.002;
+      info.Type = RECORD_TYPE_TRANSFORM;
+      info.StreamId = 1;
+      CHECK(writer.Append(info, matrix, sizeof(matrix)));
+
+      // A second consumer pulling the same message, either appending it or asking first as NetworkSystem does
+      if (i % 2 == 0)
+      {
+        CHECK(writer.Append(info, matrix, sizeof(matrix)));
+      }
+      else
+      {
+        CHECK(!writer.IsNewRecord(info.StreamId, info.Timestamp));
+      }
+
+      if (i % (TRANSFORM_COUNT / IMAGE_COUNT) == 0)
+      {
+        std::vector<uint8_t> image = MakeImage(i);
+        std::shared_ptr<uint8_t> payload(new uint8_t[image.size()], std::default_delete<uint8_t[]>());
+        memcpy(payload.get(), image.data(), image.size());
+        info.Type = RECORD_TYPE_TRACKED_FRAME;
+        info.StreamId = 2;
+        CHECK(writer.Append(info, std::shared_ptr<const uint8_t>(payload), image.size(), 2));
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void CheckRecords(const RecordingReader& reader)
+  {
+    CHECK(reader.GetRecordCount() == TRANSFORM_COUNT + IMAGE_COUNT);
+
+    uint32_t images(0);
+    for (size_t i = reader.Find(0.0, RECORD_TYPE_TRACKED_FRAME); i < reader.GetRecordCount(); i = reader.Next(i, RECORD_TYPE_TRACKED_FRAME))
+    {
+      Record record;
+      CHECK(reader.Read(i, record));
+      uint32_t index = static_cast<uint32_t>(record.Info.Timestamp / 0.002 + 0.5);
+      CHECK(record.Payload == MakeImage(index));
+      images++;
+    }
+    CHECK(images == IMAGE_COUNT);
+
+    size_t index = reader.Find(0.5, RECORD_TYPE_TRANSFORM);
+    Record record;
+    CHECK(reader.Read(index, record) && record.Payload.size() == 16 * sizeof(float));
+    float translation(0.f);
+    memcpy(&translation, record.Payload.data() + 3 * sizeof(float), sizeof(float));
+    CHECK(translation == 250.f);
+  }
+
+  //----------------------------------------------------------------------------
+  std::vector<uint8_t> ReadFile(const char* fileName)
+  {
+    std::vector<uint8_t> contents;
+    FILE* file = fopen(fileName, "rb");
+    if (file == nullptr)
+    {
+      return contents;
+    }
+    uint8_t buffer[65536];
+    size_t read(0);
+    while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0)
+    {
+      contents.insert(contents.end(), buffer, buffer + read);
+    }
+    fclose(file);
+    return contents;
+  }
+
+  //----------------------------------------------------------------------------
+  void WriteFile(const char* fileName, const std::vector<uint8_t>& contents)
+  {
+    FILE* file = fopen(fileName, "wb");
+    fwrite(contents.data(), 1, contents.size(), file);
+    fclose(file);
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  if (!CHECK(PortableTests::ChangeToTempDirectory()))
+  {
+    return PortableTests::Finish("IGTRecordingTest");
+  }
+
+  // Closed recording with a file name that does not survive narrowing to 8 bits
+  const std::wstring wideName(L"IGTRecordingTest_\u00e9\u4e2d.hirec");
+  {
+    RecordingWriter writer;
+    CHECK(writer.Open(wideName, 64 * 1024));
+    WriteRecords(writer);
+    CHECK(writer.Flush());
+
+    auto stats = writer.GetStatistics();
+    CHECK(stats.Records == TRANSFORM_COUNT + IMAGE_COUNT);
+    CHECK(stats.DuplicatesDropped == TRANSFORM_COUNT);
+    CHECK(stats.QueueDropped == 0);
+    CHECK(stats.StoredBytes < stats.RawBytes / 2);
+    CHECK(stats.Chunks > 1);
+    CHECK(writer.IsNewRecord(1, TRANSFORM_COUNT * 0.002));
+    CHECK(writer.Close());
+    CHECK(!writer.IsOpen());
+    CHECK(!writer.IsNewRecord(1, TRANSFORM_COUNT * 0.002));
+  }
+  {
+    RecordingReader reader;
+    CHECK(reader.Open(wideName));
+    CHECK(!reader.WasRecovered());
+    CheckRecords(reader);
+  }
+#if !defined(_WIN32)
+  CHECK(!ReadFile(WIDE_FILE_NAME_UTF8).empty());
+#endif
+
+  // Recording that was flushed but never closed, as after a crash
+  {
+    RecordingWriter writer;
+    CHECK(writer.Open(std::string(OPEN_FILE_NAME)));
+    WriteRecords(writer);
+    CHECK(writer.Flush());
+    WriteFile(RECOVERED_FILE_NAME, ReadFile(OPEN_FILE_NAME));
+  }
+  {
+    RecordingReader reader;
+    CHECK(reader.Open(std::string(RECOVERED_FILE_NAME)));
+    CHECK(reader.WasRecovered());
+    CheckRecords(reader);
+  }
+
+  // Footer whose index count times 32 wraps around to the real index size
+  {
+    std::vector<uint8_t> contents = ReadFile(OPEN_FILE_NAME);
+    CHECK(contents.size() > 24);
+    uint64_t indexCount(0);
+    memcpy(&indexCount, contents.data() + contents.size() - 16, sizeof(indexCount));
+    CHECK(indexCount == TRANSFORM_COUNT + IMAGE_COUNT);
+    indexCount += 1ull << 59;
+    memcpy(contents.data() + contents.size() - 16, &indexCount, sizeof(indexCount));
+    WriteFile(CORRUPT_FILE_NAME, contents);
+
+    RecordingReader reader;
+    CHECK(reader.Open(std::string(CORRUPT_FILE_NAME)));
+    CHECK(reader.WasRecovered());
+    CheckRecords(reader);
+  }
+
+  for (const char* fileName : { OPEN_FILE_NAME, RECOVERED_FILE_NAME, CORRUPT_FILE_NAME })
+  {
+    CHECK(remove(fileName) == 0);
+  }
+#if defined(_WIN32)
+  CHECK(_wremove(wideName.c_str()) == 0);
+#else
+  CHECK(remove(WIDE_FILE_NAME_UTF8) == 0);
+#endif
+
+  return PortableTests::Finish("IGTRecordingTest");
+}
\ No newline at end of file
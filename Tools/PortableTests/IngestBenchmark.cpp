@@ -0,0 +1,260 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Runs the ingest path of one tracked transform in real time at 100, 500 and 1000 Hz for every ingest mode
+// A tracker thread stands in for the OpenIGTLink client, which only keeps the latest message. A receive thread polls it
+// the way NetworkSystem::ReceiveLoop does: IngestGate decides whether to pull, ArrivalEstimator when to look again, a
+// pulled message pays a fixed conversion cost, goes into the TransformHistory for INGEST_MODE_HISTORY, and is posted to a mailbox read by a 60 Hz consumer.
+// For INGEST_MODE_LATEST_ONLY the mailbox fetches from the client when the consumer reads it, paying the conversion
+// there, and the receive thread pulls nothing.
+// Reports conversions/s (the work the policy saves), consumer updates/s and the age of the pose the consumer sees.
+//   IngestBenchmark [seconds per run, default 2]
+// To drive a real connector at these rates use IGTMockServer --Profile=profiles/tracking.profile --TRANSFORMRateHz=1000
+
+// Local includes
+#include "pch.h"
+#include "IngestPolicy.h"
+#include "SubscriptionHub.h"
+#include "TestCommon.h"
+#include "TransformHistory.h"
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+
+using namespace HoloIntervention;
+using namespace HoloIntervention::Network;
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  const double CONSUMER_RATE_HZ = 60.0;
+  const double DECIMATE_RATE_HZ = 60.0;
+  const uint32_t HISTORY_LENGTH = 64;
+  const double CONVERSION_COST_SEC = 20e-6;   // Unpacking into a WinRT Transform, measured on HoloLens at 15-30 us
+  const uint64_t KEY = 1;
+
+  struct Message
+  {
+    double    Timestamp = 0.0;
+    uint64_t  Sequence = 0;
+  };
+
+  struct Result
+  {
+    double    ReceivedPerSec = 0.0;
+    double    ConvertedPerSec = 0.0;
+    double    ConsumedPerSec = 0.0;
+    double    MeanAgeMsec = 0.0;
+    double    MaxAgeMsec = 0.0;
+  };
+
+  //----------------------------------------------------------------------------
+  double Now()
+  {
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+  }
+
+  //----------------------------------------------------------------------------
+  void Spin(double seconds)
+  {
+    const double end = Now() + seconds;
+    while (Now() < end) {}
+  }
+
+  //----------------------------------------------------------------------------
+  Result Run(double trackerRateHz, IngestMode mode, double durationSec)
+  {
+    IngestPolicy policy;
+    policy.Mode = mode;
+    policy.RateHz = DECIMATE_RATE_HZ;
+    policy.HistoryLength = HISTORY_LENGTH;
+    IngestGate gate;
+    gate.SetPolicy(policy);
+
+    TransformHistory history(HISTORY_LENGTH);
+    SubscriptionHub<Message> hub;
+    SubscriptionHub<Message>::MailboxPtr mailbox;
+
+    std::mutex clientMutex;
+    Message clientLatest;
+    std::atomic_bool stop(false);
+    uint64_t received(0);
+    std::atomic<uint64_t> converted(0);
+
+    if (mode == INGEST_MODE_LATEST_ONLY)
+    {
+      hub.Subscribe(KEY, mailbox, [&](double latestTimestamp, Mailbox<Message>::Entry & outEntry)
+      {
+        Message message;
+        {
+          std::lock_guard<std::mutex> guard(clientMutex);
+          message = clientLatest;
+        }
+        if (message.Sequence == 0 || message.Timestamp <= latestTimestamp)
+        {
+          return false;
+        }
+        Spin(CONVERSION_COST_SEC);
+        converted++;
+        outEntry.Payload = message;
+        outEntry.Timestamp = message.Timestamp;
+        return true;
+      });
+    }
+    else
+    {
+      hub.Subscribe(KEY, mailbox);
+    }
+
+    // Tracker, on a fixed schedule
+    std::thread tracker([&]()
+    {
+      auto next = Clock::now();
+      const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / trackerRateHz));
+      uint64_t sequence(0);
+      while (!stop)
+      {
+        std::this_thread::sleep_until(next);
+        next += period;
+        std::lock_guard<std::mutex> guard(clientMutex);
+        clientLatest.Timestamp = Now();
+        clientLatest.Sequence = ++sequence;
+      }
+      std::lock_guard<std::mutex> guard(clientMutex);
+      received = sequence;
+    });
+
+    // Receive thread
+    std::thread receiver([&]()
+    {
+      uint64_t latestSequence(0);
+      ArrivalEstimator arrival;
+      TransformHistory::Matrix matrix = {};
+      while (!stop)
+      {
+        const double now = Now();
+        bool pulled(false);
+        if (gate.ShouldPull(now, hub.AllSubscribersFetch(KEY)))
+        {
+          Message message;
+          {
+            std::lock_guard<std::mutex> guard(clientMutex);
+            message = clientLatest;
+          }
+          if (message.Sequence != latestSequence)
+          {
+            latestSequence = message.Sequence;
+            Spin(CONVERSION_COST_SEC);
+            converted++;
+            gate.OnPulled(now);
+            arrival.OnPulled(now, message.Timestamp);
+            if (mode == INGEST_MODE_HISTORY)
+            {
+              history.Add(message.Timestamp, matrix);
+            }
+            hub.Publish(KEY, message, message.Timestamp);
+            pulled = true;
+          }
+        }
+        if (!pulled)
+        {
+          const double wakeSec = std::max(arrival.GetNextCheckSec(now), gate.GetNextPullSec());
+          std::this_thread::sleep_until(Clock::time_point(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wakeSec))));
+        }
+      }
+    });
+
+    // Consumer, one read per rendered frame
+    uint64_t consumed(0);
+    double ageSum(0.0);
+    double ageMax(0.0);
+    uint64_t frames(0);
+    auto next = Clock::now();
+    const auto framePeriod = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / CONSUMER_RATE_HZ));
+    PortableTests::Stopwatch stopwatch;
+    Message latest;
+    while (stopwatch.GetElapsedSec() < durationSec)
+    {
+      std::this_thread::sleep_until(next);
+      next += framePeriod;
+
+      Mailbox<Message>::Entry entry;
+      if (mailbox->TryTake(entry))
+      {
+        latest = entry.Payload;
+        consumed++;
+      }
+      if (latest.Sequence != 0)
+      {
+        double age = Now() - latest.Timestamp;
+        ageSum += age;
+        ageMax = std::max(ageMax, age);
+        frames++;
+      }
+    }
+    const double elapsedSec = stopwatch.GetElapsedSec();
+
+    stop = true;
+    tracker.join();
+    receiver.join();
+
+    Result result;
+    result.ReceivedPerSec = received / elapsedSec;
+    result.ConvertedPerSec = converted / elapsedSec;
+    result.ConsumedPerSec = consumed / elapsedSec;
+    result.MeanAgeMsec = frames == 0 ? 0.0 : ageSum / frames * 1e3;
+    result.MaxAgeMsec = ageMax * 1e3;
+    return result;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const double durationSec = argc > 1 ? std::max(0.1, atof(argv[1])) : 2.0;
+  const double rates[] = { 100.0, 500.0, 1000.0 };
+  const IngestMode modes[] = { INGEST_MODE_EVERY_MESSAGE, INGEST_MODE_LATEST_ONLY, INGEST_MODE_DECIMATE, INGEST_MODE_HISTORY };
+
+  printf("%8s %-13s %11s %12s %11s %12s %11s\n", "tracker", "mode", "received/s", "converted/s", "consumed/s", "mean age ms", "max age ms");
+  for (double rate : rates)
+  {
+    for (IngestMode mode : modes)
+    {
+      Result result = Run(rate, mode, durationSec);
+      std::wstring wideName = IngestPolicy::ModeToString(mode);
+      std::string name(wideName.begin(), wideName.end());
+      printf("%5.0f Hz %-13s %11.1f %12.1f %11.1f %12.2f %11.2f\n", rate, name.c_str(), result.ReceivedPerSec, result.ConvertedPerSec, result.ConsumedPerSec, result.MeanAgeMsec, result.MaxAgeMsec);
+    }
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
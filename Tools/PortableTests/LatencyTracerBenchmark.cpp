@@ -0,0 +1,153 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+
+// Cost of LatencyTracer stamps on the receive, dispatch and render threads: a disabled tracer, one message taken
+// through every stage on one thread, and 1 to 8 threads stamping handoffs on streams of their own, as dedicated
+// receive threads do, all contending for the tracer's single lock
+//   LatencyTracerBenchmark [seconds per run, default 0.3]
+
+// Local includes
+#include "pch.h"
+#include "LatencyTracer.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  const int BATCH_SIZE = 256;
+
+  //----------------------------------------------------------------------------
+  // Nanoseconds per stamp of a disabled tracer
+  double RunDisabled(double seconds)
+  {
+    LatencyTracer tracer;
+    uint64_t stamps(0);
+    uint64_t accepted(0);
+    PortableTests::Stopwatch stopwatch;
+    while (stopwatch.GetElapsedSec() < seconds)
+    {
+      for (int i = 0; i < BATCH_SIZE; ++i)
+      {
+        accepted += tracer.Stamp(1, static_cast<double>(stamps + i), LATENCY_STAGE_HANDOFF) ? 1 : 0;
+      }
+      stamps += BATCH_SIZE;
+    }
+    return accepted > 0 ? 0.0 : stopwatch.GetElapsedSec() * 1e9 / stamps;
+  }
+
+  //----------------------------------------------------------------------------
+  // Nanoseconds per message stamped sent, handoff and consumed, then rendered once per batch as by the render loop
+  double RunLifecycle(double seconds)
+  {
+    LatencyTracer tracer;
+    tracer.SetEnabled(true);
+    uint64_t messages(0);
+    PortableTests::Stopwatch stopwatch;
+    while (stopwatch.GetElapsedSec() < seconds)
+    {
+      for (int i = 0; i < BATCH_SIZE; ++i)
+      {
+        const double timestamp = static_cast<double>(messages + i);
+        tracer.Stamp(1, timestamp, LATENCY_STAGE_SENT, timestamp);
+        tracer.Stamp(1, timestamp, LATENCY_STAGE_HANDOFF);
+        tracer.Stamp(1, timestamp, LATENCY_STAGE_CONSUMED);
+      }
+      tracer.StampRendered();
+      messages += BATCH_SIZE;
+    }
+    return stopwatch.GetElapsedSec() * 1e9 / messages;
+  }
+
+  //----------------------------------------------------------------------------
+  // Handoff stamps per second summed over threads
+  double RunContended(int threadCount, double seconds)
+  {
+    LatencyTracer tracer;
+    tracer.SetEnabled(true);
+
+    std::atomic_bool start(false);
+    std::atomic_bool stop(false);
+    std::atomic<uint64_t> stamps(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t)
+    {
+      threads.push_back(std::thread([&, t]()
+      {
+        while (!start)
+        {
+          std::this_thread::yield();
+        }
+        uint64_t count(0);
+        while (!stop.load(std::memory_order_relaxed))
+        {
+          for (int i = 0; i < BATCH_SIZE; ++i)
+          {
+            tracer.Stamp(t + 1, static_cast<double>(count + i), LATENCY_STAGE_HANDOFF);
+          }
+          count += BATCH_SIZE;
+        }
+        stamps += count;
+      }));
+    }
+
+    PortableTests::Stopwatch stopwatch;
+    start = true;
+    std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+    stop = true;
+    const double elapsed = stopwatch.GetElapsedSec();
+    for (auto& thread : threads)
+    {
+      thread.join();
+    }
+    return stamps.load() / elapsed;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const double seconds = argc > 1 ? std::max(0.01, atof(argv[1])) : 0.3;
+
+  printf("%u hardware threads\n", std::thread::hardware_concurrency());
+  printf("%-40s %8.1f ns\n", "disabled stamp", RunDisabled(seconds));
+  printf("%-40s %8.1f ns\n", "sent, handoff, consumed and rendered", RunLifecycle(seconds));
+  printf("%8s %18s\n", "threads", "handoff stamps/s");
+  for (int threadCount : { 1, 2, 4, 8 })
+  {
+    printf("%8d %16.2f M\n", threadCount, RunContended(threadCount, seconds) / 1e6);
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,153 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+
+// Checks LatencyHistogram percentiles against a known distribution, and LatencyTracer stage and end-to-end latencies
+// with explicit stamp times, duplicate stamps from a second consumer, per-frame render stamping, the pending message
+// bound and the disabled tracer
+
+// Local includes
+#include "pch.h"
+#include "LatencyTracer.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <chrono>
+#include <cmath>
+#include <thread>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  const uint64_t STREAM_ID = 0x1234;
+  const int MESSAGE_COUNT = 100;
+
+  //----------------------------------------------------------------------------
+  bool Near(double value, double expected, double relative)
+  {
+    return std::fabs(value - expected) <= expected * relative;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  // 1 to 1000 ms, the histogram is within half a bucket (~3%) of the exact percentiles
+  {
+    LatencyHistogram histogram;
+    CHECK(histogram.GetPercentile(50.0) == 0.0);
+    for (int i = 1; i <= 1000; ++i)
+    {
+      histogram.Record(i * 1e-3);
+    }
+    CHECK(histogram.GetCount() == 1000);
+    CHECK(Near(histogram.GetMean(), 0.5005, 1e-9));
+    CHECK(histogram.GetMax() == 1.0);
+    CHECK(Near(histogram.GetPercentile(50.0), 0.5, 0.035));
+    CHECK(Near(histogram.GetPercentile(95.0), 0.95, 0.035));
+    CHECK(Near(histogram.GetPercentile(99.0), 0.99, 0.035));
+    CHECK(histogram.GetPercentile(100.0) <= 1.0);
+
+    LatencyHistogram other;
+    other.Record(2.0);
+    histogram.Merge(other);
+    CHECK(histogram.GetCount() == 1001 && histogram.GetMax() == 2.0);
+    histogram.Reset();
+    CHECK(histogram.GetCount() == 0 && histogram.GetMax() == 0.0);
+  }
+
+  LatencyTracer tracer;
+  LatencyTracer::Summary summary;
+
+  // Disabled by default, nothing is collected
+  CHECK(!tracer.IsEnabled());
+  CHECK(!tracer.Stamp(STREAM_ID, 1.0, LATENCY_STAGE_HANDOFF, 1.0));
+  CHECK(tracer.GetStreams().empty());
+  tracer.SetEnabled(true);
+
+  // Explicit stamp times: 5 ms transport, 2 ms to consume, 10 ms to render. A second consumer pulling the same message
+  // later does not count
+  for (int i = 0; i < MESSAGE_COUNT; ++i)
+  {
+    const double timestamp = 100.0 + i * 0.01;
+    CHECK(tracer.Stamp(STREAM_ID, timestamp, LATENCY_STAGE_SENT, timestamp) == (i == 0));
+    tracer.Stamp(STREAM_ID, timestamp, LATENCY_STAGE_HANDOFF, timestamp + 0.005);
+    tracer.Stamp(STREAM_ID, timestamp, LATENCY_STAGE_HANDOFF, timestamp + 0.050);
+    tracer.Stamp(STREAM_ID, timestamp, LATENCY_STAGE_CONSUMED, timestamp + 0.007);
+    tracer.Stamp(STREAM_ID, timestamp, LATENCY_STAGE_RENDERED, timestamp + 0.017);
+  }
+  CHECK(tracer.GetStreams().size() == 1);
+  CHECK(tracer.GetStageLatency(STREAM_ID, LATENCY_STAGE_HANDOFF, summary));
+  CHECK(summary.Count == MESSAGE_COUNT && Near(summary.MeanSec, 0.005, 1e-6) && Near(summary.P99Sec, 0.005, 0.035));
+  CHECK(tracer.GetStageLatency(STREAM_ID, LATENCY_STAGE_CONSUMED, summary));
+  CHECK(summary.Count == MESSAGE_COUNT && Near(summary.MeanSec, 0.002, 1e-6));
+  CHECK(tracer.GetStageLatency(STREAM_ID, LATENCY_STAGE_RENDERED, summary));
+  CHECK(summary.Count == MESSAGE_COUNT && Near(summary.MeanSec, 0.010, 1e-6));
+
+  // End to end starts at the handoff, the sender's clock is not ours
+  CHECK(tracer.GetEndToEndLatency(STREAM_ID, summary));
+  CHECK(summary.Count == MESSAGE_COUNT && Near(summary.MeanSec, 0.012, 1e-6));
+
+  tracer.SetStreamName(STREAM_ID, "Tracker/StylusToReference");
+  const std::string table = tracer.ToString();
+  CHECK(table.find("stream,stage,count") == 0);
+  CHECK(table.find("Tracker/StylusToReference,Handoff,100,") != std::string::npos);
+  CHECK(table.find("Tracker/StylusToReference,EndToEnd,100,") != std::string::npos);
+
+  // Reset keeps the stream but clears its histograms
+  tracer.Reset();
+  CHECK(tracer.GetStageLatency(STREAM_ID, LATENCY_STAGE_HANDOFF, summary) && summary.Count == 0);
+
+  // Consumed messages are rendered by the next per-frame call, and only once
+  CHECK(!tracer.Stamp(STREAM_ID, 200.0, LATENCY_STAGE_HANDOFF));
+  tracer.Stamp(STREAM_ID, 200.0, LATENCY_STAGE_CONSUMED);
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  tracer.StampRendered();
+  tracer.StampRendered();
+  CHECK(tracer.GetEndToEndLatency(STREAM_ID, summary));
+  CHECK(summary.Count == 1 && summary.MeanSec >= 0.002 && summary.MeanSec < 1.0);
+
+  // Disabling drops messages that were consumed but not yet rendered
+  tracer.Stamp(STREAM_ID, 201.0, LATENCY_STAGE_HANDOFF);
+  tracer.Stamp(STREAM_ID, 201.0, LATENCY_STAGE_CONSUMED);
+  tracer.SetEnabled(false);
+  tracer.SetEnabled(true);
+  tracer.StampRendered();
+  CHECK(tracer.GetEndToEndLatency(STREAM_ID, summary) && summary.Count == 1);
+
+  // Messages that are never rendered are evicted oldest first, a late render stamp of an evicted message is not counted
+  for (int i = 0; i < 1000; ++i)
+  {
+    tracer.Stamp(STREAM_ID, 300.0 + i, LATENCY_STAGE_HANDOFF, 300.0 + i);
+  }
+  tracer.Stamp(STREAM_ID, 300.0, LATENCY_STAGE_RENDERED, 1400.0);
+  CHECK(tracer.GetEndToEndLatency(STREAM_ID, summary) && summary.Count == 1);
+  tracer.Stamp(STREAM_ID, 1299.0, LATENCY_STAGE_RENDERED, 1299.5);
+  CHECK(tracer.GetEndToEndLatency(STREAM_ID, summary) && summary.Count == 2);
+
+  return PortableTests::Finish("LatencyTracerTest");
+}
\ No newline at end of file
@@ -0,0 +1,400 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Validates MultiVolumeRayMarcher, the CPU reference for MultiVolumePS.hlsl, with a sphere, a sinusoid and a rotated
+// sphere volume over random rays. Intervals are checked against brute force box membership; the joint march against
+// front over back compositing of disjoint volumes, against itself in any volume order and against VolumeRayMarcher for
+// one volume. For overlapping volumes it checks that the joint march is closer to the blended result than either order
+// of separate unblended passes, with fewer samples.
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "MultiVolumeRayMarcher.h"
+#include "PreIntegrationTable.h"
+#include "VolumeRayMarcher.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  const int RAY_COUNT = 2000;
+  const int BRUTE_FORCE_RAY_COUNT = 500;
+  const int BRUTE_FORCE_SAMPLES = 20000;
+
+  enum Shape
+  {
+    Shape_Sphere,
+    Shape_Sinusoid,
+  };
+
+  // An 8 bit volume with a grey ramp transfer function, transparent below 40
+  struct TestVolume
+  {
+    std::vector<uint8_t>  Data;
+    PreIntegrationTable   Table;
+    VolumeRayMarcher      Marcher;
+
+    TestVolume(uint32_t width, uint32_t height, uint32_t depth, Shape shape, float opacityScale)
+    {
+      Data.resize((size_t)width * height * depth);
+      for (uint32_t k = 0; k < depth; ++k)
+      {
+        for (uint32_t j = 0; j < height; ++j)
+        {
+          for (uint32_t i = 0; i < width; ++i)
+          {
+            const float u = (i + 0.5f) / width - 0.5f;
+            const float v = (j + 0.5f) / height - 0.5f;
+            const float w = (k + 0.5f) / depth - 0.5f;
+            const float radius = std::sqrt(u * u + v * v + w * w);
+            const float value = shape == Shape_Sphere ? (radius < 0.4f ? 200.f * (1.f - radius) : 0.f) : 255.f * (0.5f + 0.5f * std::sin(10.f * u) * std::cos(7.f * v));
+            Data[((size_t)k * height + j) * width + i] = static_cast<uint8_t>(std::min(std::max(value, 0.f), 255.f));
+          }
+        }
+      }
+
+      std::vector<float> rgba(256 * 4);
+      std::vector<float> opacities(256);
+      for (int i = 0; i < 256; ++i)
+      {
+        const float alpha = i < 40 ? 0.f : opacityScale * (i - 40) / 215.f;
+        rgba[4 * i] = rgba[4 * i + 1] = rgba[4 * i + 2] = i / 255.f;
+        rgba[4 * i + 3] = alpha;
+        opacities[i] = alpha;
+      }
+      Table.Build(rgba, 256, 1.f, 1);
+
+      const uint32_t dimensions[3] = { width, height, depth };
+      float step[3];
+      uint32_t iterations;
+      VolumeRayMarcher::ComputeStep(dimensions, 1.f, step, iterations);
+      Marcher.SetVolume(Data.data(), width, height, depth, 1);
+      Marcher.SetOpacityTable(opacities, 255.f);
+      Marcher.SetStep(step, iterations);
+      Marcher.SetPreIntegrationTable(&Table);
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  // Texture from world for an axis aligned box, row-major with column vectors
+  void AxisAlignedBox(float x, float y, float z, float width, float height, float depth, float outMatrix[16])
+  {
+    const float matrix[16] =
+    {
+      1.f / width, 0.f, 0.f, -x / width,
+      0.f, 1.f / height, 0.f, -y / height,
+      0.f, 0.f, 1.f / depth, -z / depth,
+      0.f, 0.f, 0.f, 1.f
+    };
+    std::copy(matrix, matrix + 16, outMatrix);
+  }
+
+  //----------------------------------------------------------------------------
+  // A unit box centred on (0.75, 0.5, 0.5), rotated by angle about z
+  void RotatedBox(float angle, float outMatrix[16])
+  {
+    const float c = std::cos(angle);
+    const float s = std::sin(angle);
+    const float x = -0.75f;
+    const float y = -0.5f;
+    const float matrix[16] =
+    {
+      c, s, 0.f, c * x + s * y + 0.5f,
+      -s, c, 0.f, -s * x + c * y + 0.5f,
+      0.f, 0.f, 1.f, 0.f,
+      0.f, 0.f, 0.f, 1.f
+    };
+    std::copy(matrix, matrix + 16, outMatrix);
+  }
+
+  //----------------------------------------------------------------------------
+  float MaxDifference(const float a[4], const float b[4])
+  {
+    float difference(0.f);
+    for (int c = 0; c < 4; ++c)
+    {
+      difference = std::max(difference, std::fabs(a[c] - b[c]));
+    }
+    return difference;
+  }
+
+  //----------------------------------------------------------------------------
+  void FrontOverBack(const float front[4], const float back[4], float outColour[4])
+  {
+    for (int c = 0; c < 4; ++c)
+    {
+      outColour[c] = front[c] + (1.f - front[3]) * back[c];
+    }
+  }
+
+  // Rays along +x from x = -2 to x = 5, through and around the unit boxes
+  class RayGenerator
+  {
+  public:
+    RayGenerator() : m_generator(5), m_distribution(-0.2f, 1.2f) {}
+
+    void Next(float eye[3], float end[3])
+    {
+      eye[0] = -2.f;
+      eye[1] = m_distribution(m_generator);
+      eye[2] = m_distribution(m_generator);
+      end[0] = 5.f;
+      end[1] = m_distribution(m_generator);
+      end[2] = m_distribution(m_generator);
+    }
+
+  protected:
+    std::mt19937                            m_generator;
+    std::uniform_real_distribution<float>   m_distribution;
+  };
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  TestVolume sphere(32, 32, 32, Shape_Sphere, 0.3f);
+  TestVolume sinusoid(48, 32, 24, Shape_Sinusoid, 0.05f);
+  TestVolume rotated(24, 24, 40, Shape_Sphere, 0.2f);
+  float sphereBox[16];
+  float farBox[16];
+  float overlappingBox[16];
+  float rotatedBox[16];
+  AxisAlignedBox(0.f, 0.f, 0.f, 1.f, 1.f, 1.f, sphereBox);
+  AxisAlignedBox(2.f, 0.f, 0.f, 1.f, 1.f, 1.f, farBox);
+  AxisAlignedBox(0.5f, 0.2f, 0.1f, 1.f, 0.8f, 0.9f, overlappingBox);
+  RotatedBox(0.6f, rotatedBox);
+
+  // Intervals match where brute force sampling finds the ray inside each box, sorted by entry
+  {
+    MultiVolumeRayMarcher marcher;
+    CHECK(marcher.AddVolume(&sphere.Marcher, sphereBox));
+    CHECK(marcher.AddVolume(&sinusoid.Marcher, overlappingBox));
+    CHECK(marcher.AddVolume(&rotated.Marcher, rotatedBox));
+    const float* boxes[3] = { sphereBox, overlappingBox, rotatedBox };
+
+    RayGenerator rays;
+    float worstEnd(0.f);
+    int hits(0);
+    int missed(0);
+    for (int r = 0; r < BRUTE_FORCE_RAY_COUNT; ++r)
+    {
+      float eye[3], end[3];
+      rays.Next(eye, end);
+      std::vector<MultiVolumeRayMarcher::Interval> intervals;
+      marcher.FindIntervals(eye, end, intervals);
+      for (size_t i = 1; i < intervals.size(); ++i)
+      {
+        CHECK(intervals[i].Enter >= intervals[i - 1].Enter);
+      }
+
+      for (uint32_t v = 0; v < 3; ++v)
+      {
+        float enter(2.f);
+        float exit(-1.f);
+        for (int s = 0; s <= BRUTE_FORCE_SAMPLES; ++s)
+        {
+          const float t = static_cast<float>(s) / BRUTE_FORCE_SAMPLES;
+          bool inside(true);
+          for (int a = 0; a < 3; ++a)
+          {
+            const float* row = boxes[v] + 4 * a;
+            const float coordinate = row[0] * (eye[0] + (end[0] - eye[0]) * t) + row[1] * (eye[1] + (end[1] - eye[1]) * t) + row[2] * (eye[2] + (end[2] - eye[2]) * t) + row[3];
+            inside = inside && coordinate >= 0.f && coordinate <= 1.f;
+          }
+          if (inside)
+          {
+            enter = std::min(enter, t);
+            exit = std::max(exit, t);
+          }
+        }
+
+        const MultiVolumeRayMarcher::Interval* found = nullptr;
+        for (auto& interval : intervals)
+        {
+          found = interval.Volume == v ? &interval : found;
+        }
+        if (found != nullptr && exit >= enter)
+        {
+          hits++;
+          worstEnd = std::max(worstEnd, std::max(std::fabs(found->Enter - enter), std::fabs(found->Exit - exit)));
+        }
+        else if ((found != nullptr) != (exit >= enter) && exit - enter > 1e-4f)
+        {
+          // Grazing rays may fall between brute force samples, anything longer must be found
+          missed++;
+        }
+      }
+    }
+    CHECK(hits > BRUTE_FORCE_RAY_COUNT);
+    CHECK(missed == 0);
+    CHECK(worstEnd <= 2.f / BRUTE_FORCE_SAMPLES);
+  }
+
+  // Disjoint volumes: the joint march is the near volume over the far one
+  {
+    MultiVolumeRayMarcher joint, nearMarcher, farMarcher;
+    joint.AddVolume(&sphere.Marcher, sphereBox);
+    joint.AddVolume(&sinusoid.Marcher, farBox);
+    nearMarcher.AddVolume(&sphere.Marcher, sphereBox);
+    farMarcher.AddVolume(&sinusoid.Marcher, farBox);
+
+    RayGenerator rays;
+    float worst(0.f);
+    int both(0);
+    for (int r = 0; r < RAY_COUNT; ++r)
+    {
+      float eye[3], end[3];
+      rays.Next(eye, end);
+      const MultiVolumeRayMarcher::RayResult jointResult = joint.March(eye, end);
+      const MultiVolumeRayMarcher::RayResult nearResult = nearMarcher.March(eye, end);
+      const MultiVolumeRayMarcher::RayResult farResult = farMarcher.March(eye, end);
+
+      // Early ray termination ends the joint march where compositing the two would carry on
+      float expected[4];
+      FrontOverBack(nearResult.Colour, farResult.Colour, expected);
+      if (nearResult.Colour[3] >= 0.95f || expected[3] >= 0.95f)
+      {
+        continue;
+      }
+      worst = std::max(worst, MaxDifference(jointResult.Colour, expected));
+      both += nearResult.Colour[3] > 0.01f && farResult.Colour[3] > 0.01f ? 1 : 0;
+    }
+    CHECK(both > 100);
+    CHECK(worst < 1e-5f);
+  }
+
+  // Overlapping volumes give the same result in any order
+  {
+    MultiVolumeRayMarcher forward2, reverse2, forward3, reverse3;
+    forward2.AddVolume(&sphere.Marcher, sphereBox);
+    forward2.AddVolume(&sinusoid.Marcher, overlappingBox);
+    reverse2.AddVolume(&sinusoid.Marcher, overlappingBox);
+    reverse2.AddVolume(&sphere.Marcher, sphereBox);
+    forward3.AddVolume(&sphere.Marcher, sphereBox);
+    forward3.AddVolume(&sinusoid.Marcher, overlappingBox);
+    forward3.AddVolume(&rotated.Marcher, rotatedBox);
+    reverse3.AddVolume(&rotated.Marcher, rotatedBox);
+    reverse3.AddVolume(&sphere.Marcher, sphereBox);
+    reverse3.AddVolume(&sinusoid.Marcher, overlappingBox);
+
+    RayGenerator rays;
+    float worst(0.f);
+    for (int r = 0; r < RAY_COUNT; ++r)
+    {
+      float eye[3], end[3];
+      rays.Next(eye, end);
+      worst = std::max(worst, MaxDifference(forward2.March(eye, end).Colour, reverse2.March(eye, end).Colour));
+      worst = std::max(worst, MaxDifference(forward3.March(eye, end).Colour, reverse3.March(eye, end).Colour));
+    }
+    CHECK(worst < 1e-5f);
+  }
+
+  // One volume marches like VolumeRayMarcher between the same entry and exit, up to where the steps start
+  {
+    MultiVolumeRayMarcher marcher;
+    marcher.AddVolume(&sphere.Marcher, sphereBox);
+
+    RayGenerator rays;
+    float worst(0.f);
+    double sum(0.0);
+    int count(0);
+    for (int r = 0; r < RAY_COUNT; ++r)
+    {
+      float eye[3], end[3];
+      rays.Next(eye, end);
+      std::vector<MultiVolumeRayMarcher::Interval> intervals;
+      marcher.FindIntervals(eye, end, intervals);
+      if (intervals.empty())
+      {
+        continue;
+      }
+
+      float front[3], back[3];
+      for (int a = 0; a < 3; ++a)
+      {
+        front[a] = eye[a] + (end[a] - eye[a]) * intervals[0].Enter;
+        back[a] = eye[a] + (end[a] - eye[a]) * intervals[0].Exit;
+      }
+      const float difference = MaxDifference(sphere.Marcher.March(front, back, false).Colour, marcher.March(eye, end).Colour);
+      worst = std::max(worst, difference);
+      sum += difference;
+      count++;
+    }
+    CHECK(count > RAY_COUNT / 2);
+    CHECK(sum / count < 5e-3);
+    CHECK(worst < 0.05f);
+  }
+
+  // Overlapping volumes drawn as separate unblended passes keep only the last one drawn, either order is far from the
+  // joint march, which is also closer to compositing them than either and takes fewer samples
+  {
+    MultiVolumeRayMarcher joint, first, second;
+    joint.AddVolume(&sphere.Marcher, sphereBox);
+    joint.AddVolume(&sinusoid.Marcher, overlappingBox);
+    first.AddVolume(&sphere.Marcher, sphereBox);
+    second.AddVolume(&sinusoid.Marcher, overlappingBox);
+
+    RayGenerator rays;
+    double firstLastError(0.0), secondLastError(0.0), blendedError(0.0);
+    uint64_t jointSamples(0), separateSamples(0);
+    int count(0);
+    for (int r = 0; r < RAY_COUNT; ++r)
+    {
+      float eye[3], end[3];
+      rays.Next(eye, end);
+      const MultiVolumeRayMarcher::RayResult jointResult = joint.March(eye, end);
+      const MultiVolumeRayMarcher::RayResult firstResult = first.March(eye, end);
+      const MultiVolumeRayMarcher::RayResult secondResult = second.March(eye, end);
+      if (firstResult.Colour[3] < 0.01f || secondResult.Colour[3] < 0.01f)
+      {
+        continue;
+      }
+
+      float blended[4];
+      FrontOverBack(firstResult.Colour, secondResult.Colour, blended);
+      firstLastError += MaxDifference(jointResult.Colour, firstResult.Colour);
+      secondLastError += MaxDifference(jointResult.Colour, secondResult.Colour);
+      blendedError += MaxDifference(jointResult.Colour, blended);
+      jointSamples += jointResult.Samples;
+      separateSamples += firstResult.Samples + secondResult.Samples;
+      count++;
+    }
+    CHECK(count > 100);
+    CHECK(firstLastError / count > 0.05);
+    CHECK(secondLastError / count > 0.05);
+    CHECK(blendedError < firstLastError && blendedError < secondLastError);
+    CHECK(jointSamples < separateSamples);
+  }
+
+  return PortableTests::Finish("MultiVolumeRayMarcherTest");
+}
\ No newline at end of file
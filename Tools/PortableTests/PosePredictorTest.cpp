@@ -0,0 +1,240 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Checks PosePredictor extrapolation of a tool moving at constant velocity, and that dropouts, repeated samples and a
+// tracker clock that restarts never leave it extrapolating from stale samples
+// Then replays tracker traces of a hand-held stylus and a probe sweep, with timestamp jitter and measurement noise, and
+// checks that the RMS error of the predicted tip position is well below that of interpolating the TransformHistory, the
+// pose the renderer gets without prediction. Extrapolating the lerp of the two newest samples is reported alongside, it
+// is not asserted on: it does better than the fit on fast smooth motion and worse once noise dominates.
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "PosePredictor.h"
+#include "TransformHistory.h"
+
+// STL includes
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  typedef PosePredictor::Matrix Matrix;
+
+  //----------------------------------------------------------------------------
+  Matrix Translation(float x)
+  {
+    Matrix pose = { 1.f, 0.f, 0.f, x,
+                    0.f, 1.f, 0.f, 0.f,
+                    0.f, 0.f, 1.f, 0.f,
+                    0.f, 0.f, 0.f, 1.f
+                  };
+    return pose;
+  }
+
+  //----------------------------------------------------------------------------
+  bool NearX(const Matrix& pose, float x)
+  {
+    return std::fabs(pose[3] - x) < 1e-2f;
+  }
+
+  const double PI = 3.14159265358979323846;
+  const double TRACE_DURATION_SEC = 20.0;
+  const double TIP_OFFSET_MM = 150.0;           // Stylus tip along the tool x axis, so rotation error shows up as position error
+  const double HORIZONS_SEC[] = { 0.016, 0.033, 0.05 };
+  const double MAX_ERROR_RATIO = 0.5;           // Predicted RMS error must be at most this fraction of the interpolated one
+
+  // Tool motion as a sum of sinusoids per axis, amplitudes in mm and radians
+  struct Trace
+  {
+    const char*   Name;
+    double        RateHz;
+    double        JitterSec;                    // Uniform, on the sample times
+    double        NoiseMm;                      // Gaussian, on the sampled translation
+    double        Amplitude[5];                 // x, y, z, rotation about z, rotation about x
+    double        FrequencyHz[5];
+    double        DriftMmPerSec;                // Added along x
+  };
+
+  const Trace TRACES[] =
+  {
+    { "stylus", 60.0, 0.002, 0.1, { 60.0, 30.0, 10.0, 0.6, 0.2 }, { 0.8, 1.3, 0.4, 0.7, 1.1 }, 0.0 },
+    { "probe sweep", 100.0, 0.001, 0.05, { 4.0, 2.0, 1.0, 0.15, 0.05 }, { 0.5, 0.9, 0.3, 0.25, 0.6 }, 20.0 }
+  };
+
+  //----------------------------------------------------------------------------
+  Matrix TracePose(const Trace& trace, double t)
+  {
+    double value[5];
+    for (int i = 0; i < 5; ++i)
+    {
+      value[i] = trace.Amplitude[i] * std::sin(2.0 * PI * trace.FrequencyHz[i] * t + i);
+    }
+    const double cz = std::cos(value[3]), sz = std::sin(value[3]);
+    const double cx = std::cos(value[4]), sx = std::sin(value[4]);
+    Matrix pose = { static_cast<float>(cz), static_cast<float>(-sz * cx), static_cast<float>(sz * sx), static_cast<float>(value[0] + trace.DriftMmPerSec * t),
+                    static_cast<float>(sz), static_cast<float>(cz * cx), static_cast<float>(-cz * sx), static_cast<float>(value[1]),
+                    0.f, static_cast<float>(sx), static_cast<float>(cx), static_cast<float>(value[2]),
+                    0.f, 0.f, 0.f, 1.f
+                  };
+    return pose;
+  }
+
+  //----------------------------------------------------------------------------
+  double TipError(const Matrix& pose, const Matrix& truth)
+  {
+    double squared(0.0);
+    for (int row = 0; row < 3; ++row)
+    {
+      double difference = (pose[row * 4] - truth[row * 4]) * TIP_OFFSET_MM + (pose[row * 4 + 3] - truth[row * 4 + 3]);
+      squared += difference * difference;
+    }
+    return std::sqrt(squared);
+  }
+
+  //----------------------------------------------------------------------------
+  // After every sample, the pose horizonSec past it as predicted and as interpolated from the history
+  bool ReplayTrace(const Trace& trace, double horizonSec, double& outPredictedRms, double& outInterpolatedRms, double& outLerpRms)
+  {
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<double> jitter(-trace.JitterSec, trace.JitterSec);
+    std::normal_distribution<double> noise(0.0, trace.NoiseMm);
+
+    PosePredictor predictor;
+    TransformHistory history;
+    double predictedSquared(0.0);
+    double interpolatedSquared(0.0);
+    double lerpSquared(0.0);
+    uint64_t count(0);
+    Matrix previous = {};
+    double previousTimestamp(0.0);
+    for (int i = 0; i < static_cast<int>(TRACE_DURATION_SEC * trace.RateHz); ++i)
+    {
+      const double timestamp = 1.0 + i / trace.RateHz + jitter(generator);
+      Matrix sample = TracePose(trace, timestamp);
+      sample[3] += static_cast<float>(noise(generator));
+      sample[7] += static_cast<float>(noise(generator));
+      sample[11] += static_cast<float>(noise(generator));
+      if (!predictor.AddSample(timestamp, timestamp + 0.01, sample) || !history.Add(timestamp, sample))
+      {
+        return false;
+      }
+      if (i < 8)
+      {
+        previous = sample;
+        previousTimestamp = timestamp;
+        continue;
+      }
+
+      // The target lies past the newest sample, beyond what the history interpolates, so without prediction the newest pose is shown
+      const double target = timestamp + horizonSec;
+      const Matrix truth = TracePose(trace, target);
+      Matrix predicted;
+      Matrix interpolated;
+      bool valid(false);
+      if (!predictor.PredictAtDeviceTime(target, predicted) || !history.GetTransform(timestamp, interpolated, valid))
+      {
+        return false;
+      }
+
+      // Lerp of the two newest samples carried on past the newest
+      Matrix lerp;
+      const double fraction = (target - previousTimestamp) / (timestamp - previousTimestamp);
+      for (int j = 0; j < 16; ++j)
+      {
+        lerp[j] = static_cast<float>(previous[j] + (sample[j] - previous[j]) * fraction);
+      }
+      previous = sample;
+      previousTimestamp = timestamp;
+
+      predictedSquared += TipError(predicted, truth) * TipError(predicted, truth);
+      interpolatedSquared += TipError(interpolated, truth) * TipError(interpolated, truth);
+      lerpSquared += TipError(lerp, truth) * TipError(lerp, truth);
+      count++;
+    }
+    outPredictedRms = std::sqrt(predictedSquared / count);
+    outInterpolatedRms = std::sqrt(interpolatedSquared / count);
+    outLerpRms = std::sqrt(lerpSquared / count);
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  // 100 mm/s along x, sampled at 100 Hz, arriving 20 ms after the device timestamp
+  PosePredictor predictor;
+  for (int i = 0; i < 8; ++i)
+  {
+    CHECK(predictor.AddSample(10.0 + i * 0.01, 0.02 + i * 0.01, Translation(i * 1.f)));
+  }
+  Matrix pose;
+  CHECK(predictor.PredictAtDeviceTime(10.0 + 7 * 0.01 + 0.05, pose) && NearX(pose, 12.f));
+  CHECK(predictor.PredictAtLocalTime(0.02 + 7 * 0.01 + 0.05, pose) && NearX(pose, 12.f));
+
+  // Extrapolation is capped at MaxHorizonSec
+  CHECK(predictor.PredictAtDeviceTime(10.0 + 7 * 0.01 + 0.2, pose) && NearX(pose, 17.f));
+
+  // A repeat of the newest sample is not accepted and changes nothing
+  CHECK(!predictor.AddSample(10.0 + 7 * 0.01, 0.1, Translation(50.f)));
+  CHECK(predictor.PredictAtDeviceTime(10.0 + 7 * 0.01, pose) && NearX(pose, 7.f));
+
+  // Tracker restarted its clock: the old fit is dropped and the new sample is used as is
+  CHECK(predictor.AddSample(1.0, 0.2, Translation(100.f)));
+  double linear[3], angular[3];
+  predictor.GetVelocity(linear, angular);
+  CHECK(linear[0] == 0.0);
+  CHECK(predictor.PredictAtDeviceTime(1.05, pose) && NearX(pose, 100.f));
+  CHECK(std::fabs(predictor.GetClockOffset() - (0.2 - 1.0)) < 1e-9);
+
+  // Tracking dropout resets, whatever its timestamp
+  CHECK(!predictor.AddSample(0.5, 0.3, Translation(0.f), false));
+  CHECK(!predictor.IsValid());
+  CHECK(!predictor.HasSample());
+  CHECK(!predictor.PredictAtDeviceTime(1.05, pose));
+  CHECK(predictor.AddSample(0.6, 0.35, Translation(3.f)));
+  CHECK(predictor.IsValid());
+
+  // Recorded-like traces, predicted against interpolated
+  for (const Trace& trace : TRACES)
+  {
+    for (double horizonSec : HORIZONS_SEC)
+    {
+      double predictedRms(0.0);
+      double interpolatedRms(0.0);
+      double lerpRms(0.0);
+      CHECK(ReplayTrace(trace, horizonSec, predictedRms, interpolatedRms, lerpRms));
+      printf("%-12s %3.0f ms ahead: predicted RMS %6.2f mm, interpolated RMS %6.2f mm, two sample lerp RMS %6.2f mm\n", trace.Name, horizonSec * 1e3, predictedRms, interpolatedRms, lerpRms);
+      CHECK(predictedRms < interpolatedRms * MAX_ERROR_RATIO);
+    }
+  }
+
+  return PortableTests::Finish("PosePredictorTest");
+}
\ No newline at end of file
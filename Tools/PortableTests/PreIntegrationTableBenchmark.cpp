@@ -0,0 +1,105 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// PreIntegrationTable builds from 64 to 1024 entries, on the calling thread alone and shared over the WorkerPool, for a
+// coloured transfer function of 8 control points. Volume builds a 256 entry table whenever the transfer function
+// changes and again, off the render thread, for every new step scale.
+//   PreIntegrationTableBenchmark [repeats, default 20]
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "PreIntegrationTable.h"
+#include "WorkerPool.h"
+
+// STL includes
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace HoloIntervention;
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  const uint32_t INPUT_ENTRIES = 512;   // Volume's transfer function lookup table
+  const uint32_t CONTROL_POINTS = 8;
+
+  //----------------------------------------------------------------------------
+  // Piecewise linear colour and opacity, transparent over the first quarter of the input range
+  std::vector<float> MakeTransferFunction()
+  {
+    const float colours[CONTROL_POINTS][4] =
+    {
+      { 0.f, 0.f, 0.f, 0.f }, { 0.f, 0.f, 0.f, 0.f }, { 0.6f, 0.2f, 0.1f, 0.05f }, { 0.9f, 0.4f, 0.3f, 0.1f },
+      { 0.9f, 0.8f, 0.6f, 0.02f }, { 1.f, 1.f, 0.9f, 0.3f }, { 1.f, 1.f, 1.f, 0.6f }, { 1.f, 1.f, 1.f, 0.9f }
+    };
+    std::vector<float> rgba(INPUT_ENTRIES * 4);
+    for (uint32_t i = 0; i < INPUT_ENTRIES; ++i)
+    {
+      const float position = static_cast<float>(i) / (INPUT_ENTRIES - 1) * (CONTROL_POINTS - 1);
+      const uint32_t lower = std::min(static_cast<uint32_t>(position), CONTROL_POINTS - 2);
+      const float fraction = position - lower;
+      for (int c = 0; c < 4; ++c)
+      {
+        rgba[i * 4 + c] = colours[lower][c] + (colours[lower + 1][c] - colours[lower][c]) * fraction;
+      }
+    }
+    return rgba;
+  }
+
+  //----------------------------------------------------------------------------
+  double BuildMsec(const std::vector<float>& rgba, uint32_t size, uint32_t threadCount, int repeats)
+  {
+    PreIntegrationTable table;
+    table.Build(rgba, size, 1.f, threadCount);
+    PortableTests::Stopwatch stopwatch;
+    for (int r = 0; r < repeats; ++r)
+    {
+      // Alternating step ratios, as step scale changes rebuild the table
+      table.Build(rgba, size, r % 2 == 0 ? 0.5f : 2.f, threadCount);
+    }
+    return table.IsValid() ? stopwatch.GetElapsedSec() * 1e3 / repeats : 0.0;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 20;
+  const std::vector<float> rgba = MakeTransferFunction();
+
+  printf("%u pool threads, %u input entries\n", WorkerPool::instance().GetThreadCount(), INPUT_ENTRIES);
+  printf("%6s %10s %14s %14s %9s\n", "size", "table MB", "1 thread ms", "pool ms", "speedup");
+  for (uint32_t size : { 64u, 128u, 256u, 512u, 1024u })
+  {
+    const double singleMsec = BuildMsec(rgba, size, 1, repeats);
+    const double poolMsec = BuildMsec(rgba, size, 0, repeats);
+    printf("%6u %10.2f %14.3f %14.3f %8.1fx\n", size, size * size * 4 * sizeof(float) / (1024.0 * 1024.0), singleMsec, poolMsec, singleMsec / std::max(poolMsec, 1e-9));
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
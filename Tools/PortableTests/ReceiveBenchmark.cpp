@@ -0,0 +1,498 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+
+// Receive threads against real loopback TCP traffic: a tracker connector sending 8 transforms at 250 Hz and an imaging
+// connector sending 640x480 16 bit images at 30 Hz. A socket thread per connector stands in for the IGT client, it
+// decodes every message and keeps the latest per stream, and can only be polled. Receive threads pull from the clients
+// the way NetworkSystem::ReceiveLoop does, converting each message they pull, and hand it to a dispatch thread through
+// SpscQueues that are drained transforms first. Compares one receive thread shared by both connectors with one per
+// connector, each idling either on a fixed 1 ms sleep or until the next message is due according to ArrivalEstimator.
+// Reports the send to dispatch latency of transforms and images, and the receive threads' wakeups and CPU time.
+//   ReceiveBenchmark [seconds per run, default 2]
+
+// Local includes
+#include "pch.h"
+#include "IngestPolicy.h"
+#include "LatencyTracer.h"
+#include "SpscQueue.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// OS includes
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace HoloIntervention;
+using namespace HoloIntervention::Network;
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  const double TRACKER_RATE_HZ = 250.0;
+  const uint32_t TRANSFORM_COUNT = 8;
+  const double IMAGE_RATE_HZ = 30.0;
+  const size_t IMAGE_BYTES = 640 * 480 * 2;
+  const size_t TRANSFORM_BYTES = 16 * sizeof(float);
+  const uint32_t FIXED_SLEEP_MSEC = 1;      // The receive loop before it waited on ArrivalEstimator
+  const double MAX_WAIT_SEC = 0.02;         // NetworkSystem::RECEIVE_DISCONNECTED_SLEEP_MSEC
+  const size_t TRANSFORM_QUEUE_CAPACITY = 256;
+  const size_t FRAME_QUEUE_CAPACITY = 4;
+
+  enum MessageType : uint32_t
+  {
+    MESSAGE_TRANSFORM,
+    MESSAGE_IMAGE
+  };
+
+  struct Header
+  {
+    uint32_t  Type;
+    uint32_t  Stream;
+    double    Timestamp;  // Steady clock at send, sender and receiver share it
+    uint64_t  Size;
+  };
+
+  //----------------------------------------------------------------------------
+  double Now()
+  {
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+  }
+
+  //----------------------------------------------------------------------------
+  double GetThreadCpuSec()
+  {
+    timespec time = {};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return time.tv_sec + time.tv_nsec * 1e-9;
+  }
+
+  //----------------------------------------------------------------------------
+  bool MakeLoopbackPair(int& outSender, int& outReceiver)
+  {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in socketAddress = {};
+    socketAddress.sin_family = AF_INET;
+    socketAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(socketAddress);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&socketAddress), length) != 0 ||
+        listen(listener, 1) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&socketAddress), &length) != 0)
+    {
+      close(listener);
+      return false;
+    }
+
+    outReceiver = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(outReceiver, reinterpret_cast<sockaddr*>(&socketAddress), length) != 0)
+    {
+      close(outReceiver);
+      close(listener);
+      return false;
+    }
+    outSender = accept(listener, nullptr, nullptr);
+    close(listener);
+
+    int noDelay(1);
+    setsockopt(outSender, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+    return outSender >= 0;
+  }
+
+  //----------------------------------------------------------------------------
+  bool SendAll(int socketHandle, const void* data, size_t size)
+  {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    while (size > 0)
+    {
+      ssize_t sent = send(socketHandle, bytes, size, MSG_NOSIGNAL);
+      if (sent <= 0)
+      {
+        return false;
+      }
+      bytes += sent;
+      size -= static_cast<size_t>(sent);
+    }
+    return true;
+  }
+
+  //----------------------------------------------------------------------------
+  bool ReceiveAll(int socketHandle, void* data, size_t size)
+  {
+    uint8_t* bytes = static_cast<uint8_t*>(data);
+    while (size > 0)
+    {
+      ssize_t received = recv(socketHandle, bytes, size, 0);
+      if (received <= 0)
+      {
+        return false;
+      }
+      bytes += received;
+      size -= static_cast<size_t>(received);
+    }
+    return true;
+  }
+
+  // Sends a batch of messages on a fixed schedule until stopped
+  class Sender
+  {
+  public:
+    Sender(int socketHandle, MessageType type, uint32_t streamCount, size_t payloadBytes, double rateHz)
+      : m_socket(socketHandle)
+    {
+      m_thread = std::thread([this, type, streamCount, payloadBytes, rateHz]()
+      {
+        std::vector<uint8_t> payload(payloadBytes, 0x5a);
+        auto next = Clock::now();
+        const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / rateHz));
+        while (!m_stop)
+        {
+          std::this_thread::sleep_until(next);
+          next += period;
+          for (uint32_t stream = 0; stream < streamCount; ++stream)
+          {
+            Header header = { type, stream, Now(), payloadBytes };
+            if (!SendAll(m_socket, &header, sizeof(header)) || !SendAll(m_socket, payload.data(), payload.size()))
+            {
+              return;
+            }
+          }
+        }
+      });
+    }
+
+    ~Sender()
+    {
+      m_stop = true;
+      m_thread.join();
+      close(m_socket);
+    }
+
+  protected:
+    int                 m_socket;
+    std::atomic_bool    m_stop { false };
+    std::thread         m_thread;
+  };
+
+  // Stands in for the IGT client of one connector: decodes every message on its socket thread, keeps only the latest
+  // of each stream, and can only be polled
+  class LoopbackClient
+  {
+  public:
+    explicit LoopbackClient(int socketHandle)
+      : m_socket(socketHandle)
+    {
+      m_thread = std::thread([this]()
+      {
+        Header header;
+        std::vector<uint8_t> payload;
+        while (ReceiveAll(m_socket, &header, sizeof(header)))
+        {
+          payload.resize(header.Size);
+          if (!ReceiveAll(m_socket, payload.data(), payload.size()))
+          {
+            return;
+          }
+          std::lock_guard<std::mutex> guard(m_mutex);
+          Latest& latest = m_latest[header.Stream];
+          latest.Timestamp = header.Timestamp;
+          latest.Payload.swap(payload);
+        }
+      });
+    }
+
+    ~LoopbackClient()
+    {
+      shutdown(m_socket, SHUT_RDWR);
+      m_thread.join();
+      close(m_socket);
+    }
+
+    /// Copies the latest message of stream if it is newer than inOutTimestamp, as IGTClient::GetTransform/GetImage do
+    bool GetLatest(uint32_t stream, double& inOutTimestamp, std::vector<uint8_t>& outPayload)
+    {
+      std::lock_guard<std::mutex> guard(m_mutex);
+      auto iter = m_latest.find(stream);
+      if (iter == m_latest.end() || iter->second.Timestamp <= inOutTimestamp)
+      {
+        return false;
+      }
+      inOutTimestamp = iter->second.Timestamp;
+      outPayload = iter->second.Payload;
+      return true;
+    }
+
+  protected:
+    struct Latest
+    {
+      double                  Timestamp = 0.0;
+      std::vector<uint8_t>    Payload;
+    };
+
+    int                               m_socket;
+    std::mutex                        m_mutex;
+    std::map<uint32_t, Latest>        m_latest;
+    std::thread                       m_thread;
+  };
+
+  struct Pulled
+  {
+    MessageType   Type = MESSAGE_TRANSFORM;
+    double        Timestamp = 0.0;
+  };
+
+  struct Stream
+  {
+    LoopbackClient*     Client = nullptr;
+    uint32_t            Id = 0;
+    MessageType         Type = MESSAGE_TRANSFORM;
+    double              LatestTimestamp = 0.0;
+    ArrivalEstimator    Arrival;
+  };
+
+  struct Worker
+  {
+    Worker() : TransformQueue(TRANSFORM_QUEUE_CAPACITY), FrameQueue(FRAME_QUEUE_CAPACITY) {}
+
+    SpscQueue<Pulled>         TransformQueue;
+    SpscQueue<Pulled>         FrameQueue;
+    std::vector<Stream>       Streams;      // Transforms first
+    std::thread               Thread;
+    uint64_t                  Wakeups = 0;
+    double                    CpuSec = 0.0;
+  };
+
+  struct Result
+  {
+    LatencyHistogram    Transforms;
+    LatencyHistogram    Images;
+    double              WakeupsPerSec = 0.0;
+    double              CpuMsecPerSec = 0.0;
+  };
+
+  //----------------------------------------------------------------------------
+  Result Run(bool dedicated, bool paced, double durationSec)
+  {
+    int trackerSender(-1);
+    int trackerReceiver(-1);
+    int imagingSender(-1);
+    int imagingReceiver(-1);
+    Result result;
+    if (!MakeLoopbackPair(trackerSender, trackerReceiver) || !MakeLoopbackPair(imagingSender, imagingReceiver))
+    {
+      printf("Unable to open loopback connections\n");
+      return result;
+    }
+
+    LoopbackClient trackerClient(trackerReceiver);
+    LoopbackClient imagingClient(imagingReceiver);
+    // On the stack, the queues are cache line aligned
+    Worker workerStorage[2];
+    std::vector<Worker*> workers;
+    workers.push_back(&workerStorage[0]);
+    for (uint32_t i = 0; i < TRANSFORM_COUNT; ++i)
+    {
+      Stream stream;
+      stream.Client = &trackerClient;
+      stream.Id = i;
+      workers.back()->Streams.push_back(stream);
+    }
+    if (dedicated)
+    {
+      workers.push_back(&workerStorage[1]);
+    }
+    Stream imageStream;
+    imageStream.Client = &imagingClient;
+    imageStream.Type = MESSAGE_IMAGE;
+    workers.back()->Streams.push_back(imageStream);
+
+    std::atomic_bool stop(false);
+    std::mutex dispatchMutex;
+    std::condition_variable dispatchCondition;
+    bool dispatchSignalled(false);
+    std::mutex wakeMutex;
+    std::condition_variable wakeCondition;
+
+    for (Worker* worker : workers)
+    {
+      worker->Thread = std::thread([&, worker]()
+      {
+        std::vector<uint8_t> payload;
+        while (!stop)
+        {
+          worker->Wakeups++;
+          const double now = Now();
+          bool received(false);
+          for (auto& stream : worker->Streams)
+          {
+            auto& queue = stream.Type == MESSAGE_TRANSFORM ? worker->TransformQueue : worker->FrameQueue;
+            if (!queue.IsFull() && stream.Client->GetLatest(stream.Id, stream.LatestTimestamp, payload))
+            {
+              stream.Arrival.OnPulled(now, stream.LatestTimestamp);
+              Pulled pulled;
+              pulled.Type = stream.Type;
+              pulled.Timestamp = stream.LatestTimestamp;
+              queue.TryPush(pulled);
+              received = true;
+            }
+          }
+
+          if (received)
+          {
+            {
+              std::lock_guard<std::mutex> guard(dispatchMutex);
+              dispatchSignalled = true;
+            }
+            dispatchCondition.notify_one();
+            continue;
+          }
+
+          if (!paced)
+          {
+            std::this_thread::sleep_for(std::chrono::milliseconds(FIXED_SLEEP_MSEC));
+            continue;
+          }
+          double wakeSec = now + MAX_WAIT_SEC;
+          for (auto& stream : worker->Streams)
+          {
+            wakeSec = std::min(wakeSec, stream.Arrival.GetNextCheckSec(now));
+          }
+          std::unique_lock<std::mutex> lock(wakeMutex);
+          wakeCondition.wait_until(lock, Clock::time_point(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(wakeSec))), [&stop]()
+          {
+            return stop.load();
+          });
+        }
+        worker->CpuSec = GetThreadCpuSec();
+      });
+    }
+
+    // Dispatch, every pending transform before the next frame
+    std::thread dispatcher([&]()
+    {
+      Pulled pulled;
+      while (true)
+      {
+        {
+          std::unique_lock<std::mutex> lock(dispatchMutex);
+          dispatchCondition.wait(lock, [&]()
+          {
+            return dispatchSignalled || stop;
+          });
+          if (stop)
+          {
+            return;
+          }
+          dispatchSignalled = false;
+        }
+
+        bool published(true);
+        while (published)
+        {
+          published = false;
+          for (Worker* worker : workers)
+          {
+            while (worker->TransformQueue.TryPop(pulled))
+            {
+              result.Transforms.Record(Now() - pulled.Timestamp);
+              published = true;
+            }
+          }
+          for (Worker* worker : workers)
+          {
+            if (worker->FrameQueue.TryPop(pulled))
+            {
+              result.Images.Record(Now() - pulled.Timestamp);
+              published = true;
+            }
+          }
+        }
+      }
+    });
+
+    PortableTests::Stopwatch stopwatch;
+    {
+      Sender tracker(trackerSender, MESSAGE_TRANSFORM, TRANSFORM_COUNT, TRANSFORM_BYTES, TRACKER_RATE_HZ);
+      Sender imaging(imagingSender, MESSAGE_IMAGE, 1, IMAGE_BYTES, IMAGE_RATE_HZ);
+      std::this_thread::sleep_for(std::chrono::duration<double>(durationSec));
+    }
+    const double elapsedSec = stopwatch.GetElapsedSec();
+
+    {
+      std::lock_guard<std::mutex> guard(wakeMutex);
+      stop = true;
+    }
+    wakeCondition.notify_all();
+    for (Worker* worker : workers)
+    {
+      worker->Thread.join();
+      result.WakeupsPerSec += worker->Wakeups / elapsedSec;
+      result.CpuMsecPerSec += worker->CpuSec / elapsedSec * 1e3;
+    }
+    {
+      std::lock_guard<std::mutex> guard(dispatchMutex);
+    }
+    dispatchCondition.notify_one();
+    dispatcher.join();
+    return result;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const double durationSec = argc > 1 ? std::max(0.2, atof(argv[1])) : 2.0;
+
+  printf("%u hardware threads, %u transforms at %.0f Hz and %zu byte images at %.0f Hz over loopback TCP\n", std::thread::hardware_concurrency(), TRANSFORM_COUNT, TRACKER_RATE_HZ,
+         IMAGE_BYTES, IMAGE_RATE_HZ);
+  printf("%-10s %-8s %12s %12s %12s %12s %10s %12s\n", "receive", "idle", "xform p50", "xform p99", "xform max", "image p50", "wakeups/s", "CPU ms per s");
+  for (bool dedicated : { false, true })
+  {
+    for (bool paced : { false, true })
+    {
+      Result result = Run(dedicated, paced, durationSec);
+      printf("%-10s %-8s %9.3f ms %9.3f ms %9.3f ms %9.3f ms %10.0f %12.2f\n", dedicated ? "dedicated" : "shared", paced ? "paced" : "1 ms", result.Transforms.GetPercentile(50.0) * 1e3,
+             result.Transforms.GetPercentile(99.0) * 1e3, result.Transforms.GetMax() * 1e3, result.Images.GetPercentile(50.0) * 1e3, result.WakeupsPerSec, result.CpuMsecPerSec);
+    }
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,309 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Drives ReconnectScheduler the way NetworkSystem does, once per frame, against a loopback server that goes up and down on demand
+// Connects are real TCP connects to 127.0.0.1, a drop is seen when the server closes its end
+
+// Local includes
+#include "pch.h"
+#include "ReconnectScheduler.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+// OS includes
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace HoloIntervention::Network;
+
+namespace
+{
+  const uint64_t CONNECTION_ID = 42;
+
+  //----------------------------------------------------------------------------
+  sockaddr_in GetLoopbackAddress(uint16_t port)
+  {
+    sockaddr_in socketAddress = {};
+    socketAddress.sin_family = AF_INET;
+    socketAddress.sin_port = htons(port);
+    socketAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    return socketAddress;
+  }
+
+  // Listens on a fixed loopback port while up, going down closes the listener and every accepted connection
+  class FlappingServer
+  {
+  public:
+    ~FlappingServer()
+    {
+      SetUp(false);
+    }
+
+    bool SetUp(bool up)
+    {
+      if (!up)
+      {
+        for (int connection : m_connections)
+        {
+          close(connection);
+        }
+        m_connections.clear();
+        if (m_listener >= 0)
+        {
+          close(m_listener);
+          m_listener = -1;
+        }
+        return true;
+      }
+
+      m_listener = socket(AF_INET, SOCK_STREAM, 0);
+      int reuse(1);
+      setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+      sockaddr_in socketAddress = GetLoopbackAddress(m_port);
+      socklen_t length = sizeof(socketAddress);
+      if (bind(m_listener, reinterpret_cast<sockaddr*>(&socketAddress), length) != 0 ||
+          listen(m_listener, 4) != 0 ||
+          getsockname(m_listener, reinterpret_cast<sockaddr*>(&socketAddress), &length) != 0)
+      {
+        close(m_listener);
+        m_listener = -1;
+        return false;
+      }
+      fcntl(m_listener, F_SETFL, fcntl(m_listener, F_GETFL, 0) | O_NONBLOCK);
+      m_port = ntohs(socketAddress.sin_port);
+      return true;
+    }
+
+    void Accept()
+    {
+      int connection(-1);
+      while (m_listener >= 0 && (connection = accept(m_listener, nullptr, nullptr)) >= 0)
+      {
+        m_connections.push_back(connection);
+      }
+    }
+
+    uint16_t GetPort() const
+    {
+      return m_port;
+    }
+
+  protected:
+    int                 m_listener = -1;
+    uint16_t            m_port = 0;       // Chosen by the first SetUp(true), reused afterwards
+    std::vector<int>    m_connections;
+  };
+
+  // One connector and the per-frame logic NetworkSystem::Update runs for it
+  class Harness
+  {
+  public:
+    Harness()
+    {
+      ReconnectScheduler::Settings settings;
+      settings.InitialDelaySec = 0.01;
+      settings.MaxDelaySec = 0.08;
+      settings.BackoffMultiplier = 2.0;
+      settings.JitterRatio = 0.25;
+      settings.FailureThreshold = 6;
+      settings.CircuitOpenSec = 0.4;
+      Scheduler.SetSettings(settings);
+    }
+
+    ~Harness()
+    {
+      if (m_client >= 0)
+      {
+        close(m_client);
+      }
+    }
+
+    bool Connect()
+    {
+      m_client = socket(AF_INET, SOCK_STREAM, 0);
+      sockaddr_in socketAddress = GetLoopbackAddress(Server.GetPort());
+      if (connect(m_client, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0)
+      {
+        m_lastError = strerror(errno);
+        close(m_client);
+        m_client = -1;
+        return false;
+      }
+      return true;
+    }
+
+    bool IsConnected() const
+    {
+      return m_client >= 0;
+    }
+
+    void Frame()
+    {
+      Server.Accept();
+
+      if (m_client >= 0)
+      {
+        char byte;
+        if (recv(m_client, &byte, 1, MSG_PEEK | MSG_DONTWAIT) == 0)
+        {
+          close(m_client);
+          m_client = -1;
+          Scheduler.OnConnectionLost(CONNECTION_ID);
+        }
+      }
+
+      for (auto id : Scheduler.Tick())
+      {
+        if (Connect())
+        {
+          Scheduler.OnConnected(id);
+        }
+        else
+        {
+          Scheduler.OnConnectFailed(id, m_lastError);
+        }
+      }
+
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    /// Run frames for durationSec
+    void Run(double durationSec)
+    {
+      PortableTests::Stopwatch stopwatch;
+      while (stopwatch.GetElapsedSec() < durationSec)
+      {
+        Frame();
+      }
+    }
+
+    /// Run frames until done returns true, false if timeoutSec passes first
+    bool RunUntil(const std::function<bool()>& done, double timeoutSec)
+    {
+      PortableTests::Stopwatch stopwatch;
+      while (!done())
+      {
+        if (stopwatch.GetElapsedSec() > timeoutSec)
+        {
+          return false;
+        }
+        Frame();
+      }
+      return true;
+    }
+
+    ReconnectScheduler::Metrics GetMetrics() const
+    {
+      ReconnectScheduler::Metrics metrics;
+      Scheduler.GetMetrics(CONNECTION_ID, metrics);
+      return metrics;
+    }
+
+  public:
+    FlappingServer        Server;
+    ReconnectScheduler    Scheduler;
+
+  protected:
+    int                   m_client = -1;
+    std::string           m_lastError;
+  };
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  Harness harness;
+  if (!CHECK(harness.Server.SetUp(true)) || !CHECK(harness.Connect()))
+  {
+    return PortableTests::Finish("ReconnectSchedulerTest");
+  }
+  harness.Scheduler.OnConnected(CONNECTION_ID);
+
+  // Short outage, retries back off instead of firing every frame
+  harness.Server.SetUp(false);
+  harness.Run(0.25);
+  ReconnectScheduler::Metrics metrics = harness.GetMetrics();
+  CHECK(!harness.IsConnected());
+  CHECK(metrics.State == ReconnectScheduler::RECONNECT_STATE_BACKOFF);
+  CHECK(metrics.Attempts >= 2 && metrics.Attempts <= 8);
+  CHECK(metrics.Failures == metrics.Attempts);
+  CHECK(metrics.CircuitOpenings == 0);
+  CHECK(!metrics.LastError.empty());
+  std::printf("Outage of 0.25 s: %llu attempts (%s)\n", static_cast<unsigned long long>(metrics.Attempts), metrics.LastError.c_str());
+
+  harness.Server.SetUp(true);
+  CHECK(harness.RunUntil([&harness]() { return harness.IsConnected(); }, 0.5));
+  metrics = harness.GetMetrics();
+  CHECK(metrics.State == ReconnectScheduler::RECONNECT_STATE_IDLE);
+  CHECK(metrics.Reconnects == 1);
+  CHECK(metrics.ConsecutiveFailures == 0);
+  CHECK(metrics.LastTimeToReconnectSec >= 0.2);
+  std::printf("Reconnected after %.3f s\n", metrics.LastTimeToReconnectSec);
+
+  // Long outage, the circuit opens and nothing is attempted while it cools off
+  harness.Server.SetUp(false);
+  CHECK(harness.RunUntil([&harness]() { return harness.GetMetrics().State == ReconnectScheduler::RECONNECT_STATE_CIRCUIT_OPEN; }, 2.0));
+  const uint64_t attemptsAtOpen = harness.GetMetrics().Attempts;
+  harness.Run(0.2);
+  metrics = harness.GetMetrics();
+  CHECK(metrics.State == ReconnectScheduler::RECONNECT_STATE_CIRCUIT_OPEN);
+  CHECK(metrics.Attempts == attemptsAtOpen);
+  CHECK(metrics.CircuitOpenings == 1);
+
+  // A single trial attempt once the cool-off ends recovers the connection
+  harness.Server.SetUp(true);
+  CHECK(harness.RunUntil([&harness]() { return harness.IsConnected(); }, 1.0));
+  metrics = harness.GetMetrics();
+  CHECK(metrics.Attempts == attemptsAtOpen + 1);
+  CHECK(metrics.Reconnects == 2);
+  CHECK(metrics.State == ReconnectScheduler::RECONNECT_STATE_IDLE);
+  std::printf("Circuit opened after %llu attempts, recovered after %.3f s\n", static_cast<unsigned long long>(attemptsAtOpen), metrics.LastTimeToReconnectSec);
+
+  // Rapid flapping, every drop is recovered and none of them opens the circuit
+  const int flapCount = 5;
+  for (int i = 0; i < flapCount; ++i)
+  {
+    harness.Server.SetUp(false);
+    harness.Run(0.05);
+    harness.Server.SetUp(true);
+    CHECK(harness.RunUntil([&harness]() { return harness.IsConnected(); }, 0.5));
+  }
+  metrics = harness.GetMetrics();
+  CHECK(metrics.Reconnects == 2 + flapCount);
+  CHECK(metrics.CircuitOpenings == 1);
+  CHECK(metrics.MaxTimeToReconnectSec >= metrics.LastTimeToReconnectSec);
+  std::printf("%d flaps: %llu attempts in total, worst time to reconnect %.3f s\n", flapCount, static_cast<unsigned long long>(metrics.Attempts), metrics.MaxTimeToReconnectSec);
+
+  return PortableTests::Finish("ReconnectSchedulerTest");
+}
\ No newline at end of file
@@ -0,0 +1,160 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Runs ServerDiscovery against listeners on loopback addresses
+// Linux routes all of 127.0.0.0/8 to the loopback interface, so 127.0.0.1 stands in for a local address on a /24 subnet
+// with servers at three other hosts, and every other host refuses immediately
+
+// Local includes
+#include "pch.h"
+#include "ServerDiscovery.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <vector>
+
+// OS includes
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace HoloIntervention::Network;
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Returns the listening socket, or -1. A port of 0 picks a free one, which is returned in port
+  int Listen(const char* address, uint16_t& port)
+  {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int reuse(1);
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in socketAddress = {};
+    socketAddress.sin_family = AF_INET;
+    socketAddress.sin_port = htons(port);
+    inet_pton(AF_INET, address, &socketAddress.sin_addr);
+    socklen_t length = sizeof(socketAddress);
+    if (bind(listener, reinterpret_cast<sockaddr*>(&socketAddress), length) != 0 ||
+        listen(listener, 16) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&socketAddress), &length) != 0)
+    {
+      close(listener);
+      return -1;
+    }
+    port = ntohs(socketAddress.sin_port);
+    return listener;
+  }
+
+  //----------------------------------------------------------------------------
+  bool IsRanked(const ServerDiscovery::ServerList& servers)
+  {
+    return std::is_sorted(servers.begin(), servers.end(), [](const DiscoveredServer & a, const DiscoveredServer & b)
+    {
+      return a.ResponseTimeSec < b.ResponseTimeSec;
+    });
+  }
+
+  //----------------------------------------------------------------------------
+  std::vector<std::string> GetAddresses(const ServerDiscovery::ServerList& servers)
+  {
+    std::vector<std::string> addresses;
+    for (auto& server : servers)
+    {
+      addresses.push_back(server.Address);
+    }
+    std::sort(addresses.begin(), addresses.end());
+    return addresses;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  uint16_t port(0);
+  std::vector<int> listeners;
+  for (auto address : { "127.0.0.10", "127.0.0.77", "127.0.0.200" })
+  {
+    listeners.push_back(Listen(address, port));
+    if (!CHECK(listeners.back() >= 0))
+    {
+      return PortableTests::Finish("ServerDiscoveryTest");
+    }
+  }
+  const std::vector<std::string> expected = { "127.0.0.10", "127.0.0.200", "127.0.0.77" };
+
+  // Two local addresses on the same subnet, which is probed and reported once
+  const std::vector<std::string> localAddresses = { "127.0.0.1", "127.0.0.1" };
+
+  ServerDiscovery discovery;
+  ServerDiscovery::ServerList servers;
+  PortableTests::Stopwatch stopwatch;
+  CHECK(discovery.DiscoverSubnets(localAddresses, port, servers));
+  const double probeSec = stopwatch.GetElapsedSec();
+  CHECK(GetAddresses(servers) == expected);
+  CHECK(IsRanked(servers));
+  CHECK(probeSec < 3.0);
+  std::printf("Probed 253 hosts in %.3f s, found %zu servers\n", probeSec, servers.size());
+
+  // Cached, no probing and still one entry per server
+  servers.clear();
+  stopwatch.Restart();
+  CHECK(discovery.DiscoverSubnets(localAddresses, port, servers));
+  const double cachedSec = stopwatch.GetElapsedSec();
+  CHECK(GetAddresses(servers) == expected);
+  CHECK(cachedSec < 0.05);
+  std::printf("Cached lookup in %.6f s\n", cachedSec);
+
+  // A discovery requested before a Cancel does nothing, even when it only starts afterwards
+  discovery.InvalidateCache();
+  const uint64_t generation = discovery.GetGeneration();
+  std::thread cancel([&discovery]()
+  {
+    discovery.Cancel();
+  });
+  cancel.join();
+  servers.clear();
+  CHECK(!discovery.DiscoverSubnets(localAddresses, port, servers, false, generation));
+  CHECK(servers.empty());
+
+  // A cancelled discovery is not cached, the next one probes again
+  servers.clear();
+  CHECK(discovery.DiscoverSubnets(localAddresses, port, servers));
+  CHECK(GetAddresses(servers) == expected);
+
+  // Closed listeners are found again once the cache is bypassed
+  close(listeners[1]);
+  servers.clear();
+  CHECK(discovery.DiscoverSubnets(localAddresses, port, servers, true));
+  CHECK(GetAddresses(servers) == std::vector<std::string>({ "127.0.0.10", "127.0.0.200" }));
+
+  close(listeners[0]);
+  close(listeners[2]);
+  return PortableTests::Finish("ServerDiscoveryTest");
+}
\ No newline at end of file
@@ -0,0 +1,258 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+
+// Polling against push delivery for 10 to 1000 tools tracked at 40 and 100 Hz, in real time
+// A tracker thread stands in for the OpenIGTLink client and updates every tool each period. Consumers see the poses
+//   poll frame  every 60 Hz frame, a lock and a name lookup per tool, as ToolSystem polled NetworkSystem
+//   poll 100 ms every 100 ms, as task loops polling with sleep(100) did
+//   mailbox     every 60 Hz frame, a SubscriptionHub mailbox per tool
+//   callback    on arrival, a SubscriptionHub callback per tool run by the publishing thread
+// Reports the consumer's busy time per second (for callbacks, the time spent publishing), the share of reads that
+// found nothing new, the share of tracker updates the consumer saw and the age of each new pose when it first saw it.
+//   SubscriptionBenchmark [seconds per run, default 1]
+
+// Local includes
+#include "pch.h"
+#include "SubscriptionHub.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace HoloIntervention::Network;
+
+namespace
+{
+  typedef std::chrono::steady_clock Clock;
+
+  const double FRAME_RATE_HZ = 60.0;
+  const double TASK_POLL_INTERVAL_SEC = 0.1;
+
+  enum Mode
+  {
+    MODE_POLL_FRAME,
+    MODE_POLL_TASK,
+    MODE_MAILBOX,
+    MODE_CALLBACK
+  };
+
+  struct Pose
+  {
+    float     Matrix[16];
+    double    Timestamp;
+  };
+
+  struct Result
+  {
+    double    BusyMsecPerSec = 0.0;
+    double    UnchangedShare = 0.0;
+    double    SeenShare = 0.0;
+    double    MeanAgeMsec = 0.0;
+  };
+
+  //----------------------------------------------------------------------------
+  double Now()
+  {
+    return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+  }
+
+  //----------------------------------------------------------------------------
+  uint64_t ToolKey(int index)
+  {
+    return 0x9e3779b97f4a7c15ull * (index + 1);
+  }
+
+  //----------------------------------------------------------------------------
+  Result Run(Mode mode, int toolCount, double trackerRateHz, double durationSec)
+  {
+    // Client side store for polling, one lock per read and per write
+    std::mutex storeMutex;
+    std::unordered_map<uint64_t, Pose> store;
+    for (int i = 0; i < toolCount; ++i)
+    {
+      store[ToolKey(i)] = Pose();
+    }
+
+    SubscriptionHub<Pose> hub;
+    std::vector<SubscriptionHub<Pose>::MailboxPtr> mailboxes(toolCount);
+    std::vector<double> lastSeen(toolCount, 0.0);
+    uint64_t published(0);
+    uint64_t reads(0);
+    uint64_t unchanged(0);
+    uint64_t updates(0);
+    double ageSum(0.0);
+    double busySec(0.0);
+
+    for (int i = 0; i < toolCount; ++i)
+    {
+      if (mode == MODE_MAILBOX)
+      {
+        hub.Subscribe(ToolKey(i), mailboxes[i]);
+      }
+      else if (mode == MODE_CALLBACK)
+      {
+        hub.Subscribe(ToolKey(i), [&](const Pose&, double timestamp)
+        {
+          reads++;
+          updates++;
+          ageSum += Now() - timestamp;
+        });
+      }
+    }
+
+    std::atomic_bool started(false);
+    std::atomic_bool stop(false);
+    std::thread tracker([&]()
+    {
+      auto next = Clock::now();
+      const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / trackerRateHz));
+      Pose pose = {};
+      while (!stop)
+      {
+        std::this_thread::sleep_until(next);
+        next += period;
+        for (int i = 0; i < toolCount; ++i)
+        {
+          pose.Matrix[3] = static_cast<float>(i);
+          pose.Timestamp = Now();
+          if (mode == MODE_POLL_FRAME || mode == MODE_POLL_TASK)
+          {
+            std::lock_guard<std::mutex> guard(storeMutex);
+            store[ToolKey(i)] = pose;
+          }
+          else
+          {
+            const double start = Now();
+            hub.Publish(ToolKey(i), pose, pose.Timestamp);
+            if (mode == MODE_CALLBACK)
+            {
+              busySec += Now() - start;
+            }
+          }
+        }
+        published += toolCount;
+        started = true;
+      }
+    });
+
+    // Consumers start once every tool has a pose
+    while (!started)
+    {
+      std::this_thread::yield();
+    }
+
+    PortableTests::Stopwatch stopwatch;
+    if (mode != MODE_CALLBACK)
+    {
+      auto next = Clock::now();
+      const double intervalSec = mode == MODE_POLL_TASK ? TASK_POLL_INTERVAL_SEC : 1.0 / FRAME_RATE_HZ;
+      const auto period = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(intervalSec));
+      while (stopwatch.GetElapsedSec() < durationSec)
+      {
+        std::this_thread::sleep_until(next);
+        next += period;
+
+        const double start = Now();
+        for (int i = 0; i < toolCount; ++i)
+        {
+          Pose pose;
+          reads++;
+          if (mode == MODE_MAILBOX)
+          {
+            Mailbox<Pose>::Entry entry;
+            if (!mailboxes[i]->TryTake(entry))
+            {
+              unchanged++;
+              continue;
+            }
+            pose = entry.Payload;
+          }
+          else
+          {
+            std::lock_guard<std::mutex> guard(storeMutex);
+            pose = store.find(ToolKey(i))->second;
+          }
+          if (pose.Timestamp == lastSeen[i])
+          {
+            unchanged++;
+            continue;
+          }
+          lastSeen[i] = pose.Timestamp;
+          updates++;
+          ageSum += Now() - pose.Timestamp;
+        }
+        busySec += Now() - start;
+      }
+    }
+    else
+    {
+      std::this_thread::sleep_for(std::chrono::duration<double>(durationSec));
+    }
+    stop = true;
+    tracker.join();
+    const double elapsedSec = stopwatch.GetElapsedSec();
+
+    Result result;
+    result.BusyMsecPerSec = busySec / elapsedSec * 1e3;
+    result.UnchangedShare = reads == 0 ? 0.0 : static_cast<double>(unchanged) / reads;
+    result.SeenShare = published == 0 ? 0.0 : static_cast<double>(updates) / published;
+    result.MeanAgeMsec = updates == 0 ? 0.0 : ageSum / updates * 1e3;
+    return result;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const double durationSec = argc > 1 ? std::max(0.1, atof(argv[1])) : 1.0;
+  const Mode modes[] = { MODE_POLL_FRAME, MODE_POLL_TASK, MODE_MAILBOX, MODE_CALLBACK };
+  const char* names[] = { "poll frame", "poll 100 ms", "mailbox", "callback" };
+
+  printf("%u hardware threads\n", std::thread::hardware_concurrency());
+  printf("%8s %6s %-12s %14s %10s %6s %12s\n", "tracker", "tools", "consumer", "busy ms per s", "unchanged", "seen", "mean age ms");
+  for (double trackerRateHz : { 40.0, 100.0 })
+  {
+    for (int toolCount : { 10, 100, 1000 })
+    {
+      for (int i = 0; i < 4; ++i)
+      {
+        Result result = Run(modes[i], toolCount, trackerRateHz, durationSec);
+        printf("%5.0f Hz %6d %-12s %14.3f %9.0f%% %5.0f%% %12.2f\n", trackerRateHz, toolCount, names[i], result.BusyMsecPerSec, result.UnchangedShare * 100.0,
+               result.SeenShare * 100.0, result.MeanAgeMsec);
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
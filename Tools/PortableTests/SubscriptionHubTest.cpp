@@ -0,0 +1,285 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Publishes to a slow and a fast callback subscriber through an executor, and checks that the slow one is coalesced
+// to the latest message without holding up the publisher or the fast subscriber. Also checks that a callback that
+// throws is called again on the next message, and that unsubscribing stops delivery. Mailboxes that fetch on read must
+// return the source's latest message, never go back in time, and see samples no older than the source's own period.
+
+// Local includes
+#include "pch.h"
+#include "SubscriptionHub.h"
+#include "TestCommon.h"
+
+// STL includes
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace HoloIntervention::Network;
+
+namespace
+{
+  const uint64_t SLOW_KEY = 1;
+  const uint64_t FAST_KEY = 2;
+  const int MESSAGE_COUNT = 40;
+  const double SOURCE_RATE_HZ = 1000.0;
+  const double CONSUMER_RATE_HZ = 60.0;
+  const size_t CONSUMER_READS = 30;
+  const double MAX_MEDIAN_AGE_SEC = 0.003;   // Dispatch cadence would leave the sample about a frame (16 ms) old
+
+  //----------------------------------------------------------------------------
+  double Now()
+  {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  //----------------------------------------------------------------------------
+  bool WaitFor(const std::atomic<int>& value, int expected, double timeoutSec)
+  {
+    PortableTests::Stopwatch stopwatch;
+    while (value.load() != expected && stopwatch.GetElapsedSec() < timeoutSec)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return value.load() == expected;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  // Without an executor callbacks run on the publishing thread
+  {
+    SubscriptionHub<int> hub;
+    int received(-1);
+    hub.Subscribe(FAST_KEY, [&received](const int& payload, double) { received = payload; });
+    CHECK(hub.Publish(FAST_KEY, 7, 0.0) == 1);
+    CHECK(received == 7);
+  }
+
+  // A callback that throws is not left in flight, the next message reaches it
+  {
+    SubscriptionHub<int> hub;
+    int calls(0);
+    uint64_t token = hub.Subscribe(FAST_KEY, [&calls](const int& payload, double)
+    {
+      calls++;
+      if (payload == 0)
+      {
+        throw std::runtime_error("Rejected");
+      }
+    });
+
+    bool thrown(false);
+    try
+    {
+      hub.Publish(FAST_KEY, 0, 0.0);
+    }
+    catch (const std::runtime_error&)
+    {
+      thrown = true;
+    }
+    CHECK(thrown);
+    CHECK(hub.Publish(FAST_KEY, 1, 0.001) == 1);
+    CHECK(calls == 2);
+
+    uint64_t delivered(0);
+    uint64_t coalesced(0);
+    CHECK(hub.GetSubscriberCounts(token, delivered, coalesced) && delivered == 1);
+
+    uint64_t key(0);
+    CHECK(hub.Unsubscribe(token, key) && key == FAST_KEY);
+    CHECK(!hub.HasSubscribers(FAST_KEY));
+    CHECK(hub.Publish(FAST_KEY, 2, 0.002) == 0);
+    CHECK(!hub.Unsubscribe(token, key));
+    CHECK(calls == 2);
+  }
+
+  // With an executor a slow callback only delays its own stream
+  {
+    SubscriptionHub<int> hub;
+    hub.SetExecutor([](std::function<void()> work)
+    {
+      std::thread(work).detach();
+    });
+
+    std::atomic<int> slowLatest(-1);
+    std::atomic<int> slowCalls(0);
+    std::atomic<int> fastLatest(-1);
+    std::atomic<int> fastCalls(0);
+    uint64_t slowToken = hub.Subscribe(SLOW_KEY, [&](const int& payload, double)
+    {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+      slowLatest = payload;
+      slowCalls++;
+    });
+    uint64_t fastToken = hub.Subscribe(FAST_KEY, [&](const int& payload, double)
+    {
+      fastLatest = payload;
+      fastCalls++;
+    });
+
+    PortableTests::Stopwatch stopwatch;
+    for (int i = 0; i < MESSAGE_COUNT; ++i)
+    {
+      hub.Publish(SLOW_KEY, i, i * 0.001);
+      hub.Publish(FAST_KEY, i, i * 0.001);
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const double publishSec = stopwatch.GetElapsedSec();
+
+    // The publisher never waited for the slow callback
+    CHECK(publishSec < 0.5);
+    CHECK(WaitFor(fastLatest, MESSAGE_COUNT - 1, 1.0));
+    CHECK(slowCalls.load() < 5);
+
+    // The slow subscriber ends on the latest message, everything in between was coalesced
+    CHECK(WaitFor(slowLatest, MESSAGE_COUNT - 1, 2.0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    uint64_t delivered(0);
+    uint64_t coalesced(0);
+    CHECK(hub.GetSubscriberCounts(slowToken, delivered, coalesced));
+    CHECK(delivered == static_cast<uint64_t>(slowCalls.load()));
+    CHECK(delivered + coalesced + 1 >= MESSAGE_COUNT);
+    CHECK(coalesced > MESSAGE_COUNT / 2);
+    CHECK(hub.GetSubscriberCounts(fastToken, delivered, coalesced));
+    CHECK(delivered == static_cast<uint64_t>(fastCalls.load()));
+  }
+
+  // Mailboxes only hold the latest message
+  {
+    SubscriptionHub<int> hub;
+    SubscriptionHub<int>::MailboxPtr mailbox;
+    hub.Subscribe(FAST_KEY, mailbox);
+    for (int i = 0; i < MESSAGE_COUNT; ++i)
+    {
+      hub.Publish(FAST_KEY, i, i * 0.001);
+    }
+    CHECK(!hub.AllSubscribersFetch(FAST_KEY));
+    Mailbox<int>::Entry entry;
+    CHECK(mailbox->TryTake(entry) && entry.Payload == MESSAGE_COUNT - 1);
+    CHECK(!mailbox->TryTake(entry));
+    CHECK(mailbox->GetCoalescedCount() == MESSAGE_COUNT - 1);
+  }
+
+  // Fetching mailboxes read the source, posted messages older than what was fetched are dropped
+  {
+    int sourceLatest(5);
+    auto fetch = [&sourceLatest](double latestTimestamp, Mailbox<int>::Entry & outEntry)
+    {
+      if (sourceLatest * 0.001 <= latestTimestamp)
+      {
+        return false;
+      }
+      outEntry.Payload = sourceLatest;
+      outEntry.Timestamp = sourceLatest * 0.001;
+      return true;
+    };
+    SubscriptionHub<int> hub;
+    SubscriptionHub<int>::MailboxPtr mailbox;
+    uint64_t token = hub.Subscribe(FAST_KEY, mailbox, fetch);
+    CHECK(hub.AllSubscribersFetch(FAST_KEY));
+
+    Mailbox<int>::Entry entry;
+    hub.Publish(FAST_KEY, 3, 0.003);
+    CHECK(mailbox->TryTake(entry) && entry.Payload == 5 && entry.Sequence == 0);
+    CHECK(!mailbox->TryTake(entry));
+    hub.Publish(FAST_KEY, 4, 0.004);
+    CHECK(!mailbox->TryTake(entry));
+    hub.Publish(FAST_KEY, 7, 0.007);
+    CHECK(mailbox->TryTake(entry) && entry.Payload == 7 && entry.Sequence == 3);
+    sourceLatest = 9;
+    CHECK(mailbox->TryTake(entry) && entry.Payload == 9);
+    CHECK(mailbox->GetFetchedCount() == 2);
+
+    uint64_t delivered(0);
+    uint64_t coalesced(0);
+    CHECK(hub.GetSubscriberCounts(token, delivered, coalesced) && delivered == 5);
+
+    SubscriptionHub<int>::MailboxPtr plainMailbox;
+    hub.Subscribe(FAST_KEY, plainMailbox);
+    CHECK(!hub.AllSubscribersFetch(FAST_KEY));
+  }
+
+  // Sample age seen by a 60 Hz consumer of a 1 kHz source, nothing is ever published
+  {
+    std::mutex sourceMutex;
+    double sourceTimestamp(0.0);
+    std::atomic_bool stop(false);
+    std::thread source([&]()
+    {
+      auto next = std::chrono::steady_clock::now();
+      const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / SOURCE_RATE_HZ));
+      while (!stop)
+      {
+        std::this_thread::sleep_until(next);
+        next += period;
+        std::lock_guard<std::mutex> guard(sourceMutex);
+        sourceTimestamp = Now();
+      }
+    });
+
+    SubscriptionHub<int> hub;
+    SubscriptionHub<int>::MailboxPtr mailbox;
+    hub.Subscribe(SLOW_KEY, mailbox, [&](double latestTimestamp, Mailbox<int>::Entry & outEntry)
+    {
+      std::lock_guard<std::mutex> guard(sourceMutex);
+      if (sourceTimestamp <= latestTimestamp)
+      {
+        return false;
+      }
+      outEntry.Timestamp = sourceTimestamp;
+      return true;
+    });
+
+    std::vector<double> ages;
+    auto next = std::chrono::steady_clock::now();
+    const auto framePeriod = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / CONSUMER_RATE_HZ));
+    while (ages.size() < CONSUMER_READS)
+    {
+      next += framePeriod;
+      std::this_thread::sleep_until(next);
+      Mailbox<int>::Entry entry;
+      if (mailbox->TryTake(entry))
+      {
+        ages.push_back(Now() - entry.Timestamp);
+      }
+    }
+    stop = true;
+    source.join();
+
+    std::sort(ages.begin(), ages.end());
+    CHECK(ages[ages.size() / 2] < MAX_MEDIAN_AGE_SEC);
+  }
+
+  return PortableTests::Finish("SubscriptionHubTest");
+}
\ No newline at end of file
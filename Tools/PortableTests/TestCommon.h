@@ -0,0 +1,98 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+#pragma once
+
+// OS includes
+#if defined(_WIN32)
+  #include <direct.h>
+#else
+  #include <unistd.h>
+#endif
+
+// STL includes
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace PortableTests
+{
+  // Failed checks are counted rather than aborting, so one run reports every broken expectation
+  inline int& GetFailureCount()
+  {
+    static int failureCount(0);
+    return failureCount;
+  }
+
+  //----------------------------------------------------------------------------
+  inline bool Check(bool condition, const char* expression, const char* file, int line)
+  {
+    if (!condition)
+    {
+      std::fprintf(stderr, "%s(%d): check failed: %s\n", file, line, expression);
+      GetFailureCount()++;
+    }
+    return condition;
+  }
+
+  //----------------------------------------------------------------------------
+  inline int Finish(const char* testName)
+  {
+    if (GetFailureCount() > 0)
+    {
+      std::printf("%s: %d check(s) failed\n", testName, GetFailureCount());
+      return EXIT_FAILURE;
+    }
+    std::printf("%s: passed\n", testName);
+    return EXIT_SUCCESS;
+  }
+
+  //----------------------------------------------------------------------------
+  // Makes the system temporary directory current, so files a test writes never land in the source or build tree
+  inline bool ChangeToTempDirectory()
+  {
+#if defined(_WIN32)
+    const wchar_t* directory = _wgetenv(L"TEMP");
+    return directory != nullptr && _wchdir(directory) == 0;
+#else
+    const char* directory = std::getenv("TMPDIR");
+    return chdir(directory != nullptr && *directory != '\0' ? directory : "/tmp") == 0;
+#endif
+  }
+
+  // Wall clock seconds since construction or the last Restart
+  class Stopwatch
+  {
+  public:
+    Stopwatch() : m_start(std::chrono::steady_clock::now()) {}
+    void Restart() { m_start = std::chrono::steady_clock::now(); }
+    double GetElapsedSec() const { return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count(); }
+
+  protected:
+    std::chrono::steady_clock::time_point m_start;
+  };
+}
+
+#define CHECK(condition) PortableTests::Check((condition), #condition, __FILE__, __LINE__)
\ No newline at end of file
@@ -0,0 +1,164 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// PiecewiseLinearTransferFunction table builds for 8 and 64 control points and 256 to 4096 entries: the previous
+// implementation (every entry tests every control point), a full sweep, and the incremental update after moving one
+// control point. Incremental tables are compared against a fresh full build of the same points.
+//   TransferFunctionBenchmark [repeats, default 200]
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "PiecewiseLinearTransferFunction.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  struct Point
+  {
+    uint32    Uid;
+    float     Input;
+    float     Alpha;
+  };
+
+  //----------------------------------------------------------------------------
+  // The table build this replaced, over value sorted points. Leaves the last entry untouched as it did.
+  void PreviousUpdate(const std::vector<Point>& points, XMFLOAT4* table, uint32 size)
+  {
+    const float maximumXValue = points.back().Input;
+    for (uint32 i = 0; i < size; ++i)
+    {
+      const float xValue = (1.f * i) / (size - 1) * maximumXValue;
+      for (size_t j = 1; j < points.size(); ++j)
+      {
+        if (xValue >= points[j - 1].Input && xValue < points[j].Input)
+        {
+          const XMFLOAT4 from(0.f, 0.f, 0.f, points[j - 1].Alpha);
+          const XMFLOAT4 to(0.f, 0.f, 0.f, points[j].Alpha);
+          table[i] = from + ((xValue - points[j - 1].Input) / (points[j].Input - points[j - 1].Input)) * (to - from);
+        }
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  float MaxDifference(const XMFLOAT4* a, const XMFLOAT4* b, uint32 count)
+  {
+    float difference(0.f);
+    for (uint32 i = 0; i < count; ++i)
+    {
+      difference = std::max(difference, std::fabs(a[i].w - b[i].w));
+    }
+    return difference;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 200;
+  std::mt19937 generator(3);
+
+  printf("%6s %6s %14s %14s %14s %12s %14s\n", "points", "size", "previous us", "sweep us", "move us", "sweep diff", "move vs full");
+  for (uint32 pointCount : { 8u, 64u })
+  {
+    for (uint32 size : { 256u, 512u, 1024u, 2048u, 4096u })
+    {
+      // Added out of input order so the value sort is exercised
+      PiecewiseLinearTransferFunction function;
+      std::vector<Point> points;
+      points.push_back({ 0, 0.f, 0.f });
+      std::vector<float> inputs;
+      for (uint32 i = 1; i < pointCount; ++i)
+      {
+        inputs.push_back(i * 255.f / (pointCount - 1));
+      }
+      std::shuffle(inputs.begin(), inputs.end(), generator);
+      for (float input : inputs)
+      {
+        const float alpha = (generator() % 1000) / 1000.f;
+        points.push_back({ function.AddControlPoint(input, alpha), input, alpha });
+      }
+      auto byInput = [](const Point & left, const Point & right) { return left.Input < right.Input; };
+      std::sort(points.begin(), points.end(), byInput);
+
+      std::vector<XMFLOAT4> previous(size, XMFLOAT4(0.f, 0.f, 0.f, 0.f));
+      PortableTests::Stopwatch stopwatch;
+      for (int r = 0; r < repeats; ++r)
+      {
+        PreviousUpdate(points, previous.data(), size);
+      }
+      const double previousUsec = stopwatch.GetElapsedSec() * 1e6 / repeats;
+
+      stopwatch.Restart();
+      for (int r = 0; r < repeats; ++r)
+      {
+        function.SetLookupTableSize(size);
+        function.Update();
+      }
+      const double sweepUsec = stopwatch.GetElapsedSec() * 1e6 / repeats;
+      const float sweepDifference = MaxDifference(previous.data(), function.GetTFLookupTable().GetLookupTableArray(), size - 1);
+
+      // Drag interior points between their neighbours, as editing a control point does
+      double moveSec(0.0);
+      for (int r = 0; r < repeats; ++r)
+      {
+        const size_t index = 1 + generator() % (points.size() - 2);
+        const float low = points[index - 1].Input;
+        const float high = points[index + 1].Input;
+        points[index].Input = low + (high - low) * ((generator() % 998) + 1) / 1000.f;
+        points[index].Alpha = (generator() % 1000) / 1000.f;
+
+        stopwatch.Restart();
+        function.MoveControlPoint(points[index].Uid, points[index].Input, points[index].Alpha);
+        function.Update();
+        moveSec += stopwatch.GetElapsedSec();
+      }
+
+      PiecewiseLinearTransferFunction fresh;
+      for (size_t i = 1; i < points.size(); ++i)
+      {
+        fresh.AddControlPoint(points[i].Input, points[i].Alpha);
+      }
+      fresh.SetLookupTableSize(size);
+      fresh.Update();
+      const float moveDifference = MaxDifference(fresh.GetTFLookupTable().GetLookupTableArray(), function.GetTFLookupTable().GetLookupTableArray(), size);
+
+      printf("%6u %6u %14.2f %14.2f %14.2f %12.2g %14.2g\n", pointCount, size, previousUsec, sweepUsec, moveSec * 1e6 / repeats, sweepDifference, moveDifference);
+    }
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,219 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Per-frame tool pose queries through TransformGraph against a string keyed repository that searches its path on every
+// query, as the UWPOpenIGTLink TransformRepository does. Every tool's Tool->Reference link changes each frame and each
+// tool asks for Model->HMD, like Tool::Update.
+//   TransformGraphBenchmark [frames, default 1000]
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "TransformGraph.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  typedef TransformGraph::Matrix Matrix;
+
+  // Links keyed by frame name pair, breadth first search with string compares and matrix products on every query
+  class StringKeyedRepository
+  {
+  public:
+    void SetTransform(const std::wstring& from, const std::wstring& to, const Matrix& fromToTo)
+    {
+      m_transforms[std::make_pair(from, to)] = fromToTo;
+    }
+
+    bool GetTransform(const std::wstring& from, const std::wstring& to, Matrix& outMatrix) const
+    {
+      std::map<std::wstring, Matrix> reached;
+      std::deque<std::wstring> queue;
+      reached[from] = TransformGraph::Identity();
+      queue.push_back(from);
+      while (!queue.empty())
+      {
+        std::wstring current = queue.front();
+        queue.pop_front();
+        if (current == to)
+        {
+          outMatrix = reached[current];
+          return true;
+        }
+
+        const Matrix currentMatrix = reached[current];
+        for (auto& entry : m_transforms)
+        {
+          if (entry.first.first == current && reached.find(entry.first.second) == reached.end())
+          {
+            reached[entry.first.second] = TransformGraph::Multiply(entry.second, currentMatrix);
+            queue.push_back(entry.first.second);
+          }
+          else if (entry.first.second == current && reached.find(entry.first.first) == reached.end())
+          {
+            Matrix inverse;
+            TransformGraph::Invert(entry.second, inverse);
+            reached[entry.first.first] = TransformGraph::Multiply(inverse, currentMatrix);
+            queue.push_back(entry.first.first);
+          }
+        }
+      }
+      return false;
+    }
+
+  protected:
+    std::map<std::pair<std::wstring, std::wstring>, Matrix> m_transforms;
+  };
+
+  //----------------------------------------------------------------------------
+  Matrix RandomPose(std::mt19937& generator)
+  {
+    std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+    const float a = distribution(generator) * 3.f;
+    Matrix pose = { std::cos(a), -std::sin(a), 0.f, distribution(generator) * 100.f,
+                    std::sin(a), std::cos(a), 0.f, distribution(generator) * 100.f,
+                    0.f, 0.f, 1.f, distribution(generator) * 100.f,
+                    0.f, 0.f, 0.f, 1.f
+                  };
+    return pose;
+  }
+
+  //----------------------------------------------------------------------------
+  float MaxDifference(const Matrix& a, const Matrix& b)
+  {
+    float difference(0.f);
+    for (size_t i = 0; i < 16; ++i)
+    {
+      difference = std::max(difference, std::fabs(a[i] - b[i]));
+    }
+    return difference;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const int frames = argc > 1 ? std::max(1, atoi(argv[1])) : 1000;
+
+  printf("%6s %16s %16s %18s %10s\n", "tools", "string us/query", "graph us/query", "graph unchanged us", "max diff");
+  for (int toolCount : { 1, 4, 10, 50 })
+  {
+    std::mt19937 generator(7);
+    TransformGraph graph;
+    StringKeyedRepository repository;
+
+    std::vector<std::wstring> toolNames;
+    std::vector<std::wstring> modelNames;
+    std::vector<TransformGraph::FrameId> tools;
+    std::vector<TransformGraph::ChainId> chains;
+    const auto reference = graph.InternFrame(L"Reference");
+    const auto hmd = graph.InternFrame(L"HMD");
+    Matrix hmdToReference = RandomPose(generator);
+    graph.SetTransform(hmd, reference, hmdToReference);
+    repository.SetTransform(L"HMD", L"Reference", hmdToReference);
+
+    for (int i = 0; i < toolCount; ++i)
+    {
+      toolNames.push_back(L"Tool" + std::to_wstring(i));
+      modelNames.push_back(L"Tool" + std::to_wstring(i) + L"Model");
+      tools.push_back(graph.InternFrame(toolNames.back()));
+      auto model = graph.InternFrame(modelNames.back());
+
+      Matrix modelToTool = RandomPose(generator);
+      graph.SetTransform(model, tools.back(), modelToTool);
+      repository.SetTransform(modelNames.back(), toolNames.back(), modelToTool);
+      graph.SetTransform(tools.back(), reference, TransformGraph::Identity());
+      repository.SetTransform(toolNames.back(), L"Reference", TransformGraph::Identity());
+      chains.push_back(graph.CompileChain(model, hmd));
+    }
+
+    std::vector<Matrix> poses(frames % 64 + 64);
+    for (auto& pose : poses)
+    {
+      pose = RandomPose(generator);
+    }
+
+    Matrix result;
+    bool valid(false);
+    PortableTests::Stopwatch stopwatch;
+    for (int frame = 0; frame < frames; ++frame)
+    {
+      for (int i = 0; i < toolCount; ++i)
+      {
+        repository.SetTransform(toolNames[i], L"Reference", poses[(frame + i) % poses.size()]);
+        repository.GetTransform(modelNames[i], L"HMD", result);
+      }
+    }
+    const double stringSec = stopwatch.GetElapsedSec();
+
+    stopwatch.Restart();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+      for (int i = 0; i < toolCount; ++i)
+      {
+        graph.SetTransform(tools[i], reference, poses[(frame + i) % poses.size()]);
+        graph.GetTransform(chains[i], result, valid);
+      }
+    }
+    const double graphSec = stopwatch.GetElapsedSec();
+
+    // Frames where no tool moved, every query is a cache hit
+    stopwatch.Restart();
+    for (int frame = 0; frame < frames; ++frame)
+    {
+      for (int i = 0; i < toolCount; ++i)
+      {
+        graph.GetTransform(chains[i], result, valid);
+      }
+    }
+    const double unchangedSec = stopwatch.GetElapsedSec();
+
+    float difference(0.f);
+    for (int i = 0; i < toolCount; ++i)
+    {
+      Matrix expected;
+      repository.GetTransform(modelNames[i], L"HMD", expected);
+      graph.GetTransform(chains[i], result, valid);
+      difference = std::max(difference, MaxDifference(expected, result));
+    }
+
+    const double queries = static_cast<double>(frames) * toolCount;
+    printf("%6d %16.3f %16.3f %18.3f %10.1e\n", toolCount, stringSec / queries * 1e6, graphSec / queries * 1e6, unchangedSec / queries * 1e6, difference);
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,182 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Checks TransformGraph chains against explicit matrix products, including inverse links, invalid links, removal and
+// re-parenting a model to another object frame as Tool::SetCoordinateFrame does, and tool chains that run through the
+// coordinate definitions ToolSystem seeds from the configuration
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "TransformGraph.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  typedef TransformGraph::Matrix Matrix;
+
+  //----------------------------------------------------------------------------
+  Matrix RandomPose(std::mt19937& generator)
+  {
+    std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+    const float a = distribution(generator) * 3.f;
+    const float b = distribution(generator) * 3.f;
+    Matrix rotateZ = { std::cos(a), -std::sin(a), 0.f, distribution(generator) * 100.f,
+                       std::sin(a), std::cos(a), 0.f, distribution(generator) * 100.f,
+                       0.f, 0.f, 1.f, distribution(generator) * 100.f,
+                       0.f, 0.f, 0.f, 1.f
+                     };
+    Matrix rotateX = { 1.f, 0.f, 0.f, 0.f,
+                       0.f, std::cos(b), -std::sin(b), 0.f,
+                       0.f, std::sin(b), std::cos(b), 0.f,
+                       0.f, 0.f, 0.f, 1.f
+                     };
+    return TransformGraph::Multiply(rotateZ, rotateX);
+  }
+
+  //----------------------------------------------------------------------------
+  bool Near(const Matrix& a, const Matrix& b, float tolerance = 1e-3f)
+  {
+    for (size_t i = 0; i < 16; ++i)
+    {
+      if (std::fabs(a[i] - b[i]) > tolerance)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  std::mt19937 generator(3);
+  TransformGraph graph;
+  auto model = graph.InternFrame(L"Model");
+  auto tip = graph.InternFrame(L"Tip");
+  auto stylus = graph.InternFrame(L"Stylus");
+  auto reference = graph.InternFrame(L"Reference");
+  auto hmd = graph.InternFrame(L"HMD");
+  CHECK(graph.InternFrame(L"Tip") == tip);
+
+  Matrix modelToTip = RandomPose(generator);
+  Matrix tipToReference = RandomPose(generator);
+  Matrix stylusToReference = RandomPose(generator);
+  Matrix hmdToReference = RandomPose(generator);
+  Matrix referenceToHMD;
+  CHECK(TransformGraph::Invert(hmdToReference, referenceToHMD));
+
+  // HMD->Reference is stored, so the chain walks it backwards
+  CHECK(graph.SetTransform(model, tip, modelToTip));
+  CHECK(graph.SetTransform(tip, reference, tipToReference));
+  CHECK(graph.SetTransform(stylus, reference, stylusToReference));
+  CHECK(graph.SetTransform(hmd, reference, hmdToReference));
+
+  auto chain = graph.CompileChain(model, hmd);
+  Matrix result;
+  bool valid(false);
+  CHECK(graph.GetTransform(chain, result, valid) && valid);
+  CHECK(Near(result, TransformGraph::Multiply(referenceToHMD, TransformGraph::Multiply(tipToReference, modelToTip))));
+
+  // Cached until a link on the path changes
+  auto stats = graph.GetStats();
+  CHECK(graph.GetTransform(chain, result, valid));
+  CHECK(graph.GetStats().CacheHits == stats.CacheHits + 1);
+  tipToReference = RandomPose(generator);
+  CHECK(graph.SetTransform(tip, reference, tipToReference));
+  CHECK(graph.GetTransform(chain, result, valid) && valid);
+  CHECK(Near(result, TransformGraph::Multiply(referenceToHMD, TransformGraph::Multiply(tipToReference, modelToTip))));
+
+  CHECK(graph.SetTransformValid(tip, reference, false));
+  CHECK(graph.GetTransform(chain, result, valid) && !valid);
+  CHECK(graph.SetTransformValid(tip, reference, true));
+
+  // Re-parent the model from Tip to Stylus: without removing the old link the model would stay attached to Tip
+  CHECK(graph.RemoveTransform(tip, model));
+  CHECK(!graph.RemoveTransform(model, tip));
+  CHECK(!graph.GetTransform(chain, result, valid));
+  CHECK(graph.SetTransform(model, stylus, modelToTip));
+  CHECK(graph.GetTransform(chain, result, valid) && valid);
+  CHECK(Near(result, TransformGraph::Multiply(referenceToHMD, TransformGraph::Multiply(stylusToReference, modelToTip))));
+
+  // The removed link's slot is reused, and a stale chain never reads it
+  auto tipChain = graph.CompileChain(tip, hmd);
+  CHECK(graph.GetTransform(tipChain, result, valid) && valid);
+  CHECK(graph.RemoveTransform(tip, reference));
+  CHECK(!graph.GetTransform(tipChain, result, valid));
+  auto lone = graph.InternFrame(L"Lone");
+  CHECK(graph.SetTransform(lone, hmd, RandomPose(generator)));
+  CHECK(!graph.GetTransform(tipChain, result, valid));
+  CHECK(graph.GetTransform(chain, result, valid) && valid);
+  CHECK(Near(result, TransformGraph::Multiply(referenceToHMD, TransformGraph::Multiply(stylusToReference, modelToTip))));
+
+  // Round trip through the inverse path
+  Matrix back;
+  CHECK(graph.GetTransform(hmd, model, back, valid));
+  CHECK(Near(TransformGraph::Multiply(back, result), TransformGraph::Identity()));
+
+  // Coordinate definitions seeded by name before any tool exists, as ToolSystem::SeedTransformGraph does
+  {
+    TransformGraph seeded;
+    auto seededReference = seeded.InternFrame(L"Reference");
+    auto seededHMD = seeded.InternFrame(L"HoloLens");
+    const Matrix tipToStylus = RandomPose(generator);
+    const Matrix needleToStylus = RandomPose(generator);
+    CHECK(seeded.SetTransform(L"StylusTip", L"Stylus", tipToStylus));
+    CHECK(seeded.SetTransform(L"Needle", L"Stylus", needleToStylus));
+    CHECK(!seeded.SetTransform(L"Stylus", L"Stylus", tipToStylus));
+    CHECK(seeded.GetFrameCount() == 5);
+
+    // A tool on StylusTip whose tracked link is Stylus to Reference
+    TransformGraph::FrameId seededStylus(TransformGraph::INVALID_FRAME);
+    CHECK(seeded.FindFrame(L"Stylus", seededStylus));
+    auto seededModel = seeded.InternFrame(L"StylusTipModel");
+    const Matrix tipModelToTip = RandomPose(generator);
+    const Matrix seededStylusToReference = RandomPose(generator);
+    const Matrix seededReferenceToHMD = RandomPose(generator);
+    CHECK(seeded.SetTransform(seededModel, seeded.InternFrame(L"StylusTip"), tipModelToTip));
+    CHECK(seeded.SetTransform(seededStylus, seededReference, seededStylusToReference));
+    CHECK(seeded.SetTransform(seededReference, seededHMD, seededReferenceToHMD));
+    auto seededChain = seeded.CompileChain(seededModel, seededHMD);
+    CHECK(seeded.GetTransform(seededChain, result, valid) && valid);
+    CHECK(Near(result, TransformGraph::Multiply(seededReferenceToHMD, TransformGraph::Multiply(seededStylusToReference, TransformGraph::Multiply(tipToStylus, tipModelToTip)))));
+
+    // The needle definition is reachable from the tool's frames without a link of its own
+    CHECK(seeded.GetTransform(seeded.InternFrame(L"Needle"), seeded.InternFrame(L"StylusTip"), result, valid) && valid);
+    Matrix stylusToTip;
+    CHECK(TransformGraph::Invert(tipToStylus, stylusToTip));
+    CHECK(Near(result, TransformGraph::Multiply(stylusToTip, needleToStylus)));
+  }
+
+  return PortableTests::Finish("TransformGraphTest");
+}
\ No newline at end of file
@@ -0,0 +1,115 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Checks TransformHistory lookups: exact samples, interpolation, clamping, dropouts and a source clock that restarts
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "TransformHistory.h"
+
+// STL includes
+#include <cmath>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  typedef TransformHistory::Matrix Matrix;
+
+  //----------------------------------------------------------------------------
+  // Rotation of angle about z, translated along x
+  Matrix Pose(double angle, float x)
+  {
+    const float c = static_cast<float>(std::cos(angle));
+    const float s = static_cast<float>(std::sin(angle));
+    Matrix pose = { c, -s, 0.f, x,
+                    s, c, 0.f, 0.f,
+                    0.f, 0.f, 1.f, 0.f,
+                    0.f, 0.f, 0.f, 1.f
+                  };
+    return pose;
+  }
+
+  //----------------------------------------------------------------------------
+  bool Near(const Matrix& a, const Matrix& b)
+  {
+    for (size_t i = 0; i < 16; ++i)
+    {
+      if (std::fabs(a[i] - b[i]) > 1e-4f)
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  TransformHistory history(16);
+  for (int i = 0; i < 10; ++i)
+  {
+    CHECK(history.Add(i * 0.01, Pose(i * 0.1, i * 1.f)));
+  }
+
+  Matrix result;
+  bool valid(false);
+  CHECK(history.GetTransform(0.05, result, valid) && valid && Near(result, Pose(0.5, 5.f)));
+  CHECK(history.GetTransform(0.055, result, valid) && Near(result, Pose(0.55, 5.5f)));
+  CHECK(history.GetTransform(0.092, result, valid) && Near(result, Pose(0.9, 9.f)));
+  CHECK(!history.GetTransform(-0.1, result, valid));
+  CHECK(!history.GetTransform(0.2, result, valid));
+
+  // Samples too far apart are a dropout
+  CHECK(history.Add(1.0, Pose(0.0, 0.f)));
+  CHECK(!history.GetTransform(0.5, result, valid));
+
+  // The source restarted its clock: nothing from the old timeline may be interpolated against the new one
+  CHECK(history.Add(0.02, Pose(2.0, 20.f)));
+  CHECK(history.GetStats().Resets == 1);
+  CHECK(history.GetSize() == 1);
+  CHECK(!history.GetTransform(0.015, result, valid));
+  CHECK(history.Add(0.03, Pose(3.0, 30.f)));
+  CHECK(history.GetTransform(0.025, result, valid) && Near(result, Pose(2.5, 25.f)));
+
+  // A repeated timestamp replaces the newest sample
+  CHECK(history.Add(0.03, Pose(3.0, 31.f), false));
+  CHECK(history.GetSize() == 2);
+  CHECK(history.GetTransform(0.03, result, valid) && !valid && Near(result, Pose(3.0, 31.f)));
+
+  // Wrapping the ring keeps the newest capacity samples
+  for (int i = 0; i < 40; ++i)
+  {
+    history.Add(0.04 + i * 0.01, Pose(0.0, i * 1.f));
+  }
+  double oldest(0.0), newest(0.0);
+  CHECK(history.GetSize() == history.GetCapacity());
+  CHECK(history.GetTimeRange(oldest, newest) && std::fabs(oldest - (0.04 + 24 * 0.01)) < 1e-9 && std::fabs(newest - (0.04 + 39 * 0.01)) < 1e-9);
+
+  return PortableTests::Finish("TransformHistoryTest");
+}
\ No newline at end of file
@@ -0,0 +1,162 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Brick based partial volume upload through VolumeBrickUploader into a null backend that mirrors every uploaded box into
+// a CPU copy, against copying the whole volume as Volume::UpdateGPUImageData did for every changed frame.
+// Each volume size runs three frame types: unchanged, a tool sized local change and a complete change under an upload budget.
+//   VolumeBricksBenchmark [repeats, default 10]
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "VolumeBricks.h"
+
+// STL includes
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  const uint64_t UPLOAD_BUDGET_BYTES = 8ull << 20;
+
+  //----------------------------------------------------------------------------
+  // Flip every voxel in a cube of edge voxels centred at (x, y, z)
+  void ChangeRegion(std::vector<uint8_t>& image, uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel, uint32_t x, uint32_t y, uint32_t z, uint32_t edge)
+  {
+    for (uint32_t k = z - edge / 2; k < std::min(z + edge / 2, depth); ++k)
+    {
+      for (uint32_t j = y - edge / 2; j < std::min(y + edge / 2, height); ++j)
+      {
+        uint8_t* row = image.data() + ((static_cast<size_t>(k) * height + j) * width + x - edge / 2) * bytesPerVoxel;
+        for (uint32_t i = 0; i < std::min(edge, width - (x - edge / 2)) * bytesPerVoxel; ++i)
+        {
+          row[i] ^= 0x5a;
+        }
+      }
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 10;
+
+  struct Case
+  {
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t Depth;
+    uint32_t BytesPerVoxel;
+  };
+  const Case cases[] = { { 128, 128, 128, 1 }, { 256, 256, 256, 1 }, { 256, 256, 256, 2 }, { 512, 512, 256, 1 } };
+
+  printf("%-16s %9s | %9s | %9s %9s | %9s %9s %9s | %9s %6s %6s\n", "volume", "MB", "copy ms",
+         "same ms", "same MB", "local ms", "local MB", "bricks", "change ms", "frames", "match");
+  for (const Case& c : cases)
+  {
+    const size_t bytes = static_cast<size_t>(c.Width) * c.Height * c.Depth * c.BytesPerVoxel;
+    std::vector<uint8_t> image(bytes);
+    std::mt19937 generator(3);
+    for (auto& voxel : image)
+    {
+      voxel = static_cast<uint8_t>(generator());
+    }
+
+    std::vector<uint8_t> gpu(image);
+    std::vector<uint8_t> staging(bytes);
+    NullBrickUploadTarget target(&gpu, c.BytesPerVoxel);
+    VolumeBrickUploader uploader;
+    uploader.Reset(c.Width, c.Height, c.Depth, c.BytesPerVoxel, image.data());
+
+    // Whole volume copied row by row into staging, as every changed frame did before bricking
+    PortableTests::Stopwatch stopwatch;
+    const size_t rowBytes = static_cast<size_t>(c.Width) * c.BytesPerVoxel;
+    for (int r = 0; r < repeats; ++r)
+    {
+      for (size_t row = 0; row < static_cast<size_t>(c.Height) * c.Depth; ++row)
+      {
+        memcpy(staging.data() + row * rowBytes, image.data() + row * rowBytes, rowBytes);
+      }
+    }
+    const double fullCopyMsec = stopwatch.GetElapsedSec() * 1000.0 / repeats;
+
+    // Unchanged frame, hashing finds nothing to upload
+    uint64_t uploadedBefore = target.GetUploadedBytes();
+    stopwatch.Restart();
+    for (int r = 0; r < repeats; ++r)
+    {
+      uploader.MarkChanged(image.data());
+      uploader.Upload(target, image.data(), UPLOAD_BUDGET_BYTES);
+    }
+    const double unchangedMsec = stopwatch.GetElapsedSec() * 1000.0 / repeats;
+    const double unchangedMB = (target.GetUploadedBytes() - uploadedBefore) / 1e6 / repeats;
+
+    // A tool sized region moving through the volume
+    uploadedBefore = target.GetUploadedBytes();
+    uint64_t bricks(0);
+    double localSec(0.0);
+    for (int r = 0; r < repeats; ++r)
+    {
+      ChangeRegion(image, c.Width, c.Height, c.Depth, c.BytesPerVoxel, c.Width / 4 + r * 4, c.Height / 2, c.Depth / 2, 24);
+      stopwatch.Restart();
+      uploader.MarkChanged(image.data());
+      bricks += uploader.Upload(target, image.data(), UPLOAD_BUDGET_BYTES);
+      localSec += stopwatch.GetElapsedSec();
+    }
+    const double localMsec = localSec * 1000.0 / repeats;
+    const double localMB = (target.GetUploadedBytes() - uploadedBefore) / 1e6 / repeats;
+
+    // Every voxel changes, the budget spreads the upload over several frames
+    for (auto& voxel : image)
+    {
+      voxel = static_cast<uint8_t>(generator());
+    }
+    int frames(0);
+    stopwatch.Restart();
+    uploader.MarkChanged(image.data());
+    while (uploader.HasDirtyBricks())
+    {
+      uploader.Upload(target, image.data(), UPLOAD_BUDGET_BYTES);
+      frames++;
+    }
+    const double changedMsec = stopwatch.GetElapsedSec() * 1000.0;
+
+    char name[32];
+    snprintf(name, sizeof(name), "%ux%ux%u %ub", c.Width, c.Height, c.Depth, c.BytesPerVoxel * 8);
+    printf("%-16s %9.1f | %9.2f | %9.2f %9.2f | %9.2f %9.2f %9.1f | %9.2f %6d %6s\n", name, bytes / 1e6, fullCopyMsec,
+           unchangedMsec, unchangedMB, localMsec, localMB, static_cast<double>(bricks) / repeats, changedMsec, frames, gpu == image ? "yes" : "NO");
+  }
+  printf("copy: whole volume row copy per frame. same: unchanged frame. local: 24 voxel region changed per frame.\n"
+         "change: all voxels changed, uploaded under a %llu MB per frame budget, total time over all frames\n", static_cast<unsigned long long>(UPLOAD_BUDGET_BYTES >> 20));
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
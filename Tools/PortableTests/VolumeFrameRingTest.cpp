@@ -0,0 +1,194 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Streams 20 Hz volume frames through VolumeFrameRing into NullVolumeFrameTarget at a 60 Hz display rate, then checks
+// that live playback never draws a frame before it is due or out of order, that loop playback replays the resident frames
+// without uploading, that the memory budget limits the slots and that a source restarting its clock refills the ring
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "VolumeFrameRing.h"
+
+// STL includes
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  const uint32_t  FRAME_BYTES = 2 * 2 * 2;
+  const double    FRAME_INTERVAL_SEC = 0.05;
+  const double    DISPLAY_INTERVAL_SEC = 1.0 / 60.0;
+  const double    PLAYOUT_DELAY_SEC = 0.15;
+
+  //----------------------------------------------------------------------------
+  // A 2x2x2 frame holding its index, so a slot's contents say which frame it holds
+  std::shared_ptr<uint8_t> MakeFrame(uint32_t index)
+  {
+    std::shared_ptr<uint8_t> image(new uint8_t[FRAME_BYTES], std::default_delete<uint8_t[]>());
+    memcpy(image.get(), &index, sizeof(index));
+    memcpy(image.get() + sizeof(index), &index, sizeof(index));
+    return image;
+  }
+
+  //----------------------------------------------------------------------------
+  uint32_t GetFrameIndex(const std::vector<uint8_t>& slot)
+  {
+    uint32_t index(0);
+    memcpy(&index, slot.data(), sizeof(index));
+    return index;
+  }
+
+  struct Stream
+  {
+    uint32_t  NextFrame = 0;
+    uint32_t  Tick = 0;
+    double    ClockOrigin = 0.0;   // Source timestamps are frame times minus this
+  };
+
+  struct PlaybackResult
+  {
+    int       Drawn = 0;
+    int       Regressions = 0;     // A frame older than the previous one was drawn
+    int       Early = 0;           // A frame was drawn before its timestamp once the timeline had begun
+    std::set<uint32_t> Seen;
+  };
+
+  //----------------------------------------------------------------------------
+  PlaybackResult Play(VolumeFrameRing& ring, NullVolumeFrameTarget& target, Stream& stream, uint32_t ticks)
+  {
+    PlaybackResult result;
+    double lastShown = -1.0;
+    for (uint32_t end = stream.Tick + ticks; stream.Tick < end; ++stream.Tick)
+    {
+      const double now = stream.Tick * DISPLAY_INTERVAL_SEC;
+      while (stream.NextFrame * FRAME_INTERVAL_SEC <= now)
+      {
+        CHECK(ring.AddFrame(stream.NextFrame * FRAME_INTERVAL_SEC - stream.ClockOrigin, MakeFrame(stream.NextFrame)));
+        stream.NextFrame++;
+      }
+
+      const double displayTime = now - stream.ClockOrigin - PLAYOUT_DELAY_SEC;
+      ring.Upload(target, displayTime, 1);
+      const int32_t slot = ring.SelectFrame(displayTime);
+      if (slot < 0)
+      {
+        continue;
+      }
+      const uint32_t frame = GetFrameIndex(target.GetSlot(slot));
+      const double shown = frame * FRAME_INTERVAL_SEC - stream.ClockOrigin;
+      result.Drawn++;
+      result.Seen.insert(frame);
+      if (ring.GetPlaybackMode() == VolumeFrameRing::Playback_Live)
+      {
+        result.Regressions += shown < lastShown ? 1 : 0;
+        // Until the first frame of a timeline is due, the ring holds it rather than drawing nothing
+        result.Early += displayTime >= 0.0 && shown > displayTime + 1e-9 ? 1 : 0;
+      }
+      lastShown = shown;
+    }
+    return result;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  // The budget fits 6 of the 16 frames asked for
+  NullVolumeFrameTarget target(true);
+  VolumeFrameRing ring;
+  CHECK(ring.Reset(target, 2, 2, 2, 1, 16, FRAME_BYTES * 6) == 6);
+  CHECK(target.GetSlotCount() == 6);
+  CHECK(ring.GetResidentBytes() == FRAME_BYTES * 6);
+
+  // Live: every frame is uploaded once, in order, and nothing is drawn early or out of order
+  Stream stream;
+  PlaybackResult result = Play(ring, target, stream, 600);
+  VolumeFrameRing::Stats stats = ring.GetStats();
+  CHECK(result.Drawn > 550);
+  CHECK(result.Regressions == 0);
+  CHECK(result.Early == 0);
+  CHECK(stats.FramesDropped == 0);
+  CHECK(stats.Uploads + ring.GetWaitingCount() == stats.FramesAdded);
+  CHECK(stats.HitRate() > 0.95);
+  CHECK(target.GetUploadCount() == stats.Uploads);
+
+  // Loop: no uploads, the resident frames cycle while arrivals keep only the newest waiting
+  ring.SetPlaybackMode(VolumeFrameRing::Playback_Loop);
+  ring.ResetStats();
+  const uint64_t uploadsBefore = target.GetUploadCount();
+  result = Play(ring, target, stream, 600);
+  stats = ring.GetStats();
+  CHECK(target.GetUploadCount() == uploadsBefore);
+  CHECK(result.Seen.size() == ring.GetResidentCount());
+  CHECK(stats.Misses == 0);
+  CHECK(ring.GetWaitingCount() <= ring.GetSlotCount());
+
+  // Back to live: stale waiting frames are dropped and playback catches up
+  ring.SetPlaybackMode(VolumeFrameRing::Playback_Live);
+  ring.ResetStats();
+  Play(ring, target, stream, 60);
+  result = Play(ring, target, stream, 120);
+  CHECK(result.Regressions == 0);
+  CHECK(result.Early == 0);
+  CHECK(ring.GetStats().HitRate() > 0.9);
+
+  // The source restarts its clock: the ring discards the old timeline and plays the new one from its first frame
+  ring.ResetStats();
+  stream.ClockOrigin = stream.NextFrame * FRAME_INTERVAL_SEC;
+  result = Play(ring, target, stream, 120);
+  stats = ring.GetStats();
+  CHECK(stats.Resets == 1);
+  CHECK(result.Regressions == 0);
+  CHECK(result.Early == 0);
+  CHECK(result.Drawn > 90);
+  CHECK(*result.Seen.begin() >= static_cast<uint32_t>(std::lround(stream.ClockOrigin / FRAME_INTERVAL_SEC)));
+
+  // A repeated timestamp is refused without a reset
+  CHECK(!ring.AddFrame((stream.NextFrame - 1) * FRAME_INTERVAL_SEC - stream.ClockOrigin, MakeFrame(0)));
+  CHECK(ring.GetStats().Resets == 1);
+
+  // A single slot is the frame on screen, it is only replaced once the next frame is due
+  NullVolumeFrameTarget singleTarget(true);
+  VolumeFrameRing single;
+  CHECK(single.Reset(singleTarget, 2, 2, 2, 1, 1, 0) == 1);
+  CHECK(single.AddFrame(1.0, MakeFrame(1)));
+  single.Upload(singleTarget, 1.5, 0);
+  CHECK(single.AddFrame(2.0, MakeFrame(2)));
+  single.Upload(singleTarget, 1.5, 0);
+  CHECK(GetFrameIndex(singleTarget.GetSlot(single.SelectFrame(1.5))) == 1);
+  CHECK(single.GetWaitingCount() == 1);
+  single.Upload(singleTarget, 2.5, 0);
+  CHECK(GetFrameIndex(singleTarget.GetSlot(single.SelectFrame(2.5))) == 2);
+  CHECK(single.GetWaitingCount() == 0);
+
+  return PortableTests::Finish("VolumeFrameRingTest");
+}
\ No newline at end of file
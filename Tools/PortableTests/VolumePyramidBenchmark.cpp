@@ -0,0 +1,148 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// VolumePyramid build throughput for 256³ and 512³ volumes, 8 and 16 bit, on one and on every hardware thread, and the
+// incremental rebuild after one 32³ brick changes. Every level is checked against a scalar box filter.
+//   VolumePyramidBenchmark [repeats, default 3]
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "VolumePyramid.h"
+
+// STL includes
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  // Rounded mean of each 2x2x2 block, edges clamped, as the pyramid defines its levels
+  template<typename T>
+  std::vector<T> Downsample(const std::vector<T>& source, uint32_t size[3])
+  {
+    const uint32_t width = std::max(size[0] / 2, 1u);
+    const uint32_t height = std::max(size[1] / 2, 1u);
+    const uint32_t depth = std::max(size[2] / 2, 1u);
+    std::vector<T> result(static_cast<size_t>(width) * height * depth);
+    for (uint32_t z = 0; z < depth; ++z)
+    {
+      for (uint32_t y = 0; y < height; ++y)
+      {
+        for (uint32_t x = 0; x < width; ++x)
+        {
+          uint32_t sum(4);
+          for (uint32_t i = 0; i < 8; ++i)
+          {
+            const uint32_t sourceX = std::min(2 * x + (i & 1), size[0] - 1);
+            const uint32_t sourceY = std::min(2 * y + ((i >> 1) & 1), size[1] - 1);
+            const uint32_t sourceZ = std::min(2 * z + (i >> 2), size[2] - 1);
+            sum += source[(static_cast<size_t>(sourceZ) * size[1] + sourceY) * size[0] + sourceX];
+          }
+          result[(static_cast<size_t>(z) * height + y) * width + x] = static_cast<T>(sum >> 3);
+        }
+      }
+    }
+    size[0] = width;
+    size[1] = height;
+    size[2] = depth;
+    return result;
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  void Run(uint32_t edge, int repeats)
+  {
+    std::vector<T> image(static_cast<size_t>(edge) * edge * edge);
+    std::mt19937 generator(edge);
+    for (auto& voxel : image)
+    {
+      voxel = static_cast<T>(generator());
+    }
+    const double megabytes = image.size() * sizeof(T) / 1e6;
+
+    std::vector<uint32_t> threadCounts(1, 1);
+    if (std::thread::hardware_concurrency() > 1)
+    {
+      threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+    for (uint32_t threadCount : threadCounts)
+    {
+      VolumePyramid pyramid;
+      pyramid.SetThreadCount(threadCount);
+      pyramid.Reset(edge, edge, edge, sizeof(T));
+
+      double bestSec(1e9);
+      for (int r = 0; r < repeats; ++r)
+      {
+        PortableTests::Stopwatch stopwatch;
+        pyramid.BuildAll(reinterpret_cast<const uint8_t*>(image.data()));
+        bestSec = std::min(bestSec, stopwatch.GetElapsedSec());
+      }
+
+      const BrickBox brick = { edge / 4, edge / 4, edge / 4, edge / 4 + 32, edge / 4 + 32, edge / 4 + 32 };
+      const int brickRepeats = 100;
+      PortableTests::Stopwatch stopwatch;
+      for (int r = 0; r < brickRepeats; ++r)
+      {
+        pyramid.UpdateRegion(reinterpret_cast<const uint8_t*>(image.data()), brick);
+      }
+      const double brickUsec = stopwatch.GetElapsedSec() * 1e6 / brickRepeats;
+
+      bool match(true);
+      std::vector<T> expected(image);
+      uint32_t size[3] = { edge, edge, edge };
+      for (uint32_t level = 1; level < pyramid.GetLevelCount(); ++level)
+      {
+        expected = Downsample(expected, size);
+        match = match && memcmp(expected.data(), pyramid.GetLevel(level).data(), expected.size() * sizeof(T)) == 0;
+      }
+
+      printf("%4u³ %2u bit %8u %9.1f %12.0f %10.0f %8s\n", edge, static_cast<uint32_t>(sizeof(T) * 8), threadCount,
+             bestSec * 1000.0, megabytes / bestSec, brickUsec, match ? "yes" : "NO");
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 3;
+
+  printf("%-11s %8s %9s %12s %10s %8s\n", "volume", "threads", "build ms", "MB/s level 0", "32³ us", "match");
+  Run<uint8_t>(256, repeats);
+  Run<uint16_t>(256, repeats);
+  Run<uint8_t>(512, repeats);
+  Run<uint16_t>(512, repeats);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
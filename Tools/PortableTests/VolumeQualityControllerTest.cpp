@@ -0,0 +1,169 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// Drives VolumeQualityController with simulated volume pass cost curves (cost as a function of the chosen quality, with
+// noise and three frames of query latency) and checks that it holds the budget when it can, reaches its bounds when it
+// can't, recovers when the load drops and does not oscillate around a borderline level
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "VolumeQualityController.h"
+
+// STL includes
+#include <deque>
+#include <functional>
+#include <random>
+
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  typedef std::function<float(int, const VolumeQualityController::Quality&)> CostCurve;
+
+  const int QUERY_LATENCY_FRAMES = 3;
+
+  struct Result
+  {
+    int       Changes = 0;
+    uint32_t  FinalLevel = 0;
+    uint32_t  LevelCount = 0;
+    float     FinalResolutionScale = 1.f;
+    float     LateMeanCost = 0.f;           // Over the second half of the run
+  };
+
+  //----------------------------------------------------------------------------
+  Result Simulate(const CostCurve& cost, int frames, float minimumResolutionScale = 1.f)
+  {
+    VolumeQualityController controller;
+    VolumeQualityController::Settings settings;
+    settings.MinimumResolutionScale = minimumResolutionScale;
+    CHECK(controller.SetSettings(settings));
+
+    std::mt19937 generator(1);
+    std::normal_distribution<float> noise(0.f, 0.05f);
+    std::deque<float> inFlight;
+    Result result;
+    double lateSum(0.0);
+    for (int frame = 0; frame < frames; ++frame)
+    {
+      const float milliseconds = cost(frame, controller.GetQuality()) * (1.f + noise(generator));
+      if (frame >= frames / 2)
+      {
+        lateSum += milliseconds;
+      }
+
+      // Timestamp queries are read back a few frames after the pass they measured
+      inFlight.push_back(milliseconds);
+      if (inFlight.size() > QUERY_LATENCY_FRAMES)
+      {
+        if (controller.AddMeasurement(inFlight.front()))
+        {
+          result.Changes++;
+        }
+        inFlight.pop_front();
+      }
+    }
+
+    result.FinalLevel = controller.GetLevel();
+    result.LevelCount = controller.GetLevelCount();
+    result.FinalResolutionScale = controller.GetQuality().ResolutionScale;
+    result.LateMeanCost = static_cast<float>(lateSum / (frames - frames / 2));
+    return result;
+  }
+
+  //----------------------------------------------------------------------------
+  // Fixed overhead plus a part proportional to samples taken: inversely to the step, with the pixel count
+  CostCurve Linear(float sampleCost)
+  {
+    return [sampleCost](int, const VolumeQualityController::Quality & quality)
+    {
+      return 0.3f + sampleCost / quality.StepScale * quality.ResolutionScale * quality.ResolutionScale;
+    };
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  const VolumeQualityController::Settings defaults;
+  const float budget = defaults.TargetMilliseconds * defaults.DegradeThreshold;
+
+  // Light load keeps full quality
+  Result result = Simulate(Linear(2.f), 3000);
+  CHECK(result.Changes == 0);
+  CHECK(result.FinalLevel == 0);
+
+  // Twice the budget at full quality settles once, within the budget
+  result = Simulate(Linear(7.f), 3000);
+  CHECK(result.Changes >= 1 && result.Changes <= 3);
+  CHECK(result.FinalLevel > 0 && result.FinalLevel < result.LevelCount - 1);
+  CHECK(result.LateMeanCost <= budget);
+
+  // Cost growing faster than the sample count
+  result = Simulate([](int, const VolumeQualityController::Quality & quality)
+  {
+    return 0.3f + 6.f / (quality.StepScale * quality.StepScale);
+  }, 3000);
+  CHECK(result.Changes <= 3);
+  CHECK(result.LateMeanCost <= budget);
+
+  // Far over budget: the step alone reaches its bound, with resolution scaling allowed the budget is met
+  result = Simulate(Linear(30.f), 3000);
+  CHECK(result.FinalLevel == result.LevelCount - 1);
+  CHECK(result.FinalResolutionScale == 1.f);
+  CHECK(result.Changes <= static_cast<int>(result.LevelCount));
+  result = Simulate(Linear(30.f), 3000, 0.5f);
+  CHECK(result.FinalResolutionScale < 1.f);
+  CHECK(result.LateMeanCost <= budget);
+
+  // A load spike is shed and full quality comes back after it
+  result = Simulate([](int frame, const VolumeQualityController::Quality & quality)
+  {
+    return 0.3f + (frame > 1000 && frame < 2000 ? 8.f : 2.f) / quality.StepScale;
+  }, 6000);
+  CHECK(result.Changes >= 2 && result.Changes <= 8);
+  CHECK(result.FinalLevel == 0);
+
+  // One level just fits and the next better one is just over: settles instead of probing it over and over
+  result = Simulate([](int, const VolumeQualityController::Quality & quality)
+  {
+    return 0.2f + 5.3f / quality.StepScale;
+  }, 20000);
+  CHECK(result.Changes <= 5);
+  CHECK(result.LateMeanCost <= budget);
+
+  // Out of range settings are refused and leave the controller as it was
+  VolumeQualityController controller;
+  VolumeQualityController::Settings settings;
+  settings.MinimumStepScale = 2.f;
+  settings.MaximumStepScale = 1.f;
+  const uint32_t levelCount = controller.GetLevelCount();
+  CHECK(!controller.SetSettings(settings));
+  CHECK(controller.GetLevelCount() == levelCount);
+
+  return PortableTests::Finish("VolumeQualityControllerTest");
+}
\ No newline at end of file
@@ -0,0 +1,270 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+// Renders CT-like 8 bit and ultrasound-like 16 bit volumes through VolumeRayMarcher, the CPU reference for
+// VolumeRendererPS.hlsl, with macrocell skipping on and off. Images must be bit for bit identical, for the
+// pre-integrated and the opacity table paths, from several views and over random rays, while skipping takes fewer samples.
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "MacrocellGrid.h"
+#include "PreIntegrationTable.h"
+#include "VolumeRayMarcher.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace HoloIntervention::Rendering;
+
+namespace
+{
+  const uint32_t IMAGE_SIZE = 96;
+  const int RAY_COUNT = 4000;
+  const float VIEW_ANGLES[][2] = { { 0.f, 0.f }, { 0.7f, 0.3f }, { 2.2f, -0.9f } };
+
+  struct TransferFunction
+  {
+    const char*   Name;
+    float         TransparentBelow;   // Fraction of the input range
+    float         MaximumOpacity;
+  };
+
+  const TransferFunction TRANSFER_FUNCTIONS[] =
+  {
+    { "bone", 0.6f, 0.6f },
+    { "tissue", 0.2f, 0.1f }
+  };
+
+  // Air with noise around an ellipsoid of soft tissue with a dense shell, as in a CT
+  // The 16 bit variant adds a speckled fan, as in an ultrasound sweep
+  struct TestVolume
+  {
+    std::vector<uint8_t>  Data;
+    uint32_t              Dimensions[3];
+    uint32_t              BytesPerVoxel;
+    float                 MaximumValue;
+
+    TestVolume(uint32_t width, uint32_t height, uint32_t depth, uint32_t bytesPerVoxel)
+      : BytesPerVoxel(bytesPerVoxel)
+      , MaximumValue(bytesPerVoxel == 1 ? 255.f : 65535.f)
+    {
+      Dimensions[0] = width;
+      Dimensions[1] = height;
+      Dimensions[2] = depth;
+      Data.resize((size_t)width * height * depth * bytesPerVoxel);
+      std::mt19937 generator(3);
+      std::uniform_real_distribution<float> noise(0.f, 0.04f);
+      for (uint32_t k = 0; k < depth; ++k)
+      {
+        for (uint32_t j = 0; j < height; ++j)
+        {
+          for (uint32_t i = 0; i < width; ++i)
+          {
+            const float u = (i + 0.5f) / width - 0.5f;
+            const float v = (j + 0.5f) / height - 0.5f;
+            const float w = (k + 0.5f) / depth - 0.5f;
+            const float radius = std::sqrt(u * u / 0.16f + v * v / 0.09f + w * w / 0.12f);
+            float value = noise(generator);
+            if (radius < 1.f)
+            {
+              value = radius > 0.85f ? 0.9f : 0.3f + 0.1f * std::sin(20.f * u);
+            }
+            if (bytesPerVoxel == 2 && v > 0.f && std::fabs(u) < v && radius >= 1.f)
+            {
+              value += 0.15f * noise(generator) / 0.04f;
+            }
+            const float scaled = std::min(std::max(value, 0.f), 1.f) * MaximumValue;
+            const size_t index = ((size_t)k * height + j) * width + i;
+            if (bytesPerVoxel == 1)
+            {
+              Data[index] = static_cast<uint8_t>(scaled);
+            }
+            else
+            {
+              const uint16_t value16 = static_cast<uint16_t>(scaled);
+              memcpy(&Data[index * 2], &value16, sizeof(value16));
+            }
+          }
+        }
+      }
+    }
+  };
+
+  struct Setup
+  {
+    std::vector<float>    Opacities;
+    PreIntegrationTable   Table;
+    MacrocellGrid         Grid;
+    VolumeRayMarcher      Marcher;
+
+    Setup(const TestVolume& volume, const TransferFunction& transferFunction, bool preIntegrated)
+    {
+      std::vector<float> rgba(256 * 4);
+      Opacities.resize(256);
+      const int transparentBelow = static_cast<int>(transferFunction.TransparentBelow * 255.f);
+      for (int i = 0; i < 256; ++i)
+      {
+        const float alpha = i < transparentBelow ? 0.f : transferFunction.MaximumOpacity * (i - transparentBelow + 1) / (256 - transparentBelow);
+        rgba[4 * i] = rgba[4 * i + 1] = rgba[4 * i + 2] = i / 255.f;
+        rgba[4 * i + 3] = alpha;
+        Opacities[i] = alpha;
+      }
+
+      float step[3];
+      uint32_t iterations;
+      VolumeRayMarcher::ComputeStep(volume.Dimensions, 1.f, step, iterations);
+      Marcher.SetVolume(volume.Data.data(), volume.Dimensions[0], volume.Dimensions[1], volume.Dimensions[2], volume.BytesPerVoxel);
+      Marcher.SetOpacityTable(Opacities, volume.MaximumValue);
+      Marcher.SetStep(step, iterations);
+      if (preIntegrated)
+      {
+        Table.Build(rgba, 256, 1.f, 1);
+        Marcher.SetPreIntegrationTable(&Table);
+      }
+
+      Grid.Reset(volume.Dimensions[0], volume.Dimensions[1], volume.Dimensions[2], volume.BytesPerVoxel);
+      Grid.UpdateAll(volume.Data.data());
+      Grid.SetOpacityTable(Opacities, volume.MaximumValue);
+      Grid.Classify();
+      Marcher.SetMacrocellGrid(&Grid);
+    }
+  };
+
+  //----------------------------------------------------------------------------
+  // Orthographic view of the unit cube rotated by yaw about y then pitch about x, row-major with column vectors
+  VolumeRayMarcher::Camera MakeCamera(float yaw, float pitch)
+  {
+    const float cy = std::cos(yaw), sy = std::sin(yaw);
+    const float cp = std::cos(pitch), sp = std::sin(pitch);
+    const float rotation[9] = { cy, 0.f, sy,
+                                sp * sy, cp, -sp * cy,
+                                -cp * sy, sp, cp * cy
+                              };
+    const float scale = 1.1f;   // The cube's diagonal fits in clip space
+    VolumeRayMarcher::Camera camera;
+    for (int row = 0; row < 3; ++row)
+    {
+      const float rowScale = row < 2 ? scale : 0.5f * scale / 1.8f;
+      float translation(0.f);
+      for (int column = 0; column < 3; ++column)
+      {
+        camera.ModelViewProjection[row * 4 + column] = rotation[row * 3 + column] * rowScale;
+        translation -= 0.5f * rotation[row * 3 + column] * rowScale;
+      }
+      camera.ModelViewProjection[row * 4 + 3] = translation + (row == 2 ? 0.5f : 0.f);
+    }
+    camera.ModelViewProjection[12] = camera.ModelViewProjection[13] = camera.ModelViewProjection[14] = 0.f;
+    camera.ModelViewProjection[15] = 1.f;
+    camera.Width = IMAGE_SIZE;
+    camera.Height = IMAGE_SIZE;
+    return camera;
+  }
+
+  //----------------------------------------------------------------------------
+  // Entry and exit on two random faces of the unit cube
+  void RandomRay(std::mt19937& generator, float front[3], float back[3])
+  {
+    std::uniform_real_distribution<float> coordinate(0.f, 1.f);
+    std::uniform_int_distribution<int> face(0, 5);
+    float* points[2] = { front, back };
+    for (float* point : points)
+    {
+      const int f = face(generator);
+      for (int c = 0; c < 3; ++c)
+      {
+        point[c] = coordinate(generator);
+      }
+      point[f / 2] = static_cast<float>(f % 2);
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  bool Identical(const std::vector<float>& a, const std::vector<float>& b)
+  {
+    return a.size() == b.size() && memcmp(a.data(), b.data(), a.size() * sizeof(float)) == 0;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int, char**)
+{
+  const TestVolume volumes[] = { TestVolume(64, 64, 48, 1), TestVolume(48, 40, 64, 2) };
+
+  for (const TestVolume& volume : volumes)
+  {
+    for (const TransferFunction& transferFunction : TRANSFER_FUNCTIONS)
+    {
+      for (bool preIntegrated : { true, false })
+      {
+        Setup setup(volume, transferFunction, preIntegrated);
+        CHECK(setup.Grid.IsSupported());
+        CHECK(setup.Grid.GetEmptyFraction() > 0.f);
+
+        uint64_t samples(0);
+        uint64_t skippingSamples(0);
+        uint64_t rays(0);
+        for (auto& angles : VIEW_ANGLES)
+        {
+          const VolumeRayMarcher::Camera camera = MakeCamera(angles[0], angles[1]);
+          std::vector<float> image;
+          std::vector<float> skippingImage;
+          auto stats = setup.Marcher.Render(camera, false, image);
+          auto skippingStats = setup.Marcher.Render(camera, true, skippingImage);
+          CHECK(stats.Rays > IMAGE_SIZE * IMAGE_SIZE / 4);
+          CHECK(skippingStats.Rays == stats.Rays);
+          CHECK(Identical(image, skippingImage));
+          CHECK(std::any_of(image.begin(), image.end(), [](float value) { return value > 0.f; }));
+          samples += stats.Samples;
+          skippingSamples += skippingStats.Samples;
+          rays += stats.Rays;
+        }
+
+        std::mt19937 generator(11);
+        for (int r = 0; r < RAY_COUNT; ++r)
+        {
+          float front[3];
+          float back[3];
+          RandomRay(generator, front, back);
+          auto result = setup.Marcher.March(front, back, false);
+          auto skippingResult = setup.Marcher.March(front, back, true);
+          CHECK(memcmp(result.Colour, skippingResult.Colour, sizeof(result.Colour)) == 0);
+          CHECK(skippingResult.Samples <= result.Samples);
+        }
+
+        CHECK(skippingSamples < samples);
+        printf("%2u bit %-6s %-14s empty cells %4.1f%%, samples per ray %6.1f without skipping, %6.1f with\n", volume.BytesPerVoxel * 8, transferFunction.Name,
+               preIntegrated ? "pre-integrated" : "opacity table", setup.Grid.GetEmptyFraction() * 100.f, static_cast<double>(samples) / rays, static_cast<double>(skippingSamples) / rays);
+      }
+    }
+  }
+
+  return PortableTests::Finish("VolumeRayMarcherTest");
+}
\ No newline at end of file
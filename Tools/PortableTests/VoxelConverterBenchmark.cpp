@@ -0,0 +1,183 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// VoxelConverter throughput per source and destination type, windowed, over a 256³ volume, against a scalar loop
+// that rescales and windows each value on its own. Results are compared with the scalar loop.
+//   VoxelConverterBenchmark [repeats, default 10]
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "VoxelConverter.h"
+#include "WorkerPool.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  //----------------------------------------------------------------------------
+  template<typename Source>
+  float Rescale(const uint8_t* source, size_t i, const VoxelWindow& window)
+  {
+    const float modality = static_cast<float>(reinterpret_cast<const Source*>(source)[i]) * window.Slope + window.Intercept;
+    return (modality - (window.WindowCenter - 0.5f * window.WindowWidth)) / window.WindowWidth;
+  }
+
+  //----------------------------------------------------------------------------
+  // One value at a time, window then range then clamp, as a straightforward conversion on the render thread would
+  void ScalarConvert(const uint8_t* source, VoxelType sourceType, uint8_t* destination, VoxelType destinationType, size_t count, const VoxelWindow& window)
+  {
+    const float range = destinationType == VoxelType_UInt8 ? 255.f : (destinationType == VoxelType_UInt16 ? 65535.f : 1.f);
+    for (size_t i = 0; i < count; ++i)
+    {
+      float value(0.f);
+      switch (sourceType)
+      {
+      case VoxelType_UInt8:
+        value = Rescale<uint8_t>(source, i, window);
+        break;
+      case VoxelType_Int8:
+        value = Rescale<int8_t>(source, i, window);
+        break;
+      case VoxelType_UInt16:
+        value = Rescale<uint16_t>(source, i, window);
+        break;
+      case VoxelType_Int16:
+        value = Rescale<int16_t>(source, i, window);
+        break;
+      default:
+        value = Rescale<float>(source, i, window);
+        break;
+      }
+      value = std::min(std::max(value * range, 0.f), range);
+      switch (destinationType)
+      {
+      case VoxelType_UInt8:
+        destination[i] = static_cast<uint8_t>(std::lrint(value));
+        break;
+      case VoxelType_UInt16:
+        reinterpret_cast<uint16_t*>(destination)[i] = static_cast<uint16_t>(std::lrint(value));
+        break;
+      default:
+        reinterpret_cast<float*>(destination)[i] = value;
+        break;
+      }
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  // Largest difference in destination units, the two fold the arithmetic differently so integers may round apart by one
+  double MaxDifference(const uint8_t* a, const uint8_t* b, VoxelType type, size_t count)
+  {
+    double difference(0.0);
+    for (size_t i = 0; i < count; ++i)
+    {
+      switch (type)
+      {
+      case VoxelType_UInt8:
+        difference = std::max(difference, std::fabs(double(a[i]) - double(b[i])));
+        break;
+      case VoxelType_UInt16:
+        difference = std::max(difference, std::fabs(double(reinterpret_cast<const uint16_t*>(a)[i]) - double(reinterpret_cast<const uint16_t*>(b)[i])));
+        break;
+      default:
+        difference = std::max(difference, std::fabs(double(reinterpret_cast<const float*>(a)[i]) - double(reinterpret_cast<const float*>(b)[i])));
+        break;
+      }
+    }
+    return difference;
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 10;
+  const size_t count = 256 * 256 * 256;
+  const VoxelType sourceTypes[] = { VoxelType_UInt8, VoxelType_Int8, VoxelType_UInt16, VoxelType_Int16, VoxelType_Float32 };
+  const VoxelType destinationTypes[] = { VoxelType_UInt8, VoxelType_UInt16, VoxelType_Float32 };
+  const char* names[] = { "?", "u8", "s8", "u16", "s16", "f32" };
+
+  std::mt19937 generator(1);
+  std::vector<uint8_t> source(count * 4);
+  for (auto& byte : source)
+  {
+    byte = static_cast<uint8_t>(generator());
+  }
+  // Floats in the window's neighbourhood rather than random bit patterns
+  float* floats = reinterpret_cast<float*>(source.data());
+  for (size_t i = 0; i < count; ++i)
+  {
+    floats[i] = (generator() % 2000) / 1000.f - 0.5f;
+  }
+
+  std::vector<uint8_t> converted(count * 4);
+  std::vector<uint8_t> expected(count * 4);
+  printf("%d WorkerPool threads, %zu values\n", WorkerPool::instance().GetThreadCount(), count);
+  printf("%-10s %12s %12s %12s %10s %12s\n", "pair", "scalar GB/s", "convert GB/s", "convert ms", "speedup", "max diff");
+  for (VoxelType sourceType : sourceTypes)
+  {
+    for (VoxelType destinationType : destinationTypes)
+    {
+      VoxelWindow window;
+      window.Windowed = true;
+      window.Slope = 0.5f;
+      window.Intercept = -3.f;
+      window.WindowCenter = sourceType == VoxelType_Float32 ? 0.3f : 20.f;
+      window.WindowWidth = sourceType == VoxelType_Float32 ? 0.7f : 100.f;
+
+      PortableTests::Stopwatch stopwatch;
+      for (int r = 0; r < repeats; ++r)
+      {
+        ScalarConvert(source.data(), sourceType, expected.data(), destinationType, count, window);
+      }
+      const double scalarSec = stopwatch.GetElapsedSec() / repeats;
+
+      VoxelConverter::Convert(source.data(), sourceType, converted.data(), destinationType, count, window);
+      stopwatch.Restart();
+      for (int r = 0; r < repeats; ++r)
+      {
+        VoxelConverter::Convert(source.data(), sourceType, converted.data(), destinationType, count, window);
+      }
+      const double convertSec = stopwatch.GetElapsedSec() / repeats;
+
+      const double bytes = static_cast<double>(count) * (VoxelConverter::GetSize(sourceType) + VoxelConverter::GetSize(destinationType));
+      char pair[16];
+      snprintf(pair, sizeof(pair), "%s->%s", names[sourceType], names[destinationType]);
+      printf("%-10s %12.2f %12.2f %12.2f %9.1fx %12.3g\n", pair, bytes / scalarSec / 1e9, bytes / convertSec / 1e9, convertSec * 1000.0,
+             scalarSec / convertSec, MaxDifference(converted.data(), expected.data(), destinationType, count));
+    }
+  }
+  return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,213 @@
+/*====================================================================
+Copyright(c) 2018 Adam Rankin
+
+
+Permission is hereby granted, free of charge, to any person obtaining a
+copy of this software and associated documentation files(the "Software"),
+to deal in the Software without restriction, including without limitation
+the rights to use, copy, modify, merge, publish, distribute, sublicense,
+and / or sell copies of the Software, and to permit persons to whom the
+Software is furnished to do so, subject to the following conditions :
+
+The above copyright notice and this permission notice shall be included
+in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS
+OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.IN NO EVENT SHALL
+THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+OTHER DEALINGS IN THE SOFTWARE.
+====================================================================*/
+
+
+
+
+// VoxelHistogram throughput over 256³ and 512³ volumes of every stored type, with 256 and 4096 bins, built whole on one
+// and on every hardware thread and accumulated a row at a time as slices stream in. The baseline is the two pass
+// approach the histogram replaces: one pass for the range, a second that bins each value on its own. Bins, range and
+// mean are checked against that baseline, and the auto window derived from them is timed.
+//   VoxelHistogramBenchmark [repeats, default 3]
+
+// Local includes
+#include "pch.h"
+#include "TestCommon.h"
+#include "VoxelHistogram.h"
+
+// STL includes
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace HoloIntervention;
+
+namespace
+{
+  const int AUTO_WINDOW_REPEATS = 1000;
+
+  struct Baseline
+  {
+    std::vector<uint64_t>   Bins;
+    float                   Minimum = 0.f;
+    float                   Maximum = 0.f;
+    double                  Mean = 0.0;
+  };
+
+  //----------------------------------------------------------------------------
+  // 12 bit CT-like values: air around a body of soft tissue with noise, and a denser core
+  std::vector<uint16_t> MakeVolume(uint32_t edge)
+  {
+    std::vector<uint16_t> volume(static_cast<size_t>(edge) * edge * edge);
+    std::mt19937 generator(edge);
+    std::normal_distribution<float> noise(0.f, 20.f);
+    const float centre = edge / 2.f;
+    for (uint32_t z = 0; z < edge; ++z)
+    {
+      for (uint32_t y = 0; y < edge; ++y)
+      {
+        for (uint32_t x = 0; x < edge; ++x)
+        {
+          const float radius = std::sqrt((x - centre) * (x - centre) + (y - centre) * (y - centre)) / edge;
+          const float value = radius > 0.45f ? 24.f : (radius < 0.1f ? 2000.f : 1040.f);
+          volume[(static_cast<size_t>(z) * edge + y) * edge + x] = static_cast<uint16_t>(std::min(std::max(value + noise(generator), 0.f), 4095.f));
+        }
+      }
+    }
+    return volume;
+  }
+
+  //----------------------------------------------------------------------------
+  // Range in one pass, bins in a second, each value binned with the histogram's own mapping
+  template<typename T>
+  Baseline TwoPass(const std::vector<T>& values, const VoxelHistogram& histogram)
+  {
+    Baseline result;
+    result.Minimum = static_cast<float>(values[0]);
+    result.Maximum = static_cast<float>(values[0]);
+    double sum(0.0);
+    for (T value : values)
+    {
+      result.Minimum = std::min(result.Minimum, static_cast<float>(value));
+      result.Maximum = std::max(result.Maximum, static_cast<float>(value));
+      sum += static_cast<double>(value);
+    }
+    result.Mean = sum / values.size();
+
+    const uint32_t binCount = histogram.GetBinCount();
+    const float lowest = histogram.GetBinLowerBound(0);
+    const float width = histogram.GetBinWidth();
+    result.Bins.assign(binCount, 0);
+    for (T value : values)
+    {
+      const float bin = std::floor((static_cast<float>(value) - lowest) / width);
+      ++result.Bins[static_cast<uint32_t>(std::min(std::max(bin, 0.f), static_cast<float>(binCount - 1)))];
+    }
+    return result;
+  }
+
+  //----------------------------------------------------------------------------
+  template<typename T>
+  void Run(const char* typeName, VoxelType type, const std::vector<T>& values, uint32_t edge, uint32_t binCount, float floatMaximum, int repeats)
+  {
+    const double gigabytes = values.size() * sizeof(T) / 1e9;
+
+    VoxelHistogram reference;
+    reference.Reset(type, binCount, 0.f, floatMaximum);
+    double baselineSec(1e9);
+    Baseline baseline;
+    for (int r = 0; r < repeats; ++r)
+    {
+      PortableTests::Stopwatch stopwatch;
+      baseline = TwoPass(values, reference);
+      baselineSec = std::min(baselineSec, stopwatch.GetElapsedSec());
+    }
+
+    std::vector<uint32_t> threadCounts(1, 1);
+    if (std::thread::hardware_concurrency() > 1)
+    {
+      threadCounts.push_back(std::thread::hardware_concurrency());
+    }
+    for (uint32_t threadCount : threadCounts)
+    {
+      VoxelHistogram histogram;
+      histogram.SetThreadCount(threadCount);
+      histogram.Reset(type, binCount, 0.f, floatMaximum);
+
+      double buildSec(1e9);
+      for (int r = 0; r < repeats; ++r)
+      {
+        PortableTests::Stopwatch stopwatch;
+        histogram.Build(values.data(), values.size());
+        buildSec = std::min(buildSec, stopwatch.GetElapsedSec());
+      }
+      bool match = histogram.GetBins() == baseline.Bins && histogram.GetMinimum() == baseline.Minimum && histogram.GetMaximum() == baseline.Maximum &&
+                   std::abs(histogram.GetMean() - baseline.Mean) <= 1e-4 * std::max(std::abs(baseline.Mean), 1.0);
+
+      // Rows as a slice streams in, on the calling thread
+      double rowSec(1e9);
+      for (int r = 0; r < repeats; ++r)
+      {
+        PortableTests::Stopwatch stopwatch;
+        histogram.Clear();
+        for (size_t first = 0; first < values.size(); first += edge)
+        {
+          histogram.Accumulate(&values[first], edge);
+        }
+        rowSec = std::min(rowSec, stopwatch.GetElapsedSec());
+      }
+      match = match && histogram.GetBins() == baseline.Bins;
+
+      PortableTests::Stopwatch stopwatch;
+      VoxelWindow window;
+      for (int r = 0; r < AUTO_WINDOW_REPEATS; ++r)
+      {
+        window = histogram.GetAutoWindow(VoxelWindow());
+      }
+      const double windowUsec = stopwatch.GetElapsedSec() * 1e6 / AUTO_WINDOW_REPEATS;
+      match = match && window.WindowWidth > 0.f;
+
+      printf("%4u³ %-7s %5u %8u %9.1f %7.2f %9.2f %12.2f %8.2fx %9.1f %6s\n", edge, typeName, binCount, threadCount, buildSec * 1000.0, gigabytes / buildSec,
+             gigabytes / rowSec, gigabytes / baselineSec, baselineSec / buildSec, windowUsec, match ? "yes" : "NO");
+    }
+  }
+
+  //----------------------------------------------------------------------------
+  void RunVolume(uint32_t edge, int repeats)
+  {
+    const std::vector<uint16_t> volume = MakeVolume(edge);
+    Run("uint16", VoxelType_UInt16, volume, edge, 256, 1.f, repeats);
+    Run("uint16", VoxelType_UInt16, volume, edge, 4096, 1.f, repeats);
+    {
+      // Hounsfield units, as signed CT data arrives
+      std::vector<int16_t> signedVolume(volume.size());
+      std::transform(volume.begin(), volume.end(), signedVolume.begin(), [](uint16_t value) { return static_cast<int16_t>(value - 1024); });
+      Run("int16", VoxelType_Int16, signedVolume, edge, 4096, 1.f, repeats);
+    }
+    {
+      std::vector<uint8_t> byteVolume(volume.size());
+      std::transform(volume.begin(), volume.end(), byteVolume.begin(), [](uint16_t value) { return static_cast<uint8_t>(value >> 4); });
+      Run("uint8", VoxelType_UInt8, byteVolume, edge, 256, 1.f, repeats);
+    }
+    {
+      std::vector<float> floatVolume(volume.size());
+      std::transform(volume.begin(), volume.end(), floatVolume.begin(), [](uint16_t value) { return value / 4095.f; });
+      Run("float", VoxelType_Float32, floatVolume, edge, 4096, 1.f, repeats);
+    }
+  }
+}
+
+//----------------------------------------------------------------------------
+int main(int argc, char** argv)
+{
+  const int repeats = argc > 1 ? std::max(1, atoi(argv[1])) : 3;
+
+  printf("%-12s %5s %8s %9s %7s %9s %12s %9s %9s %6s\n", "volume", "bins", "threads", "build ms", "GB/s", "rows GB/s", "2 pass GB/s", "speedup", "window us", "match");
+  RunVolume(256, repeats);
+  RunVolume(512, repeats);
+  return EXIT_SUCCESS;
+}
\ No newline at end of file